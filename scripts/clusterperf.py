@@ -213,6 +213,8 @@ def run_test(
         client_args['--targetOps'] = options.targetOps
     if options.txSpan != None:
         client_args['--txSpan'] = options.txSpan
+    if options.hotObjects != None:
+        client_args['--hotObjects'] = options.hotObjects
     if options.numIndexlet != None:
         client_args['--numIndexlet'] = options.numIndexlet
     if options.numIndexes != None:
@@ -734,6 +736,9 @@ if __name__ == '__main__':
             'will try to achieve')
     parser.add_option('--txSpan', type=int,
                     help='Number servers a transaction should span.')
+    parser.add_option('--hotObjects', type=int,
+            help='Number of objects readThroughput clients read (e.g. 1 to '
+                 'measure contention on a single hot key)')
     parser.add_option('-i', '--numIndexlet', type=int,
             help='Number of indexlets for measuring index scalability ')
     parser.add_option('-k', '--numIndexes', type=int,
@@ -42,6 +42,7 @@ import sys
 # the Opcode enum in WireFormat.h.
 
 callees = {
+    "BACKUP_GETRECOVERYDATA":["BACKUP_GETFRAGMENT"],
     "COORD_SPLIT_AND_MIGRATE_INDEXLET":
                              ["SPLIT_AND_MIGRATE_INDEXLET",
                               "TAKE_TABLET_OWNERSHIP",
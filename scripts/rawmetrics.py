@@ -164,6 +164,9 @@ coordinator.metric('recoveryBuildReplicaMapTicks',
                    'time contacting backups and finding replicas for crashed '
                    'master')
 coordinator.metric('recoveryStartTicks', 'time in Recovery::start')
+coordinator.metric('recoveryFirstTabletTicks',
+    'time from the start of recovery until the first recovery master '
+    'finished its partition')
 coordinator.metric('recoveryCompleteTicks',
     'time sending recovery complete RPCs to backups')
 
@@ -181,6 +184,8 @@ master.metric('segmentReadTicks',
     'elapsed time for getRecoveryData calls to backups')
 master.metric('segmentReadStallTicks',
     'time stalled waiting for segments from backups')
+master.metric('replayDrainTicks',
+    'time waiting for queued recovery segments to finish replaying')
 master.metric('segmentReadByteCount',
     'bytes of recovery segments received from backups')
 master.metric('verifyChecksumTicks',
@@ -280,6 +285,8 @@ backup.metric('storageWriteCount', 'number of segment writes to disk')
 backup.metric('storageWriteBytes', 'bytes written to disk')
 backup.metric('storageWriteTicks', 'time writing to disk')
 backup.metric('filterTicks', 'time filtering segments')
+backup.metric('firstSegmentTicks',
+    'time from the start of filtering to the first recovery segment returned')
 backup.metric('primaryLoadCount', 'number of primary segments requested')
 backup.metric('secondaryLoadCount', 'number of secondary segments requested')
 backup.metric('storageType', '1 = in-memory, 2 = on-disk')
@@ -441,6 +441,9 @@ def makeReport(data):
 
     summary = report.add(Section('Summary'))
     summary.line('Recovery time', recoveryTime, 's')
+    summary.line('Time to first tablet',
+                 (coord.coordinator.recoveryFirstTabletTicks /
+                  coord.clockFrequency), 's')
     summary.line('Failure detection time', failureDetectionTime, 's')
     summary.line('Recovery + detection time',
                  recoveryTime + failureDetectionTime, 's')
@@ -480,6 +483,8 @@ def makeReport(data):
                 storageTypeStr = 'memory'
             elif storageType == 2:
                 storageTypeStr = 'disk'
+            elif storageType == 3:
+                storageTypeStr = 'persistent memory'
             else:
                 storageTypeStr = 'unknown (%s)' % storageType
         summary.line('Storage type', storageTypeStr)
@@ -546,6 +551,8 @@ def makeReport(data):
                  'master.segmentReadStallTicks')
     master_ticks('Inside recoverSegment',
                  'master.recoverSegmentTicks')
+    master_ticks('Waiting for queued replay',
+                 'master.replayDrainTicks')
     master_ticks('Final log sync time',
                  'master.logSyncTicks')
     master_ticks('Removing tombstones',
@@ -554,6 +561,7 @@ def makeReport(data):
                      on_masters(lambda m: (m.master.recoveryTicks -
                                            m.master.segmentReadStallTicks -
                                            m.master.recoverSegmentTicks -
+                                           m.master.replayDrainTicks -
                                            m.master.logSyncTicks -
                                            m.master.removeTombstoneTicks) /
                                           m.clockFrequency),
@@ -791,6 +799,8 @@ def makeReport(data):
                  'transport.transmit.ticks')
     backup_ticks('Filtering segments',
                  'backup.filterTicks')
+    backup_ticks('Waiting for first recovery segment',
+                 'backup.firstSegmentTicks')
     backup_ticks('Reading+filtering replicas',
                  'backup.readingDataTicks')
     backup_ticks('Reading replicas from disk',
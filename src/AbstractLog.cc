@@ -39,17 +39,26 @@ namespace RAMCloud {
  *      Segments durable.
  * \param segmentSize
  *      The size, in bytes, of segments this log will use.
+ * \param numHeads
+ *      The number of head segments this log appends to concurrently. Only
+ *      the Log subclass supports more than one.
+ * \param numColdHeads
+ *      How many of the \a numHeads heads are reserved for cold data (see
+ *      append()). Zero if the log doesn't segregate hot and cold data.
  */
 AbstractLog::AbstractLog(LogEntryHandlers* entryHandlers,
                          SegmentManager* segmentManager,
                          ReplicaManager* replicaManager,
-                         uint32_t segmentSize)
+                         uint32_t segmentSize,
+                         uint32_t numHeads,
+                         uint32_t numColdHeads)
     : entryHandlers(entryHandlers),
       segmentManager(segmentManager),
       replicaManager(replicaManager),
       segmentSize(segmentSize),
-      head(NULL),
-      appendLock("AbstractLog::appendLock"),
+      numHeads(numHeads),
+      numColdHeads(numColdHeads),
+      heads(new Head[numHeads]),
       totalLiveBytes(0),
       maxLiveBytes(0),
       metrics()
@@ -74,43 +83,49 @@ AbstractLog::AbstractLog(LogEntryHandlers* entryHandlers,
  *      are also returned here.
  * \param numAppends
  *      Number of entries in the appends array.
+ * \param cold
+ *      True if the entries are expected to live long. If the log keeps
+ *      separate heads for cold data, they are appended to one of those, so
+ *      that they don't share segments with data that will soon be dead.
  * \return
  *      True if the append succeeded, false if there was insufficient space
  *      to complete the operation.
  */
 bool
-AbstractLog::append(AppendVector* appends, uint32_t numAppends)
+AbstractLog::append(AppendVector* appends, uint32_t numAppends, bool cold)
 {
     CycleCounter<uint64_t> _(&metrics.totalAppendTicks);
-    SpinLock::Guard lock(appendLock);
+    Tub<SpinLock::Guard> lock;
+    Head& head = lockHead(lock, cold);
     metrics.totalAppendCalls++;
 
     uint32_t lengths[numAppends];
     for (uint32_t i = 0; i < numAppends; i++)
         lengths[i] = appends[i].buffer.size();
 
-    if (head == NULL || !head->hasSpaceFor(lengths, numAppends)) {
-        if (!allocNewWritableHead())
-            return false;
-    }
-
-    if (head->isEmergencyHead)
+    if (!makeRoom(lock, head, lengths, numAppends))
         return false;
 
-    if (!head->hasSpaceFor(lengths, numAppends))
+    if (!head.segment->hasSpaceFor(lengths, numAppends))
         throw FatalError(HERE, "too much data to append to one segment");
 
-    LogSegment* headBefore = head;
+    LogSegment* headBefore = head.segment;
+    uint32_t lengthBefore = head.segment->getAppendedLength();
     for (uint32_t i = 0; i < numAppends; i++) {
-        bool enoughSpace = append(lock,
+        bool enoughSpace = append(*lock,
+                                  head,
                                   appends[i].type,
                                   appends[i].buffer,
                                   &appends[i].reference);
         if (!enoughSpace)
             throw FatalError(HERE, "Guaranteed append managed to fail");
     }
-    assert(head == headBefore);
+    assert(head.segment == headBefore);
 
+    if (cold && numColdHeads > 0) {
+        metrics.totalColdBytesAppended +=
+            head.segment->getAppendedLength() - lengthBefore;
+    }
     return true;
 }
 
@@ -132,21 +147,17 @@ AbstractLog::append(Buffer *logBuffer, Reference *references,
                     uint32_t numEntries)
 {
     CycleCounter<uint64_t> _(&metrics.totalAppendTicks);
-    SpinLock::Guard lock(appendLock);
+    Tub<SpinLock::Guard> lock;
+    Head& head = lockHead(lock);
     metrics.totalAppendCalls++;
 
-    if (head == NULL || !head->hasSpaceFor(logBuffer->size())) {
-        if (!allocNewWritableHead())
-            return false;
-    }
-
-    if (head->isEmergencyHead)
+    if (!makeRoom(lock, head, NULL, logBuffer->size()))
         return false;
 
-    if (!head->hasSpaceFor(logBuffer->size()))
+    if (!head.segment->hasSpaceFor(logBuffer->size()))
         throw FatalError(HERE, "too much data to append to one segment");
 
-    LogSegment* headBefore = head;
+    LogSegment* headBefore = head.segment;
 
     // Makes sense to call getRange on the entire logBuffer here because
     // everything n the buffer has to be written out before this function
@@ -160,7 +171,8 @@ AbstractLog::append(Buffer *logBuffer, Reference *references,
     uint32_t entryLength = 0;
     uint32_t offset = 0;
     for (uint32_t i = 0; i < numEntries; i++) {
-        bool enoughSpace = append(lock,
+        bool enoughSpace = append(*lock,
+                                  head,
                                   buffer + offset,
                                   &entryLength,
                                   &references[i]);
@@ -169,7 +181,7 @@ AbstractLog::append(Buffer *logBuffer, Reference *references,
         offset+= entryLength;
     }
 
-    assert(head == headBefore);
+    assert(head.segment == headBefore);
 
     return true;
 }
@@ -218,6 +230,7 @@ AbstractLog::getMetrics(ProtoBuf::LogMetrics& m)
     m.set_total_no_space_ticks(metrics.totalNoSpaceTicks);
     m.set_total_bytes_appended(metrics.totalBytesAppended);
     m.set_total_metadata_bytes_appended(metrics.totalMetadataBytesAppended);
+    m.set_total_cold_bytes_appended(metrics.totalColdBytesAppended);
 
     segmentManager->getMetrics(*m.mutable_segment_metrics());
     segmentManager->getAllocator().getMetrics(*m.mutable_seglet_metrics());
@@ -349,6 +362,8 @@ AbstractLog::getSegment(Reference reference)
  *
  * \param lock
  *      Ensures that the caller holds the monitor lock; not actually used.
+ * \param head
+ *      The head to append to; \a lock must hold its appendLock.
  * \param type
  *      Type of the entry. See LogEntryTypes.h.
  * \param buffer
@@ -368,6 +383,7 @@ AbstractLog::getSegment(Reference reference)
  */
 bool
 AbstractLog::append(const SpinLock::Guard& lock,
+            Head& head,
             LogEntryType type,
             const void* buffer,
             uint32_t length,
@@ -382,21 +398,22 @@ AbstractLog::append(const SpinLock::Guard& lock,
     // times) to be a single call.
 
     // This is only possible once after construction.
-    if (head == NULL) {
-        if (!allocNewWritableHead())
+    if (head.segment == NULL) {
+        if (!allocNewWritableHead(head))
             throw FatalError(HERE, "Could not allocate initial head segment");
     }
 
     // Try to append. If we can't, try to allocate a new head to get more space.
+    // (With several heads, the caller has already made room; see makeRoom().)
     Reference reference;
-    uint32_t bytesUsedBefore = head->getAppendedLength();
-    bool enoughSpace = head->append(type, buffer, length, &reference);
+    uint32_t bytesUsedBefore = head.segment->getAppendedLength();
+    bool enoughSpace = head.segment->append(type, buffer, length, &reference);
     if (!enoughSpace) {
-        if (!allocNewWritableHead())
+        if (numHeads == 1 && !allocNewWritableHead(head))
             return false;
 
-        bytesUsedBefore = head->getAppendedLength();
-        if (!head->append(type, buffer, length, &reference)) {
+        bytesUsedBefore = head.segment->getAppendedLength();
+        if (!head.segment->append(type, buffer, length, &reference)) {
             LOG(ERROR, "Entry too big to append to log: %u bytes of type %d",
                 length, static_cast<int>(type));
             throw FatalError(HERE, "Entry too big to append to log");
@@ -406,11 +423,12 @@ AbstractLog::append(const SpinLock::Guard& lock,
     if (outReference != NULL)
         *outReference = reference;
 
-    uint32_t lengthWithMetadata = head->getAppendedLength() - bytesUsedBefore;
+    uint32_t lengthWithMetadata =
+        head.segment->getAppendedLength() - bytesUsedBefore;
 
     // Update log statistics so that the cleaner can make intelligent decisions
     // when trying to reclaim memory.
-    head->trackNewEntry(type, lengthWithMetadata);
+    head.segment->trackNewEntry(type, lengthWithMetadata);
     if (type == LOG_ENTRY_TYPE_OBJ ||
         type == LOG_ENTRY_TYPE_RPCRESULT ||
         type == LOG_ENTRY_TYPE_PREP ||
@@ -433,6 +451,8 @@ AbstractLog::append(const SpinLock::Guard& lock,
  *
  * \param lock
  *      Ensures that the caller holds the monitor lock; not actually used.
+ * \param head
+ *      The head to append to; \a lock must hold its appendLock.
  * \param buffer
  *      Pointer to buffer containing the entry to be appended.
  * \param[out] entryLength
@@ -451,6 +471,7 @@ AbstractLog::append(const SpinLock::Guard& lock,
  */
 bool
 AbstractLog::append(const SpinLock::Guard& lock,
+            Head& head,
             const void* buffer,
             uint32_t *entryLength,
             Reference* outReference,
@@ -464,8 +485,8 @@ AbstractLog::append(const SpinLock::Guard& lock,
     // times) to be a single call.
 
     // This is only possible once after construction.
-    if (head == NULL) {
-        if (!allocNewWritableHead())
+    if (head.segment == NULL) {
+        if (!allocNewWritableHead(head))
             throw FatalError(HERE, "Could not allocate initial head segment");
     }
 
@@ -473,15 +494,16 @@ AbstractLog::append(const SpinLock::Guard& lock,
     Reference reference;
     LogEntryType type;
     uint32_t entryDataLength = 0;
-    uint32_t bytesUsedBefore = head->getAppendedLength();
-    bool enoughSpace = head->append(buffer, &entryDataLength,
-                                    &type, &reference);
+    uint32_t bytesUsedBefore = head.segment->getAppendedLength();
+    bool enoughSpace = head.segment->append(buffer, &entryDataLength,
+                                            &type, &reference);
     if (!enoughSpace) {
-        if (!allocNewWritableHead())
+        if (numHeads == 1 && !allocNewWritableHead(head))
             return false;
 
-        bytesUsedBefore = head->getAppendedLength();
-        if (!head->append(buffer, &entryDataLength, &type, &reference)) {
+        bytesUsedBefore = head.segment->getAppendedLength();
+        if (!head.segment->append(buffer, &entryDataLength, &type,
+                                  &reference)) {
             LOG(ERROR, "Entry too big to append to log: %u bytes of type %d",
                 entryDataLength, static_cast<int>(type));
             throw FatalError(HERE, "Entry too big to append to log");
@@ -491,14 +513,15 @@ AbstractLog::append(const SpinLock::Guard& lock,
     if (outReference != NULL)
         *outReference = reference;
 
-    uint32_t lengthWithMetadata = head->getAppendedLength() - bytesUsedBefore;
+    uint32_t lengthWithMetadata =
+        head.segment->getAppendedLength() - bytesUsedBefore;
 
     if (entryLength)
         *entryLength = lengthWithMetadata;
 
     // Update log statistics so that the cleaner can make intelligent decisions
     // when trying to reclaim memory.
-    head->trackNewEntry(type, lengthWithMetadata);
+    head.segment->trackNewEntry(type, lengthWithMetadata);
     if (type == LOG_ENTRY_TYPE_OBJ ||
         type == LOG_ENTRY_TYPE_RPCRESULT ||
         type == LOG_ENTRY_TYPE_PREP ||
@@ -522,6 +545,8 @@ AbstractLog::append(const SpinLock::Guard& lock,
  *
  * \param lock
  *      Ensures that the caller holds the monitor lock; not actually used.
+ * \param head
+ *      The head to append to; \a lock must hold its appendLock.
  * \param type
  *      Type of the entry. See LogEntryTypes.h.
  * \param buffer
@@ -539,12 +564,14 @@ AbstractLog::append(const SpinLock::Guard& lock,
  */
 bool
 AbstractLog::append(const SpinLock::Guard& lock,
+            Head& head,
             LogEntryType type,
             Buffer& buffer,
             Reference* outReference,
             uint64_t* outTickCounter)
 {
     return append(lock,
+                  head,
                   type,
                   buffer.getRange(0, buffer.size()),
                   buffer.size(),
@@ -553,26 +580,96 @@ AbstractLog::append(const SpinLock::Guard& lock,
 }
 
 /**
- * Allocate a new head segment, changing the ``head'' field. If the allocation
- * succeeds and the allocated segment is writable (that is, not an emergency
- * head segment), return true. Otherwise, return false.
+ * Make sure that a head has room for entries about to be appended to it,
+ * replacing it with a new segment if needed.
+ *
+ * \param lock
+ *      Holds the appendLock of \a head. If the log has several heads, the
+ *      lock is released while they are replaced, and reacquired afterwards.
+ * \param head
+ *      The head to be appended to.
+ * \param entryLengths
+ *      Lengths of the entries to be appended, not including their headers
+ *      (as for Segment::hasSpaceFor()). If NULL, \a count is instead the
+ *      total length of complete entries, including headers.
+ * \param count
+ *      Number of elements in \a entryLengths, or a length in bytes.
+ * \return
+ *      True if \a head now refers to a writable segment. The segment has
+ *      room for the entries unless they would not fit in any segment. False
+ *      if there is no memory available for a new head.
+ */
+bool
+AbstractLog::makeRoom(Tub<SpinLock::Guard>& lock,
+                      Head& head,
+                      uint32_t* entryLengths,
+                      uint32_t count)
+{
+    while (head.segment == NULL ||
+           !(entryLengths != NULL ?
+                head.segment->hasSpaceFor(entryLengths, count) :
+                head.segment->hasSpaceFor(count))) {
+        if (numHeads == 1)
+            return allocNewWritableHead(head);
+
+        // Replacing the heads takes all of their appendLocks, in order.
+        // That is also when the out-of-space accounting is updated (see
+        // checkNewHead()); this thread only holds one head's lock here.
+        LogSegment* full = head.segment;
+        lock.destroy();
+        bool replaced = allocNextHeads(head, full);
+        lock.construct(head.appendLock);
+        if (head.segment == full || head.segment->isEmergencyHead)
+            return false;
+
+        // If another thread replaced the heads first, others may have filled
+        // our new head since; check again.
+        if (replaced)
+            break;
+    }
+
+    return !head.segment->isEmergencyHead;
+}
+
+/**
+ * Allocate a new segment for a head, changing its ``segment'' field. If the
+ * allocation succeeds and the allocated segment is writable (that is, not an
+ * emergency head segment), return true. Otherwise, return false.
  *
  * This method centralizes a bit of subtle logic shared between the append
- * methods (the ``head'' field should never be NULL after the first segment
+ * methods (the ``segment'' field should never be NULL after the first segment
  * has been allocated).
+ *
+ * \param head
+ *      The head to allocate a new segment for. Its appendLock must be held.
  */
 bool
-AbstractLog::allocNewWritableHead()
+AbstractLog::allocNewWritableHead(Head& head)
 {
     LogSegment* newHead = allocNextSegment(false);
     if (newHead != NULL)
-        head = newHead;
+        head.segment = newHead;
+    return checkNewHead(newHead);
+}
 
+/**
+ * Update the log's out-of-space accounting after allocating a new head.
+ * The caller must exclude every other appender: it holds the appendLock of
+ * the log's only head, or of all of its heads (see Log::replaceHeads()).
+ *
+ * \param newHead
+ *      The newly allocated head segment, or NULL if the allocation failed.
+ * \return
+ *      True if \a newHead can be appended to.
+ */
+bool
+AbstractLog::checkNewHead(LogSegment* newHead)
+{
     // If we're entirely out of memory or were allocated an emergency head
     // segment due to memory pressure, we can't service the append. Return
     // failure and let the client retry. Hopefully the cleaner will free up
     // more memory soon.
-    if (newHead == NULL || head->isEmergencyHead) {
+    if (newHead == NULL || newHead->isEmergencyHead) {
         if (!metrics.noSpaceTimer)
             metrics.noSpaceTimer.construct(&metrics.totalNoSpaceTicks);
         RAMCLOUD_CLOG(NOTICE, "No clean segments available; deferring "
@@ -17,6 +17,7 @@
 #define RAMCLOUD_ABSTRACTLOG_H
 
 #include <stdint.h>
+#include <atomic>
 #include <unordered_map>
 #include <vector>
 
@@ -24,6 +25,8 @@
 #include "LogEntryTypes.h"
 #include "Segment.h"
 #include "SpinLock.h"
+#include "ThreadId.h"
+#include "Tub.h"
 #include "ReplicaManager.h"
 #include "HashTable.h"
 
@@ -104,10 +107,12 @@ class AbstractLog {
     AbstractLog(LogEntryHandlers* entryHandlers,
                 SegmentManager* segmentManager,
                 ReplicaManager* replicaManager,
-                uint32_t segmentSize);
+                uint32_t segmentSize,
+                uint32_t numHeads = 1,
+                uint32_t numColdHeads = 0);
     virtual ~AbstractLog() { }
 
-    bool append(AppendVector* appends, uint32_t numAppends);
+    bool append(AppendVector* appends, uint32_t numAppends, bool cold = false);
     bool append(Buffer* logBuffer, Reference *references, uint32_t numEntries);
     void free(Reference reference);
     void getMetrics(ProtoBuf::LogMetrics& m);
@@ -139,9 +144,13 @@ class AbstractLog {
            uint32_t length,
            Reference* outReference = NULL)
     {
-        SpinLock::Guard lock(appendLock);
+        Tub<SpinLock::Guard> lock;
+        Head& head = lockHead(lock);
         metrics.totalAppendCalls++;
-        return append(lock,
+        if (numHeads > 1 && !makeRoom(lock, head, &length, 1))
+            return false;
+        return append(*lock,
+                      head,
                       type,
                       buffer,
                       length,
@@ -157,18 +166,95 @@ class AbstractLog {
            Buffer& buffer,
            Reference* outReference = NULL)
     {
-        SpinLock::Guard lock(appendLock);
+        Tub<SpinLock::Guard> lock;
+        Head& head = lockHead(lock);
         metrics.totalAppendCalls++;
-        return append(lock,
+        uint32_t length = buffer.size();
+        if (numHeads > 1 && !makeRoom(lock, head, &length, 1))
+            return false;
+        return append(*lock,
+                      head,
                       type,
-                      buffer.getRange(0, buffer.size()),
-                      buffer.size(),
+                      buffer.getRange(0, length),
+                      length,
                       outReference,
                       &metrics.totalAppendTicks);
     }
 
 
   PROTECTED:
+    /**
+     * A segment that the log appends to, along with the locks that serialize
+     * access to it. A SideLog has a single head; a Log may have several (see
+     * ServerConfig::Master::numLogHeads), in which case each thread appends
+     * to one of them, chosen by lockHead().
+     */
+    class Head {
+      public:
+        Head()
+            : segment(NULL),
+              appendLock("AbstractLog::appendLock"),
+              syncLock("Log::syncLock")
+        {
+        }
+
+        /// Current segment being appended to. Whatever this points to is
+        /// owned by SegmentManager, which is responsible for its eventual
+        /// deallocation. This pointer will be initalized to NULL, but once
+        /// the first segment is allocated it will never be NULL again.
+        ///
+        /// In the Log subclass, this is an actual head of the log. In the
+        /// SideLog subclass, there is not quite the same concept of a log
+        /// head. In that case, this is simply the segment currently being
+        /// appended to.
+        LogSegment* segment;
+
+        /// Lock taken around log append operations. This ensures that
+        /// parallel writers do not modify the segment concurrently. The
+        /// Log::sync() method also uses this lock to get a consistent view of
+        /// the segment in the presence of multiple appending threads.
+        SpinLock appendLock;
+
+        /// Used by the Log subclass to serialize calls to
+        /// ReplicatedSegment::sync() for this head. This both protects the
+        /// ReplicatedSegment from concurrent access and queues up syncs so
+        /// that multiple appends can be flushed to backups in the same RPC.
+        ///
+        /// If both this lock and #appendLock need to be taken, this one must
+        /// be acquired first to avoid deadlock.
+        SpinLock syncLock;
+
+        DISALLOW_COPY_AND_ASSIGN(Head);
+    };
+
+    /**
+     * Choose the head the calling thread appends to and lock it. Threads are
+     * spread over the heads by their ThreadId, so that a thread keeps using
+     * the same head and appends from different cores rarely contend.
+     *
+     * \param[out] lock
+     *      Constructed to hold the chosen head's appendLock.
+     * \param cold
+     *      If true and the log keeps separate heads for cold data (see
+     *      #numColdHeads), choose one of those. Otherwise choose one of the
+     *      regular (hot) heads.
+     * \return
+     *      The head to append to.
+     */
+    Head&
+    lockHead(Tub<SpinLock::Guard>& lock, bool cold = false)
+    {
+        uint32_t first = 0;
+        uint32_t count = numHeads - numColdHeads;
+        if (cold && numColdHeads > 0) {
+            first = count;
+            count = numColdHeads;
+        }
+        Head& head = heads[first + (count == 1 ? 0 : ThreadId::get() % count)];
+        lock.construct(head.appendLock);
+        return head;
+    }
+
     LogSegment* getSegment(Reference reference);
 
     /**
@@ -193,23 +279,56 @@ class AbstractLog {
      */
     virtual LogSegment* allocNextSegment(bool mustNotFail) = 0;
 
+    /**
+     * Replace a full head, and the heads that must be replaced along with it,
+     * with new segments. This is used instead of allocNextSegment() when the
+     * log has more than one head; see SegmentManager::allocHeadSegments() for
+     * how that is made safe. Only the Log subclass supports several heads.
+     *
+     * This method must be called without any appendLock held.
+     *
+     * \param head
+     *      The head the caller found to be full.
+     * \param full
+     *      The segment \a head referred to when it was found to be full. If
+     *      \a head no longer refers to it, another thread has already
+     *      replaced the heads and nothing is done.
+     * \return
+     *      True if this call replaced the heads (possibly with an emergency
+     *      head). False if another thread had already done so, or if there
+     *      is no memory for new heads.
+     */
+    virtual bool
+    allocNextHeads(Head& head, LogSegment* full)
+    {
+        throw FatalError(HERE, "This log only supports a single head");
+    }
+
     bool append(const SpinLock::Guard& lock,
+                Head& head,
                 LogEntryType type,
                 const void* data,
                 uint32_t length,
                 Reference* outReference = NULL,
                 uint64_t* outTickCounter = NULL);
     bool append(const SpinLock::Guard& lock,
+                Head& head,
                 const void* data,
                 uint32_t *entryLength = NULL,
                 Reference* outReference = NULL,
                 uint64_t* outTickCounter = NULL);
     bool append(const SpinLock::Guard& lock,
+                Head& head,
                 LogEntryType type,
                 Buffer& buffer,
                 Reference* outReference = NULL,
                 uint64_t* outTickCounter = NULL);
-    bool allocNewWritableHead();
+    bool makeRoom(Tub<SpinLock::Guard>& lock,
+                  Head& head,
+                  uint32_t* entryLengths,
+                  uint32_t count);
+    bool allocNewWritableHead(Head& head);
+    bool checkNewHead(LogSegment* newHead);
 
     /// Various handlers for entries appended to this log. Used to obtain
     /// timestamps and to relocate entries during cleaning.
@@ -231,30 +350,29 @@ class AbstractLog {
     /// space each memory segment may contain.
     uint32_t segmentSize;
 
-    /// Current segment being appended to. Whatever this points to is owned by
-    /// SegmentManager, which is responsible for its eventual deallocation.
-    /// This pointer will be initalized to NULL in the constructor, but once
-    /// the first segment is allocated it will never be NULL again.
-    ///
-    /// In the Log subclass, this is the actual head of the log. In the SideLog
-    /// subclass, there is not quite the same concept of a log head. In that
-    /// case, this is simply the segment currently being appended to.
-    LogSegment* head;
-
-    /// Lock taken around log append operations. This ensures that parallel
-    /// writers do not modify the head segment concurrently. The sync()
-    /// method also uses this lock to get a consistent view of the head
-    /// segment in the presence of multiple appending threads.
-    SpinLock appendLock;
+    /// Number of entries in #heads.
+    const uint32_t numHeads;
+
+    /// Number of entries at the end of #heads that only receive appends of
+    /// cold data (see ServerConfig::Master::hotObjectSeconds). Zero if the
+    /// log doesn't segregate hot and cold data.
+    const uint32_t numColdHeads;
+
+    /// The segments this log appends to. When there is more than one, the
+    /// hot ones are replaced together and each cold one on its own (see
+    /// allocNextHeads()).
+    std::unique_ptr<Head[]> heads;
 
     // Total amount of log space occupied by long-term data such as
     // objects. Excludes data that can eventually be cleaned, such
-    // as tombstones.
-    uint64_t totalLiveBytes;
+    // as tombstones. Atomic because appends to different heads update it
+    // under different locks.
+    std::atomic<uint64_t> totalLiveBytes;
 
     // Largest value of totalLiveBytes that is "safe" (i.e. the cleaner
-    // can always make progress).
-    uint64_t maxLiveBytes;
+    // can always make progress). Only written by checkNewHead(); read
+    // without locks by hasSpaceFor().
+    std::atomic<uint64_t> maxLiveBytes;
 
     /// Various event counters and performance measurements taken during log
     /// operation.
@@ -266,7 +384,8 @@ class AbstractLog {
               totalNoSpaceTicks(0),
               noSpaceTimer(),
               totalBytesAppended(0),
-              totalMetadataBytesAppended(0)
+              totalMetadataBytesAppended(0),
+              totalColdBytesAppended(0)
         {
         }
 
@@ -283,6 +402,7 @@ class AbstractLog {
             other->metrics.totalBytesAppended += totalBytesAppended;
             other->metrics.totalMetadataBytesAppended +=
                 totalMetadataBytesAppended;
+            other->metrics.totalColdBytesAppended += totalColdBytesAppended;
         }
 
         /// Reset the metrics for the log to the initial/empty state.
@@ -293,8 +413,9 @@ class AbstractLog {
         }
 
         /// Total number of times any of the public append() methods have been
-        /// called.
-        uint64_t totalAppendCalls;
+        /// called. This and the other byte and call counts below are atomic
+        /// since appends to different heads run concurrently.
+        std::atomic<uint64_t> totalAppendCalls;
 
         /// Total number of cpu cycles spent appending data. Includes any
         /// synchronous replication time, but does not include waiting for
@@ -307,17 +428,23 @@ class AbstractLog {
 
         /// Timer used to measure how long the log has spent unable to allocate
         /// memory. Constructed when we transition from being able to append to
-        /// not, and destructed when we can append again.
+        /// not, and destructed when we can append again. Only touched by
+        /// checkNewHead().
         Tub<CycleCounter<uint64_t>> noSpaceTimer;
 
         /// Total number of useful user bytes appended to the log. This does not
         /// include any segment metadata.
-        uint64_t totalBytesAppended;
+        std::atomic<uint64_t> totalBytesAppended;
 
         /// Total number of metadata bytes appended to the log. This, plus the
         /// #totalBytesAppended value is equal to the grand total of bytes
         /// appended to the log.
         uint64_t totalMetadataBytesAppended;
+
+        /// Total number of bytes (entries and their metadata) appended to
+        /// the cold heads of a log that segregates hot and cold data. Also
+        /// counted in the two totals above.
+        std::atomic<uint64_t> totalColdBytesAppended;
     } metrics;
 
     DISALLOW_COPY_AND_ASSIGN(AbstractLog);
@@ -80,22 +80,22 @@ TEST_F(AbstractLogTest, constructor) {
                                    &masterTableMetadata);
     Log l2(&context, &serverConfig, &entryHandlers,
            &segmentManager2, &replicaManager);
-    EXPECT_EQ(static_cast<LogSegment*>(NULL), l2.head);
+    EXPECT_EQ(static_cast<LogSegment*>(NULL), l2.heads[0].segment);
 }
 
 TEST_F(AbstractLogTest, append_basic) {
     uint32_t dataLen = serverConfig.segmentSize / 2 + 1;
     char* data = new char[dataLen];
-    LogSegment* oldHead = l.head;
+    LogSegment* oldHead = l.heads[0].segment;
 
     int appends = 0;
     uint64_t original = l.totalLiveBytes;
     while (l.append(LOG_ENTRY_TYPE_OBJ, data, dataLen)) {
         if (appends++ == 0)
-            EXPECT_EQ(oldHead, l.head);
+            EXPECT_EQ(oldHead, l.heads[0].segment);
         else
-            EXPECT_NE(oldHead, l.head);
-        oldHead = l.head;
+            EXPECT_NE(oldHead, l.heads[0].segment);
+        oldHead = l.heads[0].segment;
     }
     // This depends on ServerConfig's number of bytes allocated to the log.
     EXPECT_EQ(303, appends);
@@ -116,13 +116,13 @@ TEST_F(AbstractLogTest, append_tooBigToEverFit) {
     TestLog::Enable _(appendFilter);
 
     char* data = new char[serverConfig.segmentSize + 1];
-    LogSegment* oldHead = l.head;
+    LogSegment* oldHead = l.heads[0].segment;
 
     EXPECT_THROW(l.append(LOG_ENTRY_TYPE_OBJ,
                           data,
                           serverConfig.segmentSize + 1),
         FatalError);
-    EXPECT_NE(oldHead, l.head);
+    EXPECT_NE(oldHead, l.heads[0].segment);
     EXPECT_EQ("append: Entry too big to append to log: 131073 bytes of type 2",
         TestLog::get());
     delete[] data;
@@ -218,7 +218,7 @@ TEST_F(AbstractLogTest, getSegmentId) {
     Log::Reference reference;
 
     int zero = 0, one = 0, two = 0, other = 0;
-    while (l.head == NULL || l.head->id == 1) {
+    while (l.heads[0].segment == NULL || l.heads[0].segment->id == 1) {
         EXPECT_TRUE(l.append(LOG_ENTRY_TYPE_OBJ, buffer, &reference));
         switch (l.getSegmentId(reference)) {
             case 0: zero++; break;
@@ -251,7 +251,7 @@ TEST_F(AbstractLogTest, segmentExists) {
     EXPECT_FALSE(l.segmentExists(3));
 
     char data[1000];
-    while (l.head == NULL || l.head->id == 1)
+    while (l.heads[0].segment == NULL || l.heads[0].segment->id == 1)
         l.append(LOG_ENTRY_TYPE_OBJ, data, sizeof(data));
     l.sync();
 
@@ -299,24 +299,24 @@ TEST_F(AbstractLogTest, allocNewWritableHead) {
     TestLog::Enable _;
     MockLog ml(&l);
 
-    ml.head = reinterpret_cast<LogSegment*>(0xdeadbeef);
+    ml.heads[0].segment = reinterpret_cast<LogSegment*>(0xdeadbeef);
     EXPECT_FALSE(ml.metrics.noSpaceTimer);
-    EXPECT_FALSE(ml.allocNewWritableHead());
-    EXPECT_EQ(reinterpret_cast<LogSegment*>(0xdeadbeef), ml.head);
+    EXPECT_FALSE(ml.allocNewWritableHead(ml.heads[0]));
+    EXPECT_EQ(reinterpret_cast<LogSegment*>(0xdeadbeef), ml.heads[0].segment);
     EXPECT_TRUE(ml.metrics.noSpaceTimer);
-    EXPECT_EQ("allocNewWritableHead: No clean segments available; deferring "
+    EXPECT_EQ("checkNewHead: No clean segments available; deferring "
             "operations until cleaner runs", TestLog::get());
 
     ml.returnSegment = true;
-    EXPECT_TRUE(ml.allocNewWritableHead());
-    EXPECT_EQ(&ml.segment, ml.head);
+    EXPECT_TRUE(ml.allocNewWritableHead(ml.heads[0]));
+    EXPECT_EQ(&ml.segment, ml.heads[0].segment);
     EXPECT_FALSE(ml.metrics.noSpaceTimer);
     EXPECT_NE(0U, ml.metrics.totalNoSpaceTicks);
     EXPECT_EQ(37729075lu, ml.maxLiveBytes);
 
-    *const_cast<bool*>(&ml.head->isEmergencyHead) = true;
-    EXPECT_FALSE(ml.allocNewWritableHead());
-    EXPECT_EQ(&ml.segment, ml.head);
+    *const_cast<bool*>(&ml.heads[0].segment->isEmergencyHead) = true;
+    EXPECT_FALSE(ml.allocNewWritableHead(ml.heads[0]));
+    EXPECT_EQ(&ml.segment, ml.heads[0].segment);
     EXPECT_TRUE(ml.metrics.noSpaceTimer);
 }
 
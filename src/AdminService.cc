@@ -376,6 +376,22 @@ AdminService::serverControl(const WireFormat::ServerControl::Request* reqHdr,
             TimeTrace::reset();
             break;
         }
+        case WireFormat::SET_TABLE_COMPRESSION:
+        {
+            const WireFormat::SetTableCompression* args =
+                    static_cast<const WireFormat::SetTableCompression*>(
+                    inputData);
+            if (args == NULL || reqHdr->inputLength < sizeof(*args)) {
+                respHdr->common.status = STATUS_INVALID_PARAMETER;
+                return;
+            }
+            // Servers without a master have nothing to compress.
+            if (context->getMasterService() != NULL) {
+                context->getMasterService()->objectManager.setTableCompression(
+                        args->tableId, args->enabled != 0);
+            }
+            break;
+        }
         case WireFormat::START_PERF_COUNTERS:
         {
             Perf::EnabledCounter::enabled = true;
@@ -632,6 +632,33 @@ TEST_F(AdminServiceTest, serverControl_resetMetrics) {
     EXPECT_EQ("No time trace events to print", TestUtil::toString(&output));
 }
 
+TEST_F(AdminServiceTest, serverControl_setTableCompression) {
+    Buffer output;
+    WireFormat::SetTableCompression args = {7, 1};
+
+    // No master: nothing to do.
+    AdminClient::serverControl(&context, serverId,
+            WireFormat::SET_TABLE_COMPRESSION, &args, sizeof32(args),
+            &output);
+
+    addMasterService();
+    AdminClient::serverControl(&context, serverId,
+            WireFormat::SET_TABLE_COMPRESSION, &args, sizeof32(args),
+            &output);
+    EXPECT_TRUE(masterService->masterTableMetadata.find(7)->compressValues);
+
+    args.enabled = 0;
+    AdminClient::serverControl(&context, serverId,
+            WireFormat::SET_TABLE_COMPRESSION, &args, sizeof32(args),
+            &output);
+    EXPECT_FALSE(masterService->masterTableMetadata.find(7)->compressValues);
+
+    // Input too short.
+    EXPECT_THROW(AdminClient::serverControl(&context, serverId,
+            WireFormat::SET_TABLE_COMPRESSION, &args, 8, &output),
+            ClientException);
+}
+
 TEST_F(AdminServiceTest, updateServerList_noServerList) {
     WireFormat::UpdateServerList::Response response;
     response.common.status = STATUS_OK;
@@ -70,6 +70,100 @@ FreeSegmentRpc::FreeSegmentRpc(Context* context, ServerId backupId,
     send();
 }
 
+/**
+ * This method is invoked by backups during crash recovery to rebuild a
+ * segment that was stored as erasure-coded fragments: it retrieves the
+ * fragment of the segment that another backup holds.
+ *
+ * \param context
+ *      Overall information about this RAMCloud server.
+ * \param backupId
+ *      Identifies a particular backup, which is believed to hold a
+ *      fragment of the desired segment.
+ * \param recoveryId
+ *      Which recovery the fragment is needed for; the backup must have
+ *      started reading data for this recovery.
+ * \param masterId
+ *      The id of the master that created the desired segment.
+ * \param segmentId
+ *      The id of the desired segment.
+ * \param[out] response
+ *      The contents of the fragment are returned in this buffer.
+ * \return
+ *      Which fragment was returned, how the segment was encoded, and the
+ *      certificate for the whole segment.
+ */
+GetFragmentRpc::Fragment
+BackupClient::getFragment(Context* context,
+                          ServerId backupId,
+                          uint64_t recoveryId,
+                          ServerId masterId,
+                          uint64_t segmentId,
+                          Buffer* response)
+{
+    GetFragmentRpc rpc(context, backupId, recoveryId, masterId, segmentId,
+                       response);
+    return rpc.wait();
+}
+
+/**
+ * Constructor for GetFragmentRpc: initiates an RPC in the same way as
+ * #BackupClient::getFragment, but returns once the RPC has been initiated,
+ * without waiting for it to complete.
+ *
+ * \param context
+ *      Overall information about this RAMCloud server.
+ * \param backupId
+ *      Identifies a particular backup, which is believed to hold a
+ *      fragment of the desired segment.
+ * \param recoveryId
+ *      Which recovery the fragment is needed for; the backup must have
+ *      started reading data for this recovery.
+ * \param masterId
+ *      The id of the master that created the desired segment.
+ * \param segmentId
+ *      The id of the desired segment.
+ * \param[out] response
+ *      The contents of the fragment are returned in this buffer.
+ */
+GetFragmentRpc::GetFragmentRpc(Context* context,
+                               ServerId backupId,
+                               uint64_t recoveryId,
+                               ServerId masterId,
+                               uint64_t segmentId,
+                               Buffer* response)
+    : ServerIdRpcWrapper(context, backupId,
+            sizeof(WireFormat::BackupGetFragment::Response), response)
+{
+    WireFormat::BackupGetFragment::Request* reqHdr(
+            allocHeader<WireFormat::BackupGetFragment>(backupId));
+    reqHdr->recoveryId = recoveryId;
+    reqHdr->masterId = masterId.getId();
+    reqHdr->segmentId = segmentId;
+    send();
+}
+
+/**
+ * Wait for a getFragment RPC to complete, and throw exceptions for
+ * any errors.
+ *
+ * \return
+ *      Which fragment was placed in the response Buffer given at the start
+ *      of this rpc call (with the header removed), how the segment was
+ *      encoded, and the certificate for the whole segment.
+ * \throw ServerNotUpException
+ *      The intended server for this RPC is not part of the cluster;
+ *      if it ever existed, it has since crashed.
+ */
+GetFragmentRpc::Fragment
+GetFragmentRpc::wait()
+{
+    waitAndCheckErrors();
+    Fragment fragment = *getResponseHeader<WireFormat::BackupGetFragment>();
+    response->truncateFront(sizeof(fragment));
+    return fragment;
+}
+
 /**
  * This method is invoked by recovery masters during crash recovery: it
  * retrieves from a backup all the objects from a particular segment that
@@ -136,6 +230,16 @@ BackupClient::getRecoveryData(Context* context,
  * \param[out] response
  *      The objects matching the above parameters will be returned in this
  *      buffer, organized as a Segment.
+ * \param fragmentSources
+ *      If the backup only holds a fragment of the segment, the other backups
+ *      holding fragments of it, from which it can collect enough fragments
+ *      to rebuild the segment. NULL or empty otherwise.
+ * \param offset
+ *      Offset within the recovery segment of the first byte to return.
+ * \param maxLength
+ *      Return at most this many bytes of the recovery segment, so that
+ *      large recovery segments can be fetched in pieces; 0 means return
+ *      everything from \a offset on.
  */
 GetRecoveryDataRpc::GetRecoveryDataRpc(Context* context,
                                        ServerId backupId,
@@ -143,7 +247,10 @@ GetRecoveryDataRpc::GetRecoveryDataRpc(Context* context,
                                        ServerId masterId,
                                        uint64_t segmentId,
                                        uint64_t partitionId,
-                                       Buffer* response)
+                                       Buffer* response,
+                                       const vector<ServerId>* fragmentSources,
+                                       uint32_t offset,
+                                       uint32_t maxLength)
     : ServerIdRpcWrapper(context, backupId,
             sizeof(WireFormat::BackupGetRecoveryData::Response), response)
 {
@@ -153,6 +260,15 @@ GetRecoveryDataRpc::GetRecoveryDataRpc(Context* context,
     reqHdr->masterId = masterId.getId();
     reqHdr->segmentId = segmentId;
     reqHdr->partitionId = partitionId;
+    reqHdr->fragmentSourceCount = 0;
+    reqHdr->offset = offset;
+    reqHdr->maxLength = maxLength;
+    if (fragmentSources != NULL) {
+        reqHdr->fragmentSourceCount = downCast<uint32_t>(
+                fragmentSources->size());
+        foreach (ServerId source, *fragmentSources)
+            request.emplaceAppend<uint64_t>(source.getId());
+    }
     send();
 }
 
@@ -160,6 +276,9 @@ GetRecoveryDataRpc::GetRecoveryDataRpc(Context* context,
  * Wait for a getRecoveryData RPC to complete, and throw exceptions for
  * any errors.
  *
+ * \param[out] segmentLength
+ *      If not NULL, set to the total length of the recovery segment, of
+ *      which the response Buffer holds only the range requested.
  * \return
  *      Certificate for the recovery segment which was populated
  *      into the response Buffer given at the start of this rpc call.
@@ -170,12 +289,14 @@ GetRecoveryDataRpc::GetRecoveryDataRpc(Context* context,
  *      if it ever existed, it has since crashed.
  */
 SegmentCertificate
-GetRecoveryDataRpc::wait()
+GetRecoveryDataRpc::wait(uint32_t* segmentLength)
 {
     waitAndCheckErrors();
     const WireFormat::BackupGetRecoveryData::Response* respHdr(
             getResponseHeader<WireFormat::BackupGetRecoveryData>());
     SegmentCertificate certificate = respHdr->certificate;
+    if (segmentLength != NULL)
+        *segmentLength = respHdr->segmentLength;
 
     // respHdr off limits.
     response->truncateFront(sizeof(
@@ -639,6 +760,85 @@ WriteSegmentRpc::WriteSegmentRpc(Context* context,
     send();
 }
 
+/**
+ * Constructor for WriteSegmentRpc that writes part of a fragment of an
+ * erasure-coded segment rather than part of a full replica (see
+ * ReedSolomon). Otherwise like the constructor above; fragments are never
+ * primary replicas.
+ *
+ * \param context
+ *      Overall information about this RAMCloud server.
+ * \param backupId
+ *      The id of the backup to which the fragment is to be written.
+ * \param masterId
+ *      The id of the master to which the data belongs.
+ * \param segmentId
+ *      The id of the segment the fragment belongs to.
+ * \param segmentEpoch
+ *      The epoch of the segment being replicated; see the constructor above.
+ * \param fragment
+ *      Contents of the whole fragment. Must remain valid until the rpc
+ *      completes, since it isn't copied.
+ * \param offset
+ *      Both the position in the replica where this data will be placed
+ *      and the starting offset in \a fragment of the data to write.
+ * \param length
+ *      The length in bytes of the data to write.
+ * \param certificate
+ *      Certificate for the whole segment (not the fragment); may be NULL.
+ *      See the constructor above.
+ * \param open
+ *      Whether this write is an opening write to the replica.
+ * \param close
+ *      Whether this write is a closing write to the replica.
+ * \param dataFragments
+ *      Number of data fragments the segment was encoded into.
+ * \param parityFragments
+ *      Number of parity fragments the segment was encoded with.
+ * \param fragmentIndex
+ *      Which of the segment's fragments is being written.
+ */
+WriteSegmentRpc::WriteSegmentRpc(Context* context,
+                                 ServerId backupId,
+                                 ServerId masterId,
+                                 uint64_t segmentId,
+                                 uint64_t segmentEpoch,
+                                 const void* fragment,
+                                 uint32_t offset,
+                                 uint32_t length,
+                                 const SegmentCertificate* certificate,
+                                 bool open,
+                                 bool close,
+                                 uint32_t dataFragments,
+                                 uint32_t parityFragments,
+                                 uint32_t fragmentIndex)
+    : ServerIdRpcWrapper(context, backupId,
+                         sizeof(WireFormat::BackupWrite::Response))
+{
+    WireFormat::BackupWrite::Request* reqHdr(
+            allocHeader<WireFormat::BackupWrite>(backupId));
+    reqHdr->masterId = masterId.getId();
+    reqHdr->segmentId = segmentId;
+    reqHdr->segmentEpoch = segmentEpoch;
+    reqHdr->offset = offset;
+    reqHdr->length = length;
+    reqHdr->certificateIncluded = (certificate != NULL);
+    if (reqHdr->certificateIncluded)
+        reqHdr->certificate = *certificate;
+    else
+        reqHdr->certificate = SegmentCertificate();
+    reqHdr->open = open;
+    reqHdr->close = close;
+    reqHdr->primary = false;
+    reqHdr->dataFragments = downCast<uint8_t>(dataFragments);
+    reqHdr->parityFragments = downCast<uint8_t>(parityFragments);
+    reqHdr->fragmentIndex = downCast<uint8_t>(fragmentIndex);
+    request.appendExternal(static_cast<const char*>(fragment) + offset,
+                           length);
+    CycleCounter<RawMetric> _(&metrics->master.replicationPostingWriteRpcTicks);
+    send();
+}
+
 /**
  * Wait for a writeSegment RPC to complete.
  *
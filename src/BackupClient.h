@@ -45,6 +45,27 @@ class FreeSegmentRpc : public ServerIdRpcWrapper {
     DISALLOW_COPY_AND_ASSIGN(FreeSegmentRpc);
 };
 
+/**
+ * Encapsulates the state of a BackupClient::getFragment operation,
+ * allowing it to execute asynchronously.
+ */
+class GetFragmentRpc : public ServerIdRpcWrapper {
+  public:
+    typedef WireFormat::BackupGetFragment::Response Fragment;
+
+    GetFragmentRpc(Context* context,
+                   ServerId backupId,
+                   uint64_t recoveryId,
+                   ServerId masterId,
+                   uint64_t segmentId,
+                   Buffer* responseBuffer);
+    ~GetFragmentRpc() {}
+    Fragment wait();
+
+  PRIVATE:
+    DISALLOW_COPY_AND_ASSIGN(GetFragmentRpc);
+};
+
 /**
  * Encapsulates the state of a BackupClient::getRecoveryData operation,
  * allowing it to execute asynchronously.
@@ -57,9 +78,12 @@ class GetRecoveryDataRpc : public ServerIdRpcWrapper {
                        ServerId masterId,
                        uint64_t segmentId,
                        uint64_t partitionId,
-                       Buffer* responseBuffer);
+                       Buffer* responseBuffer,
+                       const vector<ServerId>* fragmentSources = NULL,
+                       uint32_t offset = 0,
+                       uint32_t maxLength = 0);
     ~GetRecoveryDataRpc() {}
-    SegmentCertificate wait();
+    SegmentCertificate wait(uint32_t* segmentLength = NULL);
 
   PRIVATE:
     DISALLOW_COPY_AND_ASSIGN(GetRecoveryDataRpc);
@@ -192,6 +216,14 @@ class WriteSegmentRpc : public ServerIdRpcWrapper {
                     const Segment* segment, uint32_t offset, uint32_t length,
                     const SegmentCertificate* certificate,
                     bool open, bool close, bool primary);
+    WriteSegmentRpc(Context* context, ServerId backupId,
+                    ServerId masterId,
+                    uint64_t segmentId, uint64_t segmentEpoch,
+                    const void* fragment, uint32_t offset, uint32_t length,
+                    const SegmentCertificate* certificate,
+                    bool open, bool close,
+                    uint32_t dataFragments, uint32_t parityFragments,
+                    uint32_t fragmentIndex);
     ~WriteSegmentRpc() {}
     void wait();
 
@@ -211,6 +243,12 @@ class BackupClient {
             const ServerId* replicationGroupIds);
     static void freeSegment(Context* context, ServerId backupId,
             ServerId masterId, uint64_t segmentId);
+    static GetFragmentRpc::Fragment getFragment(Context* context,
+                                                ServerId backupId,
+                                                uint64_t recoveryId,
+                                                ServerId masterId,
+                                                uint64_t segmentId,
+                                                Buffer* response);
     static SegmentCertificate getRecoveryData(Context* context,
                                               ServerId backupId,
                                               uint64_t recoveryId,
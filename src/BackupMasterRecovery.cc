@@ -17,6 +17,7 @@
 #include "BackupService.h"
 #include "Object.h"
 #include "RecoverySegmentBuilder.h"
+#include "ReedSolomon.h"
 #include "ShortMacros.h"
 
 namespace RAMCloud {
@@ -34,6 +35,9 @@ SpinLock BackupMasterRecovery::deletionMutex
  * doesn't start any of them. See start() for details on the first phase of
  * master recovery which is initiated by the coordinator.
  *
+ * \param context
+ *      Overall information about the RAMCloud server; used to fetch
+ *      fragments from other backups when rebuilding erasure-coded segments.
  * \param taskQueue
  *      Task queue which will provide the context to filter loaded replicas in
  *      the background. Not used until just before start() completes. This
@@ -53,12 +57,20 @@ SpinLock BackupMasterRecovery::deletionMutex
  * \param segmentSize
  *      Size of the replicas on storage. Needed for bounds-checking on the
  *      SegmentIterators which walk the stored replicas.
+ * \param numFilterThreads
+ *      Number of threads to build recovery segments with in parallel, in
+ *      the order recovery masters ask for them. If 0, primary replicas are
+ *      filtered one at a time on the \a taskQueue thread and secondaries
+ *      on demand by the backup worker thread.
  */
-BackupMasterRecovery::BackupMasterRecovery(TaskQueue& taskQueue,
+BackupMasterRecovery::BackupMasterRecovery(Context* context,
+                                           TaskQueue& taskQueue,
                                            uint64_t recoveryId,
                                            ServerId crashedMasterId,
-                                           uint32_t segmentSize)
+                                           uint32_t segmentSize,
+                                           uint32_t numFilterThreads)
     : Task(taskQueue)
+    , context(context)
     , recoveryId(recoveryId)
     , crashedMasterId(crashedMasterId)
     , partitions()
@@ -69,6 +81,17 @@ BackupMasterRecovery::BackupMasterRecovery(TaskQueue& taskQueue,
     , firstSecondaryReplica()
     , numPrimaries(0)
     , segmentIdToReplica()
+    , pendingRebuilds()
+    , rebuildMutex("BackupMasterRecovery::rebuildMutex")
+    , rebuild()
+    , numFilterThreads(numFilterThreads)
+    , filterThreads()
+    , filterMutex()
+    , filterWork()
+    , requestedReplicas()
+    , primariesFiltered(0)
+    , stopFiltering(false)
+    , firstSegmentServed(false)
     , logDigest()
     , logDigestSegmentId(~0lu)
     , logDigestSegmentEpoch()
@@ -86,9 +109,17 @@ BackupMasterRecovery::BackupMasterRecovery(TaskQueue& taskQueue,
 
 /**
  * Perform logging of cleanup inside a destructor, since we are using a
- * distinct task to clean up the BackupMasterRecovery instance.
+ * distinct task to clean up the BackupMasterRecovery instance. Waits for
+ * filter threads to finish the replicas they are working on, if any.
  */
 BackupMasterRecovery::~BackupMasterRecovery() {
+    {
+        FilterLock lock(filterMutex);
+        stopFiltering = true;
+        filterWork.notify_all();
+    }
+    foreach (auto& thread, filterThreads)
+        thread.join();
     LOG(NOTICE, "Freeing recovery state on backup for crashed master %s "
             "(recovery %lu), including %lu filtered replicas",
             crashedMasterId.toString().c_str(), recoveryId,
@@ -255,6 +286,8 @@ BackupMasterRecovery::setPartitionsAndSchedule(
     LOG(DEBUG, "Kicked off building recovery segments");
     nextToBuild = replicas.begin();
     buildingStartTicks = Cycles::rdtsc();
+    for (uint32_t i = 0; i < numFilterThreads; ++i)
+        filterThreads.emplace_back(&BackupMasterRecovery::filterMain, this);
     schedule();
 }
 
@@ -267,7 +300,9 @@ BackupMasterRecovery::setPartitionsAndSchedule(
  * segment comes from a primary replica then do not block; if the recovery
  * segment hasn't been constructed yet the return status indicates the recovery
  * master should try to collect other recovery segments and come back for this
- * one later.
+ * one later. If the replica is a fragment of an erasure-coded segment then
+ * queue the segment to be rebuilt in the background from fragments on
+ * \a fragmentSources, and ask the recovery master to come back later.
  *
  * \param recoveryId
  *      Which master recovery this is for. The coordinator may schedule
@@ -288,6 +323,10 @@ BackupMasterRecovery::setPartitionsAndSchedule(
  *      recovery masters to check the integrity of the metadata of the
  *      returned recovery segment and to iterate over it. May be null for
  *      testing.
+ * \param fragmentSources
+ *      If the replica stored here is a fragment, the other backups holding
+ *      fragments of the segment. Only the list given with the first request
+ *      for the segment is used. May be null.
  * \return
  *      Status code: STATUS_OK if the recovery segment was appended,
  *      STATUS_RETRY if the caller should try again later.
@@ -304,7 +343,9 @@ BackupMasterRecovery::getRecoverySegment(uint64_t recoveryId,
                                          uint64_t segmentId,
                                          int partitionId,
                                          Buffer* buffer,
-                                         SegmentCertificate* certificate)
+                                         SegmentCertificate* certificate,
+                                         const vector<ServerId>*
+                                             fragmentSources)
 {
     if (this->recoveryId != recoveryId) {
         LOG(ERROR, "Requested recovery segment from recovery %lu, but current "
@@ -320,7 +361,36 @@ BackupMasterRecovery::getRecoverySegment(uint64_t recoveryId,
     }
     Replica* replica = replicaIt->second;
 
-    if (!replica->metadata->primary || DISABLE_BACKGROUND_BUILDING) {
+    if (replica->metadata->dataFragments != 0) {
+        if (!replica->rebuildQueued) {
+            if (fragmentSources)
+                replica->fragmentSources = *fragmentSources;
+            LOG(DEBUG, "Requested segment <%s,%lu> is a fragment, queuing "
+                "rebuild from %lu other fragments",
+                crashedMasterId.toString().c_str(), segmentId,
+                replica->fragmentSources.size());
+            replica->rebuildQueued = true;
+            replica->frame->startLoading();
+            {
+                SpinLock::Guard lock(rebuildMutex);
+                pendingRebuilds.push_back(replica);
+            }
+            SpinLock::Guard lock(deletionMutex);
+            if (!pendingDeletion)
+                schedule();
+        }
+    } else if (numFilterThreads != 0) {
+        // Have the filter threads take this replica next (after any asked
+        // for earlier), unless one of them is already on it.
+        FilterLock lock(filterMutex);
+        if (!replica->filterClaimed && !replica->filterRequested) {
+            replica->filterRequested = true;
+            if (!replica->metadata->primary)
+                replica->frame->startLoading();
+            requestedReplicas.push_back(replica);
+            filterWork.notify_one();
+        }
+    } else if (!replica->metadata->primary || DISABLE_BACKGROUND_BUILDING) {
         LOG(DEBUG, "Requested segment <%s,%lu> is secondary, "
             "starting build of recovery segments now",
             crashedMasterId.toString().c_str(), segmentId);
@@ -360,9 +430,70 @@ BackupMasterRecovery::getRecoverySegment(uint64_t recoveryId,
     if (certificate)
         replica->recoverySegments[partitionId].getAppendedLength(certificate);
 
+    if (!firstSegmentServed) {
+        firstSegmentServed = true;
+        uint64_t ticks = Cycles::rdtsc() - buildingStartTicks;
+        metrics->backup.firstSegmentTicks += ticks;
+        LOG(NOTICE, "Recovery %lu returned its first recovery segment %lu ms "
+            "after filtering started", recoveryId,
+            Cycles::toNanoseconds(ticks) / 1000 / 1000);
+    }
     return STATUS_OK;
 }
 
+/**
+ * Return the fragment of an erasure-coded segment stored on this backup,
+ * so another backup can use it to rebuild the segment. Used to fulfill
+ * GetFragment rpcs. Blocks while loading the fragment from storage, the same
+ * way getRecoverySegment() does for secondary replicas.
+ *
+ * \param recoveryId
+ *      Which master recovery this is for; must match this recovery.
+ * \param segmentId
+ *      Id of the segment the fragment is requested for.
+ * \param[out] buffer
+ *      Buffer to which the contents of the fragment are appended.
+ * \param[out] response
+ *      Filled in with which fragment was returned, how the segment was
+ *      encoded, and the certificate of the whole segment.
+ * \throw BackupBadSegmentIdException
+ *      If a different recovery id was requested or no fragment of the
+ *      segment is stored here.
+ */
+void
+BackupMasterRecovery::getFragment(
+        uint64_t recoveryId,
+        uint64_t segmentId,
+        Buffer* buffer,
+        WireFormat::BackupGetFragment::Response* response)
+{
+    if (this->recoveryId != recoveryId) {
+        LOG(ERROR, "Requested fragment from recovery %lu, but current "
+            "recovery for that master is %lu", recoveryId, this->recoveryId);
+        throw BackupBadSegmentIdException(HERE);
+    }
+    auto replicaIt = segmentIdToReplica.find(segmentId);
+    if (replicaIt == segmentIdToReplica.end() ||
+            replicaIt->second->metadata->dataFragments == 0) {
+        LOG(WARNING, "Asked for a fragment of segment <%s,%lu> but no "
+            "fragment of it is part of this recovery",
+           crashedMasterId.toString().c_str(), segmentId);
+        throw BackupBadSegmentIdException(HERE);
+    }
+    const BackupReplicaMetadata* metadata = replicaIt->second->metadata;
+
+    // Fragments are sized as in ReedSolomon::getFragmentLength().
+    uint32_t length = (metadata->certificate.segmentLength +
+                       metadata->dataFragments - 1) / metadata->dataFragments;
+    void* data = replicaIt->second->frame->load();
+    buffer->appendCopy(data, length);
+    response->certificate = metadata->certificate;
+    response->dataFragments = metadata->dataFragments;
+    response->parityFragments = metadata->parityFragments;
+    response->fragmentIndex = metadata->fragmentIndex;
+    response->length = length;
+}
+
 /**
  * Inform this recovery that it should cleanup and release all resources as
  * soon as possible (including any references to frames, which may allow them
@@ -401,7 +532,9 @@ BackupMasterRecovery::getRecoveryId()
  * from the backup worker thread so building recovery segments for primary
  * replicas is done in the background. Works down #replicas in order starting
  * at the beginning (which #nextToBuild is initially set to in start()) until
- * the end of #replicas or a secondary replica is encountered.
+ * the end of #replicas or a secondary replica is encountered. Also makes
+ * progress on rebuilding erasure-coded segments queued by
+ * getRecoverySegment(), one at a time.
  */
 void
 BackupMasterRecovery::performTask()
@@ -409,12 +542,34 @@ BackupMasterRecovery::performTask()
     if (DISABLE_BACKGROUND_BUILDING)
         return;
 
-    if (nextToBuild == firstSecondaryReplica) {
-        readingDataTicks.destroy();
-        uint64_t ns =
-            Cycles::toNanoseconds(Cycles::rdtsc() - buildingStartTicks);
-        LOG(NOTICE, "Took %lu ms to filter %lu primary replicas",
-            ns / 1000 / 1000, numPrimaries);
+    bool rebuilding = false;
+    if (!rebuild) {
+        SpinLock::Guard lock(rebuildMutex);
+        if (!pendingRebuilds.empty()) {
+            rebuild.construct(pendingRebuilds.front());
+            pendingRebuilds.pop_front();
+        }
+    }
+    if (rebuild) {
+        rebuilding = true;
+        if (rebuildFromFragments(*rebuild))
+            rebuild.destroy();
+    }
+
+    // Filter threads, if any, build everything but fragments.
+    if (numFilterThreads != 0 || nextToBuild == firstSecondaryReplica) {
+        if (numFilterThreads == 0 && readingDataTicks) {
+            readingDataTicks.destroy();
+            uint64_t ns =
+                Cycles::toNanoseconds(Cycles::rdtsc() - buildingStartTicks);
+            LOG(NOTICE, "Took %lu ms to filter %lu primary replicas",
+                ns / 1000 / 1000, numPrimaries);
+        }
+        if (rebuilding) {
+            SpinLock::Guard lock(deletionMutex);
+            if (!pendingDeletion)
+                schedule();
+        }
         return;
     }
 
@@ -439,6 +594,78 @@ BackupMasterRecovery::performTask()
 
 // - private -
 
+/**
+ * Main loop of each filter thread: repeatedly claims a replica which needs
+ * its recovery segments built (see claimReplicaToFilter()), loads it, and
+ * builds them, until the recovery is destroyed. Loading blocks this thread
+ * only, so with several filter threads some replicas are filtered while
+ * others are still being read from storage.
+ */
+void
+BackupMasterRecovery::filterMain()
+{
+    FilterLock lock(filterMutex);
+    while (true) {
+        Replica* replica = NULL;
+        while (!stopFiltering && !(replica = claimReplicaToFilter(lock)))
+            filterWork.wait(lock);
+        if (stopFiltering)
+            return;
+        lock.unlock();
+
+        LOG(DEBUG, "Starting to build recovery segments for (<%s,%lu>)",
+            crashedMasterId.toString().c_str(), replica->metadata->segmentId);
+        replica->frame->load();
+        buildRecoverySegments(*replica);
+        replica->frame->unload();
+        LOG(DEBUG, "Done building recovery segments for (<%s,%lu>)",
+            crashedMasterId.toString().c_str(), replica->metadata->segmentId);
+
+        lock.lock();
+        if (replica->metadata->primary &&
+                ++primariesFiltered == numPrimaries) {
+            readingDataTicks.destroy();
+            uint64_t ns =
+                Cycles::toNanoseconds(Cycles::rdtsc() - buildingStartTicks);
+            LOG(NOTICE, "Took %lu ms to filter %lu primary replicas with %u "
+                "threads", ns / 1000 / 1000, numPrimaries, numFilterThreads);
+        }
+    }
+}
+
+/**
+ * Choose the next replica a filter thread should build recovery segments
+ * for and mark it as claimed: the earliest requested one that no thread has
+ * claimed yet or, failing that, the next unclaimed primary replica in
+ * #replicas order.
+ *
+ * \param lock
+ *      Caller must hold #filterMutex.
+ * \return
+ *      The replica claimed, or NULL if there is nothing to do for now.
+ */
+BackupMasterRecovery::Replica*
+BackupMasterRecovery::claimReplicaToFilter(FilterLock& lock)
+{
+    while (!requestedReplicas.empty()) {
+        Replica* replica = requestedReplicas.front();
+        requestedReplicas.pop_front();
+        if (!replica->filterClaimed) {
+            replica->filterClaimed = true;
+            return replica;
+        }
+    }
+    while (nextToBuild != firstSecondaryReplica) {
+        Replica* replica = &*nextToBuild;
+        ++nextToBuild;
+        if (!replica->filterClaimed) {
+            replica->filterClaimed = true;
+            return replica;
+        }
+    }
+    return NULL;
+}
+
 /**
  * Append replica information and the log digest (if any) to \a responseBuffer
  * and populate \a response with the corresponding details about the
@@ -460,7 +687,9 @@ BackupMasterRecovery::populateStartResponse(Buffer* responseBuffer,
         responseBuffer->emplaceAppend<
                 WireFormat::BackupStartReadingData::Replica>(
                 replica.metadata->segmentId, replica.metadata->segmentEpoch,
-                replica.metadata->closed);
+                replica.metadata->closed, replica.metadata->dataFragments,
+                replica.metadata->parityFragments,
+                replica.metadata->fragmentIndex);
         ++response->replicaCount;
         if (replica.metadata->primary)
             ++response->primaryReplicaCount;
@@ -517,7 +746,9 @@ BackupMasterRecovery::populateStartResponse(Buffer* responseBuffer,
  * TaskQueue; primary replicas are ONLY processed by that task (performTask()).
  * Secondaries are ONLY processed by the backup worker thread. Since the worker
  * thread serializes all rpcs secondary processing is serialized. Since the two
- * sets are disjoint it all works out.
+ * sets are disjoint it all works out. With filter threads, all replicas are
+ * processed by those threads instead, and claimReplicaToFilter() hands each
+ * replica to only one of them.
  *
  * If we move to multiple worker threads then replicas will need to be locked
  * for this filtering.
@@ -538,7 +769,8 @@ BackupMasterRecovery::buildRecoverySegments(Replica& replica)
     replica.recoveryException.reset();
     replica.recoverySegments.reset();
 
-    void* replicaData = replica.frame->load();
+    void* replicaData = replica.rebuiltData ? replica.rebuiltData.get()
+                                            : replica.frame->load();
     CycleCounter<RawMetric> _(&metrics->backup.filterTicks);
 
     std::unique_ptr<Segment[]> recoverySegments(new Segment[numPartitions]);
@@ -575,6 +807,134 @@ BackupMasterRecovery::buildRecoverySegments(Replica& replica)
     replica.built = true;
 }
 
+/**
+ * Make progress on rebuilding an erasure-coded segment from the fragment
+ * stored here and fragments held by other backups, then build its recovery
+ * segments. Never blocks: fetches fragments with asynchronous rpcs, keeping
+ * just enough outstanding to collect the fragments needed (and asking the
+ * next backup in line whenever one fails), and returns false until it is
+ * done. Only called by performTask(), on the task queue thread.
+ *
+ * Like buildRecoverySegments(), failures don't throw; they are boxed into
+ * the replica's recoveryException so recovery masters move on to another
+ * replica of the segment.
+ *
+ * \param rebuild
+ *      The segment to rebuild and the fragments fetched for it so far.
+ * \return
+ *      True once the replica has been built (successfully or not), false if
+ *      performTask() should call again later.
+ */
+bool
+BackupMasterRecovery::rebuildFromFragments(FragmentRebuild& rebuild)
+{
+    Replica& replica = *rebuild.replica;
+    const BackupReplicaMetadata* metadata = replica.metadata;
+    const uint64_t segmentId = metadata->segmentId;
+    const uint32_t dataFragments = metadata->dataFragments;
+    const uint32_t parityFragments = metadata->parityFragments;
+    const uint32_t length = metadata->certificate.segmentLength;
+
+    // Give up on the replica. Callers log why themselves so the message is
+    // attributed to this method rather than to the lambda.
+    auto fail = [&]() {
+        replica.recoveryException.reset(
+            new SegmentRecoveryFailedException(HERE));
+        Fence::sfence();
+        replica.built = true;
+        replica.frame->unload();
+        return true;
+    };
+
+    if (dataFragments + parityFragments > ReedSolomon::MAX_FRAGMENTS ||
+            length > segmentSize) {
+        LOG(NOTICE, "Couldn't rebuild <%s,%lu> from fragments: invalid "
+            "fragment metadata", crashedMasterId.toString().c_str(),
+            segmentId);
+        return fail();
+    }
+    if (!replica.frame->isLoaded())
+        return false;
+    ReedSolomon codec(dataFragments, parityFragments);
+    const uint32_t fragmentLength = codec.getFragmentLength(length);
+    // The fragment stored here is one of those needed.
+    const uint32_t needed = dataFragments - 1;
+
+    foreach (auto& fetch, rebuild.fetches) {
+        if (!fetch.rpc || !fetch.rpc->isReady())
+            continue;
+        try {
+            GetFragmentRpc::Fragment fragment = fetch.rpc->wait();
+            fetch.rpc.destroy();
+            --rebuild.outstanding;
+            bool duplicate = fragment.fragmentIndex == metadata->fragmentIndex;
+            foreach (auto& other, rebuild.fetches) {
+                if (other.fragmentIndex == fragment.fragmentIndex)
+                    duplicate = true;
+            }
+            if (fragment.dataFragments != dataFragments ||
+                    fragment.parityFragments != parityFragments ||
+                    !(fragment.certificate == metadata->certificate) ||
+                    fragment.length != fragmentLength ||
+                    fetch.response.size() < fragmentLength || duplicate) {
+                LOG(WARNING, "Discarding fragment %u of <%s,%lu> from %s; "
+                    "it doesn't match the fragment stored here",
+                    fragment.fragmentIndex, crashedMasterId.toString().c_str(),
+                    segmentId, fetch.backupId.toString().c_str());
+                continue;
+            }
+            fetch.fragmentIndex = fragment.fragmentIndex;
+            ++rebuild.received;
+        } catch (const ClientException& e) {
+            LOG(NOTICE, "Couldn't fetch fragment of <%s,%lu> from %s: %s",
+                crashedMasterId.toString().c_str(), segmentId,
+                fetch.backupId.toString().c_str(), e.toSymbol());
+            fetch.rpc.destroy();
+            --rebuild.outstanding;
+        }
+    }
+
+    while (rebuild.received + rebuild.outstanding < needed &&
+           rebuild.nextSource < replica.fragmentSources.size()) {
+        rebuild.fetches.emplace_back(
+                replica.fragmentSources[rebuild.nextSource++]);
+        auto& fetch = rebuild.fetches.back();
+        fetch.rpc.construct(context, fetch.backupId, recoveryId,
+                            crashedMasterId, segmentId, &fetch.response);
+        ++rebuild.outstanding;
+    }
+
+    if (rebuild.received < needed) {
+        if (rebuild.outstanding > 0)
+            return false;
+        LOG(NOTICE, "Couldn't rebuild <%s,%lu> from fragments: not enough "
+            "fragments available", crashedMasterId.toString().c_str(),
+            segmentId);
+        return fail();
+    }
+
+    vector<uint32_t> indexes;
+    vector<const void*> fragments;
+    indexes.push_back(metadata->fragmentIndex);
+    fragments.push_back(replica.frame->load());
+    foreach (auto& fetch, rebuild.fetches) {
+        if (fetch.fragmentIndex == ~0u || indexes.size() == dataFragments)
+            continue;
+        indexes.push_back(fetch.fragmentIndex);
+        fragments.push_back(fetch.response.getRange(0, fragmentLength));
+    }
+
+    LOG(DEBUG, "Rebuilding <%s,%lu> from %u fragments",
+        crashedMasterId.toString().c_str(), segmentId, dataFragments);
+    replica.rebuiltData.reset(new char[segmentSize]);
+    codec.decode(length, &indexes[0], &fragments[0],
+                 replica.rebuiltData.get());
+    buildRecoverySegments(replica);
+    replica.rebuiltData.reset();
+    replica.frame->unload();
+    return true;
+}
+
 // -- BackupMasterRecovery --
 
 BackupMasterRecovery::Replica::Replica(const BackupStorage::FrameRef& frame)
@@ -583,6 +943,20 @@ BackupMasterRecovery::Replica::Replica(const BackupStorage::FrameRef& frame)
     , recoverySegments()
     , recoveryException()
     , built()
+    , fragmentSources()
+    , rebuildQueued()
+    , rebuiltData()
+    , filterClaimed()
+    , filterRequested()
+{
+}
+
+BackupMasterRecovery::FragmentRebuild::FragmentRebuild(Replica* replica)
+    : replica(replica)
+    , fetches()
+    , nextSource()
+    , outstanding()
+    , received()
 {
 }
 
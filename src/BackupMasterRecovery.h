@@ -16,7 +16,12 @@
 #ifndef RAMCLOUD_BACKUPMASTERRECOVERY_H
 #define RAMCLOUD_BACKUPMASTERRECOVERY_H
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include "Common.h"
+#include "BackupClient.h"
 #include "BackupStorage.h"
 #include "Log.h"
 #include "ProtoBuf.h"
@@ -75,7 +80,13 @@ class TaskKiller : public Task {
  *
  * Primary replicas are ONLY filtered by the task queue thread serially.
  * Secondary replicas are ONLY filtered by the sole backup worked thread
- * (and, hence, serially, as well).
+ * (and, hence, serially, as well). The exception is when the recovery is
+ * given filter threads: then those threads filter all (non-fragment)
+ * replicas in parallel, each replica being claimed by exactly one of them
+ * under #filterMutex, and the worker thread only queues requests for them.
+ * Fragments of erasure-coded segments
+ * are the exception: they are rebuilt and filtered by the task queue thread,
+ * since collecting the other fragments means waiting on other backups.
  * The only miniscule synchronization it to ensure that all built
  * recovery segment information is flushed to main memory before it is used
  * by getRecoverySegment().
@@ -88,10 +99,12 @@ class BackupMasterRecovery : public Task {
   PUBLIC:
     typedef WireFormat::BackupStartReadingData::Response StartResponse;
 
-    BackupMasterRecovery(TaskQueue& taskQueue,
+    BackupMasterRecovery(Context* context,
+                         TaskQueue& taskQueue,
                          uint64_t recoveryId,
                          ServerId crashedMasterId,
-                         uint32_t segmentSize);
+                         uint32_t segmentSize,
+                         uint32_t numFilterThreads = 0);
     ~BackupMasterRecovery();
     void start(const std::vector<BackupStorage::FrameRef>& frames,
                Buffer* buffer,
@@ -101,7 +114,12 @@ class BackupMasterRecovery : public Task {
                               uint64_t segmentId,
                               int partitionId,
                               Buffer* buffer,
-                              SegmentCertificate* certificate);
+                              SegmentCertificate* certificate,
+                              const vector<ServerId>* fragmentSources = NULL);
+    void getFragment(uint64_t recoveryId,
+                     uint64_t segmentId,
+                     Buffer* buffer,
+                     WireFormat::BackupGetFragment::Response* response);
     void free();
     uint64_t getRecoveryId();
     void performTask();
@@ -112,6 +130,17 @@ class BackupMasterRecovery : public Task {
     struct Replica;
     void buildRecoverySegments(Replica& replica);
     bool getLogDigest(Replica& replica, Buffer* digestBuffer);
+    struct FragmentRebuild;
+    bool rebuildFromFragments(FragmentRebuild& rebuild);
+    typedef std::unique_lock<std::mutex> FilterLock;
+    void filterMain();
+    Replica* claimReplicaToFilter(FilterLock& lock);
+
+    /**
+     * Shared RAMCloud information; used to fetch fragments from other
+     * backups when rebuilding erasure-coded segments.
+     */
+    Context* context;
 
     /**
      * Which master recovery this is for. The coordinator may schedule
@@ -220,9 +249,93 @@ class BackupMasterRecovery : public Task {
          */
         bool built;
 
+        /**
+         * Only for fragments of erasure-coded segments: the other backups
+         * which hold fragments of the segment, as given by the first recovery
+         * master to ask for it. Set by the backup worker thread before the
+         * replica is queued on #pendingRebuilds; read-only afterwards.
+         */
+        vector<ServerId> fragmentSources;
+
+        /**
+         * Only for fragments: set by the worker thread once the replica has
+         * been queued on #pendingRebuilds, so it is only rebuilt once.
+         */
+        bool rebuildQueued;
+
+        /**
+         * Only for fragments: the decoded contents of the whole segment,
+         * which buildRecoverySegments() filters instead of the frame. Only
+         * touched by the task queue thread, and freed once filtered.
+         */
+        std::unique_ptr<char[]> rebuiltData;
+
+        /**
+         * Only with filter threads: set, under #filterMutex, by the filter
+         * thread which takes on building this replica's recovery segments,
+         * so that no other thread builds them too.
+         */
+        bool filterClaimed;
+
+        /**
+         * Only with filter threads: set, under #filterMutex, once the replica
+         * has been put on #requestedReplicas.
+         */
+        bool filterRequested;
+
         DISALLOW_COPY_AND_ASSIGN(Replica);
     };
 
+    /**
+     * State of the erasure-coded segment currently being rebuilt by
+     * performTask() from the fragment stored here and fragments fetched
+     * from other backups. Only touched by the task queue thread.
+     */
+    struct FragmentRebuild {
+        explicit FragmentRebuild(Replica* replica);
+
+        /// A request for one other backup's fragment of the segment.
+        struct Fetch {
+            explicit Fetch(ServerId backupId)
+                : backupId(backupId)
+                , response()
+                , rpc()
+                , fragmentIndex(~0u)
+            {}
+
+            /// Backup the fragment was requested from.
+            ServerId backupId;
+
+            /// Holds the fragment once #rpc completes.
+            Buffer response;
+
+            /// Outstanding request; destroyed once it has completed.
+            Tub<GetFragmentRpc> rpc;
+
+            /// Which fragment arrived in #response; ~0u if none (yet).
+            uint32_t fragmentIndex;
+
+            DISALLOW_COPY_AND_ASSIGN(Fetch);
+        };
+
+        /// Fragment stored on this backup for the segment to rebuild.
+        Replica* replica;
+
+        /// One entry per fragment requested so far.
+        std::deque<Fetch> fetches;
+
+        /// Index into replica->fragmentSources of the next backup to ask.
+        size_t nextSource;
+
+        /// Number of entries in #fetches whose rpc is still outstanding.
+        uint32_t outstanding;
+
+        /// Number of entries in #fetches holding a usable fragment.
+        uint32_t received;
+
+        DISALLOW_COPY_AND_ASSIGN(FragmentRebuild);
+    };
+
     /**
      * Recovery state for each replica that is part of the recovery.
      * Stored in two "halves". The first part contains all replicas
@@ -240,7 +353,8 @@ class BackupMasterRecovery : public Task {
     /**
      * Tracks which primary replica is the next to be filtered in the
      * background. Set initially in start() when replicas is constructed,
-     * and used/incremented in performTask() as replicas are filtered.
+     * and used/incremented in performTask() as replicas are filtered (or,
+     * with filter threads, by claimReplicaToFilter() under #filterMutex).
      */
     std::deque<Replica>::iterator nextToBuild;
 
@@ -265,6 +379,73 @@ class BackupMasterRecovery : public Task {
      */
     std::unordered_map<uint64_t, Replica*> segmentIdToReplica;
 
+    /**
+     * Fragments which a recovery master has asked for recovery segments of
+     * and which are waiting to be rebuilt by performTask(), in order.
+     * Protected by #rebuildMutex, since they are queued by the backup worker
+     * thread.
+     */
+    std::deque<Replica*> pendingRebuilds;
+
+    /// Protects #pendingRebuilds.
+    SpinLock rebuildMutex;
+
+    /**
+     * The rebuild performTask() is working on, if any. Only touched by the
+     * task queue thread.
+     */
+    Tub<FragmentRebuild> rebuild;
+
+    /**
+     * Number of threads which build recovery segments in parallel once
+     * setPartitionsAndSchedule() is called. If 0, performTask() builds those
+     * of primary replicas one at a time on the task queue thread and the
+     * backup worker thread builds those of secondaries on demand.
+     */
+    const uint32_t numFilterThreads;
+
+    /**
+     * Threads running filterMain(); started by setPartitionsAndSchedule()
+     * and joined by the destructor.
+     */
+    std::vector<std::thread> filterThreads;
+
+    /**
+     * Protects #requestedReplicas, #nextToBuild, #primariesFiltered,
+     * #stopFiltering, and the filterClaimed and filterRequested fields of
+     * replicas when there are filter threads.
+     */
+    std::mutex filterMutex;
+
+    /**
+     * Notified when a replica is added to #requestedReplicas and when
+     * #stopFiltering is set.
+     */
+    std::condition_variable filterWork;
+
+    /**
+     * Replicas a recovery master has asked for recovery segments from
+     * before they were built, in the order they were asked for. Filter
+     * threads take these before continuing down #replicas in order, so
+     * that backups filter in the order recovery masters consume.
+     */
+    std::deque<Replica*> requestedReplicas;
+
+    /**
+     * Number of primary replicas the filter threads have finished with;
+     * once it reaches #numPrimaries the time spent is logged.
+     */
+    size_t primariesFiltered;
+
+    /// Tells filter threads to exit; set by the destructor.
+    bool stopFiltering;
+
+    /**
+     * False until getRecoverySegment() first returns a recovery segment;
+     * used to report how long recovery masters waited for the first one.
+     */
+    bool firstSegmentServed;
+
     /**
      * Caches the log digest extracted from the replicas for this
      * crashed master, if any.
@@ -384,7 +565,10 @@ class BackupReplicaMetadata {
                           uint32_t segmentCapacity,
                           uint64_t segmentEpoch,
                           bool closed,
-                          bool primary)
+                          bool primary,
+                          uint8_t dataFragments = 0,
+                          uint8_t parityFragments = 0,
+                          uint8_t fragmentIndex = 0)
         : certificate(certificate)
         , logId(logId)
         , segmentId(segmentId)
@@ -392,6 +576,9 @@ class BackupReplicaMetadata {
         , segmentEpoch(segmentEpoch)
         , closed(closed)
         , primary(primary)
+        , dataFragments(dataFragments)
+        , parityFragments(parityFragments)
+        , fragmentIndex(fragmentIndex)
         , checksum()
     {
         Crc32C calculatedChecksum;
@@ -472,6 +659,23 @@ class BackupReplicaMetadata {
      */
     bool primary;
 
+    /**
+     * If nonzero, the frame holds fragment #fragmentIndex of the segment
+     * rather than a copy of it: the segment was erasure coded into this
+     * many data fragments and #parityFragments parity fragments (see
+     * ReedSolomon), any dataFragments of which rebuild it. #certificate
+     * describes the whole segment, not the fragment.
+     */
+    uint8_t dataFragments;
+
+    /// Number of parity fragments the segment was encoded with, if the
+    /// frame holds a fragment. See #dataFragments.
+    uint8_t parityFragments;
+
+    /// Which fragment of the segment the frame holds, if it holds a
+    /// fragment. See #dataFragments.
+    uint8_t fragmentIndex;
+
   PRIVATE:
     /**
      * Checksum of all the above fields. Must come last in the class.
@@ -482,7 +686,7 @@ class BackupReplicaMetadata {
     Crc32C::ResultType checksum;
 } __attribute__((packed));
 // Substitute for std::is_trivially_copyable until we have real C++11.
-static_assert(sizeof(BackupReplicaMetadata) == 42,
+static_assert(sizeof(BackupReplicaMetadata) == 45,
               "Unexpected padding in BackupReplicaMetadata");
 
 } // namespace RAMCloud
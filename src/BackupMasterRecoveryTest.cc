@@ -27,6 +27,7 @@
 namespace RAMCloud {
 
 struct BackupMasterRecoveryTest : public ::testing::Test {
+    Context context;
     TaskQueue taskQueue;
     ProtoBuf::RecoveryPartition partitions;
     uint32_t segmentSize;
@@ -37,7 +38,8 @@ struct BackupMasterRecoveryTest : public ::testing::Test {
     Tub<BackupMasterRecovery> recovery;
 
     BackupMasterRecoveryTest()
-        : taskQueue()
+        : context()
+        , taskQueue()
         , partitions()
         , segmentSize()
         , storage(1024, 6, 0)
@@ -58,20 +60,23 @@ struct BackupMasterRecoveryTest : public ::testing::Test {
             ProtoBuf::Tablets::Tablet& tablet(*partitions.add_tablet());
             tablet = tablets.tablet(i);
         }
-        recovery.construct(taskQueue, 456lu, ServerId{99, 0}, segmentSize);
+        recovery.construct(&context, taskQueue, 456lu, ServerId{99, 0},
+                           segmentSize);
     }
 
     void
     mockMetadata(uint64_t segmentId,
                  bool closed = true, bool primary = false,
-                 bool screwItUp = false)
+                 bool screwItUp = false,
+                 uint8_t dataFragments = 0, uint8_t fragmentIndex = 0)
     {
         frames.emplace_back(storage.open(true, ServerId(), 0));
         SegmentCertificate certificate;
         uint32_t epoch = downCast<uint32_t>(segmentId) + 100;
         BackupReplicaMetadata metadata(certificate, crashedMasterId.getId(),
                                        segmentId, 1024, epoch,
-                                       closed, primary);
+                                       closed, primary, dataFragments,
+                                       dataFragments ? 1 : 0, fragmentIndex);
         if (screwItUp)
             metadata.checksum = 0;
         frames.back()->append(source, 0, 0, 0, &metadata, sizeof(metadata));
@@ -197,7 +202,8 @@ TEST_F(BackupMasterRecoveryTest, start) {
 }
 
 TEST_F(BackupMasterRecoveryTest, setPartitionsAndSchedule) {
-    recovery.construct(taskQueue, 456lu, ServerId{99, 0}, segmentSize);
+    recovery.construct(&context, taskQueue, 456lu, ServerId{99, 0},
+                       segmentSize);
 
     TestLog::Enable _;
     recovery->startCompleted = true;
@@ -307,10 +313,87 @@ TEST_F(BackupMasterRecoveryTest, getRecoverySegment_badArgs) {
                  BackupBadSegmentIdException);
 }
 
+TEST_F(BackupMasterRecoveryTest, getRecoverySegment_fragment) {
+    mockMetadata(88, true, false, false, 1, 1); // parity of a 1+1 code
+    recovery->testingSkipBuild = true;
+    recovery->start(frames, NULL, NULL);
+    recovery->setPartitionsAndSchedule(partitions);
+    taskQueue.performTask();
+    EXPECT_FALSE(recovery->isScheduled());
+
+    vector<ServerId> sources{ServerId(2, 0)};
+    EXPECT_THROW(recovery->getRecoverySegment(456, 88, 0, NULL, NULL,
+                                              &sources),
+                 RetryException);
+    EXPECT_TRUE(recovery->isScheduled());
+    EXPECT_EQ(1u, recovery->replicas[0].fragmentSources.size());
+    // Asking again doesn't queue the segment twice.
+    EXPECT_THROW(recovery->getRecoverySegment(456, 88, 0, NULL, NULL),
+                 RetryException);
+    EXPECT_EQ(1u, recovery->pendingRebuilds.size());
+
+    // A single fragment suffices for a 1+1 code: nothing to fetch.
+    TestLog::Enable _;
+    taskQueue.performTask();
+    EXPECT_EQ(0u, recovery->pendingRebuilds.size());
+    EXPECT_FALSE(recovery->rebuild);
+    EXPECT_TRUE(recovery->replicas[0].built);
+    EXPECT_FALSE(recovery->replicas[0].rebuiltData);
+    EXPECT_EQ(STATUS_OK,
+              recovery->getRecoverySegment(456, 88, 0, NULL, NULL));
+    taskQueue.performTask();
+    EXPECT_FALSE(recovery->isScheduled());
+}
+
+TEST_F(BackupMasterRecoveryTest, rebuildFromFragments_notEnoughFragments) {
+    mockMetadata(88, true, false, false, 2, 0);
+    recovery->testingSkipBuild = true;
+    recovery->start(frames, NULL, NULL);
+    recovery->setPartitionsAndSchedule(partitions);
+    EXPECT_THROW(recovery->getRecoverySegment(456, 88, 0, NULL, NULL),
+                 RetryException);
+    TestLog::Enable _("rebuildFromFragments");
+    taskQueue.performTask();
+    EXPECT_EQ("rebuildFromFragments: Couldn't rebuild <99.0,88> from "
+              "fragments: not enough fragments available", TestLog::get());
+    EXPECT_THROW(recovery->getRecoverySegment(456, 88, 0, NULL, NULL),
+                 SegmentRecoveryFailedException);
+}
+
+TEST_F(BackupMasterRecoveryTest, getFragment) {
+    frames.emplace_back(storage.open(true, ServerId(), 0));
+    SegmentCertificate certificate;
+    certificate.segmentLength = 10;
+    BackupReplicaMetadata metadata(certificate, crashedMasterId.getId(),
+                                   88, 1024, 188, true, false, 2, 1, 2);
+    frames.back()->append(source, 0, 5, 0, &metadata, sizeof(metadata));
+    mockMetadata(89);
+    recovery->start(frames, NULL, NULL);
+
+    Buffer buffer;
+    WireFormat::BackupGetFragment::Response response;
+    recovery->getFragment(456, 88, &buffer, &response);
+    EXPECT_EQ(5u, buffer.size());
+    EXPECT_STREQ("test", buffer.getStart<char>());
+    EXPECT_EQ(5u, response.length);
+    EXPECT_EQ(2u, response.dataFragments);
+    EXPECT_EQ(1u, response.parityFragments);
+    EXPECT_EQ(2u, response.fragmentIndex);
+    EXPECT_EQ(10u, response.certificate.segmentLength);
+
+    EXPECT_THROW(recovery->getFragment(455, 88, &buffer, &response),
+                 BackupBadSegmentIdException);
+    // Full replicas and unknown segments have no fragment to hand out.
+    EXPECT_THROW(recovery->getFragment(456, 89, &buffer, &response),
+                 BackupBadSegmentIdException);
+    EXPECT_THROW(recovery->getFragment(456, 90, &buffer, &response),
+                 BackupBadSegmentIdException);
+}
+
 TEST_F(BackupMasterRecoveryTest, free) {
     std::unique_ptr<BackupMasterRecovery> recovery(
-        new BackupMasterRecovery(taskQueue, 456lu, ServerId{99, 0},
-                                 segmentSize));
+        new BackupMasterRecovery(&context, taskQueue, 456lu,
+                                 ServerId{99, 0}, segmentSize));
     TestLog::Enable _;
     recovery->free();
     taskQueue.performTask();
@@ -345,6 +428,31 @@ TEST_F(BackupMasterRecoveryTest, performTask) {
         TestLog::get());
 }
 
+TEST_F(BackupMasterRecoveryTest, claimReplicaToFilter) {
+    mockMetadata(88, true, true);
+    mockMetadata(89, true, true);
+    mockMetadata(90, true, false);
+    recovery->testingSkipBuild = true;
+    recovery->start(frames, NULL, NULL);
+    recovery->setPartitionsAndSchedule(partitions);
+
+    // Requested replicas go first, in request order; primaries follow (most
+    // recent first), skipping those already claimed.
+    recovery->requestedReplicas.push_back(&recovery->replicas.at(2));
+    recovery->requestedReplicas.push_back(&recovery->replicas.at(1));
+    recovery->requestedReplicas.push_back(&recovery->replicas.at(2));
+    BackupMasterRecovery::FilterLock lock(recovery->filterMutex);
+    EXPECT_EQ(90lu,
+        recovery->claimReplicaToFilter(lock)->metadata->segmentId);
+    EXPECT_EQ(88lu,
+        recovery->claimReplicaToFilter(lock)->metadata->segmentId);
+    EXPECT_EQ(89lu,
+        recovery->claimReplicaToFilter(lock)->metadata->segmentId);
+    EXPECT_TRUE(NULL == recovery->claimReplicaToFilter(lock));
+    EXPECT_TRUE(recovery->requestedReplicas.empty());
+    EXPECT_EQ(recovery->firstSecondaryReplica, recovery->nextToBuild);
+}
+
 namespace {
 bool buildRecoverySegmentsFilter(string s) {
     return s == "buildRecoverySegments";
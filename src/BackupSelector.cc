@@ -52,13 +52,18 @@ BackupStats::getExpectedReadMs() {
  *      The replication factor of each segment.
  * \param allowLocalBackup
  *      Specifies whether to allow replication to the local backup.
+ * \param keepLocalReplica
+ *      Specifies whether primary replicas should be placed on the local
+ *      backup whenever possible; see selectPrimary().
  */
 BackupSelector::BackupSelector(Context* context, const ServerId* serverId,
-                               uint32_t numReplicas, bool allowLocalBackup)
+                               uint32_t numReplicas, bool allowLocalBackup,
+                               bool keepLocalReplica)
     : tracker(context)
     , serverId(serverId)
     , numReplicas(numReplicas)
     , allowLocalBackup(allowLocalBackup)
+    , keepLocalReplica(keepLocalReplica)
     , replicationIdMap()
     , okToLogNextProblem(true)
 {
@@ -69,6 +74,9 @@ BackupSelector::BackupSelector(Context* context, const ServerId* serverId,
  * backups choose the one that will minimize expected time to read replicas
  * from disk in the case that this master should crash. The ServerId returned
  * is !isValid() if there are no machines to selectSecondary() from.
+ * If #keepLocalReplica is set then the local backup is chosen instead
+ * whenever it is up and doesn't conflict with \a backupIds, so that the
+ * local backup holds a replica of every segment.
  * \param numBackups
  *      The number of entries in the \a backupIds array.
  * \param backupIds
@@ -80,6 +88,14 @@ ServerId
 BackupSelector::selectPrimary(uint32_t numBackups,
                               const ServerId backupIds[])
 {
+    if (keepLocalReplica) {
+        ServerId local = selectLocal(numBackups, backupIds);
+        if (local.isValid()) {
+            ++tracker[local]->primaryReplicaCount;
+            return local;
+        }
+    }
+
     ServerId primary = selectSecondary(numBackups, backupIds);
     if (!primary.isValid())
         return primary;
@@ -155,6 +171,55 @@ BackupSelector::signalFreedPrimary(const ServerId backupId)
     --stats->primaryReplicaCount;
 }
 
+/**
+ * From a set of 5 backups that does not conflict with an existing set of
+ * backups choose the one holding the fewest fragments of this master's
+ * erasure-coded segments. Fragments are all secondaries, so rather than
+ * balancing expected disk read time this spreads the work of rebuilding
+ * segments from fragments during recovery. The ServerId returned is
+ * !isValid() if there are no machines to selectSecondary() from.
+ * \param numBackups
+ *      The number of entries in the \a backupIds array.
+ * \param backupIds
+ *      An array of numBackups backup ids, none of which may conflict with the
+ *      returned backup. The locations of all the other fragments of the
+ *      segment as well as the server id of the master should be listed.
+ */
+ServerId
+BackupSelector::selectFragment(uint32_t numBackups,
+                               const ServerId backupIds[])
+{
+    ServerId chosen = selectSecondary(numBackups, backupIds);
+    if (!chosen.isValid())
+        return chosen;
+
+    for (uint32_t i = 0; i < 5 - 1; ++i) {
+        ServerId candidate = selectSecondary(numBackups, backupIds);
+        if (!candidate.isValid())
+            break;
+        if (tracker[chosen]->fragmentCount > tracker[candidate]->fragmentCount)
+            chosen = candidate;
+    }
+    ++tracker[chosen]->fragmentCount;
+    return chosen;
+}
+
+/**
+ * Inform the BackupSelector that a fragment has been freed from backupId,
+ * so it can maintain proper stats. Only called for fragments chosen by
+ * selectFragment().
+ * \param backupId
+ *      The ServerId of the backup whose fragment the BackupSelector should
+ *      now recognize as freed.
+ */
+void
+BackupSelector::signalFreedFragment(const ServerId backupId)
+{
+    BackupStats* stats = tracker[backupId];
+    if (stats)
+        --stats->fragmentCount;
+}
+
 // - private -
 
 /**
@@ -238,6 +303,38 @@ BackupSelector::conflictWithAny(const ServerId backupId,
     return false;
 }
 
+/**
+ * Return the id of the backup in this server's own process if it is up and
+ * doesn't conflict with any of \a backupIds, otherwise an invalid ServerId.
+ * Used to place primary replicas locally; see #keepLocalReplica.
+ *
+ * \param numBackups
+ *      The number of entries in the \a backupIds array.
+ * \param backupIds
+ *      An array of numBackups backup ids, none of which may conflict with the
+ *      returned backup.
+ */
+ServerId
+BackupSelector::selectLocal(uint32_t numBackups, const ServerId backupIds[])
+{
+    applyTrackerChanges();
+    for (uint32_t i = 0; i < numBackups; ++i) {
+        if (conflict(*serverId, backupIds[i]))
+            return ServerId();
+    }
+    try {
+        ServerDetails* details = tracker.getServerDetails(*serverId);
+        if (details->status == ServerStatus::UP &&
+                details->services.has(WireFormat::BACKUP_SERVICE) &&
+                tracker[*serverId] != NULL) {
+            return *serverId;
+        }
+    } catch (const Exception& e) {
+        // This server hasn't enlisted or isn't in the tracker yet.
+    }
+    return ServerId();
+}
+
 /**
  * Remove an entry from the \a replicationIdMap.
  * \param replicationId
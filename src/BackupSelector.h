@@ -31,6 +31,7 @@ namespace RAMCloud {
 struct BackupStats {
     BackupStats()
         : primaryReplicaCount(0)
+        , fragmentCount(0)
         , expectedReadMBytesPerSec(0)
         , replicationId(0)
     {}
@@ -40,6 +41,10 @@ struct BackupStats {
     /// Number of primary replicas this master has stored on the backup.
     uint32_t primaryReplicaCount;
 
+    /// Number of fragments of erasure-coded segments this master has stored
+    /// on the backup (see ReedSolomon).
+    uint32_t fragmentCount;
+
     /// Disk bandwidth of the host in MB/s
     uint32_t expectedReadMBytesPerSec;
 
@@ -60,6 +65,12 @@ class BaseBackupSelector {
     virtual ServerId selectSecondary(uint32_t numBackups,
                                      const ServerId backupIds[]) = 0;
     virtual void signalFreedPrimary(const ServerId backupId) = 0;
+    virtual ServerId selectFragment(uint32_t numBackups,
+                                    const ServerId backupIds[])
+    {
+        return selectSecondary(numBackups, backupIds);
+    }
+    virtual void signalFreedFragment(const ServerId backupId) {}
     virtual ~BaseBackupSelector() {}
 };
 
@@ -72,17 +83,21 @@ class BackupSelector : public BaseBackupSelector {
   PUBLIC:
 
     explicit BackupSelector(Context* context, const ServerId* serverId,
-                            uint32_t numReplicas, bool allowLocalBackup);
+                            uint32_t numReplicas, bool allowLocalBackup,
+                            bool keepLocalReplica = false);
     ServerId selectPrimary(uint32_t numBackups, const ServerId backupIds[]);
     virtual ServerId selectSecondary(uint32_t numBackups,
                                      const ServerId backupIds[]);
     void signalFreedPrimary(const ServerId backupId);
+    ServerId selectFragment(uint32_t numBackups, const ServerId backupIds[]);
+    void signalFreedFragment(const ServerId backupId);
 
   PROTECTED:
     void applyTrackerChanges();
     bool conflictWithAny(const ServerId backupId,
                          uint32_t numBackups,
                          const ServerId backupIds[]) const;
+    ServerId selectLocal(uint32_t numBackups, const ServerId backupIds[]);
     /**
      * A ServerTracker used to find backups and track replica distribution
      * stats.  Each entry in the tracker contains a pointer to a BackupStats
@@ -106,6 +121,12 @@ class BackupSelector : public BaseBackupSelector {
      */
     bool allowLocalBackup;
 
+    /**
+     * Specifies whether selectPrimary() should choose the local backup
+     * whenever it is up and doesn't conflict with the other replicas.
+     */
+    bool keepLocalReplica;
+
     /**
      * Maps replication groups to servers. Used for selecting secondary
      * replicas with MinCopysets.
@@ -194,6 +194,35 @@ TEST_F(BackupSelectorTest, selectPrimaryEvenPrimaryPlacement) {
               5U); // range < 5 won't fail often
 }
 
+TEST_F(BackupSelectorTest, selectPrimary_keepLocalReplica) {
+    std::vector<ServerId> ids;
+    addEqualHosts(ids);
+    ServerConfig config = ServerConfig::forTesting();
+    config.services = {WireFormat::MASTER_SERVICE,
+                       WireFormat::BACKUP_SERVICE,
+                       WireFormat::ADMIN_SERVICE};
+    config.localLocator = "mock:host=local";
+    config.master.keepLocalReplica = true;
+    Server* server = cluster.addServer(config);
+    selector = server->master->objectManager.replicaManager.
+        backupSelector.get();
+
+    ServerId local = server->serverId;
+    selector->applyTrackerChanges();
+    uint32_t primaryReplicaCount =
+        selector->tracker[local]->primaryReplicaCount;
+    EXPECT_EQ(local, selector->selectPrimary(0, NULL));
+    EXPECT_EQ(local, selector->selectPrimary(0, NULL));
+    EXPECT_EQ(primaryReplicaCount + 2,
+              selector->tracker[local]->primaryReplicaCount);
+
+    // The local backup already holds a replica of the segment.
+    ServerId constraint[] = { local };
+    ServerId id = selector->selectPrimary(1, constraint);
+    EXPECT_TRUE(id.isValid());
+    EXPECT_NE(local, id);
+}
+
 TEST_F(BackupSelectorTest, selectSecondary) {
     MockRandom _(1);
     std::vector<ServerId> ids;
@@ -250,6 +279,37 @@ TEST_F(BackupSelectorTest, signalFreedPrimary) {
     EXPECT_EQ(9u, stats->primaryReplicaCount);
 }
 
+TEST_F(BackupSelectorTest, selectFragment) {
+    std::vector<ServerId> ids;
+    addEqualHosts(ids);
+
+    uint32_t fragmentCounts[9] = {};
+    for (uint32_t i = 0; i < 900; ++i) {
+        ServerId backup = selector->selectFragment(0, NULL);
+        ++fragmentCounts[lastChar(selector->tracker.getLocator(backup)) - '1'];
+    }
+    EXPECT_LT(*std::max_element(fragmentCounts, fragmentCounts + 9) -
+              *std::min_element(fragmentCounts, fragmentCounts + 9),
+              5U); // range < 5 won't fail often
+    EXPECT_EQ(fragmentCounts[0], selector->tracker[ids[0]]->fragmentCount);
+    EXPECT_EQ(0u, selector->tracker[ids[0]]->primaryReplicaCount);
+
+    const ServerId conflicts[] = { ids[0], ids[1], ids[2], ids[3], ids[4],
+                                   ids[5], ids[6], ids[7] };
+    EXPECT_EQ(ids[8], selector->selectFragment(8, conflicts));
+}
+
+TEST_F(BackupSelectorTest, signalFreedFragment) {
+    std::vector<ServerId> ids;
+    addEqualHosts(ids);
+    selector->applyTrackerChanges();
+
+    BackupStats *stats = selector->tracker[ids[0]];
+    stats->fragmentCount = 10;
+    selector->signalFreedFragment(ids[0]);
+    EXPECT_EQ(9u, stats->fragmentCount);
+}
+
 #if 0
 // This test should run forever, hence why it is commented out.
 // Occasionally, when self-doubt mounts, it is worth running, though.
@@ -18,6 +18,10 @@
 #include "ClientException.h"
 #include "Cycles.h"
 #include "InMemoryStorage.h"
+#ifdef IO_URING
+#include "IoUringStorage.h"
+#endif
+#include "MappedStorage.h"
 #include "PerfStats.h"
 #include "ServerConfig.h"
 #include "ShortMacros.h"
@@ -59,10 +63,24 @@ BackupService::BackupService(Context* context,
     , oldReplicas(0)
 {
     context->services[WireFormat::BACKUP_SERVICE] = this;
+    size_t fragmentFrameSize = config->backup.fragmentFrameSize;
+    if (fragmentFrameSize == 0)
+        fragmentFrameSize = config->segmentSize / 4;
     if (config->backup.inMemory) {
         storage.reset(new InMemoryStorage(config->segmentSize,
                                           config->backup.numSegmentFrames,
-                                          config->backup.writeRateLimit));
+                                          config->backup.writeRateLimit,
+                                          config->backup.numFragmentFrames,
+                                          fragmentFrameSize));
+    } else if (config->backup.mapped) {
+        if (config->backup.numFragmentFrames != 0) {
+            LOG(WARNING, "Mapped backup storage has no fragment frames; "
+                "fragments will take whole segment frames");
+        }
+        storage.reset(new MappedStorage(config->segmentSize,
+                                        config->backup.numSegmentFrames,
+                                        config->backup.writeRateLimit,
+                                        config->backup.file.c_str()));
     } else {
         size_t maxWriteBuffers = config->backup.maxNonVolatileBuffers;
         if (maxWriteBuffers == 0) {
@@ -73,12 +91,34 @@ BackupService::BackupService(Context* context,
             maxWriteBuffers = config->backup.numSegmentFrames;
         }
 
-        storage.reset(new MultiFileStorage(config->segmentSize,
-                                           config->backup.numSegmentFrames,
-                                           config->backup.writeRateLimit,
-                                           maxWriteBuffers,
-                                           config->backup.file.c_str(),
-                                           O_DIRECT | O_SYNC));
+#ifdef IO_URING
+        if (config->backup.ioUring && IoUringStorage::isSupported()) {
+            storage.reset(new IoUringStorage(config->segmentSize,
+                                             config->backup.numSegmentFrames,
+                                             config->backup.writeRateLimit,
+                                             maxWriteBuffers,
+                                             config->backup.file.c_str(),
+                                             O_DIRECT | O_SYNC,
+                                             config->backup.groupCommit,
+                                             config->backup.numFragmentFrames,
+                                             fragmentFrameSize));
+        } else
+#endif
+        {
+            if (config->backup.ioUring) {
+                LOG(WARNING, "io_uring isn't available; backup storage "
+                    "will use POSIX aio instead");
+            }
+            storage.reset(new MultiFileStorage(config->segmentSize,
+                                               config->backup.numSegmentFrames,
+                                               config->backup.writeRateLimit,
+                                               maxWriteBuffers,
+                                               config->backup.file.c_str(),
+                                               O_DIRECT | O_SYNC,
+                                               config->backup.groupCommit,
+                                               config->backup.numFragmentFrames,
+                                               fragmentFrameSize));
+        }
     }
     if (storage->getMetadataSize() < sizeof(BackupReplicaMetadata))
         DIE("Storage metadata block too small to hold BackupReplicaMetadata");
@@ -194,6 +234,10 @@ BackupService::dispatch(WireFormat::Opcode opcode, Rpc* rpc)
             callHandler<WireFormat::BackupFree, BackupService,
                         &BackupService::freeSegment>(rpc);
             break;
+        case WireFormat::BackupGetFragment::opcode:
+            callHandler<WireFormat::BackupGetFragment, BackupService,
+                        &BackupService::getFragment>(rpc);
+            break;
         case WireFormat::BackupGetRecoveryData::opcode:
             callHandler<WireFormat::BackupGetRecoveryData, BackupService,
                         &BackupService::getRecoveryData>(rpc);
@@ -267,11 +311,15 @@ BackupService::freeSegment(const WireFormat::BackupFree::Request* reqHdr,
  * \param rpc
  *      The Rpc being serviced.  A back-to-back list of RecoveredObjects
  *      follows the respHdr in this buffer of length
- *      respHdr->recoveredObjectCount.
+ *      respHdr->recoveredObjectCount. Only the range of the recovery
+ *      segment given by reqHdr->offset and reqHdr->maxLength is returned,
+ *      so large recovery segments can be fetched in pieces.
  *
  * \throw BackupBadSegmentIdException
  *      If the segment has not had recovery started for it (startReadingData()
  *      must have been called for its corresponding master id).
+ * \throw InvalidParameterException
+ *      If reqHdr->offset is past the end of the recovery segment.
  */
 void
 BackupService::getRecoveryData(
@@ -292,22 +340,84 @@ BackupService::getRecoveryData(
         throw BackupBadSegmentIdException(HERE);
     }
 
+    vector<ServerId> fragmentSources;
+    uint32_t offset = sizeof32(*reqHdr);
+    for (uint32_t i = 0; i < reqHdr->fragmentSourceCount; ++i) {
+        const uint64_t* source =
+            rpc->requestPayload->getOffset<uint64_t>(offset);
+        if (source == NULL)
+            throw MessageTooShortError(HERE);
+        fragmentSources.push_back(ServerId(*source));
+        offset += sizeof32(*source);
+    }
+
+    // #segment refers to memory held by the recovery, which outlives this
+    // rpc; Buffer::append() copies anything else, so only the requested
+    // range needs to go into the reply.
+    Buffer segment;
     Status status =
         recoveryIt->second->getRecoverySegment(reqHdr->recoveryId,
                                                reqHdr->segmentId,
                                                downCast<int>(
                                                    reqHdr->partitionId),
-                                               rpc->replyPayload,
-                                               &respHdr->certificate);
+                                               &segment,
+                                               &respHdr->certificate,
+                                               &fragmentSources);
     if (status != STATUS_OK) {
         respHdr->common.status = status;
         return;
     }
 
+    respHdr->segmentLength = segment.size();
+    if (reqHdr->offset > segment.size())
+        throw InvalidParameterException(HERE);
+    uint32_t length = segment.size() - reqHdr->offset;
+    if (reqHdr->maxLength != 0)
+        length = std::min(length, reqHdr->maxLength);
+    rpc->replyPayload->append(&segment, reqHdr->offset, length);
+
+    if (reqHdr->offset + length < segment.size())
+        return;
     ++metrics->backup.readCompletionCount;
     LOG(DEBUG, "getRecoveryData complete");
 }
 
+/**
+ * Return this backup's fragment of an erasure-coded segment, so that another
+ * backup can rebuild the segment from it during a recovery of the master
+ * that wrote it. See BackupClient::getFragment for details.
+ *
+ * \param reqHdr
+ *      Header of the Rpc request containing the recovery, master and
+ *      segment ids.
+ * \param respHdr
+ *      Header for the Rpc response; describes the fragment, which follows
+ *      respHdr in the response payload.
+ * \param rpc
+ *      The Rpc being serviced.
+ *
+ * \throw BackupBadSegmentIdException
+ *      If the master isn't under recovery on this backup, or this backup
+ *      holds no fragment for the segment.
+ */
+void
+BackupService::getFragment(
+    const WireFormat::BackupGetFragment::Request* reqHdr,
+    WireFormat::BackupGetFragment::Response* respHdr,
+    Rpc* rpc)
+{
+    ServerId crashedMasterId(reqHdr->masterId);
+    auto recoveryIt = recoveries.find(crashedMasterId);
+    if (recoveryIt == recoveries.end()) {
+        LOG(WARNING, "Asked for fragment of <%s,%lu> but the master "
+            "wasn't under recovery on the backup",
+            crashedMasterId.toString().c_str(), reqHdr->segmentId);
+        throw BackupBadSegmentIdException(HERE);
+    }
+    recoveryIt->second->getFragment(reqHdr->recoveryId, reqHdr->segmentId,
+                                    rpc->replyPayload, respHdr);
+}
+
 /**
  * Perform once-only initialization for the backup service after having
  * enlisted the process with the coordinator.
@@ -474,10 +584,12 @@ BackupService::startReadingData(
     }
     BackupMasterRecovery* recovery;
     if (mustCreateRecovery) {
-        recovery = new BackupMasterRecovery(taskQueue,
+        recovery = new BackupMasterRecovery(context,
+                                            taskQueue,
                                             reqHdr->recoveryId,
                                             crashedMasterId,
-                                            segmentSize);
+                                            segmentSize,
+                                            config->backup.filterThreads);
         recoveries[crashedMasterId] = recovery;
     }
     recovery = recoveries[crashedMasterId];
@@ -607,7 +719,16 @@ BackupService::writeSegment(const WireFormat::BackupWrite::Request* reqHdr,
     if (reqHdr->open && !frame) {
         LOG(DEBUG, "Opening <%s,%lu>", masterId.toString().c_str(),
             segmentId);
-        frame = storage->open(config->backup.sync, masterId, segmentId);
+        if (reqHdr->dataFragments != 0) {
+            // No fragment is longer than this (see
+            // ReedSolomon::getFragmentLength()).
+            size_t fragmentLength = (segmentSize + reqHdr->dataFragments - 1) /
+                                    reqHdr->dataFragments;
+            frame = storage->openFragment(config->backup.sync, masterId,
+                                          segmentId, fragmentLength);
+        } else {
+            frame = storage->open(config->backup.sync, masterId, segmentId);
+        }
         frames[MasterSegmentIdPair(masterId, segmentId)] = frame;
     }
 
@@ -636,7 +757,10 @@ BackupService::writeSegment(const WireFormat::BackupWrite::Request* reqHdr,
                                masterId.getId(), segmentId,
                                segmentSize,
                                reqHdr->segmentEpoch,
-                               reqHdr->close, reqHdr->primary);
+                               reqHdr->close, reqHdr->primary,
+                               reqHdr->dataFragments,
+                               reqHdr->parityFragments,
+                               reqHdr->fragmentIndex);
         }
         frame->append(*rpc->requestPayload, sizeof(*reqHdr),
                       reqHdr->length, reqHdr->offset,
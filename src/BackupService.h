@@ -51,6 +51,10 @@ class BackupService : public Service
     void freeSegment(const WireFormat::BackupFree::Request* reqHdr,
                      WireFormat::BackupFree::Response* respHdr,
                      Rpc* rpc);
+    void getFragment(
+        const WireFormat::BackupGetFragment::Request* reqHdr,
+        WireFormat::BackupGetFragment::Response* respHdr,
+        Rpc* rpc);
     void getRecoveryData(
         const WireFormat::BackupGetRecoveryData::Request* reqHdr,
         WireFormat::BackupGetRecoveryData::Response* respHdr,
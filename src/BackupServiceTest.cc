@@ -294,6 +294,67 @@ TEST_F(BackupServiceTest, getRecoveryData) {
                 BackupBadSegmentIdException);
 }
 
+TEST_F(BackupServiceTest, getRecoveryData_inPieces) {
+    Segment segment;
+    SegmentHeader header(99, 88, 1000);
+    ASSERT_TRUE(segment.append(LOG_ENTRY_TYPE_SEGHEADER,
+                               &header, sizeof(header)));
+    Key key(1, "key", 3);
+    Buffer dataBuffer;
+    Object object(key, "value", 6, 1, 0, dataBuffer);
+    Buffer objectBuffer;
+    object.assembleForLog(objectBuffer);
+    ASSERT_TRUE(segment.append(LOG_ENTRY_TYPE_OBJ, objectBuffer));
+    SegmentCertificate certificate;
+    uint32_t length = segment.getAppendedLength(&certificate);
+    // Secondary, so its recovery segments are built on the first request
+    // rather than by the background task.
+    BackupClient::writeSegment(&context, backupId, {99, 0}, 88, 0,
+                               &segment, 0, length, &certificate,
+                               true, true, false);
+
+    ProtoBuf::Tablets tablets;
+    TabletsBuilder{tablets}
+        (1, 0, ~0lu, TabletsBuilder::RECOVERING, 0);
+    ProtoBuf::RecoveryPartition recoveryPartition;
+    *recoveryPartition.add_tablet() = tablets.tablet(0);
+    BackupClient::startReadingData(&context, backupId, 456lu, {99, 0});
+    BackupClient::StartPartitioningReplicas(&context, backupId,
+                                          456lu, {99, 0}, &recoveryPartition);
+
+    Buffer whole;
+    uint32_t segmentLength = 0;
+    GetRecoveryDataRpc wholeRpc(&context, backupId, 456lu, {99, 0}, 88, 0,
+                                &whole);
+    wholeRpc.wait(&segmentLength);
+    EXPECT_EQ(whole.size(), segmentLength);
+    ASSERT_LT(10u, segmentLength);
+
+    uint64_t completions = metrics->backup.readCompletionCount;
+    Buffer first;
+    GetRecoveryDataRpc firstRpc(&context, backupId, 456lu, {99, 0}, 88, 0,
+                                &first, NULL, 0, 10);
+    firstRpc.wait(&segmentLength);
+    EXPECT_EQ(whole.size(), segmentLength);
+    EXPECT_EQ(10u, first.size());
+    EXPECT_EQ(completions, metrics->backup.readCompletionCount);
+
+    Buffer rest;
+    GetRecoveryDataRpc restRpc(&context, backupId, 456lu, {99, 0}, 88, 0,
+                               &rest, NULL, 10, segmentLength);
+    restRpc.wait();
+    EXPECT_EQ(segmentLength - 10, rest.size());
+    EXPECT_EQ(completions + 1, metrics->backup.readCompletionCount);
+    EXPECT_EQ(0, memcmp(whole.getRange(0, 10), first.getRange(0, 10), 10));
+    EXPECT_EQ(0, memcmp(whole.getRange(10, rest.size()),
+                        rest.getRange(0, rest.size()), rest.size()));
+
+    Buffer past;
+    GetRecoveryDataRpc pastRpc(&context, backupId, 456lu, {99, 0}, 88, 0,
+                               &past, NULL, segmentLength + 1, 0);
+    EXPECT_THROW(pastRpc.wait(), InvalidParameterException);
+}
+
 TEST_F(BackupServiceTest, restartFromStorage)
 {
     ServerConfig config = ServerConfig::forTesting();
@@ -457,6 +518,25 @@ TEST_F(BackupServiceTest, writeSegment) {
                  static_cast<char*>(frameIt->second->load()) + 10);
 }
 
+TEST_F(BackupServiceTest, writeSegment_fragment) {
+    backup->storage.reset(new InMemoryStorage(config.segmentSize, 5, 0,
+                                              1, config.segmentSize / 4));
+    char fragment[] = "fragment";
+    WriteSegmentRpc(&context, backupId, {99, 0}, 88, 0, fragment, 0,
+                    sizeof(fragment), NULL, true, false, 4, 2, 5).wait();
+    auto frameIt = backup->frames.find({{99, 0}, 88});
+    EXPECT_EQ(5u, static_cast<InMemoryStorage::Frame*>(
+                    frameIt->second.get())->frameIndex);
+    EXPECT_STREQ("fragment", static_cast<char*>(frameIt->second->load()));
+
+    // Fragments of a code with fewer data fragments are too big.
+    WriteSegmentRpc(&context, backupId, {99, 0}, 89, 0, fragment, 0,
+                    sizeof(fragment), NULL, true, false, 2, 1, 0).wait();
+    frameIt = backup->frames.find({{99, 0}, 89});
+    EXPECT_EQ(0u, static_cast<InMemoryStorage::Frame*>(
+                    frameIt->second.get())->frameIndex);
+}
+
 TEST_F(BackupServiceTest, writeSegment_checkCallerId) {
     backup->testingSkipCallerIdCheck = false;
     EXPECT_THROW(openSegment({99, 0}, 88), CallerNotInClusterException);
@@ -584,7 +664,8 @@ TEST_F(BackupServiceTest, GarbageCollectDownServerTask) {
     EXPECT_NE(backup->frames.end(), backup->frames.find({{99, 1}, 88}));
 
     backup->recoveries[ServerId{99, 0}] =
-        new BackupMasterRecovery(backup->taskQueue, 456, {99, 0}, 0);
+        new BackupMasterRecovery(&context, backup->taskQueue, 456, {99, 0},
+                                 0);
     EXPECT_NE(backup->recoveries.end(), backup->recoveries.find({99, 0}));
 
     typedef BackupService::GarbageCollectDownServerTask Task;
@@ -82,6 +82,32 @@ BackupStorage::benchmark(BackupStrategy backupStrategy)
     }
 }
 
+/**
+ * Allocate a frame to hold one fragment of an erasure-coded segment, which
+ * is at most \a length bytes long. Storages that set aside smaller frames
+ * for fragments use one of them if it is big enough; otherwise (and by
+ * default) this is the same as open() and the fragment gets a whole
+ * segment frame. See open() for details.
+ *
+ * \param sync
+ *      See open().
+ * \param masterId
+ *      See open().
+ * \param segmentId
+ *      See open().
+ * \param length
+ *      Most bytes the fragment can hold; any appends past this many bytes
+ *      may be rejected by the returned frame.
+ * \return
+ *      See open().
+ */
+BackupStorage::FrameRef
+BackupStorage::openFragment(bool sync, ServerId masterId, uint64_t segmentId,
+                            size_t length)
+{
+    return open(sync, masterId, segmentId);
+}
+
 /**
  * Release the frame for reuse with another replica.
  * Called implicitly when the reference count associated with a FrameRef
@@ -352,6 +352,8 @@ class BackupStorage {
      *      another replica.
      */
     virtual FrameRef open(bool sync, ServerId masterId, uint64_t segmentId) = 0;
+    virtual FrameRef openFragment(bool sync, ServerId masterId,
+                                  uint64_t segmentId, size_t length);
 
     /**
      * Returns the maximum number of bytes of metadata that can be stored
@@ -442,7 +444,9 @@ class BackupStorage {
     virtual void fry() = 0;
 
     /// See #storageType.
-    enum class Type { UNKNOWN = 0, MEMORY = 1, DISK = 2 };
+    enum class Type {
+        UNKNOWN = 0, MEMORY = 1, DISK = 2, PERSISTENT_MEMORY = 3
+    };
 
   PROTECTED:
     /**
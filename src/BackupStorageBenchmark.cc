@@ -1,4 +1,4 @@
-/* Copyright (c) 2011 Stanford University
+/* Copyright (c) 2011-2016 Stanford University
  *
  * Permission to use, copy, modify, and distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -13,152 +13,217 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <fcntl.h>
 #include <thread>
 
-#include "BackupStorage.h"
+#include "Buffer.h"
 #include "Cycles.h"
-#include "Logging.h"
-#include "Segment.h"
+#ifdef IO_URING
+#include "IoUringStorage.h"
+#endif
+#include "Logger.h"
+#include "MappedStorage.h"
+#include "Memory.h"
+#include "MultiFileStorage.h"
+#include "ShortMacros.h"
 
 using namespace RAMCloud;
 
-struct Store {
-    Store(MultiFileStorage& storage,
-          const char* segment,
-          BackupStorage::Handle* handle)
-        : storage(storage)
-        , segment(segment)
-        , handle(handle)
-    {
-    }
-
-    void
-    operator()()
-    {
-        uint64_t startTime = Cycles::rdtsc();
-        storage.putSegment(handle, segment);
-        LOG(DEBUG, "StoreOp took %lu us",
-            Cycles::toNanoseconds(Cycles::rdtsc() - startTime) / 1000);
-    }
-
-    MultiFileStorage& storage;
-    const char* segment;
-    BackupStorage::Handle* handle;
-};
-
+/**
+ * Measures replica write and read bandwidth of a BackupStorage backed by
+ * local files. Run against both MultiFileStorage (POSIX aio) and
+ * IoUringStorage on the same files to compare the two, and with and without
+ * group commit to see how well small synchronous writes from many masters
+ * are coalesced. MappedStorage, which writes replicas into a memory mapping
+ * instead, is measured on a separate file (ideally on a DAX filesystem).
+ */
 struct Bench {
-    explicit Bench(const char* backupFile)
-        : backupFile(backupFile)
-        , segmentCount(80 * 2)
-        , storage(Segment::SEGMENT_SIZE,
-                  segmentCount,
-                  backupFile,
-                  O_DIRECT | O_SYNC | O_NOATIME)
-        , allocated()
-        , scratch(SegmentAllocator::malloc(Segment::SEGMENT_SIZE))
-        , mb(static_cast<double>(Segment::SEGMENT_SIZE) / (1 << 20))
-    {
-    }
-
-    ~Bench()
+    Bench(BackupStorage& storage, uint32_t segmentSize,
+          uint32_t segmentCount)
+        : storage(storage)
+        , segmentSize(segmentSize)
+        , segmentCount(segmentCount)
+        , frames()
+        , data(Memory::xmemalign(HERE, 4096, segmentSize), std::free)
+        , mb(static_cast<double>(segmentSize) / (1 << 20))
     {
-        SegmentAllocator::free(scratch);
+        memset(data.get(), 'x', segmentSize);
     }
 
+    /**
+     * Write a full replica to each of the frames, one at a time and
+     * synchronously, as masters do when replicating a segment.
+     */
     void
-    fill(const uint32_t count)
+    fill()
     {
+        Buffer source;
+        source.appendExternal(data.get(), segmentSize);
+        char metadata[] = "metadata";
         double sum = 0., min = 100000.0, max = 0.;
-        for (uint32_t i = 0; i < count; i++) {
-            auto* handle = storage.allocate(0, i);
-            allocated.push_back(handle);
+        for (uint32_t i = 0; i < segmentCount; i++) {
             uint64_t start = Cycles::rdtsc();
-            storage.putSegment(handle, scratch);
-            uint64_t putTime = Cycles::rdtsc() - start;
-            double mbSec = mb / Cycles::toSeconds(putTime);
-            LOG(NOTICE, "Stored segment at %.1f MB/s", mbSec);
+            frames.push_back(storage.open(true, ServerId(1, 0), i));
+            frames.back()->append(source, 0, segmentSize, 0,
+                                  metadata, sizeof(metadata));
+            frames.back()->close();
+            double mbSec = mb / Cycles::toSeconds(Cycles::rdtsc() - start);
             sum += mbSec;
             max = std::max(max, mbSec);
             min = std::min(min, mbSec);
         }
-        LOG(WARNING, "=== Min/Avg/Max Put Bandwidth: %.1f %.1f %.1f ===",
-            min, sum / count, max);
+        LOG(NOTICE, "Min/Avg/Max write bandwidth: %.1f %.1f %.1f MB/s",
+            min, sum / segmentCount, max);
     }
 
+    /**
+     * Read the replicas back one at a time, then all at once as a recovery
+     * does (requesting every replica before waiting for any of them).
+     */
     void
-    testRead()
+    read()
     {
-        const uint32_t count = 80;
-
-        fill(count);
-        usleep(1000000);
-
         double sum = 0., min = 100000.0, max = 0.;
-        foreach (auto* handle, allocated) {
+        foreach (BackupStorage::FrameRef& frame, frames) {
             uint64_t start = Cycles::rdtsc();
-            storage.getSegment(handle, scratch);
-            uint64_t getTime = Cycles::rdtsc() - start;
-            double mbSec = mb / Cycles::toSeconds(getTime);
-            LOG(NOTICE, "Fetched segment at %.1f MB/s", mbSec);
+            frame->load();
+            double mbSec = mb / Cycles::toSeconds(Cycles::rdtsc() - start);
+            frame->unload();
             sum += mbSec;
             max = std::max(max, mbSec);
             min = std::min(min, mbSec);
         }
-        LOG(WARNING, "=== Min/Avg/Max Get Bandwidth: %.1f %.1f %.1f ===",
-            min, sum / count, max);
+        LOG(NOTICE, "Min/Avg/Max read bandwidth: %.1f %.1f %.1f MB/s",
+            min, sum / segmentCount, max);
+
+        uint64_t start = Cycles::rdtsc();
+        foreach (BackupStorage::FrameRef& frame, frames)
+            frame->startLoading();
+        foreach (BackupStorage::FrameRef& frame, frames)
+            frame->load();
+        double seconds = Cycles::toSeconds(Cycles::rdtsc() - start);
+        foreach (BackupStorage::FrameRef& frame, frames)
+            frame->unload();
+        LOG(NOTICE, "Recovery-style read bandwidth: %.1f MB/s",
+            mb * segmentCount / seconds);
     }
 
+    /**
+     * Have \a writers threads each append to their own replica in small
+     * synchronous writes, as many masters replicating small objects to one
+     * backup would, and report the aggregate rate.
+     */
     void
-    testReadWithWriteInterference()
+    smallWrites(uint32_t writers, uint32_t writeSize, uint32_t writesPerWriter)
     {
-        const uint32_t count = 80;
-
-        fill(count);
-        usleep(1000000);
-
-        auto writeList = allocated;
-        std::random_shuffle(writeList.begin(), writeList.end());
-
-        auto writeHandle = writeList.begin();
-
-        double sum = 0., min = 100000.0, max = 0.;
-        int i = 0;
-        foreach (auto* handle, allocated) {
-            if (!(i++ % 3))
-                std::thread(Store(storage, scratch, *(writeHandle++)));
-            uint64_t start = Cycles::rdtsc();
-            storage.getSegment(handle, scratch);
-            uint64_t getTime = Cycles::rdtsc() - start;
-            double mbSec = mb / Cycles::toSeconds(getTime);
-            LOG(NOTICE, "Fetched segment at %.1f MB/s", mbSec);
-            sum += mbSec;
-            max = std::max(max, mbSec);
-            min = std::min(min, mbSec);
+        std::vector<BackupStorage::FrameRef> replicas;
+        for (uint32_t i = 0; i < writers; i++)
+            replicas.push_back(storage.open(true, ServerId(1, 0), i));
+        char metadata[] = "metadata";
+
+        uint64_t start = Cycles::rdtsc();
+        std::vector<std::thread> threads;
+        for (uint32_t i = 0; i < writers; i++) {
+            threads.emplace_back([&, i] {
+                Buffer source;
+                source.appendExternal(data.get(), writeSize);
+                for (uint32_t j = 0; j < writesPerWriter; j++) {
+                    replicas[i]->append(source, 0, writeSize, j * writeSize,
+                                        metadata, sizeof(metadata));
+                }
+            });
         }
-        LOG(WARNING, "=== Min/Avg/Max Get Bandwidth: %.1f %.1f %.1f ===",
-            min, sum / count, max);
+        foreach (std::thread& thread, threads)
+            thread.join();
+        double seconds = Cycles::toSeconds(Cycles::rdtsc() - start);
+
+        uint64_t writes = uint64_t(writers) * writesPerWriter;
+        LOG(NOTICE, "%u writers, %u-byte sync writes: %.0f writes/s, "
+            "%.1f MB/s", writers, writeSize, double(writes) / seconds,
+            double(writes * writeSize) / seconds / (1 << 20));
+        foreach (BackupStorage::FrameRef& replica, replicas)
+            replica->free();
     }
 
-    const string backupFile;
+    BackupStorage& storage;
+    const uint32_t segmentSize;
     const uint32_t segmentCount;
-    MultiFileStorage storage;
-    vector<BackupStorage::Handle*> allocated;
-    char* const scratch;
+    std::vector<BackupStorage::FrameRef> frames;
+    Memory::unique_ptr_free data;
     const double mb;
 
     DISALLOW_COPY_AND_ASSIGN(Bench);
 };
 
 int
-main(int ac, char* av[])
+main(int argc, char* argv[])
 {
     const char* backupFile = "/var/tmp/backup.log";
-    if (ac > 1)
-        backupFile = av[1];
-    LOG(WARNING, "Writing to %s", backupFile);
+    if (argc > 1)
+        backupFile = argv[1];
+    const char* mappedFile = "/var/tmp/backup.mapped";
+    if (argc > 2)
+        mappedFile = argv[2];
+    const uint32_t segmentSize = 8 * 1024 * 1024;
+    const uint32_t segmentCount = 80;
+    // Small synchronous writes, one replica per writer.
+    const uint32_t writers = 64;
+    const uint32_t writeSize = 1024;
+    const uint32_t writesPerWriter = 200;
+    Logger::get().setLogLevels(NOTICE);
+    LOG(NOTICE, "Writing to %s", backupFile);
 
-    Bench(backupFile).testRead();
-    //Bench(backupFile).testReadWithWriteInterference();
+    {
+        LOG(NOTICE, "=== MultiFileStorage (POSIX aio) ===");
+        MultiFileStorage storage(segmentSize, segmentCount, 0, segmentCount,
+                                 backupFile, O_DIRECT | O_SYNC);
+        Bench bench(storage, segmentSize, segmentCount);
+        bench.smallWrites(writers, writeSize, writesPerWriter);
+        bench.fill();
+        bench.read();
+    }
+    {
+        LOG(NOTICE, "=== MultiFileStorage (POSIX aio), group commit ===");
+        MultiFileStorage storage(segmentSize, segmentCount, 0, segmentCount,
+                                 backupFile, O_DIRECT | O_SYNC, true);
+        Bench bench(storage, segmentSize, segmentCount);
+        bench.smallWrites(writers, writeSize, writesPerWriter);
+    }
+
+    {
+        LOG(NOTICE, "=== MappedStorage (%s) ===", mappedFile);
+        MappedStorage storage(segmentSize, segmentCount, 0, mappedFile);
+        Bench bench(storage, segmentSize, segmentCount);
+        bench.smallWrites(writers, writeSize, writesPerWriter);
+        bench.fill();
+        bench.read();
+    }
+
+#ifdef IO_URING
+    if (!IoUringStorage::isSupported()) {
+        LOG(WARNING, "Kernel doesn't support io_uring; skipping "
+            "IoUringStorage");
+        return 0;
+    }
+    {
+        LOG(NOTICE, "=== IoUringStorage ===");
+        IoUringStorage storage(segmentSize, segmentCount, 0, segmentCount,
+                               backupFile, O_DIRECT | O_SYNC);
+        Bench bench(storage, segmentSize, segmentCount);
+        bench.smallWrites(writers, writeSize, writesPerWriter);
+        bench.fill();
+        bench.read();
+    }
+    {
+        LOG(NOTICE, "=== IoUringStorage, group commit ===");
+        IoUringStorage storage(segmentSize, segmentCount, 0, segmentCount,
+                               backupFile, O_DIRECT | O_SYNC, true);
+        Bench bench(storage, segmentSize, segmentCount);
+        bench.smallWrites(writers, writeSize, writesPerWriter);
+    }
+#else
+    LOG(WARNING, "Built without io_uring; skipping IoUringStorage");
+#endif
 
     return 0;
 }
@@ -86,19 +86,44 @@ CleanableSegmentManager::getUndeadTombstoneUtilization()
     return downCast<int>((100 * undeadTombstoneBytes) / totalSegletBytes);
 }
 
-LogSegment*
-CleanableSegmentManager::getSegmentToCompact()
+/**
+ * Claim the best segments for memory compaction. The segments returned are
+ * removed from consideration until they have been compacted (and their
+ * replacements handed to us by the SegmentManager), so cleaner threads that
+ * call this concurrently always get disjoint batches.
+ *
+ * \param maxSegments
+ *      Return no more than this many segments.
+ * \param[out] outSegments
+ *      The chosen segments are appended here, best first. Nothing is
+ *      appended if there are no candidates. Segments whose replicas are
+ *      still being converted to fragments are skipped.
+ */
+void
+CleanableSegmentManager::getSegmentsToCompact(uint32_t maxSegments,
+                                              LogSegmentVector& outSegments)
 {
     SpinLock::Guard guard(lock);
     update(guard);
 
-    if (compactionCandidates.empty())
-        return NULL;
+    auto it = compactionCandidates.begin();
+    while (maxSegments > 0 && it != compactionCandidates.end()) {
+        LogSegment& segment = *it++;
 
-    LogSegment& segment = *compactionCandidates.begin();
-    eraseFromAll(&segment, guard);
-    segmentsToCleaner++;
-    return &segment;
+        // The segment can't be swapped for its compacted version until its
+        // replicas have been converted to fragments, and waiting for that
+        // would stall the SegmentManager (see compactionComplete()). Leave
+        // it for a later pass.
+        if (segment.replicatedSegment != NULL &&
+                segment.replicatedSegment->isConvertingToFragments()) {
+            continue;
+        }
+
+        eraseFromAll(&segment, guard);
+        segmentsToCleaner++;
+        outSegments.push_back(&segment);
+        maxSegments--;
+    }
 }
 
 void
@@ -255,7 +280,7 @@ CleanableSegmentManager::update(const SpinLock::Guard& guard)
 /**
  * Scan the best candidate in tombstoneScanCandidates for dead tombstones and
  * update the segment's statistics. This lets the getSegmentsToClean() and
- * getSegmentToCompact() methods return better candidates. Otherwise, we would
+ * getSegmentsToCompact() methods return better candidates. Otherwise, we would
  * not know which tombstones are dead.
  *
  * Note that this method will drop the monitor lock while scanning the segment
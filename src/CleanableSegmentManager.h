@@ -76,7 +76,8 @@ class CleanableSegmentManager {
     ~CleanableSegmentManager();
     int getLiveObjectUtilization();
     int getUndeadTombstoneUtilization();
-    LogSegment* getSegmentToCompact();
+    void getSegmentsToCompact(uint32_t maxSegments,
+                              LogSegmentVector& outSegments);
     void getSegmentsToClean(LogSegmentVector& outSegsToClean);
 
   PRIVATE:
@@ -103,7 +104,7 @@ class CleanableSegmentManager {
     enum { MIN_SEGMENTS_BEFORE_UPDATE_DELAY = 100 };
 
     /// A single segment will be scanned for dead tombstones after this many
-    /// segments have been returned via the getSegmentToCompact() and
+    /// segments have been returned via the getSegmentsToCompact() and
     /// getSegmentsToClean() methods. This acts as a throttle to trade off
     /// better accounting accuracy for the overhead of scanning.
     ///
@@ -141,7 +142,7 @@ class CleanableSegmentManager {
     /// freeable first.
     uint64_t undeadTombstoneBytes;
 
-    /// Count of the number of segments returned via getSegmentToCompact() and
+    /// Count of the number of segments returned via getSegmentsToCompact() and
     /// getSegmentsToClean().
     uint64_t segmentsToCleaner;
 
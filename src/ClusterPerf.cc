@@ -123,6 +123,11 @@ static int targetOps;
 // the server span of a transaction.
 static int txSpan;
 
+// Value of the "--hotObjects" command-line option: if nonzero, the
+// readThroughput test only reads this many of the objects it creates
+// (e.g. 1 to measure contention on a single hot key).
+static int hotObjects;
+
 // Identifier for table that is used for test-specific data.
 uint64_t dataTable = -1;
 
@@ -5633,12 +5638,19 @@ readThroughput()
     if (size < 0)
         size = 100;
     const int numObjects = 40000000/size;
+    int readObjects = numObjects;
+    if (hotObjects > 0 && hotObjects < numObjects)
+        readObjects = hotObjects;
     if (clientIndex == 0) {
         // This is the master client.
         printf("# RAMCloud read throughput of a single server with a varying\n"
                 "# number of clients issuing individual reads on randomly\n"
                 "# chosen %d-byte objects with %d-byte keys\n",
                 size, keyLength);
+        if (readObjects != numObjects) {
+            printf("# (all reads go to the same %d of %d objects)\n",
+                    readObjects, numObjects);
+        }
         printf("# Generated by 'clusterperf.py readThroughput'\n");
         readThroughputMaster(numObjects, size, keyLength);
     } else {
@@ -5676,7 +5688,7 @@ readThroughput()
                 do {
                     char key[keyLength];
                     Buffer value;
-                    makeKey(downCast<int>(generateRandom() % numObjects),
+                    makeKey(downCast<int>(generateRandom() % readObjects),
                             keyLength, key);
                     cluster->read(dataTable, key, keyLength, &value);
                     ++objectsRead;
@@ -6286,6 +6298,9 @@ try
                 "will try to achieve (0 means run as fast as possible)")
         ("txSpan", po::value<int>(&txSpan)->default_value(1),
                 "Number of servers that each transaction should span")
+        ("hotObjects", po::value<int>(&hotObjects)->default_value(0),
+                "Number of objects that readThroughput clients read "
+                "(0 means all of them)")
         ("numIndexlet", po::value<int>(&numIndexlet)->default_value(1),
                 "number of Indexlets")
         ("numIndexes", po::value<int>(&numIndexes)->default_value(1),
@@ -0,0 +1,283 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "Compressor.h"
+
+namespace RAMCloud {
+
+/// Shortest match worth encoding.
+static const uint32_t MIN_MATCH = 4;
+
+/// Matches may reach back at most this far.
+static const uint32_t MAX_DISTANCE = 65535;
+
+/// Log2 of the largest number of entries in the compressor's match table.
+/// Smaller inputs use smaller tables, so that clearing the table doesn't
+/// cost more than compressing the input.
+static const int MAX_HASH_BITS = 12;
+
+/// The last few bytes of the input are always encoded as literals, so that
+/// the match-finding loop can read ahead without bounds checks.
+static const uint32_t TAIL_LITERALS = 8;
+
+/// A length nibble with this value means more length bytes follow.
+static const uint32_t MORE_LENGTH = 15;
+
+/// Load 4 (possibly unaligned) bytes.
+static inline uint32_t
+read32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/**
+ * Write the extra bytes for a length whose nibble was MORE_LENGTH. Returns
+ * the new output position, or NULL if \a outEnd was reached.
+ */
+static uint8_t*
+writeLength(uint8_t* out, uint8_t* outEnd, uint32_t length)
+{
+    length -= MORE_LENGTH;
+    while (length >= 255) {
+        if (out == outEnd)
+            return NULL;
+        *out++ = 255;
+        length -= 255;
+    }
+    if (out == outEnd)
+        return NULL;
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+}
+
+/**
+ * Read the extra bytes for a length whose nibble was MORE_LENGTH, adding
+ * them to \a length. Returns false if the input is truncated or the length
+ * is unreasonably large.
+ */
+static bool
+readLength(const uint8_t** in, const uint8_t* inEnd, uint32_t* length)
+{
+    uint32_t byte;
+    do {
+        if (*in == inEnd || *length > (1u << 30))
+            return false;
+        byte = *(*in)++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+/**
+ * Append one (literals, match) pair to the output. Returns the new output
+ * position, or NULL if it didn't fit before \a outEnd.
+ *
+ * \param out
+ *      Where to write the pair.
+ * \param outEnd
+ *      End of the output buffer.
+ * \param literals
+ *      Bytes to be copied verbatim.
+ * \param literalLength
+ *      Number of bytes at \a literals.
+ * \param distance
+ *      How far back in the uncompressed data the match starts.
+ * \param matchLength
+ *      Length of the match, or 0 for the final pair, which has none.
+ */
+static uint8_t*
+writePair(uint8_t* out, uint8_t* outEnd,
+          const uint8_t* literals, uint32_t literalLength,
+          uint32_t distance, uint32_t matchLength)
+{
+    if (out == outEnd)
+        return NULL;
+    uint32_t matchCode = (matchLength == 0) ? 0 : matchLength - MIN_MATCH;
+    uint8_t* token = out++;
+    *token = static_cast<uint8_t>(
+            (std::min(literalLength, MORE_LENGTH) << 4) |
+            std::min(matchCode, MORE_LENGTH));
+
+    if (literalLength >= MORE_LENGTH) {
+        out = writeLength(out, outEnd, literalLength);
+        if (out == NULL)
+            return NULL;
+    }
+    if (static_cast<uint32_t>(outEnd - out) < literalLength)
+        return NULL;
+    memcpy(out, literals, literalLength);
+    out += literalLength;
+
+    if (matchLength == 0)
+        return out;
+    if (outEnd - out < 2)
+        return NULL;
+    *out++ = static_cast<uint8_t>(distance);
+    *out++ = static_cast<uint8_t>(distance >> 8);
+    if (matchCode >= MORE_LENGTH)
+        out = writeLength(out, outEnd, matchCode);
+    return out;
+}
+
+/**
+ * Compress a block of memory.
+ *
+ * \param input
+ *      The data to compress.
+ * \param inputLength
+ *      Number of bytes at \a input.
+ * \param output
+ *      Where to write the compressed data.
+ * \param outputCapacity
+ *      Number of bytes available at \a output. Callers that only want
+ *      the compressed form if it's smaller can pass less than
+ *      \a inputLength.
+ * \return
+ *      The number of bytes written to \a output, or 0 if the compressed
+ *      form didn't fit in \a outputCapacity bytes.
+ */
+uint32_t
+Compressor::compress(const void* input, uint32_t inputLength,
+                     void* output, uint32_t outputCapacity)
+{
+    const uint8_t* in = static_cast<const uint8_t*>(input);
+    const uint8_t* inEnd = in + inputLength;
+    uint8_t* out = static_cast<uint8_t*>(output);
+    uint8_t* outEnd = out + outputCapacity;
+    const uint8_t* anchor = in;
+
+    if (inputLength > TAIL_LITERALS + MIN_MATCH) {
+        // Size the table to the input: one entry per 4 bytes, roughly.
+        int hashBits = 6;
+        while (hashBits < MAX_HASH_BITS && (1u << (hashBits + 2)) < inputLength)
+            hashBits++;
+        uint32_t table[1 << MAX_HASH_BITS];
+        memset(table, 0, sizeof(table[0]) << hashBits);
+
+        const uint8_t* matchLimit = inEnd - TAIL_LITERALS;
+        const uint8_t* ip = in + 1;
+        uint32_t misses = 0;
+        while (ip + MIN_MATCH <= matchLimit) {
+            uint32_t hash = (read32(ip) * 2654435761u) >> (32 - hashBits);
+            const uint8_t* match = in + table[hash];
+            table[hash] = downCast<uint32_t>(ip - in);
+            uint32_t distance = downCast<uint32_t>(ip - match);
+            if (distance == 0 || distance > MAX_DISTANCE ||
+                    read32(match) != read32(ip)) {
+                // Skip ahead faster through data that isn't compressing.
+                ip += 1 + (misses++ >> 5);
+                continue;
+            }
+            misses = 0;
+
+            const uint8_t* matchEnd = ip + MIN_MATCH;
+            match += MIN_MATCH;
+            while (matchEnd < matchLimit && *matchEnd == *match) {
+                matchEnd++;
+                match++;
+            }
+            out = writePair(out, outEnd, anchor,
+                            downCast<uint32_t>(ip - anchor), distance,
+                            downCast<uint32_t>(matchEnd - ip));
+            if (out == NULL)
+                return 0;
+            ip = anchor = matchEnd;
+        }
+    }
+
+    out = writePair(out, outEnd, anchor, downCast<uint32_t>(inEnd - anchor),
+                    0, 0);
+    if (out == NULL)
+        return 0;
+    return downCast<uint32_t>(out - static_cast<uint8_t*>(output));
+}
+
+/**
+ * Decompress data produced by compress(). Malformed input is detected
+ * rather than trusted: nothing is ever read or written out of bounds.
+ *
+ * \param input
+ *      The compressed data.
+ * \param inputLength
+ *      Number of bytes at \a input.
+ * \param output
+ *      Where to write the decompressed data.
+ * \param outputLength
+ *      The length of the data before it was compressed. Exactly this many
+ *      bytes are written to \a output if decompression succeeds.
+ * \return
+ *      True if \a input was well formed and decompressed to exactly
+ *      \a outputLength bytes, false otherwise.
+ */
+bool
+Compressor::decompress(const void* input, uint32_t inputLength,
+                       void* output, uint32_t outputLength)
+{
+    const uint8_t* in = static_cast<const uint8_t*>(input);
+    const uint8_t* inEnd = in + inputLength;
+    uint8_t* outStart = static_cast<uint8_t*>(output);
+    uint8_t* out = outStart;
+    uint8_t* outEnd = out + outputLength;
+
+    while (in < inEnd) {
+        uint32_t token = *in++;
+
+        uint32_t literalLength = token >> 4;
+        if (literalLength == MORE_LENGTH &&
+                !readLength(&in, inEnd, &literalLength))
+            return false;
+        if (literalLength > static_cast<uint32_t>(inEnd - in) ||
+                literalLength > static_cast<uint32_t>(outEnd - out))
+            return false;
+        memcpy(out, in, literalLength);
+        in += literalLength;
+        out += literalLength;
+
+        // Only the final pair ends right after its literals.
+        if (in == inEnd)
+            break;
+
+        if (inEnd - in < 2)
+            return false;
+        uint32_t distance = in[0] | (in[1] << 8);
+        in += 2;
+        if (distance == 0 || distance > static_cast<uint32_t>(out - outStart))
+            return false;
+
+        uint32_t matchLength = token & MORE_LENGTH;
+        if (matchLength == MORE_LENGTH &&
+                !readLength(&in, inEnd, &matchLength))
+            return false;
+        matchLength += MIN_MATCH;
+        if (matchLength > static_cast<uint32_t>(outEnd - out))
+            return false;
+
+        const uint8_t* match = out - distance;
+        if (distance >= matchLength) {
+            memcpy(out, match, matchLength);
+            out += matchLength;
+        } else {
+            // Overlapping copy: the match repeats a short pattern.
+            while (matchLength-- > 0)
+                *out++ = *match++;
+        }
+    }
+
+    return out == outEnd;
+}
+
+} // namespace RAMCloud
@@ -0,0 +1,55 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef RAMCLOUD_COMPRESSOR_H
+#define RAMCLOUD_COMPRESSOR_H
+
+#include "Common.h"
+
+namespace RAMCloud {
+
+/**
+ * A small, fast LZ77 codec used to compress object values in the log (see
+ * Object::compressValue()). It trades compression ratio for speed: matches
+ * are found with a single hash probe and no entropy coding is done, so
+ * both directions run at memory-copy speeds, which is what a read-mostly
+ * in-memory store needs.
+ *
+ * The compressed format is a sequence of (literals, match) pairs, as in
+ * LZ4's block format. Each pair starts with a token byte whose high and
+ * low nibbles hold the literal length and the match length minus 4 (the
+ * shortest match encoded); a nibble of 15 means more length bytes follow
+ * (each adding up to 255, with 255 meaning yet another follows). Then come
+ * the literals, and then the match's distance back into the output as a
+ * 16-bit little-endian value. The last pair has literals only.
+ *
+ * Compressed data isn't self-describing: the caller must keep track of the
+ * uncompressed length and pass it to decompress().
+ */
+class Compressor {
+  public:
+    static uint32_t compress(const void* input, uint32_t inputLength,
+                             void* output, uint32_t outputCapacity);
+    static bool decompress(const void* input, uint32_t inputLength,
+                           void* output, uint32_t outputLength);
+
+  PRIVATE:
+    Compressor();
+    DISALLOW_COPY_AND_ASSIGN(Compressor);
+};
+
+} // namespace RAMCloud
+
+#endif // RAMCLOUD_COMPRESSOR_H
@@ -0,0 +1,105 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "TestUtil.h"
+
+#include "Compressor.h"
+
+namespace RAMCloud {
+
+/**
+ * Compress and then decompress a string, checking that the result matches.
+ * Returns the compressed length, or 0 if it wasn't smaller than the input.
+ */
+static uint32_t
+roundTrip(const string& input)
+{
+    uint32_t length = downCast<uint32_t>(input.size());
+    vector<char> compressed(length + 64);
+    uint32_t compressedLength = Compressor::compress(input.data(), length,
+            &compressed[0], downCast<uint32_t>(compressed.size()));
+    EXPECT_NE(0U, compressedLength);
+
+    vector<char> output(length + 1);
+    EXPECT_TRUE(Compressor::decompress(&compressed[0], compressedLength,
+                                       &output[0], length));
+    EXPECT_EQ(input, string(&output[0], length));
+    return compressedLength < length ? compressedLength : 0;
+}
+
+TEST(CompressorTest, compress_empty) {
+    EXPECT_EQ(0U, roundTrip(""));
+}
+
+TEST(CompressorTest, compress_short) {
+    // Too short to contain a match: the output is one literal-only pair.
+    EXPECT_EQ(0U, roundTrip("abcabcabc"));
+}
+
+TEST(CompressorTest, compress_repetitive) {
+    string json;
+    for (int i = 0; i < 50; i++)
+        json += format("{\"id\":%d,\"name\":\"user\",\"active\":true},", i);
+    uint32_t compressedLength = roundTrip(json);
+    EXPECT_NE(0U, compressedLength);
+    EXPECT_LT(compressedLength, json.size() / 4);
+}
+
+TEST(CompressorTest, compress_longRuns) {
+    // Exercises the extra length bytes and overlapping matches.
+    string input(1000, 'a');
+    input += "0123456789";
+    input += string(70000, 'b');
+    EXPECT_NE(0U, roundTrip(input));
+}
+
+TEST(CompressorTest, compress_random) {
+    string input;
+    for (int i = 0; i < 5000; i++)
+        input.push_back(static_cast<char>(generateRandom()));
+    roundTrip(input);
+}
+
+TEST(CompressorTest, compress_doesNotFit) {
+    string input;
+    for (int i = 0; i < 100; i++)
+        input.push_back(static_cast<char>(generateRandom()));
+    char output[99];
+    EXPECT_EQ(0U, Compressor::compress(input.data(), 100, output, 99));
+}
+
+TEST(CompressorTest, decompress_malformed) {
+    string input(200, 'x');
+    char compressed[300];
+    uint32_t length = Compressor::compress(input.data(), 200, compressed,
+                                           sizeof(compressed));
+    char output[200];
+
+    // Wrong expected length.
+    EXPECT_FALSE(Compressor::decompress(compressed, length, output, 199));
+    EXPECT_FALSE(Compressor::decompress(compressed, length - 1, output, 200));
+
+    // A match that reaches back before the start of the output.
+    const char badDistance[] = { 0x10, 'x', 0x05, 0x00 };
+    EXPECT_FALSE(Compressor::decompress(badDistance, sizeof(badDistance),
+                                        output, 5));
+
+    // Literals that run off the end of the input.
+    const char truncated[] = { 0x50, 'x', 'y' };
+    EXPECT_FALSE(Compressor::decompress(truncated, sizeof(truncated),
+                                        output, 5));
+}
+
+}  // namespace RAMCloud
@@ -15,6 +15,10 @@
 
 // RAMCloud pragma [CPPLINT=0]
 
+#if __SSE4_2__
+#include <wmmintrin.h>
+#endif
+
 #include "Crc32C.h"
 #include "Logger.h"
 #include "ShortMacros.h"
@@ -40,10 +44,249 @@ haveSse42() {
 
 #if __SSE4_2__
 bool Crc32C::haveHardware = haveSse42();
+bool Crc32C::haveCarrylessMultiply = (__builtin_cpu_init(),
+                                      __builtin_cpu_supports("pclmul"));
 #else
 bool Crc32C::haveHardware = false;
+bool Crc32C::haveCarrylessMultiply = false;
+#endif
+
+namespace {
+
+/// The CRC32C polynomial, bit-reflected to match the register's bit order.
+const uint32_t POLYNOMIAL = 0x82F63B78;
+
+/**
+ * Multiply a (bit-reflected) CRC register value by x^power modulo the
+ * CRC32C polynomial. This is exactly what running the CRC over power / 8
+ * bytes of zeros does to the register, only one bit at a time.
+ */
+uint32_t
+multiplyByXPower(uint32_t crc, uint64_t power)
+{
+    while (power-- > 0)
+        crc = (crc >> 1) ^ ((crc & 1) ? POLYNOMIAL : 0);
+    return crc;
+}
+
+/**
+ * Advances a CRC register value over a fixed number of zero bytes in constant
+ * time. The CRC is linear, so crc(a, X || Y) equals this shift of crc(a, X)
+ * by the length of Y, XORed with crc(0, Y); that is what lets the streams of
+ * intelCrc32CInterleaved() run independently and be combined afterwards.
+ */
+class Crc32CShift {
+  public:
+    /**
+     * \param bytes
+     *      Number of zero bytes this shift advances the register over.
+     */
+    explicit Crc32CShift(uint64_t bytes)
+        : table()
+        , constant(multiplyByXPower(0x80000000U, 8 * bytes - 33))
+    {
+        // The shift is linear, so shifting each byte of the register can
+        // be precomputed from the shifts of its individual bits. Bit i is
+        // bit i + 1 times x.
+        uint32_t bits[32];
+        bits[31] = multiplyByXPower(1U << 31, 8 * bytes);
+        for (int i = 30; i >= 0; i--)
+            bits[i] = multiplyByXPower(bits[i + 1], 1);
+        for (int i = 0; i < 4; i++) {
+            for (uint32_t b = 0; b < 256; b++) {
+                uint32_t shifted = 0;
+                for (int j = 0; j < 8; j++) {
+                    if (b & (1U << j))
+                        shifted ^= bits[8 * i + j];
+                }
+                table[i][b] = shifted;
+            }
+        }
+    }
+
+    /**
+     * Return the register value that results from running the CRC over
+     * the shift's number of zero bytes starting from the given value.
+     *
+     * \param crc
+     *      Register value to shift.
+     * \param carrylessMultiply
+     *      Whether the PCLMUL instruction may be used (see
+     *      Crc32C::haveCarrylessMultiply); if not, the tables are.
+     */
+    inline uint32_t
+    operator()(uint32_t crc, bool carrylessMultiply) const
+    {
+#if __SSE4_2__
+        if (carrylessMultiply)
+            return multiply(crc, constant);
+#endif
+        return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^
+               table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+    }
+
+  private:
+#if __SSE4_2__
+    /**
+     * Carry-less multiplication of two bit-reflected polynomials yields
+     * their product times x; reducing the 64-bit product with the crc32
+     * instruction multiplies it by another x^32. Hence #constant is
+     * x^(8 * bytes - 33). This is compiled for PCLMUL regardless of the
+     * target the rest of the server is built for, so it must only be used
+     * if the processor supports it.
+     */
+    __attribute__((target("pclmul")))
+    static uint32_t
+    multiply(uint32_t crc, uint32_t constant)
+    {
+        __m128i product = _mm_clmulepi64_si128(
+                _mm_cvtsi32_si128(static_cast<int>(crc)),
+                _mm_cvtsi32_si128(static_cast<int>(constant)), 0);
+        return downCast<uint32_t>(__builtin_ia32_crc32di(0,
+                static_cast<uint64_t>(_mm_cvtsi128_si64(product))));
+    }
 #endif
 
+    /// table[i][b] is the shifted value of byte i of the register being b
+    /// and all its other bytes being 0.
+    uint32_t table[4][256];
+
+    /// Bit-reflected x^(8 * bytes - 33) modulo the polynomial; see
+    /// operator().
+    uint32_t constant;
+};
+
+/// Length of each stream's block when interleaving long inputs.
+const uint64_t LONG_BLOCK = 8192;
+
+/// Length of each stream's block for what remains of the input once less
+/// than three LONG_BLOCKs are left.
+const uint64_t SHORT_BLOCK = 256;
+
+const Crc32CShift longShift(LONG_BLOCK);
+const Crc32CShift shortShift(SHORT_BLOCK);
+
+#if __SSE4_2__
+/**
+ * Checksum three consecutive blocks of the given length as independent
+ * streams of crc32 instructions and combine the results.
+ */
+inline uint32_t
+crc32CThreeBlocks(uint32_t crc, const uint64_t* p, uint64_t blockBytes,
+                  const Crc32CShift& shift, bool carrylessMultiply)
+{
+    uint64_t crc0 = crc;
+    uint64_t crc1 = 0;
+    uint64_t crc2 = 0;
+    const uint64_t words = blockBytes / 8;
+    for (uint64_t i = 0; i < words; i++) {
+        crc0 = __builtin_ia32_crc32di(crc0, p[i]);
+        crc1 = __builtin_ia32_crc32di(crc1, p[words + i]);
+        crc2 = __builtin_ia32_crc32di(crc2, p[2 * words + i]);
+    }
+    crc = shift(downCast<uint32_t>(crc0), carrylessMultiply) ^
+          downCast<uint32_t>(crc1);
+    return shift(crc, carrylessMultiply) ^ downCast<uint32_t>(crc2);
+}
+#endif
+
+} // anonymous namespace
+
+/**
+ * Compute the same function as intelCrc32C(), but split the input into
+ * three streams to overlap the latency of consecutive crc32 instructions.
+ * Each crc32 instruction takes three cycles to produce its result but can
+ * start every cycle, so a single dependent chain (as in intelCrc32C())
+ * runs at a third of the instruction's throughput.
+ *
+ * Only worthwhile for inputs of at least Crc32C::INTERLEAVE_THRESHOLD
+ * bytes; Crc32C::update() chooses between the two.
+ *
+ * \param carrylessMultiply
+ *      Whether to merge the streams' results with the PCLMUL instruction
+ *      rather than table lookups. Only pass true if the processor has it
+ *      (see Crc32C::haveCarrylessMultiply).
+ */
+uint32_t
+intelCrc32CInterleaved(uint32_t crc, const void* buffer, uint64_t bytes,
+                       bool carrylessMultiply)
+{
+#if __SSE4_2__
+    const uint64_t* p64 = static_cast<const uint64_t*>(buffer);
+    while (bytes >= 3 * LONG_BLOCK) {
+        crc = crc32CThreeBlocks(crc, p64, LONG_BLOCK, longShift,
+                                carrylessMultiply);
+        p64 += 3 * LONG_BLOCK / 8;
+        bytes -= 3 * LONG_BLOCK;
+    }
+    while (bytes >= 3 * SHORT_BLOCK) {
+        crc = crc32CThreeBlocks(crc, p64, SHORT_BLOCK, shortShift,
+                                carrylessMultiply);
+        p64 += 3 * SHORT_BLOCK / 8;
+        bytes -= 3 * SHORT_BLOCK;
+    }
+    return intelCrc32C(crc, p64, bytes);
+#else
+    throw FatalError(HERE, "SSE 4.2 was not enabled at compile-time");
+#endif
+}
+
+/**
+ * Compute the CRC32C checksums of a number of separate pieces of memory,
+ * such as the objects in a segment being replayed. A single small checksum
+ * is bound by the latency of its chain of crc32 instructions, so this
+ * checksums three pieces at a time to keep the instruction busy.
+ *
+ * \param count
+ *      Number of pieces to checksum.
+ * \param buffers
+ *      The start of each piece.
+ * \param lengths
+ *      The length of each piece in bytes.
+ * \param[out] results
+ *      The checksum of each piece is stored here, just as
+ *      Crc32C().update(buffers[i], lengths[i]).getResult() would return it.
+ * \param forceSoftware
+ *      If true, don't use Intel's CRC32C instruction even if the machine has
+ *      it.
+ */
+void
+Crc32C::batch(uint32_t count, const void* const buffers[],
+              const uint32_t lengths[], ResultType results[],
+              bool forceSoftware)
+{
+    uint32_t i = 0;
+#if __SSE4_2__
+    if (!forceSoftware && haveHardware) {
+        for (; i + 3 <= count; i += 3) {
+            const uint64_t* p0 = static_cast<const uint64_t*>(buffers[i]);
+            const uint64_t* p1 = static_cast<const uint64_t*>(buffers[i + 1]);
+            const uint64_t* p2 = static_cast<const uint64_t*>(buffers[i + 2]);
+            uint32_t words = std::min(std::min(lengths[i], lengths[i + 1]),
+                                      lengths[i + 2]) / 8;
+            uint64_t crc0 = ~0U;
+            uint64_t crc1 = ~0U;
+            uint64_t crc2 = ~0U;
+            for (uint32_t j = 0; j < words; j++) {
+                crc0 = __builtin_ia32_crc32di(crc0, p0[j]);
+                crc1 = __builtin_ia32_crc32di(crc1, p1[j]);
+                crc2 = __builtin_ia32_crc32di(crc2, p2[j]);
+            }
+            results[i] = ~intelCrc32C(downCast<uint32_t>(crc0), p0 + words,
+                                      lengths[i] - 8 * words);
+            results[i + 1] = ~intelCrc32C(downCast<uint32_t>(crc1), p1 + words,
+                                          lengths[i + 1] - 8 * words);
+            results[i + 2] = ~intelCrc32C(downCast<uint32_t>(crc2), p2 + words,
+                                          lengths[i + 2] - 8 * words);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        results[i] = Crc32C(forceSoftware).update(buffers[i], lengths[i])
+                                          .getResult();
+    }
+}
+
 } // namespace RAMCloud
 
 namespace Crc32CSlicingBy8 {
@@ -126,6 +126,56 @@ TEST_P(Crc32CTest, updateFromBuffer) {
     EXPECT_EQ(c.result, d.result);
 }
 
+TEST_P(Crc32CTest, interleaved) {
+    // Long enough for both block sizes of intelCrc32CInterleaved, with
+    // leftovers of every kind.
+    static uint8_t buf[3 * 8192 + 3 * 256 + 64 + 8 + 7 + 3];
+    for (uint32_t i = 0; i < sizeof(buf); i++)
+        buf[i] = static_cast<uint8_t>(i * 131 + (i >> 8));
+
+    uint32_t lengths[] = { Crc32C::INTERLEAVE_THRESHOLD - 1,
+                           Crc32C::INTERLEAVE_THRESHOLD,
+                           3 * 8192 - 1, 3 * 8192, sizeof32(buf) - 3 };
+    // Merge the streams both with and (if the processor has it) without
+    // PCLMUL.
+    bool haveCarrylessMultiply = Crc32C::haveCarrylessMultiply;
+    bool modes[] = { false, haveCarrylessMultiply };
+    foreach (bool carrylessMultiply, modes) {
+        Crc32C::haveCarrylessMultiply = carrylessMultiply;
+        foreach (uint32_t length, lengths) {
+            for (uint32_t offset = 0; offset < 3; offset++) {
+                Crc32C crc(forceSoftware);
+                crc.update(&buf[offset], 5);
+                crc.update(&buf[offset + 5], length - 5);
+                EXPECT_EQ(Crc32C(true).update(&buf[offset], length)
+                                      .getResult(),
+                          crc.getResult()) << length << " " << offset
+                                           << " " << carrylessMultiply;
+            }
+        }
+    }
+    Crc32C::haveCarrylessMultiply = haveCarrylessMultiply;
+}
+
+TEST_P(Crc32CTest, batch) {
+    const void* buffers[7];
+    uint32_t lengths[7];
+    Crc32C::ResultType results[7];
+    for (uint32_t i = 0; i < 7; i++) {
+        buffers[i] = &input[i];
+        lengths[i] = (i * 37) % (sizeof32(input) - 7);
+    }
+
+    Crc32C::batch(7, buffers, lengths, results, forceSoftware);
+    for (uint32_t i = 0; i < 7; i++) {
+        EXPECT_EQ(Crc32C(true).update(buffers[i], lengths[i]).getResult(),
+                  results[i]) << i;
+    }
+    EXPECT_EQ(crcByLength[lengths[0]], results[0]);
+
+    Crc32C::batch(0, NULL, NULL, NULL, forceSoftware);
+}
+
 TEST_P(Crc32CTest, assignmentOperator) {
     Crc32C a;
     a.update(&a, sizeof(a));
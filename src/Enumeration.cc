@@ -15,6 +15,7 @@
 
 #include "Enumeration.h"
 #include "Object.h"
+#include "ShortMacros.h"
 
 namespace RAMCloud {
 
@@ -30,6 +31,14 @@ struct EnumerateBucketArgs {
     /// client, which may differ from the tablet owned by this master.
     uint64_t requestedTabletStartHash;
 
+    /// Number of buckets being enumerated; see Enumeration::complete().
+    uint64_t numBuckets;
+
+    /// The bucket being enumerated. Entries whose key hashes to another
+    /// bucket (when #numBuckets is larger than the HashTable's own size)
+    /// are skipped.
+    uint64_t bucketIndex;
+
     /// Log containing the objects we're enumerating.
     Log* log;
 
@@ -67,12 +76,15 @@ enumerateBucket(uint64_t reference, void* cookie)
     if (type != LOG_ENTRY_TYPE_OBJ)
         return;
 
-    // Filter objects by table and tablet hash range.
+    // Filter objects by table, tablet hash range and bucket.
     Key key(type, buffer);
     KeyHash keyHash = key.getHash();
+    uint64_t unused;
     if (key.getTableId() != args.tableId ||
         keyHash < args.requestedTabletStartHash ||
-        args.iter->top().tabletEndHash < keyHash) {
+        args.iter->top().tabletEndHash < keyHash ||
+        HashTable::findBucketIndex(args.numBuckets, keyHash, &unused) !=
+                args.bucketIndex) {
         return;
     }
 
@@ -136,6 +148,21 @@ appendObjectsToBuffer(Log& log,
         log.getEntry(references[index], objectBuffer);
 
         Object object(objectBuffer);
+        if (!keysOnly && object.isValueCompressed()) {
+            // Clients expect values as they wrote them (see
+            // ObjectManager::setTableCompression()). The uncompressed keys
+            // and value live in the response buffer's own storage. Never
+            // hand out a value the client can't read; leave a corrupt
+            // object out of the enumeration instead.
+            if (!object.decompressValue(*buffer)) {
+                LOG(ERROR, "Compressed value of object in table %lu "
+                    "(version %lu) is corrupt; omitting it from enumeration",
+                    object.getTableId(), object.getVersion());
+                continue;
+            }
+            objectBuffer.reset();
+            object.assembleForLog(objectBuffer);
+        }
         uint32_t length = objectBuffer.size();
         if (keysOnly) {
             uint32_t dataLength = object.getValueLength();
@@ -227,9 +254,11 @@ class ObjectHashComparator {
  *      The iterator provided by the client. The iterator object will
  *      be modified with state that should be returned to the client.
  * \param log
- *      The log containing the objects referenced in the objectMap.
- * \param objectMap
- *      The hash table of objects living on this server.
+ *      The log containing the objects referenced in the objectMaps.
+ * \param objectMaps
+ *      The hash tables that index the tablet's objects on this server
+ *      (there may be several with ServerConfig::Master::hashTablePerTable;
+ *      see ObjectManager::getObjectMaps()). Must not be empty.
  * \param[out] payload
  *      A Buffer to hold the resulting objects.
  * \param maxPayloadBytes
@@ -243,7 +272,7 @@ Enumeration::Enumeration(uint64_t tableId,
                          uint64_t* nextTabletStartHash,
                          EnumerationIterator& iter,
                          Log& log,
-                         HashTable& objectMap,
+                         const std::vector<HashTable*>& objectMaps,
                          Buffer& payload, uint32_t maxPayloadBytes)
     : tableId(tableId)
     , keysOnly(keysOnly)
@@ -253,7 +282,7 @@ Enumeration::Enumeration(uint64_t tableId,
     , nextTabletStartHash(nextTabletStartHash)
     , iter(iter)
     , log(log)
-    , objectMap(objectMap)
+    , objectMaps(objectMaps)
     , payload(payload)
     , maxPayloadBytes(maxPayloadBytes)
 {
@@ -269,21 +298,28 @@ Enumeration::Enumeration(uint64_t tableId,
 void
 Enumeration::complete()
 {
+    // When the tablet's objects are spread over several hash tables, they
+    // are enumerated as if they were all in one table the size of the
+    // largest: bucket i covers bucket i of that table and the matching
+    // bucket of each smaller one (sizes are powers of two).
+    uint64_t numBuckets = 0;
+    foreach (HashTable* objectMap, objectMaps)
+        numBuckets = std::max(numBuckets, objectMap->getNumBuckets());
+
     // Check iterator state to see if the tablet configuration has
     // changed since the last call to enumerateTablet().
     if (iter.size() == 0 ||
         iter.top().tabletStartHash != actualTabletStartHash ||
         iter.top().tabletEndHash != actualTabletEndHash ||
-        iter.top().numBuckets != objectMap.getNumBuckets()) {
+        iter.top().numBuckets != numBuckets) {
 
         EnumerationIterator::Frame frame(
             actualTabletStartHash, actualTabletEndHash,
-            objectMap.getNumBuckets(), 0, 0);
+            numBuckets, 0, 0);
         iter.push(frame);
     }
 
     uint64_t bucketIndex = iter.top().bucketIndex;
-    uint64_t numBuckets = objectMap.getNumBuckets();
     uint32_t bucketStart;
     uint32_t initialPayloadLength = payload.size();
     bool payloadFull = false;
@@ -291,6 +327,7 @@ Enumeration::complete()
     EnumerateBucketArgs args;
     args.tableId = tableId;
     args.requestedTabletStartHash = requestedTabletStartHash;
+    args.numBuckets = numBuckets;
     args.log = &log;
     args.iter = &iter;
     args.objectReferences = &objectRefs;
@@ -298,7 +335,12 @@ Enumeration::complete()
     while (bucketIndex < numBuckets) {
         objectRefs.clear();
         bucketStart = payload.size();
-        objectMap.forEachInBucket(enumerateBucket, cookie, bucketIndex);
+        args.bucketIndex = bucketIndex;
+        foreach (HashTable* objectMap, objectMaps) {
+            uint64_t mapBuckets = objectMap->getNumBuckets();
+            objectMap->forEachInBucket(enumerateBucket, cookie,
+                                       bucketIndex & (mapBuckets - 1));
+        }
         int64_t overflow = appendObjectsToBuffer(log, &payload, objectRefs,
                                                  maxPayloadBytes, keysOnly);
         payloadFull = overflow >= 0;
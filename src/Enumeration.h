@@ -44,7 +44,7 @@ class Enumeration {
                 uint64_t* nextTabletStartHash,
                 EnumerationIterator& iter,
                 Log& log,
-                HashTable& objectMap,
+                const std::vector<HashTable*>& objectMaps,
                 Buffer& payload, uint32_t maxPayloadBytes);
     void complete();
 
@@ -76,14 +76,16 @@ class Enumeration {
     /// The log we're enumerating over. Needed to look up hash table references.
     Log& log;
 
-    /// The hash table of objects living on this server.
-    HashTable& objectMap;
+    /// The hash tables indexing the tablet's objects on this server.
+    std::vector<HashTable*> objectMaps;
 
     /// A Buffer to hold the resulting objects.
     Buffer& payload;
 
     /// The maximum number of bytes of objects to be returned.
     uint32_t maxPayloadBytes;
+
+    DISALLOW_COPY_AND_ASSIGN(Enumeration);
 };
 
 }
@@ -13,11 +13,18 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <immintrin.h>
+
 #include "Common.h"
+#include "Fence.h"
 #include "HashTable.h"
+#include "HopscotchHashTable.h"
 
 namespace RAMCloud {
 
+HashTable::MatchFunction HashTable::match = HashTable::matchFirstCall;
+HashTable::ProbeType HashTable::probeType = HashTable::PROBE_SCALAR;
+
 /**
  * Reinitialize a hash table entry as unused.
  */
@@ -84,6 +91,24 @@ HashTable::Entry::getReference() const
     return ue.ptr;
 }
 
+/**
+ * Like #getReference(), but returns 0 rather than asserting if the entry
+ * does not currently hold a reference. The entry is read exactly once, so
+ * this is safe for readers that don't hold the bucket's lock and may race
+ * with writers clearing the entry or turning it into a chain pointer.
+ */
+uint64_t
+HashTable::Entry::getReferenceIfPresent() const
+{
+    Entry snapshot;
+    snapshot.value = *reinterpret_cast<const volatile uint64_t*>(&value);
+    UnpackedEntry ue;
+    snapshot.unpack(ue);
+    if (ue.chain)
+        return 0;
+    return ue.ptr;
+}
+
 /**
  * Extract the chain pointer to another cache line.
  * \return
@@ -168,9 +193,14 @@ HashTable::Entry::unpack(UnpackedEntry& ue) const
  * Construct an empty set of candidates.
  */
 HashTable::Candidates::Candidates()
-    : bucket(NULL)
+    : table(NULL)
+    , bucket(NULL)
     , index()
+    , matches()
     , secondaryHash()
+    , homeBucket()
+    , pendingLines()
+    , inOverflow(false)
 {
 }
 
@@ -180,24 +210,29 @@ HashTable::Candidates::Candidates()
  * given secondaryHash.
  */
 void
-HashTable::Candidates::init(CacheLine* cl, uint64_t secondaryHash)
+HashTable::Candidates::init(HashTable* table, CacheLine* cl,
+                            uint64_t secondaryHash)
 {
+    this->table = table;
     bucket = cl;
     index = -1;
     this->secondaryHash = secondaryHash;
+    matches = match(cl, secondaryHash);
     next();
 }
 
 /**
  * Obtain the reference for the candidate currently pointed to by the
- * iterator. If there is no next candidate, 0 is returned.
+ * iterator. If there is no next candidate, 0 is returned. 0 is also
+ * returned if the caller doesn't hold the bucket's lock and a concurrent
+ * writer has removed the candidate since it was found.
  */
 uint64_t
 HashTable::Candidates::getReference()
 {
     if (bucket == NULL)
         return 0;
-    return bucket->entries[index].getReference();
+    return bucket->entries[index].getReferenceIfPresent();
 }
 
 /**
@@ -218,8 +253,12 @@ HashTable::Candidates::setReference(uint64_t reference)
 void
 HashTable::Candidates::remove()
 {
-    if (bucket != NULL)
-        bucket->entries[index].clear();
+    if (bucket != NULL) {
+        if (table != NULL)
+            table->removeCandidate(*this);
+        else
+            bucket->entries[index].clear();
+    }
 }
 
 /**
@@ -228,33 +267,21 @@ HashTable::Candidates::remove()
 void
 HashTable::Candidates::next()
 {
-    while (true) {
-        // Not found in the cache line, see if there's a chain to
-        // another cache line.
-        if (index == ENTRIES_PER_CACHE_LINE && bucket != NULL) {
-            Entry* entry = &bucket->entries[ENTRIES_PER_CACHE_LINE - 1];
-            bucket = entry->getChainPointer();
-            index = -1;
-        }
-
-        if (bucket == NULL)
+    while (bucket != NULL) {
+        if (matches != 0) {
+            // The hash within the hash table entry matches, so with high
+            // probability this is the pointer we're looking for. We'll
+            // report this index to the user of this class in the next
+            // getReference() call so that they can verify the match.
+            index = BitOps::findFirstSet(matches) - 1;
+            matches &= matches - 1;
             return;
-
-        // Resume in the current cache line.
-        index++;
-        Entry* candidate = &bucket->entries[index];
-        while (index < ENTRIES_PER_CACHE_LINE) {
-            if (candidate->hashMatches(secondaryHash)) {
-                // The hash within the hash table entry matches, so with
-                // high probability this is the pointer we're looking
-                // for. We'll report this index to the user of this
-                // class in the next getReference() call so that they
-                // can verify the match.
-                return;
-            }
-            candidate++;
-            index++;
         }
+
+        // No more matches in the cache line; let the table decide where
+        // to look next.
+        index = -1;
+        table->nextCacheLine(*this);
     }
 }
 
@@ -268,17 +295,220 @@ HashTable::Candidates::isDone()
     return (bucket == NULL);
 }
 
+/**
+ * Return whether the processor we're running on can use a given
+ * implementation of the bucket probe.
+ *
+ * \param type
+ *      The implementation to check.
+ */
+bool
+HashTable::isProbeTypeSupported(ProbeType type)
+{
+    __builtin_cpu_init();
+    switch (type) {
+    case PROBE_SCALAR:
+        return true;
+    case PROBE_SSE:
+        return __builtin_cpu_supports("sse4.1");
+    case PROBE_AVX2:
+        return __builtin_cpu_supports("avx2");
+    default:
+        return false;
+    }
+}
+
+/**
+ * Return the implementation of the bucket probe currently used by all hash
+ * tables. Unless changed with #setProbeType(), this is the fastest one the
+ * processor supports.
+ */
+HashTable::ProbeType
+HashTable::getProbeType()
+{
+    if (match == matchFirstCall) {
+        for (int type = NUM_PROBE_TYPES - 1; type >= 0; type--) {
+            if (setProbeType(static_cast<ProbeType>(type)))
+                break;
+        }
+    }
+    return probeType;
+}
+
+/**
+ * Change the implementation of the bucket probe used by all hash tables.
+ * This is meant for benchmarks and tests; it must not be called while any
+ * hash table is in use.
+ *
+ * \param type
+ *      The implementation to use.
+ * \return
+ *      True if the probe was changed, false if the processor doesn't
+ *      support \a type.
+ */
+bool
+HashTable::setProbeType(ProbeType type)
+{
+    if (!isProbeTypeSupported(type))
+        return false;
+
+    switch (type) {
+    case PROBE_SSE:
+        match = matchSse;
+        break;
+    case PROBE_AVX2:
+        match = matchAvx2;
+        break;
+    default:
+        match = matchScalar;
+        break;
+    }
+    probeType = type;
+    return true;
+}
+
+/**
+ * Return a printable name for a ProbeType.
+ */
+const char*
+HashTable::probeTypeToString(ProbeType type)
+{
+    switch (type) {
+    case PROBE_SCALAR:
+        return "scalar";
+    case PROBE_SSE:
+        return "sse";
+    case PROBE_AVX2:
+        return "avx2";
+    default:
+        return "unknown";
+    }
+}
+
+/**
+ * Find the entries of a cache line that hold references with a given
+ * secondary hash by examining each entry in turn.
+ *
+ * \param cl
+ *      The cache line to probe.
+ * \param secondaryHash
+ *      The secondary hash bits (16 bits) to look for.
+ * \return
+ *      A bit mask in which bit i is set if cl->entries[i] matches.
+ */
+uint32_t
+HashTable::matchScalar(const CacheLine* cl, uint64_t secondaryHash)
+{
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < ENTRIES_PER_CACHE_LINE; i++) {
+        if (cl->entries[i].hashMatches(secondaryHash))
+            mask |= 1U << i;
+    }
+    return mask;
+}
+
+/**
+ * Equivalent to #matchScalar(), but compares two entries at a time with
+ * SSE4.1 instructions. An entry matches if its hash and chain bits equal
+ * (secondaryHash, 0) and its reference is nonzero.
+ */
+uint32_t
+HashTable::matchSse(const CacheLine* cl, uint64_t secondaryHash)
+{
+    static_assert(ENTRIES_PER_CACHE_LINE % 2 == 0,
+                  "matchSse assumes an even number of entries per line");
+    const __m128i* p = reinterpret_cast<const __m128i*>(cl->entries);
+    const __m128i hashAndChain = _mm_set1_epi64x(0xffff800000000000L);
+    const __m128i pointer = _mm_set1_epi64x(0x00007fffffffffffL);
+    const __m128i wanted = _mm_set1_epi64x(
+            static_cast<int64_t>(secondaryHash << 48));
+    const __m128i zero = _mm_setzero_si128();
+
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < ENTRIES_PER_CACHE_LINE / 2; i++) {
+        __m128i v = _mm_load_si128(p + i);
+        __m128i hashEqual = _mm_cmpeq_epi64(_mm_and_si128(v, hashAndChain),
+                                            wanted);
+        __m128i unused = _mm_cmpeq_epi64(_mm_and_si128(v, pointer), zero);
+        __m128i hit = _mm_andnot_si128(unused, hashEqual);
+        mask |= static_cast<uint32_t>(
+                _mm_movemask_pd(_mm_castsi128_pd(hit))) << (2 * i);
+    }
+    return mask;
+}
+
+/**
+ * Equivalent to #matchSse(), but compares four entries at a time with AVX2
+ * instructions. This is compiled for AVX2 regardless of the target the rest
+ * of the server is built for, so it must only be used if the processor
+ * supports it (see #isProbeTypeSupported()).
+ */
+__attribute__((target("avx2")))
+uint32_t
+HashTable::matchAvx2(const CacheLine* cl, uint64_t secondaryHash)
+{
+    static_assert(ENTRIES_PER_CACHE_LINE % 4 == 0,
+                  "matchAvx2 assumes a multiple of 4 entries per line");
+    const __m256i* p = reinterpret_cast<const __m256i*>(cl->entries);
+    const __m256i hashAndChain = _mm256_set1_epi64x(0xffff800000000000L);
+    const __m256i pointer = _mm256_set1_epi64x(0x00007fffffffffffL);
+    const __m256i wanted = _mm256_set1_epi64x(
+            static_cast<int64_t>(secondaryHash << 48));
+    const __m256i zero = _mm256_setzero_si256();
+
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < ENTRIES_PER_CACHE_LINE / 4; i++) {
+        __m256i v = _mm256_load_si256(p + i);
+        __m256i hashEqual = _mm256_cmpeq_epi64(
+                _mm256_and_si256(v, hashAndChain), wanted);
+        __m256i unused = _mm256_cmpeq_epi64(_mm256_and_si256(v, pointer),
+                                            zero);
+        __m256i hit = _mm256_andnot_si256(unused, hashEqual);
+        mask |= static_cast<uint32_t>(
+                _mm256_movemask_pd(_mm256_castsi256_pd(hit))) << (4 * i);
+    }
+    return mask;
+}
+
+/**
+ * The initial value of #match: select the best implementation for this
+ * processor, then use it.
+ */
+uint32_t
+HashTable::matchFirstCall(const CacheLine* cl, uint64_t secondaryHash)
+{
+    getProbeType();
+    return match(cl, secondaryHash);
+}
+
 /**
  * Constructor for HashTable.
  * \param[in] numBuckets
  *      The number of buckets in the new hash table. This should be a power
  *      of two.
+ * \param[in] memoryPolicy
+ *      Page size and NUMA placement for the bucket array.
  * \throw Exception
  *      An exception is thrown if numBuckets is 0.
  */
-HashTable::HashTable(uint64_t numBuckets)
+HashTable::HashTable(uint64_t numBuckets, const MemoryPolicy& memoryPolicy)
     : numBuckets(BitOps::powerOfTwoLessOrEqual(numBuckets))
-    , buckets(this->numBuckets * sizeof(CacheLine))
+    , memoryPolicy(memoryPolicy)
+    , buckets(this->numBuckets * sizeof(CacheLine), memoryPolicy)
+    , oldBuckets()
+    , oldNumBuckets(0)
+    , resizing(false)
+    , migrated()
+    , bucketsMigrated(0)
+    , keyHashCallback(NULL)
+    , keyHashCookie(NULL)
+    , retiredBuckets()
+    , retiredLines()
+    , resizeCount(0)
+    , numEntries(0)
+    , numOverflowLines(0)
+    , longestChain(1)
+    , optimisticReadsPaused(false)
 {
     if (numBuckets != this->numBuckets) {
         RAMCLOUD_LOG(DEBUG,
@@ -291,28 +521,61 @@ HashTable::HashTable(uint64_t numBuckets)
         throw Exception(HERE, "HashTable numBuckets == 0?!");
 }
 
+/**
+ * Construct a HashTable of the given type.
+ *
+ * \param type
+ *      Which engine to use: "chained" for this class, or "hopscotch" for
+ *      HopscotchHashTable.
+ * \param numBuckets
+ *      Passed to the engine's constructor.
+ * \param memoryPolicy
+ *      Passed to the engine's constructor.
+ * \return
+ *      The new table, which the caller must delete.
+ * \throw Exception
+ *      \a type does not name an engine.
+ */
+HashTable*
+HashTable::create(const string& type, uint64_t numBuckets,
+                  const MemoryPolicy& memoryPolicy)
+{
+    if (type == "chained")
+        return new HashTable(numBuckets, memoryPolicy);
+    if (type == "hopscotch")
+        return new HopscotchHashTable(numBuckets, memoryPolicy);
+    throw Exception(HERE, format("Unknown HashTable type \"%s\"",
+                                 type.c_str()));
+}
+
 /**
  * Destructor for HashTable.
  */
 HashTable::~HashTable()
 {
-    uint32_t lastEntryIndex = ENTRIES_PER_CACHE_LINE - 1;
+    for (uint64_t i = 0; i < numBuckets; ++i)
+        freeChain(&buckets.get()[i]);
 
-    for (uint64_t i = 0; i < numBuckets; ++i) {
-        CacheLine* currBucket = &buckets.get()[i];
-
-        // Skip the first bucket and break the chain
-        Entry* last = &currBucket->entries[lastEntryIndex];
-        currBucket = last->getChainPointer();
-        last->clear();
-
-        while (currBucket != NULL) {
-            CacheLine *nextBucket
-                        = currBucket->entries[lastEntryIndex].getChainPointer();
-            free(currBucket);
-            currBucket = nextBucket;
+    // Migrated old buckets still chain to their overflow lines, but those
+    // lines are owned by #retiredLines now; don't free them twice.
+    if (resizing) {
+        for (uint64_t i = 0; i < oldNumBuckets; ++i) {
+            if (!migrated[i])
+                freeChain(&oldBuckets->get()[i]);
         }
     }
+
+    foreach (CacheLine* cl, retiredLines)
+        free(cl);
+}
+
+/**
+ * Return the name of this engine, as accepted by #create().
+ */
+const char*
+HashTable::getType() const
+{
+    return "chained";
 }
 
 /**
@@ -336,7 +599,7 @@ HashTable::lookup(KeyHash keyHash, Candidates& candidates)
     // caller as it examines possible candidates.
     uint64_t secondaryHash;
     CacheLine *bucket = findBucket(keyHash, &secondaryHash);
-    candidates.init(bucket, secondaryHash);
+    candidates.init(this, bucket, secondaryHash);
 }
 
 /**
@@ -355,8 +618,30 @@ void
 HashTable::insert(KeyHash keyHash, uint64_t reference)
 {
     uint64_t secondaryHash;
+    uint64_t bucketIndex;
+    CacheLine* bucket = findBucket(keyHash, &secondaryHash, &bucketIndex);
+    insertIntoBucket(bucket, secondaryHash, reference, bucketIndex);
+    numEntries++;
+}
+
+/**
+ * Store a reference in the first free entry of a bucket, chaining a new
+ * overflow cache line onto the bucket if it is full.
+ *
+ * \param bucket
+ *      First cache line of the bucket to insert into.
+ * \param secondaryHash
+ *      The secondary hash bits (16 bits) of the key the reference refers to.
+ * \param reference
+ *      Reference to the new element to insert into the bucket.
+ * \param bucketIndex
+ *      Index of the bucket in #buckets; only used for logging.
+ */
+void
+HashTable::insertIntoBucket(CacheLine* bucket, uint64_t secondaryHash,
+                            uint64_t reference, uint64_t bucketIndex)
+{
     int overflowBuckets = 0;
-    CacheLine* bucket = findBucket(keyHash, &secondaryHash);
     while (true) {
         Entry* entry = bucket->entries;
         for (size_t i = 0; i < ENTRIES_PER_CACHE_LINE; i++) {
@@ -375,15 +660,24 @@ HashTable::insert(KeyHash keyHash, uint64_t reference)
         if (bucket == NULL) {
             // no empty space found, allocate a new cache line
             RAMCLOUD_CLOG(NOTICE, "Allocating overflow bucket %d for index %lu",
-                    overflowBuckets,
-                    findBucketIndex(numBuckets, keyHash, &secondaryHash));
+                    overflowBuckets, bucketIndex);
             void *buf = Memory::xmemalign(HERE, sizeof(CacheLine),
                                           sizeof(CacheLine));
             bucket = static_cast<CacheLine *>(buf);
             bucket->entries[0] = *last;
             for (size_t i = 1; i < ENTRIES_PER_CACHE_LINE; i++)
                 bucket->entries[i].clear();
+            // Unlocked readers may follow the chain pointer as soon as it
+            // is stored, so the new line must be filled in first.
+            Fence::sfence();
             last->setChainPointer(bucket);
+
+            numOverflowLines++;
+            uint64_t chainLength = static_cast<uint64_t>(overflowBuckets) + 1;
+            uint64_t longest = longestChain.load();
+            while (chainLength > longest &&
+                   !longestChain.compare_exchange_weak(longest, chainLength)) {
+            }
         }
     }
 }
@@ -391,6 +685,11 @@ HashTable::insert(KeyHash keyHash, uint64_t reference)
 /**
  * Apply the given callback function to each element stored in the
  * specified bucket of the hash table.
+ *
+ * While a resize is in progress, \a bucket refers to the new array of
+ * buckets, and elements that will eventually move into that bucket but
+ * are still in an unmigrated old bucket are included as well.
+ *
  * \param callback
  *      The callback to fire on each element stored in the HashTable.
  * \param cookie
@@ -407,12 +706,69 @@ HashTable::forEachInBucket(void (*callback)(uint64_t, void *),
                            uint64_t bucket)
 {
     uint64_t numCalls = 0;
-    CacheLine *cl = &buckets.get()[bucket];
+
+    if (resizing) {
+        if (numBuckets > oldNumBuckets) {
+            // Growing: the old bucket this one is split from holds elements
+            // for two new buckets, so only pick out the ones that map here.
+            uint64_t oldBucket = bucket & (oldNumBuckets - 1);
+            if (!migrated[oldBucket]) {
+                numCalls += forEachInCacheLines(callback, cookie,
+                        &oldBuckets->get()[oldBucket], bucket);
+            }
+        } else {
+            // Shrinking: two old buckets are merged into this one.
+            for (uint64_t oldBucket = bucket; oldBucket < oldNumBuckets;
+                    oldBucket += numBuckets) {
+                if (!migrated[oldBucket]) {
+                    numCalls += forEachInCacheLines(callback, cookie,
+                            &oldBuckets->get()[oldBucket], ~0UL);
+                }
+            }
+        }
+    }
+
+    numCalls += forEachInCacheLines(callback, cookie,
+            &buckets.get()[bucket], ~0UL);
+    return numCalls;
+}
+
+/**
+ * Helper for forEachInBucket() and migrateBucket(): apply the given callback
+ * function to each element stored in a chain of cache lines.
+ *
+ * \param callback
+ *      The callback to fire on each element stored in the cache lines.
+ * \param cookie
+ *      An opaque parameter to pass to the callback function.
+ * \param cl
+ *      First cache line of the chain.
+ * \param filterBucket
+ *      If not ~0, only elements whose key hash maps into this bucket of
+ *      #buckets are passed to the callback. This requires #keyHashCallback.
+ * \return
+ *      The number of callbacks fired.
+ */
+uint64_t
+HashTable::forEachInCacheLines(void (*callback)(uint64_t, void *),
+                               void *cookie, CacheLine* cl,
+                               uint64_t filterBucket)
+{
+    uint64_t numCalls = 0;
     while (1) {
         for (uint32_t j = 0; j < ENTRIES_PER_CACHE_LINE; j++) {
             Entry *e = &cl->entries[j];
             if (!e->isAvailable() && e->getChainPointer() == NULL) {
-                callback(e->getReference(), cookie);
+                uint64_t reference = e->getReference();
+                if (filterBucket != ~0UL) {
+                    uint64_t unused;
+                    KeyHash keyHash = keyHashCallback(reference,
+                                                      keyHashCookie);
+                    if (findBucketIndex(numBuckets, keyHash, &unused) !=
+                            filterBucket)
+                        continue;
+                }
+                callback(reference, cookie);
                 numCalls++;
             }
         }
@@ -521,14 +877,370 @@ HashTable::findBucketIndex(uint64_t numBuckets,
  *      Hash of key representing the element we're looking for. 
  * \param[out] secondaryHash
  *      The secondary hash bits (16 bits).
+ * \param[out] bucketIndex
+ *      If not NULL, the index of the returned bucket (in the old bucket
+ *      array, if the bucket hasn't been migrated yet during a resize).
  * \return
  *      The bucket corresponding to the given key.
  */
 HashTable::CacheLine*
-HashTable::findBucket(KeyHash keyHash, uint64_t *secondaryHash) //const
+HashTable::findBucket(KeyHash keyHash, uint64_t *secondaryHash,
+                      uint64_t *bucketIndex) //const
+{
+    uint64_t index;
+    if (expect_false(resizing)) {
+        index = findBucketIndex(oldNumBuckets, keyHash, secondaryHash);
+        if (!migrated[index]) {
+            if (bucketIndex != NULL)
+                *bucketIndex = index;
+            return &oldBuckets->get()[index];
+        }
+    }
+    index = findBucketIndex(numBuckets, keyHash, secondaryHash);
+    if (bucketIndex != NULL)
+        *bucketIndex = index;
+    return &buckets.get()[index];
+}
+
+/**
+ * Called by Candidates when it has run out of matches in its current cache
+ * line, to move it on to the next cache line that may hold matches. The
+ * chained table simply follows the chain; other engines override this.
+ *
+ * \param candidates
+ *      Iterator to advance. Its #bucket is set to NULL if no cache lines
+ *      remain to be searched; otherwise #matches is set for the new line.
+ */
+void
+HashTable::nextCacheLine(Candidates& candidates)
+{
+    Entry* entry = &candidates.bucket->entries[ENTRIES_PER_CACHE_LINE - 1];
+    candidates.bucket = entry->getChainPointer();
+    if (candidates.bucket != NULL)
+        candidates.matches = match(candidates.bucket, candidates.secondaryHash);
+}
+
+/**
+ * Called by Candidates::remove() to remove the entry the iterator currently
+ * points at.
+ *
+ * \param candidates
+ *      Iterator whose current entry is to be removed.
+ */
+void
+HashTable::removeCandidate(Candidates& candidates)
+{
+    candidates.bucket->entries[candidates.index].clear();
+    numEntries--;
+}
+
+/**
+ * Free all overflow cache lines chained onto a bucket and unlink them from
+ * the bucket's first cache line.
+ *
+ * \param bucket
+ *      First cache line of the bucket. This is not freed, since it lives
+ *      in an array of buckets.
+ */
+void
+HashTable::freeChain(CacheLine* bucket)
+{
+    uint32_t lastEntryIndex = ENTRIES_PER_CACHE_LINE - 1;
+
+    // Skip the first bucket and break the chain
+    Entry* last = &bucket->entries[lastEntryIndex];
+    CacheLine* currBucket = last->getChainPointer();
+    if (currBucket != NULL)
+        last->clear();
+
+    while (currBucket != NULL) {
+        CacheLine *nextBucket
+                    = currBucket->entries[lastEntryIndex].getChainPointer();
+        free(currBucket);
+        currBucket = nextBucket;
+    }
+}
+
+/**
+ * Return true if this engine implements the incremental resizing methods
+ * (#prepareResize() and so on).
+ */
+bool
+HashTable::supportsResize() const
+{
+    return true;
+}
+
+/**
+ * Allocate the array of buckets for a future resize. This is separate from
+ * #startResize() so that the (potentially slow) allocation can be done
+ * without excluding other users of the table. There must not already be a
+ * resize in progress or retired memory waiting to be released.
+ *
+ * \param newNumBuckets
+ *      The number of buckets the table should have once resized. This must
+ *      be either twice or half of the current number of buckets.
+ * \throw Exception
+ *      An exception is thrown if the new size is invalid or if a previous
+ *      resize has not been completed.
+ */
+void
+HashTable::prepareResize(uint64_t newNumBuckets)
+{
+    if (!supportsResize())
+        throw Exception(HERE, format("%s HashTable can't be resized",
+                                     getType()));
+    if (resizing || retiredBuckets || retiredLines.size() != 0)
+        throw Exception(HERE, "HashTable resize already in progress");
+    if (newNumBuckets != numBuckets * 2 && newNumBuckets * 2 != numBuckets)
+        throw Exception(HERE, format("HashTable can't resize from %lu to %lu "
+                "buckets", numBuckets, newNumBuckets));
+
+    oldBuckets.reset(new LargeBlockOfMemory<CacheLine>(
+            newNumBuckets * sizeof(CacheLine), memoryPolicy));
+    migrated.clear();
+    migrated.resize(std::max(numBuckets, newNumBuckets), 0);
+}
+
+/**
+ * Begin a resize previously prepared with #prepareResize(): the new array
+ * of buckets becomes current, and all elements are considered to still be
+ * in their old buckets until migrated with #migrateBucket().
+ *
+ * The caller must guarantee that no other thread is using the table when
+ * this method is invoked.
+ *
+ * \param keyHashCallback
+ *      Used to obtain the full key hash of a reference. It is only invoked
+ *      if the table is growing, and then only by #migrateBucket() and
+ *      #forEachInBucket().
+ * \param cookie
+ *      Opaque parameter passed to \a keyHashCallback.
+ */
+void
+HashTable::startResize(KeyHashCallback keyHashCallback, void* cookie)
+{
+    assert(oldBuckets && !resizing);
+    this->keyHashCallback = keyHashCallback;
+    this->keyHashCookie = cookie;
+
+    uint64_t newNumBuckets = oldBuckets->length / sizeof(CacheLine);
+    migrated.resize(numBuckets);
+    buckets.swap(*oldBuckets);
+    oldNumBuckets = numBuckets;
+    numBuckets = newNumBuckets;
+    bucketsMigrated = 0;
+    longestChain = 1;
+    resizeCount++;
+    resizing = true;
+
+    RAMCLOUD_LOG(NOTICE, "Resizing HashTable from %lu to %lu buckets",
+                 oldNumBuckets, numBuckets);
+}
+
+/**
+ * Move all elements of one bucket of the old array into the new array.
+ * Elements are copied before the old bucket is marked as migrated, and the
+ * old bucket's overflow cache lines are retired rather than freed, so
+ * unsynchronized readers never see freed memory (though they may see an
+ * element twice or miss it).
+ *
+ * The caller must guarantee exclusive access to the old bucket and the
+ * new bucket(s) it migrates into; see the class documentation. Only one
+ * thread may migrate buckets at a time.
+ *
+ * \param oldBucket
+ *      Index of the bucket in the old array. Buckets that have already
+ *      been migrated are ignored.
+ */
+void
+HashTable::migrateBucket(uint64_t oldBucket)
+{
+    if (!resizing || migrated[oldBucket])
+        return;
+
+    CacheLine* cl = &oldBuckets->get()[oldBucket];
+    while (cl != NULL) {
+        for (uint32_t j = 0; j < ENTRIES_PER_CACHE_LINE; j++) {
+            Entry *e = &cl->entries[j];
+            if (e->isAvailable() || e->getChainPointer() != NULL)
+                continue;
+
+            Entry::UnpackedEntry ue;
+            e->unpack(ue);
+            uint64_t newBucket;
+            if (numBuckets > oldNumBuckets) {
+                uint64_t unused;
+                KeyHash keyHash = keyHashCallback(ue.ptr, keyHashCookie);
+                newBucket = findBucketIndex(numBuckets, keyHash, &unused);
+            } else {
+                newBucket = oldBucket & (numBuckets - 1);
+            }
+            insertIntoBucket(&buckets.get()[newBucket], ue.hash, ue.ptr,
+                             newBucket);
+        }
+        cl = cl->entries[ENTRIES_PER_CACHE_LINE - 1].getChainPointer();
+    }
+
+    // Publish the copies before marking the old bucket migrated.
+    Fence::sfence();
+    migrated[oldBucket] = 1;
+    bucketsMigrated++;
+
+    // The old bucket's first cache line stays in place (it is freed along
+    // with the rest of the old array); just retire its chain. The chain
+    // pointer is left intact for readers still walking the old bucket, so
+    // the destructor must not free chains of migrated buckets.
+    Entry* last = &oldBuckets->get()[oldBucket].entries[
+            ENTRIES_PER_CACHE_LINE - 1];
+    cl = last->getChainPointer();
+    while (cl != NULL) {
+        retiredLines.push_back(cl);
+        numOverflowLines--;
+        cl = cl->entries[ENTRIES_PER_CACHE_LINE - 1].getChainPointer();
+    }
+}
+
+/**
+ * Complete the current resize, if every old bucket has been migrated. The
+ * old array of buckets is retired; it must later be freed with
+ * #releaseRetiredMemory().
+ *
+ * \return
+ *      True if the resize completed (or none was in progress), false if
+ *      some old buckets still need to be migrated.
+ */
+bool
+HashTable::finishResize()
+{
+    if (!resizing)
+        return true;
+    if (bucketsMigrated < oldNumBuckets)
+        return false;
+
+    resizing = false;
+    retiredBuckets = std::move(oldBuckets);
+    RAMCLOUD_LOG(NOTICE, "HashTable resize to %lu buckets complete",
+                 numBuckets);
+    return true;
+}
+
+/**
+ * Free the memory retired by #migrateBucket() and #finishResize(). The
+ * caller must ensure that no thread can still be reading that memory
+ * (ObjectManager, for example, waits until all RPCs that could have
+ * started before the resize finished have completed).
+ *
+ * \return
+ *      True if memory was freed, false if there was nothing to free.
+ */
+bool
+HashTable::releaseRetiredMemory()
+{
+    if (resizing || (!retiredBuckets && retiredLines.size() == 0))
+        return false;
+
+    foreach (CacheLine* cl, retiredLines)
+        free(cl);
+    retiredLines.clear();
+    retiredBuckets.reset();
+    migrated.clear();
+    migrated.shrink_to_fit();
+    return true;
+}
+
+/**
+ * Returns true if a resize is in progress (#startResize() has been called,
+ * but #finishResize() has not yet completed it).
+ */
+bool
+HashTable::isResizing() const
+{
+    return resizing;
+}
+
+/**
+ * Returns the number of buckets in the array being resized away from. Only
+ * meaningful while #isResizing().
+ */
+uint64_t
+HashTable::getOldNumBuckets() const
+{
+    return oldNumBuckets;
+}
+
+/**
+ * Returns the number of old buckets migrated so far during the current
+ * (or most recent) resize.
+ */
+uint64_t
+HashTable::getBucketsMigrated() const
+{
+    return bucketsMigrated;
+}
+
+/**
+ * Returns the number of resizes that have been started on this table. This
+ * changes whenever #getNumBuckets() does, so callers iterating over all
+ * buckets can use it to detect that they need to start over.
+ */
+uint64_t
+HashTable::getResizeCount() const
+{
+    return resizeCount;
+}
+
+/**
+ * Returns the number of references currently stored in the table.
+ */
+uint64_t
+HashTable::getNumEntries() const
+{
+    return numEntries;
+}
+
+/**
+ * Returns the number of overflow cache lines currently chained onto
+ * buckets (not counting any that are retired, but not yet freed).
+ */
+uint64_t
+HashTable::getNumOverflowLines() const
+{
+    return numOverflowLines;
+}
+
+/**
+ * Returns the number of cache lines in the longest bucket chain created
+ * since the last resize started (or since the table was constructed).
+ */
+uint64_t
+HashTable::getLongestChain() const
+{
+    return longestChain;
+}
+
+/**
+ * Record whether readers that don't synchronize with writers (such as
+ * ObjectManager::readObject()'s optimistic path) must stay away from this
+ * table. The table doesn't enforce this; it just keeps the flag next to the
+ * data it protects, so that each table can be paused independently.
+ *
+ * \param paused
+ *      True to pause such readers, false to let them proceed again.
+ */
+void
+HashTable::setOptimisticReadsPaused(bool paused)
+{
+    optimisticReadsPaused.store(paused, std::memory_order_release);
+}
+
+/**
+ * Returns the value last passed to #setOptimisticReadsPaused().
+ */
+bool
+HashTable::areOptimisticReadsPaused() const
 {
-    uint64_t bucketIndex = findBucketIndex(numBuckets, keyHash, secondaryHash);
-    return &buckets.get()[bucketIndex];
+    return optimisticReadsPaused.load(std::memory_order_acquire);
 }
 
 } // namespace RAMCloud
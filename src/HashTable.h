@@ -16,6 +16,9 @@
 #ifndef RAMCLOUD_HASHTABLE_H
 #define RAMCLOUD_HASHTABLE_H
 
+#include <atomic>
+#include <memory>
+
 #include "Common.h"
 #include "BitOps.h"
 #include "CycleCounter.h"
@@ -52,6 +55,39 @@ namespace RAMCloud {
  * buckets). In this case, the last hash table entry in each of the
  * non-terminal cache lines has a pointer to the next cache line instead of a
  * log reference.
+ *
+ * \section resize Incremental Resizing
+ *
+ * The number of buckets may be doubled or halved while the table is in use.
+ * A resize is started by #prepareResize() (which allocates the new array of
+ * buckets) and #startResize() (which makes it current). From then on, each
+ * bucket of the old array is either "unmigrated", in which case all keys that
+ * map into it are still found there (lookups and inserts go to the old
+ * bucket), or "migrated", in which case its entries have been moved into the
+ * new array. #migrateBucket() moves a single old bucket; once every old bucket
+ * has been migrated, #finishResize() ends the resize and the old memory may
+ * be released with #releaseRetiredMemory() once no stale readers remain.
+ *
+ * Since entries only store 16 bits of each key's hash, splitting a bucket
+ * while growing requires the full key hash of every reference; this is
+ * obtained from the KeyHashCallback passed to #startResize().
+ *
+ * Moving a bucket only touches buckets whose indexes are equal modulo the
+ * smaller of the two table sizes. Callers that serialize access to buckets
+ * with locks striped by bucket index (as ObjectManager does) may therefore
+ * migrate a bucket while holding only that bucket's stripe, as long as the
+ * number of stripes does not exceed the number of buckets in either table.
+ *
+ * \section engines Alternative Engines
+ *
+ * The methods that decide where a reference lives (#lookup(), #insert(),
+ * #forEachInBucket() and the iteration in Candidates) are virtual, so that
+ * other layouts can share this interface with the rest of the system;
+ * #create() constructs the engine named by a configuration string. Every
+ * engine must keep the property that a key's home bucket is given by
+ * #findBucketIndex() and that #forEachInBucket() visits exactly the
+ * references whose keys hash to that bucket, since both ObjectManager's
+ * bucket locks and Enumeration depend on it. See HopscotchHashTable.
  */
 class HashTable {
   PRIVATE:
@@ -83,6 +119,7 @@ class HashTable {
         void setChainPointer(CacheLine *ptr);
         bool isAvailable() const;
         uint64_t getReference() const;
+        uint64_t getReferenceIfPresent() const;
         CacheLine* getChainPointer() const;
         bool hashMatches(uint64_t hash) const;
 
@@ -116,6 +153,9 @@ class HashTable {
         };
 
         void unpack(UnpackedEntry& ue) const;
+
+        friend class HashTable;
+        friend class HopscotchHashTable;
     };
     static_assert(sizeof(Entry) == 8, "HashTable::Entry is not 8 bytes");
 
@@ -186,7 +226,11 @@ class HashTable {
         bool isDone();
 
       PRIVATE:
-        void init(CacheLine* cl, uint64_t secondaryHash);
+        void init(HashTable* table, CacheLine* cl, uint64_t secondaryHash);
+
+        /// The table this iterator belongs to. Used to keep track of the
+        /// number of entries in the table when candidates are removed.
+        HashTable* table;
 
         /// Pointer to the hash table bucket we're currently iterating over.
         CacheLine* bucket;
@@ -194,22 +238,73 @@ class HashTable {
         /// Index into bucket we're currently iterating over.
         uint32_t index;
 
+        /// Bit i is set if entry i of #bucket matches #secondaryHash and
+        /// has not yet been returned by the iterator (see HashTable::match).
+        uint32_t matches;
+
         /// This iterator only returns references to entries that share this
         /// secondaryHash. All others cannot possibly be matches. This helps
         /// to reduce the number of candidates whose keys are extracted from
         /// the log and compared.
         uint64_t secondaryHash;
 
+        /// The remaining fields hold iteration state for engines that
+        /// search more than one chain of cache lines (see
+        /// HopscotchHashTable::nextCacheLine). The chained HashTable
+        /// doesn't use them.
+
+        /// Index of the bucket the key being looked up hashes to.
+        uint64_t homeBucket;
+
+        /// Engine-specific bit mask of cache lines still to be searched.
+        uint32_t pendingLines;
+
+        /// True once the iterator has moved on to overflow cache lines.
+        bool inOverflow;
+
         friend class HashTable;
+        friend class HopscotchHashTable;
     };
 
-    explicit HashTable(uint64_t numBuckets);
-    ~HashTable();
-    void lookup(KeyHash keyHash, Candidates& candidates);
-    void insert(KeyHash keyHash, uint64_t reference);
-    uint64_t forEachInBucket(void (*callback)(uint64_t, void *),
-                             void *cookie,
-                             uint64_t bucket);
+    /**
+     * Callback used during resizes to obtain the full key hash of the
+     * element a reference refers to. The first argument is the reference,
+     * the second is the cookie given to #startResize().
+     */
+    typedef KeyHash (*KeyHashCallback)(uint64_t, void *);
+
+    /**
+     * Implementations of the routine that probes a cache line for entries
+     * matching a secondary hash (see #match). The SIMD versions compare all
+     * entries of a cache line at once; which ones can be used depends on
+     * the processor the server runs on.
+     */
+    enum ProbeType {
+        /// Examine each entry in turn. Always available.
+        PROBE_SCALAR = 0,
+        /// Compare two entries at a time using SSE4.1 instructions.
+        PROBE_SSE,
+        /// Compare four entries at a time using AVX2 instructions.
+        PROBE_AVX2,
+        NUM_PROBE_TYPES
+    };
+    static bool isProbeTypeSupported(ProbeType type);
+    static ProbeType getProbeType();
+    static bool setProbeType(ProbeType type);
+    static const char* probeTypeToString(ProbeType type);
+
+    static HashTable* create(const string& type, uint64_t numBuckets,
+            const MemoryPolicy& memoryPolicy = MemoryPolicy());
+
+    explicit HashTable(uint64_t numBuckets,
+            const MemoryPolicy& memoryPolicy = MemoryPolicy());
+    virtual ~HashTable();
+    virtual const char* getType() const;
+    virtual void lookup(KeyHash keyHash, Candidates& candidates);
+    virtual void insert(KeyHash keyHash, uint64_t reference);
+    virtual uint64_t forEachInBucket(void (*callback)(uint64_t, void *),
+                                     void *cookie,
+                                     uint64_t bucket);
     uint64_t forEach(void (*callback)(uint64_t, void *), void *cookie);
     void prefetchBucket(KeyHash keyHash);
     static uint32_t bytesPerCacheLine();
@@ -219,18 +314,79 @@ class HashTable {
                                     KeyHash keyHash,
                                     uint64_t *secondaryHash);
 
+    virtual bool supportsResize() const;
+    void prepareResize(uint64_t newNumBuckets);
+    void startResize(KeyHashCallback keyHashCallback, void* cookie);
+    void migrateBucket(uint64_t oldBucket);
+    bool finishResize();
+    bool releaseRetiredMemory();
+    bool isResizing() const;
+    uint64_t getOldNumBuckets() const;
+    uint64_t getBucketsMigrated() const;
+    uint64_t getResizeCount() const;
+    uint64_t getNumEntries() const;
+    uint64_t getNumOverflowLines() const;
+    uint64_t getLongestChain() const;
+    void setOptimisticReadsPaused(bool paused);
+    bool areOptimisticReadsPaused() const;
+
   PRIVATE:
 
     // forward declarations
     class Entry;
     struct CacheLine;
 
-    CacheLine * findBucket(KeyHash keyHash, uint64_t *secondaryHash);
+    CacheLine * findBucket(KeyHash keyHash, uint64_t *secondaryHash,
+                           uint64_t *bucketIndex = NULL);
+    virtual void nextCacheLine(Candidates& candidates);
+    virtual void removeCandidate(Candidates& candidates);
+
+    /**
+     * Signature of the functions that implement #match for each ProbeType.
+     * They return a bit mask in which bit i is set if entry i of the given
+     * cache line holds a reference with the given secondary hash.
+     */
+    typedef uint32_t (*MatchFunction)(const CacheLine* cl,
+                                      uint64_t secondaryHash);
+    static uint32_t matchScalar(const CacheLine* cl, uint64_t secondaryHash);
+    static uint32_t matchSse(const CacheLine* cl, uint64_t secondaryHash);
+    static uint32_t matchAvx2(const CacheLine* cl, uint64_t secondaryHash);
+    static uint32_t matchFirstCall(const CacheLine* cl,
+                                   uint64_t secondaryHash);
+
+    /**
+     * Used by Candidates to find all entries of a cache line that match a
+     * secondary hash. This points to the fastest implementation the
+     * processor supports, unless overridden with #setProbeType(). It is
+     * selected lazily (see #matchFirstCall()) so that it is valid even
+     * during static initialization.
+     */
+    static MatchFunction match;
+
+    /// The ProbeType that #match currently implements.
+    static ProbeType probeType;
+    void insertIntoBucket(CacheLine* bucket, uint64_t secondaryHash,
+                          uint64_t reference, uint64_t bucketIndex);
+    uint64_t forEachInCacheLines(void (*callback)(uint64_t, void *),
+                                 void *cookie, CacheLine* cl,
+                                 uint64_t filterBucket);
+    static void freeChain(CacheLine* bucket);
 
     /**
-     * The number of buckets allocated to the table.
+     * The number of buckets allocated to the table. While a resize is in
+     * progress this is the size of the new array of buckets.
+     *
+     * This is only modified by #startResize(), when the caller guarantees
+     * exclusive access to the table, but it may be read without any locks
+     * held (ObjectManager does so to find the lock for a key's bucket).
      */
-    const uint64_t numBuckets;
+    uint64_t numBuckets;
+
+    /**
+     * Page size and NUMA placement for #buckets, and for the new arrays
+     * allocated when the table is resized.
+     */
+    MemoryPolicy memoryPolicy;
 
     /**
      * The array of buckets.
@@ -238,7 +394,87 @@ class HashTable {
      */
     LargeBlockOfMemory<CacheLine> buckets;
 
-    friend void hashTableBenchmark(uint64_t nkeys, uint64_t nlines);
+    /**
+     * Staging area for the next array of buckets. Between #prepareResize()
+     * and #startResize() this holds the new array; while a resize is in
+     * progress it holds the old one (the two are swapped when the resize
+     * starts). Empty at all other times, except while the old array waits
+     * in #retiredBuckets to be released.
+     */
+    std::unique_ptr<LargeBlockOfMemory<CacheLine>> oldBuckets;
+
+    /**
+     * Number of buckets in #oldBuckets. Only meaningful while #resizing.
+     */
+    uint64_t oldNumBuckets;
+
+    /**
+     * True while a resize is in progress; that is, while some buckets may
+     * still be found in #oldBuckets.
+     */
+    std::atomic<bool> resizing;
+
+    /**
+     * One byte per bucket in #oldBuckets; nonzero means the bucket has been
+     * migrated into #buckets. Each byte is only written by a thread holding
+     * exclusive access to the corresponding bucket, which is why this is
+     * not a bit vector.
+     */
+    std::vector<uint8_t> migrated;
+
+    /**
+     * Number of nonzero values in #migrated.
+     */
+    std::atomic<uint64_t> bucketsMigrated;
+
+    /**
+     * Supplies full key hashes for the references being split during a
+     * resize that doubles the table. Set by #startResize().
+     */
+    KeyHashCallback keyHashCallback;
+
+    /// Cookie passed to #keyHashCallback.
+    void* keyHashCookie;
+
+    /**
+     * Memory from previous resizes that could still be referenced by
+     * readers which do not synchronize with the resize (for example, a
+     * Candidates object initialized just before a bucket was migrated).
+     * This consists of the old bucket array and the overflow cache lines
+     * that were chained off of migrated buckets. It is freed by
+     * #releaseRetiredMemory(), which the caller invokes only once no such
+     * readers can exist.
+     */
+    std::unique_ptr<LargeBlockOfMemory<CacheLine>> retiredBuckets;
+
+    /// See #retiredBuckets.
+    std::vector<CacheLine*> retiredLines;
+
+    /// Number of times #startResize() has been called. Used by callers that
+    /// iterate over buckets to detect a change in the number of buckets.
+    std::atomic<uint64_t> resizeCount;
+
+    /// Number of references currently stored in the table.
+    std::atomic<uint64_t> numEntries;
+
+    /// Number of overflow cache lines currently chained off of buckets.
+    std::atomic<uint64_t> numOverflowLines;
+
+    /// Number of cache lines in the longest bucket chain seen since the
+    /// last resize started.
+    std::atomic<uint64_t> longestChain;
+
+    /**
+     * Set by the table's owner while readers that don't synchronize with
+     * writers must not use the table (for example, while its bucket array
+     * is about to be replaced). The table itself only stores it; see
+     * ObjectManager::readObject().
+     */
+    std::atomic<bool> optimisticReadsPaused;
+
+    friend class HopscotchHashTable;
+    friend void hashTableBenchmark(uint64_t nkeys, uint64_t nlines,
+                                   const string& type, bool compareProbes);
     DISALLOW_COPY_AND_ASSIGN(HashTable);
 };
 
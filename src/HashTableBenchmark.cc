@@ -43,17 +43,116 @@ class TestObject {
     uint64_t key;
 } __attribute__((aligned(64)));
 
+/**
+ * Look up every key in the table once and return the total number of
+ * cycles taken.
+ */
+uint64_t
+measureLookups(HashTable& ht, uint64_t nkeys)
+{
+    HashTable::Candidates c;
+
+    // don't use a CycleCounter, as we may want to run without PERF_COUNTERS
+    uint64_t lookupCycles = Cycles::rdtsc();
+    for (uint64_t i = 0; i < nkeys; i++) {
+        Key key(0, &i, sizeof(i));
+        uint64_t reference = 0;
+        bool success = false;
+
+        ht.lookup(key.getHash(), c);
+        while (!c.isDone()) {
+            reference = c.getReference();
+            TestObject* candidateObject =
+                reinterpret_cast<TestObject*>(reference);
+            Key candidateKey(0,
+                             &candidateObject->key,
+                             sizeof(candidateObject->key));
+            if (candidateKey == key) {
+                success = true;
+                break;
+            }
+            c.next();
+        }
+        assert(success);
+        assert(reinterpret_cast<TestObject*>(reference)->key == i);
+    }
+    return Cycles::rdtsc() - lookupCycles;
+}
+
 } // anonymous namespace
 
+/**
+ * Fill fresh tables to loads of 50% through 95% and print, for each, the
+ * memory used per key (including overflow lines) and the average insert and
+ * lookup latency. Load is relative to HashTable::entriesPerCacheLine()
+ * entries per bucket for every engine, so that engines are compared at the
+ * same number of keys for the same memory.
+ *
+ * \param nlines
+ *      Number of buckets in each table.
+ * \param type
+ *      Which HashTable engine to measure (see HashTable::create()).
+ */
+void
+hashTableLoadSweep(uint64_t nlines, const string& type)
+{
+    uint64_t totalEntries = nlines * HashTable::entriesPerCacheLine();
+    uint64_t maxKeys = totalEntries * 95 / 100;
+    LargeBlockOfMemory<TestObject> block(maxKeys * sizeof(TestObject));
+    TestObject* values = block.get();
+
+    printf("hash table type: %s\n", type.c_str());
+    printf("hash table lines: %lu\n", nlines);
+    printf("%6s %10s %10s %10s %12s %12s\n", "load", "keys", "bytes/key",
+           "overflow", "insert (ns)", "lookup (ns)");
+    for (uint64_t percent = 50; percent <= 95; percent += 5) {
+        std::unique_ptr<HashTable> ht(HashTable::create(type, nlines));
+        uint64_t nkeys = totalEntries * percent / 100;
+
+        uint64_t insertCycles = Cycles::rdtsc();
+        for (uint64_t i = 0; i < nkeys; i++) {
+            Key key(0, &i, sizeof(i));
+            values[i] = TestObject(i);
+            ht->insert(key.getHash(), reinterpret_cast<uint64_t>(&values[i]));
+        }
+        insertCycles = Cycles::rdtsc() - insertCycles;
+        uint64_t lookupCycles = measureLookups(*ht, nkeys);
+
+        uint64_t bytes = (nlines + ht->getNumOverflowLines()) *
+                HashTable::bytesPerCacheLine();
+        printf("%5lu%% %10lu %10.2f %10lu %12lu %12lu\n", percent, nkeys,
+               static_cast<double>(bytes) / static_cast<double>(nkeys),
+               ht->getNumOverflowLines(),
+               Cycles::toNanoseconds(insertCycles / nkeys),
+               Cycles::toNanoseconds(lookupCycles / nkeys));
+    }
+}
+
+/**
+ * \param nkeys
+ *      Number of keys to insert into the table.
+ * \param nlines
+ *      Number of buckets in the table.
+ * \param type
+ *      Which HashTable engine to measure (see HashTable::create()).
+ * \param compareProbes
+ *      If true, the lookup measurements are repeated once for every
+ *      HashTable::ProbeType the processor supports, so that the scalar and
+ *      SIMD bucket probes can be compared. Otherwise only the probe
+ *      HashTable selects by default is measured.
+ */
 void
-hashTableBenchmark(uint64_t nkeys, uint64_t nlines)
+hashTableBenchmark(uint64_t nkeys, uint64_t nlines, const string& type,
+                   bool compareProbes)
 {
     uint64_t i;
-    HashTable ht(nlines);
+    std::unique_ptr<HashTable> table(HashTable::create(type, nlines));
+    HashTable& ht = *table;
     LargeBlockOfMemory<TestObject> block(nkeys * sizeof(TestObject));
     TestObject* values = block.get();
     assert(nlines == ht.numBuckets);
 
+    printf("hash table type: %s\n", ht.getType());
     printf("hash table keys: %lu\n", nkeys);
     printf("hash table lines: %lu\n", nlines);
     printf("cache line size: %d\n", ht.bytesPerCacheLine());
@@ -111,40 +210,30 @@ hashTableBenchmark(uint64_t nkeys, uint64_t nlines)
 
     printf("Starting lookups in 3 seconds (get your measurements ready!)\n");
     sleep(3);
-    printf("running lookup measurements...");
-    fflush(stdout);
 
-    // don't use a CycleCounter, as we may want to run without PERF_COUNTERS
-    uint64_t lookupCycles = Cycles::rdtsc();
-    for (i = 0; i < nkeys; i++) {
-        Key key(0, &i, sizeof(i));
-        uint64_t reference = 0;
-        bool success = false;
-
-        ht.lookup(key.getHash(), c);
-        while (!c.isDone()) {
-            reference = c.getReference();
-            TestObject* candidateObject =
-                reinterpret_cast<TestObject*>(reference);
-            Key candidateKey(0,
-                             &candidateObject->key,
-                             sizeof(candidateObject->key));
-            if (candidateKey == key) {
-                success = true;
-                break;
-            }
-            c.next();
+    HashTable::ProbeType defaultProbe = HashTable::getProbeType();
+    for (int type = 0; type < HashTable::NUM_PROBE_TYPES; type++) {
+        HashTable::ProbeType probe = static_cast<HashTable::ProbeType>(type);
+        if (compareProbes) {
+            if (!HashTable::setProbeType(probe))
+                continue;
+        } else if (probe != defaultProbe) {
+            continue;
         }
-        assert(success);
-        assert(reinterpret_cast<TestObject*>(reference)->key == i);
-    }
-    i = Cycles::rdtsc() - lookupCycles;
-    printf("done!\n");
 
-    printf("== lookup() took %.3f s ==\n", Cycles::toSeconds(i));
+        printf("running lookup measurements (%s probe)...",
+               HashTable::probeTypeToString(probe));
+        fflush(stdout);
+        i = measureLookups(ht, nkeys);
+        printf("done!\n");
+
+        printf("== lookup() with %s probe took %.3f s ==\n",
+               HashTable::probeTypeToString(probe), Cycles::toSeconds(i));
 
-    printf("    external avg: %lu ticks, %lu nsec\n", i / nkeys,
-        Cycles::toNanoseconds(i / nkeys));
+        printf("    external avg: %lu ticks, %lu nsec\n", i / nkeys,
+            Cycles::toNanoseconds(i / nkeys));
+    }
+    HashTable::setProbeType(defaultProbe);
 
     uint64_t *histogram = static_cast<uint64_t *>(
         Memory::xmalloc(HERE, nlines * sizeof(histogram[0])));
@@ -191,6 +280,9 @@ main(int argc, char **argv)
 
     uint64_t hashTableMegs, numberOfKeys;
     double loadFactor;
+    bool compareProbes;
+    bool loadSweep;
+    string type;
 
     OptionsDescription benchmarkOptions("HashTableBenchmark");
     benchmarkOptions.add_options()
@@ -205,7 +297,21 @@ main(int argc, char **argv)
         ("NumberOfKeys,n",
          ProgramOptions::value<uint64_t>(&numberOfKeys)->
             default_value(0),
-         "Number of keys to insert into the HashTable (overrides LoadFactor)");
+         "Number of keys to insert into the HashTable (overrides LoadFactor)")
+        ("CompareProbes,c",
+         ProgramOptions::bool_switch(&compareProbes),
+         "Measure lookups once with each bucket probe implementation "
+         "(scalar and SIMD) that the processor supports, rather than only "
+         "with the default one")
+        ("Type,t",
+         ProgramOptions::value<string>(&type)->
+            default_value("chained"),
+         "HashTable engine to measure: chained or hopscotch")
+        ("LoadSweep,s",
+         ProgramOptions::bool_switch(&loadSweep),
+         "Instead of the usual measurements, fill fresh tables to loads of "
+         "50% through 95% and report memory per key and insert and lookup "
+         "latency at each");
 
     OptionParser optionParser(benchmarkOptions, argc, argv);
 
@@ -223,6 +329,10 @@ main(int argc, char **argv)
                           static_cast<double>(totalEntries));
     }
 
-    hashTableBenchmark(numberOfKeys, numberOfCachelines);
+    if (loadSweep) {
+        hashTableLoadSweep(numberOfCachelines, type);
+        return 0;
+    }
+    hashTableBenchmark(numberOfKeys, numberOfCachelines, type, compareProbes);
     return 0;
 }
@@ -197,6 +197,18 @@ TEST_F(HashTableEntryTest, getReference) {
     EXPECT_EQ(&o, reinterpret_cast<TestObject*>(e.getReference()));
 }
 
+TEST_F(HashTableEntryTest, getReferenceIfPresent) {
+    HashTable::Entry e;
+    TestObject o;
+    uint64_t oRef = o.u64Address();
+    e.setReference(0xaaaaUL, oRef);
+    EXPECT_EQ(oRef, e.getReferenceIfPresent());
+    e.clear();
+    EXPECT_EQ(0UL, e.getReferenceIfPresent());
+    e.setChainPointer(reinterpret_cast<HashTable::CacheLine*>(0x1000UL));
+    EXPECT_EQ(0UL, e.getReferenceIfPresent());
+}
+
 TEST_F(HashTableEntryTest, getChainPointer) {
     HashTable::CacheLine *cl;
     cl = reinterpret_cast<HashTable::CacheLine*>(0x7fffffffffffUL);
@@ -579,6 +591,10 @@ TEST_F(HashTableTest, findBucket) {
     uint64_t expectedBucketIdx = (hashValue & 0x0000ffffffffffffffffUL) % 1024;
     EXPECT_EQ(actualBucketIdx, expectedBucketIdx);
     EXPECT_EQ(secondaryHash, hashValue >> 48);
+
+    uint64_t bucketIndex = 0;
+    EXPECT_EQ(bucket, ht.findBucket(hashValue, &secondaryHash, &bucketIndex));
+    EXPECT_EQ(expectedBucketIdx, bucketIndex);
 }
 
 /**
@@ -674,6 +690,83 @@ TEST_F(HashTableTest, lookup) {
     delete v;
 }
 
+TEST_F(HashTableTest, setProbeType) {
+    HashTable::ProbeType original = HashTable::getProbeType();
+    EXPECT_TRUE(HashTable::isProbeTypeSupported(original));
+    EXPECT_TRUE(HashTable::setProbeType(HashTable::PROBE_SCALAR));
+    EXPECT_EQ(HashTable::PROBE_SCALAR, HashTable::getProbeType());
+    EXPECT_FALSE(HashTable::setProbeType(HashTable::NUM_PROBE_TYPES));
+    EXPECT_EQ(HashTable::PROBE_SCALAR, HashTable::getProbeType());
+    EXPECT_STREQ("avx2", HashTable::probeTypeToString(HashTable::PROBE_AVX2));
+    HashTable::setProbeType(original);
+}
+
+TEST_F(HashTableTest, match_allProbeTypesAgree) {
+    HashTable::CacheLine* cl = static_cast<HashTable::CacheLine*>(
+            Memory::xmemalign(HERE, sizeof(HashTable::CacheLine),
+                              sizeof(HashTable::CacheLine)));
+
+    // Secondary hashes are drawn from a tiny range to get many matches.
+    for (int trial = 0; trial < 1000; trial++) {
+        for (uint32_t i = 0; i < HashTable::ENTRIES_PER_CACHE_LINE; i++) {
+            uint64_t r = generateRandom();
+            if (r % 5 == 0) {
+                cl->entries[i].clear();
+            } else if (i == HashTable::ENTRIES_PER_CACHE_LINE - 1 &&
+                       r % 5 == 1) {
+                cl->entries[i].setChainPointer(cl);
+            } else {
+                cl->entries[i].setReference((r >> 8) % 3,
+                                            (r >> 16) & 0x7fffffffffffUL);
+                if (((r >> 16) & 0x7fffffffffffUL) == 0)
+                    cl->entries[i].clear();
+            }
+        }
+        for (uint64_t hash = 0; hash < 3; hash++) {
+            uint32_t expected = HashTable::matchScalar(cl, hash);
+            if (HashTable::isProbeTypeSupported(HashTable::PROBE_SSE)) {
+                EXPECT_EQ(expected, HashTable::matchSse(cl, hash));
+            }
+            if (HashTable::isProbeTypeSupported(HashTable::PROBE_AVX2)) {
+                EXPECT_EQ(expected, HashTable::matchAvx2(cl, hash));
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < HashTable::ENTRIES_PER_CACHE_LINE; i++)
+        cl->entries[i].setReference(0xffff, 1 + i);
+    cl->entries[3].clear();
+    EXPECT_EQ(0xf7U, HashTable::matchScalar(cl, 0xffff));
+    EXPECT_EQ(0U, HashTable::matchScalar(cl, 0xfffe));
+    if (HashTable::isProbeTypeSupported(HashTable::PROBE_SSE)) {
+        EXPECT_EQ(0xf7U, HashTable::matchSse(cl, 0xffff));
+    }
+    if (HashTable::isProbeTypeSupported(HashTable::PROBE_AVX2)) {
+        EXPECT_EQ(0xf7U, HashTable::matchAvx2(cl, 0xffff));
+    }
+
+    free(cl);
+}
+
+TEST_F(HashTableTest, lookup_eachProbeType) {
+    HashTable::ProbeType original = HashTable::getProbeType();
+
+    // Spans three cache lines, so chains are followed too.
+    setup(0, seven * 2 + 2);
+    for (int type = 0; type < HashTable::NUM_PROBE_TYPES; type++) {
+        if (!HashTable::setProbeType(static_cast<HashTable::ProbeType>(type)))
+            continue;
+        for (uint64_t i = 0; i < numEnt; i++) {
+            string key = format("%lu", i);
+            EXPECT_EQ(&entryAt(&ht, i / seven, i % seven),
+                      findBucketAndLookupEntry(&ht, 0, key.c_str(),
+                            downCast<uint16_t>(key.length())))
+                << HashTable::probeTypeToString(HashTable::getProbeType());
+        }
+    }
+    HashTable::setProbeType(original);
+}
+
 #if 0
 TEST_F(HashTableTest, remove) {
     HashTable ht(1);
@@ -823,4 +916,211 @@ TEST_F(HashTableTest, forEach) {
         EXPECT_EQ(1U, checkoff[i].count);
 }
 
+/**
+ * KeyHashCallback used by the resize tests: references are TestObject
+ * pointers.
+ */
+static KeyHash
+test_resize_keyHash(uint64_t ref, void *cookie)
+{
+    EXPECT_EQ(cookie, reinterpret_cast<void *>(58));
+    TestObject* obj = reinterpret_cast<TestObject*>(ref);
+    Key key(obj->tableId, obj->stringKeyPtr, obj->stringKeyLength);
+    return key.getHash();
+}
+
+/**
+ * Fill a hash table with TestObjects keyed "0" through "count - 1".
+ */
+static void
+test_resize_fill(HashTable* ht, TestObject* objects, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        objects[i].setKey(format("%u", i));
+        Key key(objects[i].tableId,
+                objects[i].stringKeyPtr,
+                objects[i].stringKeyLength);
+        ht->insert(key.getHash(), objects[i].u64Address());
+    }
+}
+
+TEST_F(HashTableTest, prepareResize_badSize) {
+    HashTable ht(4);
+    EXPECT_THROW(ht.prepareResize(4), Exception);
+    EXPECT_THROW(ht.prepareResize(16), Exception);
+    ht.prepareResize(8);
+    ht.startResize(test_resize_keyHash, reinterpret_cast<void *>(58));
+    EXPECT_THROW(ht.prepareResize(16), Exception);
+}
+
+TEST_F(HashTableTest, resize_grow) {
+    HashTable ht(4);
+    uint32_t count = 200;
+    TestObject* objects = new TestObject[count];
+    test_resize_fill(&ht, objects, count);
+    EXPECT_EQ(count, ht.getNumEntries());
+    EXPECT_LT(0U, ht.getNumOverflowLines());
+
+    ht.prepareResize(8);
+    EXPECT_EQ(4U, ht.getNumBuckets());
+    ht.startResize(test_resize_keyHash, reinterpret_cast<void *>(58));
+    EXPECT_TRUE(ht.isResizing());
+    EXPECT_EQ(8U, ht.getNumBuckets());
+    EXPECT_EQ(4U, ht.getOldNumBuckets());
+    EXPECT_EQ(1U, ht.getResizeCount());
+
+    // Elements must be found whether or not their bucket has moved.
+    ht.migrateBucket(1);
+    ht.migrateBucket(1);
+    EXPECT_EQ(1U, ht.getBucketsMigrated());
+    EXPECT_FALSE(ht.finishResize());
+    for (uint32_t i = 0; i < count; i++) {
+        Key key(objects[i].tableId,
+                objects[i].stringKeyPtr,
+                objects[i].stringKeyLength);
+        uint64_t outRef;
+        EXPECT_TRUE(lookup(&ht, key, outRef));
+        EXPECT_EQ(objects[i].u64Address(), outRef);
+    }
+
+    // Each element is visited exactly once, even though some are still in
+    // the old buckets.
+    EXPECT_EQ(count, ht.forEach(test_forEach_callback,
+        reinterpret_cast<void *>(57)));
+    for (uint32_t i = 0; i < count; i++)
+        EXPECT_EQ(1U, objects[i].count);
+
+    for (uint64_t i = 0; i < ht.getOldNumBuckets(); i++)
+        ht.migrateBucket(i);
+    EXPECT_TRUE(ht.finishResize());
+    EXPECT_FALSE(ht.isResizing());
+    EXPECT_EQ(count, ht.getNumEntries());
+    EXPECT_TRUE(ht.releaseRetiredMemory());
+    EXPECT_FALSE(ht.releaseRetiredMemory());
+
+    for (uint32_t i = 0; i < count; i++) {
+        Key key(objects[i].tableId,
+                objects[i].stringKeyPtr,
+                objects[i].stringKeyLength);
+        uint64_t unused;
+        uint64_t bucket = HashTable::findBucketIndex(8, key.getHash(),
+                                                     &unused);
+        uint64_t outRef;
+        EXPECT_TRUE(lookup(&ht, key, outRef));
+        EXPECT_EQ(objects[i].u64Address(), outRef);
+        EXPECT_EQ(&ht.buckets.get()[bucket],
+                  ht.findBucket(key.getHash(), &unused));
+    }
+
+    delete[] objects;
+}
+
+TEST_F(HashTableTest, resize_shrink) {
+    HashTable ht(8);
+    uint32_t count = 100;
+    TestObject* objects = new TestObject[count];
+    test_resize_fill(&ht, objects, count);
+
+    ht.prepareResize(4);
+    ht.startResize(test_resize_keyHash, reinterpret_cast<void *>(58));
+    EXPECT_EQ(4U, ht.getNumBuckets());
+    ht.migrateBucket(6);
+
+    // Inserts into unmigrated buckets go to the old array.
+    TestObject extra(0, "extra");
+    Key extraKey(extra.tableId, extra.stringKeyPtr, extra.stringKeyLength);
+    ht.insert(extraKey.getHash(), extra.u64Address());
+
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < ht.getNumBuckets(); i++) {
+        total += ht.forEachInBucket(test_forEach_callback,
+                reinterpret_cast<void *>(57), i);
+    }
+    EXPECT_EQ(count + 1, total);
+
+    for (uint64_t i = 0; i < ht.getOldNumBuckets(); i++)
+        ht.migrateBucket(i);
+    EXPECT_TRUE(ht.finishResize());
+    EXPECT_EQ(count + 1, ht.getNumEntries());
+    EXPECT_EQ(count + 1, ht.forEach(test_forEach_callback,
+        reinterpret_cast<void *>(57)));
+
+    uint64_t outRef;
+    EXPECT_TRUE(lookup(&ht, extraKey, outRef));
+    EXPECT_EQ(extra.u64Address(), outRef);
+    for (uint32_t i = 0; i < count; i++) {
+        EXPECT_EQ(2U, objects[i].count);
+        Key key(objects[i].tableId,
+                objects[i].stringKeyPtr,
+                objects[i].stringKeyLength);
+        EXPECT_TRUE(lookup(&ht, key, outRef));
+    }
+
+    delete[] objects;
+}
+
+TEST_F(HashTableTest, resize_removeDuringResize) {
+    HashTable ht(2);
+    uint32_t count = 40;
+    TestObject* objects = new TestObject[count];
+    test_resize_fill(&ht, objects, count);
+
+    ht.prepareResize(4);
+    ht.startResize(test_resize_keyHash, reinterpret_cast<void *>(58));
+    ht.migrateBucket(0);
+
+    for (uint32_t i = 0; i < count; i += 2) {
+        Key key(objects[i].tableId,
+                objects[i].stringKeyPtr,
+                objects[i].stringKeyLength);
+        HashTable::Candidates candidates;
+        ht.lookup(key.getHash(), candidates);
+        while (!candidates.isDone()) {
+            if (candidates.getReference() == objects[i].u64Address()) {
+                candidates.remove();
+                break;
+            }
+            candidates.next();
+        }
+    }
+    EXPECT_EQ(count / 2, ht.getNumEntries());
+
+    ht.migrateBucket(1);
+    EXPECT_TRUE(ht.finishResize());
+    EXPECT_EQ(count / 2, ht.forEach(test_forEach_callback,
+        reinterpret_cast<void *>(57)));
+    for (uint32_t i = 0; i < count; i++)
+        EXPECT_EQ(i % 2, objects[i].count);
+
+    delete[] objects;
+}
+
+TEST_F(HashTableTest, destructor_duringResize) {
+    HashTable* ht = new HashTable(2);
+    uint32_t count = 40;
+    TestObject* objects = new TestObject[count];
+    test_resize_fill(ht, objects, count);
+    EXPECT_LT(0U, ht->getNumOverflowLines());
+
+    // Bucket 0's overflow lines are retired but still chained from the old
+    // bucket; they must only be freed once.
+    ht->prepareResize(4);
+    ht->startResize(test_resize_keyHash, reinterpret_cast<void *>(58));
+    ht->migrateBucket(0);
+    EXPECT_LT(0U, ht->retiredLines.size());
+    EXPECT_TRUE(ht->isResizing());
+    delete ht;
+
+    delete[] objects;
+}
+
+TEST_F(HashTableTest, insert_longestChain) {
+    HashTable ht(1);
+    EXPECT_EQ(1U, ht.getLongestChain());
+    for (uint64_t i = 1; i <= HashTable::ENTRIES_PER_CACHE_LINE * 2; i++)
+        ht.insert(0, i << 6);
+    EXPECT_EQ(3U, ht.getLongestChain());
+    EXPECT_EQ(2U, ht.getNumOverflowLines());
+}
+
 } // namespace RAMCloud
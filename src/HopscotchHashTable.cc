@@ -0,0 +1,453 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "Common.h"
+#include "BitOps.h"
+#include "Fence.h"
+#include "HopscotchHashTable.h"
+
+namespace RAMCloud {
+
+static_assert((1U << (16 - HopscotchHashTable::TAG_BITS)) >=
+              HopscotchHashTable::NEIGHBORHOOD,
+              "HopscotchHashTable neighbor offsets don't fit in an entry");
+
+/// Mask selecting the tag bits of a stored secondary hash.
+static const uint64_t TAG_MASK = (1UL << HopscotchHashTable::TAG_BITS) - 1;
+
+/// Mask selecting the slots of a line that may hold references.
+static const uint32_t SLOT_MASK = (1U << HopscotchHashTable::NUM_SLOTS) - 1;
+
+/**
+ * Construct a HopscotchHashTable.
+ *
+ * \param numBuckets
+ *      See HashTable::HashTable().
+ * \param memoryPolicy
+ *      See HashTable::HashTable().
+ * \throw Exception
+ *      An exception is thrown if numBuckets is 0.
+ */
+HopscotchHashTable::HopscotchHashTable(uint64_t numBuckets,
+                                       const MemoryPolicy& memoryPolicy)
+    : HashTable(numBuckets, memoryPolicy)
+    , neighborhood()
+    , searchDistance()
+    , numHops(0)
+{
+    uint64_t distinctLines = std::max(1UL,
+            this->numBuckets / NEIGHBOR_STRIDE);
+    neighborhood = downCast<uint32_t>(std::min(
+            static_cast<uint64_t>(NEIGHBORHOOD), distinctLines));
+    searchDistance = downCast<uint32_t>(std::min(
+            static_cast<uint64_t>(MAX_SEARCH_DISTANCE), distinctLines));
+}
+
+// See HashTable::getType().
+const char*
+HopscotchHashTable::getType() const
+{
+    return "hopscotch";
+}
+
+/**
+ * Find possible references to an element in the hash table given a key.
+ * See HashTable::lookup(); the neighborhood lines named by the home
+ * bucket's hop mask are searched first, followed by its overflow lines.
+ */
+void
+HopscotchHashTable::lookup(KeyHash keyHash, Candidates& candidates)
+{
+    uint64_t secondaryHash;
+    uint64_t home = findBucketIndex(numBuckets, keyHash, &secondaryHash);
+
+    candidates.table = this;
+    candidates.homeBucket = home;
+    candidates.pendingLines = getHopMask(&buckets.get()[home]);
+    candidates.inOverflow = false;
+    candidates.secondaryHash = secondaryHash & TAG_MASK;
+    candidates.bucket = &buckets.get()[home];
+    candidates.index = -1;
+    candidates.matches = 0;
+    candidates.next();
+}
+
+/**
+ * Insert an element corresponding to a given key into the hash table.
+ * See HashTable::insert().
+ *
+ * The reference goes in the nearest free slot of its home bucket's
+ * neighborhood. If the neighborhood is full, a free slot further away is
+ * moved towards it by hopping other references within their own
+ * neighborhoods; failing that, the reference goes in an overflow line.
+ */
+void
+HopscotchHashTable::insert(KeyHash keyHash, uint64_t reference)
+{
+    uint64_t secondaryHash;
+    uint64_t home = findBucketIndex(numBuckets, keyHash, &secondaryHash);
+    uint64_t tag = secondaryHash & TAG_MASK;
+
+    uint32_t distance = 0;
+    uint32_t slot = NUM_SLOTS;
+    for (distance = 0; distance < searchDistance; distance++) {
+        slot = findFreeSlot(line(home, distance));
+        if (slot < NUM_SLOTS)
+            break;
+    }
+
+    if (slot < NUM_SLOTS && hopTowards(home, &distance, &slot)) {
+        line(home, distance)->entries[slot].setReference(
+                storedHash(tag, distance), reference);
+        addToHopMask(home, distance);
+    } else {
+        insertIntoOverflow(home, tag, reference);
+    }
+    numEntries++;
+}
+
+/**
+ * Apply the given callback function to each element whose key hashes to
+ * the given bucket. See HashTable::forEachInBucket().
+ */
+uint64_t
+HopscotchHashTable::forEachInBucket(void (*callback)(uint64_t, void *),
+                                    void *cookie,
+                                    uint64_t bucket)
+{
+    uint64_t numCalls = 0;
+    CacheLine* home = &buckets.get()[bucket];
+
+    // The callback may remove entries and so change the hop mask; take a
+    // copy first.
+    uint32_t hopMask = getHopMask(home);
+    while (hopMask != 0) {
+        uint32_t offset = BitOps::findFirstSet(hopMask) - 1;
+        hopMask &= hopMask - 1;
+        CacheLine* cl = line(bucket, offset);
+        for (uint32_t i = 0; i < NUM_SLOTS; i++) {
+            Entry* e = &cl->entries[i];
+            if (e->isAvailable() || (e->value >> 48) >> TAG_BITS != offset)
+                continue;
+            callback(e->getReference(), cookie);
+            numCalls++;
+        }
+    }
+
+    CacheLine* overflow = getOverflow(home);
+    if (overflow != NULL)
+        numCalls += forEachInCacheLines(callback, cookie, overflow, ~0UL);
+    return numCalls;
+}
+
+// See HashTable::supportsResize().
+bool
+HopscotchHashTable::supportsResize() const
+{
+    return false;
+}
+
+/**
+ * Return the number of times a reference has been moved to another line of
+ * its neighborhood to make room for an insert.
+ */
+uint64_t
+HopscotchHashTable::getNumHops() const
+{
+    return numHops;
+}
+
+/**
+ * Advance Candidates to the next line of the home bucket's neighborhood
+ * that holds its references, then on to its overflow lines.
+ * See HashTable::nextCacheLine().
+ */
+void
+HopscotchHashTable::nextCacheLine(Candidates& candidates)
+{
+    if (candidates.inOverflow) {
+        HashTable::nextCacheLine(candidates);
+        return;
+    }
+
+    uint64_t tag = candidates.secondaryHash & TAG_MASK;
+    if (candidates.pendingLines != 0) {
+        uint32_t offset = BitOps::findFirstSet(candidates.pendingLines) - 1;
+        candidates.pendingLines &= candidates.pendingLines - 1;
+        candidates.bucket = line(candidates.homeBucket, offset);
+        candidates.secondaryHash = storedHash(tag, offset);
+        candidates.matches = match(candidates.bucket,
+                                   candidates.secondaryHash) & SLOT_MASK;
+        return;
+    }
+
+    // Overflow entries are stored with an offset of 0.
+    candidates.inOverflow = true;
+    candidates.secondaryHash = tag;
+    candidates.bucket = getOverflow(&buckets.get()[candidates.homeBucket]);
+    if (candidates.bucket != NULL)
+        candidates.matches = match(candidates.bucket, tag);
+}
+
+/**
+ * Remove the entry Candidates currently points at, clearing the home
+ * bucket's hop bit for the line if it was the last of the bucket's
+ * references there. See HashTable::removeCandidate().
+ */
+void
+HopscotchHashTable::removeCandidate(Candidates& candidates)
+{
+    candidates.bucket->entries[candidates.index].clear();
+    numEntries--;
+    if (!candidates.inOverflow) {
+        uint32_t offset = downCast<uint32_t>(
+                candidates.secondaryHash >> TAG_BITS);
+        if (!holdsOffset(candidates.bucket, offset))
+            removeFromHopMask(candidates.homeBucket, offset);
+    }
+}
+
+/**
+ * Return the index of the given line of a bucket's neighborhood.
+ *
+ * \param bucket
+ *      Index of the home bucket.
+ * \param offset
+ *      Which line of the neighborhood; 0 is the home bucket itself.
+ */
+uint64_t
+HopscotchHashTable::lineIndex(uint64_t bucket, uint32_t offset) const
+{
+    return (bucket + offset * NEIGHBOR_STRIDE) & (numBuckets - 1);
+}
+
+/**
+ * Return the given line of a bucket's neighborhood; see #lineIndex().
+ */
+HashTable::CacheLine*
+HopscotchHashTable::line(uint64_t bucket, uint32_t offset)
+{
+    return &buckets.get()[lineIndex(bucket, offset)];
+}
+
+/**
+ * Return the secondary hash stored in an entry, which combines the key's
+ * tag with the entry's offset from its home bucket.
+ */
+uint64_t
+HopscotchHashTable::storedHash(uint64_t tag, uint32_t offset)
+{
+    return (static_cast<uint64_t>(offset) << TAG_BITS) | tag;
+}
+
+/**
+ * Return the index of the first free reference slot in a line, or NUM_SLOTS
+ * if there is none.
+ */
+uint32_t
+HopscotchHashTable::findFreeSlot(const CacheLine* cl)
+{
+    for (uint32_t i = 0; i < NUM_SLOTS; i++) {
+        if (cl->entries[i].isAvailable())
+            return i;
+    }
+    return NUM_SLOTS;
+}
+
+/**
+ * Return true if a line holds any reference stored with the given offset.
+ * Since references in one line with the same offset all have the same home
+ * bucket, this tells whether that bucket's hop bit must remain set.
+ */
+bool
+HopscotchHashTable::holdsOffset(const CacheLine* cl, uint32_t offset)
+{
+    for (uint32_t i = 0; i < NUM_SLOTS; i++) {
+        const Entry* e = &cl->entries[i];
+        if (!e->isAvailable() && (e->value >> 48) >> TAG_BITS == offset)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Return the hop mask from a line's metadata entry.
+ */
+uint32_t
+HopscotchHashTable::getHopMask(const CacheLine* cl)
+{
+    const volatile uint64_t* value =
+            &cl->entries[ENTRIES_PER_CACHE_LINE - 1].value;
+    return downCast<uint32_t>(*value >> 48);
+}
+
+/**
+ * Return the first overflow line chained off of a line's metadata entry,
+ * or NULL if there is none.
+ */
+HashTable::CacheLine*
+HopscotchHashTable::getOverflow(const CacheLine* cl)
+{
+    const volatile uint64_t* value =
+            &cl->entries[ENTRIES_PER_CACHE_LINE - 1].value;
+    uint64_t v = *value;
+    if (((v >> 47) & 1) == 0)
+        return NULL;
+    return reinterpret_cast<CacheLine*>(v & 0x00007fffffffffffUL);
+}
+
+/**
+ * Replace a line's metadata entry. The entry is written with a single store
+ * so that unlocked readers see either the old or the new value. It uses the
+ * layout of a chain pointer, so HashTable::freeChain() releases the
+ * overflow lines when the table is destroyed.
+ *
+ * \param cl
+ *      Line whose metadata is to be replaced.
+ * \param hopMask
+ *      New hop mask.
+ * \param overflow
+ *      First overflow line, or NULL.
+ */
+void
+HopscotchHashTable::setMetadata(CacheLine* cl, uint32_t hopMask,
+                                CacheLine* overflow)
+{
+    uint64_t value = static_cast<uint64_t>(hopMask) << 48;
+    if (overflow != NULL)
+        value |= (1UL << 47) | reinterpret_cast<uint64_t>(overflow);
+    cl->entries[ENTRIES_PER_CACHE_LINE - 1].value = value;
+}
+
+/**
+ * Set bit \a offset of a bucket's hop mask.
+ */
+void
+HopscotchHashTable::addToHopMask(uint64_t bucket, uint32_t offset)
+{
+    CacheLine* cl = &buckets.get()[bucket];
+    setMetadata(cl, getHopMask(cl) | (1U << offset), getOverflow(cl));
+}
+
+/**
+ * Clear bit \a offset of a bucket's hop mask.
+ */
+void
+HopscotchHashTable::removeFromHopMask(uint64_t bucket, uint32_t offset)
+{
+    CacheLine* cl = &buckets.get()[bucket];
+    setMetadata(cl, getHopMask(cl) & ~(1U << offset), getOverflow(cl));
+}
+
+/**
+ * Move a free slot into a bucket's neighborhood by repeatedly moving a
+ * reference from a line closer to the home bucket into the free slot, as
+ * long as the reference stays within its own neighborhood.
+ *
+ * Each reference is written to its new slot before its old slot is
+ * cleared, so a reader holding no lock may see it twice but never miss it;
+ * those readers validate their results against the bucket lock's version
+ * anyway.
+ *
+ * \param home
+ *      Index of the bucket a reference is being inserted into.
+ * \param[in,out] distance
+ *      Line (relative to \a home) of the free slot. On success, this is
+ *      less than #neighborhood.
+ * \param[in,out] slot
+ *      Index of the free slot within its line.
+ * \return
+ *      True if the free slot was moved into the neighborhood; false if no
+ *      reference could be moved.
+ */
+bool
+HopscotchHashTable::hopTowards(uint64_t home, uint32_t* distance,
+                               uint32_t* slot)
+{
+    while (*distance >= neighborhood) {
+        bool moved = false;
+        CacheLine* freeLine = line(home, *distance);
+
+        // Prefer the line furthest from home, so that the free slot gets as
+        // close as possible in each step.
+        for (uint32_t d = *distance - (neighborhood - 1);
+                d < *distance && !moved; d++) {
+            CacheLine* cl = line(home, d);
+            for (uint32_t i = 0; i < NUM_SLOTS; i++) {
+                Entry* e = &cl->entries[i];
+                if (e->isAvailable())
+                    continue;
+                uint64_t hash = e->value >> 48;
+                uint32_t offset = downCast<uint32_t>(hash >> TAG_BITS);
+                uint32_t newOffset = offset + (*distance - d);
+                if (newOffset >= neighborhood)
+                    continue;
+
+                uint64_t entryHome = (lineIndex(home, d) -
+                        offset * NEIGHBOR_STRIDE) & (numBuckets - 1);
+                freeLine->entries[*slot].setReference(
+                        storedHash(hash & TAG_MASK, newOffset),
+                        e->getReference());
+                addToHopMask(entryHome, newOffset);
+                e->clear();
+                if (!holdsOffset(cl, offset))
+                    removeFromHopMask(entryHome, offset);
+                numHops++;
+
+                *distance = d;
+                *slot = i;
+                moved = true;
+                break;
+            }
+        }
+        if (!moved)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Store a reference in the overflow lines of its home bucket, allocating
+ * the first one if necessary.
+ *
+ * \param home
+ *      Index of the reference's home bucket.
+ * \param tag
+ *      Tag bits of the key's secondary hash.
+ * \param reference
+ *      Reference to store.
+ */
+void
+HopscotchHashTable::insertIntoOverflow(uint64_t home, uint64_t tag,
+                                       uint64_t reference)
+{
+    CacheLine* homeLine = &buckets.get()[home];
+    CacheLine* overflow = getOverflow(homeLine);
+    if (overflow == NULL) {
+        RAMCLOUD_CLOG(NOTICE, "Allocating overflow bucket for index %lu",
+                      home);
+        void *buf = Memory::xmemalign(HERE, sizeof(CacheLine),
+                                      sizeof(CacheLine));
+        overflow = static_cast<CacheLine *>(buf);
+        for (size_t i = 0; i < ENTRIES_PER_CACHE_LINE; i++)
+            overflow->entries[i].clear();
+        Fence::sfence();
+        setMetadata(homeLine, getHopMask(homeLine), overflow);
+        numOverflowLines++;
+    }
+    insertIntoBucket(overflow, storedHash(tag, 0), reference, home);
+}
+
+} // namespace RAMCloud
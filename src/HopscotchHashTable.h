@@ -0,0 +1,140 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef RAMCLOUD_HOPSCOTCHHASHTABLE_H
+#define RAMCLOUD_HOPSCOTCHHASHTABLE_H
+
+#include "HashTable.h"
+
+namespace RAMCloud {
+
+/**
+ * A HashTable engine based on bucketized hopscotch hashing. Unlike the
+ * chained HashTable, which allocates an overflow cache line whenever a
+ * bucket's first line fills up, this engine places a reference in one of a
+ * small, fixed neighborhood of cache lines in the bucket array itself,
+ * moving ("hopping") other references around within their own neighborhoods
+ * to make room if necessary. This keeps tables usable at much higher load
+ * factors without overflow lines, and bounds the number of cache lines a
+ * lookup must examine.
+ *
+ * \section layout Layout
+ *
+ * Each cache line in the bucket array has NUM_SLOTS entries for references
+ * and one metadata entry, which holds a "hop" bit mask and a pointer to the
+ * bucket's overflow lines (see below). Bit k of bucket b's hop mask is set
+ * if the k'th line of b's neighborhood holds at least one reference whose
+ * key hashes to b. The k'th line of the neighborhood is bucket
+ * (b + k * NEIGHBOR_STRIDE) mod numBuckets.
+ *
+ * Neighbors are NEIGHBOR_STRIDE buckets apart, rather than adjacent, so that
+ * a bucket, all of its neighbors, and the home buckets of any references
+ * that hop between them have the same bucket index modulo NEIGHBOR_STRIDE.
+ * ObjectManager stripes its bucket locks by bucket index modulo a divisor
+ * of NEIGHBOR_STRIDE, so holding the lock for a key's bucket covers every
+ * line an insert can touch.
+ *
+ * Since a line may hold references for several home buckets, each entry
+ * records which neighbor it is of its home bucket in the top bits of the
+ * secondary hash it stores (so only the remaining TAG_BITS bits of the key's
+ * secondary hash are kept). This lets the SIMD probe in HashTable::match
+ * check both at once, and lets #forEachInBucket() pick out exactly the
+ * references of one bucket, as Enumeration requires.
+ *
+ * If no slot can be freed within the neighborhood (which is rare below 90%
+ * load), the reference goes in overflow cache lines chained off of the home
+ * bucket's metadata entry, exactly like the chained HashTable's.
+ *
+ * Tables with no more than NEIGHBOR_STRIDE buckets have neighborhoods of a
+ * single line, so this engine is only worthwhile for large tables.
+ *
+ * This engine does not support incremental resizing.
+ */
+class HopscotchHashTable : public HashTable {
+  public:
+    /**
+     * Number of cache lines in each bucket's neighborhood. This must fit in
+     * the offset bits of an entry's secondary hash (see TAG_BITS).
+     */
+    static const uint32_t NEIGHBORHOOD = 8;
+
+    /**
+     * Distance, in buckets, between consecutive lines of a neighborhood.
+     */
+    static const uint64_t NEIGHBOR_STRIDE = 1024;
+
+    /**
+     * When looking for a free slot to hop towards a full neighborhood,
+     * examine at most this many lines starting at the home bucket.
+     */
+    static const uint32_t MAX_SEARCH_DISTANCE = 64;
+
+    /**
+     * Number of slots for references in each cache line of the bucket array.
+     * The last entry is used for metadata.
+     */
+    static const uint32_t NUM_SLOTS = ENTRIES_PER_CACHE_LINE - 1;
+
+    /**
+     * Number of bits of each key's secondary hash stored in its entry; the
+     * rest hold the entry's neighbor offset.
+     */
+    static const uint32_t TAG_BITS = 13;
+
+    explicit HopscotchHashTable(uint64_t numBuckets,
+            const MemoryPolicy& memoryPolicy = MemoryPolicy());
+    const char* getType() const;
+    void lookup(KeyHash keyHash, Candidates& candidates);
+    void insert(KeyHash keyHash, uint64_t reference);
+    uint64_t forEachInBucket(void (*callback)(uint64_t, void *),
+                             void *cookie,
+                             uint64_t bucket);
+    bool supportsResize() const;
+    uint64_t getNumHops() const;
+
+  PRIVATE:
+    void nextCacheLine(Candidates& candidates);
+    void removeCandidate(Candidates& candidates);
+
+    uint64_t lineIndex(uint64_t bucket, uint32_t offset) const;
+    CacheLine* line(uint64_t bucket, uint32_t offset);
+    static uint64_t storedHash(uint64_t tag, uint32_t offset);
+    static uint32_t findFreeSlot(const CacheLine* cl);
+    static bool holdsOffset(const CacheLine* cl, uint32_t offset);
+    static uint32_t getHopMask(const CacheLine* cl);
+    static CacheLine* getOverflow(const CacheLine* cl);
+    static void setMetadata(CacheLine* cl, uint32_t hopMask,
+                            CacheLine* overflow);
+    void addToHopMask(uint64_t bucket, uint32_t offset);
+    void removeFromHopMask(uint64_t bucket, uint32_t offset);
+    bool hopTowards(uint64_t home, uint32_t* distance, uint32_t* slot);
+    void insertIntoOverflow(uint64_t home, uint64_t tag, uint64_t reference);
+
+    /// Number of distinct lines in each neighborhood: NEIGHBORHOOD, unless
+    /// the table is too small to provide that many.
+    uint32_t neighborhood;
+
+    /// How far (in lines) #insert() may search for a free slot.
+    uint32_t searchDistance;
+
+    /// Total number of references moved to make room for an insert.
+    std::atomic<uint64_t> numHops;
+
+    DISALLOW_COPY_AND_ASSIGN(HopscotchHashTable);
+};
+
+} // namespace RAMCloud
+
+#endif // RAMCLOUD_HOPSCOTCHHASHTABLE_H
@@ -0,0 +1,191 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "TestUtil.h"
+
+#include "HopscotchHashTable.h"
+
+namespace RAMCloud {
+
+static const uint64_t STRIDE = HopscotchHashTable::NEIGHBOR_STRIDE;
+static const uint32_t SLOTS = HopscotchHashTable::NUM_SLOTS;
+
+class HopscotchHashTableTest : public ::testing::Test {
+  public:
+    HopscotchHashTableTest() {}
+
+    /// Build a key hash that maps to the given bucket and secondary hash.
+    static KeyHash
+    keyHash(uint64_t bucket, uint64_t tag)
+    {
+        return (tag << 48) | bucket;
+    }
+
+    /// Return the first reference found for a key hash, or 0.
+    static uint64_t
+    find(HashTable& ht, KeyHash hash)
+    {
+        HashTable::Candidates candidates;
+        ht.lookup(hash, candidates);
+        if (candidates.isDone())
+            return 0;
+        return candidates.getReference();
+    }
+
+    /// Fill the first line of a bucket with references homed there.
+    static void
+    fillBucket(HashTable& ht, uint64_t bucket, uint64_t* tag)
+    {
+        for (uint32_t i = 0; i < SLOTS; i++) {
+            ht.insert(keyHash(bucket, *tag), 1000 + *tag);
+            (*tag)++;
+        }
+    }
+
+    static void
+    countCallback(uint64_t reference, void* cookie)
+    {
+        (*reinterpret_cast<uint64_t*>(cookie))++;
+    }
+
+    DISALLOW_COPY_AND_ASSIGN(HopscotchHashTableTest);
+};
+
+TEST_F(HopscotchHashTableTest, constructor) {
+    HopscotchHashTable small(16);
+    EXPECT_EQ(1U, small.neighborhood);
+    EXPECT_EQ(1U, small.searchDistance);
+
+    HopscotchHashTable medium(16 * STRIDE);
+    EXPECT_EQ(8U, medium.neighborhood);
+    EXPECT_EQ(16U, medium.searchDistance);
+
+    HopscotchHashTable large(128 * STRIDE);
+    EXPECT_EQ(8U, large.neighborhood);
+    EXPECT_EQ(64U, large.searchDistance);
+}
+
+TEST_F(HopscotchHashTableTest, create) {
+    std::unique_ptr<HashTable> ht(HashTable::create("hopscotch", 1024));
+    EXPECT_STREQ("hopscotch", ht->getType());
+    EXPECT_FALSE(ht->supportsResize());
+    EXPECT_THROW(ht->prepareResize(2048), Exception);
+    EXPECT_THROW(HashTable::create("cuckoo", 1024), Exception);
+}
+
+TEST_F(HopscotchHashTableTest, insert_neighborhood) {
+    HopscotchHashTable ht(16 * STRIDE);
+    uint64_t tag = 1;
+    fillBucket(ht, 0, &tag);
+    EXPECT_EQ(1U, ht.getHopMask(ht.line(0, 0)));
+
+    // The home line is full, so the next reference goes one line over.
+    ht.insert(keyHash(0, tag), 1000 + tag);
+    EXPECT_EQ(3U, ht.getHopMask(ht.line(0, 0)));
+    EXPECT_EQ(0U, ht.getHopMask(ht.line(0, 1)));
+    EXPECT_EQ(0U, ht.getNumOverflowLines());
+    EXPECT_EQ(SLOTS + 1, ht.getNumEntries());
+
+    for (uint64_t t = 1; t <= tag; t++)
+        EXPECT_EQ(1000 + t, find(ht, keyHash(0, t)));
+    EXPECT_EQ(0U, find(ht, keyHash(0, tag + 1)));
+}
+
+TEST_F(HopscotchHashTableTest, insert_hop) {
+    HopscotchHashTable ht(16 * STRIDE);
+    uint64_t tag = 1;
+
+    // Fill lines 0 through 8 of bucket 0's neighborhood, each with
+    // references homed at that line, so the nearest free slot is 9 lines
+    // away: outside the neighborhood.
+    for (uint64_t k = 0; k <= 8; k++)
+        fillBucket(ht, k * STRIDE, &tag);
+    ht.insert(keyHash(0, tag), 1000 + tag);
+
+    // A reference from line 2 moved to line 9 (offset 7 from its home),
+    // making room on line 2.
+    EXPECT_EQ(1U, ht.getNumHops());
+    EXPECT_EQ(0U, ht.getNumOverflowLines());
+    EXPECT_EQ(5U, ht.getHopMask(ht.line(0, 0)));
+    EXPECT_EQ(0x81U, ht.getHopMask(ht.line(2 * STRIDE, 0)));
+
+    for (uint64_t t = 1; t < tag; t++)
+        EXPECT_EQ(1000 + t, find(ht, keyHash(((t - 1) / SLOTS) * STRIDE, t)))
+            << "tag " << t;
+    EXPECT_EQ(1000 + tag, find(ht, keyHash(0, tag)));
+
+    uint64_t count = 0;
+    EXPECT_EQ(SLOTS + 1, ht.forEachInBucket(countCallback, &count, 0));
+    EXPECT_EQ(SLOTS, ht.forEachInBucket(countCallback, &count, 2 * STRIDE));
+    EXPECT_EQ(2 * SLOTS + 1, count);
+}
+
+TEST_F(HopscotchHashTableTest, insert_overflow) {
+    HopscotchHashTable ht(16);
+    uint64_t tag = 1;
+    fillBucket(ht, 3, &tag);
+    ht.insert(keyHash(3, tag), 1000 + tag);
+    ht.insert(keyHash(3, tag + 1), 1001 + tag);
+
+    EXPECT_EQ(1U, ht.getNumOverflowLines());
+    EXPECT_TRUE(ht.getOverflow(ht.line(3, 0)) != NULL);
+    for (uint64_t t = 1; t <= tag + 1; t++)
+        EXPECT_EQ(1000 + t, find(ht, keyHash(3, t)));
+
+    uint64_t count = 0;
+    EXPECT_EQ(SLOTS + 2, ht.forEachInBucket(countCallback, &count, 3));
+    EXPECT_EQ(0U, ht.forEachInBucket(countCallback, &count, 4));
+
+    HashTable::Candidates candidates;
+    ht.lookup(keyHash(3, tag), candidates);
+    candidates.remove();
+    EXPECT_EQ(0U, find(ht, keyHash(3, tag)));
+    EXPECT_EQ(1001 + tag, find(ht, keyHash(3, tag + 1)));
+    EXPECT_EQ(SLOTS + 1, ht.getNumEntries());
+}
+
+TEST_F(HopscotchHashTableTest, remove_clearsHopBit) {
+    HopscotchHashTable ht(16 * STRIDE);
+    uint64_t tag = 1;
+    fillBucket(ht, 5, &tag);
+    ht.insert(keyHash(5, tag), 1000 + tag);
+    ht.insert(keyHash(5, tag + 1), 1001 + tag);
+    EXPECT_EQ(3U, ht.getHopMask(ht.line(5, 0)));
+
+    HashTable::Candidates candidates;
+    ht.lookup(keyHash(5, tag), candidates);
+    candidates.remove();
+    EXPECT_EQ(3U, ht.getHopMask(ht.line(5, 0)));
+    ht.lookup(keyHash(5, tag + 1), candidates);
+    candidates.remove();
+    EXPECT_EQ(1U, ht.getHopMask(ht.line(5, 0)));
+    EXPECT_EQ(SLOTS, ht.getNumEntries());
+}
+
+TEST_F(HopscotchHashTableTest, setReference) {
+    HopscotchHashTable ht(16 * STRIDE);
+    uint64_t tag = 1;
+    fillBucket(ht, 0, &tag);
+    ht.insert(keyHash(0, tag), 1000 + tag);
+
+    HashTable::Candidates candidates;
+    ht.lookup(keyHash(0, tag), candidates);
+    candidates.setReference(42);
+    EXPECT_EQ(42U, find(ht, keyHash(0, tag)));
+    uint64_t count = 0;
+    EXPECT_EQ(SLOTS + 1, ht.forEachInBucket(countCallback, &count, 0));
+}
+
+}  // namespace RAMCloud
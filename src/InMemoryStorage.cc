@@ -167,13 +167,14 @@ InMemoryStorage::Frame::append(Buffer& source,
         throw BackupBadSegmentIdException(HERE);
     }
     // Three conditions because overflow is possible on addition.
-    if (length > storage->segmentSize ||
-        destinationOffset > storage->segmentSize ||
-        length + destinationOffset > storage->segmentSize)
+    const size_t frameSize = storage->bytesInFrame(frameIndex);
+    if (length > frameSize ||
+        destinationOffset > frameSize ||
+        length + destinationOffset > frameSize)
     {
         LOG(ERROR, "Out-of-bounds appended attempted on storage frame: "
-            "offset %lu, length %lu, segmentSize %lu ",
-            destinationOffset, length, storage->segmentSize);
+            "offset %lu, length %lu, frame size %lu ",
+            destinationOffset, length, frameSize);
         throw BackupSegmentOverflowException(HERE);
     }
     if (metadataLength > METADATA_SIZE) {
@@ -255,8 +256,9 @@ InMemoryStorage::Frame::open()
     Lock _(storage->mutex);
     if (isOpen || isClosed)
         return;
-    buffer.reset(new char[storage->segmentSize]);
-    memset(buffer.get(), '\0', storage->segmentSize); // Quiet valgrind.
+    const size_t frameSize = storage->bytesInFrame(frameIndex);
+    buffer.reset(new char[frameSize]);
+    memset(buffer.get(), '\0', frameSize); // Quiet valgrind.
     isOpen = true;
     isClosed = false;
     memset(metadata.get(), '\0', METADATA_SIZE);
@@ -276,18 +278,29 @@ InMemoryStorage::Frame::open()
  *      When specified, writes to this storage instance should be
  *      limited to at most the given rate (in megabytes per second).
  *      The special value 0 turns off throttling.
+ * \param fragmentFrameCount
+ *      Number of extra frames to set aside for fragments of erasure-coded
+ *      segments, in addition to the \a frameCount segment frames. See
+ *      openFragment().
+ * \param fragmentFrameSize
+ *      Bytes each fragment frame can hold; no more than \a segmentSize.
  */
 InMemoryStorage::InMemoryStorage(size_t segmentSize,
                                  size_t frameCount,
-                                 size_t writeRateLimit)
+                                 size_t writeRateLimit,
+                                 size_t fragmentFrameCount,
+                                 size_t fragmentFrameSize)
     : BackupStorage(segmentSize, Type::MEMORY, writeRateLimit)
     , mutex()
     , frames()
     , frameCount(frameCount)
-    , freeMap(frameCount)
+    , fragmentFrameCount(fragmentFrameCount)
+    , fragmentFrameSize(fragmentFrameCount == 0 ? 0 :
+                        std::min(fragmentFrameSize, segmentSize))
+    , freeMap(frameCount + fragmentFrameCount)
     , lastAllocatedFrame(FreeMap::npos)
 {
-    for (size_t frame = 0; frame < frameCount; ++frame)
+    for (size_t frame = 0; frame < frameCount + fragmentFrameCount; ++frame)
         frames.emplace_back(this, frame);
     freeMap.set();
 }
@@ -325,22 +338,40 @@ BackupStorage::FrameRef
 InMemoryStorage::open(bool sync, ServerId masterId, uint64_t segmentId)
 {
     Lock lock(mutex);
+    // Fragment frames follow the segment frames; don't hand those out.
     FreeMap::size_type next = freeMap.find_next(lastAllocatedFrame);
-    if (next == FreeMap::npos) {
+    if (next >= frameCount) {
         next = freeMap.find_first();
-        if (next == FreeMap::npos) {
+        if (next >= frameCount) {
             RAMCLOUD_CLOG(NOTICE, "Rejecting open: no free storage frames");
             throw BackupOpenRejectedException(HERE);
         }
     }
     lastAllocatedFrame = next;
-    size_t frameIndex = next;
-    assert(freeMap[frameIndex] == 1);
-    freeMap[frameIndex] = 0;
-    Frame* frame = &frames[frameIndex];
-    lock.unlock();
-    frame->open();
-    return {frame, BackupStorage::freeFrame};
+    return openFrame(lock, next);
+}
+
+/**
+ * Allocate one of the fragment frames (see #fragmentFrameCount) to hold a
+ * fragment of an erasure-coded segment. Falls back to open() if the fragment
+ * might not fit in a fragment frame or they are all in use. See
+ * BackupStorage::openFragment() for details.
+ */
+BackupStorage::FrameRef
+InMemoryStorage::openFragment(bool sync, ServerId masterId,
+                              uint64_t segmentId, size_t length)
+{
+    Lock lock(mutex);
+    FreeMap::size_type next = FreeMap::npos;
+    if (length <= fragmentFrameSize) {
+        next = frameCount == 0 ? freeMap.find_first()
+                               : freeMap.find_next(frameCount - 1);
+    }
+    if (next == FreeMap::npos) {
+        lock.unlock();
+        return open(sync, masterId, segmentId);
+    }
+    return openFrame(lock, next);
 }
 
 /**
@@ -417,4 +448,38 @@ InMemoryStorage::fry()
 {
 }
 
+// - private -
+
+/**
+ * Open a free frame for a new replica; helper for open() and openFragment().
+ *
+ * \param lock
+ *      Lock on #mutex; released before the frame is opened.
+ * \param frameIndex
+ *      Free frame to allocate.
+ */
+BackupStorage::FrameRef
+InMemoryStorage::openFrame(Frame::Lock& lock, size_t frameIndex)
+{
+    assert(freeMap[frameIndex] == 1);
+    freeMap[frameIndex] = 0;
+    Frame* frame = &frames[frameIndex];
+    lock.unlock();
+    frame->open();
+    return {frame, BackupStorage::freeFrame};
+}
+
+/**
+ * Returns the number of bytes of replica data a frame can hold: #segmentSize
+ * for segment frames and #fragmentFrameSize for fragment frames.
+ *
+ * \param frameIndex
+ *      Frame to find the size of.
+ */
+size_t
+InMemoryStorage::bytesInFrame(size_t frameIndex) const
+{
+    return frameIndex < frameCount ? segmentSize : fragmentFrameSize;
+}
+
 } // namespace RAMCloud
@@ -136,9 +136,13 @@ class InMemoryStorage : public BackupStorage {
 
     InMemoryStorage(size_t segmentSize,
                     size_t frameCount,
-                    size_t writeRateLimit);
+                    size_t writeRateLimit,
+                    size_t fragmentFrameCount = 0,
+                    size_t fragmentFrameSize = 0);
 
     FrameRef open(bool sync, ServerId masterId, uint64_t segmentId);
+    FrameRef openFragment(bool sync, ServerId masterId, uint64_t segmentId,
+                          size_t length);
     size_t getMetadataSize();
     std::vector<FrameRef> loadAllMetadata();
     void resetSuperblock(ServerId serverId,
@@ -149,6 +153,9 @@ class InMemoryStorage : public BackupStorage {
     void fry();
 
   PRIVATE:
+    FrameRef openFrame(Frame::Lock& lock, size_t frameIndex);
+    size_t bytesInFrame(size_t frameIndex) const;
+
     /// Maximum size of metadata for each frame.
     enum { METADATA_SIZE = MultiFileStorage::METADATA_SIZE };
 
@@ -167,6 +174,16 @@ class InMemoryStorage : public BackupStorage {
     /// The number of replicas this storage can store simultaneously.
     const size_t frameCount;
 
+    /**
+     * Number of extra, smaller frames set aside for fragments of
+     * erasure-coded segments (see openFragment()). They follow the
+     * #frameCount segment frames in #frames.
+     */
+    const size_t fragmentFrameCount;
+
+    /// Bytes of replica data each fragment frame can hold.
+    const size_t fragmentFrameSize;
+
     /// Type of the freeMap.  A bitmap.
     typedef boost::dynamic_bitset<> FreeMap;
     /// Keeps a bit set for each frame in frames indicating if it is free.
@@ -64,4 +64,28 @@ TEST_F(InMemoryStorageTest, open) {
               static_cast<InMemoryStorage::Frame*>(frame.get())->frameIndex);
 }
 
+TEST_F(InMemoryStorageTest, openFragment) {
+    storage.construct(segmentSize, segmentFrames, 0, 1, segmentSize / 4);
+    BackupStorage::FrameRef fragment =
+        storage->openFragment(false, ServerId(), 0, segmentSize / 4);
+    EXPECT_EQ(4u, static_cast<Frame*>(fragment.get())->frameIndex);
+    fragment->append(testSource, 0, 5, 0, test, testLength + 1);
+    EXPECT_THROW(fragment->append(testSource, 0, 1, segmentSize / 4, NULL, 0),
+                 BackupSegmentOverflowException);
+    EXPECT_STREQ(test, bytes(fragment->load()));
+
+    // None left, so the next fragment gets a segment frame.
+    BackupStorage::FrameRef frame =
+        storage->openFragment(false, ServerId(), 0, segmentSize / 4);
+    EXPECT_EQ(0u, static_cast<Frame*>(frame.get())->frameIndex);
+
+    // Segment replicas never get fragment frames.
+    fragment.reset();
+    std::vector<BackupStorage::FrameRef> frames;
+    for (uint32_t f = 1; f < segmentFrames; ++f)
+        frames.push_back(storage->open(false, ServerId(), 0));
+    EXPECT_THROW(storage->open(false, ServerId(), 0),
+                 BackupOpenRejectedException);
+}
+
 } // namespace RAMCloud
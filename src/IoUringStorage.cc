@@ -0,0 +1,729 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "IoUringStorage.h"
+#include "CycleCounter.h"
+#include "Cycles.h"
+#include "RawMetrics.h"
+#include "ShortMacros.h"
+#include "PerfStats.h"
+
+// Must follow MultiFileStorage.h: it pulls in linux/fs.h, whose BLOCK_SIZE
+// macro would clobber MultiFileStorage::BLOCK_SIZE.
+#include <linux/io_uring.h>
+#undef BLOCK_SIZE
+
+namespace RAMCloud {
+
+namespace {
+/// Wrapper for the io_uring_setup system call, which glibc lacks.
+int
+ioUringSetup(uint32_t entries, struct io_uring_params* params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+/// Wrapper for the io_uring_enter system call, which glibc lacks.
+int
+ioUringEnter(int fd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit,
+                                    minComplete, flags, NULL, 0));
+}
+
+/// Wrapper for the io_uring_register system call, which glibc lacks.
+int
+ioUringRegister(int fd, uint32_t opcode, void* arg, uint32_t count)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg,
+                                    count));
+}
+
+/// Return the address \a offset bytes into \a base, as type T.
+template<typename T>
+T*
+at(void* base, uint32_t offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+} // anonymous namespace
+
+/**
+ * Create an IoUringStorage. Throws BackupStorageException if the kernel
+ * doesn't support io_uring; check isSupported() first to fall back to
+ * MultiFileStorage gracefully. The arguments are the same as for
+ * MultiFileStorage::MultiFileStorage().
+ */
+IoUringStorage::IoUringStorage(size_t segmentSize,
+                               size_t frameCount,
+                               size_t writeRateLimit,
+                               size_t maxNonVolatileBuffers,
+                               const char* filePaths,
+                               int openFlags,
+                               bool groupCommit,
+                               size_t fragmentFrameCount,
+                               size_t fragmentFrameSize)
+    : MultiFileStorage(segmentSize, frameCount, writeRateLimit,
+                       maxNonVolatileBuffers, filePaths, openFlags,
+                       groupCommit, fragmentFrameCount, fragmentFrameSize)
+    , ringMutex()
+    , ringChanged()
+    , inFlight(0)
+    , ringFd(-1)
+    , queueDepth(0)
+    , submissionRing(NULL)
+    , submissionRingLength(0)
+    , completionRing(NULL)
+    , completionRingLength(0)
+    , submissionEntries(NULL)
+    , sqHead(NULL)
+    , sqTail(NULL)
+    , sqMask(NULL)
+    , sqArray(NULL)
+    , cqHead(NULL)
+    , cqTail(NULL)
+    , cqMask(NULL)
+    , completionEntries(NULL)
+    , registeredBuffers()
+    , reaper()
+{
+    // The completion queue is twice as big as the submission queue, and
+    // submit() never has more than a submission queue's worth of operations
+    // in flight, so completions can't overflow.
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ringFd = ioUringSetup(QUEUE_DEPTH, &params);
+    if (ringFd < 0) {
+        int e = errno;
+        throw BackupStorageException(HERE, "Couldn't create io_uring", e);
+    }
+    queueDepth = params.sq_entries;
+
+    submissionRingLength = params.sq_off.array +
+                           params.sq_entries * sizeof(uint32_t);
+    completionRingLength = params.cq_off.cqes +
+                           params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        submissionRingLength = std::max(submissionRingLength,
+                                        completionRingLength);
+        completionRingLength = submissionRingLength;
+    }
+    submissionRing = mmap(NULL, submissionRingLength, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ringFd,
+                          IORING_OFF_SQ_RING);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        completionRing = submissionRing;
+    } else {
+        completionRing = mmap(NULL, completionRingLength,
+                              PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ringFd,
+                              IORING_OFF_CQ_RING);
+    }
+    void* entries = mmap(NULL, params.sq_entries * sizeof(io_uring_sqe),
+                         PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ringFd, IORING_OFF_SQES);
+    if (submissionRing == MAP_FAILED || completionRing == MAP_FAILED ||
+            entries == MAP_FAILED) {
+        DIE("Couldn't map io_uring queues: %s", strerror(errno));
+    }
+    submissionEntries = static_cast<struct io_uring_sqe*>(entries);
+
+    sqHead = at<uint32_t>(submissionRing, params.sq_off.head);
+    sqTail = at<uint32_t>(submissionRing, params.sq_off.tail);
+    sqMask = at<uint32_t>(submissionRing, params.sq_off.ring_mask);
+    sqArray = at<uint32_t>(submissionRing, params.sq_off.array);
+    cqHead = at<uint32_t>(completionRing, params.cq_off.head);
+    cqTail = at<uint32_t>(completionRing, params.cq_off.tail);
+    cqMask = at<uint32_t>(completionRing, params.cq_off.ring_mask);
+    completionEntries = at<struct io_uring_cqe>(completionRing,
+                                                params.cq_off.cqes);
+
+    registerBuffers();
+    reaper.construct(&IoUringStorage::reapCompletions, this);
+
+    LOG(NOTICE, "Backup storage using io_uring with %u entries and %lu "
+        "registered buffers", queueDepth, registeredBuffers.size());
+}
+
+/// Stop IO and release the ring.
+IoUringStorage::~IoUringStorage()
+{
+    // The ring goes away before MultiFileStorage's destructor stops the IO
+    // thread, so stop it here, then let the IO it started finish.
+    ioQueue.halt();
+
+    // An operation with no Operation tells the reaper to exit. It's only
+    // queued once nothing else is in flight, so it completes last.
+    {
+        std::unique_lock<std::mutex> lock(ringMutex);
+        while (inFlight > 0)
+            ringChanged.wait(lock);
+        uint32_t tail = *sqTail;
+        uint32_t index = tail & *sqMask;
+        struct io_uring_sqe* sqe = &submissionEntries[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = 0;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        inFlight++;
+        int r;
+        do {
+            r = ioUringEnter(ringFd, 1, 0, 0);
+        } while (r < 0 && (errno == EINTR || errno == EAGAIN ||
+                           errno == EBUSY));
+        if (r < 0) {
+            // Can't throw from here; leave the ring to the reaper rather
+            // than unmapping it out from under it.
+            LOG(ERROR, "couldn't stop io_uring reaper: %s", strerror(errno));
+            reaper->detach();
+            return;
+        }
+    }
+    reaper->join();
+
+    munmap(submissionEntries, queueDepth * sizeof(io_uring_sqe));
+    if (completionRing != submissionRing)
+        munmap(completionRing, completionRingLength);
+    munmap(submissionRing, submissionRingLength);
+
+    // Closing the ring also unregisters the buffers.
+    close(ringFd);
+}
+
+/**
+ * Return true if the running kernel supports io_uring, i.e. whether an
+ * IoUringStorage can be constructed.
+ */
+bool
+IoUringStorage::isSupported()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = ioUringSetup(1, &params);
+    if (fd < 0)
+        return false;
+    close(fd);
+    return true;
+}
+
+/**
+ * Construct an empty request.
+ *
+ * \param storage
+ *      Storage the request's operations are for (needed to construct
+ *      #buffer).
+ */
+IoUringStorage::Request::Request(IoUringStorage* storage)
+    : operations()
+    , outstanding(0)
+    , frame(NULL)
+    , replicaWrite()
+    , buffer(NULL, BufferDeleter(storage))
+    , startTicks(0)
+    , done(false)
+{
+}
+
+/**
+ * Same as MultiFileStorage::unlockedRead(), except the reads of all
+ * framelets are submitted to the ring together.
+ */
+void
+IoUringStorage::unlockedRead(Frame::Lock& lock, void* buf, size_t frameIndex,
+                             bool usingDevNull)
+{
+    lock.unlock();
+    CycleCounter<RawMetric> _(&metrics->backup.storageReadTicks);
+
+    Request request(this);
+    addReads(&request, buf, frameIndex);
+    performIo(&request);
+    checkReads(&request);
+
+    PerfStats::threadStats.backupReadActiveCycles += _.stop();
+    lock.lock();
+}
+
+/**
+ * Same as MultiFileStorage::unlockedWrite(), except the framelet writes and
+ * the metadata writes of all of the replicas are submitted to the ring
+ * together.
+ */
+void
+IoUringStorage::unlockedWrite(Frame::Lock& lock, ReplicaWrite* writes,
+                              size_t count)
+{
+    uint64_t start = Cycles::rdtsc();
+    lock.unlock();
+
+    Request request(this);
+    std::vector<bool> written(fds.size());
+    size_t totalBytes = addWrites(&request, writes, count, &written);
+    performIo(&request);
+    checkWrites(&request);
+
+    if (flushAfterWrites)
+        flushFiles(written);
+
+    double elapsedSeconds = Cycles::toSeconds(Cycles::rdtsc() - start);
+    if (elapsedSeconds > 0.1) {
+        LOG(WARNING, "Slow write to replica storage: %.1f ms for %lu bytes",
+            elapsedSeconds*1e03, totalBytes);
+    }
+
+    // Reduce our bandwidth (if so configured) by delaying this operation.
+    sleepToThrottleWrites(totalBytes, Cycles::rdtsc() - start);
+
+    uint64_t elapsed = Cycles::rdtsc() - start;
+    metrics->backup.storageWriteTicks += elapsed;
+    PerfStats::threadStats.backupWriteActiveCycles += elapsed;
+    lock.lock();
+}
+
+/**
+ * Start reading a frame's replica from storage without waiting for it; the
+ * reaper thread hands the buffer to the frame and clears its performingIo
+ * once the read completes.
+ *
+ * \param lock
+ *      Lock on #mutex, which must be held. Released while submitting.
+ * \param frame
+ *      Frame to read; its performingIo must be set.
+ * \param buffer
+ *      Buffer to read into. Taken over by this method.
+ * \return
+ *      Always true.
+ */
+bool
+IoUringStorage::startFrameRead(Frame::Lock& lock, Frame* frame,
+                               BufferPtr& buffer)
+{
+    Request* request = new Request(this);
+    request->frame = frame;
+    request->buffer = std::move(buffer);
+    addReads(request, request->buffer.get(), frame->frameIndex);
+    lock.unlock();
+    submit(request);
+    lock.lock();
+    return true;
+}
+
+/**
+ * Start writing a frame's dirty data and metadata to storage without
+ * waiting for it; the reaper thread calls the frame's finishWrite() and
+ * clears its performingIo once the write completes. Writes that must be
+ * followed by a flush, or throttled, are left to the synchronous path.
+ *
+ * \param lock
+ *      Lock on #mutex, which must be held. Released while submitting.
+ * \param frame
+ *      Frame to write; its performingIo must be set.
+ * \param write
+ *      The write, as filled in by the frame's startWrite().
+ * \return
+ *      True if the write was started, false if the caller must perform it
+ *      synchronously instead.
+ */
+bool
+IoUringStorage::startFrameWrite(Frame::Lock& lock, Frame* frame,
+                                const ReplicaWrite& write)
+{
+    if (flushAfterWrites || writeRateLimit != 0)
+        return false;
+
+    Request* request = new Request(this);
+    request->frame = frame;
+    request->replicaWrite = write;
+    std::vector<bool> written(fds.size());
+    addWrites(request, &request->replicaWrite, 1, &written);
+    lock.unlock();
+    submit(request);
+    lock.lock();
+    return true;
+}
+
+/**
+ * Registered buffers must stay allocated for as long as the ring exists, so
+ * they always return to the pool.
+ */
+bool
+IoUringStorage::isBufferPinned(void* buffer)
+{
+    return registeredBuffers.count(static_cast<const char*>(buffer)) != 0;
+}
+
+/**
+ * Add the operations that read all of the framelets of a frame to a request.
+ *
+ * \param request
+ *      Request to add the operations to.
+ * \param buf
+ *      Memory to read the frame into.
+ * \param frameIndex
+ *      Which frame to read.
+ */
+void
+IoUringStorage::addReads(Request* request, void* buf, size_t frameIndex)
+{
+    off_t frameletStart = offsetOfFramelet(frameIndex);
+    for (size_t fileIndex = 0; fileIndex < fds.size(); fileIndex++) {
+        size_t frameletSize = bytesInFramelet(fileIndex, frameIndex);
+        request->operations.emplace_back();
+        Operation* op = &request->operations.back();
+        op->write = false;
+        op->metadata = false;
+        op->fileIndex = fileIndex;
+        op->offset = frameletStart;
+        op->buf = static_cast<char*>(buf) + (frameletSize * fileIndex);
+        op->length = frameletSize;
+    }
+}
+
+/**
+ * Add the operations that write the dirty data and the metadata of some
+ * replicas to a request.
+ *
+ * \param request
+ *      Request to add the operations to.
+ * \param writes
+ *      The writes, as filled in by Frame::startWrite().
+ * \param count
+ *      Number of entries in \a writes.
+ * \param[out] written
+ *      Entries for the files written to are set to true.
+ * \return
+ *      The total number of bytes to be written.
+ */
+size_t
+IoUringStorage::addWrites(Request* request, ReplicaWrite* writes, size_t count,
+                          std::vector<bool>* written)
+{
+    size_t totalBytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        ReplicaWrite* write = &writes[i];
+        void* buf = write->buf;
+        size_t remaining = write->count;
+        off_t frameletStart = offsetOfFramelet(write->frameIndex);
+        off_t offsetInFramelet = write->offsetInFrame;
+        for (size_t fileIndex = 0; remaining > 0; fileIndex++) {
+            size_t frameletSize = bytesInFramelet(fileIndex,
+                                                  write->frameIndex);
+            if (static_cast<size_t>(offsetInFramelet) > frameletSize) {
+                // The offset that we want to write is past this framelet.
+                offsetInFramelet -= frameletSize;
+                continue;
+            }
+
+            size_t bytesToWrite = std::min(frameletSize - offsetInFramelet,
+                                           remaining);
+            request->operations.emplace_back();
+            Operation* op = &request->operations.back();
+            op->write = true;
+            op->metadata = false;
+            op->fileIndex = fileIndex;
+            op->offset = frameletStart + offsetInFramelet;
+            op->buf = buf;
+            op->length = bytesToWrite;
+            (*written)[fileIndex] = true;
+
+            remaining -= bytesToWrite;
+            buf = static_cast<char*>(buf) + bytesToWrite;
+            offsetInFramelet = 0;
+        }
+
+        // Metadata follows the replica's data.
+        request->operations.emplace_back();
+        Operation* metadataOp = &request->operations.back();
+        metadataOp->write = true;
+        metadataOp->metadata = true;
+        metadataOp->fileIndex = 0;
+        metadataOp->offset = offsetOfFrameMetadata(write->frameIndex);
+        metadataOp->buf = write->metadataBuf;
+        metadataOp->length = write->metadataCount;
+        (*written)[0] = true;
+
+        totalBytes += write->count + write->metadataCount;
+    }
+    return totalBytes;
+}
+
+/// DIE if any of the reads in a completed request failed.
+void
+IoUringStorage::checkReads(Request* request)
+{
+    foreach (Operation& op, request->operations) {
+        if (op.result < 0) {
+            DIE("Failed to read replica: %s, "
+                "reading %lu bytes from backup file %lu at offset %lu.",
+                strerror(-op.result), op.length, op.fileIndex, op.offset);
+        } else if (op.result != downCast<int>(op.length) && !usingDevNull) {
+            DIE("Failure performing io_uring IO (short read: "
+                "wanted %lu, got %d at offset %lu in file %lu)",
+                op.length, op.result, op.offset, op.fileIndex);
+        }
+    }
+}
+
+/// DIE if any of the writes in a completed request failed.
+void
+IoUringStorage::checkWrites(Request* request)
+{
+    foreach (Operation& op, request->operations) {
+        const char* what = op.metadata ? "metadata for replica" : "replica";
+        if (op.result < 0) {
+            DIE("Failed to write %s: %s, "
+                "writing %lu bytes to backup file %lu at offset %lu.",
+                what, strerror(-op.result), op.length, op.fileIndex,
+                op.offset);
+        } else if (op.result != downCast<int>(op.length)) {
+            DIE("Unexpectedly short write to %s, "
+                "file %lu at offset %lu, "
+                "expected length %lu, actual write length %d",
+                what, op.fileIndex, op.offset, op.length, op.result);
+        }
+    }
+}
+
+/**
+ * Submit a request's operations to the ring and sleep until all of them
+ * have completed.
+ *
+ * \param request
+ *      The request to perform; its frame must be NULL. On return, the result
+ *      field of each operation holds its outcome.
+ */
+void
+IoUringStorage::performIo(Request* request)
+{
+    submit(request);
+    std::unique_lock<std::mutex> lock(ringMutex);
+    while (!request->done)
+        ringChanged.wait(lock);
+}
+
+/**
+ * Queue a request's operations in the ring and hand them to the kernel,
+ * without waiting for them to complete. If the ring doesn't have room for
+ * all of them, this sleeps until earlier operations complete and submits
+ * the rest as room opens up.
+ *
+ * \param request
+ *      The request to submit. If its frame is set, the request belongs to
+ *      the reaper thread once this returns.
+ */
+void
+IoUringStorage::submit(Request* request)
+{
+    size_t count = request->operations.size();
+    foreach (Operation& op, request->operations)
+        op.request = request;
+    request->startTicks = Cycles::rdtsc();
+
+    std::unique_lock<std::mutex> lock(ringMutex);
+    request->outstanding = count;
+    if (count == 0)
+        request->done = true;
+    size_t next = 0;
+    while (next < count) {
+        while (inFlight == queueDepth)
+            ringChanged.wait(lock);
+
+        uint32_t tail = *sqTail;
+        uint32_t submitted = 0;
+        for (; next < count && inFlight < queueDepth; next++) {
+            Operation* op = &request->operations[next];
+            uint32_t index = tail & *sqMask;
+            struct io_uring_sqe* sqe = &submissionEntries[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->fd = fds[op->fileIndex];
+            sqe->off = op->offset;
+            sqe->user_data = reinterpret_cast<uint64_t>(op);
+            int bufferIndex = findRegisteredBuffer(op->buf, op->length);
+            if (bufferIndex >= 0) {
+                sqe->opcode = op->write ? IORING_OP_WRITE_FIXED
+                                        : IORING_OP_READ_FIXED;
+                sqe->addr = reinterpret_cast<uint64_t>(op->buf);
+                sqe->len = downCast<uint32_t>(op->length);
+                sqe->buf_index = downCast<uint16_t>(bufferIndex);
+            } else {
+                op->iov.iov_base = op->buf;
+                op->iov.iov_len = op->length;
+                sqe->opcode = op->write ? IORING_OP_WRITEV : IORING_OP_READV;
+                sqe->addr = reinterpret_cast<uint64_t>(&op->iov);
+                sqe->len = 1;
+            }
+            sqArray[index] = index;
+            tail++;
+            submitted++;
+            inFlight++;
+        }
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+        // Only hand the entries to the kernel here; the reaper thread is the
+        // one that waits for them.
+        while (submitted > 0) {
+            int r = ioUringEnter(ringFd, submitted, 0, 0);
+            if (r < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                    continue;
+                DIE("io_uring_enter failed: %s", strerror(errno));
+            }
+            submitted -= std::min(submitted, static_cast<uint32_t>(r));
+        }
+    }
+}
+
+/**
+ * Main loop of the #reaper thread: sleep in the kernel until operations
+ * complete, record their results, and finish off each request whose
+ * operations have all completed. Returns once the destructor's final
+ * operation completes.
+ */
+void
+IoUringStorage::reapCompletions()
+{
+    PerfStats::registerStats(&PerfStats::threadStats);
+    while (true) {
+        int r = ioUringEnter(ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+        if (r < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            DIE("io_uring_enter failed: %s", strerror(errno));
+
+        std::vector<Request*> finished;
+        bool exit = false;
+        {
+            std::lock_guard<std::mutex> _(ringMutex);
+            uint32_t head = *cqHead;
+            uint32_t completionTail = __atomic_load_n(cqTail,
+                                                      __ATOMIC_ACQUIRE);
+            for (; head != completionTail; head++) {
+                struct io_uring_cqe* cqe = &completionEntries[head & *cqMask];
+                Operation* op = reinterpret_cast<Operation*>(cqe->user_data);
+                inFlight--;
+                if (op == NULL) {
+                    exit = true;
+                    continue;
+                }
+                op->result = cqe->res;
+                Request* request = op->request;
+                if (--request->outstanding > 0)
+                    continue;
+                if (request->frame == NULL)
+                    request->done = true;
+                else
+                    finished.push_back(request);
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            ringChanged.notify_all();
+        }
+
+        // Done without ringMutex: this needs the storage's mutex, which
+        // submitters of frame IO don't hold while waiting for room.
+        foreach (Request* request, finished)
+            finishFrameIo(request);
+        if (exit)
+            break;
+    }
+    PerfStats::unregisterStats(&PerfStats::threadStats);
+}
+
+/**
+ * Complete the frame IO started by startFrameRead() or startFrameWrite()
+ * once all of its operations have completed, and free the request.
+ */
+void
+IoUringStorage::finishFrameIo(Request* request)
+{
+    Frame* frame = request->frame;
+    uint64_t elapsed = Cycles::rdtsc() - request->startTicks;
+    bool write = request->operations[0].write;
+    if (write) {
+        checkWrites(request);
+        metrics->backup.storageWriteTicks += elapsed;
+        PerfStats::threadStats.backupWriteActiveCycles += elapsed;
+    } else {
+        checkReads(request);
+        metrics->backup.storageReadTicks += elapsed;
+        PerfStats::threadStats.backupReadActiveCycles += elapsed;
+    }
+
+    Lock lock(mutex);
+    frame->performingIo = false;
+    if (write) {
+        frame->finishWrite(lock, request->replicaWrite);
+    } else {
+        assert(!frame->buffer);
+        frame->buffer = std::move(request->buffer);
+    }
+    delete request;
+}
+
+/**
+ * Return the index under which the buffer containing the given memory was
+ * registered with the ring, or -1 if the memory isn't entirely within a
+ * registered buffer.
+ */
+int
+IoUringStorage::findRegisteredBuffer(const void* buf, size_t length)
+{
+    const char* start = static_cast<const char*>(buf);
+    auto it = registeredBuffers.upper_bound(start);
+    if (it == registeredBuffers.begin())
+        return -1;
+    --it;
+    if (start + length > it->first + segmentSize + METADATA_SIZE)
+        return -1;
+    return it->second;
+}
+
+/**
+ * Register the buffers currently in the pool with the ring so that reads and
+ * writes of replicas staged in them can use IORING_OP_READ_FIXED and
+ * IORING_OP_WRITE_FIXED. Registration pins the memory, so it fails if the
+ * process's RLIMIT_MEMLOCK is too low; IO still works without it.
+ */
+void
+IoUringStorage::registerBuffers()
+{
+    std::vector<void*> pooled;
+    while (!buffers.empty()) {
+        pooled.push_back(buffers.top());
+        buffers.pop();
+    }
+    std::vector<struct iovec> iovecs;
+    foreach (void* buffer, pooled) {
+        buffers.push(buffer);
+        iovecs.push_back({buffer, segmentSize + METADATA_SIZE});
+    }
+
+    int r = ioUringRegister(ringFd, IORING_REGISTER_BUFFERS, iovecs.data(),
+                            downCast<uint32_t>(iovecs.size()));
+    if (r < 0) {
+        LOG(WARNING, "Couldn't register %lu replica buffers with io_uring "
+            "(%s); IO will use unregistered buffers. Raising the memlock "
+            "limit (ulimit -l) avoids this.", iovecs.size(), strerror(errno));
+        return;
+    }
+    for (uint16_t i = 0; i < iovecs.size(); i++) {
+        registeredBuffers[static_cast<const char*>(iovecs[i].iov_base)] = i;
+    }
+}
+
+} // namespace RAMCloud
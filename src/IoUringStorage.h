@@ -0,0 +1,233 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef RAMCLOUD_IOURINGSTORAGE_H
+#define RAMCLOUD_IOURINGSTORAGE_H
+
+#include <sys/uio.h>
+#include <condition_variable>
+#include <map>
+#include <thread>
+
+#include "MultiFileStorage.h"
+#include "Tub.h"
+
+// Defined in linux/io_uring.h, which is only included by IoUringStorage.cc:
+// this header is also included where io_uring isn't available (see
+// IO_URING in GNUmakefile), and linux/fs.h's BLOCK_SIZE macro would clobber
+// MultiFileStorage::BLOCK_SIZE anyway.
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace RAMCloud {
+
+/**
+ * A MultiFileStorage which performs its replica reads and writes through a
+ * Linux io_uring instead of POSIX aio. All of the framelet operations (and the
+ * metadata write) for a replica are queued in the ring and handed to the
+ * kernel together, and the storage's pooled replica buffers are registered
+ * with the ring up front so the kernel needn't pin and unpin their pages on
+ * every operation.
+ *
+ * Frame IO scheduled on the ioQueue doesn't wait for the kernel: the ioQueue
+ * thread submits each frame's operations and moves on to the next frame, so
+ * many frames can be read and written at once, and a separate thread reaps
+ * completions and finishes off each frame as its IO completes. Synchronous
+ * writes (including group commits) and reads made outside the ioQueue share
+ * the same ring and sleep until their own operations complete.
+ *
+ * Everything else (frame state, buffering, superblocks, file layout) is
+ * inherited from MultiFileStorage, so the two are interchangeable on the same
+ * files. Only built if the kernel headers provide io_uring (see IO_URING in
+ * GNUmakefile); use isSupported() to check whether the running kernel
+ * provides it before constructing one.
+ */
+class IoUringStorage : public MultiFileStorage {
+  public:
+    IoUringStorage(size_t segmentSize,
+                   size_t frameCount,
+                   size_t writeRateLimit,
+                   size_t maxNonVolatileBuffers,
+                   const char* filePaths,
+                   int openFlags = 0,
+                   bool groupCommit = false,
+                   size_t fragmentFrameCount = 0,
+                   size_t fragmentFrameSize = 0);
+    ~IoUringStorage();
+
+    static bool isSupported();
+
+  PRIVATE:
+    struct Request;
+
+    /**
+     * One read or write to be submitted to the ring.
+     */
+    struct Operation {
+        /// True to write #buf to the file, false to read into it.
+        bool write;
+
+        /// True if this writes a replica's metadata rather than its data;
+        /// only used in error messages.
+        bool metadata;
+
+        /// Index into #fds of the file to operate on.
+        size_t fileIndex;
+
+        /// Offset in the file.
+        off_t offset;
+
+        /// Memory to read into or write from.
+        void* buf;
+
+        /// Number of bytes to transfer.
+        size_t length;
+
+        /// Filled in once the operation completes: the number of bytes
+        /// transferred or a negated errno value.
+        int result;
+
+        /// Used when #buf isn't in a registered buffer.
+        struct iovec iov;
+
+        /// The request this operation is part of.
+        Request* request;
+    };
+
+    /**
+     * A group of operations that complete together: the reads of all of the
+     * framelets of a frame, or the writes of one or more replicas.
+     */
+    struct Request {
+        explicit Request(IoUringStorage* storage);
+
+        /// The operations to perform.
+        std::vector<Operation> operations;
+
+        /// Number of #operations that haven't completed yet. Protected by
+        /// #ringMutex.
+        size_t outstanding;
+
+        /// If non-NULL, this is IO for the frame started by startFrameRead()
+        /// or startFrameWrite(), and the reaper thread finishes it off.
+        /// Otherwise a thread is waiting in performIo() for it.
+        Frame* frame;
+
+        /// For frame writes: the write that was started.
+        ReplicaWrite replicaWrite;
+
+        /// For frame reads: the buffer being read into, which becomes the
+        /// frame's buffer once the read completes.
+        BufferPtr buffer;
+
+        /// Cycles::rdtsc() when the request was submitted.
+        uint64_t startTicks;
+
+        /// Set (under #ringMutex) when every operation has completed.
+        bool done;
+
+        DISALLOW_COPY_AND_ASSIGN(Request);
+    };
+
+    void unlockedRead(Frame::Lock& lock, void* buf, size_t frameIndex,
+                      bool usingDevNull);
+    using MultiFileStorage::unlockedWrite;
+    void unlockedWrite(Frame::Lock& lock, ReplicaWrite* writes, size_t count);
+    bool startFrameRead(Frame::Lock& lock, Frame* frame, BufferPtr& buffer);
+    bool startFrameWrite(Frame::Lock& lock, Frame* frame,
+                         const ReplicaWrite& write);
+    bool isBufferPinned(void* buffer);
+    void addReads(Request* request, void* buf, size_t frameIndex);
+    size_t addWrites(Request* request, ReplicaWrite* writes, size_t count,
+                     std::vector<bool>* written);
+    void checkReads(Request* request);
+    void checkWrites(Request* request);
+    void performIo(Request* request);
+    void submit(Request* request);
+    void reapCompletions();
+    void finishFrameIo(Request* request);
+    int findRegisteredBuffer(const void* buf, size_t length);
+    void registerBuffers();
+
+    /// Number of entries requested for the submission queue. This bounds
+    /// the number of operations in flight (frames times files, plus one
+    /// metadata write per frame written); requests for more than this are
+    /// submitted in pieces.
+    enum { QUEUE_DEPTH = 256 };
+
+    /**
+     * Protects the submission queue, #inFlight, and Request::outstanding
+     * and Request::done. Never held while waiting for IO.
+     */
+    std::mutex ringMutex;
+
+    /// Notified whenever operations complete, for threads waiting for room
+    /// in the ring or for their request to finish.
+    std::condition_variable ringChanged;
+
+    /// Number of operations submitted whose completions haven't been reaped.
+    uint32_t inFlight;
+
+    /// File descriptor returned by io_uring_setup().
+    int ringFd;
+
+    /// Number of entries in the submission queue.
+    uint32_t queueDepth;
+
+    /// Mapping of the submission queue ring.
+    void* submissionRing;
+
+    /// Length of #submissionRing in bytes.
+    size_t submissionRingLength;
+
+    /// Mapping of the completion queue ring; may equal #submissionRing.
+    void* completionRing;
+
+    /// Length of #completionRing in bytes.
+    size_t completionRingLength;
+
+    /// Mapping of the submission queue entries.
+    struct io_uring_sqe* submissionEntries;
+
+    /// Pointers into #submissionRing; see struct io_sqring_offsets.
+    uint32_t* sqHead;
+    uint32_t* sqTail;
+    uint32_t* sqMask;
+    uint32_t* sqArray;
+
+    /// Pointers into #completionRing; see struct io_cqring_offsets.
+    uint32_t* cqHead;
+    uint32_t* cqTail;
+    uint32_t* cqMask;
+    struct io_uring_cqe* completionEntries;
+
+    /**
+     * Start address of each buffer registered with the ring, mapped to its
+     * index in the registration. Empty if registration failed (for example,
+     * because RLIMIT_MEMLOCK is too low), in which case all IO uses the
+     * unregistered operations.
+     */
+    std::map<const char*, uint16_t> registeredBuffers;
+
+    /// Runs reapCompletions(): waits in the kernel for operations to
+    /// complete and finishes off their requests.
+    Tub<std::thread> reaper;
+
+    DISALLOW_COPY_AND_ASSIGN(IoUringStorage);
+};
+
+} // namespace RAMCloud
+
+#endif
@@ -0,0 +1,298 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "TestUtil.h"
+#include "IoUringStorage.h"
+#include "PerfStats.h"
+
+namespace RAMCloud {
+
+class IoUringStorageTest : public ::testing::Test {
+  public:
+    typedef char* bytes;
+    enum { BLOCK_SIZE = MultiFileStorage::BLOCK_SIZE };
+    enum { METADATA_SIZE = MultiFileStorage::METADATA_SIZE };
+    typedef MultiFileStorage::Frame Frame;
+
+    uint32_t segmentFrames;
+    uint32_t segmentSize;
+    Tub<IoUringStorage> storage;
+    const char* filePath1;
+    const char* filePath2;
+    mode_t oldUmask;
+
+    IoUringStorageTest()
+        : segmentFrames(4)
+        // Needed when testing with O_DIRECT
+        , segmentSize(BLOCK_SIZE * 4)
+        , storage()
+        , filePath1("/tmp/ramcloud-iouring-storage-test-delete-this-1")
+        , filePath2("/tmp/ramcloud-iouring-storage-test-delete-this-2")
+        , oldUmask(umask(0))
+    {
+        Logger::get().setLogLevels(SILENT_LOG_LEVEL);
+        // Kernels without io_uring get MultiFileStorage instead, so there
+        // is nothing to test there.
+        if (!IoUringStorage::isSupported())
+            return;
+        std::string twoFiles = std::string(filePath1) + "," + filePath2;
+        storage.construct(segmentSize, segmentFrames, 0, segmentFrames,
+                          twoFiles.c_str(), O_DIRECT | O_SYNC);
+    }
+
+    ~IoUringStorageTest()
+    {
+        storage.destroy();
+        umask(oldUmask);
+        unlink(filePath1);
+        unlink(filePath2);
+    }
+
+    DISALLOW_COPY_AND_ASSIGN(IoUringStorageTest);
+};
+
+TEST_F(IoUringStorageTest, unlockedWrite) {
+    // This test also implicitly tests unlockedRead.
+    if (!storage)
+        return;
+    size_t dataLen1 = BLOCK_SIZE + BLOCK_SIZE / 2;
+    size_t dataLen2 = BLOCK_SIZE;
+    Memory::unique_ptr_free data(
+        Memory::xmemalign(HERE, getpagesize(), segmentSize),
+        std::free);
+    memset(data.get(), 'x', dataLen1);
+    memset(static_cast<char*>(data.get()) + dataLen1, 'y', dataLen2);
+    static_cast<char*>(data.get())[dataLen1 + dataLen2] = '\0';
+    char metadata[] = "metadata";
+
+    Buffer source;
+    source.appendExternal(data.get(), segmentSize);
+
+    BackupStorage::FrameRef frameRef = storage->open(false, ServerId(), 0);
+    Frame* frame = static_cast<Frame*>(frameRef.get());
+    frame->append(source, 0, dataLen1, 0, metadata, sizeof(metadata));
+    storage->quiesce();
+    frame->append(source, dataLen1, dataLen2 + 1, dataLen1, NULL, 0);
+    while (!frame->isSynced());
+
+    // Force a read from disk.
+    frame->buffer.reset();
+    {
+        Frame::Lock lock(frame->storage->mutex);
+        frame->loadRequested = true;
+        frame->performRead(lock);
+    }
+    char* replica = bytes(frame->load());
+    EXPECT_STREQ(bytes(data.get()), replica);
+    EXPECT_STREQ(metadata, bytes(const_cast<void*>(frame->getMetadata())));
+}
+
+TEST_F(IoUringStorageTest, unlockedWriteSeveralReplicas) {
+    // This test also implicitly tests unlockedRead.
+    if (!storage)
+        return;
+    storage->ioQueue.halt();
+    const char* contents[] = { "first", "second" };
+    BackupStorage::FrameRef frameRefs[2];
+    MultiFileStorage::ReplicaWrite writes[2];
+    for (int i = 0; i < 2; i++) {
+        frameRefs[i] = storage->open(false, ServerId(), i);
+        Frame* frame = static_cast<Frame*>(frameRefs[i].get());
+        Buffer source;
+        source.appendExternal(contents[i],
+                              downCast<uint32_t>(strlen(contents[i]) + 1));
+        // Straddle the boundary between the framelets in the two files.
+        frame->append(source, 0, source.size(), segmentSize / 2 - 1,
+                      contents[i], strlen(contents[i]) + 1);
+        Frame::Lock lock(storage->mutex);
+        frame->startWrite(&writes[i]);
+    }
+    {
+        Frame::Lock lock(storage->mutex);
+        storage->unlockedWrite(lock, writes, 2);
+        for (int i = 0; i < 2; i++) {
+            static_cast<Frame*>(frameRefs[i].get())->finishWrite(lock,
+                                                                 writes[i]);
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        Frame* frame = static_cast<Frame*>(frameRefs[i].get());
+        // Force a read from disk.
+        frame->buffer.reset();
+        {
+            Frame::Lock lock(frame->storage->mutex);
+            frame->loadRequested = true;
+            frame->performRead(lock);
+        }
+        char* replica = bytes(frame->load());
+        EXPECT_STREQ(contents[i], replica + segmentSize / 2 - 1);
+        EXPECT_STREQ(contents[i],
+                     bytes(const_cast<void*>(frame->getMetadata())));
+    }
+}
+
+TEST_F(IoUringStorageTest, startFrameWrite_startFrameRead) {
+    if (!storage)
+        return;
+    storage->ioQueue.halt();
+    BackupStorage::FrameRef frameRef = storage->open(false, ServerId(), 0);
+    Frame* frame = static_cast<Frame*>(frameRef.get());
+    Buffer source;
+    source.appendExternal("data", 5);
+    frame->append(source, 0, 5, 0, "metadata", 9);
+
+    // The write is left to the reaper thread to finish.
+    {
+        Frame::Lock lock(storage->mutex);
+        frame->performingIo = true;
+        EXPECT_FALSE(frame->performWrite(lock, true));
+    }
+    while (true) {
+        Frame::Lock lock(storage->mutex);
+        if (!frame->performingIo)
+            break;
+    }
+    EXPECT_TRUE(frame->isSynced());
+
+    // So is the read.
+    {
+        Frame::Lock lock(storage->mutex);
+        frame->buffer.reset();
+        frame->loadRequested = true;
+        frame->performingIo = true;
+        EXPECT_FALSE(frame->performRead(lock, true));
+    }
+    char* replica = bytes(frame->load());
+    EXPECT_STREQ("data", replica);
+    Frame::Lock lock(storage->mutex);
+    EXPECT_FALSE(frame->performingIo);
+}
+
+TEST_F(IoUringStorageTest, reapCompletions_registersStats) {
+    if (!storage)
+        return;
+    storage.destroy();
+    size_t registered = PerfStats::registeredStats.size();
+
+    // The reaper registers its stats once it starts up (as does the
+    // thread running ioQueue)...
+    std::string twoFiles = std::string(filePath1) + "," + filePath2;
+    storage.construct(segmentSize, segmentFrames, 0, segmentFrames,
+                      twoFiles.c_str(), O_DIRECT | O_SYNC);
+    for (int i = 0; i < 1000; i++) {
+        {
+            std::lock_guard<SpinLock> _(PerfStats::mutex);
+            if (PerfStats::registeredStats.size() >= registered + 2)
+                break;
+        }
+        usleep(1000);
+    }
+    EXPECT_EQ(registered + 2, PerfStats::registeredStats.size());
+
+    // ...and unregisters them before it exits.
+    storage.destroy();
+    EXPECT_EQ(registered, PerfStats::registeredStats.size());
+}
+
+TEST_F(IoUringStorageTest, performIo_unregisteredBuffers) {
+    if (!storage)
+        return;
+    char out[BLOCK_SIZE] __attribute__((aligned(BLOCK_SIZE)));
+    char in[BLOCK_SIZE] __attribute__((aligned(BLOCK_SIZE)));
+    memset(out, 'a', sizeof(out));
+    memset(in, 0, sizeof(in));
+    EXPECT_EQ(-1, storage->findRegisteredBuffer(out, sizeof(out)));
+
+    IoUringStorage::Request write(storage.get());
+    write.operations.resize(1);
+    IoUringStorage::Operation* op = &write.operations[0];
+    op->write = true;
+    op->fileIndex = 1;
+    op->offset = 0;
+    op->buf = out;
+    op->length = sizeof(out);
+    storage->performIo(&write);
+    EXPECT_EQ(BLOCK_SIZE, op->result);
+
+    IoUringStorage::Request read(storage.get());
+    read.operations.push_back(*op);
+    read.operations[0].write = false;
+    read.operations[0].buf = in;
+    read.operations.push_back(read.operations[0]);
+    read.operations[1].fileIndex = 0;
+    storage->performIo(&read);
+    EXPECT_EQ(BLOCK_SIZE, read.operations[0].result);
+    EXPECT_EQ(BLOCK_SIZE, read.operations[1].result);
+    EXPECT_EQ(0, memcmp(in, out, sizeof(in)));
+}
+
+TEST_F(IoUringStorageTest, submit_moreThanQueueDepth) {
+    if (!storage)
+        return;
+    char out[BLOCK_SIZE] __attribute__((aligned(BLOCK_SIZE)));
+    memset(out, 'b', sizeof(out));
+    IoUringStorage::Request request(storage.get());
+    for (uint32_t i = 0; i < storage->queueDepth + 3; i++) {
+        request.operations.emplace_back();
+        IoUringStorage::Operation* op = &request.operations.back();
+        op->write = true;
+        op->fileIndex = i % 2;
+        op->offset = 0;
+        op->buf = out;
+        op->length = sizeof(out);
+    }
+    storage->performIo(&request);
+    foreach (IoUringStorage::Operation& op, request.operations)
+        EXPECT_EQ(BLOCK_SIZE, op.result);
+    EXPECT_EQ(0U, storage->inFlight);
+}
+
+TEST_F(IoUringStorageTest, findRegisteredBuffer) {
+    if (!storage || storage->registeredBuffers.empty())
+        return;
+    MultiFileStorage::BufferPtr buffer = storage->allocateBuffer();
+    char* start = static_cast<char*>(buffer.get());
+    int index = storage->findRegisteredBuffer(start, 1);
+    EXPECT_LE(0, index);
+    EXPECT_EQ(index, storage->findRegisteredBuffer(
+            start + segmentSize, METADATA_SIZE));
+    EXPECT_EQ(-1, storage->findRegisteredBuffer(
+            start + segmentSize, METADATA_SIZE + 1));
+    EXPECT_EQ(-1, storage->findRegisteredBuffer(start - 1, 1));
+}
+
+TEST_F(IoUringStorageTest, isBufferPinned) {
+    if (!storage || storage->registeredBuffers.empty())
+        return;
+    MultiFileStorage::BufferPtr buffer = storage->allocateBuffer();
+    EXPECT_TRUE(storage->isBufferPinned(buffer.get()));
+    char unregistered;
+    EXPECT_FALSE(storage->isBufferPinned(&unregistered));
+
+    // Registered buffers go back to the pool even when it is full.
+    size_t pooled = storage->buffers.size();
+    while (storage->buffers.size() < 128)
+        storage->buffers.push(NULL);
+    void* pinned = buffer.get();
+    buffer.reset();
+    EXPECT_EQ(pinned, storage->buffers.top());
+    storage->buffers.pop();
+    while (storage->buffers.size() > pooled)
+        storage->buffers.pop();
+    storage->buffers.push(pinned);
+}
+
+} // namespace RAMCloud
@@ -22,6 +22,7 @@
 #include <boost/type_traits.hpp>
 #include <boost/utility/enable_if.hpp>
 #include "Common.h"
+#include "MemoryPolicy.h"
 
 namespace RAMCloud {
 
@@ -55,6 +56,7 @@ struct LargeBlockOfMemory {
     explicit LargeBlockOfMemory(size_t length)
         : length(length)
         , block(static_cast<T*>(mmapGigabyteAligned(length, MAP_ANONYMOUS)))
+        , mappedLength(length)
     {
         if (block == MAP_FAILED) {
             if (length == 0)
@@ -65,6 +67,57 @@ struct LargeBlockOfMemory {
         }
     }
 
+    /**
+     * Allocates anonymous backing pages for a block of memory as requested
+     * by a MemoryPolicy, then pins and zeros them like the constructor
+     * above. If the policy's huge pages aren't available, small pages are
+     * used instead. Unless the policy is the default, what the block ended
+     * up with is logged.
+     * \param length
+     *      The number of bytes of memory to allocate.
+     * \param policy
+     *      The page size and NUMA placement to request.
+     * \throw FatalError
+     *      If the memory could not be allocated.
+     */
+    LargeBlockOfMemory(size_t length, const MemoryPolicy& policy)
+        : length(length)
+        , block(NULL)
+        , mappedLength(length)
+    {
+        void* base = MAP_FAILED;
+        if (policy.getMmapFlags() != 0 && length != 0) {
+            // Hugetlb mappings must be a whole number of pages.
+            size_t pageBytes = policy.getPageBytes();
+            mappedLength = (length + pageBytes - 1) & ~(pageBytes - 1);
+            base = mmapGigabyteAligned(mappedLength,
+                    MAP_ANONYMOUS | policy.getMmapFlags(), -1, &policy);
+            if (base == MAP_FAILED) {
+                RAMCLOUD_LOG(WARNING, "Couldn't get %s pages for %lu-byte "
+                             "block; using small pages instead",
+                             policy.toString().c_str(), length);
+                mappedLength = length;
+            }
+        }
+        if (base == MAP_FAILED)
+            base = mmapGigabyteAligned(length, MAP_ANONYMOUS, -1, &policy);
+        block = static_cast<T*>(base);
+        if (base == MAP_FAILED) {
+            if (length == 0)
+                return;
+            throw FatalError(HERE,
+                             format("Could not allocate %lu bytes", length),
+                             errno);
+        }
+
+        if (!policy.isDefault()) {
+            RAMCLOUD_LOG(NOTICE, "Allocated %lu-byte block at %p with "
+                         "memory policy %s: %s", length, base,
+                         policy.toString().c_str(),
+                         policy.describe(base, mappedLength).c_str());
+        }
+    }
+
     /**
      * Creates a file of the desired length and mmaps pages from it, pins them,
      * and zeros them. This is intended to be used with hugetlbfs to get
@@ -81,7 +134,8 @@ struct LargeBlockOfMemory {
      */
     LargeBlockOfMemory(string filePath, size_t length)
         : length(length),
-          block(NULL)
+          block(NULL),
+          mappedLength(length)
     {
         const char* path = filePath.c_str();
 
@@ -131,7 +185,7 @@ struct LargeBlockOfMemory {
 
     ~LargeBlockOfMemory()
     {
-        if (block != NULL && munmap(block, length) != 0)
+        if (block != NULL && munmap(block, mappedLength) != 0)
             RAMCLOUD_LOG(WARNING, "munmap of large block failed with %d",
                          errno);
     }
@@ -139,6 +193,7 @@ struct LargeBlockOfMemory {
     void swap(LargeBlockOfMemory<T>& other) {
         std::swap(this->length, other.length);
         std::swap(this->block, other.block);
+        std::swap(this->mappedLength, other.mappedLength);
     }
 
     /// Returns #block.
@@ -161,6 +216,10 @@ struct LargeBlockOfMemory {
     T* block;
 
   private:
+    /// The number of bytes actually mapped at #block; this is #length
+    /// rounded up to a whole number of pages for hugetlb mappings.
+    size_t mappedLength;
+
     /**
      * Mmap the desired amount of space with gigabyte alignment (lower 30
      * bits of the address are 0). Also, ensure that all mappings are faulted
@@ -178,25 +237,40 @@ struct LargeBlockOfMemory {
      *      Extra flags to be passed to mmap(2).
      * \param[in] fd
      *      Optional file descriptor (if mmaping a file, for instance).
+     * \param[in] policy
+     *      Optional MemoryPolicy to apply to the mapping before its pages
+     *      are faulted in.
      */
     void*
-    mmapGigabyteAligned(size_t length, int extraFlags, int fd = -1)
+    mmapGigabyteAligned(size_t length, int extraFlags, int fd = -1,
+                        const MemoryPolicy* policy = NULL)
     {
         const int maxTries = 10000;
         int i;
 
+        // By default the kernel only uses transparent huge pages for
+        // private anonymous memory, not shared memory.
+        int sharing = MAP_SHARED;
+        if (policy != NULL &&
+                policy->pageSize == MemoryPolicy::TRANSPARENT_HUGE_PAGES)
+            sharing = MAP_PRIVATE;
+
         uint64_t tryBase = LargeBlockOfMemoryInternal::nextProbeBase;
         for (i = 0; i < maxTries; i++) {
             void *base = mmap(reinterpret_cast<void*>(tryBase),
                               length,
                               PROT_READ | PROT_WRITE,
-                              MAP_SHARED | extraFlags,
+                              sharing | extraFlags,
                               fd,
                               0);
 
             if (base == reinterpret_cast<void*>(tryBase))
                 break;
 
+            // If the huge page pool is exhausted, other addresses won't help.
+            if (base == MAP_FAILED && (extraFlags & MAP_HUGETLB))
+                return MAP_FAILED;
+
             if (base != MAP_FAILED) {
                 if (munmap(base, length)) {
                     RAMCLOUD_LOG(ERROR, "couldn't munmap undesirable mapping!");
@@ -213,6 +287,8 @@ struct LargeBlockOfMemory {
         }
 
         void* block = reinterpret_cast<void*>(tryBase);
+        if (policy != NULL)
+            policy->apply(block, length);
 
         // Do not pin and fault in pages if we're testing, since that just
         // slows things down considerably (we usually don't touch anywhere near
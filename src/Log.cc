@@ -15,6 +15,7 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <algorithm>
 
 #include "Log.h"
 #include "LogCleaner.h"
@@ -63,10 +64,14 @@ Log::Log(Context* context,
     : AbstractLog(entryHandlers,
                   segmentManager,
                   replicaManager,
-                  config->segmentSize),
+                  config->segmentSize,
+                  std::max(config->master.numLogHeads, 1U) *
+                      (config->master.hotObjectSeconds > 0 ? 2 : 1),
+                  config->master.hotObjectSeconds > 0 ?
+                      std::max(config->master.numLogHeads, 1U) : 0),
       context(context),
       cleaner(NULL),
-      syncLock("Log::syncLock"),
+      transitionLock("Log::transitionLock"),
       metrics()
 {
     cleaner = new LogCleaner(context,
@@ -119,12 +124,15 @@ Log::getMetrics(ProtoBuf::LogMetrics& m)
 }
 
 /**
- * Return the position of the current log head.
+ * Return the position of the current log head. If the log has several heads,
+ * this is the position of the one with the lowest id, so that everything
+ * appended afterwards lies beyond it.
  */
 LogPosition
 Log::getHead() {
-    SpinLock::Guard _(appendLock);
-    return LogPosition(head->id, head->getAppendedLength());
+    SpinLock::Guard _(heads[0].appendLock);
+    return LogPosition(heads[0].segment->id,
+                       heads[0].segment->getAppendedLength());
 }
 
 /**
@@ -143,6 +151,12 @@ Log::getHead() {
  * started waiting. This lets us batch backup writes and improve throughput for
  * small entries.
  *
+ * If the log has several heads, only the heads that the calling thread appends
+ * to (one, or two if the log segregates hot and cold data) are synced. That
+ * covers all of the calling thread's own appends, which is what callers (such
+ * as ObjectManager::syncChanges()) need, while threads appending to other
+ * heads sync in parallel.
+ *
  * An alternative to batching writes would have been to pipeline replication
  * RPCs to backups. That would probably also work just fine, but results in
  * more RPCs and is more complicated (we'd need to keep track of various RPCs
@@ -154,17 +168,32 @@ void
 Log::sync()
 {
     CycleCounter<uint64_t> __(&PerfStats::threadStats.logSyncCycles);
+    metrics.totalSyncCalls++;
 
+    sync(false);
+    if (numColdHeads > 0)
+        sync(true);
+}
+
+/**
+ * Sync one of the heads the calling thread appends to; see sync().
+ *
+ * \param cold
+ *      If true, sync the calling thread's cold head rather than its regular
+ *      one (see AbstractLog::lockHead()).
+ */
+void
+Log::sync(bool cold)
+{
     Tub<SpinLock::Guard> lock;
-    lock.construct(appendLock);
-    metrics.totalSyncCalls++;
+    Head& head = lockHead(lock, cold);
 
-    // The only time 'head' should be NULL is after construction and before the
-    // initial call to this method. Even if we run out of memory in the future,
-    // head will remain valid.
-    if (head == NULL) {
+    // The only time a head's segment should be NULL is after construction
+    // and before the initial call to this method (or append()). Even if we
+    // run out of memory in the future, it will remain valid.
+    if (head.segment == NULL) {
         assert(metrics.totalSyncCalls == 1);
-        if (!allocNewWritableHead())
+        if (!makeRoom(lock, head, NULL, 0))
             throw FatalError(HERE, "Could not allocate initial head segment");
     }
 
@@ -175,20 +204,20 @@ Log::sync()
     // sometimes when the log really is synced up to our appends, but this logic
     // mistakes additional data from other threads' appends as stuff we care
     // about.
-    uint32_t appendedLength = head->getAppendedLength();
+    uint32_t appendedLength = head.segment->getAppendedLength();
 
     // Concurrent appends may cause the head segment to change while we wait
     // for another thread to finish syncing, so save the segment associated
     // with the appendedLength we just acquired.
-    LogSegment* originalHead = head;
+    LogSegment* originalHead = head.segment;
 
     // We have a consistent view of the current head segment, so drop the append
     // lock and grab the sync lock. This allows other writers to append to the
     // log while we wait. Once we grab the sync lock, take the append lock again
     // to ensure our new view of the head is consistent.
     lock.destroy();
-    SpinLock::Guard _(syncLock);
-    lock.construct(appendLock);
+    SpinLock::Guard _(head.syncLock);
+    lock.construct(head.appendLock);
 
     // See if we still have work to do. It's possible that another thread
     // already did the syncing we needed for us.
@@ -202,7 +231,17 @@ Log::sync()
         // while we sync.
         lock.destroy();
 
-        originalHead->replicatedSegment->sync(appendedLength, &certificate);
+        ReplicatedSegment* replicatedSegment = originalHead->replicatedSegment;
+        waitForHeadTransition();
+        replicatedSegment->sync(appendedLength, &certificate);
+
+        // One of several heads that lost an open replica isn't durable again
+        // until it has been closed; see ReplicatedSegment::openWithOtherHeads.
+        while (numHeads > 1 && replicatedSegment->isAwaitingClose()) {
+            replaceHeads(&head, originalHead, true);
+            replicatedSegment->sync(appendedLength, &certificate);
+        }
+
         originalHead->syncedLength = appendedLength;
         TEST_LOG("log synced");
     } else {
@@ -239,13 +278,16 @@ Log::syncTo(Log::Reference reference)
     segment->getEntry(offset, NULL, &lengthWithMetadata);
     uint32_t desiredSyncedLength = offset + lengthWithMetadata;
 
-    SpinLock::Guard _(syncLock);
+    // With several heads, the entry's segment belongs to (or was replaced by)
+    // the head with the same index.
+    Head& head = heads[segment->headIndex];
+    SpinLock::Guard _(head.syncLock);
 
     // See if we still have work to do. It's possible that another thread
     // already did the syncing we needed for us.
     if (desiredSyncedLength > segment->syncedLength) {
         Tub<SpinLock::Guard> lock;
-        lock.construct(appendLock);
+        lock.construct(head.appendLock);
 
         // Get the latest segment length and certificate. This allows us to
         // batch up other appends that came in while we were waiting.
@@ -253,14 +295,16 @@ Log::syncTo(Log::Reference reference)
         // If segment != head, segment must have been closed and its replication
         // is queued already. Forcing sync of head segment will also make sure
         // that the closed segment is fully replicated.
-        uint32_t appendedLength = head->getAppendedLength(&certificate);
+        LogSegment* headSegment = head.segment;
+        uint32_t appendedLength = headSegment->getAppendedLength(&certificate);
 
         // Drop the append lock. We don't want to block other appending
         // threads while we sync.
         lock.destroy();
 
-        head->replicatedSegment->sync(appendedLength, &certificate);
-        head->syncedLength = appendedLength;
+        waitForHeadTransition();
+        headSegment->replicatedSegment->sync(appendedLength, &certificate);
+        headSegment->syncedLength = appendedLength;
         TEST_LOG("log synced");
         return;
     }
@@ -282,25 +326,35 @@ Log::syncTo(Log::Reference reference)
  * want to recover that data if a failure occurrs. Fortunately, its data would
  * be at strictly lower positions in the log, so it's easy to filter during
  * recovery.
+ *
+ * If the log has several heads, all of them are replaced and the position
+ * returned is that of the new head with the lowest id.
  */
 LogPosition
 Log::rollHeadOver()
 {
-    SpinLock::Guard lock(syncLock);
-    SpinLock::Guard lock2(appendLock);
+    if (numHeads > 1) {
+        LogPosition position;
+        replaceHeads(NULL, NULL, true, &position);
+        return position;
+    }
+
+    Head& head = heads[0];
+    SpinLock::Guard lock(head.syncLock);
+    SpinLock::Guard lock2(head.appendLock);
 
     // Allocate the new head and sync the log. This will ensure that the
     // position returned is stable on backups. This is paricularly important
     // for SideLog::commit(), which rolls the head over to inject a SideLog
     // into the main log (by adding segments to a new log digest and syncing
     // that to disk). See RAM-489.
-    head = allocNextSegment(true);
+    head.segment = allocNextSegment(true);
     SegmentCertificate certificate;
-    uint32_t appendedLength = head->getAppendedLength(&certificate);
-    head->replicatedSegment->sync(appendedLength, &certificate);
-    head->syncedLength = appendedLength;
+    uint32_t appendedLength = head.segment->getAppendedLength(&certificate);
+    head.segment->replicatedSegment->sync(appendedLength, &certificate);
+    head.segment->syncedLength = appendedLength;
 
-    return LogPosition(head->id, head->getAppendedLength());
+    return LogPosition(head.segment->id, head.segment->getAppendedLength());
 }
 
 /******************************************************************************
@@ -311,7 +365,8 @@ Log::rollHeadOver()
  * Allocate a new head segment for the log. This is used by the AbstractLog
  * superclass when a new segment is needed.
  *
- * This method must be called with the AbstractLog's appendLock held.
+ * This method must be called with the AbstractLog's appendLock held. It is
+ * only used by logs with a single head; see allocNextHeads() for the others.
  *
  * \param mustNotFail
  *      If true, this method must return a valid LogSegment pointer and may
@@ -321,7 +376,8 @@ Log::rollHeadOver()
 LogSegment*
 Log::allocNextSegment(bool mustNotFail)
 {
-    assert(!appendLock.try_lock());
+    assert(numHeads == 1);
+    assert(!heads[0].appendLock.try_lock());
 
     if (mustNotFail)
         return segmentManager->allocHeadSegment(SegmentManager::MUST_NOT_FAIL);
@@ -329,4 +385,177 @@ Log::allocNextSegment(bool mustNotFail)
         return segmentManager->allocHeadSegment();
 }
 
+/**
+ * Replace the head the caller found to be full with a new segment, unless
+ * another thread has done so since. A full hot head is replaced along with
+ * the other hot heads; a full cold head on its own (see replaceHeads()).
+ * This is used by the AbstractLog superclass when a log with several heads
+ * needs more space.
+ *
+ * This method must be called without any appendLock held.
+ *
+ * \param head
+ *      The head the caller found to be full.
+ * \param full
+ *      The segment \a head referred to at the time.
+ * \return
+ *      True if this call replaced the head, false if another thread had
+ *      already done so or if there is no memory for new heads.
+ */
+bool
+Log::allocNextHeads(Head& head, LogSegment* full)
+{
+    return replaceHeads(&head, full, false);
+}
+
+/**
+ * Replace some or all of the log's heads with new segments from
+ * SegmentManager::allocHeadSegments(). If that returns a single emergency
+ * head, every head refers to it.
+ *
+ * Given a head, only the heads in its group are replaced: all of the hot
+ * heads, or just that head if it's a cold one, since cold heads fill slowly.
+ * The others stay open, with a new digest appended that names the new
+ * heads. Every head is replaced, though, if one of them has lost an open
+ * replica: closing that one would invalidate the open replicas of the heads
+ * with lower ids (see ReplicatedSegment::openWithOtherHeads).
+ *
+ * Appends are held up only while the new heads are installed. Waiting for
+ * backups to make the new heads and the digests durable and to close the
+ * previous heads happens afterwards, with just #transitionLock held; see
+ * waitForHeadTransition(). The log's out-of-space accounting (see
+ * checkNewHead()) is updated while every head is locked.
+ *
+ * This method must be called without any appendLock held.
+ *
+ * \param head
+ *      If non-NULL, the heads in its group are replaced, but only if this
+ *      head still refers to \a expected (another thread may have replaced
+ *      it meanwhile). If NULL, every head is replaced.
+ * \param expected
+ *      See \a head.
+ * \param mustNotFail
+ *      If true, this method must succeed and may block as long as needed
+ *      (see SegmentManager::MUST_NOT_FAIL).
+ * \param[out] position
+ *      If non-NULL, the position of the new head with the lowest id, as of
+ *      its installation, is returned here. The log is synced to this point
+ *      on backups once this method returns.
+ * \return
+ *      True if the heads were replaced, false if \a head had changed or if
+ *      out of memory.
+ */
+bool
+Log::replaceHeads(Head* head, LogSegment* expected, bool mustNotFail,
+                  LogPosition* position)
+{
+    SpinLock::Guard _(transitionLock);
+
+    while (true) {
+        // Only transitions change the heads' segments, so they can be
+        // looked at without any appendLock.
+        uint32_t firstReplaced = 0;
+        uint32_t numReplaced = numHeads;
+        if (head != NULL) {
+            uint32_t index = downCast<uint32_t>(head - heads.get());
+            uint32_t numHotHeads = numHeads - numColdHeads;
+            if (index < numHotHeads) {
+                numReplaced = numHotHeads;
+            } else {
+                firstReplaced = index;
+                numReplaced = 1;
+            }
+        }
+        for (uint32_t i = 0; i < numHeads; i++) {
+            LogSegment* segment = heads[i].segment;
+            if (segment == NULL || segment->isEmergencyHead ||
+                    segment->replicatedSegment->isAwaitingClose()) {
+                firstReplaced = 0;
+                numReplaced = numHeads;
+                break;
+            }
+        }
+
+        LogSegmentVector newHeads;
+        LogSegmentVector prevHeads;
+        LogSegmentVector keptHeads;
+        vector<uint32_t> keptLengths;
+        vector<SegmentCertificate> keptCertificates;
+        {
+            AllHeadsLock allHeads(this);
+            if (head != NULL && head->segment != expected)
+                return false;
+            if (!segmentManager->allocHeadSegments(numHeads, newHeads,
+                    prevHeads,
+                    mustNotFail ? SegmentManager::MUST_NOT_FAIL :
+                                  SegmentManager::EMPTY,
+                    firstReplaced, numReplaced)) {
+                checkNewHead(NULL);
+                return false;
+            }
+            checkNewHead(newHeads[0]);
+
+            for (uint32_t i = 0; i < numHeads; i++) {
+                if (newHeads[0]->isEmergencyHead) {
+                    heads[i].segment = newHeads[0];
+                } else if (heads[i].segment != NULL &&
+                           std::find(prevHeads.begin(), prevHeads.end(),
+                                     heads[i].segment) == prevHeads.end()) {
+                    LogSegment* kept = heads[i].segment;
+                    keptHeads.push_back(kept);
+                    keptCertificates.emplace_back();
+                    keptLengths.push_back(
+                        kept->getAppendedLength(&keptCertificates.back()));
+                }
+            }
+            foreach (LogSegment* newHead, newHeads) {
+                if (!newHead->isEmergencyHead)
+                    heads[newHead->headIndex].segment = newHead;
+            }
+            if (position != NULL) {
+                *position = LogPosition(newHeads[0]->id,
+                                        newHeads[0]->getAppendedLength());
+            }
+        }
+
+        // The lowest-numbered open head may be one that stayed open, in
+        // which case recovery uses the digest just appended to it.
+        for (size_t i = 0; i < keptHeads.size(); i++) {
+            keptHeads[i]->replicatedSegment->sync(keptLengths[i],
+                                                  &keptCertificates[i]);
+        }
+        bool lostOpenReplica =
+            segmentManager->closeHeadSegments(newHeads, prevHeads);
+
+        // A head that stayed open may have lost an open replica while its
+        // digest was being synced, or closing a previous head may have
+        // invalidated its open replicas. Either way, recovery could no longer
+        // rely on it, so close it too.
+        bool replaceAll = lostOpenReplica && !keptHeads.empty();
+        foreach (LogSegment* kept, keptHeads) {
+            if (kept->replicatedSegment->isAwaitingClose())
+                replaceAll = true;
+        }
+        if (!replaceAll)
+            return true;
+        head = NULL;
+        mustNotFail = true;
+    }
+}
+
+/**
+ * Wait until no thread is in the middle of replacing the log's heads (see
+ * replaceHeads()). Until then, recovery could use the digest of one of the
+ * previous heads, which doesn't name the new ones, so data appended to the
+ * new heads can't be considered durable yet, no matter how many backups
+ * hold it. Callers must not hold any appendLock.
+ */
+void
+Log::waitForHeadTransition()
+{
+    if (numHeads > 1) {
+        SpinLock::Guard _(transitionLock);
+    }
+}
+
 } // namespace
@@ -64,9 +64,17 @@ class ServerConfig;
  * explicitly invoke the sync() method to flush all previous appends to backups.
  *
  * This class is thread-safe. Multiple threads may invoke append() in parallel,
- * but all appends are serialized by a single SpinLock. The sync() method will
- * batch multiple append operations to backups to improve throughput, especially
- * when individual entries are small.
+ * but all appends to the same head segment are serialized by a SpinLock. By
+ * default the log has a single head; with ServerConfig::Master::numLogHeads
+ * set higher, threads append to several heads in parallel, which are replaced
+ * together when one fills up (see SegmentManager::allocHeadSegments()). If
+ * ServerConfig::Master::hotObjectSeconds is set, there is a second set of
+ * heads for data that callers expect to live long (see AbstractLog::append()),
+ * so that it fills segments of its own instead of sharing them with data
+ * that will soon be overwritten. Each of those is replaced only when it
+ * fills up itself. The sync() method will batch multiple append
+ * operations to backups to improve throughput, especially when individual
+ * entries are small.
  */
 class Log : public AbstractLog {
   public:
@@ -86,7 +94,37 @@ class Log : public AbstractLog {
     LogPosition rollHeadOver();
 
   PRIVATE:
+    /**
+     * Holds the appendLock of every head of a Log, acquired in index order,
+     * for as long as it exists. This is needed to replace the heads.
+     */
+    class AllHeadsLock {
+      public:
+        explicit AllHeadsLock(Log* log)
+            : log(log)
+        {
+            for (uint32_t i = 0; i < log->numHeads; i++)
+                log->heads[i].appendLock.lock();
+        }
+
+        ~AllHeadsLock()
+        {
+            for (uint32_t i = log->numHeads; i > 0; i--)
+                log->heads[i - 1].appendLock.unlock();
+        }
+
+      private:
+        Log* log;
+
+        DISALLOW_COPY_AND_ASSIGN(AllHeadsLock);
+    };
+
     LogSegment* allocNextSegment(bool mustNotFail);
+    bool allocNextHeads(Head& head, LogSegment* full);
+    bool replaceHeads(Head* head, LogSegment* expected, bool mustNotFail,
+                      LogPosition* position = NULL);
+    void waitForHeadTransition();
+    void sync(bool cold);
 
     INTRUSIVE_LIST_TYPEDEF(LogSegment, listEntries) SegmentList;
 
@@ -100,14 +138,11 @@ class Log : public AbstractLog {
     /// method.
     LogCleaner* cleaner;
 
-    /// Lock used to serialize calls to ReplicatedSegment::sync(). This both
-    /// protects the ReplicatedSegment from concurrent access and queues up
-    /// syncs in the log so that multiple appends can be flushed to backups
-    /// in the same RPC.
-    ///
-    /// If both this lock and the AbstractLog::appendLock need to be taken,
-    /// this one must be acquired first to avoid deadlock.
-    SpinLock syncLock;
+    /// Held by a thread while it replaces the heads of a log with several
+    /// of them, including while it waits for backups to make the new heads
+    /// durable and to close the previous ones (appends are only held up for
+    /// the first part). Syncs wait for it; see waitForHeadTransition().
+    SpinLock transitionLock;
 
     /// Various event counters and performance measurements taken during log
     /// operation.
@@ -15,6 +15,7 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <limits>
 
 #include "Common.h"
 #include "Fence.h"
@@ -63,6 +64,7 @@ LogCleaner::LogCleaner(Context* context,
       numThreads(config->master.cleanerThreadCount),
       segletSize(config->segletSize),
       segmentSize(config->segmentSize),
+      memoryPolicy(config->master.memoryPolicy),
       activeThreads(0),
       disableCount(0),
       cleanerIdle(),
@@ -100,6 +102,12 @@ LogCleaner::LogCleaner(Context* context,
     } else if (balancerArg.compare(0, 15, "tombstoneRatio:") == 0) {
         string ratio = balancerArg.substr(15);
         balancer = new TombstoneRatioBalancer(this, atof(ratio.c_str()));
+    } else if (balancerArg == "adaptive") {
+        balancer = new AdaptiveBalancer(this, 0);
+    } else if (balancerArg.compare(0, 9, "adaptive:") == 0) {
+        string limit = balancerArg.substr(9);
+        uint64_t maxBackupMBPerSecond = strtoul(limit.c_str(), NULL, 10);
+        balancer = new AdaptiveBalancer(this, maxBackupMBPerSecond << 20);
     } else {
         DIE("Unknown balancer specified: \"%s\"", balancerArg.c_str());
     }
@@ -201,6 +209,13 @@ LogCleaner::cleanerThreadEntry(LogCleaner* logCleaner, Context* context)
 
     CleanerThreadState state;
     state.threadNumber = __sync_fetch_and_add(&threadCnt, 1);
+
+    vector<int> nodes;
+    MemoryPolicy::getOnlineNodes(&nodes);
+    int node = logCleaner->getNodeForThread(state.threadNumber, nodes);
+    if (node >= 0 && MemoryPolicy::bindThreadToNode(node))
+        LOG(NOTICE, "LogCleaner thread pinned to NUMA node %d", node);
+
     try {
         while (1) {
             Fence::lfence();
@@ -213,9 +228,41 @@ LogCleaner::cleanerThreadEntry(LogCleaner* logCleaner, Context* context)
         DIE("Fatal error in cleaner thread: %s", e.what());
     }
 
+    PerfStats::unregisterStats(&PerfStats::threadStats);
     LOG(NOTICE, "LogCleaner thread stopping");
 }
 
+/**
+ * Decide which NUMA node a cleaner thread should run on, so that it copies
+ * seglets out of (and into) memory on its own socket. If the log's memory
+ * is on a single node, every thread goes there; if it's interleaved across
+ * nodes, the threads are spread over the nodes in the same way.
+ *
+ * \param threadNumber
+ *      Which cleaner thread is asking (0 for the first one started).
+ * \param nodes
+ *      The NUMA nodes that are online.
+ * \return
+ *      The node to pin the thread to, or -1 if the thread should stay
+ *      where it is: either there's only one node, or the policy already
+ *      restricted all threads to the log's node (see
+ *      MemoryPolicy::bindCurrentThread), or the log's node is unknown.
+ */
+int
+LogCleaner::getNodeForThread(uint32_t threadNumber, const vector<int>& nodes)
+{
+    if (nodes.size() < 2 || memoryPolicy.placement == MemoryPolicy::BIND)
+        return -1;
+
+    if (memoryPolicy.placement == MemoryPolicy::INTERLEAVE)
+        return nodes[threadNumber % nodes.size()];
+
+    // With the default policy the block was zeroed (and so placed) by the
+    // thread that created it, so its first page tells us where it all is.
+    return MemoryPolicy::getNode(
+            segmentManager.getAllocator().getBaseAddress());
+}
+
 int
 LogCleaner::getLiveObjectUtilization()
 {
@@ -295,9 +342,15 @@ LogCleaner::doWork(CleanerThreadState* state)
 }
 
 /**
- * Perform an in-memory cleaning pass. This takes a segment and compacts it,
+ * Perform an in-memory cleaning pass. This claims a batch of up to
+ * MAX_SEGMENTS_PER_COMPACTION_PASS segments and compacts each of them,
  * re-packing all live entries together sequentially, allowing us to reclaim
  * some of the dead space.
+ *
+ * Segments are claimed and their survivors allocated and handed back a whole
+ * batch at a time, so that concurrent cleaner threads work on disjoint
+ * segments and take the CleanableSegmentManager and SegmentManager locks
+ * once per batch rather than once per segment.
  */
 void
 LogCleaner::doMemoryCleaning()
@@ -309,28 +362,80 @@ LogCleaner::doMemoryCleaning()
     if (disableInMemoryCleaning)
         return;
 
-    LogSegment* segment = getSegmentToCompact();
-    if (segment == NULL)
+    LogSegmentVector segments;
+    getSegmentsToCompact(segments);
+    if (segments.empty())
         return;
 
     LogCleanerMetrics::InMemory<uint64_t> localMetrics;
 
+    // Allocate survivor segments to write into. The survivor reserve is
+    // one pool shared by all cleaner threads (including those cleaning on
+    // disk), so this may get fewer survivors than there are segments in the
+    // batch; the loop below falls back to allocating the rest one at a time.
+    LogSegmentVector survivors;
+    {
+        CycleCounter<uint64_t> waitTicks(
+            &localMetrics.waitForFreeSurvivorTicks);
+        segmentManager.allocSurvivorSegments(segments, survivors);
+    }
+
+    size_t completed = 0;
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (i == survivors.size()) {
+            // Out of survivors: hand back the segments compacted so far so
+            // their memory can be reused, then wait for another one. This
+            // call may block if one is not available right now.
+            completeCompaction(segments, survivors, completed, i);
+            completed = i;
+            CycleCounter<uint64_t> waitTicks(
+                &localMetrics.waitForFreeSurvivorTicks);
+            survivors.push_back(segmentManager.allocSideSegment(
+                SegmentManager::FOR_CLEANING | SegmentManager::MUST_NOT_FAIL,
+                segments[i]));
+        }
+        compactSegment(segments[i], survivors[i], &localMetrics);
+    }
+
+    // Merge our local metrics into the global aggregate counters.
+    inMemoryMetrics.merge(localMetrics);
+
+    // Also, maintain a few key statistics in PerfStats.
+    PerfStats::threadStats.compactorInputBytes +=
+            localMetrics.totalBytesInCompactedSegments;
+    PerfStats::threadStats.compactorSurvivorBytes +=
+            localMetrics.totalBytesAppendedToSurvivors;
+    PerfStats::threadStats.compactorActiveCycles +=
+            Cycles::rdtsc() - startTicks;
+
+    completeCompaction(segments, survivors, completed, segments.size());
+}
+
+/**
+ * Compact a single segment into a survivor segment; see doMemoryCleaning().
+ *
+ * \param segment
+ *      The segment to compact.
+ * \param survivor
+ *      A survivor segment allocated to replace \a segment, into which its
+ *      live entries are written.
+ * \param localMetrics
+ *      The calling thread's metrics for the current pass, which are updated
+ *      with the results.
+ */
+void
+LogCleaner::compactSegment(LogSegment* segment,
+                           LogSegment* survivor,
+                           LogCleanerMetrics::InMemory<uint64_t>* localMetrics)
+{
     // If the segment happens to be empty then there's no data to move.
     const bool empty = (segment->getLiveBytes() == 0);
     if (empty)
-        localMetrics.totalEmptySegmentsCompacted++;
-
-    // Allocate a survivor segment to write into. This call may block if one
-    // is not available right now.
-    CycleCounter<uint64_t> waitTicks(&localMetrics.waitForFreeSurvivorTicks);
-    LogSegment* survivor = segmentManager.allocSideSegment(
-            SegmentManager::FOR_CLEANING | SegmentManager::MUST_NOT_FAIL,
-            segment);
-    assert(survivor != NULL);
-    waitTicks.stop();
-
-    localMetrics.totalBytesInCompactedSegments +=
+        localMetrics->totalEmptySegmentsCompacted++;
+
+    localMetrics->totalBytesInCompactedSegments +=
         segment->getSegletsAllocated() * segletSize;
+    uint32_t liveScannedEntryCounts[TOTAL_LOG_ENTRY_TYPES] = { 0 };
     uint32_t liveScannedEntryTotalLengths[TOTAL_LOG_ENTRY_TYPES] = { 0 };
 
     // Take two passes, writing out the tombstones first. This makes the
@@ -353,18 +458,19 @@ LogCleaner::doMemoryCleaning()
                                           buffer,
                                           reference,
                                           survivor,
-                                          &localMetrics,
+                                          localMetrics,
                                           &bytesAppended);
             if (expect_false(s == RELOCATION_FAILED))
                 throw FatalError(HERE, "Entry didn't fit into survivor!");
 
-            localMetrics.totalEntriesScanned[type]++;
-            localMetrics.totalScannedEntryLengths[type] +=
+            localMetrics->totalEntriesScanned[type]++;
+            localMetrics->totalScannedEntryLengths[type] +=
                 buffer.size();
             if (expect_true(s == RELOCATED)) {
-                localMetrics.totalLiveEntriesScanned[type]++;
-                localMetrics.totalLiveScannedEntryLengths[type] +=
+                localMetrics->totalLiveEntriesScanned[type]++;
+                localMetrics->totalLiveScannedEntryLengths[type] +=
                     buffer.size();
+                liveScannedEntryCounts[type]++;
                 liveScannedEntryTotalLengths[type] += bytesAppended;
             }
         }
@@ -375,8 +481,8 @@ LogCleaner::doMemoryCleaning()
     // it avoids the expense of atomically updating those fields.
     for (size_t i = 0; i < TOTAL_LOG_ENTRY_TYPES; i++) {
         survivor->trackNewEntries(static_cast<LogEntryType>(i),
-                    downCast<uint32_t>(localMetrics.totalLiveEntriesScanned[i]),
-                    liveScannedEntryTotalLengths[i]);
+                                  liveScannedEntryCounts[i],
+                                  liveScannedEntryTotalLengths[i]);
     }
 
     survivor->close();
@@ -389,24 +495,39 @@ LogCleaner::doMemoryCleaning()
     if (freeSegletsGained == 0)
         balancer->compactionFailed();
     uint64_t bytesFreed = freeSegletsGained * segletSize;
-    localMetrics.totalBytesFreed += bytesFreed;
-    localMetrics.totalBytesAppendedToSurvivors +=
+    localMetrics->totalBytesFreed += bytesFreed;
+    localMetrics->totalBytesAppendedToSurvivors +=
         survivor->getAppendedLength();
-    localMetrics.totalSegmentsCompacted++;
-
-    // Merge our local metrics into the global aggregate counters.
-    inMemoryMetrics.merge(localMetrics);
-
-    // Also, maintain a few key statistics in PerfStats.
-    PerfStats::threadStats.compactorInputBytes +=
-            localMetrics.totalBytesInCompactedSegments;
-    PerfStats::threadStats.compactorSurvivorBytes +=
-            localMetrics.totalBytesAppendedToSurvivors;
-    PerfStats::threadStats.compactorActiveCycles +=
-            Cycles::rdtsc() - startTicks;
+    localMetrics->totalSegmentsCompacted++;
+}
 
-    AtomicCycleCounter __(&inMemoryMetrics.compactionCompleteTicks);
-    segmentManager.compactionComplete(segment, survivor);
+/**
+ * Hand a range of compacted segments and their survivors to the
+ * SegmentManager; see doMemoryCleaning().
+ *
+ * \param segments
+ *      The segments claimed for a compaction pass.
+ * \param survivors
+ *      Their survivors, in the same order.
+ * \param begin
+ *      Index of the first compacted segment to hand over.
+ * \param end
+ *      Index after the last compacted segment to hand over.
+ */
+void
+LogCleaner::completeCompaction(LogSegmentVector& segments,
+                               LogSegmentVector& survivors,
+                               size_t begin,
+                               size_t end)
+{
+    if (begin == end)
+        return;
+    LogSegmentVector oldSegments(segments.begin() + begin,
+                                 segments.begin() + end);
+    LogSegmentVector newSegments(survivors.begin() + begin,
+                                 survivors.begin() + end);
+    AtomicCycleCounter _(&inMemoryMetrics.compactionCompleteTicks);
+    segmentManager.compactionComplete(oldSegments, newSegments);
 }
 
 /**
@@ -505,17 +626,22 @@ LogCleaner::doDiskCleaning()
 }
 
 /**
- * Choose the best segment to clean in memory. We greedily choose the segment
+ * Choose the best segments to clean in memory. We greedily choose the segments
  * with the most freeable seglets. Care is taken to ensure that we determine the
- * number of freeable seglets that will keep the segment under our maximum
+ * number of freeable seglets that will keep each segment under our maximum
  * cleanable utilization after compaction. This ensures that we will always be
- * able to use the compacted version of this segment during disk cleaning.
+ * able to use the compacted version of a segment during disk cleaning.
+ *
+ * \param[out] outSegments
+ *      Up to MAX_SEGMENTS_PER_COMPACTION_PASS segments, which no other thread
+ *      will be given, are returned here.
  */
-LogSegment*
-LogCleaner::getSegmentToCompact()
+void
+LogCleaner::getSegmentsToCompact(LogSegmentVector& outSegments)
 {
     AtomicCycleCounter _(&inMemoryMetrics.getSegmentToCompactTicks);
-    return cleanableSegments.getSegmentToCompact();
+    cleanableSegments.getSegmentsToCompact(MAX_SEGMENTS_PER_COMPACTION_PASS,
+                                           outSegments);
 }
 
 /**
@@ -743,17 +869,27 @@ LogCleaner::closeSurvivor(LogSegment* survivor)
     assert(r);
 }
 
-bool
-LogCleaner::Balancer::isMemoryLow(CleanerThreadState* thread)
+/**
+ * Return the percentage of memory in use (including tombstones, dead objects,
+ * etc.) above which the first cleaner thread should start cleaning.
+ */
+int
+LogCleaner::Balancer::getMemoryThreshold()
 {
-    // T = Total % of memory in use (including tombstones, dead objects, etc).
     // L = Total % of memory in use by live objects.
-    const int T = cleaner->segmentManager.getMemoryUtilization();
     const int L = cleaner->cleanableSegments.getLiveObjectUtilization();
 
     // We need to clean if memory is low and there's space that could be
     // reclaimed. It's not worth cleaning if almost everything is alive.
-    int baseThreshold = std::max(90, (100 + L) / 2);
+    return std::max(90, (100 + L) / 2);
+}
+
+bool
+LogCleaner::Balancer::isMemoryLow(CleanerThreadState* thread)
+{
+    // T = Total % of memory in use (including tombstones, dead objects, etc).
+    const int T = cleaner->segmentManager.getMemoryUtilization();
+    int baseThreshold = getMemoryThreshold();
     if (T < baseThreshold)
         return false;
 
@@ -904,6 +1040,209 @@ LogCleaner::FixedBalancer::isDiskCleaningNeeded(CleanerThreadState* thread)
     return true;
 }
 
+/**
+ * Construct an AdaptiveBalancer.
+ *
+ * \param cleaner
+ *      The cleaner whose work is being balanced.
+ * \param maxBackupBytesPerSecond
+ *      If nonzero, disk cleaning is scaled back whenever it writes survivor
+ *      segments to backups faster than this, even if it is cheaper than
+ *      compaction. 0 means backup bandwidth is not limited.
+ */
+LogCleaner::AdaptiveBalancer::AdaptiveBalancer(LogCleaner* cleaner,
+                                               uint64_t maxBackupBytesPerSecond)
+    : Balancer(cleaner)
+    , maxBackupBytesPerSecond(maxBackupBytesPerSecond)
+    , lock("LogCleaner::AdaptiveBalancer::lock")
+    , lastUpdateTicks(Cycles::rdtsc())
+    , lastCompactionBytesCopied(0)
+    , lastCompactionBytesFreed(0)
+    , lastDiskBytesCopied(0)
+    , lastDiskBytesFreed(0)
+    , lastMemoryUtilization(cleaner->segmentManager.getMemoryUtilization())
+    , compactionWriteCost(0)
+    , diskWriteCost(0)
+    , diskCleaningPercentage(cleaner->disableInMemoryCleaning ?
+                             100 : INITIAL_DISK_CLEANING_PERCENTAGE)
+    , threadLimit(1)
+    , recentDiskTicks(0)
+    , recentMemoryTicks(0)
+    , seenDiskTicks(0)
+    , seenMemoryTicks(0)
+    , seenUpdateTicks(0)
+{
+    LOG(NOTICE, "Using adaptive balancer with %s backup bandwidth limit",
+        maxBackupBytesPerSecond == 0 ? "no" :
+        format("a %lu MB/s", maxBackupBytesPerSecond >> 20).c_str());
+}
+
+LogCleaner::AdaptiveBalancer::~AdaptiveBalancer()
+{
+}
+
+bool
+LogCleaner::AdaptiveBalancer::isDiskCleaningNeeded(CleanerThreadState* thread)
+{
+    update();
+
+    // See TombstoneRatioBalancer::isDiskCleaningNeeded for comments on this
+    // first handful of conditions.
+    if (thread->threadNumber != 0 && !cleaner->disableInMemoryCleaning)
+        return false;
+
+    if (cleaner->segmentManager.getSegmentUtilization() >= MIN_DISK_UTILIZATION)
+        return true;
+
+    if (!isMemoryLow(thread))
+        return false;
+
+    if (cleaner->disableInMemoryCleaning)
+        return true;
+
+    if (compactionFailures > compactionFailuresHandled) {
+        compactionFailuresHandled++;
+        return true;
+    }
+
+    // Only this thread gets here, so it alone maintains the recent ticks.
+    recentDiskTicks += thread->diskCleaningTicks - seenDiskTicks;
+    recentMemoryTicks += thread->memoryCompactionTicks - seenMemoryTicks;
+    seenDiskTicks = thread->diskCleaningTicks;
+    seenMemoryTicks = thread->memoryCompactionTicks;
+    uint64_t updateTicks = lastUpdateTicks;
+    if (updateTicks != seenUpdateTicks) {
+        seenUpdateTicks = updateTicks;
+        recentDiskTicks /= 2;
+        recentMemoryTicks /= 2;
+    }
+
+    uint64_t totalTicks = recentDiskTicks + recentMemoryTicks;
+    if (totalTicks == 0)
+        return diskCleaningPercentage > 0;
+    return 100 * recentDiskTicks / totalTicks < diskCleaningPercentage;
+}
+
+bool
+LogCleaner::AdaptiveBalancer::isMemoryLow(CleanerThreadState* thread)
+{
+    if (thread->threadNumber >= threadLimit)
+        return false;
+    return cleaner->segmentManager.getMemoryUtilization() >=
+           getMemoryThreshold();
+}
+
+/**
+ * Measure what the cleaner did since the last update and adjust the balance
+ * accordingly (see adjust()). Does nothing if the last update was less than
+ * UPDATE_INTERVAL_MS ago, or if another thread is updating already.
+ */
+void
+LogCleaner::AdaptiveBalancer::update()
+{
+    uint64_t now = Cycles::rdtsc();
+    if (Cycles::toNanoseconds(now - lastUpdateTicks) <
+            UPDATE_INTERVAL_MS * 1000000UL)
+        return;
+    if (!lock.try_lock())
+        return;
+    std::lock_guard<SpinLock> _(lock, std::adopt_lock);
+
+    // Survivor bytes are derived as in doDiskCleaning(); the disk cleaner's
+    // totalBytesAppendedToSurvivors isn't maintained.
+    LogCleanerMetrics::InMemory<>& inMemory = cleaner->inMemoryMetrics;
+    LogCleanerMetrics::OnDisk<>& onDisk = cleaner->onDiskMetrics;
+    uint64_t compactionBytesCopied = inMemory.totalBytesAppendedToSurvivors;
+    uint64_t compactionBytesFreed = inMemory.totalBytesFreed;
+    uint64_t diskBytesCopied = onDisk.totalDiskBytesInCleanedSegments -
+                               onDisk.totalDiskBytesFreed;
+    uint64_t diskBytesFreed = onDisk.totalMemoryBytesFreed;
+    int memoryUtilization = cleaner->segmentManager.getMemoryUtilization();
+
+    Sample sample;
+    sample.compactionBytesCopied =
+            compactionBytesCopied - lastCompactionBytesCopied;
+    sample.compactionBytesFreed = compactionBytesFreed -
+                                  lastCompactionBytesFreed;
+    sample.diskBytesCopied = diskBytesCopied - lastDiskBytesCopied;
+    sample.diskBytesFreed = diskBytesFreed - lastDiskBytesFreed;
+    sample.seconds = Cycles::toSeconds(now - lastUpdateTicks);
+    sample.memoryUtilizationChange = memoryUtilization - lastMemoryUtilization;
+    sample.memoryLow = memoryUtilization >= getMemoryThreshold();
+    adjust(sample);
+
+    lastCompactionBytesCopied = compactionBytesCopied;
+    lastCompactionBytesFreed = compactionBytesFreed;
+    lastDiskBytesCopied = diskBytesCopied;
+    lastDiskBytesFreed = diskBytesFreed;
+    lastMemoryUtilization = memoryUtilization;
+    lastUpdateTicks = now;
+}
+
+/**
+ * Adjust #diskCleaningPercentage and #threadLimit in light of what the
+ * cleaner did during the last update interval.
+ *
+ * \param sample
+ *      What the cleaner did.
+ */
+void
+LogCleaner::AdaptiveBalancer::adjust(const Sample& sample)
+{
+    // Remember the latest write cost of each kind of cleaning that ran. A
+    // pass that copied data without freeing any memory is infinitely
+    // expensive.
+    const double infinity = std::numeric_limits<double>::infinity();
+    if (sample.compactionBytesCopied != 0 || sample.compactionBytesFreed != 0) {
+        compactionWriteCost = sample.compactionBytesFreed == 0 ? infinity :
+                static_cast<double>(sample.compactionBytesCopied) /
+                static_cast<double>(sample.compactionBytesFreed);
+    }
+    if (sample.diskBytesCopied != 0 || sample.diskBytesFreed != 0) {
+        diskWriteCost = sample.diskBytesFreed == 0 ? infinity :
+                static_cast<double>(sample.diskBytesCopied) /
+                static_cast<double>(sample.diskBytesFreed);
+    }
+
+    // Shift time towards the cheaper kind of cleaning, unless disk cleaning
+    // is flooding the backups. Compaction gets more expensive as tombstones
+    // accumulate, and disk cleaning frees them, so this settles at a mix
+    // rather than running away to either end.
+    uint32_t percentage = diskCleaningPercentage;
+    double backupBytesPerSecond = sample.seconds == 0 ? 0 :
+            static_cast<double>(sample.diskBytesCopied) / sample.seconds;
+    if (cleaner->disableInMemoryCleaning) {
+        percentage = 100;
+    } else if (maxBackupBytesPerSecond != 0 &&
+            backupBytesPerSecond > static_cast<double>(
+            maxBackupBytesPerSecond)) {
+        percentage -= std::min(percentage, uint32_t(PERCENTAGE_STEP));
+    } else if (compactionWriteCost != 0 && diskWriteCost != 0) {
+        if (compactionWriteCost > diskWriteCost)
+            percentage = std::min(100U, percentage + PERCENTAGE_STEP);
+        else if (compactionWriteCost < diskWriteCost)
+            percentage -= std::min(percentage, uint32_t(PERCENTAGE_STEP));
+    } else if (compactionWriteCost == infinity) {
+        // Disk cleaning hasn't run yet, but compaction is getting nowhere.
+        percentage = std::min(100U, percentage + PERCENTAGE_STEP);
+    }
+    diskCleaningPercentage = percentage;
+
+    // Add a thread while memory keeps filling up despite the cleaning, and
+    // drop one once it no longer is.
+    uint32_t threads = threadLimit;
+    if (sample.memoryLow && sample.memoryUtilizationChange > 0) {
+        if (threads < static_cast<uint32_t>(cleaner->numThreads))
+            threads++;
+    } else if (!sample.memoryLow || sample.memoryUtilizationChange < 0) {
+        if (threads > 1)
+            threads--;
+    }
+    threadLimit = threads;
+
+    TEST_LOG("disk cleaning %u%%, %u threads", percentage, threads);
+}
+
 /**
  * Construct a Disabler object. Once the constructor returns, the caller
  * can be certain that no cleaner threads are running, or will run until
@@ -26,6 +26,7 @@
 #include "LogEntryHandlers.h"
 #include "LogEntryRelocator.h"
 #include "LogSegment.h"
+#include "MemoryPolicy.h"
 #include "SegmentManager.h"
 #include "ReplicaManager.h"
 
@@ -74,6 +75,14 @@ class LogCleaner {
     /// entries from candidate segments until it exceeds that product.
     enum { MAX_LIVE_SEGMENTS_PER_DISK_PASS = 10 };
 
+    /// The maximum number of segments a cleaner thread claims for each
+    /// in-memory cleaning pass. Claiming several at once lets concurrent
+    /// threads compact disjoint segments while taking the shared locks only
+    /// once per batch. A batch needs as many survivor segments as it has
+    /// segments; if the shared survivor reserve can't cover all of them, the
+    /// rest are compacted one at a time (see doMemoryCleaning()).
+    enum { MAX_SEGMENTS_PER_COMPACTION_PASS = 4 };
+
     /// The maximum in-memory segment utilization we will clean at. This upper
     /// limit, in conjunction with the number of seglets per segment, ensures
     /// that we can never consume more seglets in cleaning than we free.
@@ -190,7 +199,8 @@ class LogCleaner {
         void compactionFailed();
 
       PROTECTED:
-        bool isMemoryLow(CleanerThreadState* thread);
+        int getMemoryThreshold();
+        virtual bool isMemoryLow(CleanerThreadState* thread);
         virtual bool isDiskCleaningNeeded(CleanerThreadState* thread) = 0;
         LogCleaner* cleaner;
         std::atomic<uint64_t> compactionFailures;
@@ -220,15 +230,147 @@ class LogCleaner {
         const uint32_t cleaningPercentage;
     };
 
+    /**
+     * A balancer that tunes itself as the workload changes, rather than
+     * relying on a fixed ratio. Every UPDATE_INTERVAL_MS it measures what
+     * the cleaner has been doing: how many bytes compaction and disk cleaning
+     * each copied per byte of memory they freed (their write costs), how fast
+     * the disk cleaner wrote survivor segments to backups, and whether memory
+     * utilization rose or fell. It then shifts cleaner time towards whichever
+     * kind of cleaning is currently cheaper (unless disk cleaning is using
+     * more backup bandwidth than it is allowed), and adds cleaner threads
+     * while memory keeps filling up, removing them again once it doesn't.
+     */
+    class AdaptiveBalancer : public Balancer {
+      public:
+        AdaptiveBalancer(LogCleaner* cleaner,
+                         uint64_t maxBackupBytesPerSecond);
+        ~AdaptiveBalancer();
+
+      PRIVATE:
+        /// How often, in milliseconds, the balancer re-measures the cleaner
+        /// and adjusts #diskCleaningPercentage and #threadLimit.
+        enum { UPDATE_INTERVAL_MS = 100 };
+
+        /// How far #diskCleaningPercentage moves in one adjustment.
+        enum { PERCENTAGE_STEP = 5 };
+
+        /// Starting value of #diskCleaningPercentage.
+        enum { INITIAL_DISK_CLEANING_PERCENTAGE = 20 };
+
+        /**
+         * Cleaner activity during one update interval, computed by update()
+         * and acted upon by adjust().
+         */
+        struct Sample {
+            Sample()
+                : compactionBytesCopied(0)
+                , compactionBytesFreed(0)
+                , diskBytesCopied(0)
+                , diskBytesFreed(0)
+                , seconds(0)
+                , memoryUtilizationChange(0)
+                , memoryLow(false)
+            {}
+
+            /// Bytes of live data compaction copied into survivors.
+            uint64_t compactionBytesCopied;
+
+            /// Bytes of memory compaction freed.
+            uint64_t compactionBytesFreed;
+
+            /// Bytes of live data disk cleaning wrote to survivor segments
+            /// (and hence to backups).
+            uint64_t diskBytesCopied;
+
+            /// Bytes of memory disk cleaning freed.
+            uint64_t diskBytesFreed;
+
+            /// Length of the interval.
+            double seconds;
+
+            /// Percentage points by which memory utilization grew over the
+            /// interval (negative if it shrank).
+            int memoryUtilizationChange;
+
+            /// True if memory was low enough to need cleaning at the end of
+            /// the interval.
+            bool memoryLow;
+        };
+
+        bool isDiskCleaningNeeded(CleanerThreadState* thread);
+        bool isMemoryLow(CleanerThreadState* thread);
+        void update();
+        void adjust(const Sample& sample);
+
+        /// Copy of the constructor argument: if nonzero, the rate of survivor
+        /// bytes that disk cleaning may write before the balancer shifts
+        /// work to compaction regardless of write costs.
+        const uint64_t maxBackupBytesPerSecond;
+
+        /// Serializes update(). Threads that find it held skip the update,
+        /// since another thread is already doing it.
+        SpinLock lock;
+
+        /// Cycles::rdtsc() time of the last update().
+        std::atomic<uint64_t> lastUpdateTicks;
+
+        /// Values of the cleaner's metrics at the last update(), from which
+        /// the next update computes what happened in between.
+        uint64_t lastCompactionBytesCopied;
+        uint64_t lastCompactionBytesFreed;
+        uint64_t lastDiskBytesCopied;
+        uint64_t lastDiskBytesFreed;
+        int lastMemoryUtilization;
+
+        /// Most recently measured write costs (bytes copied per byte of
+        /// memory freed) of compaction and disk cleaning. 0 means that kind
+        /// of cleaning hasn't run yet; infinity means it ran but freed
+        /// nothing.
+        double compactionWriteCost;
+        double diskWriteCost;
+
+        /// Percentage of the first thread's cleaning time to spend on disk
+        /// cleaning rather than compaction. Other threads only compact.
+        std::atomic<uint32_t> diskCleaningPercentage;
+
+        /// Number of cleaner threads currently allowed to work. Threads
+        /// numbered at or above this sleep.
+        std::atomic<uint32_t> threadLimit;
+
+        /// Time the first thread recently spent cleaning on disk and
+        /// compacting. Both are halved at every update, so that the share
+        /// of disk cleaning follows #diskCleaningPercentage promptly when
+        /// that changes. Only used by the first thread, which is the only one
+        /// that cleans on disk.
+        uint64_t recentDiskTicks;
+        uint64_t recentMemoryTicks;
+
+        /// The first thread's CleanerThreadState::diskCleaningTicks and
+        /// memoryCompactionTicks when it last looked, and #lastUpdateTicks
+        /// then; used to maintain #recentDiskTicks and #recentMemoryTicks.
+        uint64_t seenDiskTicks;
+        uint64_t seenMemoryTicks;
+        uint64_t seenUpdateTicks;
+    };
+
     static void cleanerThreadEntry(LogCleaner* logCleaner, Context* context);
+    int getNodeForThread(uint32_t threadNumber, const vector<int>& nodes);
     int getLiveObjectUtilization();
     int getUndeadTombstoneUtilization();
     bool checkIfCleaningNeeded(CleanerThreadState* thread);
     bool checkIfDiskCleaningNeeded(CleanerThreadState* thread);
     void doWork(CleanerThreadState* state);
     void doMemoryCleaning();
+    void compactSegment(LogSegment* segment,
+                        LogSegment* survivor,
+                        LogCleanerMetrics::InMemory<uint64_t>* localMetrics);
+    void completeCompaction(LogSegmentVector& segments,
+                            LogSegmentVector& survivors,
+                            size_t begin,
+                            size_t end);
     void doDiskCleaning();
-    LogSegment* getSegmentToCompact();
+    void getSegmentsToCompact(LogSegmentVector& outSegments);
     void sortSegmentsByCostBenefit(LogSegmentVector& segments);
     void debugDumpSegments(LogSegmentVector& segments);
     void getSegmentsToClean(LogSegmentVector& outSegmentsToClean);
@@ -377,6 +519,11 @@ class LogCleaner {
     /// space freed on backup disks.
     uint32_t segmentSize;
 
+    /// How the log's seglets were placed across NUMA nodes. Cleaner threads
+    /// are pinned to the node(s) holding the seglets they'll be copying, so
+    /// that compaction doesn't pull every live object across sockets.
+    MemoryPolicy memoryPolicy;
+
     /// Total number of threads actively working (not just sleeping);
     /// used to implement Disablers.
     int activeThreads;
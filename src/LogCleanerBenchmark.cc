@@ -32,6 +32,7 @@
 #include "MasterService.h"
 #include "MasterClient.h"
 #include "MultiWrite.h"
+#include "MutationTrace.h"
 #include "OptionParser.h"
 #include "Object.h"
 #include "ObjectFinder.h"
@@ -65,7 +66,9 @@ class Options {
           minimumBenchmarkSeconds(0),
           distributionName(),
           tableName(),
+          traceFile(),
           outputFilesPrefix(),
+          phaseLength(0),
           doneWhenCleanerRuns(false)
     {
         for (int i = 0; i < argc; i++)
@@ -82,7 +85,9 @@ class Options {
     unsigned minimumBenchmarkSeconds;
     string distributionName;
     string tableName;
+    string traceFile;
     string outputFilesPrefix;
+    uint64_t phaseLength;
     bool doneWhenCleanerRuns;
 };
 
@@ -111,6 +116,18 @@ class Distribution {
     virtual uint32_t getObjectLength() = 0;
     virtual uint32_t getMaximumObjectLength() = 0;
 
+    /**
+     * Return true if the current key should be removed rather than written.
+     * Only trace replays remove objects.
+     */
+    virtual bool isRemove() { return false; }
+
+    /**
+     * Return true if the distribution has run out of objects. Only trace
+     * replays end; the others go on until the write cost converges.
+     */
+    virtual bool isDone() { return false; }
+
   PROTECTED:
     /**
      * Compute the number of distinct objects one would have to store to fill
@@ -415,6 +432,120 @@ class HotAndColdDistribution : public Distribution {
     DISALLOW_COPY_AND_ASSIGN(HotAndColdDistribution);
 };
 
+/**
+ * The phased distribution prefills the log like the uniform distribution and
+ * then alternates between a uniform phase and a hot-and-cold 90->10 phase
+ * every fixed number of writes. The two phases stress the cleaner quite
+ * differently (uniform overwrites leave little to compact cheaply, whereas
+ * hot-and-cold ones produce many nearly empty segments), so this is useful for
+ * seeing how well a cleaner balancer copes with a changing workload.
+ */
+class PhasedDistribution : public Distribution {
+  public:
+    /**
+     * \param logSize
+     *      Size of the target server's log in bytes.
+     * \param utilization
+     *      Desired utilization of live data in the server's log.
+     * \param objectLength
+     *      Size of each object to write.
+     * \param phaseLength
+     *      Number of objects to write in each phase after the prefill.
+     */
+    PhasedDistribution(uint64_t logSize,
+                       int utilization,
+                       uint32_t objectLength,
+                       uint64_t phaseLength)
+        : objectLength(objectLength),
+          maxObjectId(objectsNeeded(logSize, utilization, 8, objectLength)),
+          phaseLength(phaseLength),
+          objectCount(0),
+          key(0),
+          prefiller(maxObjectId)
+    {
+    }
+
+    bool
+    isPrefillDone()
+    {
+        return (objectCount >= maxObjectId);
+    }
+
+    /**
+     * Return true if the benchmark is in one of the hot-and-cold phases.
+     */
+    bool
+    isHotAndColdPhase()
+    {
+        return isPrefillDone() &&
+            ((objectCount - maxObjectId) / phaseLength) % 2 == 1;
+    }
+
+    void
+    advance()
+    {
+        if (!isPrefillDone()) {
+            key = prefiller.next();
+        } else if (!isHotAndColdPhase()) {
+            key = randomInteger(0, maxObjectId);
+        } else {
+            uint64_t maxHotObjectId = maxObjectId / 10;
+            if (randomInteger(0, 99) < 90)
+                key = randomInteger(0, maxHotObjectId - 1);
+            else
+                key = randomInteger(maxHotObjectId, maxObjectId);
+        }
+
+        objectCount++;
+    }
+
+    void
+    getKey(void* outKey)
+    {
+        *reinterpret_cast<uint64_t*>(outKey) = key;
+    }
+
+    uint16_t
+    getKeyLength()
+    {
+        return sizeof(key);
+    }
+
+    uint16_t
+    getMaximumKeyLength()
+    {
+        return sizeof(key);
+    }
+
+    void
+    getObject(void* outObject)
+    {
+        // Do nothing. Content doesn't matter.
+    }
+
+    uint32_t
+    getObjectLength()
+    {
+        return objectLength;
+    }
+
+    uint32_t
+    getMaximumObjectLength()
+    {
+        return objectLength;
+    }
+
+  PRIVATE:
+    uint32_t objectLength;
+    uint64_t maxObjectId;
+    uint64_t phaseLength;
+    uint64_t objectCount;
+    uint64_t key;
+    OutOfOrderSequence prefiller;
+
+    DISALLOW_COPY_AND_ASSIGN(PhasedDistribution);
+};
+
 /**
  * The Zipfian distribution generates an access pattern of high locality where
  * X% of accesses go to Y% of the data. Berk found that approximately 90% of
@@ -672,6 +803,118 @@ class ZipfianDistribution : public Distribution {
     DISALLOW_COPY_AND_ASSIGN(ZipfianDistribution);
 };
 
+/**
+ * The trace distribution replays a log mutation trace recorded by a master
+ * (see MutationTrace and the server's --mutationTrace option), so that the
+ * cleaner can be evaluated against a production workload's object size mix,
+ * overwrite skew, and deletes rather than a synthetic one.
+ *
+ * Records are replayed in order but as fast as possible; their timestamps
+ * are ignored. Each recorded (table, key hash) pair becomes a distinct key
+ * of the recorded length in the benchmark's table, and removes are issued
+ * as remove RPCs. The records before the trace's first overwrite or remove
+ * (normally the master being loaded) form the prefill phase; the benchmark
+ * phase ends with the trace, not when the write cost converges.
+ */
+class TraceDistribution : public Distribution {
+  public:
+    explicit TraceDistribution(const string& traceFile)
+        : reader(traceFile),
+          record(),
+          prefillDone(false),
+          done(false),
+          maximumKeyLength(sizeof(uint64_t)),
+          maximumObjectLength(0)
+    {
+        advance();
+    }
+
+    bool
+    isPrefillDone()
+    {
+        return prefillDone;
+    }
+
+    bool
+    isDone()
+    {
+        return done;
+    }
+
+    bool
+    isRemove()
+    {
+        return record.type == MutationTrace::REMOVE;
+    }
+
+    void
+    advance()
+    {
+        if (!reader.next(&record)) {
+            done = prefillDone = true;
+            return;
+        }
+        if (record.type != MutationTrace::WRITE)
+            prefillDone = true;
+        maximumKeyLength = std::max(maximumKeyLength, getKeyLength());
+        maximumObjectLength = std::max(maximumObjectLength,
+                                       getObjectLength());
+    }
+
+    void
+    getKey(void* outKey)
+    {
+        // Tables are folded into the key so that keys from different tables
+        // with the same hash don't collide.
+        uint64_t key = record.keyHash ^
+                       (record.tableId * 0x9e3779b97f4a7c15UL);
+        memset(outKey, 0, getKeyLength());
+        memcpy(outKey, &key, sizeof(key));
+    }
+
+    uint16_t
+    getKeyLength()
+    {
+        // Keys shorter than a hash can't keep traced objects distinct.
+        uint16_t keyLength = record.keyLength;
+        return std::max(keyLength, static_cast<uint16_t>(sizeof(uint64_t)));
+    }
+
+    uint16_t
+    getMaximumKeyLength()
+    {
+        return maximumKeyLength;
+    }
+
+    void
+    getObject(void* outObject)
+    {
+        // Do nothing. Content doesn't matter.
+    }
+
+    uint32_t
+    getObjectLength()
+    {
+        return record.valueLength;
+    }
+
+    uint32_t
+    getMaximumObjectLength()
+    {
+        return maximumObjectLength;
+    }
+
+  PRIVATE:
+    MutationTrace::Reader reader;
+    MutationTrace::Record record;
+    bool prefillDone;
+    bool done;
+    uint16_t maximumKeyLength;
+    uint32_t maximumObjectLength;
+
+    DISALLOW_COPY_AND_ASSIGN(TraceDistribution);
+};
+
 class Benchmark;
 
 /**
@@ -704,7 +947,9 @@ class Output {
                                string& masterLocator,
                                uint64_t objects,
                                uint64_t bytes,
-                               uint64_t ticks);
+                               uint64_t ticks,
+                               FILE* timelineFile = NULL,
+                               uint64_t timelineTicks = 0);
 
   PRIVATE:
     template<typename T>
@@ -784,7 +1029,8 @@ class Benchmark {
           prefillLogMetrics(),
           finalLogMetrics(),
           prefillClusterMetrics(),
-          benchmarkClusterMetrics()
+          benchmarkClusterMetrics(),
+          timelineFile(NULL)
     {
     }
 
@@ -845,13 +1091,17 @@ class Benchmark {
                                                 serverLocator,
                                                 totalPrefillObjectsWritten,
                                                 totalPrefillBytesWritten,
+                                                Cycles::rdtsc() - prefillStart,
+                                                timelineFile,
                                                 Cycles::rdtsc() - prefillStart);
             } else {
                 cleanerRan = Output::updateLiveLine(ramcloud,
                                              serverLocator,
                                              totalObjectsWritten,
                                              totalBytesWritten,
-                                             Cycles::rdtsc() - start);
+                                             Cycles::rdtsc() - start,
+                                             timelineFile,
+                                             Cycles::rdtsc() - prefillStart);
             }
 
             lastOutputUpdateTsc = Cycles::rdtsc();
@@ -867,7 +1117,8 @@ class Benchmark {
      *
      * If the write consists of only one RPC, it will be sent in a normal
      * WriteRpc request. Otherwise MultiWrite will be used to send multiple
-     * writes at once.
+     * writes at once. Removes (which only trace replays issue) are always
+     * sent on their own in a RemoveRpc.
      *
      * Note: This class does too much dynamic memory allocation.
      */
@@ -893,6 +1144,8 @@ class Benchmark {
             , ticks()
             , rpc()
             , multiRpc()
+            , removeRpc()
+            , remove(false)
             , writes()
             , multiWriteObjs()
             , keys()
@@ -908,6 +1161,9 @@ class Benchmark {
             if (multiRpc)
                 multiRpc.destroy();
 
+            if (removeRpc)
+                removeRpc.destroy();
+
             for (size_t i = 0; i < keys.size(); i++)
                 delete[] keys[i];
 
@@ -929,6 +1185,7 @@ class Benchmark {
 
             distribution->getKey(keys.back());
             distribution->getObject(objects.back());
+            remove = distribution->isRemove();
 
             writes.push_back({ tableId,
                                keys.back(), keyLength,
@@ -940,9 +1197,20 @@ class Benchmark {
         void
         start()
         {
-            assert(!rpc && !multiRpc);
+            assert(!rpc && !multiRpc && !removeRpc);
             assert(!writes.empty());
 
+            // RemoveRpc case
+            if (remove) {
+                assert(writes.size() == 1);
+                ticks.construct();
+                removeRpc.construct(ramcloud,
+                                    writes[0].tableId,
+                                    writes[0].key,
+                                    writes[0].keyLength);
+                return;
+            }
+
             // single WriteRpc case
             if (writes.size() == 1) {
                 ticks.construct();
@@ -981,6 +1249,8 @@ class Benchmark {
                 assert(!rpc);
                 return multiRpc->isReady();
             }
+            if (removeRpc)
+                return removeRpc->isReady();
             return false;
         }
 
@@ -995,12 +1265,24 @@ class Benchmark {
         uint64_t
         getObjectCount()
         {
-            return writes.size();
+            return remove ? 0 : writes.size();
+        }
+
+        /**
+         * Return true if this is a remove, which can't be batched with any
+         * other operations.
+         */
+        bool
+        isRemove()
+        {
+            return remove;
         }
 
         uint64_t
         getObjectLengths()
         {
+            if (remove)
+                return 0;
             uint64_t sum = 0;
             for (size_t i = 0; i < writes.size(); i++)
                 sum += writes[i].objectLength;
@@ -1012,6 +1294,8 @@ class Benchmark {
         Tub<CycleCounter<uint64_t>> ticks;
         Tub<WriteRpc> rpc;
         Tub<MultiWrite> multiRpc;
+        Tub<RemoveRpc> removeRpc;
+        bool remove;
         vector<WriteData> writes;
         vector<MultiWriteObject*> multiWriteObjs;
         vector<uint8_t*> keys;
@@ -1042,7 +1326,8 @@ class Benchmark {
             // While any RPCs can still be sent, send them.
             bool allRpcsSent = false;
             for (int i = 0; i < options.pipelinedRpcs; i++) {
-                allRpcsSent = prefilling ? distribution.isPrefillDone() : false;
+                allRpcsSent = prefilling ? distribution.isPrefillDone() :
+                                           distribution.isDone();
                 if (allRpcsSent)
                     break;
 
@@ -1053,9 +1338,12 @@ class Benchmark {
                 bool outOfObjects = false;
                 for (int cnt = 0;
                   cnt < options.objectsPerRpc && !outOfObjects; cnt++) {
+                    if (cnt > 0 && distribution.isRemove())
+                        break;
                     rpcs[i]->addObject(tableId, &distribution);
                     outOfObjects = prefilling ?
-                        distribution.isPrefillDone() : false;
+                        distribution.isPrefillDone() : distribution.isDone();
+                    outOfObjects |= rpcs[i]->isRemove();
                 }
 
                 rpcs[i]->start();
@@ -1115,8 +1403,10 @@ class Benchmark {
                 isDone = true;
 
             // If we're not prefilling, we're done once the write cost has
-            // stabilized.
-            if (!prefilling && writeCostHasConverged())
+            // stabilized (unless we're replaying a trace, which ends when
+            // the trace does).
+            if (!prefilling && options.traceFile.empty() &&
+              writeCostHasConverged())
                 isDone = true;
         }
     }
@@ -1285,6 +1575,11 @@ class Benchmark {
     /// This contains generic metrics data on all servers in the system.
     ClusterMetrics benchmarkClusterMetrics;
 
+    /// If not NULL, the live statistics are also appended to this file each
+    /// time they're updated, so that write costs, cleaner CPU time, and
+    /// memory utilization can be plotted over the course of the run.
+    FILE* timelineFile;
+
   PRIVATE:
 
     /// Let the output class poke around inside to extract what it needs.
@@ -1392,6 +1687,12 @@ Output::dumpSummary(FILE* fp)
     fprintf(fp, "  Total Log Bytes Written:       %lu  (%.2f MB/sec)\n",
         bytesAppended, d(bytesAppended) / elapsed / 1024 / 1024);
 
+    uint64_t coldBytesAppended =
+        benchmark.finalLogMetrics.total_cold_bytes_appended() -
+        benchmark.prefillLogMetrics.total_cold_bytes_appended();
+    fprintf(fp, "  Cold Head Bytes Written:       %lu  (%.2f%%)\n",
+        coldBytesAppended, 100.0 * d(coldBytesAppended) / d(bytesAppended));
+
     fprintf(fp, "  Average Latency:               %lu us / RPC (end-to-end, "
         "including queueing delays)\n",
         benchmark.latencyHistogram.getAverage() / 1000);
@@ -1576,7 +1877,9 @@ Output::updateLiveLine(RamCloud& ramcloud,
                        string& masterLocator,
                        uint64_t objects,
                        uint64_t bytes,
-                       uint64_t ticks)
+                       uint64_t ticks,
+                       FILE* timelineFile,
+                       uint64_t timelineTicks)
 {
     ProtoBuf::LogMetrics logMetrics;
     ramcloud.getLogMetrics(masterLocator.c_str(), logMetrics);
@@ -1600,6 +1903,28 @@ Output::updateLiveLine(RamCloud& ramcloud,
         logMetrics.cleaner_metrics().in_memory_metrics();
     uint64_t memWrote = inMemoryMetrics.total_bytes_appended_to_survivors();
 
+    if (timelineFile != NULL) {
+        uint64_t memFreed = inMemoryMetrics.total_bytes_freed();
+        double memoryWriteCost = d(memFreed + memWrote) / d(memFreed);
+        double cleanerSeconds = d(onDiskMetrics.total_ticks() +
+                                  inMemoryMetrics.total_ticks()) /
+                                logMetrics.ticks_per_second();
+        const ProtoBuf::LogMetrics_SegletMetrics& segletMetrics =
+            logMetrics.seglet_metrics();
+        double memoryUtilization = 100.0 *
+            d(segletMetrics.total_usable_seglets() -
+              segletMetrics.default_pool_count()) /
+            d(segletMetrics.total_usable_seglets());
+        fprintf(timelineFile, "%9.1f %12lu %12.2f %8.3f %8.3f %10.2f %6.2f\n",
+            Cycles::toSeconds(timelineTicks),
+            objects,
+            d(bytes) / 1024 / 1024,
+            diskWriteCost,
+            memoryWriteCost,
+            cleanerSeconds,
+            memoryUtilization);
+    }
+
     // Return true if either cleaner has ever run. If not, false.
     return memWrote != 0 || wrote != 0;
 }
@@ -1677,7 +2002,15 @@ try
          ProgramOptions::value<string>(&options.distributionName)->
            default_value("uniform"),
          "Object distribution; choose one of \"uniform\", "
-         "\"hotAndCold\", or \"zipfian\"")
+         "\"hotAndCold\", \"zipfian\", \"phased\" (alternate between "
+         "uniform and hotAndCold every --phaseLength objects), or \"trace\" "
+         "(replay the file given by --traceFile)")
+        ("phaseLength",
+         ProgramOptions::value<uint64_t>(&options.phaseLength)->
+           default_value(10 * 1000 * 1000),
+         "Number of objects written in each phase of the \"phased\" "
+         "distribution. Run the master with --cleanerBalancer adaptive to "
+         "see the cleaner rebalance itself at each phase change.")
         ("minimumBenchmarkSeconds,m",
          ProgramOptions::value<unsigned>(&options.minimumBenchmarkSeconds)->
             default_value(600),
@@ -1687,6 +2020,12 @@ try
          "throughput is skewed too high. A real fix would be to reset counters "
          "once we've converged, and then measure for another X seconds to take "
          "whatever ``steady-state'' measurements we want.")
+        ("traceFile",
+         ProgramOptions::value<string>(&options.traceFile)->
+           default_value(""),
+         "Log mutation trace to replay with the \"trace\" distribution, as "
+         "recorded by a master started with --mutationTrace. The size and "
+         "utilization options are ignored; the trace determines both.")
         ("outputFilesPrefix,O",
          ProgramOptions::value<string>(&options.outputFilesPrefix)->
            default_value(""),
@@ -1694,7 +2033,8 @@ try
          "distributions, and raw protocol buffer data will be dumped to "
          "after the benchmark completes. This program will append \"-m.txt\" "
          ", \"-l.txt\", and \"-rp.txt/-rb.txt\" prefixes for metrics, latency, "
-         "and raw prefill/benchmark files.")
+         "and raw prefill/benchmark files, and \"-t.txt\" for a timeline of "
+         "write costs, cleaner CPU time, and memory utilization.")
         ("objectsPerRpc,o",
          ProgramOptions::value<int>(&options.objectsPerRpc)->default_value(75),
          "Number of objects to write for each RPC sent to the server. If 1, "
@@ -1746,9 +2086,20 @@ try
     }
     if (options.distributionName != "uniform" &&
       options.distributionName != "hotAndCold" &&
-      options.distributionName != "zipfian") {
+      options.distributionName != "zipfian" &&
+      options.distributionName != "phased" &&
+      options.distributionName != "trace") {
         fprintf(stderr, "ERROR: Distribution must be one of \"uniform\", "
-            "\"hotAndCold\", or \"zipfian\"\n");
+            "\"hotAndCold\", \"zipfian\", \"phased\", or \"trace\"\n");
+        exit(1);
+    }
+    if (options.phaseLength < 1) {
+        fprintf(stderr, "ERROR: phaseLength must be >= 1\n");
+        exit(1);
+    }
+    if ((options.distributionName == "trace") == options.traceFile.empty()) {
+        fprintf(stderr, "ERROR: traceFile must be given with, and only "
+            "with, the \"trace\" distribution\n");
         exit(1);
     }
     if (options.objectSize < 1 || options.objectSize > MAX_OBJECT_SIZE) {
@@ -1773,6 +2124,7 @@ try
     FILE* diskHistAllFile = NULL;
     FILE* clusterMetricsPrefillFile = NULL;
     FILE* clusterMetricsBenchFile = NULL;
+    FILE* timelineFile = NULL;
 
     if (options.outputFilesPrefix != "") {
         string& outPrefix = options.outputFilesPrefix;
@@ -1784,6 +2136,7 @@ try
         string diskHistAllFilename = outPrefix + "-dha.txt";
         string clusterMetricsPrefillFilename = outPrefix + "-cmp.txt";
         string clusterMetricsBenchFilename = outPrefix + "-cmb.txt";
+        string timelineFilename = outPrefix + "-t.txt";
 
         if (fileExists(metricsFilename) ||
           fileExists(latencyFilename) ||
@@ -1792,10 +2145,11 @@ try
           fileExists(diskHistCleanedFilename) ||
           fileExists(diskHistAllFilename) ||
           fileExists(clusterMetricsPrefillFilename) ||
-          fileExists(clusterMetricsBenchFilename)) {
+          fileExists(clusterMetricsBenchFilename) ||
+          fileExists(timelineFilename)) {
             fprintf(stderr,
-                "One or more output files (%s, %s, %s, %s, %s, %s, %s or %s) "
-                "already exist!\n",
+                "One or more output files (%s, %s, %s, %s, %s, %s, %s, %s "
+                "or %s) already exist!\n",
                 metricsFilename.c_str(),
                 latencyFilename.c_str(),
                 rawPrefillFilename.c_str(),
@@ -1803,7 +2157,8 @@ try
                 diskHistCleanedFilename.c_str(),
                 diskHistAllFilename.c_str(),
                 clusterMetricsPrefillFilename.c_str(),
-                clusterMetricsBenchFilename.c_str());
+                clusterMetricsBenchFilename.c_str(),
+                timelineFilename.c_str());
             exit(1);
         }
 
@@ -1817,6 +2172,9 @@ try
             fopen(clusterMetricsPrefillFilename.c_str(), "w");
         clusterMetricsBenchFile =
             fopen(clusterMetricsBenchFilename.c_str(), "w");
+        timelineFile = fopen(timelineFilename.c_str(), "w");
+        fprintf(timelineFile, "# seconds      objects    objectMB   diskWC "
+            "   memWC cleanerSec  memUtil\n");
     }
 
     // Set an alarm to abort this in case we can't connect.
@@ -1871,6 +2229,13 @@ try
                                                options.objectSize,
                                                90, 15);
         alarm(options.abortTimeout);
+    } else if (options.distributionName == "phased") {
+        distribution = new PhasedDistribution(logSize,
+                                              options.utilization,
+                                              options.objectSize,
+                                              options.phaseLength);
+    } else if (options.distributionName == "trace") {
+        distribution = new TraceDistribution(options.traceFile);
     } else {
         assert(0);
     }
@@ -1880,6 +2245,7 @@ try
                         locator,
                         *distribution,
                         options);
+    benchmark.timelineFile = timelineFile;
     setvbuf(stdout, NULL, _IONBF, 0);
     Output output(ramcloud, locator, serverConfig, benchmark);
     output.addFile(stdout);
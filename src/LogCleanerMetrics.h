@@ -167,9 +167,9 @@ class InMemory {
     /// In other words, the amount of live data.
     CounterType totalBytesAppendedToSurvivors;
 
-    /// Total number of times a segment has been compacted. Since the
-    /// doMemoryCleaning() method processes one segment per call, this also
-    /// implies the number of times it was called and did work.
+    /// Total number of times a segment has been compacted. The
+    /// doMemoryCleaning() method processes up to
+    /// LogCleaner::MAX_SEGMENTS_PER_COMPACTION_PASS segments per call.
     CounterType totalSegmentsCompacted;
 
     /// Number of segments compacted that were empty (no live data whatsoever).
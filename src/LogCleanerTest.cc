@@ -176,6 +176,31 @@ TEST_F(LogCleanerTest, constructor) {
     EXPECT_FALSE(cleaner3.disableInMemoryCleaning);
 }
 
+TEST_F(LogCleanerTest, constructor_adaptiveBalancer) {
+    SegletAllocator allocator2(serverConfig());
+    SegmentManager segmentManager2(&context, serverConfig(), &serverId,
+                                   allocator2, replicaManager,
+                                   &masterTableMetadata);
+    serverConfig()->master.cleanerBalancer = "adaptive";
+    LogCleaner cleaner2(&context, serverConfig(),
+                        segmentManager2, replicaManager, entryHandlers);
+    LogCleaner::AdaptiveBalancer* balancer =
+            dynamic_cast<LogCleaner::AdaptiveBalancer*>(cleaner2.balancer);
+    ASSERT_TRUE(balancer != NULL);
+    EXPECT_EQ(0U, balancer->maxBackupBytesPerSecond);
+
+    SegletAllocator allocator3(serverConfig());
+    SegmentManager segmentManager3(&context, serverConfig(), &serverId,
+                                   allocator3, replicaManager,
+                                   &masterTableMetadata);
+    serverConfig()->master.cleanerBalancer = "adaptive:100";
+    LogCleaner cleaner3(&context, serverConfig(),
+                        segmentManager3, replicaManager, entryHandlers);
+    balancer = dynamic_cast<LogCleaner::AdaptiveBalancer*>(cleaner3.balancer);
+    ASSERT_TRUE(balancer != NULL);
+    EXPECT_EQ(100U << 20, balancer->maxBackupBytesPerSecond);
+}
+
 TEST_F(LogCleanerTest, start) {
     TestLog::Enable _;
     cleaner.start();
@@ -287,8 +312,47 @@ TEST_F(LogCleanerTest, doWork_notifyConditionVariable) {
     thread.join();
 }
 
-// There are currently no meaningful tests for doMemoryCleaning;
-// please write some!
+TEST_F(LogCleanerTest, doMemoryCleaning_batch) {
+    cleaner.disableInMemoryCleaning = false;
+    LogSegment* first = segmentManager.allocHeadSegment();
+    clearLiveBytes(first);
+    LogSegment* second = segmentManager.allocHeadSegment();
+    clearLiveBytes(second);
+    segmentManager.allocHeadSegment(); // roll over
+    getNewCandidates();
+
+    TestLog::Enable _("compactionComplete", "allocSurvivorSegments", NULL);
+    cleaner.doMemoryCleaning();
+    EXPECT_EQ(2U, cleaner.inMemoryMetrics.totalSegmentsCompacted);
+    EXPECT_EQ(2U, cleaner.inMemoryMetrics.totalEmptySegmentsCompacted);
+    EXPECT_EQ(0U, cleaner.cleanableSegments.compactionCandidates.size());
+
+    // Both survivors were allocated, and both segments handed back, with
+    // a single trip into the SegmentManager each.
+    EXPECT_EQ("allocSurvivorSegments: id = 2 | "
+              "allocSurvivorSegments: id = 1 | "
+              "compactionComplete: Compaction used 2 seglets to free "
+              "256 seglets", TestLog::get());
+}
+
+TEST_F(LogCleanerTest, getNodeForThread) {
+    vector<int> nodes;
+    nodes.push_back(0);
+    EXPECT_EQ(-1, cleaner.getNodeForThread(0, nodes));
+
+    nodes.push_back(1);
+    cleaner.memoryPolicy = MemoryPolicy("interleave");
+    EXPECT_EQ(0, cleaner.getNodeForThread(0, nodes));
+    EXPECT_EQ(1, cleaner.getNodeForThread(1, nodes));
+    EXPECT_EQ(0, cleaner.getNodeForThread(2, nodes));
+
+    cleaner.memoryPolicy = MemoryPolicy("node=1");
+    EXPECT_EQ(-1, cleaner.getNodeForThread(0, nodes));
+
+    cleaner.memoryPolicy = MemoryPolicy();
+    EXPECT_EQ(MemoryPolicy::getNode(allocator.getBaseAddress()),
+              cleaner.getNodeForThread(3, nodes));
+}
 
 TEST_F(LogCleanerTest, doDiskCleaning) {
     // Not entirely sure what to check here. doDiskCleaning() mostly just
@@ -623,6 +687,108 @@ TEST_F(LogCleanerTest, relocateEntry) {
 }
 #endif
 
+TEST_F(LogCleanerTest, AdaptiveBalancer_adjust_writeCosts) {
+    cleaner.disableInMemoryCleaning = false;
+    LogCleaner::AdaptiveBalancer balancer(&cleaner, 0);
+    EXPECT_EQ(20U, balancer.diskCleaningPercentage);
+
+    // Nothing known about disk cleaning yet.
+    LogCleaner::AdaptiveBalancer::Sample sample;
+    sample.compactionBytesCopied = 50;
+    sample.compactionBytesFreed = 100;
+    sample.seconds = 0.1;
+    balancer.adjust(sample);
+    EXPECT_EQ(0.5, balancer.compactionWriteCost);
+    EXPECT_EQ(20U, balancer.diskCleaningPercentage);
+
+    // Disk cleaning is cheaper.
+    sample.diskBytesCopied = 10;
+    sample.diskBytesFreed = 100;
+    balancer.adjust(sample);
+    EXPECT_EQ(0.1, balancer.diskWriteCost);
+    EXPECT_EQ(25U, balancer.diskCleaningPercentage);
+
+    // Compaction freed nothing; only disk cleaning ran.
+    sample = {};
+    sample.compactionBytesCopied = 10;
+    balancer.adjust(sample);
+    EXPECT_EQ(std::numeric_limits<double>::infinity(),
+              balancer.compactionWriteCost);
+    EXPECT_EQ(30U, balancer.diskCleaningPercentage);
+
+    // Compaction is cheaper again.
+    sample = {};
+    sample.compactionBytesCopied = 1;
+    sample.compactionBytesFreed = 100;
+    balancer.diskCleaningPercentage = 3;
+    balancer.adjust(sample);
+    EXPECT_EQ(0U, balancer.diskCleaningPercentage);
+    balancer.adjust(sample);
+    EXPECT_EQ(0U, balancer.diskCleaningPercentage);
+}
+
+TEST_F(LogCleanerTest, AdaptiveBalancer_adjust_backupBandwidth) {
+    cleaner.disableInMemoryCleaning = false;
+    LogCleaner::AdaptiveBalancer balancer(&cleaner, 1000);
+    balancer.compactionWriteCost = 1.0;
+    balancer.diskWriteCost = 0.1;
+
+    LogCleaner::AdaptiveBalancer::Sample sample;
+    sample.diskBytesCopied = 100;
+    sample.diskBytesFreed = 1000;
+    sample.seconds = 0.1;
+    balancer.adjust(sample);
+    EXPECT_EQ(25U, balancer.diskCleaningPercentage);
+
+    sample.diskBytesCopied = 101;
+    balancer.adjust(sample);
+    EXPECT_EQ(20U, balancer.diskCleaningPercentage);
+}
+
+TEST_F(LogCleanerTest, AdaptiveBalancer_adjust_threads) {
+    // The fixture's cleaner already took its SegmentManager's survivor
+    // reserve, so this cleaner needs a SegmentManager of its own.
+    ServerConfig config = *serverConfig();
+    config.master.cleanerThreadCount = 2;
+    SegletAllocator twoThreadAllocator(&config);
+    SegmentManager twoThreadSegmentManager(&context, &config, &serverId,
+                                           twoThreadAllocator, replicaManager,
+                                           &masterTableMetadata);
+    LogCleaner twoThreadCleaner(&context, &config, twoThreadSegmentManager,
+                                replicaManager, entryHandlers);
+    LogCleaner::AdaptiveBalancer balancer(&twoThreadCleaner, 0);
+    EXPECT_EQ(100U, balancer.diskCleaningPercentage);
+    EXPECT_EQ(1U, balancer.threadLimit);
+
+    LogCleaner::AdaptiveBalancer::Sample sample;
+    sample.memoryLow = true;
+    sample.memoryUtilizationChange = 1;
+    balancer.adjust(sample);
+    EXPECT_EQ(2U, balancer.threadLimit);
+    balancer.adjust(sample);
+    EXPECT_EQ(2U, balancer.threadLimit);
+
+    // Holding steady while memory is low keeps the extra thread.
+    sample.memoryUtilizationChange = 0;
+    balancer.adjust(sample);
+    EXPECT_EQ(2U, balancer.threadLimit);
+
+    sample.memoryUtilizationChange = -1;
+    balancer.adjust(sample);
+    EXPECT_EQ(1U, balancer.threadLimit);
+    balancer.adjust(sample);
+    EXPECT_EQ(1U, balancer.threadLimit);
+    EXPECT_EQ(100U, balancer.diskCleaningPercentage);
+}
+
+TEST_F(LogCleanerTest, AdaptiveBalancer_isMemoryLow) {
+    LogCleaner::AdaptiveBalancer balancer(&cleaner, 0);
+    threadState.threadNumber = 1;
+    EXPECT_FALSE(balancer.isMemoryLow(&threadState));
+    threadState.threadNumber = 0;
+    EXPECT_FALSE(balancer.isMemoryLow(&threadState));
+}
+
 TEST_F(LogCleanerTest, Disabler_basics) {
     TestLog::Enable _;
     Tub<LogCleaner::Disabler> disabler1, disabler2;
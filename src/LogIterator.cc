@@ -48,7 +48,7 @@ LogIterator::LogIterator(Log& log)
       done(false),
       headReached(false)
 {
-    if (log.head == NULL) {
+    if (log.heads[0].segment == NULL) {
         // Log is empty; not sure this should ever happen in practice.
         done = true;
     }
@@ -77,8 +77,9 @@ LogIterator::next()
         // updates and given any operations in progress a chance to complete.
         // That means that all of the relevant entries are now present
         // in the log. Record the current log head position: it will
-        // define the end of the iteration.
-        lastSegment = log.head;
+        // define the end of the iteration. If the log has several heads,
+        // they are all included, so stop at the one with the highest id.
+        lastSegment = log.heads[log.numHeads - 1].segment;
         SegmentCertificate dummy;
         lastSegmentLength = lastSegment->getAppendedLength(&dummy);
 
@@ -120,8 +121,9 @@ LogIterator::next()
         }
     }
 
-    if (segmentList.back() == log.head) {
-        headReached = true;
+    for (uint32_t i = 0; i < log.numHeads; i++) {
+        if (segmentList.back() == log.heads[i].segment)
+            headReached = true;
     }
 
     LogSegment* nextSegment = segmentList.back();
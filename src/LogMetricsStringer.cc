@@ -539,6 +539,27 @@ LogMetricsStringer::getLogMetrics()
         onDisk,
         100 * static_cast<double>(onDisk) / static_cast<double>(logSegments));
 
+    if (logMetrics->has_hash_table_metrics()) {
+        const ProtoBuf::LogMetrics_HashTableMetrics& htm =
+            logMetrics->hash_table_metrics();
+        s += ls + format("  Hash Table Buckets:            %lu "
+            "(%.2f%% full, %lu entries)\n",
+            htm.num_buckets(), 100.0 * htm.load_factor(), htm.num_entries());
+        s += ls + format("    Overflow Cache Lines:        %lu\n",
+            htm.overflow_cache_lines());
+        s += ls + format("    Longest Chain:               %lu lines\n",
+            htm.longest_chain());
+        s += ls + format("    Resizes:                     %lu grows, "
+            "%lu shrinks, %.3f sec migrating\n",
+            htm.total_grows(), htm.total_shrinks(),
+            Cycles::toSeconds(htm.total_migration_ticks(), serverHz));
+        if (htm.resize_in_progress()) {
+            s += ls + format("    Resize In Progress:          %lu of %lu "
+                "buckets migrated\n",
+                htm.buckets_migrated(), htm.old_num_buckets());
+        }
+    }
+
     return s;
 }
 
@@ -84,6 +84,7 @@ class LogSegment : public Segment {
           segmentSize(segmentSize),
           creationTimestamp(creationTimestamp),
           isEmergencyHead(isEmergencyHead),
+          headIndex(0),
           cleanedEpoch(0),
           cachedCleaningCostBenefitScore(0),
           cachedCompactionCostBenefitScore(0),
@@ -247,6 +248,13 @@ class LogSegment : public Segment {
     /// that is expected to live longer.
     const bool isEmergencyHead;
 
+    /// If this segment was allocated as a head of a Log with more than one
+    /// head, the index of the head it was allocated for (see
+    /// SegmentManager::allocHeadSegments). Log::syncTo() uses this to find
+    /// the head whose replication covers an entry. Zero for all other
+    /// segments.
+    uint32_t headIndex;
+
     /// The epoch value when cleaning was completed on this segment. Once no
     /// more RPCs in the system exist with epochs less than or equal to this,
     /// there can be no more outstanding references into the segment and its
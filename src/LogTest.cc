@@ -18,6 +18,7 @@
 #include "Segment.h"
 #include "ServerRpcPool.h"
 #include "Log.h"
+#include "LogDigest.h"
 #include "LogEntryTypes.h"
 #include "Memory.h"
 #include "MockCluster.h"
@@ -75,6 +76,105 @@ class LogTest : public ::testing::Test {
     DISALLOW_COPY_AND_ASSIGN(LogTest);
 };
 
+/**
+ * Unit tests for a Log with several heads.
+ */
+class LogMultiHeadTest : public ::testing::Test {
+  public:
+    Context context;
+    ServerId serverId;
+    ServerList serverList;
+    ServerConfig serverConfig;
+    ReplicaManager replicaManager;
+    MasterTableMetadata masterTableMetadata;
+    SegletAllocator allocator;
+    SegmentManager segmentManager;
+    DoNothingHandlers entryHandlers;
+    Log l;
+
+    static ServerConfig
+    multiHeadConfig()
+    {
+        ServerConfig config = ServerConfig::forTesting();
+        config.master.numLogHeads = 3;
+        config.segletSize = config.segmentSize / 8;
+        return config;
+    }
+
+    explicit LogMultiHeadTest(ServerConfig config = multiHeadConfig())
+        : context(),
+          serverId(ServerId(57, 0)),
+          serverList(&context),
+          serverConfig(config),
+          replicaManager(&context, &serverId, 0, false, false),
+          masterTableMetadata(),
+          allocator(&serverConfig),
+          segmentManager(&context, &serverConfig, &serverId,
+                         allocator, replicaManager, &masterTableMetadata),
+          entryHandlers(),
+          l(&context, &serverConfig, &entryHandlers,
+            &segmentManager, &replicaManager)
+    {
+        l.sync();
+    }
+
+  private:
+    DISALLOW_COPY_AND_ASSIGN(LogMultiHeadTest);
+};
+
+class LogHotColdTest : public LogMultiHeadTest {
+  public:
+    static ServerConfig
+    hotColdConfig()
+    {
+        ServerConfig config = multiHeadConfig();
+        config.master.numLogHeads = 1;
+        config.master.hotObjectSeconds = 1;
+        return config;
+    }
+
+    LogHotColdTest()
+        : LogMultiHeadTest(hotColdConfig())
+    {
+    }
+
+    /// Return the ids named by the last log digest in \a segment, which is
+    /// the one recovery uses.
+    static vector<uint64_t>
+    latestDigest(LogSegment* segment)
+    {
+        vector<uint64_t> ids;
+        for (SegmentIterator it(*segment); !it.isDone(); it.next()) {
+            if (it.getType() != LOG_ENTRY_TYPE_LOGDIGEST)
+                continue;
+            Buffer buffer;
+            it.appendToBuffer(buffer);
+            LogDigest digest(buffer.getRange(0, buffer.size()),
+                             buffer.size());
+            ids.clear();
+            for (uint32_t i = 0; i < digest.size(); i++)
+                ids.push_back(digest[i]);
+        }
+        return ids;
+    }
+
+    /// Append cold (or hot) entries until the head they go to is replaced.
+    void
+    fillHead(bool cold)
+    {
+        Log::AppendVector append;
+        append.type = LOG_ENTRY_TYPE_OBJ;
+        char data[10000] = { 0 };
+        append.buffer.appendCopy(data, sizeof(data));
+        LogSegment* full = l.heads[cold ? 1 : 0].segment;
+        while (l.heads[cold ? 1 : 0].segment == full)
+            ASSERT_TRUE(l.append(&append, 1, cold));
+    }
+
+  private:
+    DISALLOW_COPY_AND_ASSIGN(LogHotColdTest);
+};
+
 /**
  * Unit tests for Log sync (especially syncTo).
  * Here, we build a mockCluster with a backup, and log has non-zero replica.
@@ -149,7 +249,7 @@ TEST_F(LogTest, constructor) {
                                    &masterTableMetadata);
     Log l2(&context, &serverConfig, &entryHandlers,
            &segmentManager2, &replicaManager);
-    EXPECT_EQ(static_cast<LogSegment*>(NULL), l2.head);
+    EXPECT_EQ(static_cast<LogSegment*>(NULL), l2.heads[0].segment);
     EXPECT_NE(static_cast<LogCleaner*>(NULL), l2.cleaner);
 }
 
@@ -196,7 +296,8 @@ TEST_F(LogTest, enableCleaner_and_disableCleaner) {
 
 TEST_F(LogTest, getHead) {
     EXPECT_EQ(l.getHead(),
-            LogPosition(l.head->id, l.head->getAppendedLength()));
+            LogPosition(l.heads[0].segment->id,
+                        l.heads[0].segment->getAppendedLength()));
     LogPosition oldPos = l.getHead();
     l.append(LOG_ENTRY_TYPE_OBJ, "hi", 2);
     EXPECT_LT(oldPos, l.getHead());
@@ -216,11 +317,13 @@ TEST_F(LogTest, sync) {
 
     TestLog::reset();
     l.append(LOG_ENTRY_TYPE_OBJ, "hi", 2);
-    EXPECT_NE(l.head->syncedLength, l.head->getAppendedLength());
+    EXPECT_NE(l.heads[0].segment->syncedLength,
+              l.heads[0].segment->getAppendedLength());
     l.sync();
     EXPECT_EQ("sync: syncing segment 1 to offset 84 | sync: log synced",
         TestLog::get());
-    EXPECT_EQ(l.head->syncedLength, l.head->getAppendedLength());
+    EXPECT_EQ(l.heads[0].segment->syncedLength,
+              l.heads[0].segment->getAppendedLength());
 
     TestLog::reset();
     l.sync();
@@ -231,8 +334,8 @@ TEST_F(LogTest, sync) {
     TestLog::reset();
     l.append(LOG_ENTRY_TYPE_OBJ, "hi", 2);
     {
-        SpinLock::Guard lock(l.appendLock);
-        l.allocNewWritableHead();
+        SpinLock::Guard lock(l.heads[0].appendLock);
+        l.allocNewWritableHead(l.heads[0]);
     }
     l.sync();
     EXPECT_EQ("sync: syncing segment 2 to offset 88 | sync: log synced",
@@ -250,15 +353,18 @@ TEST_F(LogSyncTest, syncTo) {
     TestLog::reset();
     Log::Reference reference, reference2;
     l->append(LOG_ENTRY_TYPE_OBJ, "hi", 2, &reference);
-    EXPECT_NE(l->head->syncedLength, l->head->getAppendedLength());
+    EXPECT_NE(l->heads[0].segment->syncedLength,
+              l->heads[0].segment->getAppendedLength());
     l->syncTo(reference);
     EXPECT_EQ("sync: syncing segment 1 to offset 84 | syncTo: log synced",
         TestLog::get());
-    EXPECT_EQ(l->head->syncedLength, l->head->getAppendedLength());
+    EXPECT_EQ(l->heads[0].segment->syncedLength,
+              l->heads[0].segment->getAppendedLength());
 
     TestLog::reset();
     l->append(LOG_ENTRY_TYPE_OBJ, "ho", 2, &reference2);
-    EXPECT_NE(l->head->syncedLength, l->head->getAppendedLength());
+    EXPECT_NE(l->heads[0].segment->syncedLength,
+              l->heads[0].segment->getAppendedLength());
     l->syncTo(reference);
     EXPECT_EQ("syncTo: sync not needed: entry is already replicated",
         TestLog::get());
@@ -266,8 +372,8 @@ TEST_F(LogSyncTest, syncTo) {
     // Test sync if preceding segment is not closed durably.
     TestLog::reset();
     {
-        SpinLock::Guard lock(l->appendLock);
-        l->allocNewWritableHead();
+        SpinLock::Guard lock(l->heads[0].appendLock);
+        l->allocNewWritableHead(l->heads[0]);
     }
     EXPECT_FALSE(l->getSegment(reference2)->closedCommitted);
     l->syncTo(reference2);
@@ -280,18 +386,183 @@ TEST_F(LogSyncTest, syncTo) {
 
 TEST_F(LogTest, rollHeadOver) {
     LogPosition oldPos = LogPosition(0, 0);
-    LogSegment* oldHead = l.head;
+    LogSegment* oldHead = l.heads[0].segment;
     EXPECT_LT(oldPos, l.rollHeadOver());
-    EXPECT_NE(oldHead, l.head);
+    EXPECT_NE(oldHead, l.heads[0].segment);
 
-    oldPos = LogPosition(l.head->id, l.head->getAppendedLength());
-    oldHead = l.head;
+    oldPos = LogPosition(l.heads[0].segment->id,
+                         l.heads[0].segment->getAppendedLength());
+    oldHead = l.heads[0].segment;
     EXPECT_LT(oldPos, l.rollHeadOver());
-    EXPECT_NE(oldHead, l.head);
+    EXPECT_NE(oldHead, l.heads[0].segment);
+}
+
+TEST_F(LogMultiHeadTest, sync_allocatesAllHeads) {
+    EXPECT_EQ(3U, l.numHeads);
+    for (uint32_t i = 0; i < 3; i++) {
+        EXPECT_EQ(i + 1, l.heads[i].segment->id);
+        EXPECT_EQ(i, l.heads[i].segment->headIndex);
+    }
+    EXPECT_EQ(LogPosition(1, l.heads[0].segment->getAppendedLength()),
+              l.getHead());
+}
+
+TEST_F(LogMultiHeadTest, append_replacesAllHeads) {
+    LogSegment* oldHeads[3];
+    for (uint32_t i = 0; i < 3; i++)
+        oldHeads[i] = l.heads[i].segment;
+
+    // This thread always appends to the same head; once that one fills, the
+    // whole group is replaced.
+    char data[10000] = { 0 };
+    Log::Reference reference;
+    uint32_t appends = 0;
+    while (l.heads[0].segment == oldHeads[0]) {
+        ASSERT_TRUE(l.append(LOG_ENTRY_TYPE_OBJ, data, sizeof(data),
+                             &reference));
+        appends++;
+    }
+    EXPECT_GT(appends, 10U);
+    for (uint32_t i = 0; i < 3; i++) {
+        EXPECT_EQ(i + 4, l.heads[i].segment->id);
+        EXPECT_TRUE(oldHeads[i]->closed);
+    }
+
+    // The heads that weren't full gave their unused seglets back.
+    EXPECT_EQ(1U, oldHeads[2]->getSegletsAllocated());
+
+    // The last entry went into a new head, and can be synced by reference.
+    LogSegment* segment = l.getSegment(reference);
+    EXPECT_EQ(segment, l.heads[segment->headIndex].segment);
+    l.syncTo(reference);
+    EXPECT_EQ(segment->syncedLength, segment->getAppendedLength());
+}
+
+TEST_F(LogHotColdTest, append_coldHeads) {
+    Log& log = l;
+    EXPECT_EQ(2U, log.numHeads);
+    EXPECT_EQ(1U, log.numColdHeads);
+
+    Log::AppendVector append;
+    append.type = LOG_ENTRY_TYPE_OBJ;
+    append.buffer.appendCopy("object", 6);
+    ASSERT_TRUE(log.append(&append, 1));
+    EXPECT_EQ(log.heads[0].segment, log.getSegment(append.reference));
+    EXPECT_EQ(0U, log.AbstractLog::metrics.totalColdBytesAppended);
+
+    LogSegment* cold = log.heads[1].segment;
+    uint32_t coldLength = cold->getAppendedLength();
+    ASSERT_TRUE(log.append(&append, 1, true));
+    EXPECT_EQ(cold, log.getSegment(append.reference));
+    EXPECT_EQ(cold->getAppendedLength() - coldLength,
+              log.AbstractLog::metrics.totalColdBytesAppended);
+
+    // sync() covers both of the calling thread's heads.
+    log.sync();
+    EXPECT_EQ(cold->getAppendedLength(), cold->syncedLength);
+    EXPECT_EQ(log.heads[0].segment->getAppendedLength(),
+              log.heads[0].segment->syncedLength);
+}
+
+TEST_F(LogHotColdTest, append_coldHeadsRecoverable) {
+    // Recovery takes the latest log digest of the lowest-numbered open head
+    // and replays everything up to the highest id it names, so that digest
+    // must name every open head, across each kind of head transition.
+    Log& log = l;
+    Log::AppendVector append;
+    append.type = LOG_ENTRY_TYPE_OBJ;
+    append.buffer.appendCopy("object", 6);
+    for (int i = 0; i < 3; i++) {
+        LogSegment* hot = log.heads[0].segment;
+        LogSegment* cold = log.heads[1].segment;
+        ASSERT_TRUE(log.append(&append, 1, true));
+        log.sync();
+        EXPECT_EQ(cold->getAppendedLength(), cold->syncedLength);
+
+        LogSegment* lowest = hot->id < cold->id ? hot : cold;
+        vector<uint64_t> ids = latestDigest(lowest);
+        ASSERT_FALSE(ids.empty());
+        EXPECT_NE(ids.end(), std::find(ids.begin(), ids.end(), hot->id));
+        EXPECT_NE(ids.end(), std::find(ids.begin(), ids.end(), cold->id));
+        EXPECT_EQ(std::max(hot->id, cold->id),
+                  *std::max_element(ids.begin(), ids.end()));
+
+        if (i == 0)
+            log.rollHeadOver();
+        else
+            fillHead(i == 2);
+    }
+}
+
+TEST_F(LogHotColdTest, append_hotHeadFullLeavesColdHeadOpen) {
+    Log& log = l;
+    LogSegment* hot = log.heads[0].segment;
+    LogSegment* cold = log.heads[1].segment;
+    fillHead(false);
+
+    LogSegment* newHot = log.heads[0].segment;
+    EXPECT_TRUE(hot->closed);
+    EXPECT_EQ(cold, log.heads[1].segment);
+    EXPECT_FALSE(cold->closed);
+    EXPECT_GT(newHot->id, cold->id);
+    EXPECT_EQ(2U, segmentManager.segmentsByState[SegmentManager::HEAD].size());
+
+    // The cold head is now the lowest-numbered open head, so the digest
+    // appended to it must name the new hot head, and be durable.
+    vector<uint64_t> ids = latestDigest(cold);
+    EXPECT_EQ(newHot->id, *std::max_element(ids.begin(), ids.end()));
+    EXPECT_EQ(latestDigest(newHot), ids);
+    EXPECT_EQ(cold->getAppendedLength(),
+              cold->replicatedSegment->getCommitted().bytes);
+
+    // A full cold head is likewise replaced on its own.
+    fillHead(true);
+    EXPECT_TRUE(cold->closed);
+    EXPECT_EQ(newHot, log.heads[0].segment);
+    EXPECT_FALSE(newHot->closed);
+    ids = latestDigest(newHot);
+    EXPECT_EQ(log.heads[1].segment->id,
+              *std::max_element(ids.begin(), ids.end()));
+}
+
+TEST_F(LogMultiHeadTest, rollHeadOver) {
+    LogSegment* oldHead = l.heads[2].segment;
+    EXPECT_EQ(LogPosition(4, l.heads[0].segment->getAppendedLength()),
+              l.rollHeadOver());
+    EXPECT_EQ(6U, l.heads[2].segment->id);
+    EXPECT_TRUE(oldHead->closed);
+    EXPECT_EQ(3U, segmentManager.segmentsByState[SegmentManager::HEAD].size());
+}
+
+TEST_F(LogMultiHeadTest, replaceHeads) {
+    // Another thread already replaced the heads.
+    LogSegment* head = l.heads[0].segment;
+    EXPECT_FALSE(l.replaceHeads(&l.heads[1], head, false));
+    EXPECT_EQ(head, l.heads[0].segment);
+
+    LogPosition position;
+    EXPECT_TRUE(l.replaceHeads(&l.heads[0], head, false, &position));
+    EXPECT_EQ(4U, l.heads[0].segment->id);
+    EXPECT_EQ(LogPosition(4, l.heads[0].segment->getAppendedLength()),
+              position);
+    EXPECT_TRUE(head->closed);
+
+    // The transition is over, so syncs needn't wait.
+    EXPECT_TRUE(l.transitionLock.try_lock());
+    l.transitionLock.unlock();
+
+    // Running out of memory is accounted for while every head is locked,
+    // not by the appender that found its head full.
+    while (segmentManager.allocSideSegment(0, NULL) != NULL) {
+        // eat up all free segments
+    }
+    EXPECT_FALSE(l.AbstractLog::metrics.noSpaceTimer);
+    l.replaceHeads(&l.heads[0], l.heads[0].segment, false);
+    EXPECT_TRUE(l.AbstractLog::metrics.noSpaceTimer);
 }
 
 TEST_F(LogTest, allocNextSegment) {
-    SpinLock::Guard _(l.appendLock);
+    SpinLock::Guard _(l.heads[0].appendLock);
 
     LogSegment* segment = segmentManager.allocSideSegment(0, NULL);
     EXPECT_NE(static_cast<LogSegment*>(NULL), segment);
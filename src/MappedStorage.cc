@@ -0,0 +1,819 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <immintrin.h>
+
+#include "MappedStorage.h"
+#include "BackupMasterRecovery.h"
+#include "Buffer.h"
+#include "ClientException.h"
+#include "CycleCounter.h"
+#include "ShortMacros.h"
+
+namespace RAMCloud {
+
+namespace {
+/// Round \a n up to a multiple of \a unit, which must be a power of two.
+size_t
+roundUpTo(size_t n, size_t unit)
+{
+    return (n + unit - 1) & ~(unit - 1);
+}
+
+/// Contents of each superblock image in the mapping.
+struct SuperblockImage {
+    SuperblockImage()
+        : superblock()
+        , checksum(0)
+    {
+    }
+    BackupStorage::Superblock superblock;
+    Crc32C::ResultType checksum;
+} __attribute__((packed));
+
+/// Write back the cache lines from \a line up to \a end with CLWB.
+__attribute__((target("clwb")))
+void
+writeBackClwb(uintptr_t line, uintptr_t end)
+{
+    for (; line < end; line += CACHE_LINE_SIZE)
+        _mm_clwb(reinterpret_cast<void*>(line));
+}
+
+/// Write back the cache lines from \a line up to \a end with CLFLUSHOPT.
+__attribute__((target("clflushopt")))
+void
+writeBackClflushopt(uintptr_t line, uintptr_t end)
+{
+    for (; line < end; line += CACHE_LINE_SIZE)
+        _mm_clflushopt(reinterpret_cast<void*>(line));
+}
+} // anonymous namespace
+
+MappedStorage::WriteBackInstruction MappedStorage::writeBackInstruction =
+    MappedStorage::detectWriteBackInstruction();
+
+// --- MappedStorage::Frame ---
+
+/**
+ * Create a Frame associated with a region of the mapping that may hold a
+ * replica. Only called when MappedStorage is constructed.
+ */
+MappedStorage::Frame::Frame(MappedStorage* storage, size_t frameIndex)
+    : storage(storage)
+    , frameIndex(frameIndex)
+    , data(storage->base + roundUpTo(2 * SUPERBLOCK_SIZE, getpagesize()) +
+           frameIndex * storage->frameStride)
+    , metadata(data + storage->segmentSize)
+    , isOpen(false)
+    , isClosed(false)
+    , sync(false)
+    , appendedToByCurrentProcess(false)
+    , appendedLength(0)
+    , dirty(false)
+    , loadRequested(false)
+{
+}
+
+/**
+ * Returns true if append has been called on this frame during the life of this
+ * process; returns false otherwise. This includes across free()/open() cycles.
+ * This is used by the backup replica garbage collector to determine whether it
+ * might have missed a BackupFree rpc from a master, in which case it has to
+ * query the master for the replica status. This is "appended to" rather than
+ * "opened by" because of benchmark(); benchmark "opens" replicas and loads them
+ * but doesn't do any. Masters open and append data in a single rpc, so this
+ * is a fine proxy.
+ */
+bool
+MappedStorage::Frame::wasAppendedToByCurrentProcess()
+{
+    return appendedToByCurrentProcess;
+}
+
+/**
+ * No-op for MappedStorage; the metadata is always read straight from the
+ * mapping.
+ */
+void
+MappedStorage::Frame::loadMetadata()
+{
+}
+
+/**
+ * Return a pointer to the most recently appended metadata for this frame,
+ * which is its copy in the mapping.
+ * Warning: Concurrent calls to append modify the metadata that the return
+ * of this method points to. In practice it should only be called when the
+ * frame isn't accepting appends (either it was just constructed or one of
+ * close, load, or free has already been called on it). Used only during
+ * backup restart and master recovery to extract details about the replica
+ * in this frame without loading the frame.
+ */
+const void*
+MappedStorage::Frame::getMetadata()
+{
+    return metadata;
+}
+
+/**
+ * Prevents any further append() calls from being accepted; there's nothing
+ * to load, since the replica is already in the mapping.
+ */
+void
+MappedStorage::Frame::startLoading()
+{
+    Lock lock(storage->mutex);
+    loadRequested = true;
+}
+
+/**
+ * Returns true once startLoading() or load() has been called; the replica
+ * is already in the mapping, so load() never waits to read it (though it
+ * may still flush appends that aren't durable yet). Always returns false
+ * if startLoading() or load() hasn't been called.
+ */
+bool
+MappedStorage::Frame::isLoaded()
+{
+    Lock lock(storage->mutex);
+    return loadRequested;
+}
+
+/**
+ * Return a pointer to the replica data (in the mapping) for recovery. Makes
+ * sure everything appended is durable first, so that recoveries only use
+ * durable data. Prevents any further append() calls from being accepted.
+ */
+void*
+MappedStorage::Frame::load()
+{
+    Lock lock(storage->mutex);
+    loadRequested = true;
+    syncIfDirty();
+    return data;
+}
+
+/**
+ * Has no effect for MappedStorage.
+ */
+void
+MappedStorage::Frame::unload()
+{
+}
+
+/**
+ * Append data to frame and update metadata by copying both directly into the
+ * mapping. If the frame was opened with sync (or the mapping is MAP_SYNC,
+ * which makes it cheap) the data is made durable before the metadata is
+ * written, so a crash never leaves metadata describing data that didn't make
+ * it, and both are durable when this returns. Otherwise both only become
+ * durable by close(), load(), or quiesce(), and until then the kernel may
+ * write the metadata back before the data; a replica caught that way fails
+ * its certificate check when read for recovery, like any other torn write.
+ *
+ * Idempotence: the caller must guarantee duplicated calls provide identical
+ * arguments.
+ *
+ * append() after a load() or a close() throws an exception to
+ * the master performing the append since it is either an error by the master
+ * or the master has crashed.
+ *
+ * \param source
+ *      Buffer contained the data to be copied into the frame.
+ * \param sourceOffset
+ *      Offset into \a source where data should be copied from.
+ * \param length
+ *      Bytes to copy to the frame starting at \a sourceOffset in \a source.
+ * \param destinationOffset
+ *      Offset into the frame where the source data should be copied.
+ * \param metadata
+ *      Metadata which should be written to storage immediately after the data
+ *      appended is written. May be NULL if there is no updated metadata to
+ *      commit to storage along with this data.
+ * \param metadataLength
+ *      Bytes of metadata pointed to by \a metadata. Ignored if \a metadata
+ *      is NULL.
+ */
+void
+MappedStorage::Frame::append(Buffer& source,
+                             size_t sourceOffset,
+                             size_t length,
+                             size_t destinationOffset,
+                             const void* metadata,
+                             size_t metadataLength)
+{
+    Lock lock(storage->mutex);
+    CycleCounter<uint64_t> ticks;
+    if (!isOpen) {
+        LOG(WARNING, "Tried to append to a frame but it wasn't "
+            "open on this backup; this can happen legitimately if a master's "
+            "rpc system retried a closing write rpc.");
+        throw BackupBadSegmentIdException(HERE);
+    }
+    if (loadRequested) {
+        LOG(NOTICE, "Tried to append to a frame but it was already enqueued "
+            "for load for recovery; calling master is probably already dead");
+        throw BackupBadSegmentIdException(HERE);
+    }
+    // Three conditions because overflow is possible on addition.
+    if (length > storage->segmentSize ||
+        destinationOffset > storage->segmentSize ||
+        length + destinationOffset > storage->segmentSize)
+    {
+        LOG(ERROR, "Out-of-bounds appended attempted on storage frame: "
+            "offset %lu, length %lu, segmentSize %lu ",
+            destinationOffset, length, storage->segmentSize);
+        throw BackupSegmentOverflowException(HERE);
+    }
+    if (metadataLength > METADATA_SIZE) {
+        LOG(ERROR, "Tried to append to a frame with metadata of length %lu "
+            "but storage only allows max length of %d",
+            metadataLength, METADATA_SIZE);
+        throw BackupSegmentOverflowException(HERE);
+    }
+
+    // Copy (and persist) with the lock held: otherwise a quiesce() could
+    // find the frame dirty, flush it, and mark it clean before the data
+    // landed, and close() would then skip the flush that makes it durable.
+    appendedToByCurrentProcess = true;
+    source.copy(downCast<uint32_t>(sourceOffset),
+                downCast<uint32_t>(length),
+                data + destinationOffset);
+    if ((destinationOffset + length) > appendedLength)
+        appendedLength = destinationOffset + length;
+    const bool persistNow = sync || storage->mapSync;
+    if (persistNow)
+        storage->persist(data + destinationOffset, length);
+    if (metadata) {
+        memcpy(this->metadata, metadata, metadataLength);
+        if (persistNow)
+            storage->persist(this->metadata, metadataLength);
+    }
+    if (!persistNow)
+        dirty = true;
+
+    lock.unlock();
+    storage->sleepToThrottleWrites(length + metadataLength, ticks.stop());
+}
+
+/**
+ * Mark this frame as closed, making sure everything appended to it is
+ * durable. Calls to close after a call to load() throw
+ * BackupBadSegmentIdException which should kill the calling master; in this
+ * case recovery has already started for them so they are likely already dead.
+ */
+void
+MappedStorage::Frame::close()
+{
+    Lock lock(storage->mutex);
+    if (isClosed)
+        return;
+    if (loadRequested) {
+        LOG(NOTICE, "Tried to close a frame but it was already enqueued "
+            "for load for recovery; calling master is probably already dead");
+        throw BackupBadSegmentIdException(HERE);
+    }
+    isOpen = false;
+    isClosed = true;
+    syncIfDirty();
+}
+
+// See BackupStorage.h for documentation.
+void
+MappedStorage::Frame::reopen(size_t length)
+{
+    // The frame could be open or closed depending on state when it crashed.
+    Lock _(storage->mutex);
+    appendedLength = length;
+    isOpen = true;
+    isClosed = false;
+    loadRequested = false;
+}
+
+/**
+ * Do not call; see BackupStorage::freeFrame().
+ * Make this frame available for reuse; data previously stored in this frame
+ * may or may not be part of future recoveries. It does not modify storage,
+ * only in-memory bookkeeping structures, so a previously freed frame will not
+ * be free on restart until higher-level backup code explicitly free them after
+ * it determines it is not needed.
+ */
+void
+MappedStorage::Frame::free()
+{
+    Lock lock(storage->mutex);
+    isOpen = false;
+    isClosed = false;
+    loadRequested = false;
+    appendedLength = 0;
+    dirty = false;
+    storage->freeMap[frameIndex] = 1;
+}
+
+// - private -
+
+/**
+ * Open the frame, resetting its state to accept appends for a new replica.
+ * Open is not synchronous itself. Even after return from open() if this
+ * backup crashes it may find the replica which was formerly stored in this
+ * frame or metadata for the former replica and data for the newly open replica.
+ * Recovery is expected to address these consistency issues with the checksums.
+ *
+ * Idempotence: Duplicate calls to open() are ignored until the frame is freed.
+ * Calling open() after the frame is freed will reset this frame for reuse
+ * with an new replica.
+ *
+ * \param sync
+ *      Only return from append() calls when all enqueued data and the most
+ *      recently enqueued metadata are durable on storage.
+ */
+void
+MappedStorage::Frame::open(bool sync)
+{
+    Lock _(storage->mutex);
+    if (isOpen || isClosed)
+        return;
+    isOpen = true;
+    isClosed = false;
+    this->sync = sync;
+    appendedLength = 0;
+    dirty = false;
+    loadRequested = false;
+    memset(metadata, '\0', METADATA_SIZE);
+}
+
+/**
+ * Make everything appended to this frame durable if some of it might not
+ * be. The caller must hold the lock on storage->mutex.
+ */
+void
+MappedStorage::Frame::syncIfDirty()
+{
+    if (!dirty)
+        return;
+    storage->persist(data, appendedLength);
+    storage->persist(metadata, METADATA_SIZE);
+    dirty = false;
+}
+
+// --- MappedStorage ---
+
+/**
+ * Create a MappedStorage, creating or extending the file as needed and
+ * mapping all of it.
+ *
+ * \param segmentSize
+ *      The size in bytes of the segments this storage will deal with.
+ * \param frameCount
+ *      The number of segments this storage can store simultaneously.
+ * \param writeRateLimit
+ *      When specified, writes to this storage instance should be
+ *      limited to at most the given rate (in megabytes per second).
+ *      The special value 0 turns off throttling.
+ * \param filePath
+ *      The file (or DAX device) to map. Ideally on a DAX filesystem over
+ *      persistent memory; see the class documentation.
+ * \throw BackupStorageException
+ *      If the file can't be opened, extended, or mapped.
+ */
+MappedStorage::MappedStorage(size_t segmentSize,
+                             size_t frameCount,
+                             size_t writeRateLimit,
+                             const char* filePath)
+    : BackupStorage(segmentSize, Type::PERSISTENT_MEMORY, writeRateLimit)
+    , mutex()
+    , fd(-1)
+    , base(NULL)
+    , mappingLength(0)
+    , frameStride(roundUpTo(segmentSize + METADATA_SIZE, getpagesize()))
+    , mapSync(false)
+    , superblock()
+    , lastSuperblockFrame(1)
+    , frames()
+    , frameCount(frameCount)
+    , freeMap(frameCount)
+    , lastAllocatedFrame(FreeMap::npos)
+{
+    mappingLength = roundUpTo(2 * SUPERBLOCK_SIZE, getpagesize()) +
+                    frameCount * frameStride;
+
+    fd = ::open(filePath, O_CREAT | O_RDWR, 0666);
+    if (fd == -1) {
+        int e = errno;
+        LOG(ERROR, "Failed to open backup storage file %s: %s",
+            filePath, strerror(e));
+        throw BackupStorageException(HERE,
+            format("Failed to open backup storage file %s", filePath), e);
+    }
+
+    // Regular files are grown to fit; devices are assumed to be big enough.
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+            static_cast<size_t>(st.st_size) < mappingLength) {
+        if (ftruncate(fd, mappingLength) == -1) {
+            int e = errno;
+            ::close(fd);
+            throw BackupStorageException(HERE,
+                "Couldn't reserve storage space for backup", e);
+        }
+    }
+
+    void* mapping = MAP_FAILED;
+#ifdef MAP_SYNC
+    // Fails with EOPNOTSUPP unless the file is on a DAX filesystem.
+    mapping = mmap(NULL, mappingLength, PROT_READ | PROT_WRITE,
+                   MAP_SHARED_VALIDATE | MAP_SYNC, fd, 0);
+    mapSync = (mapping != MAP_FAILED);
+#endif
+    if (mapping == MAP_FAILED) {
+        mapping = mmap(NULL, mappingLength, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+    }
+    if (mapping == MAP_FAILED) {
+        int e = errno;
+        ::close(fd);
+        throw BackupStorageException(HERE,
+            format("Couldn't map backup storage file %s", filePath), e);
+    }
+    base = static_cast<char*>(mapping);
+
+    for (size_t frame = 0; frame < frameCount; ++frame)
+        frames.emplace_back(this, frame);
+    freeMap.set();
+
+    LOG(NOTICE, "Backup storage mapped with %lu bytes available; allocated "
+        "%lu frame(s) in %s with %lu bytes per frame; %s",
+        frameCount * segmentSize, frameCount, filePath, segmentSize,
+        mapSync ? "MAP_SYNC (persistent memory)"
+                : "not MAP_SYNC, so durability needs msync()");
+}
+
+/// Unmap and close the file.
+MappedStorage::~MappedStorage()
+{
+    if (munmap(base, mappingLength) == -1)
+        LOG(ERROR, "Couldn't unmap backup storage: %s", strerror(errno));
+    if (::close(fd) == -1)
+        LOG(ERROR, "Couldn't close backup storage: %s", strerror(errno));
+}
+
+/**
+ * Allocate a frame on storage, resetting its state to accept appends for a new
+ * replica. Open is not synchronous itself. Even after return from open() if
+ * this backup crashes it may find the replica which was formerly stored in
+ * this frame or metadata for the former replica and data for the newly open
+ * replica. Recovery is expected to address these consistency issues with the
+ * checksums.
+ *
+ * This call is NOT idempotent since it allocates and return resources to
+ * the caller. The caller must take care not to lose frames. Any returned
+ * frame which is not freed may be leaked until the backup (or the creating
+ * master crashes). For example, the BackupService will need to guarantee that
+ * any returned frame is associated with a particular replica and that future
+ * RPCs requesting the creation of that replica reuse the returned frame.
+ *
+ * \param sync
+ *      Only return from append() calls when all enqueued data and the most
+ *      recently enqueued metadata are durable on storage.
+ * \param masterId
+ *      The server that owns the segment associated with this replica.
+ * \param segmentId
+ *      Unique identifier (in the log of masterId) of the segment
+ *      associated with this replica.
+ * \return
+ *      Reference to a frame through which handles all IO for a single
+ *      replica. Maintains a reference count; when destroyed if the
+ *      reference count drops to zero the frame will be freed for reuse with
+ *      another replica.
+ */
+BackupStorage::FrameRef
+MappedStorage::open(bool sync, ServerId masterId, uint64_t segmentId)
+{
+    Lock lock(mutex);
+    FreeMap::size_type next = freeMap.find_next(lastAllocatedFrame);
+    if (next == FreeMap::npos) {
+        next = freeMap.find_first();
+        if (next == FreeMap::npos) {
+            RAMCLOUD_CLOG(NOTICE, "Rejecting open: no free storage frames");
+            throw BackupOpenRejectedException(HERE);
+        }
+    }
+    lastAllocatedFrame = next;
+    size_t frameIndex = next;
+    assert(freeMap[frameIndex] == 1);
+    freeMap[frameIndex] = 0;
+    Frame* frame = &frames[frameIndex];
+    lock.unlock();
+    frame->open(sync);
+    return {frame, BackupStorage::freeFrame};
+}
+
+/**
+ * Returns the maximum number of bytes of metadata that can be stored
+ * which each append(). Also, how many bytes of getMetadata() are safe
+ * for access after getMetadata() calls, though returned data may or may
+ * not contain valid or meaningful (or even consistent with the
+ * replica) metadata.
+ */
+size_t
+MappedStorage::getMetadataSize()
+{
+    return METADATA_SIZE;
+}
+
+/**
+ * Marks ALL storage frames as allocated and initializes frame state based on
+ * metadata if its metadata is valid. This should only be performed at backup
+ * startup. The caller is reponsible for freeing the frames if the metadata
+ * indicates the replica data stored there isn't useful.
+ *
+ * \return
+ *      Pointer to every frame which has various uses depending on the
+ *      metadata that is found in that frame. BackupService code is expected
+ *      to examine the metadata and either free the frame or take note of the
+ *      metadata in the frame for potential use in future recoveries.
+ */
+std::vector<BackupStorage::FrameRef>
+MappedStorage::loadAllMetadata()
+{
+    std::vector<FrameRef> ret;
+    ret.reserve(frames.size());
+    foreach (Frame& frame, frames) {
+        frame.loadMetadata();
+        assert(freeMap[frame.frameIndex] == 1);
+        freeMap[frame.frameIndex] = 0;
+
+        const BackupReplicaMetadata* metadata =
+                static_cast<const BackupReplicaMetadata*>(frame.getMetadata());
+        if (metadata->checkIntegrity()) {
+            frame.isClosed = metadata->closed;
+            frame.isOpen = !metadata->closed;
+            frame.appendedLength = metadata->certificate.segmentLength;
+        }
+
+        ret.push_back({&frame, BackupStorage::freeFrame});
+    }
+    return ret;
+}
+
+/**
+ * Overwrite the superblock in the mapping with new information that future
+ * backups reusing this storage will need (in the case of this backup's
+ * demise). This is done safely so that a failure in the middle of the update
+ * will leave either the old superblock or the new.
+ *
+ * \param serverId
+ *      The server id of the process as assigned by the coordinator.
+ *      It is persisted for the benefit of future processes reusing this
+ *      storage.
+ * \param clusterName
+ *      Controls the reuse of replicas stored on this backup; see
+ *      BackupStorage::resetSuperblock().
+ * \param frameSkipMask
+ *      Used for testing. This storage keeps two superblock images and
+ *      overwrites the older first then the newer in the case a failure
+ *      occurs in the middle of writing. Setting frameSkipMask to 0x1
+ *      skips writing the first superblock image, 0x2 skips the second,
+ *      and 0x3 skips both.
+ */
+void
+MappedStorage::resetSuperblock(ServerId serverId,
+                               const string& clusterName,
+                               const uint32_t frameSkipMask)
+{
+    SuperblockImage image;
+    image.superblock =
+        Superblock(superblock.version + 1, serverId, clusterName.c_str());
+    Crc32C crc;
+    crc.update(&image.superblock, sizeof(image.superblock));
+    image.checksum = crc.getResult();
+
+    // Overwrite the two superblock images starting with the older one.
+    for (uint32_t i = 0; i < 2; ++i) {
+        const uint32_t nextFrame = (lastSuperblockFrame + 1) % 2;
+        if (!((frameSkipMask >> nextFrame) & 0x01)) {
+            char* destination = superblockImage(nextFrame);
+            memcpy(destination, &image, sizeof(image));
+            persist(destination, sizeof(image));
+            LOG(DEBUG, "Superblock frame %u written", nextFrame);
+        }
+        lastSuperblockFrame = nextFrame;
+    }
+
+    superblock = image.superblock;
+}
+
+/**
+ * Read both superblock images and return the most up-to-date and complete
+ * superblock since the last resetSuperblock().
+ *
+ * \return
+ *      The most up-to-date complete superblock found on storage.  If no
+ *      superblock can be found a default superblock is returned which
+ *      indicates no prior backup instance left behind intelligible
+ *      traces of life on storage.
+ */
+BackupStorage::Superblock
+MappedStorage::loadSuperblock()
+{
+    Tub<Superblock> left = tryLoadSuperblock(0);
+    Tub<Superblock> right = tryLoadSuperblock(1);
+
+    bool chooseLeft = false;
+    if (left && right) {
+        chooseLeft = left->version >= right->version;
+    } else if (!left && !right) {
+        LOG(WARNING,
+            "Backup couldn't find existing superblock; "
+            "starting as fresh backup.");
+        right.construct();
+        chooseLeft = false;
+    } else {
+        chooseLeft = left;
+    }
+
+    if (chooseLeft) {
+        superblock = *left;
+        lastSuperblockFrame = 0;
+    } else {
+        superblock = *right;
+        lastSuperblockFrame = 1;
+    }
+
+    LOG(DEBUG,
+        "Reloading backup superblock (version %lu, superblockFrame %u) "
+        "from previous run", superblock.version, lastSuperblockFrame);
+    return superblock;
+}
+
+/**
+ * Return only after all data appended to all Frames prior to this call
+ * is durable.
+ */
+void
+MappedStorage::quiesce()
+{
+    Lock lock(mutex);
+    foreach (Frame& frame, frames)
+        frame.syncIfDirty();
+}
+
+/**
+ * Scribble on all the metadata blocks of all the storage frames to prevent
+ * what is already in the file from being reused in future runs.
+ * Only safe immedately after this class is instantiated, before it is used
+ * to allocate or perform operations on frames.
+ * Called whenever the cluster name changes from what is stored in
+ * the superblock to prevent replicas already on storage from getting
+ * confused for ones written by the starting up backup process.
+ */
+void
+MappedStorage::fry()
+{
+    Lock lock(mutex);
+    foreach (Frame& frame, frames) {
+        memset(frame.metadata, 0, METADATA_SIZE);
+        persist(frame.metadata, METADATA_SIZE);
+    }
+}
+
+// - private -
+
+/**
+ * Make stores to a range of the mapping durable. With MAP_SYNC it's enough
+ * to write back the CPU cache lines holding the range; otherwise the pages
+ * holding it are flushed with msync(). DIEs if that fails, since the caller
+ * is about to tell someone their data is safe.
+ *
+ * \param start
+ *      First byte of the range; must be in the mapping.
+ * \param length
+ *      Bytes in the range.
+ */
+void
+MappedStorage::persist(const void* start, size_t length)
+{
+    if (length == 0)
+        return;
+    if (mapSync) {
+        writeBack(start, length);
+        return;
+    }
+    const size_t pageSize = getpagesize();
+    uintptr_t first = reinterpret_cast<uintptr_t>(start) & ~(pageSize - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(start) + length;
+    if (msync(reinterpret_cast<void*>(first), end - first, MS_SYNC) == -1) {
+        DIE("Failed to flush mapped backup storage; "
+            "cannot continue safely: %s", strerror(errno));
+    }
+}
+
+/**
+ * Return the cheapest cache-line write-back instruction this processor has;
+ * used once to initialize #writeBackInstruction.
+ */
+MappedStorage::WriteBackInstruction
+MappedStorage::detectWriteBackInstruction()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("clwb"))
+        return CLWB;
+    if (__builtin_cpu_supports("clflushopt"))
+        return CLFLUSHOPT;
+    return CLFLUSH;
+}
+
+/**
+ * Write back every CPU cache line holding part of a range of memory and wait
+ * for the write-backs to complete (with respect to later stores). Uses the
+ * cheapest instruction the processor supports (see #writeBackInstruction).
+ *
+ * \param start
+ *      First byte of the range.
+ * \param length
+ *      Bytes in the range.
+ */
+void
+MappedStorage::writeBack(const void* start, size_t length)
+{
+    uintptr_t line = reinterpret_cast<uintptr_t>(start) &
+                     ~uintptr_t(CACHE_LINE_SIZE - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(start) + length;
+    switch (writeBackInstruction) {
+    case CLWB:
+        writeBackClwb(line, end);
+        break;
+    case CLFLUSHOPT:
+        writeBackClflushopt(line, end);
+        break;
+    case CLFLUSH:
+        for (; line < end; line += CACHE_LINE_SIZE)
+            _mm_clflush(reinterpret_cast<void*>(line));
+        break;
+    }
+    _mm_sfence();
+}
+
+/**
+ * Return the start of one of the two superblock images in the mapping.
+ *
+ * \param superblockIndex
+ *      Which image: 0 or 1.
+ */
+char*
+MappedStorage::superblockImage(uint32_t superblockIndex)
+{
+    return base + superblockIndex * SUPERBLOCK_SIZE;
+}
+
+/**
+ * Try to read one of the two superblock images from the mapping.
+ *
+ * \param superblockIndex
+ *      Which of the superblock images to read.
+ * \return
+ *      The superblock stored in the image if its checksum was correct;
+ *      otherwise the returned value is empty.
+ */
+Tub<BackupStorage::Superblock>
+MappedStorage::tryLoadSuperblock(uint32_t superblockIndex)
+{
+    SuperblockImage image;
+    memcpy(&image, superblockImage(superblockIndex), sizeof(image));
+
+    Crc32C crc;
+    crc.update(&image.superblock, sizeof(image.superblock));
+    uint32_t checksum = crc.getResult();
+    if (image.checksum != checksum) {
+        LOG(NOTICE, "Stored superblock had a bad checksum: "
+            "stored checksum was %x, but stored data had checksum %x",
+            image.checksum, checksum);
+        return {};
+    }
+    char& endOfName =
+        image.superblock.clusterName[sizeof(image.superblock.clusterName) - 1];
+    if (endOfName != '\0')
+        DIE("Stored superblock's cluster name should end in \\0; "
+            "this should never happen unless there is a software bug");
+
+    return { image.superblock };
+}
+
+} // namespace RAMCloud
@@ -0,0 +1,253 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef RAMCLOUD_MAPPEDSTORAGE_H
+#define RAMCLOUD_MAPPEDSTORAGE_H
+
+#include <deque>
+
+#include "Common.h"
+#include "BackupStorage.h"
+#include "Crc32C.h"
+#include "MultiFileStorage.h"
+
+namespace RAMCloud {
+
+/**
+ * A BackupStorage backend which maps a single file into memory and stores
+ * replicas by copying appended data straight into the mapping. There are no
+ * read or write system calls and no staging buffers: durability comes from
+ * writing the affected cache lines back and fencing, as for persistent
+ * memory. Replicas and the superblock survive backup restarts just as they
+ * do with MultiFileStorage (see loadAllMetadata()).
+ *
+ * The file should be on a DAX filesystem over persistent memory, in which
+ * case the mapping is made with MAP_SYNC and flushing CPU caches is all it
+ * takes to make data durable. Any other file (for example, on tmpfs or an
+ * ordinary disk filesystem) works too; then durability additionally requires
+ * an msync() of the affected pages, which is done only where callers need it
+ * (synchronous appends, close(), load(), and quiesce()).
+ *
+ * File layout: two superblock images, followed by one slot per frame, each
+ * holding segmentSize bytes of replica data and then METADATA_SIZE bytes of
+ * metadata, padded to a whole number of pages.
+ */
+class MappedStorage : public BackupStorage {
+  public:
+    /**
+     * Represents the region of the mapping which holds a single replica and
+     * its metadata. Frames get reused for different replicas making a frame
+     * something of a state machine.
+     *
+     * Backups open() frames, append() data, and then close() them. When the
+     * replica is no longer needed free() releases the frame for reuse by
+     * another replica, for which, the same cycle will be repeated.
+     * See MappedStorage::open() to allocate and open a Frame.
+     */
+    class Frame : public BackupStorage::Frame {
+      PUBLIC:
+        typedef std::unique_lock<std::mutex> Lock;
+
+        Frame(MappedStorage* storage, size_t frameIndex);
+
+        bool wasAppendedToByCurrentProcess();
+
+        void loadMetadata();
+        const void* getMetadata();
+
+        void startLoading();
+        bool isLoaded();
+        bool currentlyOpen() { return isOpen; }
+        void* load();
+        void unload();
+
+        void append(Buffer& source,
+                    size_t sourceOffset,
+                    size_t length,
+                    size_t destinationOffset,
+                    const void* metadata,
+                    size_t metadataLength);
+        void close();
+        void reopen(size_t length);
+        void free();
+
+      PRIVATE:
+        void open(bool sync);
+        void syncIfDirty();
+
+        /// Storage where this frame resides.
+        MappedStorage* storage;
+
+        /// Index of the frame in #storage.frames. Used to mark the frame free.
+        const size_t frameIndex;
+
+        /// Start of this frame's replica data in the mapping.
+        char* data;
+
+        /// Start of this frame's metadata in the mapping; follows #data.
+        char* metadata;
+
+        /**
+         * Tracks whether a replica has been opened (either initially or
+         * since the time of the last free). False if #isClosed.
+         */
+        bool isOpen;
+
+        /**
+         * Tracks whether a replica has been closed (either initially or
+         * since the time of the last free). False if #isOpen.
+         */
+        bool isClosed;
+
+        /**
+         * Only return from append() calls when all enqueued data and the most
+         * recently enqueued metadata are durable on storage.
+         */
+        bool sync;
+
+        /**
+         * Tracks whether append has been called on this frame during the
+         * life of this process. This includes across free()/open() cycles.
+         * See wasAppendedToByCurrentProcess().
+         */
+        bool appendedToByCurrentProcess;
+
+        /// Bytes of the replica that have been appended (or recovered on
+        /// restart); only the pages holding these need syncing.
+        size_t appendedLength;
+
+        /**
+         * True if appends to this frame may not be durable yet because
+         * the mapping isn't MAP_SYNC and they weren't synchronous.
+         * Cleared by syncIfDirty().
+         */
+        bool dirty;
+
+        /**
+         * True if the replica data has been requested. Used to reject
+         * appends after load requests.
+         */
+        bool loadRequested;
+
+        // ONLY for open() and the restart logic in loadAllMetadata(); please
+        // try not to touch other details of frames in MappedStorage (or
+        // elsewhere).
+        friend class MappedStorage;
+        DISALLOW_COPY_AND_ASSIGN(Frame);
+    };
+
+    MappedStorage(size_t segmentSize,
+                  size_t frameCount,
+                  size_t writeRateLimit,
+                  const char* filePath);
+    ~MappedStorage();
+
+    FrameRef open(bool sync, ServerId masterId, uint64_t segmentId);
+    size_t getMetadataSize();
+    std::vector<FrameRef> loadAllMetadata();
+    void resetSuperblock(ServerId serverId,
+                         const string& clusterName,
+                         uint32_t frameSkipMask = 0);
+    Superblock loadSuperblock();
+    void quiesce();
+    void fry();
+
+    /// Maximum size of metadata for each frame.
+    enum { METADATA_SIZE = MultiFileStorage::METADATA_SIZE };
+
+  PRIVATE:
+    /// Space reserved in the file for each of the two superblock images.
+    enum { SUPERBLOCK_SIZE = 4096 };
+    static_assert(sizeof(Superblock) + sizeof(Crc32C::ResultType) <=
+                  SUPERBLOCK_SIZE,
+                  "Superblock doesn't fit in its space in the mapping");
+
+    /// Instructions writeBack() can use to write back a cache line.
+    enum WriteBackInstruction {
+        CLWB,           // Writes the line back and leaves it cached.
+        CLFLUSHOPT,     // Evicts the line; weakly ordered.
+        CLFLUSH,        // Evicts the line; serializes with other flushes.
+    };
+
+    /**
+     * The instruction writeBack() uses: the cheapest the processor supports,
+     * determined once at startup. Tests may override it.
+     */
+    static WriteBackInstruction writeBackInstruction;
+
+    static WriteBackInstruction detectWriteBackInstruction();
+    void persist(const void* start, size_t length);
+    void writeBack(const void* start, size_t length);
+    char* superblockImage(uint32_t superblockIndex);
+    Tub<Superblock> tryLoadSuperblock(uint32_t superblockIndex);
+
+    /// Protects concurrent operations on storage and all of its frames.
+    std::mutex mutex;
+    typedef std::unique_lock<std::mutex> Lock;
+
+    /// Descriptor for the mapped file.
+    int fd;
+
+    /// Start of the mapping of the whole file.
+    char* base;
+
+    /// Length of the file and of #base in bytes.
+    size_t mappingLength;
+
+    /// Bytes from the start of one frame's slot in the file to the next.
+    size_t frameStride;
+
+    /**
+     * True if the file is mapped with MAP_SYNC (it is on a DAX filesystem),
+     * so writing back CPU caches makes stores durable. Otherwise, persist()
+     * must also msync() the pages.
+     */
+    bool mapSync;
+
+    /// Holds the most recent image of the superblock.
+    Superblock superblock;
+
+    /// Tracks which of the superblock images was most recently written.
+    uint32_t lastSuperblockFrame;
+
+    /**
+     * Frame for each region in the mapping which can hold a replica.
+     * Frames get reused for different replicas making a frame something of a
+     * state machine, but are all created and destroyed along with the
+     * storage instance.
+     */
+    std::deque<Frame> frames;
+
+    /// The number of replicas this storage can store simultaneously.
+    const size_t frameCount;
+
+    /// Type of the freeMap.  A bitmap.
+    typedef boost::dynamic_bitset<> FreeMap;
+    /// Keeps a bit set for each frame in frames indicating if it is free.
+    FreeMap freeMap;
+
+    /**
+     * Track the last used segment frame so they can be used in FIFO.
+     * This gives recovery dump tools a much better chance at recovering
+     * data since old data is destroyed from storage first rather than new.
+     */
+    FreeMap::size_type lastAllocatedFrame;
+
+    DISALLOW_COPY_AND_ASSIGN(MappedStorage);
+};
+
+} // namespace RAMCloud
+
+#endif
@@ -0,0 +1,382 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "TestUtil.h"
+#include "BackupMasterRecovery.h"
+#include "MappedStorage.h"
+#include "StringUtil.h"
+
+namespace RAMCloud {
+
+class MappedStorageTest : public ::testing::Test {
+  public:
+    typedef char* bytes;
+    typedef MappedStorage::Frame Frame;
+
+    const char* test;
+    uint32_t testLength;
+    Buffer testSource;
+    uint32_t segmentFrames;
+    uint32_t segmentSize;
+    const char* filePath;
+    Tub<MappedStorage> storage;
+
+    MappedStorageTest()
+        : test("test")
+        , testLength(downCast<uint32_t>(strlen(test)))
+        , testSource()
+        , segmentFrames(4)
+        , segmentSize(64 * 1024)
+        , filePath("/tmp/ramcloud-mapped-storage-test-delete-this")
+        , storage()
+    {
+        Logger::get().setLogLevels(SILENT_LOG_LEVEL);
+        testSource.appendExternal(test, testLength + 1);
+        unlink(filePath);
+        storage.construct(segmentSize, segmentFrames, 0, filePath);
+    }
+
+    ~MappedStorageTest()
+    {
+        storage.destroy();
+        unlink(filePath);
+    }
+
+    /**
+     * Store a replica along with valid metadata for it in a frame, as a
+     * master would have, so it can be found after a restart.
+     */
+    void
+    writeReplica(uint64_t segmentId, uint32_t length, bool closed)
+    {
+        Buffer data;
+        TestUtil::fillLargeBuffer(&data, length);
+        SegmentCertificate certificate;
+        certificate.segmentLength = length;
+        BackupReplicaMetadata metadata(certificate, 99, segmentId,
+                segmentSize, 0, closed, true);
+        BackupStorage::FrameRef frame = storage->open(true, ServerId(),
+                                                      segmentId);
+        frame->append(data, 0, length, 0, &metadata, sizeof(metadata));
+    }
+
+    DISALLOW_COPY_AND_ASSIGN(MappedStorageTest);
+};
+
+TEST_F(MappedStorageTest, constructor) {
+    struct stat st;
+    ASSERT_EQ(0, stat(filePath, &st));
+    EXPECT_EQ(storage->mappingLength, static_cast<size_t>(st.st_size));
+    EXPECT_EQ(0u, storage->frameStride % getpagesize());
+    EXPECT_LE(segmentSize + MappedStorage::METADATA_SIZE,
+              storage->frameStride);
+    EXPECT_EQ(segmentFrames, storage->frames.size());
+    EXPECT_EQ(segmentFrames, storage->freeMap.count());
+    EXPECT_EQ(BackupStorage::Type::PERSISTENT_MEMORY, storage->storageType);
+}
+
+TEST_F(MappedStorageTest, constructorOpenFails) {
+    EXPECT_THROW(MappedStorage(segmentSize, segmentFrames, 0,
+                               "/non-existent-directory/mapped"),
+                 BackupStorageException);
+}
+
+TEST_F(MappedStorageTest, Frame_appendSync) {
+    BackupStorage::FrameRef frameRef = storage->open(true, ServerId(), 0);
+    Frame* frame = static_cast<Frame*>(frameRef.get());
+    frame->append(testSource, 0, testLength + 1, 0, test, testLength + 1);
+    EXPECT_FALSE(frame->dirty);
+    EXPECT_TRUE(frame->wasAppendedToByCurrentProcess());
+    EXPECT_EQ(testLength + 1, frame->appendedLength);
+    EXPECT_STREQ(test, bytes(frame->load()));
+    EXPECT_STREQ(test, bytes(const_cast<void*>(frame->getMetadata())));
+}
+
+TEST_F(MappedStorageTest, Frame_appendNotSync) {
+    BackupStorage::FrameRef frameRef = storage->open(false, ServerId(), 0);
+    Frame* frame = static_cast<Frame*>(frameRef.get());
+    frame->append(testSource, 0, testLength + 1, 10, test, testLength + 1);
+    EXPECT_EQ(!storage->mapSync, frame->dirty);
+    EXPECT_EQ(10 + testLength + 1, frame->appendedLength);
+    frame->close();
+    EXPECT_FALSE(frame->dirty);
+    EXPECT_STREQ(test, bytes(frame->load()) + 10);
+}
+
+TEST_F(MappedStorageTest, Frame_appendNotOpen) {
+    BackupStorage::FrameRef frameRef = storage->open(false, ServerId(), 0);
+    frameRef->close();
+    EXPECT_THROW(frameRef->append(testSource, 0, 0, 0, NULL, 0),
+                 BackupBadSegmentIdException);
+}
+
+TEST_F(MappedStorageTest, Frame_appendLoading) {
+    BackupStorage::FrameRef frameRef = storage->open(false, ServerId(), 0);
+    EXPECT_FALSE(frameRef->isLoaded());
+    frameRef->startLoading();
+    EXPECT_TRUE(frameRef->isLoaded());
+    EXPECT_THROW(frameRef->append(testSource, 0, 0, 0, NULL, 0),
+                 BackupBadSegmentIdException);
+    EXPECT_THROW(frameRef->close(), BackupBadSegmentIdException);
+}
+
+TEST_F(MappedStorageTest, Frame_appendOutOfBounds) {
+    BackupStorage::FrameRef frameRef = storage->open(false, ServerId(), 0);
+    EXPECT_THROW(frameRef->append(testSource, 0, 1, segmentSize, NULL, 0),
+                 BackupSegmentOverflowException);
+    char metadata[MappedStorage::METADATA_SIZE + 1];
+    EXPECT_THROW(frameRef->append(testSource, 0, 0, 0,
+                                  metadata, sizeof(metadata)),
+                 BackupSegmentOverflowException);
+}
+
+TEST_F(MappedStorageTest, Frame_free) {
+    BackupStorage::FrameRef frameRef = storage->open(false, ServerId(), 0);
+    Frame* frame = static_cast<Frame*>(frameRef.get());
+    frame->append(testSource, 0, testLength + 1, 0, NULL, 0);
+    EXPECT_FALSE(storage->freeMap[0]);
+    frameRef.reset();
+    EXPECT_TRUE(storage->freeMap[0]);
+    EXPECT_FALSE(frame->isOpen);
+    EXPECT_FALSE(frame->isClosed);
+    EXPECT_FALSE(frame->dirty);
+    EXPECT_EQ(0u, frame->appendedLength);
+}
+
+TEST_F(MappedStorageTest, Frame_open) {
+    BackupStorage::FrameRef frameRef = storage->open(false, ServerId(), 0);
+    Frame* frame = static_cast<Frame*>(frameRef.get());
+    frame->append(testSource, 0, 0, 0, test, testLength + 1);
+    EXPECT_FALSE(frame->sync);
+
+    frame->open(true);
+    EXPECT_FALSE(frame->sync);
+    EXPECT_STREQ(test, bytes(const_cast<void*>(frame->getMetadata())));
+
+    frame->free();
+    frame->open(true);
+    EXPECT_TRUE(frame->sync);
+    EXPECT_TRUE(frame->isOpen);
+    EXPECT_STREQ("", bytes(const_cast<void*>(frame->getMetadata())));
+}
+
+TEST_F(MappedStorageTest, open_ensureFifoUse) {
+    for (uint32_t i = 0; i < segmentFrames + 1; ++i) {
+        BackupStorage::FrameRef frameRef = storage->open(false, ServerId(), i);
+        Frame* frame = static_cast<Frame*>(frameRef.get());
+        EXPECT_EQ(i % segmentFrames, frame->frameIndex);
+    }
+}
+
+TEST_F(MappedStorageTest, open_noFreeFrames) {
+    std::vector<BackupStorage::FrameRef> frames;
+    for (uint32_t i = 0; i < segmentFrames; ++i)
+        frames.push_back(storage->open(false, ServerId(), i));
+    EXPECT_THROW(storage->open(false, ServerId(), segmentFrames),
+                 BackupOpenRejectedException);
+}
+
+TEST_F(MappedStorageTest, loadAllMetadataAfterRestart) {
+    writeReplica(1000, 50, false);
+    writeReplica(1001, 70, true);
+    storage->resetSuperblock({9999, 1}, "hasso");
+
+    // Simulate a restart of the backup.
+    storage.destroy();
+    storage.construct(segmentSize, segmentFrames, 0, filePath);
+
+    auto superblock = storage->loadSuperblock();
+    EXPECT_EQ(ServerId(9999, 1), superblock.getServerId());
+    EXPECT_STREQ("hasso", superblock.getClusterName());
+
+    std::vector<BackupStorage::FrameRef> frames = storage->loadAllMetadata();
+    ASSERT_EQ(segmentFrames, frames.size());
+    EXPECT_EQ(0u, storage->freeMap.count());
+
+    Frame* frame = static_cast<Frame*>(frames[0].get());
+    EXPECT_TRUE(frame->isOpen);
+    EXPECT_FALSE(frame->isClosed);
+    EXPECT_EQ(50u, frame->appendedLength);
+    EXPECT_FALSE(frame->wasAppendedToByCurrentProcess());
+    const BackupReplicaMetadata* metadata =
+            static_cast<const BackupReplicaMetadata*>(frame->getMetadata());
+    EXPECT_EQ(1000u, metadata->segmentId);
+    EXPECT_EQ(0, strncmp("word 1, word 2", bytes(frame->load()), 14));
+
+    frame = static_cast<Frame*>(frames[1].get());
+    EXPECT_FALSE(frame->isOpen);
+    EXPECT_TRUE(frame->isClosed);
+    EXPECT_EQ(70u, frame->appendedLength);
+
+    frame = static_cast<Frame*>(frames[2].get());
+    EXPECT_FALSE(frame->isOpen);
+    EXPECT_FALSE(frame->isClosed);
+}
+
+TEST_F(MappedStorageTest, Frame_reopen) {
+    writeReplica(1000, 50, false);
+    storage.destroy();
+    storage.construct(segmentSize, segmentFrames, 0, filePath);
+    std::vector<BackupStorage::FrameRef> frames = storage->loadAllMetadata();
+    Frame* frame = static_cast<Frame*>(frames[0].get());
+    frame->reopen(50);
+    EXPECT_TRUE(frame->isOpen);
+    EXPECT_FALSE(frame->isClosed);
+
+    // Make sure we can successfully append to this frame.
+    Buffer source;
+    source.appendExternal("0123456789", 10);
+    frame->append(source, 4, 6, 50, NULL, 0);
+    EXPECT_EQ(56LU, frame->appendedLength);
+    EXPECT_EQ(0, strncmp("wo456789", bytes(frame->load()) + 48, 8));
+}
+
+TEST_F(MappedStorageTest, resetSuperblock) {
+    for (uint32_t expectedVersion = 1; expectedVersion < 3; ++expectedVersion) {
+        storage->resetSuperblock({9999, expectedVersion}, "hasso");
+        for (uint32_t frame = 0; frame < 2; ++frame) {
+            auto superblock = storage->tryLoadSuperblock(frame);
+            ASSERT_TRUE(superblock);
+            EXPECT_EQ(ServerId(9999, expectedVersion),
+                      superblock->getServerId());
+            EXPECT_STREQ("hasso", superblock->getClusterName());
+            EXPECT_EQ(expectedVersion, superblock->version);
+            EXPECT_EQ(expectedVersion, storage->superblock.version);
+            EXPECT_EQ(1u, storage->lastSuperblockFrame);
+        }
+    }
+}
+
+TEST_F(MappedStorageTest, loadSuperblockRightGreater) {
+    // "0x2" means skip writing superblock frame 1.
+    storage->resetSuperblock({9996, 2}, "fruuuu", 0x2);
+    // "0x1" means skip writing superblock frame 0.
+    storage->resetSuperblock({9996, 1}, "gruuuu", 0x1);
+    auto superblock = storage->loadSuperblock();
+    EXPECT_EQ(ServerId(9996, 1), superblock.getServerId());
+    EXPECT_STREQ("gruuuu", superblock.getClusterName());
+    EXPECT_EQ(2u, superblock.version);
+    EXPECT_EQ(1u, storage->lastSuperblockFrame);
+}
+
+namespace {
+bool loadSuperblockFilter(string s) { return s == "loadSuperblock"; }
+}
+
+TEST_F(MappedStorageTest, loadSuperblockNoneFound) {
+    TestLog::Enable _(loadSuperblockFilter);
+    auto superblock = storage->loadSuperblock();
+    EXPECT_TRUE(StringUtil::startsWith(TestLog::get(),
+                "loadSuperblock: Backup couldn't find existing superblock;"));
+    EXPECT_EQ(ServerId(), superblock.getServerId());
+    EXPECT_STREQ("__unnamed__", superblock.getClusterName());
+    EXPECT_EQ(0u, superblock.version);
+    EXPECT_EQ(1u, storage->lastSuperblockFrame);
+}
+
+TEST_F(MappedStorageTest, quiesce) {
+    BackupStorage::FrameRef frameRef = storage->open(false, ServerId(), 0);
+    Frame* frame = static_cast<Frame*>(frameRef.get());
+    frame->append(testSource, 0, testLength + 1, 0, test, testLength + 1);
+    storage->quiesce();
+    EXPECT_FALSE(frame->dirty);
+}
+
+// Calls quiesce() until told to stop. Whenever that leaves the frame clean,
+// everything the frame claims to hold must already be in the mapping;
+// otherwise a later close() would skip flushing data that landed after the
+// quiesce(). Counts the times that isn't so in \a unflushed.
+static void
+quiesceThread(MappedStorage* storage, MappedStorage::Frame* frame,
+              std::atomic<bool>* done, std::atomic<int>* unflushed)
+{
+    while (!*done) {
+        storage->quiesce();
+        MappedStorage::Lock lock(storage->mutex);
+        if (frame->dirty)
+            continue;
+        for (size_t i = 0; i < frame->appendedLength; i++) {
+            if (frame->data[i] != 'x') {
+                (*unflushed)++;
+                break;
+            }
+        }
+    }
+}
+
+TEST_F(MappedStorageTest, quiesceDuringAppends) {
+    BackupStorage::FrameRef frameRef = storage->open(false, ServerId(), 0);
+    Frame* frame = static_cast<Frame*>(frameRef.get());
+    char piece[64];
+    memset(piece, 'x', sizeof(piece));
+    Buffer source;
+    source.appendExternal(piece, sizeof32(piece));
+
+    std::atomic<bool> done(false);
+    std::atomic<int> unflushed(0);
+    std::thread thread(quiesceThread, storage.get(), frame, &done,
+                       &unflushed);
+    const uint32_t pieces = segmentSize / sizeof32(piece);
+    for (uint32_t i = 0; i < pieces; i++)
+        frame->append(source, 0, sizeof(piece), i * sizeof(piece), NULL, 0);
+    done = true;
+    thread.join();
+
+    frame->close();
+    EXPECT_EQ(0, unflushed.load());
+    EXPECT_FALSE(frame->dirty);
+    EXPECT_EQ(segmentSize, frame->appendedLength);
+    const char* replica = bytes(frame->load());
+    EXPECT_EQ(segmentSize, downCast<uint32_t>(
+                std::count(replica, replica + segmentSize, 'x')));
+}
+
+TEST_F(MappedStorageTest, writeBack) {
+    MappedStorage::WriteBackInstruction detected =
+        MappedStorage::writeBackInstruction;
+    std::vector<MappedStorage::WriteBackInstruction> instructions;
+    instructions.push_back(MappedStorage::CLFLUSH);
+    if (__builtin_cpu_supports("clflushopt"))
+        instructions.push_back(MappedStorage::CLFLUSHOPT);
+    if (__builtin_cpu_supports("clwb"))
+        instructions.push_back(MappedStorage::CLWB);
+    char buffer[4 * CACHE_LINE_SIZE];
+    foreach (MappedStorage::WriteBackInstruction instruction, instructions) {
+        MappedStorage::writeBackInstruction = instruction;
+        memset(buffer, instruction, sizeof(buffer));
+        storage->writeBack(buffer + 3, sizeof(buffer) - 5);
+        EXPECT_EQ(sizeof(buffer), static_cast<size_t>(
+                std::count(buffer, buffer + sizeof(buffer),
+                           static_cast<char>(instruction))));
+    }
+    MappedStorage::writeBackInstruction = detected;
+}
+
+TEST_F(MappedStorageTest, fry) {
+    writeReplica(1000, 50, true);
+    storage->fry();
+    storage.destroy();
+    storage.construct(segmentSize, segmentFrames, 0, filePath);
+    std::vector<BackupStorage::FrameRef> frames = storage->loadAllMetadata();
+    Frame* frame = static_cast<Frame*>(frames[0].get());
+    EXPECT_FALSE(frame->isClosed);
+    EXPECT_EQ(0, bytes(const_cast<void*>(frame->getMetadata()))[0]);
+}
+
+} // namespace RAMCloud
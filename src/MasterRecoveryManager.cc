@@ -115,14 +115,23 @@ class EnqueueMasterRecoveryTask : public Task {
      *      an equal segmentId with a lesser epoch is not eligible to be used
      *      for recovery (both for log digest and object data purposes).
      *      Stored in and provided by the coordinator server list.
+     * \param restartLocator
+     *      If not empty, the crashed server is being restarted in place
+     *      with this service locator; see Recovery::restartLocator.
+     * \param restartDeadline
+     *      See Recovery::restartDeadline.
      */
     EnqueueMasterRecoveryTask(MasterRecoveryManager& recoveryManager,
                               ServerId crashedServerId,
-                              const ProtoBuf::MasterRecoveryInfo& recoveryInfo)
+                              const ProtoBuf::MasterRecoveryInfo& recoveryInfo,
+                              const string& restartLocator = "",
+                              uint64_t restartDeadline = 0)
         : Task(recoveryManager.taskQueue)
         , mgr(recoveryManager)
         , crashedServerId(crashedServerId)
         , masterRecoveryInfo(recoveryInfo)
+        , restartLocator(restartLocator)
+        , restartDeadline(restartDeadline)
     { }
 
     /**
@@ -134,7 +143,8 @@ class EnqueueMasterRecoveryTask : public Task {
     {
         mgr.waitingRecoveries.push(new Recovery(mgr.context, mgr.taskQueue,
                                 &mgr.tableManager, &mgr.tracker,
-                                &mgr, crashedServerId, masterRecoveryInfo));
+                                &mgr, crashedServerId, masterRecoveryInfo,
+                                restartLocator, restartDeadline));
         (new MaybeStartRecoveryTask(mgr))->schedule();
         delete this;
     }
@@ -143,6 +153,8 @@ class EnqueueMasterRecoveryTask : public Task {
     MasterRecoveryManager& mgr;
     ServerId crashedServerId;
     ProtoBuf::MasterRecoveryInfo masterRecoveryInfo;
+    string restartLocator;
+    uint64_t restartDeadline;
     DISALLOW_COPY_AND_ASSIGN(EnqueueMasterRecoveryTask);
 };
 
@@ -474,8 +486,19 @@ MasterRecoveryManager::startMasterRecovery(
                  crashedServerId.toString().c_str());
         return;
     }
+    string restartLocator;
+    uint64_t restartDeadline = 0;
+    if (runtimeOptions && runtimeOptions->takeRestartLocally(crashedServerId)) {
+        restartLocator = crashedServer.serviceLocator;
+        restartDeadline = Cycles::rdtsc() +
+            Cycles::fromSeconds(Recovery::RESTART_WAIT_SECONDS);
+        LOG(NOTICE, "Server %s is restarting in place; it will recover "
+            "itself from its own backup",
+            crashedServerId.toString().c_str());
+    }
     (new EnqueueMasterRecoveryTask(*this, crashedServerId,
-                    crashedServer.masterRecoveryInfo))->schedule();
+                    crashedServer.masterRecoveryInfo,
+                    restartLocator, restartDeadline))->schedule();
 }
 
 namespace MasterRecoveryManagerInternal {
@@ -483,7 +506,8 @@ class ApplyTrackerChangesTask : public Task {
   PUBLIC:
     /**
      * Create a task which when run will apply all enqueued changes to
-     * #tracker and notifies any recoveries which have lost recovery masters.
+     * #tracker and notifies any recoveries which have lost recovery masters
+     * or are waiting for a server that has just enlisted.
      * This brings #mgr.tracker into sync with #mgr.serverList. Because this
      * task is run by #mgr.taskQueue is it serialized with other tasks.
      */
@@ -498,10 +522,15 @@ class ApplyTrackerChangesTask : public Task {
         ServerDetails server;
         ServerChangeEvent event;
         while (mgr.tracker.getChange(server, event)) {
+            if (event == SERVER_ADDED) {
+                // Wake any recovery waiting for this server to restart.
+                foreach (auto& entry, mgr.activeRecoveries)
+                    entry.second->serverEnlisted(server);
+            }
             if (event == SERVER_CRASHED || event == SERVER_REMOVED) {
                 Recovery* recovery = mgr.tracker[server.serverId];
                 if (!recovery)
-                    break;
+                    continue;
                 LOG(NOTICE, "Recovery master %s crashed while recovering "
                     "a partition of server %s",
                     server.serverId.toString().c_str(),
@@ -577,13 +606,15 @@ MasterRecoveryManager::recoveryFinished(Recovery* recovery)
         // will flood its log with recovery messages in situations
         // were there aren't enough resources to recover.
         if (!skipRescheduleDelay) {
-            usleep(2000000);
+            usleep(RESCHEDULE_DELAY_MS * 1000);
         }
 
         // Enqueue will schedule a MaybeStartRecoveryTask.
         (new EnqueueMasterRecoveryTask(*this,
                                        recovery->crashedServerId,
-                                       recovery->masterRecoveryInfo))->
+                                       recovery->masterRecoveryInfo,
+                                       recovery->restartLocator,
+                                       recovery->restartDeadline))->
                                                             schedule();
     }
 
@@ -51,6 +51,12 @@ class MasterRecoveryManager : public Recovery::Owner
                             , public ServerTracker<Recovery>::Callback
 {
   PUBLIC:
+    /**
+     * How long recoveryFinished() waits before rescheduling a recovery that
+     * left some tablets unrecovered, in milliseconds.
+     */
+    static const uint32_t RESCHEDULE_DELAY_MS = 2000;
+
     MasterRecoveryManager(Context* context,
                           TableManager& tableManager,
                           RuntimeOptions* runtimeOptions);
@@ -189,6 +189,33 @@ TEST_F(MasterRecoveryManagerTest, trackerChangesEnqueued) {
     EXPECT_EQ(1lu, recovery->unsuccessfulRecoveryMasters);
 }
 
+TEST_F(MasterRecoveryManagerTest, trackerChangesEnqueued_serverEnlisted) {
+    Lock lock(mutex); // For calls to internal functions without real lock.
+    ServerId crashedId = addMaster(lock, ServerStatus::CRASHED);
+    Recovery* recovery = new Recovery(&context, mgr->taskQueue, tableManager,
+                                      &mgr->tracker, NULL, crashedId, {},
+                                      "restarted-locator");
+    recovery->status = Recovery::WAIT_FOR_RESTART;
+    mgr->activeRecoveries[recovery->recoveryId] = recovery;
+
+    // Another server enlisting doesn't wake the recovery.
+    addMaster(lock);
+    EXPECT_FALSE(recovery->isScheduled());
+
+    serverList->enlistServer({WireFormat::MASTER_SERVICE,
+                              WireFormat::BACKUP_SERVICE},
+                             0, 0, "restarted-locator");
+    serverList->sync();
+    serverList->haltUpdater();
+    while (!recovery->isScheduled() && mgr->taskQueue.performTask()) {}
+    EXPECT_TRUE(recovery->isScheduled());
+
+    mgr->activeRecoveries.erase(recovery->recoveryId);
+    recovery->status = Recovery::DONE;
+    while (mgr->taskQueue.performTask()) {}
+    delete recovery;
+}
+
 TEST_F(MasterRecoveryManagerTest, recoveryFinished) {
     Lock lock(mutex); // For calls to internal functions without real lock.
     EXPECT_EQ(0lu, serverList->version);
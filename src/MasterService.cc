@@ -32,6 +32,7 @@
 #include "ProtoBuf.h"
 #include "RawMetrics.h"
 #include "Segment.h"
+#include "SegmentReplayer.h"
 #include "ServerRpcPool.h"
 #include "ShortMacros.h"
 #include "TableStats.h"
@@ -54,12 +55,15 @@ namespace RAMCloud {
  * \param state
  *      See #state member. The default (NOT_STARTED) is usually what you want
  *      here, but other values are allowed for testing.
+ * \param fragment
+ *      See #fragment member.
  */
 MasterService::Replica::Replica(uint64_t backupId, uint64_t segmentId,
-        State state)
+        State state, bool fragment)
     : backupId(backupId)
     , segmentId(segmentId)
     , state(state)
+    , fragment(fragment)
 {
 }
 
@@ -328,7 +332,8 @@ MasterService::dropTabletOwnership(
 
     // Ensure that the ObjectManager never returns objects from this deleted
     // tablet again.
-    objectManager.removeOrphanedObjects();
+    objectManager.removeOrphanedObjects(reqHdr->tableId,
+            reqHdr->firstKeyHash, reqHdr->lastKeyHash);
 
     LOG(NOTICE, "Dropped ownership of (or did not own) tablet [0x%lx,0x%lx] "
                 "in tableId %lu",
@@ -409,13 +414,15 @@ MasterService::enumerate(const WireFormat::Enumerate::Request* reqHdr,
     // header and also the serialized iteration state at the end of enumeration.
     uint32_t maxPayloadBytes = downCast<uint32_t>(
             Transport::MAX_RPC_LEN - sizeof(*respHdr) - (1 << 20));
+    vector<HashTable*> objectMaps;
+    objectManager.getObjectMaps(reqHdr->tableId, actualTabletStartHash,
+                                actualTabletEndHash, &objectMaps);
     Enumeration enumeration(
             reqHdr->tableId, reqHdr->keysOnly,
             reqHdr->tabletFirstHash,
             actualTabletStartHash, actualTabletEndHash,
             &respHdr->tabletFirstHash, iter,
-            *objectManager.getLog(),
-            *objectManager.getObjectMap(),
+            *objectManager.getLog(), objectMaps,
             *rpc->replyPayload, maxPayloadBytes);
     enumeration.complete();
     respHdr->payloadBytes = rpc->replyPayload->size()
@@ -453,6 +460,8 @@ MasterService::getLogMetrics(
 {
     ProtoBuf::LogMetrics logMetrics;
     objectManager.getLog()->getMetrics(logMetrics);
+    objectManager.getHashTableMetrics(
+            *logMetrics.mutable_hash_table_metrics());
     respHdr->logMetricsLength = ProtoBuf::serializeToResponse(
             rpc->replyPayload, &logMetrics);
 }
@@ -469,6 +478,8 @@ MasterService::getServerStatistics(
     ProtoBuf::ServerStatistics serverStats;
     tabletManager.getStatistics(&serverStats);
     SpinLock::getStatistics(serverStats.mutable_spin_lock_stats());
+    objectManager.getCompressionStatistics(
+            serverStats.mutable_compression_stats());
     respHdr->serverStatsLength = serializeToResponse(
             rpc->replyPayload, &serverStats);
 }
@@ -1166,7 +1177,7 @@ MasterService::migrateTablet(const WireFormat::MigrateTablet::Request* reqHdr,
 
     // Ensure that the ObjectManager never returns objects from this deleted
     // tablet again.
-    objectManager.removeOrphanedObjects();
+    objectManager.removeOrphanedObjects(tableId, firstKeyHash, lastKeyHash);
 }
 
 /**
@@ -1304,6 +1315,9 @@ MasterService::multiRead(const WireFormat::MultiOp::Request* reqHdr,
     respHdr->count = numRequests;
     uint32_t oldResponseLength = rpc->replyPayload->size();
 
+    // Offset of the first request that hasn't been prefetched yet.
+    uint32_t prefetchOffset = reqOffset;
+
     // Each iteration extracts one request from request rpc, finds the
     // corresponding object, and appends the response to the response rpc.
     for (uint32_t i = 0; ; i++) {
@@ -1326,9 +1340,18 @@ MasterService::multiRead(const WireFormat::MultiOp::Request* reqHdr,
             break;
         }
 
+        if (i % ObjectManager::MAX_PREFETCH_BATCH == 0) {
+            prefetchOffset = prefetchMultiRead(rpc->requestPayload,
+                    prefetchOffset, numRequests - i);
+        }
+
         const WireFormat::MultiOp::Request::ReadPart *currentReq =
                 rpc->requestPayload->getOffset<
                 WireFormat::MultiOp::Request::ReadPart>(reqOffset);
+        if (currentReq == NULL) {
+            respHdr->common.status = STATUS_REQUEST_FORMAT_ERROR;
+            break;
+        }
         reqOffset += sizeof32(WireFormat::MultiOp::Request::ReadPart);
 
         const void* stringKey = rpc->requestPayload->getRange(
@@ -1475,9 +1498,17 @@ MasterService::multiWrite(const WireFormat::MultiOp::Request* reqHdr,
     // Buffer on stack.
     Buffer oldObjectBuffers[numRequests];
 
+    // Offset of the first request that hasn't been prefetched yet.
+    uint32_t prefetchOffset = reqOffset;
+
     // Each iteration extracts one request from the rpc, writes the object
     // if possible, and appends a status and version to the response buffer.
     for (uint32_t i = 0; i < numRequests; i++) {
+        if (i % ObjectManager::MAX_PREFETCH_BATCH == 0) {
+            prefetchOffset = prefetchMultiWrite(rpc->requestPayload,
+                    prefetchOffset, numRequests - i);
+        }
+
         const WireFormat::MultiOp::Request::WritePart *currentReq =
                 rpc->requestPayload->getOffset<
                 WireFormat::MultiOp::Request::WritePart>(reqOffset);
@@ -1540,6 +1571,91 @@ MasterService::multiWrite(const WireFormat::MultiOp::Request* reqHdr,
     }
 }
 
+/**
+ * Helper for multiRead: parse the next batch of ReadParts from a MULTI_OP
+ * request and ask the ObjectManager to prefetch the corresponding hash
+ * table buckets and log entries, so that the reads that follow don't each
+ * stall on their own cache misses.
+ *
+ * \param requestPayload
+ *      Request buffer for the MULTI_OP rpc.
+ * \param reqOffset
+ *      Offset in \a requestPayload of the first ReadPart to prefetch.
+ * \param count
+ *      Number of ReadParts remaining in the request. At most
+ *      ObjectManager::MAX_PREFETCH_BATCH of them are prefetched.
+ * \return
+ *      Offset of the first ReadPart that was not prefetched. Malformed
+ *      parts are left for multiRead to reject.
+ */
+uint32_t
+MasterService::prefetchMultiRead(Buffer* requestPayload, uint32_t reqOffset,
+        uint32_t count)
+{
+    Tub<Key> keys[ObjectManager::MAX_PREFETCH_BATCH];
+    uint32_t numKeys = 0;
+    while (numKeys < count && numKeys < ObjectManager::MAX_PREFETCH_BATCH) {
+        const WireFormat::MultiOp::Request::ReadPart *part =
+                requestPayload->getOffset<
+                WireFormat::MultiOp::Request::ReadPart>(reqOffset);
+        if (part == NULL)
+            break;
+        const void* stringKey = requestPayload->getRange(
+                reqOffset + sizeof32(*part), part->keyLength);
+        if (stringKey == NULL)
+            break;
+        keys[numKeys].construct(part->tableId, stringKey, part->keyLength);
+        numKeys++;
+        reqOffset += sizeof32(*part) + part->keyLength;
+    }
+    objectManager.prefetchObjects(keys, numKeys);
+    return reqOffset;
+}
+
+/**
+ * Helper for multiWrite: the analog of prefetchMultiRead for WriteParts.
+ * Prefetching the existing version of each object speeds up the hash table
+ * lookup and reject-rule checks that writeObject does before appending.
+ *
+ * \param requestPayload
+ *      Request buffer for the MULTI_OP rpc.
+ * \param reqOffset
+ *      Offset in \a requestPayload of the first WritePart to prefetch.
+ * \param count
+ *      Number of WriteParts remaining in the request. At most
+ *      ObjectManager::MAX_PREFETCH_BATCH of them are prefetched.
+ * \return
+ *      Offset of the first WritePart that was not prefetched. Malformed
+ *      parts are left for multiWrite to reject.
+ */
+uint32_t
+MasterService::prefetchMultiWrite(Buffer* requestPayload, uint32_t reqOffset,
+        uint32_t count)
+{
+    Tub<Key> keys[ObjectManager::MAX_PREFETCH_BATCH];
+    uint32_t numKeys = 0;
+    while (numKeys < count && numKeys < ObjectManager::MAX_PREFETCH_BATCH) {
+        const WireFormat::MultiOp::Request::WritePart *part =
+                requestPayload->getOffset<
+                WireFormat::MultiOp::Request::WritePart>(reqOffset);
+        if (part == NULL)
+            break;
+        uint32_t objectOffset = reqOffset + sizeof32(*part);
+        if (requestPayload->size() < objectOffset + part->length)
+            break;
+        Object object(part->tableId, 0, 0, *requestPayload, objectOffset,
+                part->length);
+        KeyLength keyLength;
+        const void* stringKey = object.getKey(0, &keyLength);
+        if (stringKey != NULL)
+            keys[numKeys].construct(part->tableId, stringKey, keyLength);
+        numKeys++;
+        reqOffset = objectOffset + part->length;
+    }
+    objectManager.prefetchObjects(keys, numKeys);
+    return reqOffset;
+}
+
 /**
  * Top-level server method to handle the PREP_FOR_INDEXLET_MIGRATION request.
  *
@@ -3262,18 +3378,40 @@ class RecoveryTask {
                  uint64_t recoveryId,
                  ServerId masterId,
                  uint64_t partitionId,
-                 MasterService::Replica& replica)
+                 MasterService::Replica& replica,
+                 const std::unordered_multimap<uint64_t,
+                                               MasterService::Replica*>&
+                     segmentIdToBackups,
+                 uint32_t chunkBytes)
         : context(context)
         , recoveryId(recoveryId)
         , masterId(masterId)
         , partitionId(partitionId)
         , replica(replica)
-        , response()
+        , fragmentSources()
+        , chunkBytes(chunkBytes)
+        , response(new Buffer())
+        , segmentData(NULL)
+        , received(0)
+        , chunk()
+        , certificate()
+        , checker()
         , startTime(Cycles::rdtsc())
         , rpc()
     {
+        // A backup holding only a fragment needs to know where the other
+        // fragments are to rebuild the segment.
+        if (replica.fragment) {
+            foreach (auto it, segmentIdToBackups.equal_range(
+                    replica.segmentId)) {
+                const MasterService::Replica& other = *it.second;
+                if (other.fragment && other.backupId != replica.backupId)
+                    fragmentSources.push_back(other.backupId);
+            }
+        }
         rpc.construct(context, replica.backupId, recoveryId, masterId,
-                replica.segmentId, partitionId, &response);
+                replica.segmentId, partitionId, response.get(),
+                &fragmentSources, 0, chunkBytes);
     }
     ~RecoveryTask()
     {
@@ -3285,16 +3423,104 @@ class RecoveryTask {
     }
     void resend() {
         LOG(DEBUG, "Resend %lu", replica.segmentId);
-        response.reset();
+        response->reset();
+        segmentData = NULL;
+        received = 0;
+        chunk.reset();
+        checker.destroy();
         rpc.construct(context, replica.backupId, recoveryId, masterId,
-                replica.segmentId, partitionId, &response);
+                replica.segmentId, partitionId, response.get(),
+                &fragmentSources, 0, chunkBytes);
     }
+
+    /**
+     * Collect the piece of the recovery segment that #rpc returned and
+     * check the metadata of the entries it completes; if more of the
+     * segment remains, start fetching the next piece.
+     *
+     * \return
+     *      True once all of the recovery segment is in #response (starting
+     *      at #segmentData) and its metadata matched #certificate; false if
+     *      #rpc was restarted for the next piece.
+     * \throw SegmentIteratorException
+     *      The recovery segment is corrupt.
+     */
+    bool
+    receiveChunk()
+    {
+        uint32_t segmentLength = 0;
+        SegmentCertificate chunkCertificate = rpc->wait(&segmentLength);
+        rpc.destroy();
+        if (!checker) {
+            certificate = chunkCertificate;
+            checker.construct(certificate);
+            received = response->size();
+            if (received < segmentLength) {
+                // The segment comes in pieces; gather them contiguously so
+                // it can be checked and iterated without another copy.
+                std::unique_ptr<Buffer> first(std::move(response));
+                response.reset(new Buffer());
+                segmentData = static_cast<char*>(
+                        response->alloc(segmentLength));
+                first->copy(0, received, segmentData);
+            } else if (received == segmentLength) {
+                segmentData = static_cast<char*>(
+                        response->getRange(0, received));
+            } else {
+                throw SegmentIteratorException(HERE,
+                        "recovery segment longer than its stated length");
+            }
+        } else {
+            if (memcmp(&chunkCertificate, &certificate,
+                       sizeof(certificate)) != 0 ||
+                    segmentLength != response->size() ||
+                    chunk.size() == 0 ||
+                    received + chunk.size() > segmentLength) {
+                throw SegmentIteratorException(HERE,
+                        "recovery segment changed between pieces");
+            }
+            chunk.copy(0, chunk.size(), segmentData + received);
+            received += chunk.size();
+            chunk.reset();
+        }
+
+        if (!checker->update(segmentData, received))
+            throw SegmentIteratorException(HERE, "corrupt recovery segment");
+        if (received < segmentLength) {
+            rpc.construct(context, replica.backupId, recoveryId, masterId,
+                    replica.segmentId, partitionId, &chunk,
+                    &fragmentSources, received, chunkBytes);
+            return false;
+        }
+        if (!checker->finish())
+            throw SegmentIteratorException(HERE, "corrupt recovery segment");
+        return true;
+    }
+
     Context* context;
     uint64_t recoveryId;
     ServerId masterId;
     uint64_t partitionId;
     MasterService::Replica& replica;
-    Buffer response;
+    vector<ServerId> fragmentSources;
+    /// If nonzero, the recovery segment is fetched in pieces of at most
+    /// this many bytes (see ServerConfig::Master::recoveryChunkBytes).
+    uint32_t chunkBytes;
+    /// Where the recovery segment is received; handed to the
+    /// SegmentReplayer along with ownership once all of it has arrived.
+    std::unique_ptr<Buffer> response;
+    /// Contiguous copy of the recovery segment within #response; NULL
+    /// until the first piece arrives.
+    char* segmentData;
+    /// Bytes of the recovery segment received so far.
+    uint32_t received;
+    /// Where each piece after the first is received before it's copied
+    /// into #response.
+    Buffer chunk;
+    /// Certificate of the recovery segment, from the first piece.
+    SegmentCertificate certificate;
+    /// Checks the recovery segment's metadata as its pieces arrive.
+    Tub<Segment::MetadataChecker> checker;
     const uint64_t startTime;
     Tub<GetRecoveryDataRpc> rpc;
     DISALLOW_COPY_AND_ASSIGN(RecoveryTask);
@@ -3443,10 +3669,18 @@ MasterService::recover(uint64_t recoveryId, ServerId masterId,
     auto notStarted = replicas.begin();
     auto replicasEnd = replicas.end();
 
-    // The SideLog we'll append recovered entries to. It will be committed after
-    // replay completes on all segments, making all of the recovered data
-    // durable.
-    SideLog sideLog(objectManager.getLog());
+    // Replays recovered entries into SideLogs with config->master.replayThreads
+    // threads. They will be committed after replay completes on all
+    // segments, making all of the recovered data durable. If
+    // config->master.replayQueueDepth is nonzero, segments are replayed in
+    // the background while this thread keeps fetching more.
+    SegmentReplayer replayer(&objectManager, config->master.replayThreads,
+                             &nextNodeIdMap, config->master.replayQueueDepth);
+
+    std::unordered_multimap<uint64_t, Replica*> segmentIdToBackups;
+    foreach (Replica& replica, replicas) {
+        segmentIdToBackups.insert({replica.segmentId, &replica});
+    }
 
     // Start RPCs
     auto replicaIt = notStarted;
@@ -3460,7 +3694,9 @@ MasterService::recover(uint64_t recoveryId, ServerId masterId,
                     context->serverList->toString(replica.backupId).c_str(),
                     replica.segmentId,
                     &task - &tasks[0]);
-            task.construct(context, recoveryId, masterId, partitionId, replica);
+            task.construct(context, recoveryId, masterId, partitionId, replica,
+                           segmentIdToBackups,
+                           config->master.recoveryChunkBytes);
             replica.state = Replica::State::WAITING;
             runningSet.insert(replica.segmentId);
             ++metrics->master.segmentReadCount;
@@ -3479,12 +3715,13 @@ MasterService::recover(uint64_t recoveryId, ServerId masterId,
 
     bool gotFirstGRD = false;
 
-    std::unordered_multimap<uint64_t, Replica*> segmentIdToBackups;
-    foreach (Replica& replica, replicas) {
-        segmentIdToBackups.insert({replica.segmentId, &replica});
-    }
-
     while (activeRequests) {
+        if (replayer.hasFailed()) {
+            // A segment replaying in the background failed; the partition
+            // can't be recovered, so stop fetching (drain() below reports
+            // it). Outstanding RPCs are abandoned with their tasks.
+            break;
+        }
         if (!readStallTicks)
             readStallTicks.construct(&metrics->master.segmentReadStallTicks);
         objectManager.getReplicaManager()->proceed();
@@ -3499,8 +3736,12 @@ MasterService::recover(uint64_t recoveryId, ServerId masterId,
                     context->serverList->toString(
                             task->replica.backupId).c_str());
             try {
-                SegmentCertificate certificate = task->rpc->wait();
-                task->rpc.destroy();
+                // Large recovery segments arrive in pieces; each is checked
+                // as it comes, and the segment is replayed once all of it
+                // is here (the certificate covers the whole segment).
+                if (!task->receiveChunk())
+                    continue;
+                const SegmentCertificate& certificate = task->certificate;
                 uint64_t grdTime = Cycles::rdtsc() - task->startTime;
                 metrics->master.segmentReadTicks += grdTime;
 
@@ -3549,22 +3790,30 @@ MasterService::recover(uint64_t recoveryId, ServerId masterId,
                             &task - &tasks[0]);
                 }
 
-                uint32_t responseLen = task->response.size();
+                uint32_t responseLen = task->received;
                 metrics->master.segmentReadByteCount += responseLen;
                 uint64_t startUseful = Cycles::rdtsc();
-                SegmentIterator it(task->response.getRange(0, responseLen),
-                        responseLen, certificate);
-                it.checkMetadataIntegrity();
+                SegmentIterator it(task->segmentData, responseLen,
+                        certificate);
                 if (LOG_RECOVERY_REPLICATION_RPC_TIMING) {
                     LOG(DEBUG, "@%7lu: Replaying segment %lu with length %u",
                             Cycles::toMicroseconds(Cycles::rdtsc() -
                                     ReplicatedSegment::recoveryStart),
                             task->replica.segmentId, responseLen);
                 }
-                objectManager.replaySegment(&sideLog, it, &nextNodeIdMap);
+                if (config->master.replayQueueDepth != 0) {
+                    // The segment's metadata checked out, so nothing is left
+                    // that would make another replica of it any better; free
+                    // this channel to fetch the next segment while it
+                    // replays.
+                    replayer.enqueue(task->replica.segmentId,
+                                     std::move(task->response), certificate);
+                } else {
+                    replayer.replay(it);
+                    TEST_LOG("Segment %lu replay complete",
+                             task->replica.segmentId);
+                }
                 usefulTime += Cycles::rdtsc() - startUseful;
-                TEST_LOG("Segment %lu replay complete",
-                         task->replica.segmentId);
                 if (LOG_RECOVERY_REPLICATION_RPC_TIMING) {
                     LOG(DEBUG, "@%7lu: Replaying segment %lu done",
                             Cycles::toMicroseconds(Cycles::rdtsc() -
@@ -3636,7 +3885,8 @@ MasterService::recover(uint64_t recoveryId, ServerId masterId,
                         context->serverList->toString(replica.backupId).c_str(),
                         replica.segmentId, &task - &tasks[0]);
                 task.construct(context, recoveryId, masterId,
-                        partitionId, replica);
+                        partitionId, replica, segmentIdToBackups,
+                        config->master.recoveryChunkBytes);
                 replica.state = Replica::State::WAITING;
                 runningSet.insert(replica.segmentId);
                 ++metrics->master.segmentReadCount;
@@ -3648,6 +3898,16 @@ MasterService::recover(uint64_t recoveryId, ServerId masterId,
     }
     readStallTicks.destroy();
 
+    try {
+        CycleCounter<RawMetric> _(&metrics->master.replayDrainTicks);
+        replayer.drain();
+    } catch (const Exception& e) {
+        LOG(ERROR, "Recovery master failed to replay a segment of master "
+                "%s partition %lu: %s", masterId.toString().c_str(),
+                partitionId, e.what());
+        throw SegmentRecoveryFailedException(HERE);
+    }
+
     detectSegmentRecoveryFailure(masterId, partitionId, replicas);
 
     {
@@ -3661,7 +3921,7 @@ MasterService::recover(uint64_t recoveryId, ServerId masterId,
                 0 - metrics->transport.infiniband.transmitActiveTicks;
         metrics->master.logSyncPostingWriteRpcTicks =
                 0 - metrics->master.replicationPostingWriteRpcTicks;
-        sideLog.commit();
+        replayer.commit();
         metrics->master.logSyncBytes += metrics->transport.transmit.byteCount;
         metrics->master.logSyncTransmitCopyTicks +=
                 metrics->transport.transmit.copyTicks;
@@ -3742,7 +4002,9 @@ MasterService::recover(const WireFormat::Recover::Request* reqHdr,
                 rpc->requestPayload->getOffset<WireFormat::Recover::Replica>(
                 offset);
         offset += sizeof32(WireFormat::Recover::Replica);
-        Replica replica(replicaLocation->backupId, replicaLocation->segmentId);
+        Replica replica(replicaLocation->backupId, replicaLocation->segmentId,
+                        Replica::State::NOT_STARTED,
+                        replicaLocation->fragment);
         replicas.push_back(replica);
     }
     LOG(DEBUG, "Starting recovery %lu for crashed master %s; "
@@ -236,6 +236,10 @@ class MasterService : public Service {
     void multiWrite(const WireFormat::MultiOp::Request* reqHdr,
                 WireFormat::MultiOp::Response* respHdr,
                 Rpc* rpc);
+    uint32_t prefetchMultiRead(Buffer* requestPayload, uint32_t reqOffset,
+                uint32_t count);
+    uint32_t prefetchMultiWrite(Buffer* requestPayload, uint32_t reqOffset,
+                uint32_t count);
     void prepForIndexletMigration(
                 const WireFormat::PrepForIndexletMigration::Request* reqHdr,
                 WireFormat::PrepForIndexletMigration::Response* respHdr,
@@ -452,7 +456,7 @@ class MasterService : public Service {
             OK,
         };
         Replica(uint64_t backupId, uint64_t segmentId,
-                State state = State::NOT_STARTED);
+                State state = State::NOT_STARTED, bool fragment = false);
 
         /**
          * The backup containing the replica.
@@ -469,6 +473,13 @@ class MasterService : public Service {
          * the data from this replica.
          */
         State state;
+
+        /**
+         * True if the backup only holds a fragment of an erasure-coded
+         * segment; it must collect fragments from the other backups listed
+         * for the segment to rebuild it.
+         */
+        bool fragment;
     };
 
     static void detectSegmentRecoveryFailure(
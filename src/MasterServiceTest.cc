@@ -606,6 +606,71 @@ TEST_F(MasterServiceTest, enumerate_mergeTablet) {
     EXPECT_EQ(0U, objects.size());
 }
 
+TEST_F(MasterServiceTest, enumerate_perTableIndexMergedTablet) {
+    ServerConfig master2Config = masterConfig;
+    master2Config.master.numReplicas = 0;
+    master2Config.master.hashTablePerTable = true;
+    master2Config.localLocator = "mock:host=master2";
+    MasterService* master2 = cluster.addServer(master2Config)->master.get();
+
+    // (tableId = 1, key = "012345") hashes to 0x7fc19e9dda158f61
+    // (tableId = 1, key = "678910") hashes to 0xb1e38b2242e1bbf4
+    // Each object is written while its half of the table is a separate
+    // tablet, so each gets an index partition of its own.
+    master2->tabletManager.addTablet(1, 0, 0x8fffffffffffffffLU,
+            TabletManager::NORMAL);
+    master2->tabletManager.addTablet(1, 0x9000000000000000LU, ~0UL,
+            TabletManager::NORMAL);
+    const char* keys[] = { "012345", "678910" };
+    foreach (const char* stringKey, keys) {
+        Key key(1, stringKey, 6);
+        Buffer value;
+        Object obj(key, "abcdef", 6, 0, 0, value);
+        EXPECT_EQ(STATUS_OK,
+                  master2->objectManager.writeObject(obj, NULL, NULL));
+    }
+
+    // Merge the tablets: the merged tablet spans both partitions.
+    master2->tabletManager.deleteTablet(1, 0, 0x8fffffffffffffffLU);
+    master2->tabletManager.deleteTablet(1, 0x9000000000000000LU, ~0UL);
+    master2->tabletManager.addTablet(1, 0, ~0UL, TabletManager::NORMAL);
+    vector<HashTable*> maps;
+    master2->objectManager.getObjectMaps(1, 0, ~0UL, &maps);
+    EXPECT_EQ(2U, maps.size());
+
+    Buffer reqBuf;
+    Buffer respBuf;
+    Service::Rpc rpc(NULL, &reqBuf, &respBuf);   // Fake RPC with no worker.
+    WireFormat::Enumerate::Request* reqHdr =
+            reqBuf.emplaceAppend<WireFormat::Enumerate::Request>();
+    memset(reqHdr, 0, sizeof(*reqHdr));
+    reqHdr->tableId = 1;
+    WireFormat::Enumerate::Response* respHdr =
+            respBuf.emplaceAppend<WireFormat::Enumerate::Response>();
+    memset(respHdr, 0, sizeof(*respHdr));
+    master2->enumerate(reqHdr, respHdr, &rpc);
+    EXPECT_EQ(STATUS_OK, respHdr->common.status);
+    EXPECT_EQ(0U, respHdr->tabletFirstHash);
+
+    // Both objects are returned, in whichever order their buckets come.
+    EXPECT_EQ(86U, respHdr->payloadBytes);
+    std::set<string> found;
+    uint32_t offset = sizeof32(*respHdr);
+    while (offset < sizeof32(*respHdr) + respHdr->payloadBytes) {
+        uint32_t length = *respBuf.getOffset<uint32_t>(offset);
+        Buffer objectBuffer;
+        objectBuffer.appendExternal(respBuf.getRange(offset + 4, length),
+                length);
+        Object object(objectBuffer);
+        found.insert(string(reinterpret_cast<const char*>(object.getKey()),
+                            object.getKeyLength()));
+        offset += 4 + length;
+    }
+    EXPECT_EQ(2U, found.size());
+    EXPECT_EQ(1U, found.count("012345"));
+    EXPECT_EQ(1U, found.count("678910"));
+}
+
 TEST_F(MasterServiceTest, getHeadOfLog) {
     EXPECT_EQ(LogPosition(2, 88),
             MasterClient::getHeadOfLog(&context, masterServer->serverId));
@@ -1315,7 +1380,8 @@ TEST_F(MasterServiceTest, migrateTablet_movingData) {
     master2Log->sync();
 
     LogPosition master2HeadPositionBefore = LogPosition(
-            master2Log->head->id, master2Log->head->getAppendedLength());
+            master2Log->heads[0].segment->id,
+            master2Log->heads[0].segment->getAppendedLength());
 
     // JIRA Issue: RAM-441: Without the syncCoordinatorServerList() call in
     // cluster.addServer(..) above, this crashes since the CoordinatorServerList
@@ -1341,7 +1407,8 @@ TEST_F(MasterServiceTest, migrateTablet_movingData) {
     // migration, but less than the current log position (since we added
     // data).
     LogPosition master2HeadPositionAfter = LogPosition(
-            master2Log->head->id, master2Log->head->getAppendedLength());
+            master2Log->heads[0].segment->id,
+            master2Log->heads[0].segment->getAppendedLength());
     LogPosition ctimeCoord =
             cluster.coordinator->tableManager.getTablet(tbl, 0).ctime;
     EXPECT_GT(ctimeCoord, master2HeadPositionBefore);
@@ -1434,6 +1501,39 @@ TEST_F(MasterServiceTest, multiRead_basics) {
             value2.get()->getValue()), 9));
 }
 
+TEST_F(MasterServiceTest, multiRead_multiplePrefetchBatches) {
+    uint64_t tableId1 = ramcloud->createTable("table1");
+    const uint32_t numObjects = 2 * ObjectManager::MAX_PREFETCH_BATCH + 3;
+    string keys[numObjects];
+    Tub<ObjectBuffer> values[numObjects];
+    Tub<MultiReadObject> objects[numObjects];
+    MultiReadObject* requests[numObjects];
+    for (uint32_t i = 0; i < numObjects; i++) {
+        keys[i] = format("key%u", i);
+        // Leave every third object unwritten.
+        if (i % 3 != 0) {
+            ramcloud->write(tableId1, keys[i].c_str(), downCast<uint16_t>(
+                    keys[i].length()), format("value%u", i).c_str());
+        }
+        objects[i].construct(tableId1, keys[i].c_str(),
+                downCast<uint16_t>(keys[i].length()), &values[i]);
+        requests[i] = objects[i].get();
+    }
+    ramcloud->multiRead(requests, numObjects);
+
+    for (uint32_t i = 0; i < numObjects; i++) {
+        if (i % 3 == 0) {
+            EXPECT_EQ(STATUS_OBJECT_DOESNT_EXIST, objects[i]->status);
+            continue;
+        }
+        EXPECT_EQ(STATUS_OK, objects[i]->status);
+        uint32_t length;
+        const void* value = values[i]->getValue(&length);
+        EXPECT_EQ(format("value%u", i),
+                string(reinterpret_cast<const char*>(value), length));
+    }
+}
+
 TEST_F(MasterServiceTest, multiRead_bufferSizeExceeded) {
     uint64_t tableId1 = ramcloud->createTable("table1");
     service->maxResponseRpcLen = 78;
@@ -1626,6 +1726,36 @@ TEST_F(MasterServiceTest, multiWrite_basics) {
     EXPECT_EQ(2U, request2.version);
 }
 
+TEST_F(MasterServiceTest, multiWrite_multiplePrefetchBatches) {
+    uint64_t tableId1 = ramcloud->createTable("table1");
+    const uint32_t numObjects = 2 * ObjectManager::MAX_PREFETCH_BATCH + 3;
+    string keys[numObjects];
+    string values[numObjects];
+    Tub<MultiWriteObject> objects[numObjects];
+    MultiWriteObject* requests[numObjects];
+    for (uint32_t i = 0; i < numObjects; i++) {
+        keys[i] = format("key%u", i);
+        values[i] = format("value%u", i);
+        // Overwrite every third object.
+        if (i % 3 == 0)
+            ramcloud->write(tableId1, keys[i].c_str(), downCast<uint16_t>(
+                    keys[i].length()), "old");
+        objects[i].construct(tableId1, keys[i].c_str(),
+                downCast<uint16_t>(keys[i].length()), values[i].c_str(),
+                downCast<uint32_t>(values[i].length()));
+        requests[i] = objects[i].get();
+    }
+    ramcloud->multiWrite(requests, numObjects);
+
+    for (uint32_t i = 0; i < numObjects; i++) {
+        EXPECT_EQ(STATUS_OK, objects[i]->status);
+        Buffer value;
+        ramcloud->read(tableId1, keys[i].c_str(),
+                downCast<uint16_t>(keys[i].length()), &value);
+        EXPECT_EQ(values[i], TestUtil::toString(&value));
+    }
+}
+
 TEST_F(MasterServiceTest, multiWrite_rejectRules) {
     RejectRules rules;
     memset(&rules, 0, sizeof(rules));
@@ -4661,13 +4791,16 @@ class MasterRecoverTest : public ::testing::Test {
     { }
 
     MasterService*
-    createMasterService()
+    createMasterService(uint32_t replayQueueDepth = 0,
+                        uint32_t recoveryChunkBytes = 0)
     {
         ServerConfig config = ServerConfig::forTesting();
         config.localLocator = "mock:host=master";
         config.services = {WireFormat::MASTER_SERVICE,
                 WireFormat::ADMIN_SERVICE};
         config.master.numReplicas = 2;
+        config.master.replayQueueDepth = replayQueueDepth;
+        config.master.recoveryChunkBytes = recoveryChunkBytes;
         return cluster.addServer(config)->master.get();
     }
 
@@ -4749,6 +4882,93 @@ TEST_F(MasterRecoverTest, recover) {
             "recover: Segment 87 replay complete"));
 }
 
+TEST_F(MasterRecoverTest, recover_replayQueue) {
+    MasterService* master = createMasterService(1);
+
+    Context context2;
+    ServerList serverList2(&context2);
+    context2.transportManager->registerMock(&cluster.transport);
+    serverList2.testingAdd({backup1Id, "mock:host=backup1",
+            {WireFormat::BACKUP_SERVICE, WireFormat::ADMIN_SERVICE},
+            100, ServerStatus::UP});
+    ServerId serverId(99, 0);
+    ReplicaManager mgr(&context2, &serverId, 1, false, false);
+    MasterServiceTest::writeRecoverableSegment(&context, mgr, serverId, 99, 87,
+                                               23);
+    MasterServiceTest::writeRecoverableSegment(&context, mgr, serverId, 99, 88,
+                                               45);
+
+    ProtoBuf::RecoveryPartition recoveryPartition;
+    createRecoveryPartition(recoveryPartition);
+    BackupClient::startReadingData(&context, backup1Id, 456lu, ServerId(99));
+    BackupClient::StartPartitioningReplicas(&context, backup1Id, 456lu,
+            ServerId(99), &recoveryPartition);
+
+    vector<MasterService::Replica> replicas {
+        { backup1Id.getId(), 87 },
+        { backup1Id.getId(), 88 },
+    };
+    std::unordered_map<uint64_t, uint64_t> nextNodeIdMap;
+    master->recover(456lu, ServerId(99, 0), 0, replicas, nextNodeIdMap);
+
+    // Both segments were replayed in the background before recover()
+    // returned.
+    foreach (auto& replica, replicas)
+        EXPECT_EQ(MasterService::Replica::State::OK, replica.state);
+    EXPECT_EQ(45U, master->objectManager.segmentManager.safeVersion);
+}
+
+TEST_F(MasterRecoverTest, recover_inPieces) {
+    MasterService* master = createMasterService(0, 4);
+
+    Context context2;
+    ServerList serverList2(&context2);
+    context2.transportManager->registerMock(&cluster.transport);
+    serverList2.testingAdd({backup1Id, "mock:host=backup1",
+            {WireFormat::BACKUP_SERVICE, WireFormat::ADMIN_SERVICE},
+            100, ServerStatus::UP});
+    ServerId serverId(99, 0);
+    ReplicaManager mgr(&context2, &serverId, 1, false, false);
+    MasterServiceTest::writeRecoverableSegment(&context, mgr, serverId, 99, 87,
+                                               23);
+    MasterServiceTest::writeRecoverableSegment(&context, mgr, serverId, 99, 88,
+                                               45);
+
+    ProtoBuf::RecoveryPartition recoveryPartition;
+    createRecoveryPartition(recoveryPartition);
+    BackupClient::startReadingData(&context, backup1Id, 456lu, ServerId(99));
+    BackupClient::StartPartitioningReplicas(&context, backup1Id, 456lu,
+            ServerId(99), &recoveryPartition);
+
+    vector<MasterService::Replica> replicas {
+        { backup1Id.getId(), 87 },
+        { backup1Id.getId(), 88 },
+    };
+    uint64_t readBytes = metrics->master.segmentReadByteCount;
+    TestLog::Enable _("recover", "getRecoveryData", NULL);
+    std::unordered_map<uint64_t, uint64_t> nextNodeIdMap;
+    master->recover(456lu, ServerId(99, 0), 0, replicas, nextNodeIdMap);
+
+    // Each segment took several 4-byte rpcs, and was replayed once all of
+    // it had arrived.
+    EXPECT_LT(readBytes, metrics->master.segmentReadByteCount);
+    string log = TestLog::get();
+    string request = "getRecoveryData masterId 99.0, segmentId 87";
+    size_t requests = 0;
+    for (size_t pos = log.find(request); pos != string::npos;
+            pos = log.find(request, pos + 1)) {
+        requests++;
+    }
+    EXPECT_LT(1u, requests);
+    EXPECT_NE(string::npos, TestLog::get().find(
+            "recover: Segment 87 replay complete"));
+    EXPECT_NE(string::npos, TestLog::get().find(
+            "recover: Segment 88 replay complete"));
+    foreach (auto& replica, replicas)
+        EXPECT_EQ(MasterService::Replica::State::OK, replica.state);
+    EXPECT_EQ(45U, master->objectManager.segmentManager.safeVersion);
+}
+
 TEST_F(MasterRecoverTest, failedToRecoverAll) {
     MasterService* master = createMasterService();
 
@@ -17,6 +17,7 @@
 #ifndef RAMCLOUD_MASTERTABLEMETADATA_H
 #define RAMCLOUD_MASTERTABLEMETADATA_H
 
+#include <atomic>
 #include <unordered_map>
 #include "Common.h"
 #include "SpinLock.h"
@@ -67,9 +68,14 @@ class MasterTableMetadata {
         uint64_t tableId;
         TableStats::Block stats;
 
+        /// True if values of objects written to this table are compressed
+        /// in the log (see ObjectManager::setTableCompression()).
+        std::atomic<bool> compressValues;
+
         explicit Entry(uint64_t tableId)
             : tableId(tableId)
             , stats()
+            , compressValues(false)
         {}
     };
 
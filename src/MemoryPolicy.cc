@@ -0,0 +1,411 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <fstream>
+
+#include "MemoryPolicy.h"
+#include "ShortMacros.h"
+#include "StringUtil.h"
+
+// Older headers don't define the hugetlb page size selectors.
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+namespace RAMCloud {
+
+/// The highest NUMA node number (plus one) that policies can refer to.
+static const int MAX_NODES = 1024;
+
+/// Number of words in a node mask covering MAX_NODES.
+static const int NODEMASK_WORDS = MAX_NODES / (8 * sizeof(unsigned long));
+
+/**
+ * Return the first line of a (sysfs) file, or an empty string if it can't
+ * be read.
+ */
+static string
+readFirstLine(const string& path)
+{
+    std::ifstream file(path.c_str());
+    string line;
+    std::getline(file, line);
+    return line;
+}
+
+/**
+ * Construct the default policy: small pages from whichever node touches
+ * them first. This is what LargeBlockOfMemory has always provided.
+ */
+MemoryPolicy::MemoryPolicy()
+    : pageSize(SMALL_PAGES)
+    , placement(LOCAL)
+    , node(0)
+{
+}
+
+/**
+ * Construct a policy from its string form.
+ *
+ * \param spec
+ *      A comma-separated list of options. "small" (the default), "thp",
+ *      "2m", or "1g" select the page size; "local" (the default),
+ *      "node=N", or "interleave" select the NUMA placement. For example,
+ *      "1g,node=0". An empty string selects the default policy.
+ * \throw Exception
+ *      If \a spec contains an unknown option.
+ */
+MemoryPolicy::MemoryPolicy(const string& spec)
+    : pageSize(SMALL_PAGES)
+    , placement(LOCAL)
+    , node(0)
+{
+    foreach (const string& option, StringUtil::split(spec, ',')) {
+        if (option.empty() || option == "small") {
+            pageSize = SMALL_PAGES;
+        } else if (option == "thp") {
+            pageSize = TRANSPARENT_HUGE_PAGES;
+        } else if (option == "2m") {
+            pageSize = HUGE_PAGES_2MB;
+        } else if (option == "1g") {
+            pageSize = HUGE_PAGES_1GB;
+        } else if (option == "local") {
+            placement = LOCAL;
+        } else if (option == "interleave") {
+            placement = INTERLEAVE;
+        } else if (StringUtil::startsWith(option, "node=")) {
+            bool error;
+            int64_t n = StringUtil::stringToInt(option.c_str() + 5, &error);
+            if (error || n < 0 || n >= MAX_NODES) {
+                throw Exception(HERE, format("Invalid NUMA node in memory "
+                        "policy option \"%s\"", option.c_str()));
+            }
+            placement = BIND;
+            node = downCast<int>(n);
+        } else {
+            throw Exception(HERE, format("Unknown memory policy option "
+                    "\"%s\"", option.c_str()));
+        }
+    }
+}
+
+/**
+ * Apply the parts of this policy that are set after mapping memory, and
+ * that must be set before the memory is first touched: transparent huge
+ * pages and NUMA placement. Failures are logged, and leave the memory with
+ * the kernel's defaults.
+ *
+ * \param block
+ *      Page-aligned start of the newly mapped memory.
+ * \param length
+ *      Number of bytes mapped at \a block.
+ * \return
+ *      True if everything requested was applied.
+ */
+bool
+MemoryPolicy::apply(void* block, size_t length) const
+{
+    bool success = true;
+
+    if (pageSize == TRANSPARENT_HUGE_PAGES &&
+            madvise(block, length, MADV_HUGEPAGE) != 0) {
+        LOG(WARNING, "Couldn't enable transparent huge pages for %lu-byte "
+            "block at %p: %s", length, block, strerror(errno));
+        success = false;
+    }
+
+    if (placement != LOCAL) {
+        vector<int> nodes;
+        if (placement == BIND) {
+            nodes.push_back(node);
+        } else {
+            getOnlineNodes(&nodes);
+        }
+
+        unsigned long nodemask[NODEMASK_WORDS] = { 0 };
+        const int bitsPerWord = 8 * sizeof(unsigned long);
+        foreach (int n, nodes) {
+            if (n >= 0 && n < MAX_NODES)
+                nodemask[n / bitsPerWord] |= 1UL << (n % bitsPerWord);
+        }
+
+        // libnuma's mbind() is just this system call; calling it directly
+        // avoids depending on the library.
+        int mode = (placement == BIND) ? MPOL_BIND : MPOL_INTERLEAVE;
+        if (syscall(SYS_mbind, block, length, mode, nodemask,
+                    MAX_NODES + 1, 0) != 0) {
+            LOG(WARNING, "Couldn't set NUMA policy \"%s\" for %lu-byte "
+                "block at %p: %s", toString().c_str(), length, block,
+                strerror(errno));
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+/**
+ * If this policy binds memory to one NUMA node, restrict the calling
+ * thread to the cores of that node, so that threads accessing the memory
+ * don't have to cross sockets. Threads inherit this restriction from the
+ * thread that creates them, so calling this early in main() covers the
+ * dispatch, worker, and cleaner threads. Otherwise this does nothing.
+ */
+void
+MemoryPolicy::bindCurrentThread() const
+{
+    if (placement != BIND)
+        return;
+    if (bindThreadToNode(node)) {
+        LOG(NOTICE, "Threads restricted to the cores of NUMA node %d",
+            node);
+    }
+}
+
+/**
+ * Restrict the calling thread to the cores of one NUMA node. Failures are
+ * logged and leave the thread's affinity unchanged.
+ *
+ * \param node
+ *      The node whose cores the thread may run on.
+ * \return
+ *      True if the thread's affinity was changed.
+ */
+bool
+MemoryPolicy::bindThreadToNode(int node)
+{
+    vector<int> cpus;
+    if (!parseList(readFirstLine(format(
+            "/sys/devices/system/node/node%d/cpulist", node)), &cpus)) {
+        LOG(WARNING, "Couldn't find the cores of NUMA node %d", node);
+        return false;
+    }
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    foreach (int cpu, cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &cpuSet);
+    }
+    if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0) {
+        LOG(WARNING, "Couldn't restrict thread to NUMA node %d: %s",
+            node, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Return the NUMA node holding the page at a given address, faulting the
+ * page in first if it hasn't been touched yet. Returns -1 if the kernel
+ * can't tell (for example, if it was built without NUMA support).
+ */
+int
+MemoryPolicy::getNode(const void* address)
+{
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, NULL, 0, address,
+                MPOL_F_NODE | MPOL_F_ADDR) != 0) {
+        return -1;
+    }
+    return node;
+}
+
+/**
+ * Fill in the list of NUMA nodes that are online. Machines (or kernels)
+ * without NUMA support report a single node 0.
+ */
+void
+MemoryPolicy::getOnlineNodes(vector<int>* nodes)
+{
+    nodes->clear();
+    if (!parseList(readFirstLine("/sys/devices/system/node/online"),
+                   nodes) || nodes->empty()) {
+        nodes->clear();
+        nodes->push_back(0);
+    }
+}
+
+/**
+ * Return a human-readable description of what a block of memory actually
+ * got from the kernel, which may be less than this policy asked for (for
+ * example, if there weren't enough huge pages reserved). Pages that have
+ * not been touched yet aren't counted.
+ *
+ * \param block
+ *      Start of a block of memory mapped by LargeBlockOfMemory.
+ * \param length
+ *      Number of bytes mapped at \a block.
+ */
+string
+MemoryPolicy::describe(void* block, size_t length) const
+{
+    // Find the block's mapping in /proc/self/smaps; it's the one whose
+    // address range contains the block's start.
+    uint64_t kernelPageKB = 0;
+    uint64_t hugeKB = 0;
+    uintptr_t address = reinterpret_cast<uintptr_t>(block);
+    bool inMapping = false;
+    std::ifstream smaps("/proc/self/smaps");
+    string line;
+    while (std::getline(smaps, line)) {
+        unsigned long start, end;
+        if (sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2) {
+            if (inMapping)
+                break;
+            inMapping = (start <= address && address < end);
+            continue;
+        }
+        if (!inMapping)
+            continue;
+        unsigned long kb;
+        if (sscanf(line.c_str(), "KernelPageSize: %lu kB", &kb) == 1)
+            kernelPageKB = kb;
+        else if (sscanf(line.c_str(), "AnonHugePages: %lu kB", &kb) == 1)
+            hugeKB += kb;
+        else if (sscanf(line.c_str(), "ShmemPmdMapped: %lu kB", &kb) == 1)
+            hugeKB += kb;
+    }
+
+    string result;
+    if (kernelPageKB >= 2048) {
+        result = format("%lu MB hugetlb pages", kernelPageKB / 1024);
+    } else {
+        result = format("%lu KB pages", kernelPageKB);
+        if (pageSize == TRANSPARENT_HUGE_PAGES || hugeKB > 0) {
+            result += format(", %lu of %lu MB in transparent huge pages",
+                             hugeKB / 1024, length >> 20);
+        }
+    }
+
+    int mode = 0;
+    if (syscall(SYS_get_mempolicy, &mode, NULL, 0, block,
+                MPOL_F_ADDR) == 0) {
+        if (mode == MPOL_BIND)
+            result += ", bound";
+        else if (mode == MPOL_INTERLEAVE)
+            result += ", interleaved";
+        else
+            result += ", local";
+    }
+    int firstNode = -1;
+    if (syscall(SYS_get_mempolicy, &firstNode, NULL, 0, block,
+                MPOL_F_NODE | MPOL_F_ADDR) == 0) {
+        result += format(", first page on node %d", firstNode);
+    }
+    return result;
+}
+
+/**
+ * Return the size of the pages this policy asks for. LargeBlockOfMemory
+ * rounds hugetlb mappings up to a multiple of this.
+ */
+size_t
+MemoryPolicy::getPageBytes() const
+{
+    switch (pageSize) {
+    case HUGE_PAGES_2MB:
+        return 2UL << 20;
+    case HUGE_PAGES_1GB:
+        return 1UL << 30;
+    default:
+        return sysconf(_SC_PAGESIZE);
+    }
+}
+
+/**
+ * Return the extra mmap(2) flags needed to get this policy's pages, or
+ * 0 if it uses regular (possibly transparently huge) pages.
+ */
+int
+MemoryPolicy::getMmapFlags() const
+{
+    switch (pageSize) {
+    case HUGE_PAGES_2MB:
+        return MAP_HUGETLB | MAP_HUGE_2MB;
+    case HUGE_PAGES_1GB:
+        return MAP_HUGETLB | MAP_HUGE_1GB;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Return true if this policy asks for nothing beyond the kernel's defaults.
+ */
+bool
+MemoryPolicy::isDefault() const
+{
+    return pageSize == SMALL_PAGES && placement == LOCAL;
+}
+
+/**
+ * Return the string form of this policy, as accepted by the constructor.
+ */
+string
+MemoryPolicy::toString() const
+{
+    static const char* pageSizes[] = { "small", "thp", "2m", "1g" };
+    string result = pageSizes[pageSize];
+    if (placement == BIND)
+        result += format(",node=%d", node);
+    else if (placement == INTERLEAVE)
+        result += ",interleave";
+    return result;
+}
+
+/**
+ * Parse a list of numbers in the format Linux uses for sets of cores and
+ * NUMA nodes in sysfs, such as "0-3,8,10-11".
+ *
+ * \param list
+ *      The list to parse.
+ * \param[out] values
+ *      The numbers in the list are appended here, in order.
+ * \return
+ *      False if \a list is empty or malformed.
+ */
+bool
+MemoryPolicy::parseList(const string& list, vector<int>* values)
+{
+    if (list.empty())
+        return false;
+    foreach (const string& range, StringUtil::split(list, ',')) {
+        int first, last;
+        char extra;
+        int n = sscanf(range.c_str(), "%d-%d%c", &first, &last, &extra);
+        if (n == 1) {
+            last = first;
+        } else if (n != 2 || first > last) {
+            return false;
+        }
+        for (int i = first; i <= last; i++)
+            values->push_back(i);
+    }
+    return true;
+}
+
+} // namespace RAMCloud
@@ -0,0 +1,93 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef RAMCLOUD_MEMORYPOLICY_H
+#define RAMCLOUD_MEMORYPOLICY_H
+
+#include "Common.h"
+
+namespace RAMCloud {
+
+/**
+ * A MemoryPolicy describes how the large, long-lived blocks of memory that
+ * back log seglets and the HashTable should be provided by the kernel:
+ * which page size to use (fewer, larger pages mean fewer TLB misses when
+ * accessing the blocks randomly) and which NUMA node(s) the pages should
+ * come from.
+ *
+ * Policies are requested with a short string (see the constructor), which
+ * comes from ServerConfig::Master::memoryPolicy. Whatever can't be obtained
+ * falls back to the kernel's defaults, so LargeBlockOfMemory reports what
+ * each block actually got (see describe()).
+ */
+class MemoryPolicy {
+  public:
+    /// Which pages to back memory with.
+    enum PageSize {
+        /// The system's base pages (usually 4 KB).
+        SMALL_PAGES,
+
+        /// Base pages that the kernel may collapse into 2 MB pages
+        /// (madvise(MADV_HUGEPAGE)).
+        TRANSPARENT_HUGE_PAGES,
+
+        /// Pages from the 2 MB or 1 GB hugetlbfs pools. These must have
+        /// been reserved ahead of time (e.g. vm.nr_hugepages).
+        HUGE_PAGES_2MB,
+        HUGE_PAGES_1GB,
+    };
+
+    /// Which NUMA node(s) to take pages from.
+    enum Placement {
+        /// The kernel's default: the node of the thread that touches each
+        /// page first.
+        LOCAL,
+
+        /// Only the node given by #node.
+        BIND,
+
+        /// Spread pages round-robin across all nodes.
+        INTERLEAVE,
+    };
+
+    MemoryPolicy();
+    explicit MemoryPolicy(const string& spec);
+
+    bool apply(void* block, size_t length) const;
+    void bindCurrentThread() const;
+    string describe(void* block, size_t length) const;
+    size_t getPageBytes() const;
+    int getMmapFlags() const;
+    bool isDefault() const;
+    string toString() const;
+
+    static bool bindThreadToNode(int node);
+    static int getNode(const void* address);
+    static void getOnlineNodes(vector<int>* nodes);
+    static bool parseList(const string& list, vector<int>* values);
+
+    /// Page size requested.
+    PageSize pageSize;
+
+    /// NUMA placement requested.
+    Placement placement;
+
+    /// If #placement is BIND, the node to allocate from.
+    int node;
+};
+
+} // namespace RAMCloud
+
+#endif // RAMCLOUD_MEMORYPOLICY_H
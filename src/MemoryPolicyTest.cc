@@ -0,0 +1,92 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "TestUtil.h"
+#include "LargeBlockOfMemory.h"
+#include "MemoryPolicy.h"
+
+namespace RAMCloud {
+
+class MemoryPolicyTest : public ::testing::Test {
+  public:
+    TestLog::Enable logEnabler;
+
+    MemoryPolicyTest()
+        : logEnabler()
+    {
+    }
+
+    DISALLOW_COPY_AND_ASSIGN(MemoryPolicyTest);
+};
+
+TEST_F(MemoryPolicyTest, constructor) {
+    MemoryPolicy defaults("");
+    EXPECT_TRUE(defaults.isDefault());
+    EXPECT_EQ("small", defaults.toString());
+
+    MemoryPolicy policy("1g,node=3");
+    EXPECT_EQ(MemoryPolicy::HUGE_PAGES_1GB, policy.pageSize);
+    EXPECT_EQ(MemoryPolicy::BIND, policy.placement);
+    EXPECT_EQ(3, policy.node);
+    EXPECT_EQ("1g,node=3", policy.toString());
+    EXPECT_FALSE(policy.isDefault());
+
+    EXPECT_EQ("thp,interleave", MemoryPolicy("thp,interleave").toString());
+    EXPECT_EQ("2m", MemoryPolicy("interleave,2m,local").toString());
+
+    EXPECT_THROW(MemoryPolicy("huge"), Exception);
+    EXPECT_THROW(MemoryPolicy("node=x"), Exception);
+    EXPECT_THROW(MemoryPolicy("node=-1"), Exception);
+}
+
+TEST_F(MemoryPolicyTest, getMmapFlags) {
+    EXPECT_EQ(0, MemoryPolicy("thp").getMmapFlags());
+    EXPECT_NE(0, MemoryPolicy("2m").getMmapFlags() & MAP_HUGETLB);
+    EXPECT_NE(MemoryPolicy("2m").getMmapFlags(),
+              MemoryPolicy("1g").getMmapFlags());
+    EXPECT_EQ(2UL << 20, MemoryPolicy("2m").getPageBytes());
+    EXPECT_EQ(1UL << 30, MemoryPolicy("1g").getPageBytes());
+}
+
+TEST_F(MemoryPolicyTest, parseList) {
+    vector<int> values;
+    EXPECT_TRUE(MemoryPolicy::parseList("0-2,5,7-8", &values));
+    EXPECT_EQ((vector<int>{0, 1, 2, 5, 7, 8}), values);
+
+    values.clear();
+    EXPECT_FALSE(MemoryPolicy::parseList("", &values));
+    EXPECT_FALSE(MemoryPolicy::parseList("3-1", &values));
+    EXPECT_FALSE(MemoryPolicy::parseList("a", &values));
+}
+
+TEST_F(MemoryPolicyTest, largeBlockOfMemory_transparentHugePages) {
+    LargeBlockOfMemory<uint8_t> block(4 << 20, MemoryPolicy("thp"));
+    ASSERT_TRUE(block.get() != NULL);
+    EXPECT_EQ(4U << 20, block.length);
+    block.get()[0] = 1;
+    block.get()[block.length - 1] = 1;
+    EXPECT_NE(string::npos, TestLog::get().find("memory policy thp"));
+}
+
+TEST_F(MemoryPolicyTest, largeBlockOfMemory_hugetlbFallback) {
+    // Whether or not huge pages are reserved on this machine, the block
+    // must be usable and no smaller than requested.
+    LargeBlockOfMemory<uint8_t> block((1 << 20) + 1, MemoryPolicy("2m"));
+    ASSERT_TRUE(block.get() != NULL);
+    EXPECT_EQ((1U << 20) + 1, block.length);
+    block.get()[block.length - 1] = 1;
+}
+
+}  // namespace RAMCloud
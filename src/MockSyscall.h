@@ -44,6 +44,7 @@ class MockSyscall : public Syscall {
                     recvErrno(0), recvEof(false), recvfromErrno(0),
                     recvfromEof(false), recvmmsgErrno(0),
                     sendmsgErrno(0), sendmsgReturnCount(-1),
+                    sendmmsgErrno(0), sendmmsgReturnCount(-1),
                     sendtoErrno(0), sendtoReturnCount(-1), setsockoptErrno(0),
                     socketErrno(0), writeErrno(0) {}
 
@@ -268,6 +269,22 @@ class MockSyscall : public Syscall {
         return ::sendmsg(sockfd, msg, flags);
     }
 
+    int sendmmsgErrno;
+    int sendmmsgReturnCount;
+    int sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                 int flags) {
+        if (sendmmsgErrno != 0) {
+            errno = sendmmsgErrno;
+            sendmmsgErrno = 0;
+            return -1;
+        } else if (sendmmsgReturnCount >= 0) {
+            // Simulates sending only some of the messages.
+            vlen = std::min(vlen, unsigned(sendmmsgReturnCount));
+            sendmmsgReturnCount = -1;
+        }
+        return ::sendmmsg(sockfd, msgvec, vlen, flags);
+    }
+
     int sendtoErrno;
     int sendtoReturnCount;
     ssize_t sendto(int socket, const void *buffer, size_t length, int flags,
@@ -92,6 +92,7 @@ MultiFileStorage::Frame::Frame(MultiFileStorage* storage, size_t frameIndex)
     , committedMetadataVersion(0)
     , loadRequested(false)
     , performingIo(false)
+    , inGroupCommitQueue(false)
     , epoch(1)
     , scheduledInEpoch(0)
     , testingHadToWaitForBufferOnLoad(false)
@@ -328,13 +329,14 @@ MultiFileStorage::Frame::append(Buffer& source,
         throw BackupBadSegmentIdException(HERE);
     }
     // Three conditions because overflow is possible on addition.
-    if (length > storage->segmentSize ||
-        destinationOffset > storage->segmentSize ||
-        length + destinationOffset > storage->segmentSize)
+    const size_t frameSize = storage->bytesInFrame(frameIndex);
+    if (length > frameSize ||
+        destinationOffset > frameSize ||
+        length + destinationOffset > frameSize)
     {
         LOG(ERROR, "Out-of-bounds appended attempted on storage frame: "
-            "offset %lu, length %lu, segmentSize %lu ",
-            destinationOffset, length, storage->segmentSize);
+            "offset %lu, length %lu, frame size %lu ",
+            destinationOffset, length, frameSize);
         throw BackupSegmentOverflowException(HERE);
     }
     if (metadataLength > METADATA_SIZE) {
@@ -363,7 +365,9 @@ MultiFileStorage::Frame::append(Buffer& source,
     }
 
     if (!isSynced()) {
-        if (sync) {
+        if (sync && storage->groupCommit) {
+            storage->waitForGroupCommit(lock, this);
+        } else if (sync) {
             performWrite(lock);
         } else {
             schedule(lock, LOW);
@@ -420,13 +424,20 @@ MultiFileStorage::Frame::performTask()
     Lock lock(storage->mutex);
     if (epoch != scheduledInEpoch)
         return;
+
+    // IO started by an earlier call may still be in flight; whoever finishes
+    // it reschedules the frame if there's more to do.
+    if (performingIo)
+        return;
     performingIo = true;
+    bool finished = true;
     if (!isSynced()) {
-        performWrite(lock);
+        finished = performWrite(lock, true);
     } else if (loadRequested && !buffer) {
-        performRead(lock);
+        finished = performRead(lock, true);
     }
-    performingIo = false;
+    if (finished)
+        performingIo = false;
 }
 
 // - protected -
@@ -450,6 +461,12 @@ MultiFileStorage::Frame::free()
     }
     ++epoch;
     deschedule();
+    if (inGroupCommitQueue) {
+        std::vector<Frame*>& queue = storage->groupCommitQueue;
+        queue.erase(std::remove(queue.begin(), queue.end(), this),
+                    queue.end());
+        inGroupCommitQueue = false;
+    }
     if (!isSynced())
         CycleCounter<RawMetric> _(&metrics->backup.uncommittedFramesFreed);
     isOpen = false;
@@ -577,7 +594,7 @@ MultiFileStorage::unlockedRead(Frame::Lock& lock, void* buf, size_t frameIndex,
     memset(cbs, 0, sizeof(struct aiocb) * fds.size());
     size_t frameletStart = offsetOfFramelet(frameIndex);
     for (size_t fileIndex = 0; fileIndex < fds.size(); fileIndex++) {
-        size_t frameletSize = bytesInFramelet(fileIndex);
+        size_t frameletSize = bytesInFramelet(fileIndex, frameIndex);
         struct aiocb* cb = &cbs[fileIndex];
         cb->aio_fildes = fds[fileIndex];
         cb->aio_offset = frameletStart;
@@ -615,7 +632,7 @@ MultiFileStorage::unlockedRead(Frame::Lock& lock, void* buf, size_t frameIndex,
 /**
  * Performs all necessary IO operations to write #count bytes to the Frame
  * identified by #frameIndex, beginning at #offsetInFrame bytes. Also writes
- * out the most recently appended metadata block. DIEs on any problem and
+ * out the metadata block in #metadataBuf. DIEs on any problem and
  * releases #lock during IO.
  *
  * \param lock
@@ -639,73 +656,118 @@ void
 MultiFileStorage::unlockedWrite(Frame::Lock& lock, void* buf, size_t count,
                                 size_t frameIndex, off_t offsetInFrame,
                                 void* metadataBuf, size_t metadataCount)
+{
+    ReplicaWrite write;
+    write.buf = buf;
+    write.count = count;
+    write.frameIndex = frameIndex;
+    write.offsetInFrame = offsetInFrame;
+    write.metadataBuf = metadataBuf;
+    write.metadataCount = metadataCount;
+    write.appendedLength = 0;
+    write.appendedMetadataVersion = 0;
+    unlockedWrite(lock, &write, 1);
+}
+
+/**
+ * Same as above, but for a batch of writes (possibly to different frames)
+ * which are all issued before waiting for any of them. If the storage
+ * performs group commits (see waitForGroupCommit()) the files written are
+ * flushed once at the end rather than once per write. DIEs on any problem
+ * and releases #lock during IO.
+ *
+ * \param lock
+ *     Lock on the storage mutex which must be held before calling. This lock
+ *     is released during IO and reacquired at the end of the method.
+ * \param writes
+ *     The writes to perform; see Frame::startWrite().
+ * \param count
+ *     Number of entries in \a writes.
+ */
+void
+MultiFileStorage::unlockedWrite(Frame::Lock& lock, ReplicaWrite* writes,
+                                size_t count)
 {
     uint64_t start = Cycles::rdtsc();
     CycleCounter<RawMetric> writeTicks(&metrics->backup.storageWriteTicks);
     lock.unlock();
 
-    size_t remaining = count;
-    off_t frameletStart = offsetOfFramelet(frameIndex);
-    off_t offsetInFramelet = offsetInFrame;
-
     // Use asynchronous IO to initiate concurrent IO operations on all of the
-    // storage files to read the replica in parallel.
-    // Keep one control block for each file, plus an extra (the last one) for
-    // metadata.
-    struct aiocb cbs[fds.size() + 1];
-    // Linux documentation recommends clearing control blocks before use. Also,
-    // zeroing everything out makes it safe to call aio_suspend on any control
-    // blocks that don't end up being used.
-    memset(cbs, 0, sizeof(struct aiocb) * (fds.size() + 1));
-    for (size_t fileIndex = 0; remaining > 0; fileIndex++) {
-        size_t frameletSize = bytesInFramelet(fileIndex);
-        if (static_cast<size_t>(offsetInFramelet) > frameletSize) {
-            // The offset that we want to write is past this framelet.
-            offsetInFramelet -= frameletSize;
-            continue;
+    // storage files to write the replicas in parallel.
+    // Keep up to one control block for each file for each write, plus an
+    // extra for each write's metadata. fileIndices records which file each
+    // control block is for; fds.size() marks a metadata write.
+    // Value-initializing the control blocks clears them, as the Linux
+    // documentation recommends.
+    std::vector<struct aiocb> cbs(count * (fds.size() + 1));
+    std::vector<size_t> fileIndices(cbs.size());
+    std::vector<bool> written(fds.size());
+    size_t numCbs = 0;
+    size_t totalBytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        ReplicaWrite* write = &writes[i];
+        void* buf = write->buf;
+        size_t remaining = write->count;
+        off_t frameletStart = offsetOfFramelet(write->frameIndex);
+        off_t offsetInFramelet = write->offsetInFrame;
+        for (size_t fileIndex = 0; remaining > 0; fileIndex++) {
+            size_t frameletSize = bytesInFramelet(fileIndex,
+                                                  write->frameIndex);
+            if (static_cast<size_t>(offsetInFramelet) > frameletSize) {
+                // The offset that we want to write is past this framelet.
+                offsetInFramelet -= frameletSize;
+                continue;
+            }
+
+            size_t bytesToWrite = std::min(frameletSize - offsetInFramelet,
+                                           remaining);
+            struct aiocb* cb = &cbs[numCbs];
+            fileIndices[numCbs++] = fileIndex;
+            cb->aio_fildes = fds[fileIndex];
+            cb->aio_offset = frameletStart + offsetInFramelet;
+            cb->aio_buf = buf;
+            cb->aio_nbytes = bytesToWrite;
+            aio_write(cb);
+            written[fileIndex] = true;
+
+            remaining -= bytesToWrite;
+            buf = static_cast<char*>(buf) + bytesToWrite;
+            offsetInFramelet = 0;
         }
 
-        size_t bytesToWrite = std::min(frameletSize - offsetInFramelet,
-                                       remaining);
-        struct aiocb* cb = &cbs[fileIndex];
-        cb->aio_fildes = fds[fileIndex];
-        cb->aio_offset = frameletStart + offsetInFramelet;
-        cb->aio_buf = buf;
-        cb->aio_nbytes = bytesToWrite;
-        aio_write(cb);
-
-        remaining -= bytesToWrite;
-        buf = static_cast<char*>(buf) + bytesToWrite;
-        offsetInFramelet = 0;
+        // Metadata gets its own IO operation.
+        struct aiocb* metadataCb = &cbs[numCbs];
+        fileIndices[numCbs++] = fds.size();
+        metadataCb->aio_fildes = fds[0];
+        metadataCb->aio_offset = offsetOfFrameMetadata(write->frameIndex);
+        metadataCb->aio_buf = write->metadataBuf;
+        metadataCb->aio_nbytes = write->metadataCount;
+        aio_write(metadataCb);
+        written[0] = true;
+
+        totalBytes += write->count + write->metadataCount;
     }
 
-    // Metadata gets its own IO operation.
-    struct aiocb* metadataCb = &cbs[fds.size()];
-    metadataCb->aio_fildes = fds[0];
-    metadataCb->aio_offset = offsetOfFrameMetadata(frameIndex);
-    metadataCb->aio_buf = metadataBuf;
-    metadataCb->aio_nbytes = metadataCount;
-    aio_write(metadataCb);
-
     // Wait for all of the IO operations to complete.
     bool firstSlowIO = true;
-    for (size_t i = 0; i < fds.size() + 1; i++) {
+    for (size_t i = 0; i < numCbs; i++) {
         struct aiocb* cb = &cbs[i];
+        size_t fileIndex = fileIndices[i];
         aio_suspend(&cb, 1, NULL);
         ssize_t r = aio_return(cb);
         if (r == -1) {
-            if (i == fds.size())
+            if (fileIndex == fds.size())
                 DIE("Failed to write metadata for replica: %s, "
-                    "writing %lu bytes to backup file %lu at offset %lu.",
+                    "writing %lu bytes to backup file 0 at offset %lu.",
                     strerror(aio_error(cb)),
-                    cb->aio_nbytes, i, cb->aio_offset);
+                    cb->aio_nbytes, cb->aio_offset);
             else
                 DIE("Failed to write replica: %s, "
                     "writing %lu bytes to backup file %lu at offset %lu.",
                     strerror(aio_error(cb)),
-                    cb->aio_nbytes, i, cb->aio_offset);
+                    cb->aio_nbytes, fileIndex, cb->aio_offset);
         } else if (r != downCast<ssize_t>(cb->aio_nbytes)) {
-            if (i == fds.size())
+            if (fileIndex == fds.size())
                 DIE("Unexpectedly short write to metadata for replica, "
                     "file 0 at offset %lu, "
                     "expected length %lu, actual write length %lu",
@@ -714,18 +776,22 @@ MultiFileStorage::unlockedWrite(Frame::Lock& lock, void* buf, size_t count,
                 DIE("Unexpectedly short write to replica, "
                     "file %lu at offset %lu, "
                     "expected length %lu, actual write length %lu",
-                    i, cb->aio_offset, cb->aio_nbytes, r);
+                    fileIndex, cb->aio_offset, cb->aio_nbytes, r);
         }
         double elapsedSeconds = Cycles::toSeconds(Cycles::rdtsc() - start);
         if ((elapsedSeconds > 0.1) && firstSlowIO) {
             firstSlowIO = false;
             LOG(WARNING, "Slow write to replica storage on device %lu: %.1f ms "
-                    "for %lu bytes", i, elapsedSeconds*1e03, cb->aio_nbytes);
+                    "for %lu bytes", fileIndex, elapsedSeconds*1e03,
+                    cb->aio_nbytes);
         }
     }
 
+    if (flushAfterWrites)
+        flushFiles(written);
+
     // Reduce our bandwidth (if so configured) by delaying this operation.
-    sleepToThrottleWrites(count + metadataCount, Cycles::rdtsc() - start);
+    sleepToThrottleWrites(totalBytes, Cycles::rdtsc() - start);
 
     uint64_t elapsed = Cycles::rdtsc() - start;
     metrics->backup.storageWriteTicks += elapsed;
@@ -733,6 +799,189 @@ MultiFileStorage::unlockedWrite(Frame::Lock& lock, void* buf, size_t count,
     lock.lock();
 }
 
+/**
+ * Make all completed writes to the given files durable. Only needed when
+ * #flushAfterWrites is set; otherwise the files were opened with O_SYNC (or
+ * durability wasn't asked for). DIEs if a file can't be flushed, since
+ * masters will have been told their data is safe.
+ *
+ * \param written
+ *      One entry per file in #fds; true for each file to flush.
+ */
+void
+MultiFileStorage::flushFiles(const std::vector<bool>& written)
+{
+    for (size_t i = 0; i < fds.size(); i++) {
+        if (!written[i])
+            continue;
+        if (fdatasync(fds[i]) == -1) {
+            DIE("Failed to flush backup file %lu; cannot continue safely: %s",
+                i, strerror(errno));
+        }
+    }
+}
+
+/**
+ * Return once everything appended to \a frame so far is durable, writing it
+ * (and the appends of every other frame waiting at the same time) with a
+ * group commit if no other thread is already doing so. This is how
+ * synchronous appends are made durable when #groupCommit is set: rather than
+ * each append issuing its own write and flush, appends that arrive while a
+ * group commit is in progress queue up and are all written by the next one,
+ * with a single batch of IO and a single flush per file. Under many small
+ * synchronous writers this amortizes the cost of a flush across all of them.
+ *
+ * \param lock
+ *      Lock on #mutex, which must be held. Released while waiting and during
+ *      IO.
+ * \param frame
+ *      Frame that was just appended to. Must have a buffer.
+ */
+void
+MultiFileStorage::waitForGroupCommit(Frame::Lock& lock, Frame* frame)
+{
+    const size_t appendedLength = frame->appendedLength;
+    const uint64_t appendedMetadataVersion = frame->appendedMetadataVersion;
+    const uint64_t epoch = frame->epoch;
+    while (frame->epoch == epoch &&
+           (frame->committedLength < appendedLength ||
+            frame->committedMetadataVersion < appendedMetadataVersion)) {
+        // Queued again if a group commit that was already in progress when
+        // we appended finished without our latest data.
+        if (frame->performingIo) {
+            // The ioQueue is writing the frame; see if that covers us.
+            lock.unlock();
+            lock.lock();
+            continue;
+        }
+        if (!frame->inGroupCommitQueue) {
+            frame->inGroupCommitQueue = true;
+            groupCommitQueue.push_back(frame);
+        }
+        if (groupCommitInProgress)
+            groupCommitFinished.wait(lock);
+        else
+            performGroupCommit(lock);
+    }
+}
+
+/**
+ * Write every frame in #groupCommitQueue to storage in a single batch
+ * and wake up the threads waiting for it in waitForGroupCommit(). Only one
+ * group commit runs at a time; appends that arrive in the meantime wait for
+ * the next.
+ *
+ * \param lock
+ *      Lock on #mutex, which must be held. Released during IO.
+ */
+void
+MultiFileStorage::performGroupCommit(Frame::Lock& lock)
+{
+    assert(!groupCommitInProgress);
+    groupCommitInProgress = true;
+
+    std::vector<Frame*> queue;
+    queue.swap(groupCommitQueue);
+    std::vector<Frame*> batch;
+    std::vector<ReplicaWrite> writes;
+    writes.reserve(queue.size());
+    foreach (Frame* frame, queue) {
+        frame->inGroupCommitQueue = false;
+        // A frame the ioQueue is already writing is left to its waiter,
+        // which queues it again once that write finishes.
+        if (!frame->buffer || frame->isSynced() || frame->performingIo)
+            continue;
+        // Keeps free() and performTask() away from the frame and its buffer
+        // while the lock is released for the write.
+        frame->performingIo = true;
+        writes.emplace_back();
+        frame->startWrite(&writes.back());
+        batch.push_back(frame);
+    }
+
+    if (!writes.empty()) {
+        if (Frame::testingSkipRealIo) {
+            TEST_LOG("%lu replica(s)", writes.size());
+        } else {
+            foreach (ReplicaWrite& write, writes) {
+                ++metrics->backup.storageWriteCount;
+                metrics->backup.storageWriteBytes += write.count;
+                ++PerfStats::threadStats.backupWriteOps;
+                PerfStats::threadStats.backupWriteBytes += write.count;
+            }
+            // Lock released during this call.
+            unlockedWrite(lock, &writes[0], writes.size());
+        }
+        for (size_t i = 0; i < batch.size(); i++) {
+            batch[i]->finishWrite(lock, writes[i]);
+            batch[i]->performingIo = false;
+        }
+    }
+
+    groupCommitInProgress = false;
+    groupCommitFinished.notify_all();
+}
+
+/**
+ * Return true if \a buffer, which was allocated with allocateBuffer(), must
+ * go back to the pool rather than to the OS when it is released, even if the
+ * pool is full. Subclasses that hand pooled buffers to the kernel ahead of
+ * time (see IoUringStorage) use this to keep them valid.
+ */
+bool
+MultiFileStorage::isBufferPinned(void* buffer)
+{
+    return false;
+}
+
+/**
+ * Start reading a frame from storage on behalf of the ioQueue without
+ * waiting for the read to complete. Storage that can keep several frames'
+ * IO in flight (see IoUringStorage) overrides this; MultiFileStorage reads
+ * synchronously instead.
+ *
+ * \param lock
+ *      Lock on #mutex, which must be held. May be released temporarily.
+ * \param frame
+ *      Frame to read; its performingIo is set. If the read is started, the
+ *      storage must move the read buffer into the frame's #buffer and clear
+ *      performingIo once the read completes.
+ * \param buffer
+ *      Buffer to read into; taken over if the read is started.
+ * \return
+ *      True if the read was started, false if the caller must perform it
+ *      synchronously instead.
+ */
+bool
+MultiFileStorage::startFrameRead(Frame::Lock& lock, Frame* frame,
+                                 BufferPtr& buffer)
+{
+    return false;
+}
+
+/**
+ * Start writing a frame to storage on behalf of the ioQueue without waiting
+ * for the write to complete; see startFrameRead().
+ *
+ * \param lock
+ *      Lock on #mutex, which must be held. May be released temporarily.
+ * \param frame
+ *      Frame to write; its performingIo is set. If the write is started,
+ *      the storage must call the frame's finishWrite() and clear
+ *      performingIo once the write completes.
+ * \param write
+ *      The write, as filled in by the frame's startWrite().
+ * \return
+ *      True if the write was started, false if the caller must perform it
+ *      synchronously instead.
+ */
+bool
+MultiFileStorage::startFrameWrite(Frame::Lock& lock, Frame* frame,
+                                  const ReplicaWrite& write)
+{
+    return false;
+}
+
 namespace {
 /**
  * Round \a offset down to a block boundary.
@@ -762,20 +1011,32 @@ roundUp(size_t length)
  * the #buffer member to a buffer pointing to the replica data.
  * Note: the lock on #mutex is released while actual IO is happening so
  * invariants need to be rechecked after the call to unlockedRead.
+ *
+ * \param lock
+ *      Lock on storage->mutex, which must be held.
+ * \param async
+ *      If true, the storage may start the read and return without waiting
+ *      for it (see MultiFileStorage::startFrameRead()).
+ * \return
+ *      False if the read is still in flight, in which case the storage sets
+ *      #buffer and clears #performingIo once it completes.
  */
-void
-MultiFileStorage::Frame::performRead(Lock& lock)
+bool
+MultiFileStorage::Frame::performRead(Lock& lock, bool async)
 {
     assert(loadRequested);
     BufferPtr buffer = storage->allocateBuffer();
+    const size_t frameSize = storage->bytesInFrame(frameIndex);
 
     if (testingSkipRealIo) {
-        TEST_LOG("count %lu frameIndex %lu", storage->segmentSize, frameIndex);
+        TEST_LOG("count %lu frameIndex %lu", frameSize, frameIndex);
     } else {
         ++metrics->backup.storageReadCount;
-        metrics->backup.storageReadBytes += storage->segmentSize;
+        metrics->backup.storageReadBytes += frameSize;
         ++PerfStats::threadStats.backupReadOps;
-        PerfStats::threadStats.backupReadBytes += storage->segmentSize;
+        PerfStats::threadStats.backupReadBytes += frameSize;
+        if (async && storage->startFrameRead(lock, this, buffer))
+            return false;
         // Lock released during this call; assume any field could have changed.
         storage->unlockedRead(lock, buffer.get(), frameIndex,
                               storage->usingDevNull);
@@ -783,6 +1044,7 @@ MultiFileStorage::Frame::performRead(Lock& lock)
 
     assert(!this->buffer);
     this->buffer = std::move(buffer);
+    return true;
 }
 
 /*
@@ -793,48 +1055,99 @@ MultiFileStorage::Frame::performRead(Lock& lock)
  * has been requested by the time the method completes.
  * Note: the lock on #mutex is released while actual IO is happening so
  * invariants need to be rechecked after the call to unlockedWrite.
+ *
+ * \param lock
+ *      Lock on storage->mutex, which must be held.
+ * \param async
+ *      If true, the storage may start the write and return without waiting
+ *      for it (see MultiFileStorage::startFrameWrite()).
+ * \return
+ *      False if the write is still in flight, in which case the storage
+ *      calls finishWrite() and clears #performingIo once it completes.
+ */
+bool
+MultiFileStorage::Frame::performWrite(Lock& lock, bool async)
+{
+    ReplicaWrite write;
+    startWrite(&write);
+
+    if (testingSkipRealIo) {
+        TEST_LOG("sourceBufferOffset %ld count %lu frameIndex %lu",
+                 write.offsetInFrame, write.count, frameIndex);
+    } else {
+        ++metrics->backup.storageWriteCount;
+        metrics->backup.storageWriteBytes += write.count;
+        ++PerfStats::threadStats.backupWriteOps;
+        PerfStats::threadStats.backupWriteBytes += write.count;
+        if (async && storage->startFrameWrite(lock, this, write))
+            return false;
+        // Lock released during this call; assume any field could have changed.
+        storage->unlockedWrite(lock, &write, 1);
+    }
+
+    finishWrite(lock, write);
+    return true;
+}
+
+/**
+ * First half of performWrite(): describe the dirty region of #buffer and
+ * stage the latest appended metadata in its metadata block so they can be
+ * written without holding the lock. Requires #buffer to be set; the caller
+ * must hold the lock on storage->mutex.
+ *
+ * \param[out] write
+ *      Filled in with the region to write, along with snapshots of
+ *      #appendedLength and #appendedMetadataVersion which become committed
+ *      once the write is durable (see finishWrite()).
  */
 void
-MultiFileStorage::Frame::performWrite(Lock& lock)
+MultiFileStorage::Frame::startWrite(ReplicaWrite* write)
 {
     assert(buffer);
 
     const size_t startOfFirstDirtyBlock = roundDown(committedLength);
     const size_t startOfNextCleanBlock = roundUp(appendedLength);
-    const size_t dirtyLength = startOfNextCleanBlock - startOfFirstDirtyBlock;
 
-    char* firstDirtyBlock =
-        static_cast<char*>(buffer.get()) + startOfFirstDirtyBlock;
     char* metadataBlock =
         static_cast<char*>(buffer.get()) + storage->segmentSize;
 
     // Snapshot values which will be needed after the write and the
     // metadata block. Appends to the main buffer that are concurrent
     // with the write are ok.
-    const size_t appendedLength = this->appendedLength;
     memcpy(metadataBlock, appendedMetadata.get(), appendedMetadataLength);
-    const size_t appendedMetadataVersion = this->appendedMetadataVersion;
-
-    if (testingSkipRealIo) {
-        TEST_LOG("sourceBufferOffset %lu count %lu frameIndex %lu",
-                 startOfFirstDirtyBlock, dirtyLength, frameIndex);
-    } else {
-        ++metrics->backup.storageWriteCount;
-        metrics->backup.storageWriteBytes += dirtyLength;
-        ++PerfStats::threadStats.backupWriteOps;
-        PerfStats::threadStats.backupWriteBytes += dirtyLength;
-        // Lock released during this call; assume any field could have changed.
-        storage->unlockedWrite(lock, firstDirtyBlock, dirtyLength,
-                               frameIndex, startOfFirstDirtyBlock,
-                               metadataBlock, METADATA_SIZE);
-    }
+    write->buf = static_cast<char*>(buffer.get()) + startOfFirstDirtyBlock;
+    write->count = startOfNextCleanBlock - startOfFirstDirtyBlock;
+    write->frameIndex = frameIndex;
+    write->offsetInFrame = startOfFirstDirtyBlock;
+    write->metadataBuf = metadataBlock;
+    write->metadataCount = METADATA_SIZE;
+    write->appendedLength = appendedLength;
+    write->appendedMetadataVersion = appendedMetadataVersion;
+}
 
+/**
+ * Second half of performWrite(): once \a write (from startWrite()) is
+ * durable, mark the data and metadata it covered as committed, release
+ * the buffer if it won't be needed in the immediate future, and reschedule
+ * if any additional IO has been requested in the meantime.
+ *
+ * \param lock
+ *      Lock on storage->mutex, which must be held.
+ * \param write
+ *      The write that just completed.
+ */
+void
+MultiFileStorage::Frame::finishWrite(Lock& lock, const ReplicaWrite& write)
+{
     assert(buffer);
 
-    // Update committed based on the above snapshots of fields taken
-    // just before the write.
-    committedLength = appendedLength;
-    committedMetadataVersion = appendedMetadataVersion;
+    // Update committed based on the snapshots of fields taken just before
+    // the write. Another write of this frame may have finished while this
+    // one was in flight (for example, a group commit racing the ioQueue),
+    // so never move backwards.
+    committedLength = std::max(committedLength, write.appendedLength);
+    committedMetadataVersion = std::max(committedMetadataVersion,
+                                        write.appendedMetadataVersion);
 
     // Release the in-memory copy if it won't be used again.
     if (isClosed && isSynced() && !loadRequested && buffer) {
@@ -888,7 +1201,8 @@ void
 MultiFileStorage::BufferDeleter::operator()(void* buffer)
 {
     if (buffer) {
-        if (storage->buffers.size() >= MAX_POOLED_BUFFERS) {
+        if (storage->buffers.size() >= MAX_POOLED_BUFFERS &&
+                !storage->isBufferPinned(buffer)) {
             std::free(buffer);
         } else {
             storage->buffers.push(buffer);
@@ -920,13 +1234,28 @@ MultiFileStorage::BufferDeleter::operator()(void* buffer)
  * \param openFlags
  *      Extra flags for use while opening files in filePathsStr (default to 0,
  *      O_DIRECT may be used to disable the OS buffer cache.
+ * \param groupCommit
+ *      If true, synchronous appends from concurrent writers are coalesced into
+ *      group commits (see waitForGroupCommit()). If \a openFlags asks for
+ *      O_SYNC the files are opened without it and each batch of writes is
+ *      flushed once instead.
+ * \param fragmentFrameCount
+ *      Number of extra frames to set aside for fragments of erasure-coded
+ *      segments, in addition to the \a frameCount segment frames. See
+ *      openFragment().
+ * \param fragmentFrameSize
+ *      Bytes each fragment frame can hold; rounded up to a whole number of
+ *      blocks, and no more than \a segmentSize.
  */
 MultiFileStorage::MultiFileStorage(size_t segmentSize,
                                    size_t frameCount,
                                    size_t writeRateLimit,
                                    size_t maxWriteBuffers,
                                    const char* filePathsStr,
-                                   int openFlags)
+                                   int openFlags,
+                                   bool groupCommit,
+                                   size_t fragmentFrameCount,
+                                   size_t fragmentFrameSize)
     : BackupStorage(segmentSize, Type::DISK, writeRateLimit)
     , mutex()
     , ioQueue()
@@ -934,7 +1263,10 @@ MultiFileStorage::MultiFileStorage(size_t segmentSize,
     , lastSuperblockFrame(1)
     , frames()
     , frameCount(frameCount)
-    , freeMap(frameCount)
+    , fragmentFrameCount(fragmentFrameCount)
+    , fragmentFrameSize(fragmentFrameCount == 0 ? 0 :
+                        std::min(roundUp(fragmentFrameSize), segmentSize))
+    , freeMap(frameCount + fragmentFrameCount)
     , lastAllocatedFrame(FreeMap::npos)
     , openFlags(openFlags)
     , fds()
@@ -943,6 +1275,11 @@ MultiFileStorage::MultiFileStorage(size_t segmentSize,
     , maxWriteBuffers(maxWriteBuffers)
     , bufferDeleter(this)
     , buffers()
+    , groupCommit(groupCommit)
+    , flushAfterWrites(false)
+    , groupCommitQueue()
+    , groupCommitInProgress(false)
+    , groupCommitFinished()
 {
     assert(filePathsStr);
 
@@ -957,6 +1294,13 @@ MultiFileStorage::MultiFileStorage(size_t segmentSize,
             "know what you're doing!");
     }
 
+    // With group commit, a flush at the end of each batch of writes takes
+    // the place of O_SYNC's flush at the end of every write.
+    if (groupCommit && (openFlags & (O_SYNC | O_DSYNC))) {
+        openFlags &= ~(O_SYNC | O_DSYNC);
+        flushAfterWrites = !usingDevNull;
+    }
+
     std::string filePathsCopy(filePathsStr);
     size_t filePathIndex = 0;
     bool doneParsing = false;
@@ -1011,7 +1355,7 @@ MultiFileStorage::MultiFileStorage(size_t segmentSize,
             buffers.emplace_back(allocateBuffer());
     }
 
-    for (size_t frame = 0; frame < frameCount; ++frame)
+    for (size_t frame = 0; frame < frameCount + fragmentFrameCount; ++frame)
         frames.emplace_back(this, frame);
 
     ioQueue.start();
@@ -1019,6 +1363,10 @@ MultiFileStorage::MultiFileStorage(size_t segmentSize,
     LOG(NOTICE, "Backup storage opened with %lu bytes available; allocated %lu "
             "frame(s) across %lu file(s) with %lu bytes per frame",
             frameCount * segmentSize, frameCount, fds.size(), segmentSize);
+    if (fragmentFrameCount != 0) {
+        LOG(NOTICE, "Also allocated %lu fragment frame(s) with %lu bytes per "
+            "frame", fragmentFrameCount, this->fragmentFrameSize);
+    }
 }
 
 /// Close the files.
@@ -1090,10 +1438,11 @@ MultiFileStorage::FrameRef
 MultiFileStorage::open(bool sync, ServerId masterId, uint64_t segmentId)
 {
     Lock lock(mutex);
+    // Fragment frames follow the segment frames; don't hand those out.
     FreeMap::size_type next = freeMap.find_next(lastAllocatedFrame);
-    if (next == FreeMap::npos) {
+    if (next >= frameCount) {
         next = freeMap.find_first();
-        if (next == FreeMap::npos) {
+        if (next >= frameCount) {
             RAMCLOUD_CLOG(WARNING, "Master tried to open a storage frame "
                 "but there are no frames free (all %lu frames are in use); "
                 "rejecting", frameCount);
@@ -1105,13 +1454,32 @@ MultiFileStorage::open(bool sync, ServerId masterId, uint64_t segmentId)
         throw BackupOpenRejectedException(HERE);
     }
     lastAllocatedFrame = next;
-    size_t frameIndex = next;
-    assert(freeMap[frameIndex] == 1);
-    freeMap[frameIndex] = 0;
-    Frame* frame = &frames[frameIndex];
-    lock.unlock();
-    frame->open(sync, masterId, segmentId);
-    return {frame, BackupStorage::freeFrame};
+    return openFrame(lock, next, sync, masterId, segmentId);
+}
+
+/**
+ * Allocate one of the fragment frames (see #fragmentFrameCount) to hold a
+ * fragment of an erasure-coded segment. Falls back to open() if the fragment
+ * might not fit in a fragment frame or they are all in use. See
+ * BackupStorage::openFragment() for details.
+ */
+MultiFileStorage::FrameRef
+MultiFileStorage::openFragment(bool sync, ServerId masterId,
+                               uint64_t segmentId, size_t length)
+{
+    Lock lock(mutex);
+    FreeMap::size_type next = FreeMap::npos;
+    if (length <= fragmentFrameSize) {
+        next = frameCount == 0 ? freeMap.find_first()
+                               : freeMap.find_next(frameCount - 1);
+    }
+    if (next == FreeMap::npos) {
+        lock.unlock();
+        return open(sync, masterId, segmentId);
+    }
+    if (writeBuffersInUse >= maxWriteBuffers)
+        throw BackupOpenRejectedException(HERE);
+    return openFrame(lock, next, sync, masterId, segmentId);
 }
 
 /**
@@ -1369,9 +1737,48 @@ MultiFileStorage::fry()
 
 // - private -
 
+/**
+ * Open a free frame for a new replica; helper for open() and openFragment().
+ *
+ * \param lock
+ *      Lock on #mutex; released before the frame is opened.
+ * \param frameIndex
+ *      Free frame to allocate.
+ * \param sync
+ *      See open().
+ * \param masterId
+ *      See open().
+ * \param segmentId
+ *      See open().
+ */
+MultiFileStorage::FrameRef
+MultiFileStorage::openFrame(Frame::Lock& lock, size_t frameIndex, bool sync,
+                            ServerId masterId, uint64_t segmentId)
+{
+    assert(freeMap[frameIndex] == 1);
+    freeMap[frameIndex] = 0;
+    Frame* frame = &frames[frameIndex];
+    lock.unlock();
+    frame->open(sync, masterId, segmentId);
+    return {frame, BackupStorage::freeFrame};
+}
+
+/**
+ * Returns the number of bytes of replica data a frame can hold: #segmentSize
+ * for segment frames and #fragmentFrameSize for fragment frames.
+ *
+ * \param frameIndex
+ *      Frame to find the size of.
+ */
+size_t
+MultiFileStorage::bytesInFrame(size_t frameIndex) const
+{
+    return frameIndex < frameCount ? segmentSize : fragmentFrameSize;
+}
+
 /**
  * Returns the number of bytes of data that any framelet of a particular file
- * contains.
+ * and frame contains.
  *
  * Data is distributed between framelets as evenly as possible. Framelet sizes
  * must be in increments of BLOCK_SIZE (for O_DIRECT). In the simple case
@@ -1385,21 +1792,27 @@ MultiFileStorage::fry()
  * file leaves empty space (at the beginning of the file for superblocks and
  * after each framelet for metadata) for them in order to keep offsets uniform.
  * This extra space is negligible compared to the size of a segment.
+ * Fragment frames are divided the same way, but are smaller (see
+ * bytesInFrame()).
  *
  * \param fileIndex
  *     File to find the number of bytes in a framelet for.
+ * \param frameIndex
+ *     Frame the framelet is part of.
  */
 size_t
-MultiFileStorage::bytesInFramelet(size_t fileIndex) const
+MultiFileStorage::bytesInFramelet(size_t fileIndex, size_t frameIndex) const
 {
-    return fileIndex < (segmentSize / BLOCK_SIZE) % fds.size() ?
-        roundUp(segmentSize / fds.size()) : roundDown(segmentSize / fds.size());
+    const size_t frameSize = bytesInFrame(frameIndex);
+    return fileIndex < (frameSize / BLOCK_SIZE) % fds.size() ?
+        roundUp(frameSize / fds.size()) : roundDown(frameSize / fds.size());
 }
 
 /**
  * Returns the offset into the files where the framelets associated with a
  * particular frame start. This offset will be the same for every file. See
  * bytesInFramelet() for details on how framelets are divided between files.
+ * Fragment frames are laid out after all of the segment frames.
  *
  * \param frameIndex
  *      Frame to find start of storage for in the files.
@@ -1408,8 +1821,12 @@ off_t
 MultiFileStorage::offsetOfFramelet(size_t frameIndex) const
 {
     const size_t firstFrameStart = offsetOfSuperblockFrame(2);
-    return firstFrameStart +
+    if (frameIndex <= frameCount) {
+        return firstFrameStart +
             frameIndex * (roundUp(segmentSize / fds.size()) + METADATA_SIZE);
+    }
+    return offsetOfFramelet(frameCount) + (frameIndex - frameCount) *
+            (roundUp(fragmentFrameSize / fds.size()) + METADATA_SIZE);
 }
 
 /**
@@ -1424,7 +1841,7 @@ off_t
 MultiFileStorage::offsetOfFrameMetadata(size_t frameIndex) const
 {
     const size_t frameStart = offsetOfFramelet(frameIndex);
-    return frameStart + roundUp(segmentSize / fds.size());
+    return frameStart + roundUp(bytesInFrame(frameIndex) / fds.size());
 }
 
 /**
@@ -1451,12 +1868,12 @@ MultiFileStorage::offsetOfSuperblockFrame(size_t superblockIndex) const
  * the filesystem is out of space later.
  *
  * \throw BackupStorageException
- *      If space for frameCount segments of segmentSize cannot be reserved.
+ *      If space for all of the frames cannot be reserved.
  */
 void
 MultiFileStorage::reserveSpace(int fd)
 {
-    uint64_t logSpace = offsetOfFramelet(frameCount);
+    uint64_t logSpace = offsetOfFramelet(frameCount + fragmentFrameCount);
 
     LOG(DEBUG, "Reserving %lu bytes of log space", logSpace);
     int r = ftruncate(fd, logSpace);
@@ -16,6 +16,7 @@
 #ifndef RAMCLOUD_MULTIFILESTORAGE_H
 #define RAMCLOUD_MULTIFILESTORAGE_H
 
+#include <condition_variable>
 #include <stack>
 
 #include "Common.h"
@@ -43,6 +44,38 @@ class MultiFileStorage : public BackupStorage {
 
     typedef std::unique_ptr<void, BufferDeleter> BufferPtr;
 
+    /**
+     * Describes the dirty region of one frame (plus its metadata block) to
+     * be written to storage by unlockedWrite(), along with the snapshot of
+     * the frame's state that will count as committed once the write is
+     * durable. Filled in by Frame::startWrite().
+     */
+    struct ReplicaWrite {
+        /// Pointer to the buffer that contains the data to write to disk.
+        void* buf;
+
+        /// Number of bytes to write.
+        size_t count;
+
+        /// Identifies which Frame to write to.
+        size_t frameIndex;
+
+        /// Offset into the Frame to write to.
+        off_t offsetInFrame;
+
+        /// Pointer to the buffer that contains the metadata to write to disk.
+        void* metadataBuf;
+
+        /// Number of bytes of metadata to write.
+        size_t metadataCount;
+
+        /// Frame::appendedLength when the write was started.
+        size_t appendedLength;
+
+        /// Frame::appendedMetadataVersion when the write was started.
+        uint64_t appendedMetadataVersion;
+    };
+
     /**
      * Represents both in-memory and on-disk storage of a replica. After opened,
      * a Frame remains associated with the same replica for the lifetime of that
@@ -88,8 +121,10 @@ class MultiFileStorage : public BackupStorage {
       PRIVATE:
         void open(bool sync, ServerId masterId, uint64_t segmentId);
 
-        void performRead(Lock& lock);
-        void performWrite(Lock& lock);
+        bool performRead(Lock& lock, bool async = false);
+        bool performWrite(Lock& lock, bool async = false);
+        void startWrite(ReplicaWrite* write);
+        void finishWrite(Lock& lock, const ReplicaWrite& write);
 
         bool isSynced() const;
 
@@ -194,9 +229,15 @@ class MultiFileStorage : public BackupStorage {
          */
         bool loadRequested;
 
-        /// True if a read or write is ongoing (which is done without a lock).
+        /// True if a read or write is ongoing (which is done without a lock,
+        /// and may outlast performTask(); see startFrameRead()), including
+        /// a group commit that includes this frame.
         bool performingIo;
 
+        /// True if this frame is in storage->groupCommitQueue, waiting for
+        /// the next group commit to write it.
+        bool inGroupCommitQueue;
+
         /**
          * Logical timestamp used to track which lifecycle of the frame io was
          * scheduled during. If a task is scheduled and then freed this can be
@@ -220,6 +261,8 @@ class MultiFileStorage : public BackupStorage {
         // ONLY for open() and isSynced(); please try not to touch other
         // details of frames in MultiFileStorage (or elsewhere).
         friend class MultiFileStorage;
+        // Finishes off the IO it starts in startFrameRead/Write().
+        friend class IoUringStorage;
         DISALLOW_COPY_AND_ASSIGN(Frame);
     };
 
@@ -228,10 +271,15 @@ class MultiFileStorage : public BackupStorage {
                      size_t writeRateLimit,
                      size_t maxNonVolatileBuffers,
                      const char* filePaths,
-                     int openFlags = 0);
+                     int openFlags = 0,
+                     bool groupCommit = false,
+                     size_t fragmentFrameCount = 0,
+                     size_t fragmentFrameSize = 0);
     ~MultiFileStorage();
 
     FrameRef open(bool sync, ServerId masterId, uint64_t segmentId);
+    FrameRef openFragment(bool sync, ServerId masterId, uint64_t segmentId,
+                          size_t length);
     uint32_t benchmark(BackupStrategy backupStrategy);
     size_t getMetadataSize();
     std::vector<FrameRef> loadAllMetadata();
@@ -260,15 +308,28 @@ class MultiFileStorage : public BackupStorage {
     enum { METADATA_SIZE = BLOCK_SIZE };
 
   PRIVATE:
-    size_t bytesInFramelet(size_t fileIndex) const;
+    FrameRef openFrame(Frame::Lock& lock, size_t frameIndex, bool sync,
+                       ServerId masterId, uint64_t segmentId);
+    size_t bytesInFrame(size_t frameIndex) const;
+    size_t bytesInFramelet(size_t fileIndex, size_t frameIndex) const;
     off_t offsetOfFramelet(size_t frameIndex) const;
     off_t offsetOfFrameMetadata(size_t frameIndex) const;
     off_t offsetOfSuperblockFrame(size_t superblockIndex) const;
-    void unlockedRead(Frame::Lock& lock, void* buf, size_t frameIndex,
-                      bool usingDevNull);
+    virtual void unlockedRead(Frame::Lock& lock, void* buf, size_t frameIndex,
+                              bool usingDevNull);
     void unlockedWrite(Frame::Lock& lock, void* buf, size_t count,
                        size_t frameIndex, off_t offsetInFrame,
                        void* metadataBuf, size_t metadataCount);
+    virtual void unlockedWrite(Frame::Lock& lock, ReplicaWrite* writes,
+                               size_t count);
+    virtual bool startFrameRead(Frame::Lock& lock, Frame* frame,
+                                BufferPtr& buffer);
+    virtual bool startFrameWrite(Frame::Lock& lock, Frame* frame,
+                                 const ReplicaWrite& write);
+    void flushFiles(const std::vector<bool>& written);
+    void waitForGroupCommit(Frame::Lock& lock, Frame* frame);
+    void performGroupCommit(Frame::Lock& lock);
+    virtual bool isBufferPinned(void* buffer);
 
     void reserveSpace(int fd);
     Tub<Superblock> tryLoadSuperblock(uint32_t superblockFrame);
@@ -302,6 +363,16 @@ class MultiFileStorage : public BackupStorage {
     /// The number of replicas this storage can store simultaneously.
     const size_t frameCount;
 
+    /**
+     * Number of extra, smaller frames set aside for fragments of
+     * erasure-coded segments (see openFragment()). They follow the
+     * #frameCount segment frames in #frames and on storage.
+     */
+    const size_t fragmentFrameCount;
+
+    /// Bytes of replica data each fragment frame can hold.
+    const size_t fragmentFrameSize;
+
     /// Type of the freeMap.  A bitmap.
     typedef boost::dynamic_bitset<> FreeMap;
     /// Keeps a bit set for each frame in frames indicating if it is free.
@@ -359,6 +430,33 @@ class MultiFileStorage : public BackupStorage {
      */
     std::stack<void*, std::vector<void*>> buffers;
 
+    /**
+     * If true, synchronous appends are written by group commits (see
+     * waitForGroupCommit()) rather than each by itself. Set at construction.
+     */
+    const bool groupCommit;
+
+    /**
+     * True if the files were opened without O_SYNC even though the caller
+     * asked for it (because #groupCommit is set), in which case every batch
+     * of writes ends with a single fdatasync() of each file written.
+     */
+    bool flushAfterWrites;
+
+    /**
+     * Frames with synchronous appends that haven't been picked up by a group
+     * commit yet. The next group commit writes all of them.
+     */
+    std::vector<Frame*> groupCommitQueue;
+
+    /// True while some thread is performing a group commit.
+    bool groupCommitInProgress;
+
+    /// Notified each time a group commit finishes.
+    std::condition_variable groupCommitFinished;
+
+    // Replaces unlockedRead() and unlockedWrite() and needs the file layout.
+    friend class IoUringStorage;
     DISALLOW_COPY_AND_ASSIGN(MultiFileStorage);
 };
 
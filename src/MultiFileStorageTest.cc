@@ -279,6 +279,44 @@ TEST_F(MultiFileStorageTest, Frame_appendSync) {
     EXPECT_STREQ(test, metadata);
 }
 
+TEST_F(MultiFileStorageTest, Frame_appendSyncGroupCommit) {
+    storage1.destroy();
+    storage1.construct(segmentSize, segmentFrames, 0, segmentFrames,
+                       filePath1, O_DIRECT | O_SYNC, true);
+    Frame::testingSkipRealIo = false;
+    BackupStorage::FrameRef frameRefs[3];
+    for (int i = 0; i < 3; i++)
+        frameRefs[i] = storage1->open(true, ServerId(), i);
+
+    // Concurrent synchronous writers to different frames; each must only
+    // return once its own data is durable.
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 3; i++) {
+        writers.emplace_back([&, i] {
+            frameRefs[i]->append(testSource, 0, 5, 0, test, testLength + 1);
+            EXPECT_TRUE(static_cast<Frame*>(frameRefs[i].get())->isSynced());
+        });
+    }
+    foreach (std::thread& writer, writers)
+        writer.join();
+    EXPECT_FALSE(storage1->groupCommitInProgress);
+
+    for (int i = 0; i < 3; i++) {
+        Frame* frame = static_cast<Frame*>(frameRefs[i].get());
+        // Force a read from disk.
+        frame->buffer.reset();
+        {
+            Frame::Lock lock(frame->storage->mutex);
+            frame->loadRequested = true;
+            frame->performRead(lock);
+        }
+        char* replica = bytes(frame->load());
+        EXPECT_STREQ(test, replica);
+        char* metadata = bytes(const_cast<void*>(frame->getMetadata()));
+        EXPECT_STREQ(test, metadata);
+    }
+}
+
 TEST_F(MultiFileStorageTest, Frame_appendNothingAdded) {
     BackupStorage::FrameRef frameRef = storage1->open(false, ServerId(), 0);
     Frame* frame = static_cast<Frame*>(frameRef.get());
@@ -375,6 +413,17 @@ TEST_F(MultiFileStorageTest, Frame_freeNotWriteBuffer) {
     EXPECT_EQ(1lu, storage1->writeBuffersInUse);
 }
 
+TEST_F(MultiFileStorageTest, Frame_freeInGroupCommitQueue) {
+    BackupStorage::FrameRef frameRef = storage1->open(false, ServerId(), 0);
+    Frame* frame = static_cast<Frame*>(frameRef.get());
+    frame->inGroupCommitQueue = true;
+    storage1->groupCommitQueue.push_back(frame);
+    frame->free();
+
+    EXPECT_FALSE(frame->inGroupCommitQueue);
+    EXPECT_TRUE(storage1->groupCommitQueue.empty());
+}
+
 TEST_F(MultiFileStorageTest, Frame_reopen) {
     Frame::testingSkipRealIo = false;
     writeReplica(2, 50, 99LU, 1000LU, false, true);
@@ -538,6 +587,50 @@ TEST_F(MultiFileStorageTest, unlockedWriteMiddleOfSegment) {
     }
 }
 
+TEST_F(MultiFileStorageTest, unlockedWriteSeveralReplicas) {
+    // This test also implicitly tests unlockedRead.
+    Frame::testingSkipRealIo = false;
+    storage2->ioQueue.halt();
+    const char* contents[] = { "first", "second" };
+    BackupStorage::FrameRef frameRefs[2];
+    MultiFileStorage::ReplicaWrite writes[2];
+    for (int i = 0; i < 2; i++) {
+        frameRefs[i] = storage2->open(false, ServerId(), i);
+        Frame* frame = static_cast<Frame*>(frameRefs[i].get());
+        Buffer source;
+        source.appendExternal(contents[i],
+                              downCast<uint32_t>(strlen(contents[i]) + 1));
+        // Straddle the boundary between the framelets in the two files.
+        frame->append(source, 0, source.size(), segmentSize / 2 - 1,
+                      contents[i], strlen(contents[i]) + 1);
+        Frame::Lock lock(storage2->mutex);
+        frame->startWrite(&writes[i]);
+    }
+    {
+        Frame::Lock lock(storage2->mutex);
+        storage2->unlockedWrite(lock, writes, 2);
+        for (int i = 0; i < 2; i++) {
+            static_cast<Frame*>(frameRefs[i].get())->finishWrite(lock,
+                                                                 writes[i]);
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        Frame* frame = static_cast<Frame*>(frameRefs[i].get());
+        // Force a read from disk.
+        frame->buffer.reset();
+        {
+            Frame::Lock lock(frame->storage->mutex);
+            frame->loadRequested = true;
+            frame->performRead(lock);
+        }
+        char* replica = bytes(frame->load());
+        EXPECT_STREQ(contents[i], replica + segmentSize / 2 - 1);
+        char* metadata = bytes(const_cast<void*>(frame->getMetadata()));
+        EXPECT_STREQ(contents[i], metadata);
+    }
+}
+
 TEST_F(MultiFileStorageTest, Frame_performWrite) {
     storage1->ioQueue.halt();
     BackupStorage::FrameRef frameRef = storage1->open(false, ServerId(), 0);
@@ -652,6 +745,101 @@ TEST_F(MultiFileStorageTest, Frame_performWriteSmokeTestOffsets) {
     frame->performTask();
     EXPECT_EQ("performWrite: sourceBufferOffset 1536 count 512 frameIndex 0",
               TestLog::get());
+
+    // Nothing is started while earlier IO is still in flight.
+    frame->append(testSource, 0, 1, 1538, NULL, 0);
+    frame->deschedule();
+    frame->performingIo = true;
+    TestLog::reset();
+    frame->performTask();
+    EXPECT_EQ("", TestLog::get());
+    frame->performingIo = false;
+}
+
+TEST_F(MultiFileStorageTest, waitForGroupCommit) {
+    storage1->ioQueue.halt();
+    BackupStorage::FrameRef frameRef1 = storage1->open(false, ServerId(), 0);
+    BackupStorage::FrameRef frameRef2 = storage1->open(false, ServerId(), 1);
+    BackupStorage::FrameRef frameRef3 = storage1->open(false, ServerId(), 2);
+    Frame* frame1 = static_cast<Frame*>(frameRef1.get());
+    Frame* frame2 = static_cast<Frame*>(frameRef2.get());
+    Frame* frame3 = static_cast<Frame*>(frameRef3.get());
+    frame1->append(testSource, 0, 5, 0, test, testLength + 1);
+    frame2->append(testSource, 0, 5, 0, test, testLength + 1);
+
+    // frame2 is waiting on another thread; frame3 has nothing to write.
+    frame2->inGroupCommitQueue = true;
+    storage1->groupCommitQueue.push_back(frame2);
+    frame3->inGroupCommitQueue = true;
+    storage1->groupCommitQueue.push_back(frame3);
+
+    TestLog::Enable _("performGroupCommit");
+    {
+        Frame::Lock lock(storage1->mutex);
+        storage1->waitForGroupCommit(lock, frame1);
+    }
+    EXPECT_EQ("performGroupCommit: 2 replica(s)", TestLog::get());
+    EXPECT_TRUE(frame1->isSynced());
+    EXPECT_TRUE(frame2->isSynced());
+    EXPECT_FALSE(frame1->inGroupCommitQueue);
+    EXPECT_FALSE(frame2->inGroupCommitQueue);
+    EXPECT_FALSE(frame3->inGroupCommitQueue);
+    EXPECT_TRUE(storage1->groupCommitQueue.empty());
+    EXPECT_FALSE(storage1->groupCommitInProgress);
+
+    // Nothing new appended: returns without another group commit.
+    TestLog::reset();
+    {
+        Frame::Lock lock(storage1->mutex);
+        storage1->waitForGroupCommit(lock, frame1);
+    }
+    EXPECT_EQ("", TestLog::get());
+}
+
+namespace {
+/// Frees a frame from another thread while a group commit is writing it.
+struct FreeDuringWriteStorage : public MultiFileStorage {
+    FreeDuringWriteStorage(size_t segmentSize, size_t frameCount,
+                           const char* filePath)
+        : MultiFileStorage(segmentSize, frameCount, 0, frameCount, filePath,
+                           O_DIRECT | O_SYNC, true)
+        , frame()
+        , freed(false)
+        , freer()
+    {}
+    void unlockedWrite(Frame::Lock& lock, ReplicaWrite* writes, size_t count)
+    {
+        lock.unlock();
+        freer.construct([this] { frame->free(); freed = true; });
+        usleep(10000);
+        EXPECT_FALSE(freed);
+        lock.lock();
+    }
+    Frame* frame;
+    std::atomic<bool> freed;
+    Tub<std::thread> freer;
+    DISALLOW_COPY_AND_ASSIGN(FreeDuringWriteStorage);
+};
+}
+
+TEST_F(MultiFileStorageTest, performGroupCommit_freeDuringWrite) {
+    Frame::testingSkipRealIo = false;
+    FreeDuringWriteStorage storage(segmentSize, segmentFrames, filePath1);
+    storage.ioQueue.halt();
+    BackupStorage::FrameRef frameRef = storage.open(false, ServerId(), 0);
+    Frame* frame = static_cast<Frame*>(frameRef.get());
+    storage.frame = frame;
+    frame->append(testSource, 0, 5, 0, test, testLength + 1);
+
+    {
+        Frame::Lock lock(storage.mutex);
+        storage.waitForGroupCommit(lock, frame);
+        EXPECT_TRUE(frame->isSynced());
+        EXPECT_FALSE(frame->performingIo);
+    }
+    storage.freer->join();
+    EXPECT_TRUE(storage.freed);
+    EXPECT_FALSE(frame->isOpen);
 }
 
 TEST_F(MultiFileStorageTest, Frame_performRead) {
@@ -678,6 +866,19 @@ TEST_F(MultiFileStorageTest, constructor) {
               uint32_t(s.st_size));
 }
 
+TEST_F(MultiFileStorageTest, constructorGroupCommit) {
+    EXPECT_FALSE(storage1->flushAfterWrites);
+    storage1.destroy();
+    storage1.construct(segmentSize, segmentFrames, 0, segmentFrames,
+                       filePath1, O_DIRECT | O_SYNC, true);
+    EXPECT_TRUE(storage1->flushAfterWrites);
+    EXPECT_EQ(0, fcntl(storage1->fds[0], F_GETFL) & O_DSYNC);
+    storage1.destroy();
+    storage1.construct(segmentSize, segmentFrames, 0, segmentFrames,
+                       filePath1, O_DIRECT, true);
+    EXPECT_FALSE(storage1->flushAfterWrites);
+}
+
 TEST_F(MultiFileStorageTest, openFails) {
     TestLog::Enable _;
     EXPECT_THROW(MultiFileStorage(segmentSize,
@@ -736,6 +937,66 @@ TEST_F(MultiFileStorageTest, open_tooManyBuffersInUse) {
                  BackupOpenRejectedException);
 }
 
+TEST_F(MultiFileStorageTest, openFragment) {
+    storage1.construct(segmentSize, segmentFrames, 0, segmentFrames,
+                       filePath1, O_DIRECT | O_SYNC, false, 2, BLOCK_SIZE * 2);
+    BackupStorage::FrameRef fragment1 =
+        storage1->openFragment(false, ServerId(1, 2), 123, BLOCK_SIZE * 2);
+    Frame* frame = static_cast<Frame*>(fragment1.get());
+    EXPECT_EQ(4U, frame->frameIndex);
+    EXPECT_EQ("1.2", frame->masterId.toString());
+    EXPECT_EQ(123LU, frame->segmentId);
+    BackupStorage::FrameRef fragment2 =
+        storage1->openFragment(false, ServerId(), 0, BLOCK_SIZE);
+    EXPECT_EQ(5U, static_cast<Frame*>(fragment2.get())->frameIndex);
+
+    // Too big for a fragment frame, or none left: use a segment frame.
+    fragment1.reset();
+    BackupStorage::FrameRef fragment3 =
+        storage1->openFragment(false, ServerId(), 0, BLOCK_SIZE * 2 + 1);
+    EXPECT_EQ(0U, static_cast<Frame*>(fragment3.get())->frameIndex);
+    BackupStorage::FrameRef fragment4 =
+        storage1->openFragment(false, ServerId(), 0, BLOCK_SIZE * 2);
+    EXPECT_EQ(4U, static_cast<Frame*>(fragment4.get())->frameIndex);
+    BackupStorage::FrameRef fragment5 =
+        storage1->openFragment(false, ServerId(), 0, BLOCK_SIZE * 2);
+    EXPECT_EQ(1U, static_cast<Frame*>(fragment5.get())->frameIndex);
+
+    // Segment replicas never get fragment frames.
+    fragment2.reset();
+    std::vector<BackupStorage::FrameRef> frames;
+    for (uint32_t f = 2; f < segmentFrames; ++f) {
+        storage1->writeBuffersInUse = 0;
+        frames.push_back(storage1->open(false, ServerId(), 0));
+    }
+    storage1->writeBuffersInUse = 0;
+    EXPECT_THROW(storage1->open(false, ServerId(), 0),
+                 BackupOpenRejectedException);
+}
+
+TEST_F(MultiFileStorageTest, openFragment_appendAndLoad) {
+    Frame::testingSkipRealIo = false;
+    storage1.construct(segmentSize, segmentFrames, 0, segmentFrames,
+                       filePath1, O_DIRECT | O_SYNC, false, 2, BLOCK_SIZE * 2);
+    BackupStorage::FrameRef frameRef =
+        storage1->openFragment(true, ServerId(), 0, BLOCK_SIZE * 2);
+    Frame* frame = static_cast<Frame*>(frameRef.get());
+    EXPECT_THROW(frame->append(testSource, 0, 1, BLOCK_SIZE * 2, NULL, 0),
+                 BackupSegmentOverflowException);
+    frame->append(testSource, 0, testLength + 1, 0, test, testLength + 1);
+    frame->close();
+    EXPECT_FALSE(frame->buffer);
+    EXPECT_STREQ(test, bytes(frame->load()));
+    EXPECT_TRUE(frame->testingHadToWaitForBufferOnLoad);
+
+    // The metadata went to the fragment frame's own block.
+    char buf[BLOCK_SIZE];
+    EXPECT_EQ(BLOCK_SIZE,
+              pread(storage1->fds[0], buf, BLOCK_SIZE,
+                    storage1->offsetOfFrameMetadata(4)));
+    EXPECT_STREQ(test, buf);
+}
+
 TEST_F(MultiFileStorageTest, loadAllMetadata) {
     uint8_t ones[storage1->getMetadataSize()];
     memset(ones, 0xff, sizeof(ones));
@@ -937,11 +1198,23 @@ TEST_F(MultiFileStorageTest, offsetOfFramelet) {
                   offset);
     }
 
-    // Check for 32-bit overflow.
-    storage1->segmentSize = 1 << 23;
-    uint64_t offset = storage1->offsetOfFramelet(512);
+    // Fragment frames follow the segment frames.
+    storage1.construct(segmentSize, segmentFrames, 0, segmentFrames,
+                       filePath1, O_DIRECT | O_SYNC, false, 2, BLOCK_SIZE * 2);
+    EXPECT_EQ(2lu * BLOCK_SIZE + 4 * (segmentSize + METADATA_SIZE),
+              storage1->offsetOfFramelet(4));
+    EXPECT_EQ(2lu * BLOCK_SIZE + 4 * (segmentSize + METADATA_SIZE) +
+              BLOCK_SIZE * 2 + METADATA_SIZE,
+              storage1->offsetOfFramelet(5));
+    EXPECT_EQ(storage1->offsetOfFramelet(5) + BLOCK_SIZE * 2,
+              storage1->offsetOfFrameMetadata(5));
+
+    // Check for 32-bit overflow. Indexes past the segment frames are
+    // fragment frames, so grow the segments rather than the index.
+    storage1->segmentSize = 1 << 30;
+    uint64_t offset = storage1->offsetOfFramelet(segmentFrames);
     EXPECT_NE(0lu, offset);
-    EXPECT_EQ(1024lu + 512lu * ((1lu << 23) + 512lu), offset);
+    EXPECT_EQ(1024lu + segmentFrames * ((1lu << 30) + 512lu), offset);
 }
 
 } // namespace RAMCloud
@@ -0,0 +1,242 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+
+#include "Cycles.h"
+#include "MutationTrace.h"
+#include "ShortMacros.h"
+#include "Unlock.h"
+
+namespace RAMCloud {
+
+const char MutationTrace::MAGIC[8] =
+    { 'R', 'C', 'M', 'T', 'R', 'A', 'C', 'E' };
+
+/**
+ * Create a new trace file and start recording.
+ *
+ * \param path
+ *      Name of the file to write the trace to. If it exists, it is
+ *      truncated.
+ * \throw Exception
+ *      If the file couldn't be created.
+ */
+MutationTrace::MutationTrace(const string& path)
+    : file(fopen(path.c_str(), "w"))
+    , startTicks(Cycles::rdtsc())
+    , lock("MutationTrace::lock")
+    , buffer(new Record[BUFFERED_RECORDS])
+    , bufferedRecords(0)
+    , writeBuffer(new Record[BUFFERED_RECORDS])
+    , recordsToWrite(0)
+    , recordsAvailable()
+    , writeBufferFree()
+    , totalRecords(0)
+    , writerThread()
+    , writerThreadExit(false)
+{
+    if (file == NULL) {
+        throw Exception(HERE, format("Couldn't create mutation trace "
+                "file %s", path.c_str()), errno);
+    }
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.recordLength = sizeof(Record);
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        throw Exception(HERE, format("Couldn't write mutation trace "
+                "file %s", path.c_str()), errno);
+    }
+    LOG(NOTICE, "Recording log mutations to %s", path.c_str());
+    writerThread.construct(writerThreadMain, this);
+}
+
+/**
+ * Write out any buffered records and close the trace file.
+ */
+MutationTrace::~MutationTrace()
+{
+    flush();
+    {
+        Lock _(lock);
+        writerThreadExit = true;
+        recordsAvailable.notify_one();
+    }
+    writerThread->join();
+
+    // No lock needed: the writer thread is finished.
+    fclose(file);
+    LOG(NOTICE, "Mutation trace closed after %lu records", totalRecords);
+}
+
+/**
+ * Write all records buffered so far to the trace file, and wait until they
+ * have been.
+ */
+void
+MutationTrace::flush()
+{
+    {
+        Lock guard(lock);
+        if (bufferedRecords > 0)
+            handOff(guard);
+        while (recordsToWrite > 0)
+            writeBufferFree.wait(guard);
+    }
+
+    // Not under #lock, so that record() doesn't wait for the disk. The
+    // writer thread may have been handed more records by now, but stdio
+    // locks the stream for each call, and those records came later anyway.
+    fflush(file);
+}
+
+/**
+ * Add one mutation to the trace. Thread-safe.
+ *
+ * \param type
+ *      What happened to the object.
+ * \param tableId
+ *      Table the object belongs to.
+ * \param keyHash
+ *      Hash of the object's primary key.
+ * \param keyLength
+ *      Total length of the object's keys, in bytes.
+ * \param valueLength
+ *      Length of the object's value, in bytes.
+ */
+void
+MutationTrace::record(Type type, uint64_t tableId, uint64_t keyHash,
+                      uint16_t keyLength, uint32_t valueLength)
+{
+    uint64_t timestamp = Cycles::toNanoseconds(Cycles::rdtsc() - startTicks);
+
+    Lock guard(lock);
+    Record& record = buffer[bufferedRecords++];
+    record.timestamp = timestamp;
+    record.tableId = tableId;
+    record.keyHash = keyHash;
+    record.valueLength = valueLength;
+    record.keyLength = keyLength;
+    record.type = static_cast<uint8_t>(type);
+    if (bufferedRecords == BUFFERED_RECORDS)
+        handOff(guard);
+}
+
+/**
+ * Give the records in #buffer to the writer thread, and start a new buffer.
+ * If the writer thread is still busy with the previous batch (the file
+ * can't keep up), this waits for it rather than dropping records.
+ *
+ * \param lock
+ *      Holds #lock; it is released while waiting.
+ */
+void
+MutationTrace::handOff(Lock& lock)
+{
+    while (recordsToWrite > 0)
+        writeBufferFree.wait(lock);
+    std::swap(buffer, writeBuffer);
+    recordsToWrite = bufferedRecords;
+    bufferedRecords = 0;
+    recordsAvailable.notify_one();
+}
+
+/**
+ * This method is the main program for a separate thread that writes full
+ * buffers of records to the trace file, so that the threads calling
+ * record() never wait for the kernel.
+ *
+ * \param trace
+ *      The owning MutationTrace.
+ */
+void
+MutationTrace::writerThreadMain(MutationTrace* trace)
+{
+    Lock lock(trace->lock);
+    while (true) {
+        if (trace->recordsToWrite == 0) {
+            if (trace->writerThreadExit)
+                return;
+            trace->recordsAvailable.wait(lock);
+            continue;
+        }
+
+        // A failed write is logged and the records are dropped: losing part
+        // of a trace is preferable to failing the writes being traced.
+        uint32_t count = trace->recordsToWrite;
+        {
+            Unlock<SpinLock> unlock(trace->lock);
+            if (fwrite(trace->writeBuffer.get(), sizeof(Record), count,
+                    trace->file) != count) {
+                RAMCLOUD_CLOG(WARNING, "Lost %u mutation trace records: %s",
+                        count, strerror(errno));
+            }
+        }
+        trace->totalRecords += count;
+        trace->recordsToWrite = 0;
+        trace->writeBufferFree.notify_all();
+    }
+}
+
+/**
+ * Open a trace file for reading.
+ *
+ * \param path
+ *      Name of a file written by MutationTrace.
+ * \throw Exception
+ *      If the file can't be opened or wasn't written by a compatible
+ *      MutationTrace.
+ */
+MutationTrace::Reader::Reader(const string& path)
+    : file(fopen(path.c_str(), "r"))
+{
+    if (file == NULL) {
+        throw Exception(HERE, format("Couldn't open mutation trace file %s",
+                path.c_str()), errno);
+    }
+
+    Header header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+            memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 ||
+            header.recordLength != sizeof(Record)) {
+        fclose(file);
+        throw Exception(HERE, format("%s is not a mutation trace file, or "
+                "was written by an incompatible version", path.c_str()));
+    }
+}
+
+MutationTrace::Reader::~Reader()
+{
+    fclose(file);
+}
+
+/**
+ * Read the next record of the trace.
+ *
+ * \param[out] record
+ *      Filled in with the next record.
+ * \return
+ *      False if there are no more records, in which case \a record is
+ *      left unchanged.
+ */
+bool
+MutationTrace::Reader::next(Record* record)
+{
+    return fread(record, sizeof(*record), 1, file) == 1;
+}
+
+} // namespace RAMCloud
@@ -0,0 +1,181 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef RAMCLOUD_MUTATIONTRACE_H
+#define RAMCLOUD_MUTATIONTRACE_H
+
+#include <condition_variable>
+#include <thread>
+
+#include "Common.h"
+#include "SpinLock.h"
+#include "Tub.h"
+
+namespace RAMCloud {
+
+/**
+ * A MutationTrace records, in a compact binary file, every object write and
+ * remove a master applies to its log: which table and key hash it affected,
+ * how large the key and value were, and when it happened. Object contents
+ * are not recorded.
+ *
+ * Masters keep a trace only if ServerConfig::Master::mutationTraceFile is
+ * set. The trace can later be replayed with LogCleanerBenchmark's "trace"
+ * distribution, which drives a real master (and so the real SegmentManager
+ * and LogCleaner) with the recorded object size mix, overwrite skew, and
+ * deletes, so that cleaning policies can be tuned against a production
+ * workload.
+ *
+ * Records are buffered in memory, and full buffers are written out by a
+ * background thread, so tracing costs little more than a memory copy per
+ * mutation. The file is only guaranteed to be complete once the trace has
+ * been destroyed (or flush() has been called).
+ */
+class MutationTrace {
+  public:
+    /// What happened to an object.
+    enum Type {
+        /// An object was written and no previous version existed.
+        WRITE = 0,
+
+        /// An existing object was overwritten.
+        OVERWRITE = 1,
+
+        /// An existing object was removed.
+        REMOVE = 2,
+    };
+
+    /**
+     * One mutation, exactly as it is stored in trace files.
+     */
+    struct Record {
+        /// Nanoseconds since the trace was started.
+        uint64_t timestamp;
+
+        /// Table the object belongs to.
+        uint64_t tableId;
+
+        /// Hash of the object's primary key.
+        uint64_t keyHash;
+
+        /// Length of the object's value in bytes. For removes, the length
+        /// of the value that was removed.
+        uint32_t valueLength;
+
+        /// Length of all of the object's keys in bytes (not counting the
+        /// value).
+        uint16_t keyLength;
+
+        /// A Type value.
+        uint8_t type;
+    } __attribute__((__packed__));
+
+    /**
+     * Stored at the start of every trace file.
+     */
+    struct Header {
+        /// Always #MAGIC.
+        char magic[8];
+
+        /// Size of each Record in the file, in bytes. Lets later versions of
+        /// this class detect trace files written by incompatible versions.
+        uint32_t recordLength;
+    } __attribute__((__packed__));
+
+    /**
+     * Reads the records of a trace file written by MutationTrace, in order.
+     */
+    class Reader {
+      public:
+        explicit Reader(const string& path);
+        ~Reader();
+        bool next(Record* record);
+
+      PRIVATE:
+        /// The trace file being read.
+        FILE* file;
+
+        DISALLOW_COPY_AND_ASSIGN(Reader);
+    };
+
+    explicit MutationTrace(const string& path);
+    ~MutationTrace();
+    void flush();
+    void record(Type type, uint64_t tableId, uint64_t keyHash,
+                uint16_t keyLength, uint32_t valueLength);
+
+  PRIVATE:
+    typedef std::unique_lock<SpinLock> Lock;
+
+    void handOff(Lock& lock);
+    static void writerThreadMain(MutationTrace* trace);
+
+    /// Identifies trace files.
+    static const char MAGIC[8];
+
+    /// Number of records buffered before they're written to the file.
+    static const uint32_t BUFFERED_RECORDS = 64 * 1024;
+
+    /// Where the trace is written.
+    FILE* file;
+
+    /// Time (in Cycles::rdtsc() ticks) the trace was started. Record
+    /// timestamps are relative to this.
+    const uint64_t startTicks;
+
+    /// Serializes access to the fields below. Never held while writing to
+    /// the file.
+    SpinLock lock;
+
+    /// Records are added here by record().
+    std::unique_ptr<Record[]> buffer;
+
+    /// Number of valid records in #buffer.
+    uint32_t bufferedRecords;
+
+    /// Once #buffer fills, it is swapped with this one, which the writer
+    /// thread then writes to the file while #buffer fills up again.
+    std::unique_ptr<Record[]> writeBuffer;
+
+    /// Number of records in #writeBuffer that the writer thread hasn't
+    /// finished writing; 0 means #writeBuffer is free to swap again.
+    uint32_t recordsToWrite;
+
+    /// The writer thread waits on this for #recordsToWrite to become
+    /// nonzero.
+    std::condition_variable_any recordsAvailable;
+
+    /// Used by threads waiting for the writer thread to free up
+    /// #writeBuffer (which only happens if the file can't keep up).
+    std::condition_variable_any writeBufferFree;
+
+    /// Total number of records written to the trace so far. Only used to
+    /// log how large the trace got when it's closed.
+    uint64_t totalRecords;
+
+    /// Writes the records in #writeBuffer to the file, so that threads
+    /// calling record() don't wait for I/O.
+    Tub<std::thread> writerThread;
+
+    /// Set to true to make the writer thread exit once it has written
+    /// everything handed to it.
+    bool writerThreadExit;
+
+    DISALLOW_COPY_AND_ASSIGN(MutationTrace);
+};
+
+} // namespace RAMCloud
+
+#endif // RAMCLOUD_MUTATIONTRACE_H
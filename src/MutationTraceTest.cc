@@ -0,0 +1,111 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "TestUtil.h"
+#include "MutationTrace.h"
+
+namespace RAMCloud {
+
+class MutationTraceTest : public ::testing::Test {
+  public:
+    TestLog::Enable logEnabler;
+    char fileName[100];
+
+    MutationTraceTest()
+        : logEnabler()
+    {
+        strncpy(fileName, "/tmp/ramcloud-trace-test-delete-this-XXXXXX",
+                sizeof(fileName));
+        int fd = mkstemp(fileName);
+        close(fd);
+    }
+
+    ~MutationTraceTest()
+    {
+        unlink(fileName);
+    }
+
+    DISALLOW_COPY_AND_ASSIGN(MutationTraceTest);
+};
+
+TEST_F(MutationTraceTest, recordAndRead) {
+    {
+        MutationTrace trace(fileName);
+        trace.record(MutationTrace::WRITE, 1, 0x1234, 8, 100);
+        trace.record(MutationTrace::OVERWRITE, 1, 0x1234, 8, 200);
+        trace.record(MutationTrace::REMOVE, 2, 0x5678, 30, 200);
+        EXPECT_EQ(3U, trace.bufferedRecords);
+    }
+    EXPECT_EQ("MutationTrace: Recording log mutations to " + string(fileName) +
+              " | ~MutationTrace: Mutation trace closed after 3 records",
+              TestLog::get());
+
+    MutationTrace::Reader reader(fileName);
+    MutationTrace::Record record;
+    ASSERT_TRUE(reader.next(&record));
+    EXPECT_EQ(MutationTrace::WRITE, record.type);
+    EXPECT_EQ(1U, record.tableId);
+    EXPECT_EQ(0x1234U, record.keyHash);
+    EXPECT_EQ(8U, record.keyLength);
+    EXPECT_EQ(100U, record.valueLength);
+    uint64_t firstTimestamp = record.timestamp;
+
+    ASSERT_TRUE(reader.next(&record));
+    EXPECT_EQ(MutationTrace::OVERWRITE, record.type);
+    EXPECT_EQ(200U, record.valueLength);
+    EXPECT_LE(firstTimestamp, record.timestamp);
+
+    ASSERT_TRUE(reader.next(&record));
+    EXPECT_EQ(MutationTrace::REMOVE, record.type);
+    EXPECT_EQ(2U, record.tableId);
+    EXPECT_EQ(30U, record.keyLength);
+    EXPECT_FALSE(reader.next(&record));
+}
+
+TEST_F(MutationTraceTest, record_flushesFullBuffer) {
+    MutationTrace trace(fileName);
+    uint64_t capacity = MutationTrace::BUFFERED_RECORDS;
+    for (uint64_t i = 0; i < capacity + 1; i++)
+        trace.record(MutationTrace::WRITE, 1, i, 8, 100);
+    EXPECT_EQ(1U, trace.bufferedRecords);
+
+    // The full buffer went to the writer thread.
+    trace.flush();
+    EXPECT_EQ(0U, trace.bufferedRecords);
+    EXPECT_EQ(0U, trace.recordsToWrite);
+    EXPECT_EQ(capacity + 1, trace.totalRecords);
+
+    MutationTrace::Reader reader(fileName);
+    MutationTrace::Record record;
+    for (uint64_t i = 0; i < capacity + 1; i++) {
+        ASSERT_TRUE(reader.next(&record));
+        EXPECT_EQ(i, record.keyHash);
+    }
+    EXPECT_FALSE(reader.next(&record));
+}
+
+TEST_F(MutationTraceTest, reader_badFile) {
+    EXPECT_THROW(MutationTrace::Reader("/nonexistent/trace"), Exception);
+
+    // An empty file isn't a trace.
+    EXPECT_THROW(MutationTrace::Reader reader(fileName), Exception);
+
+    FILE* file = fopen(fileName, "w");
+    fprintf(file, "RCMTRACE but not a header of the right size");
+    fclose(file);
+    EXPECT_THROW(MutationTrace::Reader reader(fileName), Exception);
+}
+
+}  // namespace RAMCloud
@@ -14,6 +14,7 @@
  */
 
 #include "Common.h"
+#include "Compressor.h"
 #include "Crc32C.h"
 #include "Object.h"
 #include "RamCloud.h"
@@ -690,7 +691,7 @@ Object::getKeysAndValueLength()
 uint64_t
 Object::getVersion()
 {
-    return header.version;
+    return header.version & ~VALUE_COMPRESSED_FLAG;
 }
 
 /**
@@ -727,7 +728,7 @@ Object::checkIntegrity()
 void
 Object::setVersion(uint64_t version)
 {
-    header.version = version;
+    header.version = (header.version & VALUE_COMPRESSED_FLAG) | version;
 }
 
 /* Set the object creation/modification timestamp for this object */
@@ -737,6 +738,134 @@ Object::setTimestamp(uint32_t timestamp)
     header.timestamp = timestamp;
 }
 
+/**
+ * Replace this object's value with a compressed copy of it, if that makes
+ * the object smaller. The keys are left uncompressed, so the object can
+ * still be hashed, indexed and tombstoned without decompressing it; only
+ * readers of the value need to call decompressValue() first. The checksum
+ * is not updated; assembleForLog() will recompute it.
+ *
+ * \param storage
+ *      Buffer whose auxiliary memory will hold the compressed keys and
+ *      value. Its lifetime must cover the lifetime of this Object.
+ * \return
+ *      True if the value was compressed. False if it was already compressed,
+ *      too short to bother with, or didn't shrink, in which case the object
+ *      is unchanged.
+ */
+bool
+Object::compressValue(Buffer& storage)
+{
+    uint32_t valueOffset;
+    if (isValueCompressed() || !getValueOffset(&valueOffset))
+        return false;
+    uint32_t valueLength = keysAndValueLength - valueOffset;
+    if (valueLength < MIN_COMPRESSIBLE_VALUE_LENGTH)
+        return false;
+
+    // decompressValue() rejects anything bigger, so leave it alone.
+    if (keysAndValueLength > MAX_OBJECT_SIZE)
+        return false;
+
+    // Leave no room for a result that, with its length prefix, would be
+    // as big as the original.
+    const void* value = getValue();
+    if (value == NULL)
+        return false;
+    uint32_t capacity = valueLength - sizeof32(uint32_t) - 1;
+    uint8_t* compressed = static_cast<uint8_t*>(storage.allocAux(
+            valueOffset + sizeof32(uint32_t) + capacity));
+    uint32_t compressedLength = Compressor::compress(value, valueLength,
+            compressed + valueOffset + sizeof32(uint32_t), capacity);
+    if (compressedLength == 0)
+        return false;
+
+    if (keysAndValue)
+        memcpy(compressed, keysAndValue, valueOffset);
+    else
+        keysAndValueBuffer->copy(keysAndValueOffset, valueOffset, compressed);
+    memcpy(compressed + valueOffset, &valueLength, sizeof(valueLength));
+
+    keysAndValue = compressed;
+    keysAndValueBuffer = NULL;
+    keysAndValueOffset = 0;
+    keysAndValueLength = valueOffset + sizeof32(uint32_t) + compressedLength;
+    keyOffsets = NULL;
+    header.version |= VALUE_COMPRESSED_FLAG;
+    return true;
+}
+
+/**
+ * Undo compressValue(): replace this object's value with its uncompressed
+ * form, so that getValue() and the append methods return what the client
+ * wrote. The checksum is not updated; assembleForLog() will recompute it.
+ *
+ * \param storage
+ *      Buffer whose auxiliary memory will hold the uncompressed keys and
+ *      value. Its lifetime must cover the lifetime of this Object. Passing
+ *      the buffer that the value is about to be appended to avoids a copy.
+ * \return
+ *      True if the value is now uncompressed (including if it never was
+ *      compressed). False if the compressed value is malformed, in which
+ *      case the object is unchanged.
+ */
+bool
+Object::decompressValue(Buffer& storage)
+{
+    if (!isValueCompressed())
+        return true;
+    uint32_t valueOffset;
+    if (!getValueOffset(&valueOffset))
+        return false;
+    uint32_t compressedLength = keysAndValueLength - valueOffset;
+    if (compressedLength < sizeof32(uint32_t))
+        return false;
+
+    const uint8_t* value = static_cast<const uint8_t*>(getValue());
+    if (value == NULL)
+        return false;
+    uint32_t valueLength;
+    memcpy(&valueLength, value, sizeof(valueLength));
+
+    // The length comes from the log, so don't let a corrupt one make us
+    // allocate more than any object could need.
+    if (valueOffset > MAX_OBJECT_SIZE ||
+            valueLength > MAX_OBJECT_SIZE - valueOffset) {
+        return false;
+    }
+    uint8_t* uncompressed = static_cast<uint8_t*>(storage.allocAux(
+            valueOffset + valueLength));
+    if (!Compressor::decompress(value + sizeof32(uint32_t),
+            compressedLength - sizeof32(uint32_t),
+            uncompressed + valueOffset, valueLength))
+        return false;
+
+    if (keysAndValue)
+        memcpy(uncompressed, keysAndValue, valueOffset);
+    else
+        keysAndValueBuffer->copy(keysAndValueOffset, valueOffset,
+                                 uncompressed);
+
+    keysAndValue = uncompressed;
+    keysAndValueBuffer = NULL;
+    keysAndValueOffset = 0;
+    keysAndValueLength = valueOffset + valueLength;
+    keyOffsets = NULL;
+    header.version &= ~VALUE_COMPRESSED_FLAG;
+    return true;
+}
+
+/**
+ * Return true if this object's value is stored compressed, in which case
+ * getValue() and the append methods return the compressed bytes, and
+ * decompressValue() must be used to recover the original.
+ */
+bool
+Object::isValueCompressed()
+{
+    return (header.version & VALUE_COMPRESSED_FLAG) != 0;
+}
+
 /**
  * Compute checksum onto the provided Crc32c instance. This function may be
  * used to calculate checksum of big chunk containing Object.
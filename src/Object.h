@@ -129,6 +129,13 @@ class Object {
     void setVersion(uint64_t version);
     void setTimestamp(uint32_t timestamp);
 
+    bool compressValue(Buffer& storage);
+    bool decompressValue(Buffer& storage);
+    bool isValueCompressed();
+
+    /// Values shorter than this aren't worth compressing.
+    static const uint32_t MIN_COMPRESSIBLE_VALUE_LENGTH = 64;
+
 //  PRIVATE:
     /**
      * This data structure defines the format of an object header stored in a
@@ -167,7 +174,9 @@ class Object {
 
         /// Version of the object. Set to some initial value upon object
         /// creation and incremented by one for each modification. See
-        /// MasterService for the exact behavior.
+        /// MasterService for the exact behavior. The top bit isn't part of
+        /// the version: it's VALUE_COMPRESSED_FLAG, which is set if the
+        /// value has been compressed (see compressValue()).
         uint64_t version;
 
         /// Table to which this object belongs.
@@ -182,6 +191,12 @@ class Object {
         "Unexpected serialized Object size");
 
 
+    /// Set in Header::version if the value is stored in compressed form:
+    /// a 32-bit uncompressed length followed by the Compressor output.
+    /// Versions are allocated sequentially from 1, so they never get
+    /// anywhere near this bit.
+    static const uint64_t VALUE_COMPRESSED_FLAG = 1UL << 63;
+
     static uint32_t computeChecksum(const Object::Header* object,
                                     uint32_t totalLength);
     uint32_t computeChecksum();
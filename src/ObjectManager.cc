@@ -18,8 +18,11 @@
 #include "Dispatch.h"
 #include "Enumeration.h"
 #include "EnumerationIterator.h"
+#include "HopscotchHashTable.h"
 #include "IndexletManager.h"
 #include "LogEntryRelocator.h"
+#include "LogProtector.h"
+#include "Memory.h"
 #include "ObjectManager.h"
 #include "Object.h"
 #include "PerfStats.h"
@@ -86,24 +89,64 @@ ObjectManager::ObjectManager(Context* context, ServerId* serverId,
     , replicaManager(context, serverId,
                      config->master.numReplicas,
                      config->master.useMinCopysets,
-                     config->master.allowLocalBackup)
+                     config->master.allowLocalBackup,
+                     config->master.dataFragments,
+                     config->master.parityFragments,
+                     config->master.keepLocalReplica)
     , segmentManager(context, config, serverId,
                      allocator, replicaManager, masterTableMetadata)
     , log(context, config, this, &segmentManager, &replicaManager)
-    , objectMap(config->master.hashTableBytes / HashTable::bytesPerCacheLine())
+    , objectMapOwner(HashTable::create(config->master.hashTableType,
+            config->master.hashTablePerTable
+                ? arrayLength(hashTableBucketLocks)
+                : config->master.hashTableBytes /
+                  HashTable::bytesPerCacheLine(),
+            MemoryPolicy(config->master.memoryPolicy)))
+    , objectMap(*objectMapOwner)
     , anyWrites(false)
     , hashTableBucketLocks()
+    , hashTableBucketVersions(static_cast<BucketVersion*>(
+            Memory::xmemalign(HERE, CACHE_LINE_SIZE,
+                              sizeof(BucketVersion) *
+                              arrayLength(hashTableBucketLocks))))
     , lockTable(1000, log)
     , mutex("ObjectManager::mutex")
     , tombstoneRemover(this, &objectMap)
     , tombstoneProtectorCount(0)
+    , hashTableResizer(this, &objectMap)
+    , perTableIndex(config->master.hashTablePerTable)
+    , indexPartitionLock("ObjectManager::indexPartitionLock")
+    , indexTables()
+    , retiredIndexPartitions()
+    , retiredIndexPartitionSets()
+    , mutationTrace()
 {
-    for (size_t i = 0; i < arrayLength(hashTableBucketLocks); i++)
+    // HopscotchHashTable moves references between buckets NEIGHBOR_STRIDE
+    // apart while holding only one bucket lock.
+    static_assert(HopscotchHashTable::NEIGHBOR_STRIDE %
+                  (sizeof(hashTableBucketLocks) /
+                   sizeof(hashTableBucketLocks[0])) == 0,
+                  "Bucket lock stripes must divide NEIGHBOR_STRIDE");
+    for (size_t i = 0; i < arrayLength(hashTableBucketLocks); i++) {
         hashTableBucketLocks[i].setName("hashTableBucketLock");
+        new(&hashTableBucketVersions[i]) BucketVersion();
+    }
+    for (uint32_t i = 0; i < INDEX_TABLE_CHAINS; i++)
+        indexTables[i] = NULL;
+
+    // Partitions start small and rely on being grown as their tables do.
+    if (perTableIndex && !objectMap.supportsResize()) {
+        throw Exception(HERE, format("hashTablePerTable requires a "
+                "resizable HashTable, but %s HashTables can't be resized",
+                objectMap.getType()));
+    }
+
+    if (!config->master.mutationTraceFile.empty())
+        mutationTrace.construct(config->master.mutationTraceFile);
 }
 
 /**
- * The destructor does nothing particularly interesting right now.
+ * The destructor frees the per-table index partitions, if any.
  */
 ObjectManager::~ObjectManager()
 {
@@ -111,6 +154,26 @@ ObjectManager::~ObjectManager()
         DIE("Can't destroy ObjectManager with active TombstoneProtectors.");
     }
     replicaManager.haltFailureMonitor();
+
+    for (uint32_t i = 0; i < INDEX_TABLE_CHAINS; i++) {
+        IndexTable* table = indexTables[i];
+        while (table != NULL) {
+            const IndexPartitionSet* set = table->partitions;
+            if (set != NULL) {
+                foreach (IndexPartition* partition, set->partitions)
+                    delete partition;
+                delete set;
+            }
+            IndexTable* next = table->next;
+            delete table;
+            table = next;
+        }
+    }
+    for (size_t i = 0; i < retiredIndexPartitions.size(); i++)
+        delete retiredIndexPartitions[i].second;
+    for (size_t i = 0; i < retiredIndexPartitionSets.size(); i++)
+        delete retiredIndexPartitionSets[i].second;
+    std::free(hashTableBucketVersions);
 }
 
 /**
@@ -143,6 +206,92 @@ ObjectManager::initOnceEnlisted()
 
     if (!config->master.disableLogCleaner)
         log.enableCleaner();
+
+    // Resizing relies on the bucket lock for a key being independent of
+    // the table's size, which only holds if there are at least as many
+    // buckets as locks.
+    // Per-table partitions are always resized, starting when created; the
+    // main table's resizer then only frees discarded partitions.
+    if (perTableIndex) {
+        hashTableResizer.start(0);
+    } else if (config->master.hashTableAutoResize) {
+        if (!objectMap.supportsResize()) {
+            LOG(WARNING, "%s HashTable can't be resized automatically",
+                objectMap.getType());
+        } else if (objectMap.getNumBuckets() >=
+                arrayLength(hashTableBucketLocks)) {
+            hashTableResizer.start(0);
+        } else {
+            LOG(WARNING, "HashTable too small (%lu buckets) to be resized "
+                "automatically", objectMap.getNumBuckets());
+        }
+    }
+}
+
+/**
+ * Fill in the hash table portion of the log metrics returned by
+ * MasterService::getLogMetrics.
+ *
+ * \param m
+ *      Protocol buffer to fill in.
+ */
+void
+ObjectManager::getHashTableMetrics(ProtoBuf::LogMetrics_HashTableMetrics& m)
+{
+    hashTableResizer.getMetrics(m);
+    if (!perTableIndex)
+        return;
+
+    // Report the totals over all partitions. Fields that describe a
+    // single table (e.g. the chain length) report the worst partition.
+    vector<IndexPartition*> partitions;
+    getIndexPartitions(&partitions);
+    for (size_t i = 0; i < partitions.size(); i++) {
+        ProtoBuf::LogMetrics_HashTableMetrics pm;
+        partitions[i]->resizer.getMetrics(pm);
+        m.set_num_buckets(m.num_buckets() + pm.num_buckets());
+        m.set_num_entries(m.num_entries() + pm.num_entries());
+        m.set_overflow_cache_lines(m.overflow_cache_lines() +
+                                   pm.overflow_cache_lines());
+        m.set_longest_chain(std::max(m.longest_chain(), pm.longest_chain()));
+        m.set_resize_in_progress(m.resize_in_progress() ||
+                                 pm.resize_in_progress());
+        m.set_buckets_migrated(m.buckets_migrated() + pm.buckets_migrated());
+        m.set_old_num_buckets(m.old_num_buckets() + pm.old_num_buckets());
+        m.set_total_grows(m.total_grows() + pm.total_grows());
+        m.set_total_shrinks(m.total_shrinks() + pm.total_shrinks());
+        m.set_total_migration_ticks(m.total_migration_ticks() +
+                                    pm.total_migration_ticks());
+    }
+    m.set_load_factor(static_cast<double>(m.num_entries()) /
+            static_cast<double>(m.num_buckets() *
+                                HashTable::entriesPerCacheLine()));
+}
+
+/**
+ * Fill in the compression portion of the statistics returned by
+ * MasterService::getServerStatistics. The counters are kept in
+ * PerfStats::threadStats, so this adds up those of every thread.
+ *
+ * \param stats
+ *      Protocol buffer to fill in.
+ */
+void
+ObjectManager::getCompressionStatistics(
+        ProtoBuf::ServerStatistics_CompressionStats* stats)
+{
+    PerfStats m;
+    PerfStats::collectStats(&m);
+    stats->set_compressed_objects(m.compressedObjects);
+    stats->set_uncompressed_value_bytes(m.uncompressedValueBytes);
+    stats->set_compressed_value_bytes(m.compressedValueBytes);
+    stats->set_incompressible_objects(m.incompressibleObjects);
+    stats->set_decompressed_objects(m.decompressedObjects);
+    if (stats->compressed_value_bytes() != 0) {
+        stats->set_compression_ratio(
+                static_cast<double>(stats->uncompressed_value_bytes()) /
+                static_cast<double>(stats->compressed_value_bytes()));
+    }
 }
 
 /**
@@ -205,8 +354,9 @@ ObjectManager::readHashes(const uint64_t tableId, uint32_t reqNumHashes,
         // doing the work here directly, since the abstraction breaks down
         // as multiple objects having the same primary key hash may match
         // the index key range.
-        objectMap.prefetchBucket(pKHash);
+        findIndex(tableId, pKHash).prefetchBucket(pKHash);
         HashTableBucketLock lock(*this, pKHash); // unlocks self on destruct
+        HashTable& index = findIndex(tableId, pKHash);
 
         // If the tablet doesn't exist in the NORMAL state,
         // we must plead ignorance.
@@ -222,7 +372,7 @@ ObjectManager::readHashes(const uint64_t tableId, uint32_t reqNumHashes,
         }
 
         HashTable::Candidates candidates;
-        objectMap.lookup(pKHash, candidates);
+        index.lookup(pKHash, candidates);
         for (; !candidates.isDone(); candidates.next()) {
             Buffer candidateBuffer;
             Log::Reference candidateRef(candidates.getReference());
@@ -235,6 +385,9 @@ ObjectManager::readHashes(const uint64_t tableId, uint32_t reqNumHashes,
 
             // Candidate may have only partially matching primary key hash.
             if (object.getPKHash() == pKHash) {
+                if (object.isValueCompressed() &&
+                        !decompressForRead(object, *response))
+                    continue;
                 *numObjects += 1;
                 response->emplaceAppend<uint64_t>(object.getVersion());
                 response->emplaceAppend<uint32_t>(
@@ -285,13 +438,66 @@ ObjectManager::prefetchHashTableBucket(SegmentIterator* it)
         const void *primaryKey = prefetchObj.getKey(0, &primaryKeyLen);
 
         Key key(obj->tableId, primaryKey, primaryKeyLen);
-        objectMap.prefetchBucket(key.getHash());
+        findIndex(key.getTableId(), key.getHash()).prefetchBucket(
+                key.getHash());
     } else if (it->getType() == LOG_ENTRY_TYPE_OBJTOMB) {
         const ObjectTombstone::Header* tomb =
             it->getContiguous<ObjectTombstone::Header>(NULL, 0);
         Key key(tomb->tableId, tomb->key,
             downCast<uint16_t>(it->getLength() - sizeof32(*tomb)));
-        objectMap.prefetchBucket(key.getHash());
+        findIndex(key.getTableId(), key.getHash()).prefetchBucket(
+                key.getHash());
+    }
+}
+
+/**
+ * Warm the processor's caches for a batch of objects that are about to be
+ * read or written. This is done in two stages: first the hash table buckets
+ * for all of the keys are prefetched, then (once those are likely to have
+ * arrived) the log entries referenced from each bucket. This overlaps the
+ * dependent cache misses of the whole batch, rather than taking them one
+ * object at a time in readObject() or writeObject().
+ *
+ * This is purely a performance hint: the caller must still read or write
+ * each object normally, and nothing here checks that the keys exist.
+ *
+ * \param keys
+ *      Keys of the objects that will be accessed shortly. Empty Tubs are
+ *      ignored.
+ * \param numKeys
+ *      Number of entries in \a keys. This should be no more than
+ *      MAX_PREFETCH_BATCH.
+ */
+void
+ObjectManager::prefetchObjects(Tub<Key>* keys, uint32_t numKeys)
+{
+    HashTable* indexes[MAX_PREFETCH_BATCH];
+    if (numKeys > MAX_PREFETCH_BATCH)
+        numKeys = MAX_PREFETCH_BATCH;
+    for (uint32_t i = 0; i < numKeys; i++) {
+        if (!keys[i])
+            continue;
+        indexes[i] = &findIndex(keys[i]->getTableId(), keys[i]->getHash());
+        indexes[i]->prefetchBucket(keys[i]->getHash());
+    }
+
+    // The buckets are walked without the bucket locks, just as readObject()
+    // does: whatever a racing writer leaves behind is still safe to prefetch
+    // (prefetchEntry() never faults), and readObject() or writeObject() will
+    // look the key up properly anyway. Buckets can't be walked safely while
+    // their hash table is being resized, so then only the buckets themselves
+    // are prefetched.
+    for (uint32_t i = 0; i < numKeys; i++) {
+        if (!keys[i] || indexes[i]->areOptimisticReadsPaused())
+            continue;
+        HashTable::Candidates candidates;
+        indexes[i]->lookup(keys[i]->getHash(), candidates);
+        while (!candidates.isDone()) {
+            uint64_t reference = candidates.getReference();
+            if (reference != 0)
+                Log::Reference(reference).prefetchEntry();
+            candidates.next();
+        }
     }
 }
 
@@ -322,8 +528,8 @@ ObjectManager::readObject(Key& key, Buffer* outBuffer,
                 RejectRules* rejectRules, uint64_t* outVersion,
                 bool valueOnly)
 {
-    objectMap.prefetchBucket(key.getHash());
-    HashTableBucketLock lock(*this, key);
+    HashTable& index = findIndex(key.getTableId(), key.getHash());
+    index.prefetchBucket(key.getHash());
 
     // If the tablet doesn't exist in the NORMAL state, we must plead ignorance.
     if (!tabletManager->checkAndIncrementReadCount(key))
@@ -333,7 +539,44 @@ ObjectManager::readObject(Key& key, Buffer* outBuffer,
     LogEntryType type;
     uint64_t version;
     Log::Reference reference;
-    bool found = lookup(lock, key, type, buffer, &version, &reference);
+    bool found = false;
+    bool consistent = false;
+
+    // Reads don't modify anything, so rather than serializing on the bucket
+    // lock (which hurts badly when many workers read the same hot key), try
+    // the lookup without it and check afterwards that no writer or cleaner
+    // relocation touched the bucket in the meantime. Anything the lookup
+    // saw remains valid even if it raced, because log memory is only
+    // reclaimed once all RPCs that could have seen it are finished.
+    if (!index.areOptimisticReadsPaused()) {
+        uint64_t bucket = lockBucketIndex(key.getHash());
+        std::atomic<uint64_t>& bucketVersion = hashTableBucketVersions[
+                bucket & (arrayLength(hashTableBucketLocks) - 1)].value;
+        for (uint32_t attempt = 0; attempt < MAX_OPTIMISTIC_READ_ATTEMPTS;
+                attempt++) {
+            uint64_t before = bucketVersion.load(std::memory_order_acquire);
+            if ((before & 1) == 0) {
+                buffer.reset();
+                found = lookupUnlocked(key, type, buffer, &version,
+                        &reference);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (bucketVersion.load(std::memory_order_relaxed) == before) {
+                    consistent = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Too much write traffic on this bucket (or a resize in progress):
+    // fall back to locking out the writers.
+    Tub<HashTableBucketLock> lock;
+    if (!consistent) {
+        lock.construct(*this, key);
+        buffer.reset();
+        found = lookup(*lock, key, type, buffer, &version, &reference);
+    }
+
     if (!found || type != LOG_ENTRY_TYPE_OBJ)
         return STATUS_OBJECT_DOESNT_EXIST;
 
@@ -350,6 +593,8 @@ ObjectManager::readObject(Key& key, Buffer* outBuffer,
     log.syncTo(reference);
 
     Object object(buffer);
+    if (object.isValueCompressed() && !decompressForRead(object, *outBuffer))
+        return STATUS_INTERNAL_ERROR;
     if (valueOnly) {
         object.appendValueToBuffer(outBuffer);
     } else {
@@ -483,6 +728,12 @@ ObjectManager::removeObject(Key& key, RejectRules* rejectRules,
     segmentManager.raiseSafeVersion(object.getVersion() + 1);
     log.free(reference);
     remove(lock, key);
+
+    if (mutationTrace) {
+        mutationTrace->record(MutationTrace::REMOVE, key.getTableId(),
+                key.getHash(), key.getStringKeyLength(),
+                object.getValueLength());
+    }
     return STATUS_OK;
 }
 
@@ -494,11 +745,93 @@ ObjectManager::removeObject(Key& key, RejectRules* rejectRules,
 void
 ObjectManager::removeOrphanedObjects()
 {
-    for (uint64_t i = 0; i < objectMap.getNumBuckets(); i++) {
-        HashTableBucketLock lock(*this, i);
-        CleanupParameters params = { this , &lock };
-        objectMap.forEachInBucket(removeIfOrphanedObject, &params, i);
+    if (!perTableIndex) {
+        scanIndex(objectMap, removeIfOrphanedObject);
+        return;
+    }
+
+    vector<uint64_t> tableIds;
+    for (uint32_t i = 0; i < INDEX_TABLE_CHAINS; i++) {
+        for (IndexTable* table = indexTables[i].load(); table != NULL;
+                table = table->next) {
+            tableIds.push_back(table->tableId);
+        }
+    }
+    for (size_t i = 0; i < tableIds.size(); i++)
+        removeOrphanedObjects(tableIds[i]);
+}
+
+/**
+ * Remove all objects of a given table that do not belong to a tablet
+ * currently owned by this master. This is used after tablets are dropped
+ * or migrated away. If ServerConfig::Master::hashTablePerTable is set,
+ * only the index partitions overlapping the given key hash range are
+ * visited, and any of them whose range no longer has a tablet here is
+ * discarded as a whole; otherwise this is the same as
+ * removeOrphanedObjects().
+ *
+ * \param tableId
+ *      Identifier of the table whose tablet(s) this master gave up.
+ * \param firstKeyHash
+ *      First key hash of the range this master gave up.
+ * \param lastKeyHash
+ *      Last key hash (inclusive) of the range this master gave up.
+ */
+void
+ObjectManager::removeOrphanedObjects(uint64_t tableId, uint64_t firstKeyHash,
+                                     uint64_t lastKeyHash)
+{
+    if (!perTableIndex) {
+        removeOrphanedObjects();
+        return;
+    }
+
+    vector<IndexPartition*> partitions;
+    getIndexPartitions(&partitions, tableId);
+    vector<IndexPartition*> discarded;
+    foreach (IndexPartition* partition, partitions) {
+        if (partition->endKeyHash < firstKeyHash ||
+                partition->startKeyHash > lastKeyHash) {
+            continue;
+        }
+        scanIndex(*partition->objectMap, removeIfOrphanedObject);
+
+        // Objects are only indexed for tablets here, so if there are none
+        // left in the partition's range, it now holds at most tombstones
+        // and can go.
+        if (!tabletManager->hasTablets(tableId, partition->startKeyHash,
+                                       partition->endKeyHash)) {
+            discarded.push_back(partition);
+        }
+    }
+
+    if (!discarded.empty()) {
+        IndexTable* table = findIndexTable(tableId);
+        SpinLock::Guard _(indexPartitionLock);
+        vector<IndexPartition*> kept;
+        const IndexPartitionSet* set = table->partitions.load();
+        foreach (IndexPartition* partition, set->partitions) {
+            if (std::find(discarded.begin(), discarded.end(), partition) ==
+                    discarded.end()) {
+                kept.push_back(partition);
+            }
+        }
+        publishIndexPartitions(table, kept);
     }
+
+    foreach (IndexPartition* partition, discarded) {
+        partition->tombstoneRemover.stop();
+        partition->resizer.shutdown();
+        {
+            SpinLock::Guard _(indexPartitionLock);
+            retiredIndexPartitions.push_back(
+                    {LogProtector::incrementCurrentEpoch() - 1, partition});
+        }
+        LOG(DEBUG, "Discarded hash table of table %lu, key hashes "
+                "[0x%lx,0x%lx]", tableId, partition->startKeyHash,
+                partition->endKeyHash);
+    }
+    releaseRetiredIndexPartitions();
 }
 
 /**
@@ -576,35 +909,39 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it)
  * \param nextNodeIdMap
  *       A unordered map that keeps track of the nextNodeId in
  *       each indexlet table.
+ * \param shard
+ *       Which of \a numShards disjoint parts of the segment to replay: only
+ *       objects, tombstones, prepared ops and prepared op tombstones whose
+ *       key hash is \a shard modulo \a numShards are replayed, and all
+ *       other entries (which aren't tied to a key) only if \a shard is 0.
+ *       Calls for different shards of the same segment may run
+ *       concurrently, as long as each has a SideLog (and \a nextNodeIdMap)
+ *       of its own; see SegmentReplayer.
+ *       Since all versions of any one key are replayed by the same call,
+ *       the outcome is the same as replaying the whole segment at once.
+ * \param numShards
+ *       Number of parts the segment is being split into; 1 replays all of
+ *       it.
  */
 void
 ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
-    std::unordered_map<uint64_t, uint64_t>* nextNodeIdMap)
+    std::unordered_map<uint64_t, uint64_t>* nextNodeIdMap,
+    uint32_t shard, uint32_t numShards, ReplayStats* stats)
 {
     uint64_t startReplicationTicks = metrics->master.replicaManagerTicks;
     uint64_t startReplicationPostingWriteRpcTicks =
         metrics->master.replicationPostingWriteRpcTicks;
-    CycleCounter<RawMetric> _(&metrics->master.recoverSegmentTicks);
+    uint64_t startTicks = Cycles::rdtsc();
 
     if (tombstoneProtectorCount <= 0) {
         DIE("Must hold a TombstoneProtector when replaying segments");
     }
 
-    // Metrics can be very expense (they're atomic operations), so we aggregate
-    // as much as we can in local variables and update the counters once at the
+    // Metrics can be very expense (they're atomic operations), and calls
+    // for different shards may run concurrently, so we aggregate in local
+    // variables and update the counters (or the caller's stats) once at the
     // end of this method.
-    uint64_t verifyChecksumTicks = 0;
-    uint64_t segmentAppendTicks = 0;
-    uint64_t recoverySegmentEntryCount = 0;
-    uint64_t recoverySegmentEntryBytes = 0;
-    uint64_t objectAppendCount = 0;
-    uint64_t tombstoneAppendCount = 0;
-    uint64_t liveObjectCount = 0;
-    uint64_t liveObjectBytes = 0;
-    uint64_t objectDiscardCount = 0;
-    uint64_t tombstoneDiscardCount = 0;
-    uint64_t safeVersionRecoveryCount = 0;
-    uint64_t safeVersionNonRecoveryCount = 0;
+    ReplayStats local;
 
     SegmentIterator prefetcher = it;
     prefetcher.next();
@@ -622,8 +959,16 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
         }
         bytesIterated += it.getLength();
 
-        recoverySegmentEntryCount++;
-        recoverySegmentEntryBytes += it.getLength();
+        // Every shard walks the whole segment; shard 0 counts it.
+        if (shard == 0) {
+            local.recoverySegmentEntryCount++;
+            local.recoverySegmentEntryBytes += it.getLength();
+        } else if (type != LOG_ENTRY_TYPE_OBJ &&
+                   type != LOG_ENTRY_TYPE_OBJTOMB &&
+                   type != LOG_ENTRY_TYPE_PREP &&
+                   type != LOG_ENTRY_TYPE_PREPTOMB) {
+            continue;
+        }
 
         if (expect_true(type == LOG_ENTRY_TYPE_OBJ)) {
             // The recovery segment is guaranteed to be contiguous, so we need
@@ -637,6 +982,8 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
             const void *primaryKey = replayObj.getKey(0, &primaryKeyLen);
 
             Key key(recoveryObj->tableId, primaryKey, primaryKeyLen);
+            if (numShards > 1 && key.getHash() % numShards != shard)
+                continue;
 
             // If table is an BTree table,i.e., tableId exists in
             // nextNodeIdMap, update nextNodeId of its table.
@@ -653,13 +1000,13 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
             }
 
             bool checksumIsValid = ({
-                CycleCounter<uint64_t> c(&verifyChecksumTicks);
+                CycleCounter<uint64_t> c(&local.verifyChecksumTicks);
                 Object::computeChecksum(recoveryObj, it.getLength()) ==
                     recoveryObj->checksum;
             });
             if (expect_false(!checksumIsValid)) {
                 LOG(WARNING, "bad object checksum! key: %s, version: %lu",
-                    key.toString().c_str(), recoveryObj->version);
+                    key.toString().c_str(), replayObj.getVersion());
                 // JIRA Issue: RAM-673:
                 // Should throw and try another segment replica.
             }
@@ -686,8 +1033,8 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
                 }
 
                 // Throw new object away if the hash table version is newer
-                if (recoveryObj->version <= currentVersion) {
-                    objectDiscardCount++;
+                if (replayObj.getVersion() <= currentVersion) {
+                    local.objectDiscardCount++;
                     continue;
                 }
                 if (currentEntryIsObject) {
@@ -700,16 +1047,16 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
                     Buffer tombstoneBuffer;
                     tombstone.assembleForLog(tombstoneBuffer);
                     sideLog->append(LOG_ENTRY_TYPE_OBJTOMB, tombstoneBuffer);
-                    tombstoneAppendCount++;
+                    local.tombstoneAppendCount++;
                     TableStats::increment(masterTableMetadata,
                             key.getTableId(),
                             tombstoneBuffer.size(),
                             1);
 
                     // Track the death of the object
-                    liveObjectBytes -= currentBuffer.size();
+                    local.liveObjectBytes -= currentBuffer.size();
                     sideLog->free(currentReference);
-                    liveObjectCount--;
+                    local.liveObjectCount--;
                 }
             }
 
@@ -717,7 +1064,7 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
             // the hash table to refer to it.
             Log::Reference newObjReference;
             {
-                CycleCounter<uint64_t> _(&segmentAppendTicks);
+                CycleCounter<uint64_t> _(&local.segmentAppendTicks);
                 sideLog->append(LOG_ENTRY_TYPE_OBJ,
                                 recoveryObj,
                                 it.getLength(),
@@ -734,13 +1081,15 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
             // should abort the recovery. Coordinator will then try
             // another master.
 
-            liveObjectCount++;
-            objectAppendCount++;
-            liveObjectBytes += it.getLength();
+            local.liveObjectCount++;
+            local.objectAppendCount++;
+            local.liveObjectBytes += it.getLength();
         } else if (type == LOG_ENTRY_TYPE_OBJTOMB) {
             Buffer buffer;
             it.appendToBuffer(buffer);
             Key key(type, buffer);
+            if (numShards > 1 && key.getHash() % numShards != shard)
+                continue;
 
             // TODO(syang0) A B+ Tree nextNodeId check was removed here because
             // we only need to set the nextNodeId to the highest live node;
@@ -748,7 +1097,7 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
 
             ObjectTombstone recoverTomb(buffer);
             bool checksumIsValid = ({
-                CycleCounter<uint64_t> c(&verifyChecksumTicks);
+                CycleCounter<uint64_t> c(&local.verifyChecksumTicks);
                 recoverTomb.checkIntegrity();
             });
             if (expect_false(!checksumIsValid)) {
@@ -780,7 +1129,7 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
                 // Throw new tombstone away if the hash table version is
                 // strictly newer
                 if (recoverVersion < currentVersion) {
-                    tombstoneDiscardCount++;
+                    local.tombstoneDiscardCount++;
                     continue;
                 }
                 // We assume we will not see an exact duplicate tombstone and
@@ -811,16 +1160,16 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
                             tombstoneBuffer,
                             &newTombReference);
 
-                    tombstoneAppendCount++;
+                    local.tombstoneAppendCount++;
                     TableStats::increment(masterTableMetadata,
                             key.getTableId(),
                             tombstoneBuffer.size(),
                             1);
 
                     // Track the death of the object
-                    liveObjectBytes -= currentBuffer.size();
+                    local.liveObjectBytes -= currentBuffer.size();
                     sideLog->free(currentReference);
-                    liveObjectCount--;
+                    local.liveObjectCount--;
 
                     // Optimization to avoid appending two tombstones with the
                     // same version for the same key to the log.
@@ -855,7 +1204,7 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
                     tombstoneBuffer,
                     &newTombReference);
 
-            tombstoneAppendCount++;
+            local.tombstoneAppendCount++;
             TableStats::increment(masterTableMetadata,
                     key.getTableId(),
                     buffer.size(),
@@ -871,7 +1220,7 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
             uint64_t safeVersion = recoverSafeVer.getSafeVersion();
 
             bool checksumIsValid = ({
-                CycleCounter<uint64_t> _(&verifyChecksumTicks);
+                CycleCounter<uint64_t> _(&local.verifyChecksumTicks);
                 recoverSafeVer.checkIntegrity();
             });
             if (expect_false(!checksumIsValid)) {
@@ -885,7 +1234,7 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
             // Sync can be delayed, because recovery can be replayed
             // with the same backup data when the recovery crashes on the way.
             {
-                CycleCounter<uint64_t> _(&segmentAppendTicks);
+                CycleCounter<uint64_t> _(&local.segmentAppendTicks);
                 sideLog->append(LOG_ENTRY_TYPE_SAFEVERSION, buffer);
             }
             // JIRA Issue: RAM-674:
@@ -896,10 +1245,10 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
             // recover segmentManager.safeVersion (Master safeVersion)
             if (segmentManager.raiseSafeVersion(safeVersion)) {
                 // true if log.safeVersion is revised.
-                safeVersionRecoveryCount++;
+                local.safeVersionRecoveryCount++;
                 LOG(DEBUG, "SAFEVERSION %lu recovered", safeVersion);
             } else {
-                safeVersionNonRecoveryCount++;
+                local.safeVersionNonRecoveryCount++;
                 LOG(DEBUG, "SAFEVERSION %lu discarded", safeVersion);
             }
         } else if (type == LOG_ENTRY_TYPE_RPCRESULT) {
@@ -914,7 +1263,7 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
                                                  type)) {
                 Log::Reference newRpcResultReference;
                 {
-                    CycleCounter<uint64_t> _(&segmentAppendTicks);
+                    CycleCounter<uint64_t> _(&local.segmentAppendTicks);
                     sideLog->append(LOG_ENTRY_TYPE_RPCRESULT,
                                     buffer,
                                     &newRpcResultReference);
@@ -948,6 +1297,10 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
             const void *pKey = op.object.getKey(0, &pKeyLen);
 
             Key key(op.object.header.tableId, pKey, pKeyLen);
+            // Decided against the current version of the object, so this
+            // must be replayed by the same shard as the object.
+            if (numShards > 1 && key.getHash() % numShards != shard)
+                continue;
 
             if (expect_false(!op.checkIntegrity())) {
                 LOG(WARNING, "bad preparedOp checksum! key: %s, leaseId: %lu"
@@ -982,12 +1335,12 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
                                                  op.header.rpcId) &&
                 !transactionManager->getOp(op.header.clientId,
                                            op.header.rpcId) &&
-                op.object.header.version >= minSuccessor) {
+                op.object.getVersion() >= minSuccessor) {
 
                 // write to log (with lazy backup flush) & update hash table
                 Log::Reference newReference;
                 {
-                    CycleCounter<uint64_t> _(&segmentAppendTicks);
+                    CycleCounter<uint64_t> _(&local.segmentAppendTicks);
                     sideLog->append(LOG_ENTRY_TYPE_PREP,
                                     buffer,
                                     &newReference);
@@ -1005,6 +1358,9 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
             it.appendToBuffer(buffer);
 
             PreparedOpTombstone opTomb(buffer, 0);
+            // Same shard as the prepared op it deletes.
+            if (numShards > 1 && opTomb.header.keyHash % numShards != shard)
+                continue;
 
             if (expect_false(!opTomb.checkIntegrity())) {
                 LOG(WARNING, "bad preparedOpTombstone checksum! tableId: %lu, "
@@ -1029,7 +1385,7 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
                 // write to log (with lazy backup flush)
                 Log::Reference newReference;
                 {
-                    CycleCounter<uint64_t> _(&segmentAppendTicks);
+                    CycleCounter<uint64_t> _(&local.segmentAppendTicks);
                     sideLog->append(LOG_ENTRY_TYPE_PREPTOMB,
                                     buffer,
                                     &newReference);
@@ -1052,7 +1408,7 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
             TxDecisionRecord record(buffer);
 
             bool checksumIsValid = ({
-                CycleCounter<uint64_t> c(&verifyChecksumTicks);
+                CycleCounter<uint64_t> c(&local.verifyChecksumTicks);
                 record.checkIntegrity();
             });
             if (expect_false(!checksumIsValid)) {
@@ -1061,7 +1417,7 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
                 // TODO(cstlee): Should throw and try another segment replica?
             }
             if (txRecoveryManager->recoverRecovery(record)) {
-                CycleCounter<uint64_t> _(&segmentAppendTicks);
+                CycleCounter<uint64_t> _(&local.segmentAppendTicks);
                 sideLog->append(LOG_ENTRY_TYPE_TXDECISION, buffer);
                 // TODO(cstlee) : What should we do if the append fails?
                 TableStats::increment(masterTableMetadata,
@@ -1076,7 +1432,7 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
             ParticipantList participantList(buffer);
 
             bool checksumIsValid = ({
-                CycleCounter<uint64_t> c(&verifyChecksumTicks);
+                CycleCounter<uint64_t> c(&local.verifyChecksumTicks);
                 participantList.checkIntegrity();
             });
 
@@ -1100,11 +1456,55 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
         }
     }
 
-    metrics->master.backupInRecoverTicks +=
-        metrics->master.replicaManagerTicks - startReplicationTicks;
+    if (shard == 0) {
+        local.backupInRecoverTicks =
+            metrics->master.replicaManagerTicks - startReplicationTicks;
+        local.recoverSegmentPostingWriteRpcTicks =
+            metrics->master.replicationPostingWriteRpcTicks -
+            startReplicationPostingWriteRpcTicks;
+    }
+    local.recoverSegmentTicks = Cycles::rdtsc() - startTicks;
+    if (stats != NULL)
+        stats->add(local);
+    else
+        local.addToMetrics();
+}
+
+/**
+ * Add the counts in another ReplayStats to this one.
+ */
+void
+ObjectManager::ReplayStats::add(const ReplayStats& other)
+{
+    recoverSegmentTicks += other.recoverSegmentTicks;
+    backupInRecoverTicks += other.backupInRecoverTicks;
+    recoverSegmentPostingWriteRpcTicks +=
+        other.recoverSegmentPostingWriteRpcTicks;
+    verifyChecksumTicks += other.verifyChecksumTicks;
+    segmentAppendTicks += other.segmentAppendTicks;
+    recoverySegmentEntryCount += other.recoverySegmentEntryCount;
+    recoverySegmentEntryBytes += other.recoverySegmentEntryBytes;
+    objectAppendCount += other.objectAppendCount;
+    tombstoneAppendCount += other.tombstoneAppendCount;
+    liveObjectCount += other.liveObjectCount;
+    liveObjectBytes += other.liveObjectBytes;
+    objectDiscardCount += other.objectDiscardCount;
+    tombstoneDiscardCount += other.tombstoneDiscardCount;
+    safeVersionRecoveryCount += other.safeVersionRecoveryCount;
+    safeVersionNonRecoveryCount += other.safeVersionNonRecoveryCount;
+}
+
+/**
+ * Add these counts to the master's metrics. Only one thread may do so at
+ * a time.
+ */
+void
+ObjectManager::ReplayStats::addToMetrics() const
+{
+    metrics->master.recoverSegmentTicks += recoverSegmentTicks;
+    metrics->master.backupInRecoverTicks += backupInRecoverTicks;
     metrics->master.recoverSegmentPostingWriteRpcTicks +=
-        metrics->master.replicationPostingWriteRpcTicks -
-        startReplicationPostingWriteRpcTicks;
+        recoverSegmentPostingWriteRpcTicks;
     metrics->master.verifyChecksumTicks += verifyChecksumTicks;
     metrics->master.segmentAppendTicks += segmentAppendTicks;
     metrics->master.recoverySegmentEntryCount += recoverySegmentEntryCount;
@@ -1119,6 +1519,30 @@ ObjectManager::replaySegment(SideLog* sideLog, SegmentIterator& it,
     metrics->master.safeVersionNonRecoveryCount += safeVersionNonRecoveryCount;
 }
 
+/**
+ * Turn value compression on or off for a table. While it is on, values of
+ * objects subsequently written to the table are stored compressed in the
+ * log (when that makes them smaller) and decompressed when read. Objects
+ * already in the log are left as they are; reads handle both forms, as do
+ * the cleaner, backups, recovery and migration, which copy log entries
+ * verbatim.
+ *
+ * The setting is kept only in this master's memory. A table that is
+ * recovered or migrated onto another master keeps its compressed objects,
+ * but new writes there are compressed only if that master has also been
+ * told to do so.
+ *
+ * \param tableId
+ *      Identifier of the table whose setting is changed.
+ * \param enabled
+ *      True to compress values written from now on, false to stop.
+ */
+void
+ObjectManager::setTableCompression(uint64_t tableId, bool enabled)
+{
+    masterTableMetadata->findOrCreate(tableId)->compressValues = enabled;
+}
+
 /**
  * Sync any previous writes or removes. This operation is required after any
  * writeObject() or removeObject() invocation if the caller wants to ensure that
@@ -1183,7 +1607,8 @@ ObjectManager::writeObject(Object& newObject, RejectRules* rejectRules,
     const void *keyString = newObject.getKey(0, &keyLength);
     Key key(newObject.getTableId(), keyString, keyLength);
 
-    objectMap.prefetchBucket(key.getHash());
+    findIndex(key.getTableId(), key.getHash()).prefetchBucket(
+            key.getHash());
     HashTableBucketLock lock(*this, key);
 
     // If the tablet doesn't exist in the NORMAL state, we must plead ignorance.
@@ -1247,6 +1672,10 @@ ObjectManager::writeObject(Object& newObject, RejectRules* rejectRules,
     assert(currentVersion == VERSION_NONEXISTENT ||
            newObject.getVersion() > currentVersion);
 
+    // An object that replaces a recent version is likely to be overwritten
+    // again soon; anything else goes to the log's cold heads, if it has any
+    // (see ServerConfig::Master::hotObjectSeconds).
+    bool cold = true;
     Tub<ObjectTombstone> tombstone;
     if (currentVersion != VERSION_NONEXISTENT &&
       currentType == LOG_ENTRY_TYPE_OBJ) {
@@ -1254,6 +1683,12 @@ ObjectManager::writeObject(Object& newObject, RejectRules* rejectRules,
         tombstone.construct(object,
                             log.getSegmentId(currentReference),
                             WallTime::secondsTimestamp());
+        // If the clock stepped backwards, the old version looks newer than
+        // this one; call that hot rather than let the difference wrap.
+        uint32_t newTimestamp = newObject.getTimestamp();
+        uint32_t oldTimestamp = object.getTimestamp();
+        cold = newTimestamp > oldTimestamp &&
+               newTimestamp - oldTimestamp >= config->master.hotObjectSeconds;
     }
 
     // Create a vector of appends in case we need to write multiple log entries
@@ -1267,6 +1702,10 @@ ObjectManager::writeObject(Object& newObject, RejectRules* rejectRules,
     // record should exist if and only if new object is written.
     Log::AppendVector appends[2 + (rpcResult ? 1 : 0)];
 
+    // Statistics and traces describe the value as the client wrote it.
+    uint32_t valueLength = newObject.getValueLength();
+    uint32_t keysLength = newObject.getKeysAndValueLength() - valueLength;
+    compressForLog(newObject, appends[0].buffer);
     newObject.assembleForLog(appends[0].buffer);
     appends[0].type = LOG_ENTRY_TYPE_OBJ;
 
@@ -1290,7 +1729,8 @@ ObjectManager::writeObject(Object& newObject, RejectRules* rejectRules,
         appends[rpcResultIndex].type = LOG_ENTRY_TYPE_RPCRESULT;
     }
 
-    if (!log.append(appends, (tombstone ? 2 : 1) + (rpcResult ? 1 : 0))) {
+    if (!log.append(appends, (tombstone ? 2 : 1) + (rpcResult ? 1 : 0),
+                    cold)) {
         // The log is out of space. Tell the client to retry and hope
         // that the cleaner makes space soon.
         throw RetryException(HERE, 1000, 2000, "Must wait for cleaner");
@@ -1300,7 +1740,8 @@ ObjectManager::writeObject(Object& newObject, RejectRules* rejectRules,
         currentHashTableEntry.setReference(appends[0].reference.toInteger());
         log.free(currentReference);
     } else {
-        objectMap.insert(key.getHash(), appends[0].reference.toInteger());
+        getOrCreateIndex(key).insert(key.getHash(),
+                appends[0].reference.toInteger());
     }
 
     if (rpcResult && rpcResultPtr)
@@ -1308,10 +1749,8 @@ ObjectManager::writeObject(Object& newObject, RejectRules* rejectRules,
 
     tabletManager->incrementWriteCount(key);
     ++PerfStats::threadStats.writeCount;
-    uint32_t valueLength = newObject.getValueLength();
     PerfStats::threadStats.writeObjectBytes += valueLength;
-    PerfStats::threadStats.writeKeyBytes +=
-            newObject.getKeysAndValueLength() - valueLength;
+    PerfStats::threadStats.writeKeyBytes += keysLength;
 
     TEST_LOG("object: %u bytes, version %lu",
         appends[0].buffer.size(), newObject.getVersion());
@@ -1343,6 +1782,12 @@ ObjectManager::writeObject(Object& newObject, RejectRules* rejectRules,
                               recordCount);
     }
 
+    if (mutationTrace) {
+        mutationTrace->record(tombstone ? MutationTrace::OVERWRITE :
+                                          MutationTrace::WRITE,
+                key.getTableId(), key.getHash(), keyLength, valueLength);
+    }
+
     return STATUS_OK;
 }
 
@@ -1470,7 +1915,8 @@ ObjectManager::prepareOp(PreparedOp& newOp, RejectRules* rejectRules,
     const void *keyString = newOp.object.getKey(0, &keyLength);
     Key key(newOp.object.getTableId(), keyString, keyLength);
 
-    objectMap.prefetchBucket(key.getHash());
+    findIndex(key.getTableId(), key.getHash()).prefetchBucket(
+            key.getHash());
     HashTableBucketLock lock(*this, key);
 
     // If the tablet doesn't exist in the NORMAL state, we must plead ignorance.
@@ -1638,7 +2084,8 @@ ObjectManager::prepareReadOnly(PreparedOp& newOp, RejectRules* rejectRules,
     const void *keyString = newOp.object.getKey(0, &keyLength);
     Key key(newOp.object.getTableId(), keyString, keyLength);
 
-    objectMap.prefetchBucket(key.getHash());
+    findIndex(key.getTableId(), key.getHash()).prefetchBucket(
+            key.getHash());
     HashTableBucketLock lock(*this, key);
 
     // If the tablet doesn't exist in the NORMAL state, we must plead ignorance.
@@ -1706,7 +2153,8 @@ ObjectManager::tryGrabTxLock(Object& objToLock, Log::Reference& ref)
     const void *keyString = objToLock.getKey(0, &keyLength);
     Key key(objToLock.getTableId(), keyString, keyLength);
 
-    objectMap.prefetchBucket(key.getHash());
+    findIndex(key.getTableId(), key.getHash()).prefetchBucket(
+            key.getHash());
     HashTableBucketLock lock(*this, key);
 
     // If the tablet doesn't exist in the NORMAL state, we must plead ignorance.
@@ -1732,13 +2180,9 @@ ObjectManager::writeTxDecisionRecord(TxDecisionRecord& record)
 {
     // Lock the HashTableBucket to ensure that migration doesn't rip the tablet
     // out from under us.
-    objectMap.prefetchBucket(record.getKeyHash());
-    uint64_t dummy;
-    uint64_t bucketIndex = objectMap.findBucketIndex(
-            objectMap.getNumBuckets(),
-            record.getKeyHash(),
-            &dummy);
-    HashTableBucketLock lock(*this, bucketIndex);
+    findIndex(record.getTableId(), record.getKeyHash()).prefetchBucket(
+            record.getKeyHash());
+    HashTableBucketLock lock(*this, lockBucketIndex(record.getKeyHash()));
 
     // If the tablet doesn't exist in the NORMAL state, we must plead ignorance.
     TabletManager::Tablet tablet;
@@ -1935,6 +2379,11 @@ ObjectManager::commitRemove(PreparedOp& op,
     log.free(refToPreparedOp);
     transactionManager->removeOp(op.header.clientId, op.header.rpcId);
     remove(lock, key);
+
+    if (mutationTrace) {
+        mutationTrace->record(MutationTrace::REMOVE, key.getTableId(),
+                key.getHash(), keyLength, object.getValueLength());
+    }
     return STATUS_OK;
 }
 
@@ -1963,7 +2412,8 @@ ObjectManager::commitWrite(PreparedOp& op,
     bool newKey = false;
     Key key(op.object.getTableId(), keyString, keyLength);
 
-    objectMap.prefetchBucket(key.getHash());
+    findIndex(key.getTableId(), key.getHash()).prefetchBucket(
+            key.getHash());
     HashTableBucketLock lock(*this, key);
 
     // Skip if object is not prepared since it is already committed.
@@ -2017,6 +2467,7 @@ ObjectManager::commitWrite(PreparedOp& op,
     byteCount += appends[0].buffer.size();
     recordCount++;
 
+    compressForLog(op.object, appends[1].buffer);
     op.object.assembleForLog(appends[1].buffer);
     appends[1].type = LOG_ENTRY_TYPE_OBJ;
     byteCount += appends[1].buffer.size();
@@ -2068,7 +2519,14 @@ ObjectManager::commitWrite(PreparedOp& op,
         currentHashTableEntry.setReference(appends[1].reference.toInteger());
         log.free(oldReference);
     } else {
-        objectMap.insert(key.getHash(), appends[1].reference.toInteger());
+        getOrCreateIndex(key).insert(key.getHash(),
+                appends[1].reference.toInteger());
+    }
+
+    if (mutationTrace) {
+        mutationTrace->record(newKey ? MutationTrace::WRITE :
+                                       MutationTrace::OVERWRITE,
+                key.getTableId(), key.getHash(), keyLength, valueLength);
     }
     return STATUS_OK;
 }
@@ -2144,7 +2602,8 @@ ObjectManager::flushEntriesToLog(Buffer *logBuffer, uint32_t& numEntries)
             uint64_t tableId = object.getTableId();
             Key key(tableId, keyString, keyLength);
 
-            objectMap.prefetchBucket(key.getHash());
+            findIndex(key.getTableId(), key.getHash()).prefetchBucket(
+                    key.getHash());
             HashTableBucketLock lock(*this, key);
 
             if (lookup(lock, key, currentType, currentBuffer, &currentVersion,
@@ -2153,7 +2612,8 @@ ObjectManager::flushEntriesToLog(Buffer *logBuffer, uint32_t& numEntries)
                 if (currentType == LOG_ENTRY_TYPE_OBJTOMB) {
                     CleanupParameters params = { this , &lock };
                     removeIfTombstone(currentReference.toInteger(), &params);
-                    objectMap.insert(key.getHash(), references[i].toInteger());
+                    getOrCreateIndex(key).insert(key.getHash(),
+                            references[i].toInteger());
                 }
 
                 if (currentType == LOG_ENTRY_TYPE_OBJ) {
@@ -2162,7 +2622,8 @@ ObjectManager::flushEntriesToLog(Buffer *logBuffer, uint32_t& numEntries)
                     log.free(currentReference);
                 }
             } else {
-                objectMap.insert(key.getHash(), references[i].toInteger());
+                getOrCreateIndex(key).insert(key.getHash(),
+                        references[i].toInteger());
             }
 
             tabletManager->incrementWriteCount(key);
@@ -2181,7 +2642,8 @@ ObjectManager::flushEntriesToLog(Buffer *logBuffer, uint32_t& numEntries)
             uint64_t tableId = tombstone.getTableId();
             Key key(tableId, keyString, keyLength);
 
-            objectMap.prefetchBucket(key.getHash());
+            findIndex(key.getTableId(), key.getHash()).prefetchBucket(
+                    key.getHash());
             HashTableBucketLock lock(*this, key);
 
             uint64_t currentVersion = 0;
@@ -2247,7 +2709,8 @@ ObjectManager::prepareForLog(Object& newObject, Buffer *logBuffer,
     const void *keyString = newObject.getKey(0, &keyLength);
     Key key(newObject.getTableId(), keyString, keyLength);
 
-    objectMap.prefetchBucket(key.getHash());
+    findIndex(key.getTableId(), key.getHash()).prefetchBucket(
+            key.getHash());
     HashTableBucketLock lock(*this, key);
 
     // If the tablet doesn't exist in the NORMAL state, we must plead
@@ -2456,6 +2919,7 @@ ObjectManager::TombstoneRemover::TombstoneRemover(
                 HashTable* objectMap)
     : WorkerTimer(objectManager->context->dispatch)
     , currentBucket(0)
+    , resizeCount(0)
     , objectManager(objectManager)
     , objectMap(objectMap)
 {
@@ -2470,6 +2934,13 @@ ObjectManager::TombstoneRemover::handleTimerEvent()
 {
     for (int i = 0; i < 100; i++) {
         if (currentBucket >= objectMap->getNumBuckets()) {
+            // If the table was resized during the scan, tombstones may have
+            // moved into buckets that were already scanned.
+            if (objectMap->getResizeCount() != resizeCount) {
+                resizeCount = objectMap->getResizeCount();
+                currentBucket = 0;
+                continue;
+            }
             LOG(NOTICE, "Tombstone cleanup complete");
             return;
         }
@@ -2487,6 +2958,243 @@ ObjectManager::TombstoneRemover::handleTimerEvent()
     start(0);
 }
 
+/**
+ * Construct a HashTableResizer. The resizer doesn't run until started
+ * (see ObjectManager::initOnceEnlisted).
+ *
+ * \param objectManager
+ *      The instance of ObjectManager that owns the #objectMap.
+ * \param objectMap
+ *      The HashTable that will be resized.
+ */
+ObjectManager::HashTableResizer::HashTableResizer(
+                ObjectManager* objectManager,
+                HashTable* objectMap)
+    : WorkerTimer(objectManager->context->dispatch)
+    , objectManager(objectManager)
+    , objectMap(objectMap)
+    , minBuckets(objectMap->getNumBuckets())
+    , maxBuckets(~0LU)
+    , preparedNumBuckets(0)
+    , nextBucket(0)
+    , awaitingRelease(false)
+    , retiredEpoch(0)
+    , pausedReads(false)
+    , pauseEpoch(0)
+    , totalGrows(0)
+    , totalShrinks(0)
+    , totalMigrationTicks(0)
+{
+    uint64_t maxBytes = objectManager->config->master.hashTableMaxBytes;
+    if (maxBytes != 0) {
+        maxBuckets = std::max(minBuckets, BitOps::powerOfTwoLessOrEqual(
+                maxBytes / HashTable::bytesPerCacheLine()));
+    }
+}
+
+/**
+ * Make one step of progress on resizing the hash table: free memory left
+ * by the last resize once it is safe, migrate a batch of old buckets if a
+ * resize is in progress, or otherwise check whether a new resize should be
+ * started. The timer reschedules itself.
+ */
+void
+ObjectManager::HashTableResizer::handleTimerEvent()
+{
+    uint64_t checkInterval = Cycles::fromNanoseconds(
+            CHECK_INTERVAL_MS * 1000 * 1000);
+
+    // With per-table index partitions, the (otherwise empty) main table's
+    // resizer also frees partitions discarded by tablet drops.
+    if (objectManager->perTableIndex && objectMap == &objectManager->objectMap)
+        objectManager->releaseRetiredIndexPartitions();
+
+    if (objectMap->isResizing()) {
+        CycleCounter<uint64_t> _(&totalMigrationTicks);
+        uint64_t oldNumBuckets = objectMap->getOldNumBuckets();
+        for (uint64_t i = 0; i < BUCKETS_PER_PASS; i++) {
+            if (nextBucket >= oldNumBuckets)
+                break;
+            // Bucket locks don't depend on the table's size, so this also
+            // locks the new bucket(s) this old bucket migrates into.
+            HashTableBucketLock lock(*objectManager, nextBucket);
+            objectMap->migrateBucket(nextBucket);
+            ++nextBucket;
+        }
+
+        if (!objectMap->finishResize()) {
+            start(0);
+            return;
+        }
+
+        // Unlocked readers (e.g. enumerations) may still be looking at
+        // the old buckets, so their memory can't be freed until every RPC
+        // that started before now has completed.
+        retiredEpoch = LogProtector::incrementCurrentEpoch() - 1;
+        awaitingRelease = true;
+        resumeOptimisticReads();
+        LOG(NOTICE, "HashTable resize to %lu buckets complete",
+            objectMap->getNumBuckets());
+    }
+
+    if (awaitingRelease) {
+        if (!isEpochDrained(retiredEpoch)) {
+            start(Cycles::rdtsc() + checkInterval);
+            return;
+        }
+        objectMap->releaseRetiredMemory();
+        awaitingRelease = false;
+    }
+
+    uint64_t newNumBuckets = chooseNewNumBuckets();
+    if (newNumBuckets == 0) {
+        resumeOptimisticReads();
+    } else {
+        if (preparedNumBuckets != newNumBuckets) {
+            objectMap->prepareResize(newNumBuckets);
+            preparedNumBuckets = newNumBuckets;
+        }
+
+        // Optimistic readers (see ObjectManager::readObject) don't take
+        // the bucket locks, so they could see the bucket array half
+        // replaced. Switch reads over to locking first, and wait until
+        // every read that might have started optimistically is done.
+        if (!pausedReads) {
+            pausedReads = true;
+            objectMap->setOptimisticReadsPaused(true);
+            pauseEpoch = LogProtector::incrementCurrentEpoch() - 1;
+        }
+        if (isEpochDrained(pauseEpoch) && tryStartResize()) {
+            if (newNumBuckets > objectMap->getOldNumBuckets())
+                totalGrows++;
+            else
+                totalShrinks++;
+            preparedNumBuckets = 0;
+            nextBucket = 0;
+            start(0);
+            return;
+        }
+    }
+
+    start(Cycles::rdtsc() + checkInterval);
+}
+
+/**
+ * Stop the resizer for good, because its table is being discarded. Unlike
+ * WorkerTimer::stop(), this also lets readObject() read optimistically
+ * again if the resizer had prevented it.
+ */
+void
+ObjectManager::HashTableResizer::shutdown()
+{
+    stop();
+    resumeOptimisticReads();
+}
+
+/**
+ * Let readObject() read this resizer's table optimistically again, if the
+ * resizer had prevented it.
+ */
+void
+ObjectManager::HashTableResizer::resumeOptimisticReads()
+{
+    if (pausedReads) {
+        pausedReads = false;
+        objectMap->setOptimisticReadsPaused(false);
+    }
+}
+
+/**
+ * Decide whether the table is over- or under-loaded.
+ *
+ * \return
+ *      The number of buckets the table should be resized to, or 0 if it
+ *      should be left alone.
+ */
+uint64_t
+ObjectManager::HashTableResizer::chooseNewNumBuckets()
+{
+    uint64_t numBuckets = objectMap->getNumBuckets();
+    uint64_t slots = numBuckets * HashTable::entriesPerCacheLine();
+    uint64_t numEntries = objectMap->getNumEntries();
+
+    if (numEntries * 100 > slots * GROW_LOAD_PERCENT &&
+            numBuckets * 2 <= maxBuckets) {
+        return numBuckets * 2;
+    }
+    if (numEntries * 100 < slots * SHRINK_LOAD_PERCENT &&
+            numBuckets / 2 >= minBuckets) {
+        return numBuckets / 2;
+    }
+    return 0;
+}
+
+/**
+ * Check whether every RPC that started in a given LogProtector epoch (or
+ * earlier) has completed.
+ *
+ * \param epoch
+ *      Epoch returned by LogProtector::incrementCurrentEpoch(), minus one.
+ */
+bool
+ObjectManager::HashTableResizer::isEpochDrained(uint64_t epoch)
+{
+    Dispatch::Lock lock(objectManager->context->dispatch);
+    return epoch < LogProtector::getEarliestOutstandingEpoch(
+            Transport::ServerRpc::READ_ACTIVITY);
+}
+
+/**
+ * Install the prepared bucket array. This requires exclusive access to the
+ * whole table, so it tries to acquire every bucket lock; if any of them is
+ * busy, all are released again so that nobody waits on the resizer.
+ *
+ * \return
+ *      True if the resize was started, false if some bucket lock was busy.
+ */
+bool
+ObjectManager::HashTableResizer::tryStartResize()
+{
+    UnnamedSpinLock* locks = objectManager->hashTableBucketLocks;
+    uint32_t numLocks = arrayLength(objectManager->hashTableBucketLocks);
+    uint32_t acquired = 0;
+    while (acquired < numLocks && locks[acquired].try_lock())
+        acquired++;
+
+    if (acquired == numLocks)
+        objectMap->startResize(getKeyHash, objectManager);
+
+    for (uint32_t i = 0; i < acquired; i++)
+        locks[i].unlock();
+    return acquired == numLocks;
+}
+
+/**
+ * Fill in metrics describing the hash table and its resizing.
+ *
+ * \param m
+ *      Protocol buffer to fill in.
+ */
+void
+ObjectManager::HashTableResizer::getMetrics(
+        ProtoBuf::LogMetrics_HashTableMetrics& m)
+{
+    uint64_t numBuckets = objectMap->getNumBuckets();
+    m.set_num_buckets(numBuckets);
+    m.set_num_entries(objectMap->getNumEntries());
+    m.set_load_factor(static_cast<double>(objectMap->getNumEntries()) /
+            static_cast<double>(numBuckets *
+                                HashTable::entriesPerCacheLine()));
+    m.set_overflow_cache_lines(objectMap->getNumOverflowLines());
+    m.set_longest_chain(objectMap->getLongestChain());
+    m.set_resize_in_progress(objectMap->isResizing());
+    m.set_buckets_migrated(objectMap->getBucketsMigrated());
+    m.set_old_num_buckets(objectMap->getOldNumBuckets());
+    m.set_total_grows(totalGrows);
+    m.set_total_shrinks(totalShrinks);
+    m.set_total_migration_ticks(totalMigrationTicks);
+}
+
 /**
  * Constructor for TombstoneProtectors. Make sure the tombstone
  * remover isn't running.
@@ -2498,6 +3206,14 @@ ObjectManager::TombstoneProtector::TombstoneProtector(
     SpinLock::Guard guard(objectManager->mutex);
     ++objectManager->tombstoneProtectorCount;
     objectManager->tombstoneRemover.stop();
+
+    // Stopping a remover may wait for its handler, which needs
+    // indexPartitionLock, so the partitions' removers are stopped
+    // without holding it.
+    vector<IndexPartition*> partitions;
+    objectManager->getIndexPartitions(&partitions);
+    for (size_t i = 0; i < partitions.size(); i++)
+        partitions[i]->tombstoneRemover.stop();
 }
 
 /**
@@ -2510,8 +3226,79 @@ ObjectManager::TombstoneProtector::~TombstoneProtector()
     --objectManager->tombstoneProtectorCount;
     if (objectManager->tombstoneProtectorCount == 0) {
         objectManager->tombstoneRemover.currentBucket = 0;
+        objectManager->tombstoneRemover.resizeCount =
+                objectManager->objectMap.getResizeCount();
         objectManager->tombstoneRemover.start(0);
+
+        // Holding indexPartitionLock ensures that no partition is restarted
+        // after removeOrphanedObjects() has unlinked and stopped it.
+        SpinLock::Guard _(objectManager->indexPartitionLock);
+        vector<IndexPartition*> partitions;
+        objectManager->getIndexPartitions(&partitions);
+        foreach (IndexPartition* partition, partitions) {
+            TombstoneRemover& remover = partition->tombstoneRemover;
+            remover.currentBucket = 0;
+            remover.resizeCount = remover.objectMap->getResizeCount();
+            remover.start(0);
+        }
+    }
+}
+
+/**
+ * Compress an object's value before it is appended to the log, if its table
+ * has compression turned on (see setTableCompression()). Otherwise, or if
+ * compressing wouldn't make the object smaller, the object is unchanged.
+ *
+ * \param object
+ *      Object about to be assembled for the log.
+ * \param storage
+ *      Buffer that will hold the compressed value; it must live at least
+ *      as long as \a object is in use. Passing the buffer that the object
+ *      is about to be assembled into avoids a separate allocation.
+ */
+void
+ObjectManager::compressForLog(Object& object, Buffer& storage)
+{
+    MasterTableMetadata::Entry* entry =
+            masterTableMetadata->find(object.getTableId());
+    if (entry == NULL || !entry->compressValues.load(
+            std::memory_order_relaxed))
+        return;
+
+    uint32_t valueLength = object.getValueLength();
+    if (!object.compressValue(storage)) {
+        PerfStats::threadStats.incompressibleObjects++;
+        return;
+    }
+    PerfStats::threadStats.compressedObjects++;
+    PerfStats::threadStats.uncompressedValueBytes += valueLength;
+    PerfStats::threadStats.compressedValueBytes += object.getValueLength();
+}
+
+/**
+ * Restore the original value of an object read from the log whose value is
+ * compressed, so that it can be returned to a client.
+ *
+ * \param object
+ *      Object whose value is compressed.
+ * \param storage
+ *      Buffer that will hold the decompressed keys and value; it must live
+ *      at least as long as \a object is in use. This is normally the RPC
+ *      response that the value is about to be appended to.
+ * \return
+ *      True if the value was decompressed. False if it was malformed, which
+ *      means the log entry is corrupt.
+ */
+bool
+ObjectManager::decompressForRead(Object& object, Buffer& storage)
+{
+    if (!object.decompressValue(storage)) {
+        LOG(ERROR, "Compressed value of object in table %lu (version %lu) "
+            "is corrupt", object.getTableId(), object.getVersion());
+        return false;
     }
+    PerfStats::threadStats.decompressedObjects++;
+    return true;
 }
 
 /**
@@ -2665,6 +3452,263 @@ ObjectManager::getTxDecisionRecordTimestamp(Buffer& buffer)
     return record.getTimestamp();
 }
 
+/**
+ * Construct an empty partition.
+ *
+ * \param objectManager
+ *      The ObjectManager whose objects the partition indexes.
+ * \param tableId
+ *      Identifier of the table whose objects the partition indexes.
+ * \param startKeyHash
+ *      First key hash the partition indexes.
+ * \param endKeyHash
+ *      Last key hash (inclusive) the partition indexes.
+ */
+ObjectManager::IndexPartition::IndexPartition(ObjectManager* objectManager,
+                                              uint64_t tableId,
+                                              uint64_t startKeyHash,
+                                              uint64_t endKeyHash)
+    : tableId(tableId)
+    , startKeyHash(startKeyHash)
+    , endKeyHash(endKeyHash)
+    , objectMap(HashTable::create(objectManager->config->master.hashTableType,
+            arrayLength(objectManager->hashTableBucketLocks),
+            MemoryPolicy(objectManager->config->master.memoryPolicy)))
+    , tombstoneRemover(objectManager, objectMap.get())
+    , resizer(objectManager, objectMap.get())
+{
+}
+
+/**
+ * Return the entry of #indexTables for a given table, or NULL if the table
+ * never had a partition here. This doesn't take any locks.
+ */
+ObjectManager::IndexTable*
+ObjectManager::findIndexTable(uint64_t tableId)
+{
+    IndexTable* table = indexTables[tableId % INDEX_TABLE_CHAINS].load(
+            std::memory_order_acquire);
+    while (table != NULL && table->tableId != tableId)
+        table = table->next;
+    return table;
+}
+
+/**
+ * Return the HashTable that indexes a given key hash of a table. This
+ * doesn't take any locks, so it can be used on every read and write.
+ * Callers that use the result under a HashTableBucketLock must call this
+ * after taking the lock (see releaseRetiredIndexPartitions()).
+ *
+ * \param tableId
+ *      Identifier of the table.
+ * \param keyHash
+ *      Hash of the key being looked up.
+ * \return
+ *      #objectMap unless ServerConfig::Master::hashTablePerTable is set.
+ *      Otherwise the partition covering the key hash, or the empty
+ *      #objectMap if there is none (in which case there's nothing to find).
+ */
+HashTable&
+ObjectManager::findIndex(uint64_t tableId, KeyHash keyHash)
+{
+    if (!perTableIndex)
+        return objectMap;
+
+    IndexTable* table = findIndexTable(tableId);
+    if (table == NULL)
+        return objectMap;
+    const IndexPartitionSet* set =
+            table->partitions.load(std::memory_order_acquire);
+    if (set == NULL)
+        return objectMap;
+    foreach (IndexPartition* partition, set->partitions) {
+        if (keyHash < partition->startKeyHash)
+            break;
+        if (keyHash <= partition->endKeyHash)
+            return *partition->objectMap;
+    }
+    return objectMap;
+}
+
+/**
+ * Return every HashTable that may index objects in a given range of a
+ * table's key hashes. A tablet usually has one partition, but it can span
+ * several once tablets are merged or a partition was carved out of part of
+ * its range (see getOrCreateIndex()). Like findIndex(), this doesn't take
+ * any locks.
+ *
+ * \param tableId
+ *      Identifier of the table.
+ * \param startKeyHash
+ *      Lowest key hash in the range.
+ * \param endKeyHash
+ *      Highest key hash in the range (inclusive).
+ * \param[out] objectMaps
+ *      The hash tables are appended to this vector, in key hash order. At
+ *      least one is always appended (#objectMap, if no partition overlaps
+ *      the range). They remain valid until the calling RPC completes.
+ */
+void
+ObjectManager::getObjectMaps(uint64_t tableId, uint64_t startKeyHash,
+                             uint64_t endKeyHash,
+                             vector<HashTable*>* objectMaps)
+{
+    size_t initialSize = objectMaps->size();
+    IndexTable* table = perTableIndex ? findIndexTable(tableId) : NULL;
+    const IndexPartitionSet* set = (table == NULL) ? NULL :
+            table->partitions.load(std::memory_order_acquire);
+    if (set != NULL) {
+        foreach (IndexPartition* partition, set->partitions) {
+            if (partition->startKeyHash > endKeyHash)
+                break;
+            if (partition->endKeyHash >= startKeyHash)
+                objectMaps->push_back(partition->objectMap.get());
+        }
+    }
+    if (objectMaps->size() == initialSize)
+        objectMaps->push_back(&objectMap);
+}
+
+/**
+ * Return the HashTable that a new object or tombstone should be inserted
+ * into, creating a partition for it if needed. A new partition covers
+ * the range of the key's tablet, minus any parts of it that existing
+ * partitions already cover.
+ *
+ * \param key
+ *      Key of the object or tombstone.
+ */
+HashTable&
+ObjectManager::getOrCreateIndex(Key& key)
+{
+    if (!perTableIndex)
+        return objectMap;
+
+    uint64_t tableId = key.getTableId();
+    KeyHash keyHash = key.getHash();
+    HashTable& existing = findIndex(tableId, keyHash);
+    if (&existing != &objectMap)
+        return existing;
+
+    uint64_t startKeyHash = 0;
+    uint64_t endKeyHash = ~0UL;
+    TabletManager::Tablet tablet;
+    if (tabletManager->getTablet(key, &tablet)) {
+        startKeyHash = tablet.startKeyHash;
+        endKeyHash = tablet.endKeyHash;
+    }
+
+    // Allocate outside the lock; if someone else creates a partition for
+    // the key in the meantime, theirs wins.
+    IndexPartition* partition = NULL;
+    {
+        SpinLock::Guard _(indexPartitionLock);
+        IndexTable* table = findIndexTable(tableId);
+        if (table == NULL) {
+            std::atomic<IndexTable*>& chain =
+                    indexTables[tableId % INDEX_TABLE_CHAINS];
+            table = new IndexTable(tableId, chain.load());
+            chain.store(table, std::memory_order_release);
+        }
+        const IndexPartitionSet* set = table->partitions.load();
+        vector<IndexPartition*> partitions;
+        if (set != NULL)
+            partitions = set->partitions;
+        foreach (IndexPartition* other, partitions) {
+            if (keyHash >= other->startKeyHash &&
+                    keyHash <= other->endKeyHash) {
+                return *other->objectMap;
+            }
+            if (other->endKeyHash < keyHash)
+                startKeyHash = std::max(startKeyHash, other->endKeyHash + 1);
+            else
+                endKeyHash = std::min(endKeyHash, other->startKeyHash - 1);
+        }
+        partition = new IndexPartition(this, tableId, startKeyHash,
+                                       endKeyHash);
+        partitions.push_back(partition);
+        std::sort(partitions.begin(), partitions.end(),
+                  [](IndexPartition* a, IndexPartition* b) {
+                      return a->startKeyHash < b->startKeyHash;
+                  });
+        publishIndexPartitions(table, partitions);
+    }
+
+    partition->resizer.start(0);
+    return *partition->objectMap;
+}
+
+/**
+ * Replace the partitions of a table in #indexTables. The caller must hold
+ * #indexPartitionLock. The old set is retired rather than freed, since
+ * readers may still be using it.
+ *
+ * \param table
+ *      Entry of the table.
+ * \param partitions
+ *      The table's new partitions, sorted by key hash range.
+ */
+void
+ObjectManager::publishIndexPartitions(IndexTable* table,
+        const vector<IndexPartition*>& partitions)
+{
+    const IndexPartitionSet* old = table->partitions.load();
+    table->partitions.store(new IndexPartitionSet(partitions),
+                            std::memory_order_release);
+    if (old != NULL) {
+        retiredIndexPartitionSets.push_back(
+                {LogProtector::incrementCurrentEpoch() - 1, old});
+    }
+}
+
+/**
+ * Return the current index partitions.
+ *
+ * \param[out] partitions
+ *      The partitions are appended to this vector. They remain valid until
+ *      the calling RPC completes, even if discarded in the meantime.
+ * \param tableId
+ *      If not ~0, only the partitions of this table are returned.
+ */
+void
+ObjectManager::getIndexPartitions(vector<IndexPartition*>* partitions,
+                                  uint64_t tableId)
+{
+    for (uint32_t i = 0; i < INDEX_TABLE_CHAINS; i++) {
+        for (IndexTable* table = indexTables[i].load(); table != NULL;
+                table = table->next) {
+            if (tableId != ~0UL && table->tableId != tableId)
+                continue;
+            const IndexPartitionSet* set = table->partitions.load();
+            if (set != NULL) {
+                partitions->insert(partitions->end(), set->partitions.begin(),
+                                   set->partitions.end());
+            }
+        }
+    }
+}
+
+/**
+ * Return the bucket index whose entry in #hashTableBucketLocks guards a
+ * given key hash.
+ *
+ * \param keyHash
+ *      Hash of the key (see Key::getHash()).
+ */
+uint64_t
+ObjectManager::lockBucketIndex(KeyHash keyHash)
+{
+    // Every partition has at least as many buckets as there are locks, so
+    // the low bits of the hash pick the same lock regardless of which
+    // partition the key is in or how large it has grown.
+    if (perTableIndex)
+        return keyHash;
+
+    uint64_t unused;
+    return HashTable::findBucketIndex(objectMap.getNumBuckets(), keyHash,
+                                      &unused);
+}
+
 /**
  * Look up an object in the hash table, then extract the entry from the
  * log. Since tombstones are stored in the hash table during recovery,
@@ -2705,12 +3749,37 @@ ObjectManager::lookup(HashTableBucketLock& lock, Key& key,
                 uint64_t* outVersion,
                 Log::Reference* outReference,
                 HashTable::Candidates* outCandidates)
+{
+    return lookupUnlocked(key, outType, buffer, outVersion, outReference,
+            outCandidates);
+}
+
+/**
+ * Same as lookup(), except that it doesn't require the caller to hold the
+ * bucket lock. Callers that don't must verify with #hashTableBucketVersions
+ * that no writer modified the bucket while this method ran, and discard the
+ * results otherwise (see readObject()).
+ *
+ * Arguments and return value are the same as for lookup().
+ */
+bool
+ObjectManager::lookupUnlocked(Key& key, LogEntryType& outType, Buffer& buffer,
+                uint64_t* outVersion,
+                Log::Reference* outReference,
+                HashTable::Candidates* outCandidates)
 {
     HashTable::Candidates candidates;
-    objectMap.lookup(key.getHash(), candidates);
+    findIndex(key.getTableId(), key.getHash()).lookup(key.getHash(),
+                                                     candidates);
     while (!candidates.isDone()) {
+        uint64_t candidateReference = candidates.getReference();
+        if (candidateReference == 0) {
+            // Removed by a concurrent writer (unlocked callers only).
+            candidates.next();
+            continue;
+        }
         Buffer candidateBuffer;
-        Log::Reference candidateRef(candidates.getReference());
+        Log::Reference candidateRef(candidateReference);
         LogEntryType type = log.getEntry(candidateRef, candidateBuffer);
 
         Key candidateKey(type, candidateBuffer);
@@ -2757,7 +3826,8 @@ bool
 ObjectManager::remove(HashTableBucketLock& lock, Key& key)
 {
     HashTable::Candidates candidates;
-    objectMap.lookup(key.getHash(), candidates);
+    findIndex(key.getTableId(), key.getHash()).lookup(key.getHash(),
+                                                     candidates);
     while (!candidates.isDone()) {
         Buffer buffer;
         Log::Reference candidateRef(candidates.getReference());
@@ -2853,6 +3923,26 @@ ObjectManager::removeIfTombstone(uint64_t maybeTomb, void *cookie)
     }
 }
 
+/**
+ * Return the key hash of an object or tombstone in the log. This is the
+ * HashTable::KeyHashCallback used when growing #objectMap.
+ *
+ * \param reference
+ *      Log reference of the object or tombstone, as stored in the table.
+ * \param cookie
+ *      The ObjectManager owning the log.
+ */
+KeyHash
+ObjectManager::getKeyHash(uint64_t reference, void* cookie)
+{
+    ObjectManager* objectManager = reinterpret_cast<ObjectManager*>(cookie);
+    Buffer buffer;
+    LogEntryType type = objectManager->log.getEntry(
+            Log::Reference(reference), buffer);
+    Key key(type, buffer);
+    return key.getHash();
+}
+
 /**
  * Synchronously remove leftover tombstones in the hash table added during
  * replaySegment calls (for example, as caused by a recovery). This private
@@ -2862,11 +3952,102 @@ ObjectManager::removeIfTombstone(uint64_t maybeTomb, void *cookie)
 void
 ObjectManager::removeTombstones()
 {
-    for (uint64_t i = 0; i < objectMap.getNumBuckets(); i++) {
+    scanIndex(objectMap, removeIfTombstone);
+
+    vector<IndexPartition*> partitions;
+    getIndexPartitions(&partitions);
+    for (size_t i = 0; i < partitions.size(); i++)
+        scanIndex(*partitions[i]->objectMap, removeIfTombstone);
+}
+
+/**
+ * Invoke removeIfOrphanedObject() or removeIfTombstone() on every entry
+ * of a hash table, holding the bucket lock for each bucket as it is
+ * visited.
+ *
+ * \param index
+ *      Either #objectMap or the HashTable of one of #indexPartitions.
+ * \param callback
+ *      Function to invoke on each entry; its cookie is a CleanupParameters.
+ */
+void
+ObjectManager::scanIndex(HashTable& index,
+                         void (*callback)(uint64_t, void*))
+{
+    // Rescan if the table was resized underneath us, since entries may
+    // have moved into buckets that were already scanned.
+    uint64_t resizeCount;
+    do {
+        resizeCount = index.getResizeCount();
+        for (uint64_t i = 0; i < index.getNumBuckets(); i++) {
+            HashTableBucketLock lock(*this, i);
+            CleanupParameters params = { this , &lock };
+            index.forEachInBucket(callback, &params, i);
+        }
+    } while (index.getResizeCount() != resizeCount);
+}
+
+/**
+ * Free the index partitions discarded by removeOrphanedObjects(), and the
+ * partition sets replaced in #indexTables, once nothing that might still
+ * be reading them without locks is in progress.
+ */
+void
+ObjectManager::releaseRetiredIndexPartitions()
+{
+    {
+        SpinLock::Guard _(indexPartitionLock);
+        if (retiredIndexPartitions.empty() &&
+                retiredIndexPartitionSets.empty()) {
+            return;
+        }
+    }
+
+    uint64_t earliestEpoch;
+    {
+        Dispatch::Lock lock(context->dispatch);
+        earliestEpoch = LogProtector::getEarliestOutstandingEpoch(
+                Transport::ServerRpc::READ_ACTIVITY);
+    }
+
+    vector<IndexPartition*> released;
+    vector<const IndexPartitionSet*> releasedSets;
+    {
+        SpinLock::Guard _(indexPartitionLock);
+        size_t kept = 0;
+        for (size_t i = 0; i < retiredIndexPartitions.size(); i++) {
+            if (retiredIndexPartitions[i].first < earliestEpoch)
+                released.push_back(retiredIndexPartitions[i].second);
+            else
+                retiredIndexPartitions[kept++] = retiredIndexPartitions[i];
+        }
+        retiredIndexPartitions.resize(kept);
+        kept = 0;
+        for (size_t i = 0; i < retiredIndexPartitionSets.size(); i++) {
+            if (retiredIndexPartitionSets[i].first < earliestEpoch) {
+                releasedSets.push_back(retiredIndexPartitionSets[i].second);
+            } else {
+                retiredIndexPartitionSets[kept++] =
+                        retiredIndexPartitionSets[i];
+            }
+        }
+        retiredIndexPartitionSets.resize(kept);
+    }
+    if (released.empty() && releasedSets.empty())
+        return;
+
+    // The epoch covers RPCs; the cleaner looks partitions up while holding
+    // the bucket lock for the key, so cycling through every lock waits out
+    // anyone else who found these before they were unlinked.
+    for (uint64_t i = 0; i < arrayLength(hashTableBucketLocks); i++) {
         HashTableBucketLock lock(*this, i);
-        CleanupParameters params = { this , &lock };
-        objectMap.forEachInBucket(removeIfTombstone, &params, i);
     }
+
+    // Freeing a large table takes a while, so do it without the lock.
+    for (size_t i = 0; i < released.size(); i++)
+        delete released[i];
+    for (size_t i = 0; i < releasedSets.size(); i++)
+        delete releasedSets[i];
 }
 
 /**
@@ -2946,7 +4127,8 @@ ObjectManager::relocateObject(Buffer& oldBuffer, Log::Reference oldReference,
     // can easily avoid looping over the bucket twice this way for
     // live objects.
     HashTable::Candidates candidates;
-    objectMap.lookup(key.getHash(), candidates);
+    findIndex(key.getTableId(), key.getHash()).lookup(key.getHash(),
+                                                     candidates);
     while (!candidates.isDone()) {
         if (candidates.getReference() != oldReference.toInteger()) {
             candidates.next();
@@ -2985,7 +4167,8 @@ ObjectManager::keyPointsAtReference(Key& key, AbstractLog::Reference reference)
     HashTableBucketLock lock(*this, key);
 
     HashTable::Candidates candidates;
-    objectMap.lookup(key.getHash(), candidates);
+    findIndex(key.getTableId(), key.getHash()).lookup(key.getHash(),
+                                                     candidates);
     while (!candidates.isDone()) {
         if (candidates.getReference() != reference.toInteger()) {
             candidates.next();
@@ -3185,7 +4368,8 @@ ObjectManager::relocateTombstone(Buffer& oldBuffer, Log::Reference oldReference,
     Key key(LOG_ENTRY_TYPE_OBJTOMB, oldBuffer);
     HashTableBucketLock lock(*this, key);
     HashTable::Candidates candidates;
-    objectMap.lookup(key.getHash(), candidates);
+    findIndex(key.getTableId(), key.getHash()).lookup(key.getHash(),
+                                                     candidates);
     while (!candidates.isDone()) {
         if (candidates.getReference() != oldReference.toInteger()) {
             candidates.next();
@@ -3277,7 +4461,8 @@ ObjectManager::replace(HashTableBucketLock& lock, Key& key,
                 Log::Reference reference)
 {
     HashTable::Candidates candidates;
-    objectMap.lookup(key.getHash(), candidates);
+    findIndex(key.getTableId(), key.getHash()).lookup(key.getHash(),
+                                                     candidates);
     while (!candidates.isDone()) {
         Buffer buffer;
         Log::Reference candidateRef(candidates.getReference());
@@ -3290,7 +4475,8 @@ ObjectManager::replace(HashTableBucketLock& lock, Key& key,
         candidates.next();
     }
 
-    objectMap.insert(key.getHash(), reference.toInteger());
+    getOrCreateIndex(key).insert(key.getHash(),
+            reference.toInteger());
     return false;
 }
 
@@ -21,6 +21,7 @@
 #include "SideLog.h"
 #include "LogEntryHandlers.h"
 #include "HashTable.h"
+#include "MutationTrace.h"
 #include "IndexKey.h"
 #include "Object.h"
 #include "ParticipantList.h"
@@ -30,6 +31,7 @@
 #include "ReplicaManager.h"
 #include "RpcResult.h"
 #include "ServerConfig.h"
+#include "ServerStatistics.pb.h"
 #include "SpinLock.h"
 #include "TabletManager.h"
 #include "TransactionManager.h"
@@ -57,6 +59,15 @@ namespace RAMCloud {
 class ObjectManager : public LogEntryHandlers,
                       public AbstractLog::ReferenceFreer {
   public:
+    /**
+     * The largest number of keys that callers should pass to
+     * prefetchObjects() at once. Each key may have two cache misses in
+     * flight at a time (its hash table bucket, then its log entry), and
+     * processors only track about 10-20 outstanding misses per core, so
+     * larger batches just evict their own earlier prefetches.
+     */
+    static const uint32_t MAX_PREFETCH_BATCH = 8;
+
 
     ObjectManager(Context* context, ServerId* serverId,
                 const ServerConfig* config,
@@ -74,6 +85,7 @@ class ObjectManager : public LogEntryHandlers,
                 uint32_t maxLength, Buffer* response, uint32_t* respNumHashes,
                 uint32_t* numObjects);
     void prefetchHashTableBucket(SegmentIterator* it);
+    void prefetchObjects(Tub<Key>* keys, uint32_t numKeys);
     Status readObject(Key& key, Buffer* outBuffer,
                 RejectRules* rejectRules, uint64_t* outVersion,
                 bool valueOnly = false);
@@ -81,9 +93,15 @@ class ObjectManager : public LogEntryHandlers,
                 uint64_t* outVersion, Buffer* removedObjBuffer = NULL,
                 RpcResult* rpcResult = NULL, uint64_t* rpcResultPtr = NULL);
     void removeOrphanedObjects();
+    void removeOrphanedObjects(uint64_t tableId, uint64_t firstKeyHash = 0,
+                uint64_t lastKeyHash = ~0UL);
+    struct ReplayStats;
     void replaySegment(SideLog* sideLog, SegmentIterator& it,
-                std::unordered_map<uint64_t, uint64_t>* nextNodeIdMap);
+                std::unordered_map<uint64_t, uint64_t>* nextNodeIdMap,
+                uint32_t shard = 0, uint32_t numShards = 1,
+                ReplayStats* stats = NULL);
     void replaySegment(SideLog* sideLog, SegmentIterator& it);
+    void setTableCompression(uint64_t tableId, bool enabled);
     void syncChanges();
     Status writeObject(Object& newObject, RejectRules* rejectRules,
                 uint64_t* outVersion, Buffer* removedObjBuffer = NULL,
@@ -133,6 +151,15 @@ class ObjectManager : public LogEntryHandlers,
     Log* getLog() { return &log; }
     ReplicaManager* getReplicaManager() { return &replicaManager; }
     HashTable* getObjectMap() { return &objectMap; }
+    HashTable* getObjectMap(uint64_t tableId, KeyHash keyHash)
+    {
+        return &findIndex(tableId, keyHash);
+    }
+    void getObjectMaps(uint64_t tableId, uint64_t startKeyHash,
+                uint64_t endKeyHash, vector<HashTable*>* objectMaps);
+    void getHashTableMetrics(ProtoBuf::LogMetrics_HashTableMetrics& m);
+    void getCompressionStatistics(
+                ProtoBuf::ServerStatistics_CompressionStats* stats);
 
     /**
      * An object of this class must be held by any activity that places
@@ -154,6 +181,52 @@ class ObjectManager : public LogEntryHandlers,
         DISALLOW_COPY_AND_ASSIGN(TombstoneProtector);
     };
 
+    /**
+     * The recovery metrics counted by a replaySegment() call. Calls that
+     * run at the same time (see SegmentReplayer) each count into one of
+     * these instead of into the metrics, which aren't safe to update from
+     * several threads, and the totals are added to the metrics afterwards
+     * with addToMetrics().
+     */
+    struct ReplayStats {
+        ReplayStats()
+            : recoverSegmentTicks(0)
+            , backupInRecoverTicks(0)
+            , recoverSegmentPostingWriteRpcTicks(0)
+            , verifyChecksumTicks(0)
+            , segmentAppendTicks(0)
+            , recoverySegmentEntryCount(0)
+            , recoverySegmentEntryBytes(0)
+            , objectAppendCount(0)
+            , tombstoneAppendCount(0)
+            , liveObjectCount(0)
+            , liveObjectBytes(0)
+            , objectDiscardCount(0)
+            , tombstoneDiscardCount(0)
+            , safeVersionRecoveryCount(0)
+            , safeVersionNonRecoveryCount(0)
+        {}
+        void add(const ReplayStats& other);
+        void addToMetrics() const;
+
+        // Each is added to the master metric of the same name.
+        uint64_t recoverSegmentTicks;
+        uint64_t backupInRecoverTicks;
+        uint64_t recoverSegmentPostingWriteRpcTicks;
+        uint64_t verifyChecksumTicks;
+        uint64_t segmentAppendTicks;
+        uint64_t recoverySegmentEntryCount;
+        uint64_t recoverySegmentEntryBytes;
+        uint64_t objectAppendCount;
+        uint64_t tombstoneAppendCount;
+        uint64_t liveObjectCount;
+        uint64_t liveObjectBytes;
+        uint64_t objectDiscardCount;
+        uint64_t tombstoneDiscardCount;
+        uint64_t safeVersionRecoveryCount;
+        uint64_t safeVersionNonRecoveryCount;
+    };
+
   PRIVATE:
     /**
      * An instance of this class locks the bucket of the hash table that a given
@@ -164,6 +237,10 @@ class ObjectManager : public LogEntryHandlers,
      * belonging to that key. ObjectManager maintains a number of fine-grained
      * locks to reduce the likelihood of contention between operations on
      * different keys (see ObjectManager::hashTableBucketLocks).
+     *
+     * Holding the lock also keeps the corresponding entry of
+     * ObjectManager::hashTableBucketVersions odd, which is how readObject()
+     * detects that it raced with a modification without taking the lock.
      */
     class HashTableBucketLock {
       public:
@@ -178,12 +255,10 @@ class ObjectManager : public LogEntryHandlers,
          */
         HashTableBucketLock(ObjectManager& objectManager, Key& key)
             : lock(NULL)
+            , version(NULL)
         {
-            uint64_t unused;
-            uint64_t bucket = HashTable::findBucketIndex(
-                        objectManager.objectMap.getNumBuckets(),
-                        key.getHash(), &unused);
-            takeBucketLock(objectManager, bucket);
+            takeBucketLock(objectManager,
+                           objectManager.lockBucketIndex(key.getHash()));
         }
 
         /**
@@ -197,12 +272,15 @@ class ObjectManager : public LogEntryHandlers,
          */
         HashTableBucketLock(ObjectManager& objectManager, uint64_t bucket)
             : lock(NULL)
+            , version(NULL)
         {
             takeBucketLock(objectManager, bucket);
         }
 
         ~HashTableBucketLock()
         {
+            version->store(version->load(std::memory_order_relaxed) + 1,
+                           std::memory_order_release);
             lock->unlock();
         }
 
@@ -225,12 +303,23 @@ class ObjectManager : public LogEntryHandlers,
             uint64_t lockIndex = bucket & (numLocks - 1);
             lock = &objectManager.hashTableBucketLocks[lockIndex];
             lock->lock();
+
+            // Optimistic readers must see the version change before any of
+            // our modifications to the bucket or the objects it refers to.
+            version = &objectManager.hashTableBucketVersions[lockIndex].value;
+            version->store(version->load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
         }
 
         /// The hash table bucket spinlock this object acquired in the
         /// constructor and will release in the destructor.
         SpinLock* lock;
 
+        /// Version number for the locked bucket stripe; odd while #lock
+        /// is held by this object.
+        std::atomic<uint64_t>* version;
+
         DISALLOW_COPY_AND_ASSIGN(HashTableBucketLock);
     };
 
@@ -262,6 +351,9 @@ class ObjectManager : public LogEntryHandlers,
         /// Which bucket of #objectMap should be cleaned out next.
         uint64_t currentBucket;
 
+        /// HashTable::getResizeCount() when the current scan started.
+        uint64_t resizeCount;
+
         /// The ObjectManager that owns the hash table to remove tombstones
         /// from in the #recoveryCleanup callback.
         ObjectManager* objectManager;
@@ -274,20 +366,201 @@ class ObjectManager : public LogEntryHandlers,
         DISALLOW_COPY_AND_ASSIGN(TombstoneRemover);
     };
 
+    /**
+     * This object executes in the background (as a WorkerTimer) to double
+     * or halve #objectMap as its load factor changes. Resizing is
+     * incremental: once the new bucket array has been installed, old
+     * buckets are migrated a few at a time, each under its
+     * HashTableBucketLock, so no operation ever waits for the whole table
+     * to be rehashed. See HashTable's "Incremental Resizing" section.
+     */
+    class HashTableResizer : public WorkerTimer {
+      public:
+        HashTableResizer(ObjectManager* objectManager,
+                         HashTable* objectMap);
+        void handleTimerEvent();
+        void getMetrics(ProtoBuf::LogMetrics_HashTableMetrics& m);
+        void shutdown();
+
+        /// How often to check whether the table needs to be resized.
+        static const uint64_t CHECK_INTERVAL_MS = 100;
+
+        /// Number of old buckets migrated by each invocation of the timer
+        /// while a resize is in progress.
+        static const uint64_t BUCKETS_PER_PASS = 1000;
+
+        /// The table is doubled once it holds more entries than this
+        /// percentage of the slots in its bucket array.
+        static const uint64_t GROW_LOAD_PERCENT = 50;
+
+        /// The table is halved once it holds fewer entries than this
+        /// percentage of the slots in its bucket array. This must be well
+        /// below half of GROW_LOAD_PERCENT to avoid oscillating.
+        static const uint64_t SHRINK_LOAD_PERCENT = 10;
+
+      PRIVATE:
+        uint64_t chooseNewNumBuckets();
+        bool isEpochDrained(uint64_t epoch);
+        void resumeOptimisticReads();
+        bool tryStartResize();
+
+        /// The ObjectManager whose bucket locks serialize migration with
+        /// regular operations.
+        ObjectManager* objectManager;
+
+        /// The hash table to be resized.
+        HashTable* objectMap;
+
+        /// The table will never shrink below this many buckets (the number
+        /// it had when the server started).
+        uint64_t minBuckets;
+
+        /// The table will never grow beyond this many buckets (derived
+        /// from ServerConfig::Master::hashTableMaxBytes).
+        uint64_t maxBuckets;
+
+        /// If non-zero, the new bucket array for a resize to this many
+        /// buckets has been allocated, but could not yet be installed.
+        uint64_t preparedNumBuckets;
+
+        /// Which old bucket should be migrated next.
+        uint64_t nextBucket;
+
+        /// True if a completed resize left memory behind that can only be
+        /// freed once #retiredEpoch is no longer in use by any RPC.
+        bool awaitingRelease;
+
+        /// LogProtector epoch in which memory was last retired.
+        uint64_t retiredEpoch;
+
+        /// True if this resizer has paused optimistic reads of its table
+        /// (see HashTable::setOptimisticReadsPaused()). Only that table's
+        /// readers take the bucket locks meanwhile; other tables on the
+        /// server are unaffected.
+        bool pausedReads;
+
+        /// LogProtector epoch in which this resizer last paused optimistic
+        /// reads. A resize may only start once every RPC from this epoch
+        /// has completed.
+        uint64_t pauseEpoch;
+
+        /// Number of times the table has been doubled or halved.
+        uint64_t totalGrows;
+        uint64_t totalShrinks;
+
+        /// Total cycles spent migrating buckets.
+        uint64_t totalMigrationTicks;
+
+        DISALLOW_COPY_AND_ASSIGN(HashTableResizer);
+    };
+
+    /**
+     * When ServerConfig::Master::hashTablePerTable is set, each tablet's
+     * objects are indexed by a HashTable of their own, so that dropping
+     * or migrating away a tablet only touches that tablet's entries, and
+     * its whole index can be freed at once afterwards. Each partition grows
+     * and shrinks and is purged of tombstones in the background
+     * independently of the others.
+     *
+     * A partition covers the key hash range of the tablet it was created
+     * for. If that tablet is later split, both halves keep sharing it.
+     */
+    struct IndexPartition {
+        IndexPartition(ObjectManager* objectManager, uint64_t tableId,
+                       uint64_t startKeyHash, uint64_t endKeyHash);
+
+        /// Identifier of the table whose objects this partition indexes.
+        uint64_t tableId;
+
+        /// The range of key hashes (inclusive) this partition indexes.
+        uint64_t startKeyHash;
+        uint64_t endKeyHash;
+
+        /// The partition's HashTable, of the engine named by
+        /// ServerConfig::Master::hashTableType.
+        std::unique_ptr<HashTable> objectMap;
+
+        /// Removes tombstones left in #objectMap by replaySegment().
+        TombstoneRemover tombstoneRemover;
+
+        /// Grows and shrinks #objectMap as the table's size changes.
+        HashTableResizer resizer;
+
+        DISALLOW_COPY_AND_ASSIGN(IndexPartition);
+    };
+
+    /**
+     * The partitions of one table at some point in time, sorted by key hash
+     * range. A set is never modified once published in an IndexTable;
+     * adding or removing a partition publishes a new set instead, so that
+     * findIndex() can use the current one without locks.
+     */
+    struct IndexPartitionSet {
+        explicit IndexPartitionSet(const vector<IndexPartition*>& partitions)
+            : partitions(partitions)
+        {}
+
+        const vector<IndexPartition*> partitions;
+
+        DISALLOW_COPY_AND_ASSIGN(IndexPartitionSet);
+    };
+
+    /**
+     * An entry in #indexTables for a table that has (or had) partitions on
+     * this server. Entries are only freed along with the ObjectManager (a
+     * table that comes back reuses its entry), so findIndex() can walk
+     * the chains without locks.
+     */
+    struct IndexTable {
+        IndexTable(uint64_t tableId, IndexTable* next)
+            : tableId(tableId)
+            , partitions(NULL)
+            , next(next)
+        {}
+
+        /// Identifier of the table.
+        const uint64_t tableId;
+
+        /// The table's current partitions; NULL if it never had any.
+        std::atomic<const IndexPartitionSet*> partitions;
+
+        /// Next entry in the same chain of #indexTables.
+        IndexTable* const next;
+
+        DISALLOW_COPY_AND_ASSIGN(IndexTable);
+    };
+
+    void compressForLog(Object& object, Buffer& storage);
+    bool decompressForRead(Object& object, Buffer& storage);
     static string dumpSegment(Segment* segment);
+    static KeyHash getKeyHash(uint64_t reference, void* cookie);
     uint32_t getObjectTimestamp(Buffer& buffer);
     uint32_t getTombstoneTimestamp(Buffer& buffer);
     uint32_t getTxDecisionRecordTimestamp(Buffer& buffer);
+    IndexTable* findIndexTable(uint64_t tableId);
+    HashTable& findIndex(uint64_t tableId, KeyHash keyHash);
+    HashTable& getOrCreateIndex(Key& key);
+    void getIndexPartitions(vector<IndexPartition*>* partitions,
+                uint64_t tableId = ~0UL);
+    void publishIndexPartitions(IndexTable* table,
+                const vector<IndexPartition*>& partitions);
+    uint64_t lockBucketIndex(KeyHash keyHash);
     bool lookup(HashTableBucketLock& lock, Key& key,
                 LogEntryType& outType, Buffer& buffer,
                 uint64_t* outVersion = NULL,
                 Log::Reference* outReference = NULL,
                 HashTable::Candidates* outCandidates = NULL);
+    bool lookupUnlocked(Key& key, LogEntryType& outType, Buffer& buffer,
+                uint64_t* outVersion = NULL,
+                Log::Reference* outReference = NULL,
+                HashTable::Candidates* outCandidates = NULL);
     friend void recoveryCleanup(uint64_t maybeTomb, void *cookie);
     bool remove(HashTableBucketLock& lock, Key& key);
     static void removeIfOrphanedObject(uint64_t reference, void *cookie);
     static void removeIfTombstone(uint64_t maybeTomb, void *cookie);
+    void releaseRetiredIndexPartitions();
     void removeTombstones();
+    void scanIndex(HashTable& index, void (*callback)(uint64_t, void*));
     Status rejectOperation(const RejectRules* rejectRules, uint64_t version)
                 __attribute__((warn_unused_result));
     void relocateObject(Buffer& oldBuffer, Log::Reference oldReference,
@@ -376,7 +649,11 @@ class ObjectManager : public LogEntryHandlers,
      * server; objects from deleted tablets are not immediately purged from the
      * hash table.
      */
-    HashTable objectMap;
+    std::unique_ptr<HashTable> objectMapOwner;
+
+    /// The object map itself; an alias for *#objectMapOwner, which holds
+    /// whichever engine config->master.hashTableType names.
+    HashTable& objectMap;
 
     /**
      * Used to identify the first write request, so that we can initialize
@@ -394,6 +671,30 @@ class ObjectManager : public LogEntryHandlers,
      */
     UnnamedSpinLock hashTableBucketLocks[1024];
 
+    /**
+     * One of these exists for each entry in #hashTableBucketLocks. It holds
+     * a sequence number that is incremented whenever the lock is acquired
+     * and again when it is released, so it is odd exactly when someone may
+     * be modifying the corresponding buckets. readObject() uses this to read
+     * without locking: if the number is even and unchanged across the read,
+     * nothing it looked at was modified. Each version has its own cache line
+     * so that writers to different stripes don't invalidate one another;
+     * the array is allocated separately with that alignment, since heap
+     * allocated ObjectManagers wouldn't honor it.
+     */
+    struct BucketVersion {
+        BucketVersion() : value(0) {}
+        std::atomic<uint64_t> value;
+        char pad[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+    };
+    BucketVersion* hashTableBucketVersions;
+
+    /**
+     * Number of times readObject() retries an optimistic read that raced
+     * with a writer before giving up and taking the bucket lock.
+     */
+    static const uint32_t MAX_OPTIMISTIC_READ_ATTEMPTS = 4;
+
     /**
      * Locks objects during transactions.
      */
@@ -416,6 +717,57 @@ class ObjectManager : public LogEntryHandlers,
      */
     int tombstoneProtectorCount;
 
+    /**
+     * If ServerConfig::Master::hashTableAutoResize is set, this object
+     * grows and shrinks #objectMap in the background.
+     */
+    HashTableResizer hashTableResizer;
+
+    /**
+     * Copy of ServerConfig::Master::hashTablePerTable. If true, objects
+     * are indexed by the partitions in #indexTables rather than #objectMap,
+     * which then stays empty.
+     */
+    const bool perTableIndex;
+
+    /**
+     * Serializes changes to #indexTables, #retiredIndexPartitions and
+     * #retiredIndexPartitionSets. Readers of #indexTables don't take it.
+     */
+    SpinLock indexPartitionLock;
+
+    /// Number of chains in #indexTables.
+    static const uint32_t INDEX_TABLE_CHAINS = 256;
+
+    /**
+     * The index partitions of each table with objects on this server,
+     * hashed by table identifier into chains of IndexTables. Only used if
+     * #perTableIndex is set.
+     */
+    std::atomic<IndexTable*> indexTables[INDEX_TABLE_CHAINS];
+
+    /**
+     * Partitions removed from #indexTables, each with the LogProtector
+     * epoch in which that happened. RPCs that started earlier may still be
+     * reading a partition without locks, so it is only freed once its
+     * epoch has drained (see releaseRetiredIndexPartitions()).
+     */
+    vector<std::pair<uint64_t, IndexPartition*>> retiredIndexPartitions;
+
+    /**
+     * Partition sets replaced in #indexTables, each with the LogProtector
+     * epoch in which that happened; freed along with the partitions in
+     * releaseRetiredIndexPartitions().
+     */
+    vector<std::pair<uint64_t, const IndexPartitionSet*>>
+            retiredIndexPartitionSets;
+
+    /**
+     * If ServerConfig::Master::mutationTraceFile is set, every object
+     * write and remove is recorded here.
+     */
+    Tub<MutationTrace> mutationTrace;
+
     friend class CleanerCompactionBenchmark;
     friend class ObjectManagerBenchmark;
 
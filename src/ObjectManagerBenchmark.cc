@@ -18,6 +18,7 @@
 #include "Logger.h"
 #include "LogCleaner.h"
 #include "Memory.h"
+#include "MemoryPolicy.h"
 #include "ObjectManager.h"
 #include "SegmentIterator.h"
 #include "Seglet.h"
@@ -42,7 +43,8 @@ class ObjectManagerBenchmark {
     ServerId serverId;
     ObjectManager* objectManager;
 
-    ObjectManagerBenchmark(string logSize, string hashTableSize)
+    ObjectManagerBenchmark(string logSize, string hashTableSize,
+                           string hashTableType, string memoryPolicy = "")
         : context()
         , clusterClock()
         , clientLeaseValidator(&context, &clusterClock)
@@ -60,6 +62,8 @@ class ObjectManagerBenchmark {
         config.localLocator = "bogus";
         config.coordinatorLocator = "bogus";
         config.setLogAndHashTableSize(logSize, hashTableSize);
+        config.master.hashTableType = hashTableType;
+        config.master.memoryPolicy = memoryPolicy;
         config.services = {};
         config.master.numReplicas = 0;
         config.master.disableLogCleaner = true;
@@ -102,6 +106,24 @@ class ObjectManagerBenchmark {
         (*stopCount)++;
     }
 
+    /**
+     * Write one object of size 'dataBytes' with the key 'keyVal'.
+     */
+    void
+    writeObject(uint64_t keyVal, uint32_t dataBytes)
+    {
+        Key key(0, &keyVal, sizeof(keyVal));
+
+        char objectData[dataBytes];
+        Buffer dataBuffer;
+        Object object(key, objectData, dataBytes, 0, 0, dataBuffer);
+        Status status = objectManager->writeObject(object, NULL, NULL);
+        if (status != STATUS_OK) {
+            fprintf(stderr, "Failed to write object! Out of memory?\n");
+            exit(1);
+        }
+    }
+
     double
     run(uint32_t numSegments, uint32_t dataBytes, uint32_t numThreads)
     {
@@ -113,22 +135,38 @@ class ObjectManagerBenchmark {
          */
         uint64_t nextKeyVal = 0;
         do {
-            Key key(0, &nextKeyVal, sizeof(nextKeyVal));
-
-            char objectData[dataBytes];
-            Buffer dataBuffer;
-            Object object(key, objectData, dataBytes, 0, 0, dataBuffer);
-            Status status = objectManager->writeObject(object, NULL, NULL);
-            if (status != STATUS_OK) {
-                fprintf(stderr, "Failed to write object! Out of memory?\n");
-                exit(1);
-            }
+            writeObject(nextKeyVal, dataBytes);
             nextKeyVal++;
-        } while (objectManager->log.head->id <= numSegments);
+        } while (objectManager->log.heads[0].segment->id <= numSegments);
 
-        /*
-         * Now "read" a bunch of random objects.
-         */
+        return measureReads(nextKeyVal, numThreads);
+    }
+
+    /**
+     * Like run(), but fill the hash table to a given fraction of its
+     * entries rather than filling a given number of segments.
+     */
+    double
+    runAtLoad(uint32_t loadPercent, uint32_t dataBytes)
+    {
+        tabletManager.addTablet(0, 0, ~0UL, TabletManager::NORMAL);
+
+        HashTable* ht = objectManager->getObjectMap();
+        uint64_t numKeys = ht->getNumBuckets() *
+                HashTable::entriesPerCacheLine() * loadPercent / 100;
+        for (uint64_t keyVal = 0; keyVal < numKeys; keyVal++)
+            writeObject(keyVal, dataBytes);
+
+        return measureReads(numKeys, 1);
+    }
+
+    /**
+     * "Read" a bunch of random objects among the first 'numKeys' keys on
+     * 'numThreads' threads at once, and return the total reads per second.
+     */
+    double
+    measureReads(uint64_t numKeys, uint32_t numThreads)
+    {
         const uint32_t numReads = 1000000;
         std::atomic<uint32_t> startFlag(0);
         std::atomic<uint32_t> stopCount(0);
@@ -137,7 +175,7 @@ class ObjectManagerBenchmark {
             threads[i] = new std::thread(readerThreadEntry,
                                          objectManager,
                                          numReads,
-                                         nextKeyVal,
+                                         numKeys,
                                          &startFlag,
                                          &stopCount);
         }
@@ -161,24 +199,92 @@ class ObjectManagerBenchmark {
                                    Cycles::toSeconds(stop - start));
     }
 
+    /**
+     * Return the number of bytes of hash table (including overflow lines)
+     * per key stored in it.
+     */
+    double
+    hashTableBytesPerKey()
+    {
+        HashTable* ht = objectManager->getObjectMap();
+        uint64_t bytes = (ht->getNumBuckets() + ht->getNumOverflowLines()) *
+                         HashTable::bytesPerCacheLine();
+        return static_cast<double>(bytes) /
+               static_cast<double>(ht->getNumEntries());
+    }
+
     DISALLOW_COPY_AND_ASSIGN(ObjectManagerBenchmark);
 };
 
 }  // namespace RAMCloud
 
 int
-main()
+main(int argc, char* argv[])
 {
     uint32_t numSegments = 600 / 8; // = 72.
     uint32_t threads[] = { 1, 2, 3, 4, 6, 8, 12, 16, 20, 24, 28, 32, 0 };
 
-    printf("============ 100-byte Objects ==============\n");
+    // The first argument, if any, names the HashTable engine to use (see
+    // HashTable::create()).
+    const char* hashTableType = (argc > 1) ? argv[1] : "chained";
+
+    // A second argument of "loadSweep" compares engines across load factors:
+    // a 1 MB hash table is filled to 50%-95% of its entries and single-
+    // threaded reads are measured at each step.
+    if (argc > 2 && strcmp(argv[2], "loadSweep") == 0) {
+        printf("============ 100-byte Objects (%s HashTable), "
+               "load sweep ==============\n", hashTableType);
+        printf("%6s %10s %10s %10s %10s\n", "load", "keys", "bytes/key",
+               "overflow", "us/read");
+        for (uint32_t percent = 50; percent <= 95; percent += 5) {
+            RAMCloud::ObjectManagerBenchmark omb("2048", "1", hashTableType);
+            double readsPerSec = omb.runAtLoad(percent, 100);
+            RAMCloud::HashTable* ht = omb.objectManager->getObjectMap();
+            printf("%5u%% %10lu %10.2f %10lu %10.3f\n", percent,
+                   ht->getNumEntries(), omb.hashTableBytesPerKey(),
+                   ht->getNumOverflowLines(), 1.0e6 / readsPerSec);
+        }
+        return 0;
+    }
+
+    // Any further arguments are memory policies (see MemoryPolicy) to
+    // compare with single-threaded reads. Each run backs the log and the
+    // hash table with that policy, so the differences between runs are
+    // mostly the cost of TLB misses.
+    if (argc > 2) {
+        printf("============ 100-byte Objects (%s HashTable), "
+               "1 thread ==============\n", hashTableType);
+        double smallPagesRate = 0;
+        for (int i = 2; i < argc; i++) {
+            RAMCloud::ObjectManagerBenchmark omb("2048", "10%",
+                                                 hashTableType, argv[i]);
+            double readsPerSec = omb.run(numSegments, 100, 1);
+            RAMCloud::MemoryPolicy policy(argv[i]);
+            if (policy.pageSize == RAMCloud::MemoryPolicy::SMALL_PAGES)
+                smallPagesRate = readsPerSec;
+            printf(" %-16s %.2f reads/s, %.3f us/read", argv[i],
+                   readsPerSec, 1.0e6 / readsPerSec);
+            if (smallPagesRate != 0)
+                printf(", %.2fx small pages", readsPerSec / smallPagesRate);
+            printf("\n");
+        }
+        return 0;
+    }
+
+    printf("============ 100-byte Objects (%s HashTable) ==============\n",
+           hashTableType);
     double oneThreadRate = 0;
     for (int i = 0; threads[i] != 0; i++) {
-        RAMCloud::ObjectManagerBenchmark omb("2048", "10%");
+        RAMCloud::ObjectManagerBenchmark omb("2048", "10%", hashTableType);
         double readsPerSec = omb.run(numSegments, 100, threads[i]);
-        if (i == 0)
+        if (i == 0) {
             oneThreadRate = readsPerSec;
+            RAMCloud::HashTable* ht = omb.objectManager->getObjectMap();
+            printf(" hash table: %lu keys, %.2f bytes/key, "
+                   "%lu overflow lines\n",
+                   ht->getNumEntries(), omb.hashTableBytesPerKey(),
+                   ht->getNumOverflowLines());
+        }
         printf(" %u thread(s): %.2f reads/s, %.3f us/read, "
             "ratio: %.2fx (%.2f%% of optimal)\n",
             threads[i],
@@ -490,6 +490,134 @@ TEST_F(ObjectManagerTest, constructor) {
     EXPECT_EQ(ServerId(5), *objectManager.replicaManager.masterId);
 }
 
+TEST_F(ObjectManagerTest, constructor_perTableIndex) {
+    ServerConfig config(ServerConfig::forTesting());
+    config.master.hashTablePerTable = true;
+    config.master.hashTableType = "hopscotch";
+    EXPECT_THROW(ObjectManager(&context, &serverId, &config, &tabletManager,
+                               &masterTableMetadata, &unackedRpcResults,
+                               &transactionManager, &txRecoveryManager),
+                 Exception);
+}
+
+static uint32_t
+countIndexPartitions(ObjectManager& om)
+{
+    vector<ObjectManager::IndexPartition*> partitions;
+    om.getIndexPartitions(&partitions);
+    return downCast<uint32_t>(partitions.size());
+}
+
+TEST_F(ObjectManagerTest, perTableIndex) {
+    ServerConfig config(ServerConfig::forTesting());
+    config.master.hashTablePerTable = true;
+    ObjectManager om(&context, &serverId, &config, &tabletManager,
+                     &masterTableMetadata, &unackedRpcResults,
+                     &transactionManager, &txRecoveryManager);
+    tabletManager.addTablet(97, 0, ~0UL, TabletManager::NORMAL);
+    tabletManager.addTablet(98, 0, ~0UL, TabletManager::NORMAL);
+
+    Key key1(97, "1", 1);
+    Key key2(98, "1", 1);
+    Buffer value;
+    Object obj1(key1, "hi", 2, 0, 0, value);
+    Object obj2(key2, "hi", 2, 0, 0, value);
+    EXPECT_EQ(STATUS_OK, om.writeObject(obj1, NULL, NULL));
+    EXPECT_EQ(STATUS_OK, om.writeObject(obj2, NULL, NULL));
+
+    EXPECT_EQ(2U, countIndexPartitions(om));
+    EXPECT_EQ(0U, om.objectMap.getNumEntries());
+    EXPECT_EQ(1U, om.getObjectMap(97, key1.getHash())->getNumEntries());
+    EXPECT_EQ(1U, om.getObjectMap(98, key2.getHash())->getNumEntries());
+    EXPECT_EQ(&om.objectMap, om.getObjectMap(99, key1.getHash()));
+    EXPECT_EQ(arrayLength(om.hashTableBucketLocks),
+              om.getObjectMap(97, key1.getHash())->getNumBuckets());
+
+    value.reset();
+    EXPECT_EQ(STATUS_OK, om.readObject(key1, &value, NULL, NULL));
+    value.reset();
+    EXPECT_EQ(STATUS_OK, om.readObject(key2, &value, NULL, NULL));
+    value.reset();
+    Key key3(97, "2", 1);
+    EXPECT_EQ(STATUS_OBJECT_DOESNT_EXIST,
+              om.readObject(key3, &value, NULL, NULL));
+
+    // Pausing optimistic reads of one partition (as its resizer does) only
+    // makes readers of that partition take the bucket lock.
+    std::atomic<uint64_t>& version1 = om.hashTableBucketVersions[
+            om.lockBucketIndex(key1.getHash()) &
+            (arrayLength(om.hashTableBucketLocks) - 1)].value;
+    std::atomic<uint64_t>& version2 = om.hashTableBucketVersions[
+            om.lockBucketIndex(key2.getHash()) &
+            (arrayLength(om.hashTableBucketLocks) - 1)].value;
+    om.getObjectMap(97, key1.getHash())->setOptimisticReadsPaused(true);
+    uint64_t before1 = version1;
+    value.reset();
+    EXPECT_EQ(STATUS_OK, om.readObject(key1, &value, NULL, NULL));
+    EXPECT_EQ(before1 + 2, version1);
+    uint64_t before2 = version2;
+    value.reset();
+    EXPECT_EQ(STATUS_OK, om.readObject(key2, &value, NULL, NULL));
+    EXPECT_EQ(before2, version2);
+    om.getObjectMap(97, key1.getHash())->setOptimisticReadsPaused(false);
+
+    EXPECT_EQ(STATUS_OK, om.removeObject(key1, NULL, NULL));
+    EXPECT_EQ(0U, om.getObjectMap(97, key1.getHash())->getNumEntries());
+
+    ProtoBuf::LogMetrics_HashTableMetrics m;
+    om.getHashTableMetrics(m);
+    EXPECT_EQ(1U, m.num_entries());
+    EXPECT_EQ(3 * arrayLength(om.hashTableBucketLocks), m.num_buckets());
+}
+
+TEST_F(ObjectManagerTest, getObjectMaps) {
+    vector<HashTable*> maps;
+    objectManager.getObjectMaps(97, 0, ~0UL, &maps);
+    EXPECT_EQ(1U, maps.size());
+    EXPECT_EQ(&objectManager.objectMap, maps[0]);
+
+    ServerConfig config(ServerConfig::forTesting());
+    config.master.hashTablePerTable = true;
+    ObjectManager om(&context, &serverId, &config, &tabletManager,
+                     &masterTableMetadata, &unackedRpcResults,
+                     &transactionManager, &txRecoveryManager);
+    maps.clear();
+    om.getObjectMaps(97, 0, ~0UL, &maps);
+    EXPECT_EQ(1U, maps.size());
+    EXPECT_EQ(&om.objectMap, maps[0]);
+
+    // Two tablets with a partition each, later merged into one tablet.
+    Key key1(97, "1", 1);
+    Key key2(97, "2", 1);
+    KeyHash split = std::min(key1.getHash(), key2.getHash());
+    Key& lowKey = key1.getHash() == split ? key1 : key2;
+    Key& highKey = key1.getHash() == split ? key2 : key1;
+    tabletManager.addTablet(97, 0, split, TabletManager::NORMAL);
+    tabletManager.addTablet(97, split + 1, ~0UL, TabletManager::NORMAL);
+    Key* keys[] = { &key1, &key2 };
+    foreach (Key* key, keys) {
+        Buffer value;
+        Object obj(*key, "hi", 2, 0, 0, value);
+        EXPECT_EQ(STATUS_OK, om.writeObject(obj, NULL, NULL));
+    }
+
+    maps.clear();
+    om.getObjectMaps(97, 0, ~0UL, &maps);
+    ASSERT_EQ(2U, maps.size());
+    EXPECT_EQ(om.getObjectMap(97, lowKey.getHash()), maps[0]);
+    EXPECT_EQ(om.getObjectMap(97, highKey.getHash()), maps[1]);
+
+    maps.clear();
+    om.getObjectMaps(97, split + 1, ~0UL, &maps);
+    ASSERT_EQ(1U, maps.size());
+    EXPECT_EQ(om.getObjectMap(97, highKey.getHash()), maps[0]);
+
+    maps.clear();
+    om.getObjectMaps(98, 0, ~0UL, &maps);
+    ASSERT_EQ(1U, maps.size());
+    EXPECT_EQ(&om.objectMap, maps[0]);
+}
+
 TEST_F(ObjectManagerTest, readHashes) {
     uint64_t tableId = 0;
     uint8_t numKeys = 2;
@@ -561,6 +689,92 @@ TEST_F(ObjectManagerTest, readHashes) {
                                   o1.getValueLength()));
 }
 
+TEST_F(ObjectManagerTest, readObject_optimistic) {
+    Key key(1, "1", 1);
+    storeObject(key, "hi", 1);
+    tabletManager.addTablet(1, 0, ~0UL, TabletManager::NORMAL);
+    uint64_t unused;
+    uint64_t bucket = HashTable::findBucketIndex(
+            objectManager.objectMap.getNumBuckets(), key.getHash(), &unused);
+    std::atomic<uint64_t>& version = objectManager.hashTableBucketVersions[
+            bucket & (arrayLength(objectManager.hashTableBucketLocks) - 1)]
+            .value;
+    uint64_t initialVersion = version;
+    EXPECT_EQ(0U, initialVersion & 1);
+
+    Buffer buffer;
+    uint64_t objectVersion;
+    EXPECT_EQ(STATUS_OK,
+        objectManager.readObject(key, &buffer, 0, &objectVersion, true));
+    EXPECT_EQ("hi", TestUtil::toString(&buffer));
+    EXPECT_EQ(1U, objectVersion);
+    EXPECT_EQ(initialVersion, version);
+
+    // A writer appears to hold the stripe: readers give up on optimism and
+    // take the lock (which isn't really held, so they succeed).
+    version = initialVersion + 1;
+    buffer.reset();
+    EXPECT_EQ(STATUS_OK,
+        objectManager.readObject(key, &buffer, 0, &objectVersion, true));
+    EXPECT_EQ("hi", TestUtil::toString(&buffer));
+    EXPECT_EQ(initialVersion + 3, version);
+    version = initialVersion;
+
+    objectManager.objectMap.setOptimisticReadsPaused(true);
+    buffer.reset();
+    EXPECT_EQ(STATUS_OK,
+        objectManager.readObject(key, &buffer, 0, &objectVersion, true));
+    EXPECT_EQ("hi", TestUtil::toString(&buffer));
+    EXPECT_EQ(initialVersion + 2, version);
+}
+
+TEST_F(ObjectManagerTest, HashTableBucketLock_version) {
+    Key key(1, "1", 1);
+    uint64_t unused;
+    uint64_t bucket = HashTable::findBucketIndex(
+            objectManager.objectMap.getNumBuckets(), key.getHash(), &unused);
+    std::atomic<uint64_t>& version = objectManager.hashTableBucketVersions[
+            bucket & (arrayLength(objectManager.hashTableBucketLocks) - 1)]
+            .value;
+    uint64_t initialVersion = version;
+    {
+        ObjectManager::HashTableBucketLock lock(objectManager, key);
+        EXPECT_EQ(initialVersion + 1, version);
+    }
+    EXPECT_EQ(initialVersion + 2, version);
+}
+
+TEST_F(ObjectManagerTest, prefetchObjects) {
+    Key key1(1, "1", 1);
+    storeObject(key1, "hi", 1);
+    tabletManager.addTablet(1, 0, ~0UL, TabletManager::NORMAL);
+
+    // Present, absent and missing keys are all just hints.
+    Tub<Key> keys[3];
+    keys[0].construct(1, "1", static_cast<KeyLength>(1));
+    keys[1].construct(1, "2", static_cast<KeyLength>(1));
+    objectManager.prefetchObjects(keys, 3);
+    objectManager.prefetchObjects(keys, 0);
+
+    // Bucket locks aren't taken, so writers don't hold up prefetching.
+    {
+        ObjectManager::HashTableBucketLock lock(objectManager, key1);
+        objectManager.prefetchObjects(keys, 3);
+    }
+    objectManager.objectMap.setOptimisticReadsPaused(true);
+    objectManager.prefetchObjects(keys, 3);
+    objectManager.objectMap.setOptimisticReadsPaused(false);
+
+    Buffer buffer;
+    EXPECT_EQ(STATUS_OK, objectManager.readObject(key1, &buffer, 0, 0));
+    Object object(1, 1, 0, buffer);
+    EXPECT_EQ("hi", string(reinterpret_cast<const char*>(object.getValue()),
+                           object.getValueLength()));
+    Key key2(1, "2", 1);
+    EXPECT_EQ(STATUS_OBJECT_DOESNT_EXIST,
+        objectManager.readObject(key2, &buffer, 0, 0));
+}
+
 TEST_F(ObjectManagerTest, readObject) {
     Buffer buffer;
     Key key(1, "1", 1);
@@ -782,6 +996,73 @@ TEST_F(ObjectManagerTest, removeOrphanedObjects) {
     EXPECT_EQ(32lu, objectManager.log.totalLiveBytes);
 }
 
+TEST_F(ObjectManagerTest, removeOrphanedObjects_perTableIndex) {
+    ServerConfig config(ServerConfig::forTesting());
+    config.master.hashTablePerTable = true;
+    ObjectManager om(&context, &serverId, &config, &tabletManager,
+                     &masterTableMetadata, &unackedRpcResults,
+                     &transactionManager, &txRecoveryManager);
+
+    // Split table 97 into two tablets with one object in each.
+    Key key1(97, "1", 1);
+    Key key2(97, "2", 1);
+    KeyHash split = std::min(key1.getHash(), key2.getHash());
+    Key& lowKey = key1.getHash() == split ? key1 : key2;
+    Key& highKey = key1.getHash() == split ? key2 : key1;
+    tabletManager.addTablet(97, 0, split, TabletManager::NORMAL);
+    tabletManager.addTablet(97, split + 1, ~0UL, TabletManager::NORMAL);
+    tabletManager.addTablet(98, 0, ~0UL, TabletManager::NORMAL);
+    Key key3(98, "1", 1);
+    Key* keys[] = { &key1, &key2, &key3 };
+    foreach (Key* key, keys) {
+        Buffer value;
+        Object obj(*key, "hi", 2, 0, 0, value);
+        EXPECT_EQ(STATUS_OK, om.writeObject(obj, NULL, NULL));
+    }
+    EXPECT_EQ(96lu, om.log.totalLiveBytes);
+    EXPECT_EQ(3U, countIndexPartitions(om));
+    HashTable* low = om.getObjectMap(97, lowKey.getHash());
+    HashTable* high = om.getObjectMap(97, highKey.getHash());
+    EXPECT_NE(low, high);
+    EXPECT_EQ(high, om.getObjectMap(97, ~0UL));
+
+    // Dropping one tablet only scans (and discards) its own partition.
+    tabletManager.deleteTablet(97, 0, split);
+    TestLog::Enable _(antiGetEntryFilter);
+    om.removeOrphanedObjects(97, 0, split);
+    EXPECT_EQ(2U, countIndexPartitions(om));
+    EXPECT_EQ(&om.objectMap, om.getObjectMap(97, lowKey.getHash()));
+    EXPECT_EQ(high, om.getObjectMap(97, highKey.getHash()));
+    EXPECT_EQ(1U, high->getNumEntries());
+    EXPECT_EQ(64lu, om.log.totalLiveBytes);
+    EXPECT_EQ(0U, om.retiredIndexPartitions.size());
+    EXPECT_EQ(0U, om.retiredIndexPartitionSets.size());
+    string log = TestLog::get();
+    EXPECT_TRUE(StringUtil::startsWith(log,
+            "removeIfOrphanedObject: removing orphaned object at ref"));
+    EXPECT_EQ(log.find("removing"), log.rfind("removing"));
+
+    // Dropping the last tablet discards the other partition too.
+    tabletManager.deleteTablet(97, split + 1, ~0UL);
+    TestLog::reset();
+    om.removeOrphanedObjects(97, split + 1, ~0UL);
+    EXPECT_EQ(1U, countIndexPartitions(om));
+    EXPECT_EQ(&om.objectMap, om.getObjectMap(97, highKey.getHash()));
+    EXPECT_EQ(32lu, om.log.totalLiveBytes);
+    EXPECT_EQ(1U, om.getObjectMap(98, key3.getHash())->getNumEntries());
+
+    // A tablet that comes back gets a fresh partition for its range.
+    tabletManager.addTablet(97, 0, split, TabletManager::NORMAL);
+    Buffer buffer;
+    Object obj(lowKey, "hi", 2, 0, 0, buffer);
+    EXPECT_EQ(STATUS_OK, om.writeObject(obj, NULL, NULL));
+    EXPECT_EQ(2U, countIndexPartitions(om));
+    EXPECT_EQ(&om.objectMap, om.getObjectMap(97, split + 1));
+
+    Buffer value;
+    EXPECT_EQ(STATUS_OK, om.readObject(key3, &value, NULL, NULL));
+}
+
 TEST_F(ObjectManagerTest, replaySegment_nextNodeIdMap) {
     ObjectManager::TombstoneProtector p(&objectManager);
     uint32_t segLen = 8192;
@@ -826,7 +1107,7 @@ TEST_F(ObjectManagerTest, replaySegment_tombstoneSynthesis) {
     it.construct(&seg[0], len, certificate);
     objectManager.replaySegment(&sl, *it);
     verifyRecoveryObject(key0, "new");
-    it.construct(*sl.head);
+    it.construct(*sl.heads[0].segment);
     while (it->getType() != LOG_ENTRY_TYPE_OBJ)
         it->next();
     it->next();
@@ -841,6 +1122,50 @@ TEST_F(ObjectManagerTest, replaySegment_tombstoneSynthesis) {
 
 }
 
+TEST_F(ObjectManagerTest, replaySegment_compressedValue) {
+    ObjectManager::TombstoneProtector p(&objectManager);
+    SideLog sl(&objectManager.log);
+    Key key0(0, "key0", 4);
+    string value(100, 'v');
+
+    // Compressed objects are replayed verbatim, and their versions compare
+    // without the compression flag getting in the way.
+    Segment s;
+    Buffer dataBuffer;
+    Object compressed(key0, value.data(), 100, 2, 0, dataBuffer);
+    EXPECT_TRUE(compressed.compressValue(dataBuffer));
+    Buffer objectBuffer;
+    compressed.assembleForLog(objectBuffer);
+    EXPECT_TRUE(s.append(LOG_ENTRY_TYPE_OBJ, objectBuffer));
+    s.close();
+    SegmentCertificate certificate;
+    s.getAppendedLength(&certificate);
+    Buffer segBuffer;
+    s.appendToBuffer(segBuffer);
+    SegmentIterator it(segBuffer.getRange(0, segBuffer.size()),
+                       segBuffer.size(), certificate);
+    objectManager.replaySegment(&sl, it);
+
+    // An older, uncompressed version is discarded.
+    char seg[8192];
+    uint32_t len = buildRecoverySegment(seg, sizeof32(seg), key0, 1, "old",
+                                        &certificate);
+    SegmentIterator it2(&seg[0], len, certificate);
+    objectManager.replaySegment(&sl, it2);
+
+    Buffer buffer;
+    LogEntryType type;
+    ObjectManager::HashTableBucketLock lock(objectManager, key0);
+    ASSERT_TRUE(objectManager.lookup(lock, key0, type, buffer));
+    Object object(buffer);
+    EXPECT_TRUE(object.isValueCompressed());
+    EXPECT_EQ(2U, object.getVersion());
+    Buffer out;
+    EXPECT_TRUE(object.decompressValue(out));
+    object.appendValueToBuffer(&out);
+    EXPECT_EQ(value, TestUtil::toString(&out));
+}
+
 TEST_F(ObjectManagerTest, replaySegment_tombstoneSegmentId) {
     ObjectManager::TombstoneProtector p(&objectManager);
     uint32_t segLen = 8192;
@@ -863,7 +1188,7 @@ TEST_F(ObjectManagerTest, replaySegment_tombstoneSegmentId) {
     it.construct(&seg[0], len, certificate);
     objectManager.replaySegment(&sl, *it);
 
-    it.construct(*sl.head);
+    it.construct(*sl.heads[0].segment);
     while (it->getType() != LOG_ENTRY_TYPE_OBJTOMB)
         it->next();
     dataBuffer.reset();
@@ -1317,6 +1642,41 @@ TEST_F(ObjectManagerTest, replaySegment_rpcResult) {
     EXPECT_EQ(1U, unackedRpcResults->clients.size());
 }
 
+TEST_F(ObjectManagerTest, replaySegment_shards) {
+    ObjectManager::TombstoneProtector p(&objectManager);
+    uint32_t segLen = 8192;
+    char seg[segLen];
+    uint32_t len; // number of bytes in a recovery segment
+    SideLog sl(&objectManager.log);
+    Tub<SegmentIterator> it;
+
+    // Objects are replayed only by the shard their key hash falls in.
+    Key key0(0, "key0", 4);
+    uint32_t shard = downCast<uint32_t>(key0.getHash() % 3);
+    SegmentCertificate certificate;
+    len = buildRecoverySegment(seg, segLen, key0, 1, "sharded", &certificate);
+    it.construct(&seg[0], len, certificate);
+    objectManager.replaySegment(&sl, *it, NULL, (shard + 1) % 3, 3);
+    Buffer value;
+    EXPECT_EQ(STATUS_OBJECT_DOESNT_EXIST,
+              objectManager.readObject(key0, &value, NULL, NULL));
+    it.construct(&seg[0], len, certificate);
+    objectManager.replaySegment(&sl, *it, NULL, shard, 3);
+    verifyRecoveryObject(key0, "sharded");
+
+    // Entries that aren't keyed are left to shard 0.
+    UnackedRpcResults *unackedRpcResults = objectManager.unackedRpcResults;
+    Buffer buf;
+    RpcResult rpcResult(0, 1, 8, 10, 5, buf);
+    len = buildRecoverySegment(seg, segLen, rpcResult, &certificate);
+    it.construct(&seg[0], len, certificate);
+    objectManager.replaySegment(&sl, *it, NULL, 1, 3);
+    EXPECT_EQ(0U, unackedRpcResults->clients.size());
+    it.construct(&seg[0], len, certificate);
+    objectManager.replaySegment(&sl, *it, NULL, 0, 3);
+    EXPECT_EQ(1U, unackedRpcResults->clients.size());
+}
+
 TEST_F(ObjectManagerTest, replaySegment_preparedOp_basics) {
     ObjectManager::TombstoneProtector p(&objectManager);
     uint32_t segLen = 8192;
@@ -1634,11 +1994,150 @@ TEST_F(ObjectManagerTest, writeObject) {
     // Verify RetryException  when overwriting with no space
     uint64_t original = objectManager.getLog()->totalLiveBytes;
     objectManager.getLog()->totalLiveBytes =
-            objectManager.getLog()->maxLiveBytes;
+            objectManager.getLog()->maxLiveBytes.load();
     EXPECT_THROW(objectManager.writeObject(obj, 0, 0), RetryException);
     objectManager.getLog()->totalLiveBytes = original;
 }
 
+TEST_F(ObjectManagerTest, writeObject_mutationTrace) {
+    char fileName[] = "/tmp/ramcloud-trace-test-delete-this-XXXXXX";
+    close(mkstemp(fileName));
+    objectManager.mutationTrace.construct(fileName);
+
+    tabletManager.addTablet(1, 0, ~0UL, TabletManager::NORMAL);
+    Key key(1, "1", 1);
+    Buffer buffer;
+    Object obj(key, "value", 5, 0, 0, buffer);
+    EXPECT_EQ(STATUS_OK, objectManager.writeObject(obj, 0, 0));
+    EXPECT_EQ(STATUS_OK, objectManager.writeObject(obj, 0, 0));
+    EXPECT_EQ(STATUS_OK, objectManager.removeObject(key, 0, 0));
+    objectManager.mutationTrace.destroy();
+
+    MutationTrace::Reader reader(fileName);
+    MutationTrace::Record record;
+    uint8_t types[3];
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(reader.next(&record));
+        EXPECT_EQ(1U, record.tableId);
+        EXPECT_EQ(key.getHash(), record.keyHash);
+        EXPECT_EQ(1U, record.keyLength);
+        EXPECT_EQ(5U, record.valueLength);
+        types[i] = record.type;
+    }
+    EXPECT_EQ(MutationTrace::WRITE, types[0]);
+    EXPECT_EQ(MutationTrace::OVERWRITE, types[1]);
+    EXPECT_EQ(MutationTrace::REMOVE, types[2]);
+    EXPECT_FALSE(reader.next(&record));
+    unlink(fileName);
+}
+
+static void
+writeAt(ObjectManager& om, Key& key, uint32_t time)
+{
+    WallTime::mockWallTimeValue = time;
+    Buffer buffer;
+    Object obj(key, "value", 5, 0, 0, buffer);
+    EXPECT_EQ(STATUS_OK, om.writeObject(obj, 0, 0));
+}
+
+TEST_F(ObjectManagerTest, writeObject_hotCold) {
+    ServerConfig config(ServerConfig::forTesting());
+    config.master.hotObjectSeconds = 10;
+    ObjectManager om(&context, &serverId, &config, &tabletManager,
+                     &masterTableMetadata, &unackedRpcResults,
+                     &transactionManager, &txRecoveryManager);
+    tabletManager.addTablet(1, 0, ~0UL, TabletManager::NORMAL);
+    Key key(1, "1", 1);
+    std::atomic<uint64_t>& coldBytes =
+            om.log.AbstractLog::metrics.totalColdBytesAppended;
+
+    // New objects and ones overwritten long after their last write are
+    // cold; those overwritten soon after are hot.
+    uint64_t before = coldBytes;
+    writeAt(om, key, 1000);
+    EXPECT_LT(before, coldBytes);
+    before = coldBytes;
+    writeAt(om, key, 1005);
+    EXPECT_EQ(before, coldBytes);
+    writeAt(om, key, 2000);
+    EXPECT_LT(before, coldBytes);
+
+    // If the clock steps backwards, the difference mustn't wrap around.
+    before = coldBytes;
+    writeAt(om, key, 500);
+    EXPECT_EQ(before, coldBytes);
+    WallTime::mockWallTimeValue = 0;
+}
+
+TEST_F(ObjectManagerTest, writeObject_compressed) {
+    // The counters are per thread, so other tests may have bumped them. This
+    // thread's are only counted once registered, like a worker's.
+    PerfStats::registerStats(&PerfStats::threadStats);
+    ProtoBuf::ServerStatistics_CompressionStats before;
+    objectManager.getCompressionStatistics(&before);
+    tabletManager.addTablet(1, 0, ~0UL, TabletManager::NORMAL);
+    objectManager.setTableCompression(1, true);
+    string value;
+    for (int i = 0; i < 20; i++)
+        value += "{\"name\":\"value\"},";
+    Key key(1, "1", 1);
+    Buffer buffer;
+    Object obj(key, value.data(), downCast<uint32_t>(value.size()), 0, 0,
+               buffer);
+    EXPECT_EQ(STATUS_OK, objectManager.writeObject(obj, 0, 0));
+
+    // The bucket lock must be released before readObject() below.
+    uint32_t compressedLength;
+    {
+        Buffer logBuffer;
+        LogEntryType type;
+        ObjectManager::HashTableBucketLock lock(objectManager, key);
+        EXPECT_TRUE(objectManager.lookup(lock, key, type, logBuffer));
+        Object logged(logBuffer);
+        EXPECT_TRUE(logged.isValueCompressed());
+        compressedLength = logged.getValueLength();
+        EXPECT_LT(compressedLength, value.size() / 2);
+    }
+
+    // Reads see the original value and version.
+    Buffer out;
+    uint64_t version;
+    EXPECT_EQ(STATUS_OK, objectManager.readObject(key, &out, 0, &version,
+                                                  true));
+    EXPECT_EQ(value, string(static_cast<const char*>(
+            out.getRange(0, out.size())), out.size()));
+    EXPECT_EQ(1U, version);
+
+    // Short values are stored as is.
+    Key key2(1, "2", 1);
+    Object obj2(key2, "hi", 2, 0, 0, buffer);
+    EXPECT_EQ(STATUS_OK, objectManager.writeObject(obj2, 0, 0));
+
+    ProtoBuf::ServerStatistics_CompressionStats stats;
+    objectManager.getCompressionStatistics(&stats);
+    EXPECT_EQ(1U, stats.compressed_objects() - before.compressed_objects());
+    EXPECT_EQ(value.size(), stats.uncompressed_value_bytes() -
+              before.uncompressed_value_bytes());
+    EXPECT_EQ(compressedLength, stats.compressed_value_bytes() -
+              before.compressed_value_bytes());
+    EXPECT_EQ(1U, stats.incompressible_objects() -
+              before.incompressible_objects());
+    EXPECT_EQ(1U, stats.decompressed_objects() -
+              before.decompressed_objects());
+    EXPECT_GT(stats.compression_ratio(), 2.0);
+
+    // Tables without compression are left alone.
+    tabletManager.addTablet(2, 0, ~0UL, TabletManager::NORMAL);
+    Key key3(2, "1", 1);
+    Object obj3(key3, value.data(), downCast<uint32_t>(value.size()), 0, 0,
+                buffer);
+    EXPECT_EQ(STATUS_OK, objectManager.writeObject(obj3, 0, 0));
+    objectManager.getCompressionStatistics(&stats);
+    EXPECT_EQ(1U, stats.compressed_objects() - before.compressed_objects());
+    EXPECT_EQ(1U, stats.incompressible_objects() -
+              before.incompressible_objects());
+}
+
 TEST_F(ObjectManagerTest, writeObject_returnRemovedObj) {
     tabletManager.addTablet(1, 0, ~0UL, TabletManager::NORMAL);
     Key key(1, "a", 1);
@@ -1741,7 +2240,7 @@ TEST_F(ObjectManagerTest, prepareOp) {
     // Abort cannot be written and retryException is fired.
     uint64_t original = objectManager.getLog()->totalLiveBytes;
     objectManager.getLog()->totalLiveBytes =
-            objectManager.getLog()->maxLiveBytes;
+            objectManager.getLog()->maxLiveBytes.load();
     EXPECT_THROW(objectManager.prepareOp(op, 0, 0, &isCommit,
                                          &rpcResult, &rpcResultPtr),
                  RetryException);
@@ -2054,7 +2553,7 @@ TEST_F(ObjectManagerTest, flushEntriesToLog) {
     // Verify that the flush is rejected when the log's remaining size is small
     uint64_t original = objectManager.getLog()->totalLiveBytes;
     objectManager.getLog()->totalLiveBytes =
-            objectManager.getLog()->maxLiveBytes;
+            objectManager.getLog()->maxLiveBytes.load();
     EXPECT_FALSE(objectManager.flushEntriesToLog(&logBuffer, numEntries));
     objectManager.getLog()->totalLiveBytes = original;
 
@@ -2173,6 +2672,10 @@ TEST_F(ObjectManagerTest, TombstoneRemover_handleTimerEvent_doWork) {
     Buffer buffer;
     TestLog::Enable logEnabler("handleTimerEvent");
 
+    // handleTimerEvent() reschedules itself; keep the timer thread from
+    // running it concurrently with the calls below.
+    WorkerTimer::disableTimerHandlers = true;
+
     // Create two tombstones; both had better get removed.
     Key key1(0, "key1", 4);
     storeTombstone(key1);
@@ -2206,6 +2709,95 @@ TEST_F(ObjectManagerTest, TombstoneRemover_handleTimerEvent_doWork) {
         ObjectManager::HashTableBucketLock lock(objectManager, key2);
         EXPECT_FALSE(objectManager.lookup(lock, key2, type, buffer, 0, 0));
     }
+    WorkerTimer::disableTimerHandlers = false;
+}
+
+TEST_F(ObjectManagerTest, HashTableResizer_handleTimerEvent_shrink) {
+    ObjectManager::HashTableResizer& resizer = objectManager.hashTableResizer;
+    TestLog::Enable logEnabler("handleTimerEvent", "startResize", NULL);
+    for (int i = 0; i < 20; i++) {
+        Key key(0, format("%d", i).c_str(),
+                downCast<uint16_t>(format("%d", i).size()));
+        Buffer value;
+        Object obj(key, "hi", 2, 0, 0, value);
+        EXPECT_EQ(STATUS_OK, objectManager.writeObject(obj, NULL, NULL));
+    }
+
+    // Nothing to do: the table is already at its minimum size.
+    resizer.handleTimerEvent();
+    EXPECT_FALSE(objectManager.objectMap.isResizing());
+    EXPECT_TRUE(resizer.isRunning());
+    EXPECT_EQ("", TestLog::get());
+
+    uint64_t numBuckets = objectManager.objectMap.getNumBuckets();
+    resizer.minBuckets = numBuckets / 2;
+    EXPECT_FALSE(objectManager.objectMap.areOptimisticReadsPaused());
+    resizer.handleTimerEvent();
+    EXPECT_TRUE(objectManager.objectMap.isResizing());
+    EXPECT_TRUE(objectManager.objectMap.areOptimisticReadsPaused());
+    EXPECT_EQ(numBuckets / 2, objectManager.objectMap.getNumBuckets());
+    EXPECT_EQ(1U, resizer.totalShrinks);
+    EXPECT_EQ(format("startResize: Resizing HashTable from %lu to %lu "
+            "buckets", numBuckets, numBuckets / 2), TestLog::get());
+
+    TestLog::reset();
+    while (objectManager.objectMap.isResizing()) {
+        resizer.handleTimerEvent();
+        for (int i = 0; i < 20; i++) {
+            Key key(0, format("%d", i).c_str(),
+                    downCast<uint16_t>(format("%d", i).size()));
+            Buffer value;
+            EXPECT_EQ(STATUS_OK,
+                      objectManager.readObject(key, &value, NULL, NULL));
+        }
+    }
+    EXPECT_EQ(format("handleTimerEvent: HashTable resize to %lu buckets "
+            "complete", numBuckets / 2), TestLog::get());
+    EXPECT_FALSE(objectManager.objectMap.areOptimisticReadsPaused());
+    // The old buckets are freed once no older epoch is outstanding; a
+    // timer left running by another test may briefly hold one.
+    for (int i = 0; i < 1000 && resizer.awaitingRelease; i++) {
+        usleep(1000);
+        resizer.handleTimerEvent();
+    }
+    EXPECT_FALSE(resizer.awaitingRelease);
+    EXPECT_FALSE(objectManager.objectMap.releaseRetiredMemory());
+
+    ProtoBuf::LogMetrics_HashTableMetrics m;
+    objectManager.getHashTableMetrics(m);
+    EXPECT_EQ(numBuckets / 2, m.num_buckets());
+    EXPECT_EQ(20U, m.num_entries());
+    EXPECT_FALSE(m.resize_in_progress());
+    EXPECT_EQ(1U, m.total_shrinks());
+}
+
+TEST_F(ObjectManagerTest, HashTableResizer_chooseNewNumBuckets) {
+    ObjectManager::HashTableResizer& resizer = objectManager.hashTableResizer;
+    HashTable& objectMap = objectManager.objectMap;
+    uint64_t numBuckets = objectMap.getNumBuckets();
+    EXPECT_EQ(0U, resizer.chooseNewNumBuckets());
+
+    resizer.minBuckets = numBuckets / 2;
+    EXPECT_EQ(numBuckets / 2, resizer.chooseNewNumBuckets());
+
+    objectMap.numEntries = numBuckets * HashTable::entriesPerCacheLine();
+    EXPECT_EQ(numBuckets * 2, resizer.chooseNewNumBuckets());
+    resizer.maxBuckets = numBuckets;
+    EXPECT_EQ(0U, resizer.chooseNewNumBuckets());
+    objectMap.numEntries = 0;
+}
+
+TEST_F(ObjectManagerTest, getKeyHash) {
+    Key key(0, "key0", 4);
+    Buffer value;
+    Object obj(key, "item0", 5, 0, 0, value);
+    EXPECT_EQ(STATUS_OK, objectManager.writeObject(obj, NULL, NULL));
+
+    HashTable::Candidates candidates;
+    objectManager.objectMap.lookup(key.getHash(), candidates);
+    ASSERT_FALSE(candidates.isDone());
+    EXPECT_EQ(key.getHash(), ObjectManager::getKeyHash(
+            candidates.getReference(), &objectManager));
 }
 
 TEST_F(ObjectManagerTest, TombstoneProtector) {
@@ -2582,11 +3174,12 @@ TEST_F(ObjectManagerTest, keyPointsAtReference) {
     obj.assembleForLog(objBuffer);
     sl.append(LOG_ENTRY_TYPE_OBJ, objBuffer);
 
-    it.construct(*sl.head);
+    it.construct(*sl.heads[0].segment);
     while (it->getType() != LOG_ENTRY_TYPE_OBJ)
         it->next();
 
-    Log::Reference reference = sl.head->getReference(it->getOffset());
+    Log::Reference reference =
+        sl.heads[0].segment->getReference(it->getOffset());
     EXPECT_FALSE(objectManager.keyPointsAtReference(
                 key, reference));
 
@@ -835,6 +835,85 @@ TEST_F(ObjectTest, checkIntegrity) {
     }
 }
 
+TEST_F(ObjectTest, compressValue) {
+    string value(200, 'z');
+    Key key(57, "key", 3);
+    Buffer keysAndValue;
+    Object::appendKeysAndValueToBuffer(key, value.data(), 200,
+                                       &keysAndValue);
+    Object object(57, 75, 723, keysAndValue);
+
+    Buffer storage;
+    EXPECT_TRUE(object.compressValue(storage));
+    EXPECT_TRUE(object.isValueCompressed());
+    EXPECT_EQ(75U, object.getVersion());
+    EXPECT_LT(object.getValueLength(), 200U);
+    EXPECT_EQ("key", string(static_cast<const char*>(object.getKey()),
+                            object.getKeyLength()));
+    EXPECT_FALSE(object.compressValue(storage));
+
+    // The flag survives a version change and the trip through the log.
+    object.setVersion(76);
+    EXPECT_EQ(76U, object.getVersion());
+    Buffer log;
+    object.assembleForLog(log);
+    Object logged(log);
+    EXPECT_TRUE(logged.checkIntegrity());
+    EXPECT_TRUE(logged.isValueCompressed());
+    EXPECT_EQ(76U, logged.getVersion());
+
+    Buffer out;
+    EXPECT_TRUE(logged.decompressValue(out));
+    EXPECT_FALSE(logged.isValueCompressed());
+    EXPECT_EQ(76U, logged.getVersion());
+    logged.appendValueToBuffer(&out);
+    EXPECT_EQ(value, TestUtil::toString(&out));
+    EXPECT_TRUE(logged.decompressValue(out));
+}
+
+TEST_F(ObjectTest, compressValue_notWorthwhile) {
+    Buffer storage;
+    for (uint32_t i = 0; i < arrayLength(objects); i++) {
+        // Value is too short.
+        EXPECT_FALSE(objects[i]->compressValue(storage));
+        EXPECT_FALSE(objects[i]->isValueCompressed());
+    }
+
+    // Value doesn't shrink.
+    char value[200];
+    for (uint32_t i = 0; i < sizeof(value); i++)
+        value[i] = static_cast<char>(generateRandom());
+    Key key(57, "key", 3);
+    Object object(key, value, sizeof32(value), 75, 723, storage);
+    EXPECT_FALSE(object.compressValue(storage));
+    EXPECT_FALSE(object.isValueCompressed());
+    EXPECT_EQ(200U, object.getValueLength());
+}
+
+TEST_F(ObjectTest, decompressValue_malformed) {
+    string value(200, 'z');
+    Key key(57, "key", 3);
+    Buffer storage;
+    Object object(key, value.data(), 200, 75, 723, storage);
+    EXPECT_TRUE(object.compressValue(storage));
+
+    // Claim the value was longer than it was.
+    uint32_t valueOffset;
+    object.getValueOffset(&valueOffset);
+    uint32_t* length = reinterpret_cast<uint32_t*>(const_cast<char*>(
+            static_cast<const char*>(object.keysAndValue) + valueOffset));
+    *length = 201;
+    EXPECT_FALSE(object.decompressValue(storage));
+    EXPECT_TRUE(object.isValueCompressed());
+
+    // Lengths no object could have are rejected before allocating anything.
+    *length = MAX_OBJECT_SIZE;
+    EXPECT_FALSE(object.decompressValue(storage));
+    *length = ~0U;
+    EXPECT_FALSE(object.decompressValue(storage));
+    EXPECT_TRUE(object.isValueCompressed());
+}
+
 /**
  * Unit tests for ObjectTombstone.
  */
@@ -42,6 +42,7 @@
 
 #include "Common.h"
 #include "Atomic.h"
+#include "Crc32C.h"
 #include "Cycles.h"
 #include "CycleCounter.h"
 #include "Dispatch.h"
@@ -578,6 +579,46 @@ double cppAtomicLoad()
     return Cycles::toSeconds(stop - start)/count;
 }
 
+// Measure the cost of a Crc32C checksum over a buffer of the given size.
+template<int bytes>
+double crc32c()
+{
+    int count = 100000000 / bytes;
+    static char buffer[bytes];
+    memset(buffer, 'x', bytes);
+    uint32_t total = 0;
+    uint64_t start = Cycles::rdtsc();
+    for (int i = 0; i < count; i++) {
+        total += Crc32C().update(buffer, bytes).getResult();
+    }
+    uint64_t stop = Cycles::rdtsc();
+    discard(&total);
+    return Cycles::toSeconds(stop - start)/count;
+}
+
+// Measure the cost of Crc32C checksums over 100 separate 100-byte objects
+// with Crc32C::batch.
+double crc32cBatch()
+{
+    int count = 100000;
+    static char buffer[100 * 100];
+    memset(buffer, 'x', sizeof(buffer));
+    const void* buffers[100];
+    uint32_t lengths[100];
+    Crc32C::ResultType results[100];
+    for (int i = 0; i < 100; i++) {
+        buffers[i] = &buffer[100 * i];
+        lengths[i] = 100;
+    }
+    uint64_t start = Cycles::rdtsc();
+    for (int i = 0; i < count; i++) {
+        Crc32C::batch(100, buffers, lengths, results);
+    }
+    uint64_t stop = Cycles::rdtsc();
+    discard(results);
+    return Cycles::toSeconds(stop - start)/count;
+}
+
 // Measure the minimum cost of Dispatch::poll, when there are no
 // Pollers and no Timers.
 double dispatchPoll()
@@ -1587,6 +1628,14 @@ TestInfo tests[] = {
      "Exchange method on a C++ atomic_int"},
     {"cppAtomicLoad", cppAtomicLoad,
      "Read a C++ atomic_int"},
+    {"crc32c100", crc32c<100>,
+     "Crc32C checksum of 100 bytes"},
+    {"crc32c4K", crc32c<4096>,
+     "Crc32C checksum of 4 KB"},
+    {"crc32c1M", crc32c<1024*1024>,
+     "Crc32C checksum of 1 MB"},
+    {"crc32cBatch", crc32cBatch,
+     "Crc32C::batch over 100 100-byte objects"},
     {"cyclesToSeconds", perfCyclesToSeconds,
      "Convert a rdtsc result to (double) seconds"},
     {"cyclesToNanos", perfCyclesToNanoseconds,
@@ -58,6 +58,29 @@ PerfStats::registerStats(PerfStats* stats)
     registeredStats.push_back(stats);
 }
 
+/**
+ * Forget a PerfStats structure passed to registerStats, so that collectStats
+ * no longer reads it. A thread must call this on its thread-local structure
+ * before it exits, since that structure is freed along with the thread.
+ * The structure's counts no longer contribute to collectStats totals.
+ *
+ * \param stats
+ *      PerfStats structure to forget. Nothing happens if it isn't
+ *      registered.
+ */
+void
+PerfStats::unregisterStats(PerfStats* stats)
+{
+    std::lock_guard<SpinLock> lock(mutex);
+    for (auto it = registeredStats.begin(); it != registeredStats.end();
+            it++) {
+        if (*it == stats) {
+            registeredStats.erase(it);
+            return;
+        }
+    }
+}
+
 /**
  * This method aggregates performance information from all of the
  * PerfStats structures that have been registered via the registerStats
@@ -106,6 +129,11 @@ PerfStats::collectStats(PerfStats* total)
         total->cleanerInputDiskBytes += stats->cleanerInputDiskBytes;
         total->cleanerSurvivorBytes += stats->cleanerSurvivorBytes;
         total->cleanerActiveCycles += stats->cleanerActiveCycles;
+        total->compressedObjects += stats->compressedObjects;
+        total->uncompressedValueBytes += stats->uncompressedValueBytes;
+        total->compressedValueBytes += stats->compressedValueBytes;
+        total->incompressibleObjects += stats->incompressibleObjects;
+        total->decompressedObjects += stats->decompressedObjects;
         total->backupReadOps += stats->backupReadOps;
         total->backupReadBytes += stats->backupReadBytes;
         total->backupReadActiveCycles += stats->backupReadActiveCycles;
@@ -380,6 +408,11 @@ PerfStats::clusterDiff(Buffer* before, Buffer* after,
         ADD_METRIC(cleanerInputDiskBytes);
         ADD_METRIC(cleanerSurvivorBytes);
         ADD_METRIC(cleanerActiveCycles);
+        ADD_METRIC(compressedObjects);
+        ADD_METRIC(uncompressedValueBytes);
+        ADD_METRIC(compressedValueBytes);
+        ADD_METRIC(incompressibleObjects);
+        ADD_METRIC(decompressedObjects);
         ADD_METRIC(backupReadOps);
         ADD_METRIC(backupReadBytes);
         ADD_METRIC(backupReadActiveCycles);
@@ -176,6 +176,27 @@ struct PerfStats {
     /// cleaner.
     uint64_t cleanerActiveCycles;
 
+    //--------------------------------------------------------------------
+    // Statistics for value compression follow below (see
+    // ObjectManager::setTableCompression).
+    //--------------------------------------------------------------------
+    /// Total number of object values compressed before being appended to
+    /// the log.
+    uint64_t compressedObjects;
+
+    /// Total bytes in those values before compression.
+    uint64_t uncompressedValueBytes;
+
+    /// Total bytes in those values after compression.
+    uint64_t compressedValueBytes;
+
+    /// Total number of object values in compressed tables that were stored
+    /// as is, because compressing them wouldn't have saved space.
+    uint64_t incompressibleObjects;
+
+    /// Total number of compressed values decompressed for readers.
+    uint64_t decompressedObjects;
+
     //--------------------------------------------------------------------
     // Statistics for backup I/O follow below.
     //--------------------------------------------------------------------
@@ -293,6 +314,7 @@ struct PerfStats {
     static void collectStats(PerfStats* total);
     static string printClusterStats(Buffer* first, Buffer* second);
     static void registerStats(PerfStats* stats);
+    static void unregisterStats(PerfStats* stats);
 
     /// The following thread-local variable is used to access the statistics
     /// for the current thread.
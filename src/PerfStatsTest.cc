@@ -147,6 +147,19 @@ TEST_F(PerfStatsTest, registerStats_initialize) {
     EXPECT_EQ(45, PerfStats::nextThreadId);
 }
 
+TEST_F(PerfStatsTest, unregisterStats) {
+    PerfStats::registerStats(&stats);
+    PerfStats stats2;
+    PerfStats::registerStats(&stats2);
+    PerfStats::unregisterStats(&stats);
+    ASSERT_EQ(1u, PerfStats::registeredStats.size());
+    EXPECT_EQ(&stats2, PerfStats::registeredStats[0]);
+
+    // Not registered: nothing happens.
+    PerfStats::unregisterStats(&stats);
+    EXPECT_EQ(1u, PerfStats::registeredStats.size());
+}
+
 TEST_F(PerfStatsTest, collectStats) {
     PerfStats::registerStats(&stats);
     stats.readCount = 10;
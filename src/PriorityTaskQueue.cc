@@ -201,6 +201,7 @@ PriorityTaskQueue::main()
 try {
     PerfStats::registerStats(&PerfStats::threadStats);
     performTasksUntilHalt();
+    PerfStats::unregisterStats(&PerfStats::threadStats);
 } catch (const std::exception& e) {
     LOG(ERROR, "Fatal error in PriorityTaskQueue: %s", e.what());
     throw;
@@ -19,6 +19,7 @@
 #include "MasterService.h"
 #include "Memory.h"
 #include "SegmentIterator.h"
+#include "SegmentReplayer.h"
 #include "Seglet.h"
 #include "Tablets.pb.h"
 
@@ -57,7 +58,7 @@ class RecoverSegmentBenchmark {
     }
 
     void
-    run(int numSegments, int dataLen)
+    run(int numSegments, int dataLen, uint32_t numThreads)
     {
         /*
          * Allocate numSegments Segments and fill them up with objects of
@@ -114,7 +115,8 @@ class RecoverSegmentBenchmark {
         /*
          * Now run a fake recovery.
          */
-        SideLog sideLog(service->objectManager.getLog());
+        ObjectManager::TombstoneProtector _(&service->objectManager);
+        SegmentReplayer replayer(&service->objectManager, numThreads);
         uint64_t before = Cycles::rdtsc();
         for (int i = 0; i < numSegments; i++) {
             Segment* s = segments[i];
@@ -124,16 +126,17 @@ class RecoverSegmentBenchmark {
             s->getAppendedLength(&certificate);
             const void* contigSeg = buffer.getRange(0, buffer.size());
             SegmentIterator it(contigSeg, buffer.size(), certificate);
-            service->objectManager.replaySegment(&sideLog, it);
+            replayer.replay(it);
         }
         uint64_t ticks = Cycles::rdtsc() - before;
 
         uint64_t totalObjectBytes = numObjects * dataLen;
         uint64_t totalSegmentBytes = numSegments *
                                      Segment::DEFAULT_SEGMENT_SIZE;
-        printf("Recovery of %d %dKB Segments with %d byte Objects took %lu "
-            "ms\n", numSegments, Segment::DEFAULT_SEGMENT_SIZE / 1024,
-            dataLen, RAMCloud::Cycles::toNanoseconds(ticks) / 1000 / 1000);
+        printf("Recovery of %d %dKB Segments with %d byte Objects on %u "
+            "threads took %lu ms\n", numSegments,
+            Segment::DEFAULT_SEGMENT_SIZE / 1024, dataLen, numThreads,
+            RAMCloud::Cycles::toNanoseconds(ticks) / 1000 / 1000);
         printf("Actual total object count: %lu (%lu bytes in Objects, %.2f%% "
             "overhead)\n", numObjects, totalObjectBytes,
             100.0 *
@@ -200,16 +203,25 @@ if (metrics->temp.count##i.load()) { \
 
 }  // namespace RAMCloud
 
+/**
+ * Usage: RecoverSegmentBenchmark [numThreads]
+ *
+ * numThreads is the number of threads each segment is replayed with (see
+ * SegmentReplayer); it defaults to 1.
+ */
 int
-main()
+main(int argc, char* argv[])
 {
+    uint32_t numThreads = 1;
+    if (argc > 1)
+        numThreads = RAMCloud::downCast<uint32_t>(atoi(argv[1]));
     int numSegments = 600 / 8; // = 72.
     int dataLen[] = { 64, 128, 256, 512, 1024, 2048, 8192, 0 };
 
     for (int i = 0; dataLen[i] != 0; i++) {
         printf("==========================\n");
         RAMCloud::RecoverSegmentBenchmark rsb("2048", "10%", numSegments);
-        rsb.run(numSegments, dataLen[i]);
+        rsb.run(numSegments, dataLen[i], numThreads);
     }
 
     return 0;
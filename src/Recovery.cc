@@ -13,6 +13,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
 #include <cmath>
@@ -58,6 +59,12 @@ namespace RAMCloud {
  *      an equal segmentId with a lesser epoch is not eligible to be used
  *      for recovery (both for log digest and object data purposes).
  *      Stored in and provided by the coordinator server list.
+ * \param restartLocator
+ *      If not empty, the crashed master is being restarted in place and
+ *      will enlist again with this service locator; see #restartLocator.
+ * \param restartDeadline
+ *      Cycles::rdtsc() time after which to give up waiting for the
+ *      restarted server; ignored if \a restartLocator is empty.
  */
 Recovery::Recovery(Context* context,
                    TaskQueue& taskQueue,
@@ -65,20 +72,29 @@ Recovery::Recovery(Context* context,
                    RecoveryTracker* tracker,
                    Owner* owner,
                    ServerId crashedServerId,
-                   const ProtoBuf::MasterRecoveryInfo& recoveryInfo)
+                   const ProtoBuf::MasterRecoveryInfo& recoveryInfo,
+                   const string& restartLocator,
+                   uint64_t restartDeadline)
     : Task(taskQueue)
     , context(context)
     , crashedServerId(crashedServerId)
     , masterRecoveryInfo(recoveryInfo)
+    , restartLocator(restartLocator)
+    , restartDeadline(restartDeadline)
     , dataToRecover()
     , tableManager(tableManager)
     , tracker(tracker)
     , owner(owner)
     , recoveryId(generateRandom())
+    , restartedServerId()
+    , restartTimer()
     , status(START_RECOVERY_ON_BACKUPS)
     , recoveryTicks()
+    , firstTabletTicks()
     , replicaMap()
     , numPartitions()
+    , partitionMaxBytes(PARTITION_MAX_BYTES)
+    , partitionMaxRecords(PARTITION_MAX_RECORDS)
     , successfulRecoveryMasters()
     , unsuccessfulRecoveryMasters()
     , testingBackupStartTaskSendCallback()
@@ -146,11 +162,10 @@ Recovery::splitTablets(vector<Tablet> *tablets,
         // For this reason, we do not code for the case in which these values
         // will overflow.
         uint64_t byteTCount =
-                (stats.byteCount + Recovery::PARTITION_MAX_BYTES - 1)
-                / Recovery::PARTITION_MAX_BYTES;
+                (stats.byteCount + partitionMaxBytes - 1) / partitionMaxBytes;
         uint64_t recordTCount =
-                (stats.recordCount + Recovery::PARTITION_MAX_RECORDS - 1)
-                / Recovery::PARTITION_MAX_RECORDS;
+                (stats.recordCount + partitionMaxRecords - 1)
+                / partitionMaxRecords;
         uint64_t tabletCount = std::max(byteTCount, recordTCount);
 
         // The number of splits should be one less than the number of resulting
@@ -229,14 +244,19 @@ struct Partition {
     uint64_t partitionId;    //< Id used to differentiate tablet partitions
     uint64_t byteCount;      //< Number of bytes assigned to this partition.
     uint64_t recordCount;    //< Number of records assigned to this partition.
+    uint64_t maxBytes;       //< Number of bytes that fill the partition.
+    uint64_t maxRecords;     //< Number of records that fill the partition.
 
     /**
-     * Constructs a new partition with partitionId.
+     * Constructs a new partition with partitionId which holds at most
+     * maxBytes bytes and maxRecords records.
      */
-    explicit Partition(uint64_t partitionId)
+    Partition(uint64_t partitionId, uint64_t maxBytes, uint64_t maxRecords)
         : partitionId(partitionId)
         , byteCount(0)
         , recordCount(0)
+        , maxBytes(maxBytes)
+        , maxRecords(maxRecords)
     {}
 
     /**
@@ -246,11 +266,9 @@ struct Partition {
      */
     double usage() {
         double byte2 = (double(byteCount) * double(byteCount))
-                       / (double(Recovery::PARTITION_MAX_BYTES)
-                          * double(Recovery::PARTITION_MAX_BYTES));
+                       / (double(maxBytes) * double(maxBytes));
         double record2 = (double(recordCount) * double(recordCount))
-                         / (double(Recovery::PARTITION_MAX_RECORDS)
-                            * double(Recovery::PARTITION_MAX_RECORDS));
+                         / (double(maxRecords) * double(maxRecords));
         return sqrt(byte2 + record2) / sqrt(2);
     }
 
@@ -263,10 +281,9 @@ struct Partition {
      *      determine if said tablet would fit in the partition.
      */
     bool fits(TableStats::Estimator::Estimate estimate) {
-        if ((byteCount + estimate.byteCount) > Recovery::PARTITION_MAX_BYTES)
+        if ((byteCount + estimate.byteCount) > maxBytes)
             return false;
-        if ((recordCount + estimate.recordCount) >
-                Recovery::PARTITION_MAX_RECORDS)
+        if ((recordCount + estimate.recordCount) > maxRecords)
             return false;
         return true;
     }
@@ -305,6 +322,17 @@ Recovery::partitionTablets(vector<Tablet> tablets,
 {
     numPartitions = 0;
 
+    // A master restarting in place recovers all of its own tablets.
+    if (!restartLocator.empty()) {
+        foreach (auto& tablet, tablets) {
+            ProtoBuf::Tablets::Tablet& entry = *dataToRecover.add_tablet();
+            tablet.serialize(entry);
+            entry.set_user_data(0);
+        }
+        numPartitions = 1;
+        return;
+    }
+
     // If no usable estimator is available, this method will perform a naive
     // partition where each tablet will be placed in its own partition.  This
     // may occur if for some reason the table stats digest information is not
@@ -353,7 +381,8 @@ Recovery::partitionTablets(vector<Tablet> tablets,
         if (!done) {
             // This tablet did not fit in any of the open partitions we tried,
             // so make a new partition.
-            Partition partition(numPartitions++);
+            Partition partition(numPartitions++, partitionMaxBytes,
+                                partitionMaxRecords);
             partition.add(estimator->estimate(&tablet));
             ProtoBuf::Tablets::Tablet& entry = *dataToRecover.add_tablet();
             tablet.serialize(entry);
@@ -390,13 +419,17 @@ Recovery::performTask()
         return;
     }
 
-    metrics->coordinator.recoveryCount++;
     switch (status) {
     case START_RECOVERY_ON_BACKUPS:
+        metrics->coordinator.recoveryCount++;
         LOG(NOTICE, "Starting recovery %lu for crashed server %s",
             recoveryId, crashedServerId.toString().c_str());
         startBackups();
         break;
+    case WAIT_FOR_RESTART:
+        // Woken by serverEnlisted() or #restartTimer.
+        startBackups();
+        break;
     case START_RECOVERY_MASTERS:
         startRecoveryMasters();
         break;
@@ -623,7 +656,9 @@ BackupStartPartitionTask::wait()
 /**
  * Given lists of replicas provided by backups determine whether all
  * the segments in a log digest are claimed to be available on at
- * least one backup.
+ * least one backup. A segment stored as erasure-coded fragments (see
+ * ReedSolomon) is available if enough distinct fragments of it are to
+ * rebuild it.
  *
  * \param tasks
  *      Already run tasks holding the results of startReadingData calls
@@ -636,8 +671,8 @@ BackupStartPartitionTask::wait()
  *      successful and complete.
  *
  * \return
- *      True if at least one replica is available on some backup for
- *      every segment mentioned in the log digest.
+ *      True if at least one replica (or enough fragments) is available on
+ *      some backup for every segment mentioned in the log digest.
  */
 bool
 verifyLogComplete(Tub<BackupStartTask> tasks[],
@@ -645,9 +680,22 @@ verifyLogComplete(Tub<BackupStartTask> tasks[],
                  const LogDigest& digest)
 {
     std::unordered_set<uint64_t> replicaSet;
+    // Distinct fragment indexes found for each erasure-coded segment.
+    std::unordered_map<uint64_t, std::unordered_set<uint32_t>> fragments;
+    std::unordered_map<uint64_t, uint32_t> fragmentsNeeded;
     for (size_t i = 0; i < taskCount; ++i) {
-        foreach (auto replica, tasks[i]->result.replicas)
-            replicaSet.insert(replica.segmentId);
+        foreach (auto replica, tasks[i]->result.replicas) {
+            if (replica.dataFragments == 0) {
+                replicaSet.insert(replica.segmentId);
+                continue;
+            }
+            fragments[replica.segmentId].insert(replica.fragmentIndex);
+            fragmentsNeeded[replica.segmentId] = replica.dataFragments;
+        }
+    }
+    foreach (const auto& entry, fragments) {
+        if (entry.second.size() >= fragmentsNeeded[entry.first])
+            replicaSet.insert(entry.first);
     }
 
     uint32_t missing = 0;
@@ -752,7 +800,8 @@ struct ReplicaAndLoadTime {
  *  \param headId
  *      Only replicas from segments less or equal than this are included in the
  *      script.
- *      Determined by findLogDigest().
+ *      The highest segment id named by the log digest found by
+ *      findLogDigest() (the last of the log's heads).
  *  \return
  *      Script which indicates to recovery masters which replicas are on which
  *      backups and (approximately) what order segments should be replayed in.
@@ -792,7 +841,8 @@ buildReplicaMap(Tub<BackupStartTask> tasks[],
             }
             const auto& replica = task->result.replicas[i];
             if (replica.segmentId <= headId) {
-                ReplicaAndLoadTime r{{ backupId.getId(), replica.segmentId },
+                ReplicaAndLoadTime r{{ backupId.getId(), replica.segmentId,
+                                       replica.dataFragments != 0 },
                                       expectedLoadTimeMs};
                 replicasToSort.push_back(r);
             } else {
@@ -821,11 +871,88 @@ buildReplicaMap(Tub<BackupStartTask> tasks[],
 } // end namespace
 using namespace RecoveryInternal; // NOLINT
 
+/**
+ * Return the id of the server that has enlisted at #restartLocator to take
+ * the place of the crashed master, if it has enlisted with both a master
+ * and a backup; otherwise return an invalid ServerId.
+ */
+ServerId
+Recovery::findRestartedServer()
+{
+    foreach (ServerId id,
+             tracker->getServersWithService(WireFormat::BACKUP_SERVICE)) {
+        ServerDetails* details = tracker->getServerDetails(id);
+        if (id != crashedServerId &&
+                details->serviceLocator == restartLocator &&
+                details->services.has(WireFormat::MASTER_SERVICE)) {
+            return id;
+        }
+    }
+    return ServerId();
+}
+
+/**
+ * Called by the MasterRecoveryManager when a server enlists; wakes this
+ * recovery if it is waiting for that server to restart in place (see
+ * #restartLocator).
+ *
+ * \param server
+ *      Details of the server that just enlisted.
+ */
+void
+Recovery::serverEnlisted(const ServerDetails& server)
+{
+    if (status == WAIT_FOR_RESTART &&
+            server.serviceLocator == restartLocator) {
+        schedule();
+    }
+}
+
+/**
+ * Construct a timer to wake up \a recovery; see #restartTimer.
+ *
+ * \param recovery
+ *      The recovery to schedule when the timer fires.
+ */
+Recovery::RestartTimer::RestartTimer(Recovery* recovery)
+    : WorkerTimer(recovery->context->dispatch)
+    , recovery(recovery)
+{
+}
+
+/**
+ * Invoked once #restartDeadline has passed; schedules the recovery so that
+ * startBackups() gives up waiting for the server to restart in place.
+ */
+void
+Recovery::RestartTimer::handleTimerEvent()
+{
+    recovery->schedule();
+}
+
+/**
+ * Give up on recovering the crashed master from its own backup (see
+ * #restartLocator); it will be recovered from all backups instead.
+ *
+ * \param reason
+ *      Why; included in the log message.
+ */
+void
+Recovery::stopRestartingLocally(const char* reason)
+{
+    LOG(WARNING, "Can't restart server %s in place because %s; recovering "
+        "it from all backups instead",
+        crashedServerId.toString().c_str(), reason);
+    restartLocator.clear();
+}
+
 /**
  * Builds a map describing where replicas for each segment that is part of
  * the crashed master's log can be found. Collects replica information by
  * contacting all backups and ensures that the collected information makes
- * up a complete and recoverable log.
+ * up a complete and recoverable log. If the crashed master is restarting in
+ * place (see #restartLocator) only the backup of the restarted server is
+ * contacted.
  */
 void
 Recovery::startBackups()
@@ -845,13 +972,40 @@ Recovery::startBackups()
         }
         return;
     }
+    firstTabletTicks.construct(&metrics->coordinator.recoveryFirstTabletTicks);
 
     LOG(DEBUG, "Getting segment lists from backups and preparing "
                "them for recovery");
 
     const uint32_t maxActiveBackupHosts = 10;
-    std::vector<ServerId> backups =
-        tracker->getServersWithService(WireFormat::BACKUP_SERVICE);
+    std::vector<ServerId> backups;
+    if (!restartLocator.empty()) {
+        restartedServerId = findRestartedServer();
+        if (restartedServerId.isValid()) {
+            LOG(NOTICE, "Server %s restarted as %s; recovering it from the "
+                "replicas on its own backup",
+                crashedServerId.toString().c_str(),
+                restartedServerId.toString().c_str());
+            backups.push_back(restartedServerId);
+        } else if (Cycles::rdtsc() < restartDeadline) {
+            if (status != WAIT_FOR_RESTART) {
+                LOG(NOTICE, "Waiting for server %s to restart at %s",
+                    crashedServerId.toString().c_str(),
+                    restartLocator.c_str());
+            }
+            status = WAIT_FOR_RESTART;
+            if (!restartTimer) {
+                restartTimer.construct(this);
+                restartTimer->start(restartDeadline);
+            }
+            return;
+        } else {
+            stopRestartingLocally("it didn't restart in time");
+        }
+    }
+    restartTimer.destroy();
+    if (restartLocator.empty())
+        backups = tracker->getServersWithService(WireFormat::BACKUP_SERVICE);
     /// List of asynchronous startReadingData tasks and their replies
     auto backupStartTasks = std::unique_ptr<Tub<BackupStartTask>[]>(
             new Tub<BackupStartTask>[backups.size()]);
@@ -872,6 +1026,8 @@ Recovery::startBackups()
     if (!digestInfo) {
         LOG(NOTICE, "No log digest among replicas on available backups. "
             "Will retry recovery later.");
+        if (!restartLocator.empty())
+            stopRestartingLocally("its backup has no log digest");
         status = ALL_RECOVERY_MASTERS_FINISHED;
         schedule();
         return;
@@ -891,11 +1047,26 @@ Recovery::startBackups()
     if (!logIsComplete) {
         LOG(NOTICE, "Some replicas from log digest not on available backups. "
             "Will retry recovery later.");
+        if (!restartLocator.empty())
+            stopRestartingLocally("its backup lacks part of its log");
         status = ALL_RECOVERY_MASTERS_FINISHED;
         schedule();
         return;
     }
 
+    // A log with several heads (see ServerConfig::Master::numLogHeads) names
+    // all of them in each head's digest, and headId is just the lowest of
+    // them; synced data in the others must be replayed too. The digest never
+    // names a segment allocated after the heads, so the highest id in it is
+    // the end of the log.
+    uint64_t lastSegmentId = headId;
+    for (uint32_t i = 0; i < digest.size(); i++)
+        lastSegmentId = std::max(lastSegmentId, digest[i]);
+    if (lastSegmentId != headId) {
+        LOG(NOTICE, "Log has several heads; segment %lu is the last",
+            lastSegmentId);
+    }
+
     /* Broadcast 2: partition replicas into tablets for recovery masters */
     TableStats::Estimator estimator(tableStats);
     partitionTablets(tablets, &estimator);
@@ -906,7 +1077,7 @@ Recovery::startBackups()
             maxActiveBackupHosts);
 
     replicaMap = buildReplicaMap(backupStartTasks.get(), backups.size(),
-                                 tracker, headId);
+                                 tracker, lastSegmentId);
 
     status = START_RECOVERY_MASTERS;
     schedule();
@@ -1012,6 +1183,15 @@ Recovery::startRecoveryMasters()
     // Set up the tasks to execute the RPCs.
     std::vector<ServerId> masters =
         tracker->getServersWithService(WireFormat::MASTER_SERVICE);
+    if (!restartLocator.empty()) {
+        // Only the restarted server has the replicas to recover from.
+        bool restartedServerUp =
+            std::find(masters.begin(), masters.end(), restartedServerId) !=
+            masters.end();
+        masters.clear();
+        if (restartedServerUp)
+            masters.push_back(restartedServerId);
+    }
     std::random_shuffle(masters.begin(), masters.end(), randomNumberGenerator);
     uint32_t started = 0;
     Tub<MasterStartTask> recoverTasks[numPartitions];
@@ -1103,6 +1283,7 @@ Recovery::recoveryMasterFinished(ServerId recoveryMasterId,
 
     if (successful) {
         ++successfulRecoveryMasters;
+        firstTabletTicks.destroy();
     } else {
         ++unsuccessfulRecoveryMasters;
         if (recoveryMasterId.isValid())
@@ -1110,12 +1291,21 @@ Recovery::recoveryMasterFinished(ServerId recoveryMasterId,
                 "for crashed server %s",
                 recoveryMasterId.toString().c_str(),
                 crashedServerId.toString().c_str());
+        // Don't keep retrying a restart in place that has failed once; the
+        // follow up recovery uses every backup.
+        if (!restartLocator.empty() && restartedServerId.isValid())
+            stopRestartingLocally("it failed to recover itself");
     }
 
     const uint32_t completedRecoveryMasters =
         successfulRecoveryMasters + unsuccessfulRecoveryMasters;
     if (completedRecoveryMasters == numPartitions) {
         recoveryTicks.destroy();
+        if (firstTabletTicks) {
+            // No tablets were recovered.
+            firstTabletTicks->cancel();
+            firstTabletTicks.destroy();
+        }
         status = ALL_RECOVERY_MASTERS_FINISHED;
 #if BCAST_INLINE
         broadcastRecoveryComplete();
@@ -29,6 +29,7 @@
 #include "RecoveryPartition.pb.h"
 #include "TaskQueue.h"
 #include "TableStats.h"
+#include "WorkerTimer.h"
 
 namespace RAMCloud {
 
@@ -145,11 +146,14 @@ class Recovery : public Task {
              RecoveryTracker* tracker,
              Owner* owner,
              ServerId crashedServerId,
-             const ProtoBuf::MasterRecoveryInfo& recoveryInfo);
+             const ProtoBuf::MasterRecoveryInfo& recoveryInfo,
+             const string& restartLocator = "",
+             uint64_t restartDeadline = 0);
     ~Recovery();
 
     virtual void performTask();
     void recoveryMasterFinished(ServerId recoveryMasterId, bool successful);
+    void serverEnlisted(const ServerDetails& server);
 
     bool isDone() const;
     bool wasCompletelySuccessful() const;
@@ -173,6 +177,29 @@ class Recovery : public Task {
      */
     const ProtoBuf::MasterRecoveryInfo masterRecoveryInfo;
 
+    /**
+     * If not empty, the crashed master is being restarted in place for
+     * maintenance and is expected to enlist again with this service
+     * locator (see the "restartLocally" RuntimeOption). Rather than being
+     * split among many recovery masters, it is then recovered as a single
+     * partition by the restarted server, which reads every replica from
+     * the backup in its own process. Cleared if that isn't possible (the
+     * server didn't come back by #restartDeadline, its backup lacks part
+     * of the log, or it failed to recover itself), in which case the
+     * crashed master is recovered from all backups as usual.
+     */
+    string restartLocator;
+
+    /**
+     * Cycles::rdtsc() time after which to stop waiting for the server
+     * named by #restartLocator to enlist.
+     */
+    const uint64_t restartDeadline;
+
+    /// How long to wait for a server being restarted in place to enlist
+    /// before recovering it from all backups instead.
+    static const uint32_t RESTART_WAIT_SECONDS = 30;
+
     /// Defines max number of bytes a tablet partition should accommodate.
     static const uint64_t PARTITION_MAX_BYTES = 500*1024*1024;
     /// Defines the max number of records a tablet partition should accommodate.
@@ -183,6 +210,8 @@ class Recovery : public Task {
                       TableStats::Estimator* estimator);
     void partitionTablets(vector<Tablet> tablets,
                           TableStats::Estimator* estimator);
+    ServerId findRestartedServer();
+    void stopRestartingLocally(const char* reason);
     void startBackups();
     void startRecoveryMasters();
     void broadcastRecoveryComplete();
@@ -227,9 +256,40 @@ class Recovery : public Task {
      */
     uint64_t recoveryId;
 
+    /**
+     * The server recovering the crashed master from its own backup, if
+     * #restartLocator is set; found by startBackups().
+     */
+    ServerId restartedServerId;
+
+    /**
+     * Wakes up a recovery waiting for the server named by #restartLocator
+     * to enlist (WAIT_FOR_RESTART) once #restartDeadline has passed.
+     */
+    class RestartTimer : public WorkerTimer {
+      public:
+        explicit RestartTimer(Recovery* recovery);
+        virtual void handleTimerEvent();
+
+        /// The recovery to wake up.
+        Recovery* recovery;
+
+      private:
+        DISALLOW_COPY_AND_ASSIGN(RestartTimer);
+    };
+
+    /**
+     * Running only while this recovery is in WAIT_FOR_RESTART; see
+     * serverEnlisted() for the other way out of that state.
+     */
+    Tub<RestartTimer> restartTimer;
+
     enum Status {
         START_RECOVERY_ON_BACKUPS,     ///< Contact all backups and find
                                        ///  replicas.
+        WAIT_FOR_RESTART,              ///< Wait for the crashed master to
+                                       ///  enlist again; see
+                                       ///  #restartLocator.
         START_RECOVERY_MASTERS,        ///< Choose and start recovery masters.
         WAIT_FOR_RECOVERY_MASTERS,     ///< Wait on recovery master completion.
         ALL_RECOVERY_MASTERS_FINISHED, ///< All recovery managers have either
@@ -247,6 +307,13 @@ class Recovery : public Task {
      */
     Tub<CycleCounter<RawMetric>> recoveryTicks;
 
+    /**
+     * Measures time between the start of recovery on the coordinator and
+     * the first recovery master finishing its partition, when the first of
+     * the crashed master's tablets become available again.
+     */
+    Tub<CycleCounter<RawMetric>> firstTabletTicks;
+
     /**
      * A mapping of segmentIds to backup host service locators.
      * Populated by buildReplicaMap().
@@ -262,6 +329,14 @@ class Recovery : public Task {
      */
     uint32_t numPartitions;
 
+    /**
+     * Limits on the size of each partition chosen by partitionTablets().
+     * Always PARTITION_MAX_BYTES and PARTITION_MAX_RECORDS during a real
+     * recovery; RecoverySimulator changes them to evaluate other plans.
+     */
+    uint64_t partitionMaxBytes;
+    uint64_t partitionMaxRecords;
+
     /**
      * Number of recovery masters which have completed (as part of the
      * WAIT_FOR_RECOVERY_MASTERS phase) and successfully recovered
@@ -314,6 +389,7 @@ class Recovery : public Task {
     friend class RecoveryInternal::BackupStartPartitionTask;
     friend class RecoveryInternal::MasterStartTask;
     friend class RecoveryInternal::BackupEndTask;
+    friend class RecoverySimulator;
     DISALLOW_COPY_AND_ASSIGN(Recovery);
 };
 
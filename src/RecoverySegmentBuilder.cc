@@ -203,7 +203,9 @@ RecoverySegmentBuilder::build(const void* buffer, uint32_t length,
 
 /**
  * Scan \a buffer for a LogDigest and a TableStats::Digest.  If either exists,
- * replace the contents of \a digestBuffer with it.
+ * replace the contents of \a digestBuffer with it. A head of a log with
+ * several heads may hold more than one of each (see
+ * SegmentManager::allocHeadSegments()); the last one is the current one.
  *
  * \param buffer
  *      Contiguous region of \a length bytes that contains the replica contents
@@ -236,7 +238,6 @@ RecoverySegmentBuilder::extractDigest(const void* buffer, uint32_t length,
     // coordinator will have to deal.
     SegmentIterator it(buffer, length, certificate);
     bool foundDigest = false;
-    bool foundTableStats = false;
     try {
         it.checkMetadataIntegrity();
     } catch (SegmentIteratorException& e) {
@@ -253,10 +254,6 @@ RecoverySegmentBuilder::extractDigest(const void* buffer, uint32_t length,
         if (it.getType() == LOG_ENTRY_TYPE_TABLESTATS) {
             tableStatsBuffer->reset();
             it.appendToBuffer(*tableStatsBuffer);
-            foundTableStats = true;
-        }
-        if (foundDigest && foundTableStats) {
-            return true;
         }
         it.next();
     }
@@ -14,6 +14,7 @@
  */
 
 #include "TestUtil.h"
+#include "LogDigest.h"
 #include "Object.h"
 #include "ObjectManager.h"
 #include "RecoverySegmentBuilder.h"
@@ -346,6 +347,23 @@ TEST_F(RecoverySegmentBuilderTest, extractDigest) {
                               certificate, &digestBuffer, &tableStatsBuffer));
     EXPECT_NE(0u, digestBuffer.size());
 
+    // A later digest supersedes the first one.
+    LogDigest laterDigest;
+    laterDigest.addSegmentId(1);
+    laterDigest.addSegmentId(2);
+    Buffer laterDigestBuffer;
+    laterDigest.appendToBuffer(laterDigestBuffer);
+    ASSERT_TRUE(segment->append(LOG_ENTRY_TYPE_LOGDIGEST, laterDigestBuffer));
+    length = segment->getAppendedLength(&certificate);
+    ASSERT_TRUE(segment->copyOut(0, buffer, length));
+    EXPECT_TRUE(extractDigest(buffer, sizeof32(buffer),
+                              certificate, &digestBuffer, &tableStatsBuffer));
+    LogDigest extracted(digestBuffer.getRange(0, digestBuffer.size()),
+                        digestBuffer.size());
+    ASSERT_EQ(2u, extracted.size());
+    EXPECT_EQ(2u, extracted[1]);
+    EXPECT_NE(0u, tableStatsBuffer.size());
+
     // Corrupt metadata.
     certificate.checksum = 0;
     EXPECT_FALSE(extractDigest(buffer, sizeof32(buffer),
@@ -0,0 +1,308 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "RecoverySimulator.h"
+#include "CoordinatorUpdateManager.h"
+#include "MasterRecoveryManager.h"
+#include "MockExternalStorage.h"
+#include "ShortMacros.h"
+
+namespace RAMCloud {
+
+/**
+ * Construct a simulator for the recovery described by a snapshot.
+ *
+ * \param snapshot
+ *      The crashed master's tablets and table stats, the placement of its
+ *      replicas and the bandwidths of the servers in the cluster.
+ */
+RecoverySimulator::RecoverySimulator(
+        const ProtoBuf::RecoverySimulation& snapshot)
+    : snapshot(snapshot)
+{
+}
+
+/**
+ * Plan a recovery with the given options and predict how it would go.
+ *
+ * \param options
+ *      Partitioning parameters to evaluate and default bandwidths.
+ * \return
+ *      The resulting partitions and predicted recovery time.
+ * \throw FatalError
+ *      There are no recovery masters to recover with.
+ */
+RecoverySimulator::Plan
+RecoverySimulator::simulate(const Options& options)
+{
+    Plan plan;
+    plan.options = options;
+    plan.numMasters = options.recoveryMasters != 0 ? options.recoveryMasters
+            : downCast<uint32_t>(snapshot.master_size());
+    if (plan.numMasters == 0)
+        throw FatalError(HERE, "No recovery masters to simulate");
+    partition(&plan);
+    model(&plan);
+    return plan;
+}
+
+/**
+ * Divide the crashed master's tablets into partitions using the real
+ * Recovery code, and fill in the estimated size of each partition.
+ *
+ * A recovery with more partitions than recovery masters recovers only the
+ * first numMasters partitions; MasterRecoveryManager then starts another
+ * recovery, which partitions the remaining tablets all over again. Each of
+ * these recoveries is a wave of the plan, and they are partitioned here the
+ * same way.
+ *
+ * \param plan
+ *      Plan whose options give the partition limits and whose numMasters
+ *      is set; its partitionBytes, partitionRecords and imbalance fields are
+ *      filled in, along with the partitions of each of its waves.
+ */
+void
+RecoverySimulator::partition(Plan* plan)
+{
+    // Recovery needs a coordinator's TableManager to split tablets in;
+    // give it a private one backed by nothing.
+    Context context;
+    TaskQueue taskQueue;
+    RecoveryTracker tracker(&context);
+    MockExternalStorage storage(false);
+    context.externalStorage = &storage;
+    CoordinatorUpdateManager updateManager(&storage);
+    TableManager tableManager(&context, &updateManager);
+    ServerId crashedServerId(1, 0);
+    foreach (const auto& entry, snapshot.tablet()) {
+        uint64_t tableId = entry.table_id();
+        if (tableManager.idMap.find(tableId) == tableManager.idMap.end()) {
+            tableManager.testCreateTable(format("%lu", tableId).c_str(),
+                                         tableId);
+        }
+        tableManager.testAddTablet({tableId, entry.start_key_hash(),
+                entry.end_key_hash(), crashedServerId, Tablet::RECOVERING,
+                {}});
+    }
+
+    // Rebuild the digest the coordinator would find in the log head.
+    int entryCount = snapshot.table_stats_size();
+    vector<char> buffer(sizeof(TableStats::DigestHeader) +
+                        entryCount * sizeof(TableStats::DigestEntry));
+    TableStats::Digest* digest =
+        reinterpret_cast<TableStats::Digest*>(buffer.data());
+    digest->header.otherBytesPerKeyHash = snapshot.other_bytes_per_key_hash();
+    digest->header.otherRecordsPerKeyHash =
+        snapshot.other_records_per_key_hash();
+    digest->header.entryCount = entryCount;
+    for (int i = 0; i < entryCount; i++) {
+        const auto& stats = snapshot.table_stats(i);
+        digest->entries[i].tableId = stats.table_id();
+        digest->entries[i].bytesPerKeyHash = stats.bytes_per_key_hash();
+        digest->entries[i].recordsPerKeyHash = stats.records_per_key_hash();
+    }
+    TableStats::Estimator estimator(digest);
+
+    plan->partitionBytes.clear();
+    plan->partitionRecords.clear();
+    plan->waves.clear();
+    ServerId recoveryMasterId(2, 0);
+    vector<Tablet> tablets =
+            tableManager.markAllTabletsRecovering(crashedServerId);
+    while (!tablets.empty()) {
+        Recovery recovery(&context, taskQueue, &tableManager, &tracker, NULL,
+                          crashedServerId, ProtoBuf::MasterRecoveryInfo());
+        recovery.partitionMaxBytes = plan->options.partitionMaxBytes;
+        recovery.partitionMaxRecords = plan->options.partitionMaxRecords;
+        recovery.partitionTablets(tablets, &estimator);
+
+        Wave wave{downCast<uint32_t>(plan->partitionBytes.size()),
+                  std::min(plan->numMasters, recovery.numPartitions), 0, ""};
+        plan->partitionBytes.resize(wave.firstPartition + wave.numPartitions);
+        plan->partitionRecords.resize(
+                wave.firstPartition + wave.numPartitions);
+        foreach (const auto& entry, recovery.dataToRecover.tablet()) {
+            // Tablets of the other partitions are left for the next wave.
+            if (entry.user_data() >= wave.numPartitions)
+                continue;
+            Tablet tablet(entry.table_id(), entry.start_key_hash(),
+                          entry.end_key_hash(), crashedServerId,
+                          Tablet::RECOVERING, {});
+            TableStats::Estimator::Estimate estimate =
+                estimator.estimate(&tablet);
+            uint64_t partition = wave.firstPartition + entry.user_data();
+            plan->partitionBytes.at(partition) += estimate.byteCount;
+            plan->partitionRecords.at(partition) += estimate.recordCount;
+            tableManager.tabletRecovered(entry.table_id(),
+                    entry.start_key_hash(), entry.end_key_hash(),
+                    recoveryMasterId, {0, 0});
+        }
+        plan->waves.push_back(wave);
+        tablets = tableManager.markAllTabletsRecovering(crashedServerId);
+    }
+
+    plan->partitionByteImbalance = imbalance(vector<double>(
+            plan->partitionBytes.begin(), plan->partitionBytes.end()));
+    plan->partitionRecordImbalance = imbalance(vector<double>(
+            plan->partitionRecords.begin(), plan->partitionRecords.end()));
+}
+
+/**
+ * Assign the partitions of a plan to recovery masters and predict how long
+ * recovering them would take; see the class documentation for the model.
+ *
+ * \param plan
+ *      Plan whose partitions and waves have been filled in by partition();
+ *      the duration and bottleneck of each wave, and its seconds and
+ *      backupImbalance fields, are filled in.
+ */
+void
+RecoverySimulator::model(Plan* plan)
+{
+    const Options& options = plan->options;
+    const double MB = 1024 * 1024;
+
+    /// A recovery master and the rates at which it works, in bytes/s.
+    struct Master {
+        uint64_t serverId;
+        double replay;
+        double network;
+    };
+    vector<Master> masters;
+    foreach (const auto& master, snapshot.master()) {
+        masters.push_back({master.server_id(),
+            (master.has_replay_bandwidth() ? master.replay_bandwidth()
+                                           : options.replayBandwidth) * MB,
+            (master.has_network_bandwidth() ? master.network_bandwidth()
+                                            : options.networkBandwidth) * MB});
+    }
+    if (options.recoveryMasters != 0) {
+        uint64_t serverId = 1;
+        foreach (const auto& master, masters)
+            serverId = std::max(serverId, master.serverId + 1);
+        while (masters.size() < options.recoveryMasters) {
+            masters.push_back({serverId++, options.replayBandwidth * MB,
+                               options.networkBandwidth * MB});
+        }
+        masters.resize(options.recoveryMasters);
+    }
+    assert(masters.size() == plan->numMasters);
+
+    vector<double> primaryReplicas;
+    foreach (const auto& backup, snapshot.backup())
+        primaryReplicas.push_back(backup.primary_replicas());
+    plan->backupImbalance = imbalance(primaryReplicas);
+
+    uint64_t totalBytes = 0;
+    foreach (uint64_t bytes, plan->partitionBytes)
+        totalBytes += bytes;
+    uint32_t numReplicas = snapshot.num_replicas();
+
+    plan->seconds = 0;
+    foreach (Wave& wave, plan->waves) {
+        uint32_t first = wave.firstPartition;
+        auto consider = [&wave](double seconds, const string& bottleneck) {
+            if (seconds > wave.seconds) {
+                wave.seconds = seconds;
+                wave.bottleneck = bottleneck;
+            }
+        };
+
+        uint64_t waveBytes = 0;
+        for (uint32_t i = 0; i < wave.numPartitions; i++) {
+            const Master& master = masters[i];
+            double bytes = double(plan->partitionBytes[first + i]);
+            waveBytes += plan->partitionBytes[first + i];
+            consider(bytes / master.replay,
+                     format("master %lu (replay)", master.serverId));
+            consider(bytes * std::max(1u, numReplicas) / master.network,
+                     format("master %lu (network)", master.serverId));
+        }
+
+        // Each backup reads all of its primary replicas, but only sends
+        // on the part belonging to this wave's partitions. The new replicas
+        // are assumed to be spread evenly over all backups.
+        double fraction = totalBytes == 0 ? 0 :
+                double(waveBytes) / double(totalBytes);
+        double written = snapshot.backup_size() == 0 ? 0 :
+                double(waveBytes) * numReplicas / snapshot.backup_size();
+        foreach (const auto& backup, snapshot.backup()) {
+            double disk = (backup.has_disk_bandwidth()
+                    ? backup.disk_bandwidth() : options.diskBandwidth) * MB;
+            double network = (backup.has_network_bandwidth()
+                    ? backup.network_bandwidth() : options.networkBandwidth)
+                    * MB;
+            double read = double(backup.primary_replicas()) *
+                    snapshot.segment_size();
+            consider((read + written) / disk,
+                     format("backup %lu (disk)", backup.server_id()));
+            consider(std::max(read * fraction, written) / network,
+                     format("backup %lu (network)", backup.server_id()));
+        }
+
+        // Each wave after the first is a new recovery, which the
+        // coordinator only starts after a delay.
+        if (&wave != &plan->waves.front()) {
+            plan->seconds += MasterRecoveryManager::RESCHEDULE_DELAY_MS /
+                    1000.0;
+        }
+        plan->seconds += wave.seconds;
+    }
+}
+
+/**
+ * Return the largest of a set of loads divided by their average: 1.0 if
+ * they are perfectly balanced (or there are none).
+ */
+double
+RecoverySimulator::imbalance(const vector<double>& loads)
+{
+    double total = 0;
+    double largest = 0;
+    foreach (double load, loads) {
+        total += load;
+        largest = std::max(largest, load);
+    }
+    if (total == 0)
+        return 1.0;
+    return largest / (total / double(loads.size()));
+}
+
+/**
+ * Return a human-readable report of the plan, one line for the plan as a
+ * whole followed by one line per wave and one for the imbalances.
+ */
+string
+RecoverySimulator::Plan::toString() const
+{
+    string result = format("partitionMaxBytes %lu, partitionMaxRecords %lu, "
+            "%u recovery masters: %lu partitions in %lu waves, predicted "
+            "recovery time %.3f s\n", options.partitionMaxBytes,
+            options.partitionMaxRecords, numMasters, partitionBytes.size(),
+            waves.size(), seconds);
+    foreach (const Wave& wave, waves) {
+        result += format("  wave of partitions %u-%u: %.3f s, bottleneck %s\n",
+                wave.firstPartition,
+                wave.firstPartition + wave.numPartitions - 1, wave.seconds,
+                wave.bottleneck.c_str());
+    }
+    result += format("  imbalance (max/mean): partition bytes %.2f, "
+            "partition records %.2f, backup primary replicas %.2f\n",
+            partitionByteImbalance, partitionRecordImbalance,
+            backupImbalance);
+    return result;
+}
+
+} // namespace RAMCloud
@@ -0,0 +1,165 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef RAMCLOUD_RECOVERYSIMULATOR_H
+#define RAMCLOUD_RECOVERYSIMULATOR_H
+
+#include "Common.h"
+#include "Recovery.h"
+#include "RecoverySimulation.pb.h"
+
+namespace RAMCloud {
+
+/**
+ * Predicts how long the recovery of a crashed master would take under a
+ * given partitioning plan, without a cluster. This is used (through the
+ * recoverySimulator tool) to choose partitioning parameters before trying
+ * them in a real cluster with recovery.py.
+ *
+ * The input is a snapshot of what the coordinator would see (the crashed
+ * master's tablets and TableStats digest, and where BackupSelector placed
+ * its replicas) together with measured bandwidths of each server; see
+ * RecoverySimulation.proto. The tablets are divided up by the coordinator's
+ * own Recovery::partitionTablets() (which also splits large tablets), run
+ * against a private TableManager, so the plan is exactly what a real
+ * recovery would use with the same partition limits.
+ *
+ * Recovery time is then predicted with a simple bottleneck model. Partitions
+ * are handed to recovery masters in waves, as happens when there are fewer
+ * masters than partitions: each wave is a separate recovery, which
+ * repartitions the tablets left by the previous one, rereads all primary
+ * replicas from the backups, and starts only after MasterRecoveryManager's
+ * RESCHEDULE_DELAY_MS. Within a wave, each backup reads its primary replicas
+ * and writes its share of the new replicas, and each recovery master
+ * receives, replays and rereplicates its partition. Every resource is
+ * assumed to run at its rated bandwidth with all stages overlapped, so a
+ * wave takes as long as its busiest resource, which is reported as the
+ * wave's bottleneck.
+ */
+class RecoverySimulator {
+  PUBLIC:
+    /**
+     * Describes one plan to evaluate, along with the bandwidths to assume
+     * for servers whose bandwidths the snapshot leaves out.
+     */
+    struct Options {
+        Options()
+            : partitionMaxBytes(Recovery::PARTITION_MAX_BYTES)
+            , partitionMaxRecords(Recovery::PARTITION_MAX_RECORDS)
+            , recoveryMasters(0)
+            , diskBandwidth(100)
+            , networkBandwidth(3000)
+            , replayBandwidth(400)
+        {}
+
+        /// Limits on the size of each partition; see Recovery.
+        uint64_t partitionMaxBytes;
+        uint64_t partitionMaxRecords;
+
+        /// Number of recovery masters to use. 0 means every master in
+        /// the snapshot; more than that adds masters with default
+        /// bandwidths.
+        uint32_t recoveryMasters;
+
+        /// Default bandwidths in MB/s.
+        double diskBandwidth;
+        double networkBandwidth;
+        double replayBandwidth;
+    };
+
+    /**
+     * The predicted course of one round of recovery masters.
+     */
+    struct Wave {
+        /// Index in Plan::partitionBytes of the first partition recovered
+        /// in this wave.
+        uint32_t firstPartition;
+
+        /// Number of partitions (and recovery masters) in this wave.
+        uint32_t numPartitions;
+
+        /// Predicted duration of the wave in seconds, not counting the
+        /// delay before it starts.
+        double seconds;
+
+        /// The resource that determines #seconds, such as
+        /// "backup 3 (disk)".
+        string bottleneck;
+    };
+
+    /**
+     * The result of simulating one plan.
+     */
+    struct Plan {
+        Plan()
+            : options()
+            , partitionBytes()
+            , partitionRecords()
+            , numMasters(0)
+            , waves()
+            , seconds(0)
+            , partitionByteImbalance(0)
+            , partitionRecordImbalance(0)
+            , backupImbalance(0)
+        {}
+
+        string toString() const;
+
+        /// The options this plan was simulated with.
+        Options options;
+
+        /// Estimated number of bytes and records in each partition, in the
+        /// order they are recovered (the partitions of each wave follow
+        /// those of the wave before it).
+        vector<uint64_t> partitionBytes;
+        vector<uint64_t> partitionRecords;
+
+        /// Number of recovery masters used.
+        uint32_t numMasters;
+
+        /// Every wave of recovery masters, in order.
+        vector<Wave> waves;
+
+        /// Predicted recovery time in seconds, including the delays between
+        /// waves.
+        double seconds;
+
+        /// Largest partition divided by the average one, in bytes and in
+        /// records; 1.0 means perfectly balanced.
+        double partitionByteImbalance;
+        double partitionRecordImbalance;
+
+        /// Largest number of primary replicas on a backup divided by the
+        /// average number.
+        double backupImbalance;
+    };
+
+    explicit RecoverySimulator(const ProtoBuf::RecoverySimulation& snapshot);
+    Plan simulate(const Options& options);
+
+  PRIVATE:
+    void partition(Plan* plan);
+    void model(Plan* plan);
+    static double imbalance(const vector<double>& loads);
+
+    /// Everything known about the crashed master and the cluster.
+    const ProtoBuf::RecoverySimulation snapshot;
+
+    DISALLOW_COPY_AND_ASSIGN(RecoverySimulator);
+};
+
+} // namespace RAMCloud
+
+#endif // RAMCLOUD_RECOVERYSIMULATOR_H
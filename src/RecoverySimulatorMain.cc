@@ -0,0 +1,124 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Predicts master recovery times for a range of partitioning parameters
+ * without a cluster; see RecoverySimulator. Every combination of the
+ * partitionMaxBytes, partitionMaxRecords and recoveryMasters values given
+ * is simulated against the snapshot and reported, fastest last.
+ */
+
+#include <google/protobuf/text_format.h>
+#include <fstream>
+#include <sstream>
+
+#include "Common.h"
+#include "OptionParser.h"
+#include "RecoverySimulator.h"
+
+using namespace RAMCloud;
+
+int
+main(int argc, char *argv[])
+try
+{
+    string snapshotFile;
+    vector<uint64_t> partitionMaxBytes;
+    vector<uint64_t> partitionMaxRecords;
+    vector<uint32_t> recoveryMasters;
+    RecoverySimulator::Options defaults;
+
+    OptionsDescription simulatorOptions("RecoverySimulator");
+    simulatorOptions.add_options()
+        ("snapshot",
+         ProgramOptions::value<string>(&snapshotFile)->required(),
+         "File describing the crashed master and the cluster, as a "
+         "RecoverySimulation protocol buffer in text format.")
+        ("partitionMaxBytes",
+         ProgramOptions::value<vector<uint64_t>>(&partitionMaxBytes)->
+            multitoken()->default_value({Recovery::PARTITION_MAX_BYTES},
+                format("%lu", Recovery::PARTITION_MAX_BYTES)),
+         "Largest number of bytes in a partition. Give several values to "
+         "compare them.")
+        ("partitionMaxRecords",
+         ProgramOptions::value<vector<uint64_t>>(&partitionMaxRecords)->
+            multitoken()->default_value({Recovery::PARTITION_MAX_RECORDS},
+                format("%lu", Recovery::PARTITION_MAX_RECORDS)),
+         "Largest number of records in a partition. Give several values to "
+         "compare them.")
+        ("recoveryMasters",
+         ProgramOptions::value<vector<uint32_t>>(&recoveryMasters)->
+            multitoken()->default_value({0}, "0"),
+         "Number of recovery masters; 0 means the masters listed in the "
+         "snapshot. Give several values to compare them.")
+        ("diskBandwidth",
+         ProgramOptions::value<double>(&defaults.diskBandwidth)->
+            default_value(defaults.diskBandwidth),
+         "Storage bandwidth in MB/s of backups for which the snapshot "
+         "doesn't give one.")
+        ("networkBandwidth",
+         ProgramOptions::value<double>(&defaults.networkBandwidth)->
+            default_value(defaults.networkBandwidth),
+         "Network bandwidth in MB/s of servers for which the snapshot "
+         "doesn't give one.")
+        ("replayBandwidth",
+         ProgramOptions::value<double>(&defaults.replayBandwidth)->
+            default_value(defaults.replayBandwidth),
+         "Rate in MB/s at which masters for which the snapshot doesn't "
+         "give one replay recovery segments.");
+
+    OptionParser optionParser(simulatorOptions, argc, argv);
+
+    std::ifstream in(snapshotFile);
+    if (!in) {
+        fprintf(stderr, "ERROR: couldn't open %s\n", snapshotFile.c_str());
+        exit(1);
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+    ProtoBuf::RecoverySimulation snapshot;
+    if (!google::protobuf::TextFormat::ParseFromString(text.str(),
+                                                       &snapshot)) {
+        fprintf(stderr, "ERROR: couldn't parse %s\n", snapshotFile.c_str());
+        exit(1);
+    }
+
+    RecoverySimulator simulator(snapshot);
+    vector<RecoverySimulator::Plan> plans;
+    foreach (uint64_t maxBytes, partitionMaxBytes) {
+        foreach (uint64_t maxRecords, partitionMaxRecords) {
+            foreach (uint32_t masters, recoveryMasters) {
+                RecoverySimulator::Options options = defaults;
+                options.partitionMaxBytes = maxBytes;
+                options.partitionMaxRecords = maxRecords;
+                options.recoveryMasters = masters;
+                plans.push_back(simulator.simulate(options));
+            }
+        }
+    }
+
+    std::stable_sort(plans.begin(), plans.end(),
+            [](const RecoverySimulator::Plan& a,
+               const RecoverySimulator::Plan& b) {
+                return a.seconds > b.seconds;
+            });
+    foreach (const RecoverySimulator::Plan& plan, plans)
+        printf("%s", plan.toString().c_str());
+    return 0;
+} catch (RAMCloud::Exception& e) {
+    fprintf(stderr, "RAMCloud exception: %s\n", e.str().c_str());
+    return 1;
+}
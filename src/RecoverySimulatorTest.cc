@@ -0,0 +1,151 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "TestUtil.h"
+#include "RecoverySimulator.h"
+
+namespace RAMCloud {
+
+struct RecoverySimulatorTest : public ::testing::Test {
+    static const uint64_t MB = 1024 * 1024;
+    ProtoBuf::RecoverySimulation snapshot;
+    RecoverySimulator::Options options;
+
+    RecoverySimulatorTest()
+        : snapshot()
+        , options()
+    {
+        Logger::get().setLogLevels(SILENT_LOG_LEVEL);
+
+        // One table of 100 MB and 100 records, spread evenly over 100 key
+        // hashes.
+        auto& tablet = *snapshot.add_tablet();
+        tablet.set_table_id(1);
+        tablet.set_start_key_hash(0);
+        tablet.set_end_key_hash(99);
+        auto& stats = *snapshot.add_table_stats();
+        stats.set_table_id(1);
+        stats.set_bytes_per_key_hash(MB);
+        stats.set_records_per_key_hash(1);
+        snapshot.set_segment_size(MB);
+
+        auto& master = *snapshot.add_master();
+        master.set_server_id(10);
+        master.set_replay_bandwidth(100);
+        master.set_network_bandwidth(1000);
+
+        auto& backup1 = *snapshot.add_backup();
+        backup1.set_server_id(20);
+        backup1.set_primary_replicas(10);
+        backup1.set_disk_bandwidth(100);
+        auto& backup2 = *snapshot.add_backup();
+        backup2.set_server_id(21);
+        backup2.set_primary_replicas(4);
+        backup2.set_disk_bandwidth(100);
+
+        options.partitionMaxBytes = 50 * MB;
+    }
+
+  private:
+    DISALLOW_COPY_AND_ASSIGN(RecoverySimulatorTest);
+};
+
+TEST_F(RecoverySimulatorTest, simulate_partitions) {
+    RecoverySimulator simulator(snapshot);
+    RecoverySimulator::Plan plan = simulator.simulate(options);
+    EXPECT_EQ((vector<uint64_t>{50 * MB, 50 * MB}), plan.partitionBytes);
+    EXPECT_EQ((vector<uint64_t>{50, 50}), plan.partitionRecords);
+    EXPECT_DOUBLE_EQ(1.0, plan.partitionByteImbalance);
+
+    // Each simulation starts over from the snapshot's tablets.
+    options.partitionMaxBytes = 30 * MB;
+    plan = simulator.simulate(options);
+    EXPECT_EQ((vector<uint64_t>{25 * MB, 25 * MB, 25 * MB, 25 * MB}),
+              plan.partitionBytes);
+    // With one recovery master, each wave recovers one partition and
+    // repartitions the rest.
+    EXPECT_EQ(4lu, plan.waves.size());
+    options.partitionMaxBytes = 200 * MB;
+    plan = simulator.simulate(options);
+    EXPECT_EQ((vector<uint64_t>{100 * MB}), plan.partitionBytes);
+}
+
+TEST_F(RecoverySimulatorTest, simulate_waves) {
+    // One recovery master for two partitions: two waves, each limited by
+    // the backup that has to read the most and write its share of
+    // 3 * 50 MB of new replicas, with the coordinator's reschedule delay
+    // between them.
+    RecoverySimulator simulator(snapshot);
+    RecoverySimulator::Plan plan = simulator.simulate(options);
+    EXPECT_EQ(1u, plan.numMasters);
+    ASSERT_EQ(2lu, plan.waves.size());
+    EXPECT_EQ(0u, plan.waves[0].firstPartition);
+    EXPECT_EQ(1u, plan.waves[0].numPartitions);
+    EXPECT_DOUBLE_EQ(0.85, plan.waves[0].seconds);
+    EXPECT_EQ("backup 20 (disk)", plan.waves[0].bottleneck);
+    EXPECT_EQ(1u, plan.waves[1].firstPartition);
+    EXPECT_DOUBLE_EQ(1.7 + 2.0, plan.seconds);
+    EXPECT_DOUBLE_EQ(10.0 / 7, plan.backupImbalance);
+}
+
+TEST_F(RecoverySimulatorTest, simulate_masterBottleneck) {
+    snapshot.set_num_replicas(1);
+    RecoverySimulator simulator(snapshot);
+    RecoverySimulator::Plan plan = simulator.simulate(options);
+    ASSERT_EQ(2lu, plan.waves.size());
+    EXPECT_DOUBLE_EQ(0.5, plan.waves[0].seconds);
+    EXPECT_EQ("master 10 (replay)", plan.waves[0].bottleneck);
+    EXPECT_DOUBLE_EQ(1.0 + 2.0, plan.seconds);
+}
+
+TEST_F(RecoverySimulatorTest, simulate_recoveryMasters) {
+    snapshot.set_num_replicas(1);
+    options.recoveryMasters = 2;
+    RecoverySimulator simulator(snapshot);
+    RecoverySimulator::Plan plan = simulator.simulate(options);
+    EXPECT_EQ(2u, plan.numMasters);
+    ASSERT_EQ(1lu, plan.waves.size());
+    EXPECT_EQ(2u, plan.waves[0].numPartitions);
+    EXPECT_DOUBLE_EQ(0.6, plan.seconds);
+    EXPECT_EQ("backup 20 (disk)", plan.waves[0].bottleneck);
+
+    snapshot.clear_master();
+    options.recoveryMasters = 0;
+    RecoverySimulator noMasters(snapshot);
+    EXPECT_THROW(noMasters.simulate(options), FatalError);
+}
+
+TEST_F(RecoverySimulatorTest, imbalance) {
+    EXPECT_DOUBLE_EQ(1.0, RecoverySimulator::imbalance({}));
+    EXPECT_DOUBLE_EQ(1.0, RecoverySimulator::imbalance({0, 0}));
+    EXPECT_DOUBLE_EQ(1.0, RecoverySimulator::imbalance({3, 3, 3}));
+    EXPECT_DOUBLE_EQ(2.0, RecoverySimulator::imbalance({1, 2, 3, 6}));
+}
+
+TEST_F(RecoverySimulatorTest, Plan_toString) {
+    RecoverySimulator simulator(snapshot);
+    EXPECT_EQ("partitionMaxBytes 52428800, partitionMaxRecords 2000000, "
+              "1 recovery masters: 2 partitions in 2 waves, predicted "
+              "recovery time 3.700 s\n"
+              "  wave of partitions 0-0: 0.850 s, bottleneck backup 20 "
+              "(disk)\n"
+              "  wave of partitions 1-1: 0.850 s, bottleneck backup 20 "
+              "(disk)\n"
+              "  imbalance (max/mean): partition bytes 1.00, partition "
+              "records 1.00, backup primary replicas 1.43\n",
+              simulator.simulate(options).toString());
+}
+
+} // namespace RAMCloud
@@ -818,6 +818,53 @@ TEST_F(RecoveryTest, startBackups_secondariesEarlyInSomeList) {
     EXPECT_EQ(91U, recovery.replicaMap.at(5).segmentId);
 }
 
+TEST_F(RecoveryTest, startBackups_severalOpenHeads) {
+    // A log with three heads (89, 90 and 91): every head's digest names all
+    // of them, and recovery must replay the synced data in each.
+    struct Cb : public BackupStartTask::TestingCallback {
+        int callCount;
+        Cb() : callCount() {}
+        void backupStartTaskSend(StartReadingDataRpc::Result& result)
+        {
+            if (callCount == 0) {
+                result.replicas.push_back(Replica{88lu, 100u, true});
+                result.replicas.push_back(Replica{89lu, 100u, false});
+                populateLogDigest(result, 89, {88, 89, 90, 91});
+            } else if (callCount == 1) {
+                result.replicas.push_back(Replica{90lu, 100u, false});
+                populateLogDigest(result, 90, {88, 89, 90, 91});
+            } else if (callCount == 2) {
+                result.replicas.push_back(Replica{91lu, 100u, false});
+                populateLogDigest(result, 91, {88, 89, 90, 91});
+                // Not yet in any digest, so past the end of the log.
+                result.replicas.push_back(Replica{92lu, 100u, false});
+            }
+            result.primaryReplicaCount =
+                downCast<uint32_t>(result.replicas.size());
+            callCount++;
+        }
+    } callback;
+    Lock lock(mutex);     // To trick TableManager internal calls.
+    addServersToTracker(3, {WireFormat::BACKUP_SERVICE});
+    tableManager.testCreateTable("t", 123);
+    tableManager.testAddTablet({123, 10, 19, {99, 0}, Tablet::RECOVERING, {}});
+    Recovery recovery(&context, taskQueue, &tableManager, &tracker, NULL,
+                      ServerId(99), recoveryInfo);
+    recovery.testingBackupStartTaskSendCallback = &callback;
+    TestLog::Enable _("startBackups");
+    recovery.startBackups();
+    EXPECT_TRUE(TestUtil::contains(TestLog::get(),
+        "Segment 89 is the head of the log | "
+        "startBackups: Log has several heads; segment 91 is the last"));
+    EXPECT_EQ((vector<WireFormat::Recover::Replica>{
+                    { 1, 88 },
+                    { 2, 90 },
+                    { 3, 91 },
+                    { 1, 89 },
+               }),
+              recovery.replicaMap);
+}
+
 namespace {
 bool startBackupsFilter(string s) {
     return s == "startBackups";
@@ -867,6 +914,139 @@ TEST_F(RecoveryTest, startBackups_someReplicasMissing) {
             "Will retry recovery later.", TestLog::get());
 }
 
+TEST_F(RecoveryTest, startBackups_restartLocally) {
+    struct Cb : public BackupStartTask::TestingCallback {
+        int callCount;
+        Cb() : callCount() {}
+        void backupStartTaskSend(StartReadingDataRpc::Result& result)
+        {
+            result.replicas.push_back(Replica{88lu, 100lu, false});
+            result.replicas.push_back(Replica{89lu, 100lu, true});
+            populateLogDigest(result, 89, {88, 89});
+            result.primaryReplicaCount = 2;
+            callCount++;
+        }
+    } callback;
+    Lock lock(mutex);     // To trick TableManager internal calls.
+    addServersToTracker(3, {WireFormat::MASTER_SERVICE,
+                            WireFormat::BACKUP_SERVICE});
+    tableManager.testCreateTable("t", 123);
+    tableManager.testAddTablet({123,  0,  9, {99, 0}, Tablet::RECOVERING, {}});
+    tableManager.testAddTablet({123, 10, 19, {99, 0}, Tablet::RECOVERING, {}});
+    Recovery recovery(&context, taskQueue, &tableManager, &tracker, NULL,
+                      ServerId(99), recoveryInfo, "mock:host=server2",
+                      Cycles::rdtsc() + Cycles::fromSeconds(100));
+    recovery.testingBackupStartTaskSendCallback = &callback;
+    recovery.startBackups();
+    EXPECT_EQ(1, callback.callCount);
+    EXPECT_EQ(ServerId(2, 0), recovery.restartedServerId);
+    EXPECT_EQ((vector<WireFormat::Recover::Replica>{
+                    { 2, 88 },
+                    { 2, 89 },
+               }),
+              recovery.replicaMap);
+    EXPECT_EQ(1u, recovery.numPartitions);
+    ASSERT_EQ(2, recovery.dataToRecover.tablet_size());
+    EXPECT_EQ(0u, recovery.dataToRecover.tablet(0).user_data());
+    EXPECT_EQ(0u, recovery.dataToRecover.tablet(1).user_data());
+    EXPECT_EQ(Recovery::START_RECOVERY_MASTERS, recovery.status);
+}
+
+TEST_F(RecoveryTest, startBackups_restartLocally_notYetEnlisted) {
+    BackupStartTask::TestingCallback callback; // No-op callback.
+    Lock lock(mutex);     // To trick TableManager internal calls.
+    addServersToTracker(3, {WireFormat::MASTER_SERVICE,
+                            WireFormat::BACKUP_SERVICE});
+    tableManager.testCreateTable("t", 123);
+    tableManager.testAddTablet({123, 10, 19, {99, 0}, Tablet::RECOVERING, {}});
+    Recovery recovery(&context, taskQueue, &tableManager, &tracker, NULL,
+                      ServerId(99), recoveryInfo, "mock:host=server9",
+                      Cycles::rdtsc() + Cycles::fromSeconds(100));
+    recovery.testingBackupStartTaskSendCallback = &callback;
+    TestLog::Enable _(startBackupsFilter);
+    recovery.startBackups();
+    EXPECT_EQ(
+        "startBackups: Getting segment lists from backups and preparing "
+            "them for recovery | "
+        "startBackups: Waiting for server 99.0 to restart at "
+            "mock:host=server9", TestLog::get());
+    EXPECT_EQ("mock:host=server9", recovery.restartLocator);
+    EXPECT_EQ(Recovery::WAIT_FOR_RESTART, recovery.status);
+    EXPECT_FALSE(recovery.wasCompletelySuccessful());
+
+    // Nothing polls; the recovery waits for the server or the deadline.
+    EXPECT_FALSE(recovery.isScheduled());
+    ASSERT_TRUE(recovery.restartTimer);
+    EXPECT_TRUE(recovery.restartTimer->isRunning());
+
+    ServerDetails other;
+    other.serviceLocator = "mock:host=server8";
+    recovery.serverEnlisted(other);
+    EXPECT_FALSE(recovery.isScheduled());
+    ServerDetails restarted;
+    restarted.serviceLocator = "mock:host=server9";
+    recovery.serverEnlisted(restarted);
+    EXPECT_TRUE(recovery.isScheduled());
+    taskQueue.performTask();
+    recovery.restartTimer->handleTimerEvent();
+    EXPECT_TRUE(recovery.isScheduled());
+
+    // Trying again doesn't log again.
+    TestLog::reset();
+    taskQueue.performTask();
+    EXPECT_EQ(
+        "startBackups: Getting segment lists from backups and preparing "
+            "them for recovery", TestLog::get());
+    EXPECT_EQ(Recovery::WAIT_FOR_RESTART, recovery.status);
+    EXPECT_FALSE(recovery.isScheduled());
+}
+
+TEST_F(RecoveryTest, startBackups_restartLocally_timedOut) {
+    struct Cb : public BackupStartTask::TestingCallback {
+        int callCount;
+        Cb() : callCount() {}
+        void backupStartTaskSend(StartReadingDataRpc::Result& result)
+        {
+            callCount++;
+        }
+    } callback;
+    Lock lock(mutex);     // To trick TableManager internal calls.
+    addServersToTracker(3, {WireFormat::MASTER_SERVICE,
+                            WireFormat::BACKUP_SERVICE});
+    tableManager.testCreateTable("t", 123);
+    tableManager.testAddTablet({123, 10, 19, {99, 0}, Tablet::RECOVERING, {}});
+    Recovery recovery(&context, taskQueue, &tableManager, &tracker, NULL,
+                      ServerId(99), recoveryInfo, "mock:host=server9", 0);
+    recovery.testingBackupStartTaskSendCallback = &callback;
+    recovery.startBackups();
+    // Fell back to asking every backup.
+    EXPECT_EQ(3, callback.callCount);
+    EXPECT_EQ("", recovery.restartLocator);
+}
+
+TEST_F(RecoveryTest, startBackups_restartLocally_replicasMissing) {
+    struct Cb : public BackupStartTask::TestingCallback {
+        void backupStartTaskSend(StartReadingDataRpc::Result& result)
+        {
+            result.replicas.push_back(Replica{91lu, 100lu, true});
+            populateLogDigest(result, 91, {90, 91});
+        }
+    } callback;
+    Lock lock(mutex);     // To trick TableManager internal calls.
+    addServersToTracker(3, {WireFormat::MASTER_SERVICE,
+                            WireFormat::BACKUP_SERVICE});
+    tableManager.testCreateTable("t", 123);
+    tableManager.testAddTablet({123, 10, 19, {99, 0}, Tablet::RECOVERING, {}});
+    Recovery recovery(&context, taskQueue, &tableManager, &tracker, NULL,
+                      ServerId(99), recoveryInfo, "mock:host=server1",
+                      Cycles::rdtsc() + Cycles::fromSeconds(100));
+    recovery.testingBackupStartTaskSendCallback = &callback;
+    recovery.startBackups();
+    // The next attempt will recover from all backups.
+    EXPECT_EQ("", recovery.restartLocator);
+    EXPECT_EQ(Recovery::ALL_RECOVERY_MASTERS_FINISHED, recovery.status);
+}
+
 TEST_F(RecoveryTest, BackupStartTask_filterOutInvalidReplicas) {
     recoveryInfo.set_min_open_segment_id(10);
     recoveryInfo.set_min_open_segment_epoch(1);
@@ -932,6 +1112,33 @@ TEST_F(RecoveryTest, verifyLogComplete) {
     EXPECT_TRUE(verifyLogComplete(tasks, 1, digest));
 }
 
+TEST_F(RecoveryTest, verifyLogComplete_fragments) {
+    LogDigest digest;
+    digest.addSegmentId(10);
+    digest.addSegmentId(11);
+
+    Tub<BackupStartTask> tasks[2];
+    Recovery recovery(&context, taskQueue, &tableManager, &tracker, NULL,
+            {1, 0}, recoveryInfo);
+    tasks[0].construct(&recovery, ServerId(2, 0));
+    tasks[1].construct(&recovery, ServerId(3, 0));
+
+    // Segment 11 is stored as a 3+2 code; fragment 4 is found twice.
+    tasks[0]->result.replicas = {{10, 0, true}, {11, 0, true, 3, 2, 0},
+                                 {11, 0, true, 3, 2, 4}};
+    tasks[1]->result.replicas = {{11, 0, true, 3, 2, 4}};
+    TestLog::Enable _;
+    EXPECT_FALSE(verifyLogComplete(tasks, 2, digest));
+    EXPECT_EQ(
+        "verifyLogComplete: Segment 11 listed in the log digest but "
+            "not found among available backups | "
+        "verifyLogComplete: 1 segments in the digest but not available "
+            "from backups", TestLog::get());
+
+    tasks[1]->result.replicas.push_back({11, 0, true, 3, 2, 2});
+    EXPECT_TRUE(verifyLogComplete(tasks, 2, digest));
+}
+
 TEST_F(RecoveryTest, findLogDigest) {
     recoveryInfo.set_min_open_segment_id(10);
     recoveryInfo.set_min_open_segment_epoch(1);
@@ -1040,6 +1247,26 @@ TEST_F(RecoveryTest, buildReplicaMap_badReplicas) {
     EXPECT_EQ((vector<WireFormat::Recover::Replica>()), replicaMap);
 }
 
+TEST_F(RecoveryTest, buildReplicaMap_fragments) {
+    Tub<BackupStartTask> tasks[1];
+    Recovery recovery(&context, taskQueue, &tableManager, &tracker, NULL,
+                      {1, 0}, recoveryInfo);
+    tasks[0].construct(&recovery, ServerId(2, 0));
+    auto* result = &tasks[0]->result;
+    result->replicas.push_back(Replica{88lu, 100u, true});
+    result->replicas.push_back(Replica{89lu, 100u, true, 2, 1, 1});
+    result->primaryReplicaCount = 1;
+
+    addServersToTracker(2, {WireFormat::BACKUP_SERVICE});
+
+    auto replicaMap = buildReplicaMap(tasks, 1, &tracker, 91);
+    EXPECT_EQ((vector<WireFormat::Recover::Replica> {
+                    { 2, 88 },
+                    { 2, 89, true },
+               }),
+              replicaMap);
+}
+
 TEST_F(RecoveryTest, startRecoveryMasters) {
     MockRandom _(1);
     struct Cb : public MasterStartTaskTestingCallback {
@@ -1227,6 +1454,38 @@ TEST_F(RecoveryTest, startRecoveryMasters_allFailDuringRecoverRpc) {
     EXPECT_FALSE(tracker[ServerId(2, 0)]);
 }
 
+TEST_F(RecoveryTest, startRecoveryMasters_restartLocally) {
+    struct Cb : public MasterStartTaskTestingCallback {
+        void masterStartTaskSend(uint64_t recoveryId,
+            ServerId crashedServerId, uint32_t partitionId,
+            const ProtoBuf::RecoveryPartition& recoveryPartition,
+            const WireFormat::Recover::Replica replicaMap[],
+            size_t replicaMapSize)
+        {
+            EXPECT_EQ(2, recoveryPartition.tablet_size());
+        }
+    } callback;
+    Lock lock(mutex);     // To trick TableManager internal calls.
+    addServersToTracker(3, {WireFormat::MASTER_SERVICE,
+                            WireFormat::BACKUP_SERVICE});
+    tableManager.testCreateTable("t", 123);
+    tableManager.testAddTablet({123,  0,  9, {99, 0}, Tablet::RECOVERING, {}});
+    tableManager.testAddTablet({123, 10, 19, {99, 0}, Tablet::RECOVERING, {}});
+    Recovery recovery(&context, taskQueue, &tableManager, &tracker, NULL,
+                      {99, 0}, recoveryInfo, "mock:host=server3", ~0lu);
+    recovery.restartedServerId = {3, 0};
+    recovery.partitionTablets(
+                tableManager.markAllTabletsRecovering({99, 0}), NULL);
+    recovery.testingMasterStartTaskSendCallback = &callback;
+    recovery.startRecoveryMasters();
+
+    EXPECT_EQ(&recovery, tracker[ServerId(3, 0)]);
+    EXPECT_TRUE(tracker[ServerId(1, 0)] == NULL);
+    EXPECT_TRUE(tracker[ServerId(2, 0)] == NULL);
+    EXPECT_EQ(0u, recovery.unsuccessfulRecoveryMasters);
+    EXPECT_EQ(Recovery::WAIT_FOR_RECOVERY_MASTERS, recovery.status);
+}
+
 TEST_F(RecoveryTest, startRecoveryMasters_indexlet) {
     Lock lock(mutex);     // To trick TableManager internal calls.
     addServersToTracker(4, {WireFormat::MASTER_SERVICE});
@@ -1255,11 +1514,15 @@ TEST_F(RecoveryTest, recoveryMasterFinished) {
     tracker[ServerId(3, 0)] = &recovery;
     recovery.numPartitions = 2;
     recovery.status = Recovery::WAIT_FOR_RECOVERY_MASTERS;
+    recovery.firstTabletTicks.construct(
+            &metrics->coordinator.recoveryFirstTabletTicks);
 
     recovery.recoveryMasterFinished({2, 0}, true);
     EXPECT_EQ(1u, recovery.successfulRecoveryMasters);
     EXPECT_EQ(0u, recovery.unsuccessfulRecoveryMasters);
     EXPECT_EQ(Recovery::WAIT_FOR_RECOVERY_MASTERS, recovery.status);
+    // The first partition's tablets are available again.
+    EXPECT_FALSE(recovery.firstTabletTicks);
 
     recovery.recoveryMasterFinished({2, 0}, true);
     EXPECT_EQ(1u, recovery.successfulRecoveryMasters);
@@ -1272,6 +1535,22 @@ TEST_F(RecoveryTest, recoveryMasterFinished) {
     EXPECT_EQ(Recovery::ALL_RECOVERY_MASTERS_FINISHED, recovery.status);
 }
 
+TEST_F(RecoveryTest, recoveryMasterFinished_restartLocallyFailed) {
+    addServersToTracker(3, {WireFormat::MASTER_SERVICE});
+    Recovery recovery(&context, taskQueue, &tableManager, &tracker, NULL,
+                      {99, 0}, recoveryInfo, "mock:host=server3",
+                      Cycles::rdtsc() + Cycles::fromSeconds(100));
+    tracker[ServerId(3, 0)] = &recovery;
+    recovery.restartedServerId = {3, 0};
+    recovery.numPartitions = 1;
+    recovery.status = Recovery::WAIT_FOR_RECOVERY_MASTERS;
+
+    recovery.recoveryMasterFinished({3, 0}, false);
+    EXPECT_EQ(Recovery::ALL_RECOVERY_MASTERS_FINISHED, recovery.status);
+    // The follow up recovery will use every backup.
+    EXPECT_EQ("", recovery.restartLocator);
+}
+
 TEST_F(RecoveryTest, broadcastRecoveryComplete) {
     addServersToTracker(3, {WireFormat::BACKUP_SERVICE});
     struct Cb : public BackupEndTaskTestingCallback {
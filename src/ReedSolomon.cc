@@ -0,0 +1,297 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "ReedSolomon.h"
+
+namespace RAMCloud {
+
+namespace {
+
+/**
+ * Arithmetic tables for GF(2^8) with the polynomial x^8+x^4+x^3+x^2+1
+ * (0x11d), for which 2 generates the multiplicative group. Built once, on
+ * first use.
+ */
+struct GaloisField {
+    GaloisField()
+        : exp()
+        , log()
+        , product()
+    {
+        uint32_t x = 1;
+        for (uint32_t i = 0; i < 255; i++) {
+            exp[i] = downCast<uint8_t>(x);
+            exp[i + 255] = downCast<uint8_t>(x);
+            log[x] = downCast<uint8_t>(i);
+            x <<= 1;
+            if (x & 0x100)
+                x ^= 0x11d;
+        }
+        for (uint32_t a = 1; a < 256; a++) {
+            for (uint32_t b = 1; b < 256; b++)
+                product[a][b] = exp[log[a] + log[b]];
+        }
+    }
+
+    uint8_t
+    multiply(uint8_t a, uint8_t b) const
+    {
+        return product[a][b];
+    }
+
+    uint8_t
+    inverse(uint8_t a) const
+    {
+        assert(a != 0);
+        return exp[255 - log[a]];
+    }
+
+    /// Powers of the generator; doubled up so that sums of two logs
+    /// never need reducing.
+    uint8_t exp[510];
+
+    /// Discrete logarithms; log[0] is unused.
+    uint8_t log[256];
+
+    /// Full multiplication table; product[c] maps x to c * x, which lets
+    /// multiplyAdd() scale a whole fragment with one lookup per byte.
+    uint8_t product[256][256];
+};
+
+const GaloisField&
+field()
+{
+    static const GaloisField galoisField;
+    return galoisField;
+}
+
+/**
+ * Add \a coefficient times \a length bytes of \a source into \a destination
+ * (addition in GF(2^8) being exclusive or).
+ */
+void
+multiplyAdd(uint8_t coefficient, const uint8_t* source, uint32_t length,
+            uint8_t* destination)
+{
+    if (coefficient == 0)
+        return;
+    if (coefficient == 1) {
+        for (uint32_t i = 0; i < length; i++)
+            destination[i] ^= source[i];
+        return;
+    }
+    const uint8_t* row = field().product[coefficient];
+    for (uint32_t i = 0; i < length; i++)
+        destination[i] ^= row[source[i]];
+}
+
+/**
+ * encode() works through the fragments this many bytes at a time, so the
+ * slices of all of the parity fragments being accumulated stay in cache
+ * while each data fragment is folded into them.
+ */
+enum { ENCODE_BLOCK_SIZE = 16 * 1024 };
+
+} // anonymous namespace
+
+/**
+ * Construct a codec for a particular shape of erasure code.
+ *
+ * \param dataFragments
+ *      Number of fragments each segment's contents are split into; any
+ *      this many fragments suffice to rebuild the segment.
+ * \param parityFragments
+ *      Number of redundant fragments computed from the data fragments; up
+ *      to this many fragments of each segment can be lost.
+ * \throw FatalError
+ *      If there are no data fragments or too many fragments in total.
+ */
+ReedSolomon::ReedSolomon(uint32_t dataFragments, uint32_t parityFragments)
+    : dataFragments(dataFragments)
+    , parityFragments(parityFragments)
+    , parityMatrix(dataFragments * parityFragments)
+{
+    if (dataFragments == 0 ||
+            dataFragments + parityFragments > MAX_FRAGMENTS) {
+        throw FatalError(HERE, format("Invalid Reed-Solomon code: %u data "
+                "fragments and %u parity fragments", dataFragments,
+                parityFragments));
+    }
+
+    // Cauchy matrix 1 / (x_j + y_i) with x_j = dataFragments + j and
+    // y_i = i; all of the x's and y's are distinct, so no sum is zero.
+    for (uint32_t j = 0; j < parityFragments; j++) {
+        for (uint32_t i = 0; i < dataFragments; i++) {
+            parityMatrix[j * dataFragments + i] = field().inverse(
+                    downCast<uint8_t>((dataFragments + j) ^ i));
+        }
+    }
+}
+
+/**
+ * Return the length of each fragment of a segment.
+ *
+ * \param length
+ *      Number of bytes of data in the segment.
+ */
+uint32_t
+ReedSolomon::getFragmentLength(uint32_t length) const
+{
+    return (length + dataFragments - 1) / dataFragments;
+}
+
+/**
+ * Compute the parity fragments of a segment.
+ *
+ * \param data
+ *      Contents of the segment; its data fragments are consecutive ranges
+ *      of getFragmentLength(\a length) bytes.
+ * \param length
+ *      Number of bytes at \a data.
+ * \param[out] parity
+ *      Space for parityFragments * getFragmentLength(\a length) bytes, where
+ *      the parity fragments are placed one after the other.
+ */
+void
+ReedSolomon::encode(const void* data, uint32_t length, void* parity) const
+{
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    uint8_t* out = static_cast<uint8_t*>(parity);
+    uint32_t fragmentLength = getFragmentLength(length);
+    memset(out, 0, size_t(parityFragments) * fragmentLength);
+
+    for (uint32_t block = 0; block < fragmentLength;
+            block += ENCODE_BLOCK_SIZE) {
+        for (uint32_t i = 0; i < dataFragments; i++) {
+            // The tail of the last data fragment is zero padding, which
+            // contributes nothing to the parity.
+            uint64_t start = uint64_t(i) * fragmentLength + block;
+            if (start >= length)
+                break;
+            uint32_t blockLength = downCast<uint32_t>(std::min(
+                    {uint64_t(ENCODE_BLOCK_SIZE),
+                     uint64_t(fragmentLength - block),
+                     length - start}));
+            for (uint32_t j = 0; j < parityFragments; j++) {
+                multiplyAdd(parityMatrix[j * dataFragments + i],
+                            in + start, blockLength,
+                            out + uint64_t(j) * fragmentLength + block);
+            }
+        }
+    }
+}
+
+/**
+ * Rebuild a segment from any dataFragments of its fragments.
+ *
+ * \param length
+ *      Number of bytes of data in the segment.
+ * \param fragmentIndexes
+ *      Array of dataFragments distinct fragment numbers, saying which
+ *      fragment each entry of \a fragments is.
+ * \param fragments
+ *      Array of dataFragments pointers to the contents of fragments, each
+ *      getFragmentLength(\a length) bytes long.
+ * \param[out] data
+ *      Space for \a length bytes, where the segment is rebuilt.
+ * \throw FatalError
+ *      If \a fragmentIndexes contains an invalid or repeated index.
+ */
+void
+ReedSolomon::decode(uint32_t length,
+                    const uint32_t fragmentIndexes[],
+                    const void* const fragments[],
+                    void* data) const
+{
+    const uint32_t n = dataFragments;
+    uint32_t fragmentLength = getFragmentLength(length);
+    uint8_t* out = static_cast<uint8_t*>(data);
+
+    // Each fragment is a known combination of the data fragments: invert
+    // the matrix formed by the rows of the generator for the fragments at
+    // hand to express the data fragments in terms of them.
+    std::vector<uint8_t> matrix(n * n);
+    std::vector<uint8_t> inverse(n * n);
+    std::vector<int> haveDataFragment(n, -1);
+    for (uint32_t r = 0; r < n; r++) {
+        uint32_t index = fragmentIndexes[r];
+        if (index >= n + parityFragments) {
+            throw FatalError(HERE, format("Fragment index %u out of range",
+                    index));
+        }
+        if (index < n) {
+            if (haveDataFragment[index] >= 0) {
+                throw FatalError(HERE, format("Fragment %u given twice",
+                        index));
+            }
+            haveDataFragment[index] = downCast<int>(r);
+            matrix[r * n + index] = 1;
+        } else {
+            memcpy(&matrix[r * n], &parityMatrix[(index - n) * n], n);
+        }
+        inverse[r * n + r] = 1;
+    }
+
+    // Gauss-Jordan elimination.
+    for (uint32_t c = 0; c < n; c++) {
+        uint32_t pivot = c;
+        while (pivot < n && matrix[pivot * n + c] == 0)
+            pivot++;
+        if (pivot == n)
+            throw FatalError(HERE, "Fragment given twice");
+        if (pivot != c) {
+            std::swap_ranges(&matrix[pivot * n], &matrix[pivot * n] + n,
+                             &matrix[c * n]);
+            std::swap_ranges(&inverse[pivot * n], &inverse[pivot * n] + n,
+                             &inverse[c * n]);
+        }
+        uint8_t scale = field().inverse(matrix[c * n + c]);
+        for (uint32_t k = 0; k < n; k++) {
+            matrix[c * n + k] = field().multiply(matrix[c * n + k], scale);
+            inverse[c * n + k] = field().multiply(inverse[c * n + k], scale);
+        }
+        for (uint32_t r = 0; r < n; r++) {
+            uint8_t factor = matrix[r * n + c];
+            if (r == c || factor == 0)
+                continue;
+            for (uint32_t k = 0; k < n; k++) {
+                matrix[r * n + k] ^= field().multiply(factor,
+                                                      matrix[c * n + k]);
+                inverse[r * n + k] ^= field().multiply(factor,
+                                                       inverse[c * n + k]);
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t start = uint64_t(i) * fragmentLength;
+        if (start >= length)
+            break;
+        uint32_t dataLength = downCast<uint32_t>(
+                std::min(uint64_t(fragmentLength), length - start));
+        if (haveDataFragment[i] >= 0) {
+            memcpy(out + start, fragments[haveDataFragment[i]], dataLength);
+            continue;
+        }
+        memset(out + start, 0, dataLength);
+        for (uint32_t r = 0; r < n; r++) {
+            multiplyAdd(inverse[i * n + r],
+                        static_cast<const uint8_t*>(fragments[r]),
+                        dataLength, out + start);
+        }
+    }
+}
+
+} // namespace RAMCloud
@@ -0,0 +1,74 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef RAMCLOUD_REEDSOLOMON_H
+#define RAMCLOUD_REEDSOLOMON_H
+
+#include "Common.h"
+
+namespace RAMCloud {
+
+/**
+ * A systematic Reed-Solomon erasure code over GF(2^8), used to store closed
+ * segments on backups as dataFragments + parityFragments fragments instead
+ * of as full replicas (see ReplicatedSegment).
+ *
+ * A segment of length L is cut into dataFragments data fragments of
+ * getFragmentLength(L) bytes each; the data fragments are simply consecutive
+ * ranges of the segment (the last one is implicitly padded with zeroes).
+ * encode() computes parityFragments parity fragments of the same length.
+ * The coding matrix below the identity is a Cauchy matrix, so every square
+ * submatrix of the full generator is invertible: the segment can be rebuilt
+ * by decode() from ANY dataFragments of the fragments.
+ *
+ * Fragments are numbered 0 to dataFragments - 1 for the data fragments, and
+ * dataFragments onwards for the parity fragments. Instances are immutable
+ * after construction and safe to share among threads.
+ */
+class ReedSolomon {
+  PUBLIC:
+    ReedSolomon(uint32_t dataFragments, uint32_t parityFragments);
+
+    uint32_t getFragmentLength(uint32_t length) const;
+    void encode(const void* data, uint32_t length, void* parity) const;
+    void decode(uint32_t length,
+                const uint32_t fragmentIndexes[],
+                const void* const fragments[],
+                void* data) const;
+
+    /// Most fragments (data and parity) a segment may be split into; bounded
+    /// by the number of distinct elements in GF(2^8).
+    enum { MAX_FRAGMENTS = 255 };
+
+    /// Number of data fragments; any this many fragments rebuild a segment.
+    const uint32_t dataFragments;
+
+    /// Number of parity fragments; this many fragments may be lost.
+    const uint32_t parityFragments;
+
+  PRIVATE:
+    /**
+     * Coefficients used to compute the parity fragments: row j, column i
+     * (at index j * dataFragments + i) is the weight of data fragment i in
+     * parity fragment j.
+     */
+    std::vector<uint8_t> parityMatrix;
+
+    DISALLOW_COPY_AND_ASSIGN(ReedSolomon);
+};
+
+} // namespace RAMCloud
+
+#endif // RAMCLOUD_REEDSOLOMON_H
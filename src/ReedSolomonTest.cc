@@ -0,0 +1,142 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "TestUtil.h"
+
+#include "ReedSolomon.h"
+
+namespace RAMCloud {
+
+class ReedSolomonTest : public ::testing::Test {
+  public:
+    ReedSolomonTest()
+        : codec(4, 2)
+        , length(1001)
+        , data(length)
+        , fragmentLength(codec.getFragmentLength(length))
+        , fragments()
+    {
+        for (uint32_t i = 0; i < length; i++)
+            data[i] = static_cast<uint8_t>(i * 7 + 3);
+
+        // Data fragments, zero padded, then parity fragments.
+        fragments.resize(6 * fragmentLength);
+        memcpy(&fragments[0], &data[0], length);
+        codec.encode(&data[0], length, &fragments[4 * fragmentLength]);
+    }
+
+    const void*
+    fragment(uint32_t index)
+    {
+        return &fragments[index * fragmentLength];
+    }
+
+    ReedSolomon codec;
+    uint32_t length;
+    std::vector<uint8_t> data;
+    uint32_t fragmentLength;
+    std::vector<uint8_t> fragments;
+
+    DISALLOW_COPY_AND_ASSIGN(ReedSolomonTest);
+};
+
+TEST_F(ReedSolomonTest, constructor_invalid) {
+    EXPECT_THROW(ReedSolomon(0, 2), FatalError);
+    EXPECT_THROW(ReedSolomon(200, 56), FatalError);
+    ReedSolomon noParity(3, 0);
+    EXPECT_EQ(0u, noParity.parityFragments);
+}
+
+TEST_F(ReedSolomonTest, getFragmentLength) {
+    EXPECT_EQ(251u, fragmentLength);
+    EXPECT_EQ(0u, codec.getFragmentLength(0));
+    EXPECT_EQ(1u, codec.getFragmentLength(4));
+    EXPECT_EQ(2u, codec.getFragmentLength(5));
+}
+
+TEST_F(ReedSolomonTest, encode_singleDataFragment) {
+    // With one data fragment, each parity fragment alone rebuilds it.
+    ReedSolomon mirror(1, 2);
+    uint8_t parity[2 * 10];
+    mirror.encode(&data[0], 10, parity);
+    for (uint32_t j = 0; j < 2; j++) {
+        uint32_t index = 1 + j;
+        const void* piece = parity + 10 * j;
+        uint8_t rebuilt[10];
+        mirror.decode(10, &index, &piece, rebuilt);
+        EXPECT_EQ(0, memcmp(&data[0], rebuilt, 10));
+    }
+}
+
+TEST_F(ReedSolomonTest, encode_largerThanBlock) {
+    ReedSolomon big(3, 2);
+    uint32_t bigLength = 100 * 1024 + 1;
+    std::vector<uint8_t> bigData(bigLength);
+    for (uint32_t i = 0; i < bigLength; i++)
+        bigData[i] = static_cast<uint8_t>(i ^ (i >> 8));
+    uint32_t bigFragmentLength = big.getFragmentLength(bigLength);
+    std::vector<uint8_t> bigFragments(5 * bigFragmentLength);
+    memcpy(&bigFragments[0], &bigData[0], bigLength);
+    big.encode(&bigData[0], bigLength, &bigFragments[3 * bigFragmentLength]);
+
+    const uint32_t indexes[] = {4, 0, 3};
+    const void* pieces[] = {&bigFragments[4 * bigFragmentLength],
+                            &bigFragments[0],
+                            &bigFragments[3 * bigFragmentLength]};
+    std::vector<uint8_t> rebuilt(bigLength);
+    big.decode(bigLength, indexes, pieces, &rebuilt[0]);
+    EXPECT_TRUE(bigData == rebuilt);
+}
+
+TEST_F(ReedSolomonTest, decode_anyFourOfSix) {
+    uint32_t tried = 0;
+    for (uint32_t missing = 0; missing < 64; missing++) {
+        if (__builtin_popcount(missing) != 2)
+            continue;
+        uint32_t indexes[4];
+        const void* pieces[4];
+        uint32_t count = 0;
+        // Hand the fragments over in reverse order; decode() mustn't care.
+        for (int i = 5; i >= 0; i--) {
+            if (missing & (1 << i))
+                continue;
+            indexes[count] = i;
+            pieces[count] = fragment(i);
+            count++;
+        }
+        std::vector<uint8_t> rebuilt(length, 0xff);
+        codec.decode(length, indexes, pieces, &rebuilt[0]);
+        EXPECT_TRUE(data == rebuilt) << "missing mask " << missing;
+        tried++;
+    }
+    EXPECT_EQ(15u, tried);
+}
+
+TEST_F(ReedSolomonTest, decode_badIndexes) {
+    std::vector<uint8_t> rebuilt(length);
+    uint32_t outOfRange[] = {0, 1, 2, 6};
+    uint32_t repeated[] = {0, 1, 1, 4};
+    uint32_t repeatedParity[] = {0, 1, 5, 5};
+    const void* pieces[] = {fragment(0), fragment(1), fragment(2),
+                            fragment(4)};
+    EXPECT_THROW(codec.decode(length, outOfRange, pieces, &rebuilt[0]),
+                 FatalError);
+    EXPECT_THROW(codec.decode(length, repeated, pieces, &rebuilt[0]),
+                 FatalError);
+    EXPECT_THROW(codec.decode(length, repeatedParity, pieces, &rebuilt[0]),
+                 FatalError);
+}
+
+}  // namespace RAMCloud
@@ -41,18 +41,33 @@ namespace RAMCloud {
  *      replication.
  * \param allowLocalBackup
  *      Specifies whether to allow replication to the local backup.
+ * \param dataFragments
+ *      If nonzero, closed segments are stored as this many Reed-Solomon
+ *      data fragments plus \a parityFragments parity fragments, each on a
+ *      different backup, instead of as full replicas. Log heads are
+ *      replicated in full until they are closed and then converted.
+ * \param parityFragments
+ *      Number of parity fragments per erasure-coded segment.
+ * \param keepLocalReplica
+ *      If true, the primary replica of each segment is placed on the local
+ *      backup whenever it is up; see BackupSelector::selectPrimary().
  */
 ReplicaManager::ReplicaManager(Context* context,
                                const ServerId* masterId,
                                uint32_t numReplicas,
                                bool useMinCopysets,
-                               bool allowLocalBackup)
+                               bool allowLocalBackup,
+                               uint32_t dataFragments,
+                               uint32_t parityFragments,
+                               bool keepLocalReplica)
     : context(context)
     , numReplicas(numReplicas)
     , backupSelector()
     , dataMutex()
     , masterId(masterId)
-    , replicatedSegmentPool(ReplicatedSegment::sizeOf(numReplicas))
+    , codec()
+    , replicatedSegmentPool(ReplicatedSegment::sizeOf(
+            numReplicas + dataFragments + parityFragments))
     , replicatedSegmentList()
     , taskQueue()
     , writeRpcsInFlight(0)
@@ -67,11 +82,30 @@ ReplicaManager::ReplicaManager(Context* context,
         backupSelector.reset(new MinCopysetsBackupSelector(context, masterId,
                                                            numReplicas,
                                                            allowLocalBackup));
+        if (keepLocalReplica) {
+            // Copysets place all replicas of a segment in one fixed group.
+            LOG(WARNING, "Keeping a local replica is not supported with "
+                "MinCopysets; primary replicas will be placed remotely");
+        }
     } else {
         backupSelector.reset(new BackupSelector(context, masterId,
-                                                numReplicas, allowLocalBackup));
+                                                numReplicas, allowLocalBackup,
+                                                keepLocalReplica));
     }
     replicationEpoch.construct(context, &taskQueue, masterId);
+
+    if (dataFragments != 0) {
+        if (useMinCopysets) {
+            // Copysets place whole replicas in fixed groups; fragments
+            // don't fit that scheme.
+            LOG(WARNING, "Erasure coding is not supported with MinCopysets; "
+                "segments will be replicated in full");
+        } else {
+            codec.construct(dataFragments, parityFragments);
+            LOG(NOTICE, "Storing closed segments as %u data fragments and "
+                "%u parity fragments", dataFragments, parityFragments);
+        }
+    }
 }
 
 /**
@@ -272,6 +306,10 @@ ReplicaManager::isReplicaNeeded(ServerId backupServerId, uint64_t segmentId)
  *      The current log head. Used to set up ordering constraints on the
  *      operations issued to backups to ensure safety during crashes. Pass
  *      NULL if this is the first segment in the log.
+ * \param openWithOtherHeads
+ *      True if the segment is one of several log heads allocated together
+ *      (see SegmentManager::allocHeadSegments()). The log then orders
+ *      operations on the heads itself, so \a precedingSegment must be NULL.
  * \return
  *      Pointer to a ReplicatedSegment that is valid until
  *      ReplicatedSegment::free() is called on it or until the ReplicaManager
@@ -280,12 +318,15 @@ ReplicaManager::isReplicaNeeded(ServerId backupServerId, uint64_t segmentId)
 ReplicatedSegment*
 ReplicaManager::allocateHead(uint64_t segmentId,
                              const Segment* segment,
-                             ReplicatedSegment* precedingSegment)
+                             ReplicatedSegment* precedingSegment,
+                             bool openWithOtherHeads)
 {
     CycleCounter<RawMetric> _(&metrics->master.replicaManagerTicks);
+    assert(!openWithOtherHeads || precedingSegment == NULL);
     Lock lock(dataMutex);
     auto* replicatedSegment = allocateSegment(lock, segmentId,
                                               segment, true);
+    replicatedSegment->openWithOtherHeads = openWithOtherHeads;
 
     // Set up ordering constraints between this new segment and the prior
     // one in the log.
@@ -416,13 +457,28 @@ ReplicaManager::allocateSegment(const Lock& lock,
     auto* p = replicatedSegmentPool.malloc();
     if (p == NULL)
         DIE("Out of memory");
+    // Log heads are written incrementally while open, so they keep
+    // numReplicas full (interim) replicas until they have been closed and
+    // their fragments committed.
+    const ReedSolomon* segmentCodec = NULL;
+    uint32_t replicaCount = numReplicas;
+    uint32_t interimReplicas = 0;
+    if (codec && numReplicas != 0) {
+        segmentCodec = codec.get();
+        replicaCount = codec->dataFragments + codec->parityFragments;
+        if (isLogHead) {
+            interimReplicas = numReplicas;
+            replicaCount += interimReplicas;
+        }
+    }
     ReplicatedSegment* replicatedSegment =
         new(p) ReplicatedSegment(context, taskQueue, *backupSelector, *this,
                                  writeRpcsInFlight, freeRpcsInFlight,
                                  *replicationEpoch,
                                  dataMutex, segmentId, segment,
-                                 isLogHead, *masterId, numReplicas,
-                                 &replicationCounter);
+                                 isLogHead, *masterId, replicaCount,
+                                 &replicationCounter, 1024 * 1024,
+                                 segmentCodec, interimReplicas);
     replicatedSegmentList.push_back(*replicatedSegment);
 
     // ReplicatedSegment's constructor has scheduled the open.
@@ -68,13 +68,17 @@ class ReplicaManager
                    const ServerId* masterId,
                    uint32_t numReplicas,
                    bool useMinCopysets,
-                   bool allowLocalBackup);
+                   bool allowLocalBackup,
+                   uint32_t dataFragments = 0,
+                   uint32_t parityFragments = 0,
+                   bool keepLocalReplica = false);
     ~ReplicaManager();
 
     bool isIdle();
     bool isReplicaNeeded(ServerId backupServerId, uint64_t segmentId);
     ReplicatedSegment* allocateHead(uint64_t segmentId, const Segment* segment,
-                                    ReplicatedSegment* precedingSegment);
+                                    ReplicatedSegment* precedingSegment,
+                                    bool openWithOtherHeads = false);
         __attribute__((warn_unused_result));
     ReplicatedSegment* allocateNonHead(uint64_t segmentId,
                                        const Segment* segment);
@@ -138,6 +142,14 @@ class ReplicaManager
     /// Id of master that this will be managing replicas for.
     const ServerId* masterId;
 
+    /**
+     * If constructed, closed segments are stored as erasure-coded
+     * fragments using this code rather than as #numReplicas full replicas
+     * (log heads keep full replicas until they are closed). Shared by
+     * their ReplicatedSegments.
+     */
+    Tub<ReedSolomon> codec;
+
     /// Allows fast reuse of ReplicatedSegment allocations.
     boost::pool<> replicatedSegmentPool;
 
@@ -144,6 +144,30 @@ TEST_F(ReplicaManagerTest, allocateNonHead) {
     EXPECT_EQ(arrayLength(data), cluster.servers[1]->backup->bytesWritten);
 }
 
+TEST_F(ReplicaManagerTest, allocateNonHead_erasureCoded) {
+    MockRandom _(1);
+    mgr.destroy();
+    mgr.construct(&context, &serverId, 1, false, false, 1, 1);
+    char data[] = "Hello world!";
+
+    Segment headSeg(data, arrayLength(data));
+    auto head = mgr->allocateHead(87, &headSeg, NULL);
+    EXPECT_EQ(mgr->codec.get(), head->codec);
+    EXPECT_EQ(1u, head->interimReplicas);
+    EXPECT_EQ(3u, head->replicas.numElements);
+
+    Segment seg(data, arrayLength(data));
+    auto segment = mgr->allocateNonHead(88, &seg);
+    EXPECT_EQ(mgr->codec.get(), segment->codec);
+    EXPECT_EQ(0u, segment->interimReplicas);
+    EXPECT_EQ(2u, segment->replicas.numElements);
+
+    segment->close();
+    segment->sync(segment->queued.bytes);
+    EXPECT_TRUE(segment->getCommitted().close);
+    EXPECT_NE(segment->replicas[0].backupId, segment->replicas[1].backupId);
+}
+
 // This is a test that really belongs in SegmentTest.cc, but the setup
 // overhead is too high.
 TEST_F(ReplicaManagerTest, writeSegment) {
@@ -325,9 +349,9 @@ TEST_F(ReplicaManagerTest, endToEndBackupRecovery) {
     // if the wait occurs before the failure notification gets processed this
     // will be trivially true.
     log.append(LOG_ENTRY_TYPE_OBJ, buf, sizeof(buf));
-    log.head->replicatedSegment->schedule();
+    log.heads[0].segment->replicatedSegment->schedule();
     ASSERT_FALSE(mgr->isIdle());
-    ASSERT_EQ(2u, log.head->id);
+    ASSERT_EQ(2u, log.heads[0].segment->id);
 
     ServerConfig config = ServerConfig::forTesting();
     config.services = {WireFormat::BACKUP_SERVICE,
@@ -79,6 +79,16 @@ enum { OBEY_SAFETY_CONSTRAINTS = true };
  * \param maxBytesPerWriteRpc
  *      Maximum bytes to send in a single write rpc; can help latency of
  *      GetRecoveryDataRequests by unclogging backups a bit.
+ * \param codec
+ *      If non-NULL, the segment is stored as erasure-coded fragments, one
+ *      per replica slot, rather than as full replicas; \a numReplicas must
+ *      then be codec->dataFragments + codec->parityFragments (plus
+ *      \a interimReplicas). NULL means full replicas.
+ * \param interimReplicas
+ *      Only used with \a codec: number of full replicas to keep of the
+ *      segment until it has been closed and its fragments committed; needed
+ *      for log heads, which are written to incrementally while open. The
+ *      first this many of the \a numReplicas slots hold them.
  */
 ReplicatedSegment::ReplicatedSegment(Context* context,
                                      TaskQueue& taskQueue,
@@ -96,7 +106,9 @@ ReplicatedSegment::ReplicatedSegment(Context* context,
                                      uint32_t numReplicas,
                                      Tub<CycleCounter<RawMetric>>*
                                                              replicationCounter,
-                                     uint32_t maxBytesPerWriteRpc)
+                                     uint32_t maxBytesPerWriteRpc,
+                                     const ReedSolomon* codec,
+                                     uint32_t interimReplicas)
     : Task(taskQueue)
     , context(context)
     , backupSelector(backupSelector)
@@ -111,6 +123,12 @@ ReplicatedSegment::ReplicatedSegment(Context* context,
     , masterId(masterId)
     , segmentId(segmentId)
     , maxBytesPerWriteRpc(maxBytesPerWriteRpc)
+    , codec(codec)
+    , interimReplicas(interimReplicas)
+    , interimReplicasRetired(false)
+    , fragmentData()
+    , fragmentLength(0)
+    , segmentSwapped(false)
     , queued(true, 0, 0, false)
     , queuedCertificate()
     , openLen(0)
@@ -120,6 +138,7 @@ ReplicatedSegment::ReplicatedSegment(Context* context,
     , precedingSegmentCloseCommitted(true)
     , precedingSegmentOpenCommitted(true)
     , recoveringFromLostOpenReplicas(false)
+    , openWithOtherHeads(false)
     , listEntries()
     , replicationCounter(replicationCounter)
     , unopenedStartCycles(Cycles::rdtsc())
@@ -133,6 +152,8 @@ ReplicatedSegment::ReplicatedSegment(Context* context,
     }
     queued.bytes = openLen;
     queuedCertificate = openingWriteCertificate;
+    for (uint32_t i = 0; i < interimReplicas; ++i)
+        replicas[i].fullReplica = true;
     schedule(); // schedule to replicate the opening data
 }
 
@@ -302,7 +323,10 @@ ReplicatedSegment::handleBackupFailure(ServerId failedId, bool useMinCopysets)
         LOG(DEBUG, "Segment %lu recovering from lost replica which was on "
             "backup %s", segmentId, failedId.toString().c_str());
 
-        if (!replica.committed.close && !replica.replacesLostReplica) {
+        // Fragments are only ever committed whole and closed, so losing
+        // one part way through writing it can't leave a stale open replica.
+        if (!replica.committed.close && !replica.replacesLostReplica &&
+                !replicaIsFragment(replica)) {
             someOpenReplicaLost = true;
             LOG(NOTICE, "Lost replica(s) for segment %lu while open due to "
                 "crash of backup %s", segmentId, failedId.toString().c_str());
@@ -314,6 +338,8 @@ ReplicatedSegment::handleBackupFailure(ServerId failedId, bool useMinCopysets)
         if (replica.freeRpc)
             --freeRpcsInFlight;
         replica.reset(true);
+        if (codec && segmentSwapped)
+            replica.fullReplica = true;
         schedule();
         ++metrics->master.replicaRecoveries;
     }
@@ -323,6 +349,45 @@ ReplicatedSegment::handleBackupFailure(ServerId failedId, bool useMinCopysets)
     }
 }
 
+/**
+ * Return true if this segment is one of several open log heads and has lost
+ * an open replica. Recovering from that requires the log to close the
+ * segment (see #openWithOtherHeads), so until then sync() returns without
+ * waiting for any data to become durable, and the caller should roll the
+ * log's heads over.
+ */
+bool
+ReplicatedSegment::isAwaitingClose()
+{
+    Lock _(dataMutex);
+    return recoveringFromLostOpenReplicas && openWithOtherHeads &&
+        !queued.close;
+}
+
+/**
+ * Return true if this segment has ever lost an open replica. Once such a
+ * segment is closed, the replication epoch it updates invalidates the open
+ * replicas of every segment with a lower id (see #openWithOtherHeads).
+ */
+bool
+ReplicatedSegment::hasLostOpenReplica()
+{
+    Lock _(dataMutex);
+    return queued.epoch != 0;
+}
+
+/**
+ * Return true if this segment still has #interimReplicas that haven't been
+ * retired, i.e. its full replicas haven't yet been replaced by committed
+ * fragments. swapSegment() may not be called until this returns false.
+ */
+bool
+ReplicatedSegment::isConvertingToFragments()
+{
+    Lock _(dataMutex);
+    return interimReplicas && !interimReplicasRetired;
+}
+
 /**
  * Wait for the durable replication (meaning at least durably buffered on
  * backups) of data starting at the beginning of the segment up through \a
@@ -421,6 +486,12 @@ ReplicatedSegment::sync(uint32_t offset, SegmentCertificate* certificate)
     uint64_t syncStartTicks = Cycles::rdtsc();
     while (true) {
         taskQueue.performTask();
+        if (recoveringFromLostOpenReplicas && openWithOtherHeads &&
+                !queued.close) {
+            // This can't finish until the log closes the segment; let the
+            // caller find out (isAwaitingClose()) and roll the log over.
+            return;
+        }
         if (!recoveringFromLostOpenReplicas) {
             if (!normalLogSegment || precedingSegmentCloseCommitted) {
                 if (offset == ~0u) {
@@ -443,6 +514,18 @@ ReplicatedSegment::sync(uint32_t offset, SegmentCertificate* certificate)
     }
 }
 
+/**
+ * Wait for the durable replication of the data the segment held when this
+ * object was created (its opening write), as sync() would. Unlike sync()
+ * with a NULL certificate, this never reads the segment, so other threads
+ * may be appending to it meanwhile.
+ */
+void
+ReplicatedSegment::syncOpen()
+{
+    sync(openLen, &openingWriteCertificate);
+}
+
 /**
  * Replace the current in-memory segment this object is providing durability for
  * with a different, but logically identical one, and return the old segment.
@@ -462,7 +545,10 @@ ReplicatedSegment::sync(uint32_t offset, SegmentCertificate* certificate)
  * This method may block until the current segment has been fully replicated
  * before proceeding.
  *
- * This method may only be called on segments that have already been closed.
+ * This method may only be called on segments that have already been closed
+ * and that are no longer being converted to fragments (see
+ * isConvertingToFragments()): fragments cut from the old segment wouldn't
+ * match ones cut from the new one.
  *
  * \param newSegment
  *      A new segment this replicated segment will provide replication for. It
@@ -485,6 +571,7 @@ ReplicatedSegment::swapSegment(const Segment* newSegment)
         sync();
     }
     assert(getCommitted() == queued);
+    assert(!interimReplicas || interimReplicasRetired);
 
     // Only closed segments are permitted.
     assert(getCommitted().close);
@@ -495,6 +582,8 @@ ReplicatedSegment::swapSegment(const Segment* newSegment)
     queued.bytes = segment->getAppendedLength(&queuedCertificate);
     foreach (auto& replica, replicas)
         replica.committed = replica.acked = replica.sent = queued;
+    fragmentData.reset();
+    segmentSwapped = true;
 
     return oldSegment;
 }
@@ -546,8 +635,16 @@ ReplicatedSegment::performTask()
             return;
         }
     } else if (!freeQueued) {
-        foreach (Replica& replica, replicas)
-            performWrite(replica);
+        foreach (Replica& replica, replicas) {
+            if (interimReplicasRetired && replicaIsInterim(replica))
+                performFree(replica);
+            else
+                performWrite(replica);
+        }
+        if (interimReplicas && !interimReplicasRetired)
+            retireInterimReplicas();
+        if (fragmentData && getCommitted() == queued)
+            fragmentData.reset();
     }
 
     if (unopenedStartCycles != 0) {
@@ -556,7 +653,7 @@ ReplicatedSegment::performTask()
         // open it.
         bool open = true;
         foreach (Replica& replica, replicas) {
-            if (!replica.committed.open)
+            if (replicaIsCounted(replica) && !replica.committed.open)
                 open = false;
         }
         if (open) {
@@ -571,7 +668,8 @@ ReplicatedSegment::performTask()
     // be detected as the head of the log during a recovery. Hence the
     // extra condition above.
     if (recoveringFromLostOpenReplicas) {
-        if (getCommitted() == queued) {
+        if (getCommitted() == queued &&
+                (!openWithOtherHeads || queued.close)) {
             // Take care to update to the queued.epoch, not the committed epoch.
             // If enough replicas are closed on backups regardless of the
             // committed epoch we ok to shoot down stale replicas. In that case,
@@ -655,6 +753,8 @@ ReplicatedSegment::performFree(Replica& replica)
             // Let the backupSelector know if a primary replica is freed.
             if (replicaIsPrimary(replica)) {
                 backupSelector.signalFreedPrimary(replica.backupId);
+            } else if (replicaIsFragment(replica)) {
+                backupSelector.signalFreedFragment(replica.backupId);
             }
             replica.reset();
             --freeRpcsInFlight;
@@ -702,6 +802,20 @@ ReplicatedSegment::performWrite(Replica& replica)
         return;
     }
 
+    if (replicaIsFragment(replica) && !queued.close) {
+        // Fragments are cut from the closed segment; close() reschedules.
+        return;
+    }
+
+    if (replicaIsFragment(replica) && interimReplicas &&
+            !interimReplicasRetired && !getCommitted().close) {
+        // Fragments are closed replicas, so they must wait for the interim
+        // replicas to be durably closed; that is what keeps the log's
+        // ordering constraints (see close()).
+        schedule();
+        return;
+    }
+
     if (!replica.isActive) {
         // This replica does not exist yet. Choose a backup.
         // Selection of a backup is separated from the send of the open rpc
@@ -717,7 +831,10 @@ ReplicatedSegment::performWrite(Replica& replica)
             assert(numConstraints <= replicas.numElements);
         }
         ServerId backupId;
-        if (replicaIsPrimary(replica)) {
+        if (replicaIsFragment(replica)) {
+            backupId = backupSelector.selectFragment(numConstraints,
+                                                     constraints);
+        } else if (replicaIsPrimary(replica)) {
             backupId = backupSelector.selectPrimary(numConstraints,
                                                     constraints);
         } else {
@@ -821,6 +938,11 @@ ReplicatedSegment::performWrite(Replica& replica)
             return;
         }
     } else {
+        if (replicaIsFragment(replica)) {
+            performFragmentWrite(replica);
+            return;
+        }
+
         if (!replica.committed.open) {
             if (OBEY_SAFETY_CONSTRAINTS && !precedingSegmentOpenCommitted) {
                 TEST_LOG("Cannot open segment %lu until preceding segment "
@@ -969,6 +1091,114 @@ ReplicatedSegment::performWrite(Replica& replica)
     assert(false); // Unreachable by construction
 }
 
+/**
+ * Send the next part of the fragment held by a replica slot of an
+ * erasure-coded segment; the segment must be closed. Helper for
+ * performWrite(), which handles choosing a backup and completed rpcs.
+ *
+ * Each fragment goes to its backup as a sequence of rpcs of at most
+ * #maxBytesPerWriteRpc bytes, the first of which opens the replica and the
+ * last of which closes it and carries the certificate for the entire
+ * segment. Until the last one is acknowledged, replica.sent.bytes and
+ * replica.acked.bytes count bytes of the fragment rather than of the
+ * segment, and nothing of the fragment is committed.
+ */
+void
+ReplicatedSegment::performFragmentWrite(Replica& replica)
+{
+    assert(queued.close);
+    if (writeRpcsInFlight == MAX_WRITE_RPCS_IN_FLIGHT) {
+        RAMCLOUD_CLOG(DEBUG, "Delaying write to segment %lu, "
+                "fragment %lu: too many RPCs in flight", segmentId,
+                &replica - &replicas[0]);
+        schedule();
+        return;
+    }
+
+    const uint32_t dataFragments = codec->dataFragments;
+    if (!fragmentData) {
+        fragmentLength = codec->getFragmentLength(queued.bytes);
+        size_t dataLength = size_t(dataFragments) * fragmentLength;
+        fragmentData.reset(
+                new char[dataLength + size_t(codec->parityFragments) *
+                         fragmentLength]);
+        segment->copyOut(0, fragmentData.get(), queued.bytes);
+        memset(fragmentData.get() + queued.bytes, 0,
+               dataLength - queued.bytes);
+        codec->encode(fragmentData.get(), queued.bytes,
+                      fragmentData.get() + dataLength);
+    }
+
+    uint32_t fragmentIndex =
+        downCast<uint32_t>(&replica - &replicas[0]) - interimReplicas;
+    uint32_t offset = replica.sent.bytes;
+    uint32_t length = fragmentLength - offset;
+    bool last = true;
+    if (length > maxBytesPerWriteRpc) {
+        length = maxBytesPerWriteRpc;
+        last = false;
+    }
+
+    TEST_LOG("Sending fragment %u to backup %s", fragmentIndex,
+             replica.backupId.toString().c_str());
+    replica.writeRpc.construct(context, replica.backupId, masterId,
+                               segmentId, queued.epoch,
+                               fragmentData.get() +
+                                   size_t(fragmentIndex) * fragmentLength,
+                               offset, length,
+                               last ? &queuedCertificate : NULL,
+                               !replica.sent.open, last,
+                               dataFragments, codec->parityFragments,
+                               fragmentIndex);
+    ++writeRpcsInFlight;
+    replica.sentCertificate = last;
+    if (last) {
+        replica.sent = queued;
+    } else {
+        replica.sent.open = true;
+        replica.sent.bytes = offset + length;
+        replica.sent.epoch = queued.epoch;
+    }
+    schedule();
+}
+
+/**
+ * Retire the #interimReplicas of a segment once all of its fragments have
+ * been committed: the fragments then make the segment durable on their
+ * own, and performTask() frees the interim replicas rather than keeping
+ * them up. Helper for performTask().
+ */
+void
+ReplicatedSegment::retireInterimReplicas()
+{
+    if (!queued.close)
+        return;
+    if (recoveringFromLostOpenReplicas) {
+        // Wait for the recovery to finish with the interim replicas.
+        schedule();
+        return;
+    }
+    foreach (auto& replica, replicas) {
+        if (replicaIsInterim(replica))
+            continue;
+        if (!replica.isActive || replica.committed != queued)
+            return;
+    }
+
+    LOG(DEBUG, "Segment %lu fragments committed; freeing its %u interim "
+        "replicas", segmentId, interimReplicas);
+    interimReplicasRetired = true;
+    foreach (auto& replica, replicas) {
+        if (!replicaIsInterim(replica) || !replica.writeRpc)
+            continue;
+        // A replacement for a lost interim replica may still be catching up.
+        replica.writeRpc->cancel();
+        replica.writeRpc.destroy();
+        --writeRpcsInFlight;
+    }
+    schedule();
+}
+
 /**
  * Prints a ton of internal state of the replica. Useful for diagnosing why
  * a particular segment's replication is stuck.
@@ -25,6 +25,7 @@
 #include "CycleCounter.h"
 #include "UpdateReplicationEpochTask.h"
 #include "RawMetrics.h"
+#include "ReedSolomon.h"
 #include "Transport.h"
 #include "TaskQueue.h"
 #include "VarLenArray.h"
@@ -232,6 +233,7 @@ class ReplicatedSegment : public Task {
             , writeRpc()
             , replacesLostReplica(false)
             , sentCertificate(false)
+            , fullReplica(false)
         {}
 
         ~Replica() {
@@ -264,9 +266,11 @@ class ReplicatedSegment : public Task {
          *      ensure log integrity.
          */
         void reset(bool replacesLostReplica = false) {
+            bool fullReplica = this->fullReplica;
             this->~Replica();
             new(this) Replica;
             this->replacesLostReplica = replacesLostReplica;
+            this->fullReplica = fullReplica;
         }
 
         /**
@@ -333,6 +337,14 @@ class ReplicatedSegment : public Task {
          */
         bool sentCertificate;
 
+        /**
+         * Only meaningful for erasure-coded segments (see #codec). True
+         * means this slot holds a full replica rather than a fragment; set
+         * when a fragment is lost after swapSegment(), since the fragments
+         * of the swapped-in segment would not match the surviving ones.
+         */
+        bool fullReplica;
+
         DISALLOW_COPY_AND_ASSIGN(Replica);
     };
 
@@ -340,9 +352,13 @@ class ReplicatedSegment : public Task {
   PUBLIC:
     void free();
     bool isSynced() const;
+    bool isAwaitingClose();
+    bool hasLostOpenReplica();
+    bool isConvertingToFragments();
     void close();
     void handleBackupFailure(ServerId failedId, bool useMinCopysets);
     void sync(uint32_t offset = ~0u, SegmentCertificate* certificate = NULL);
+    void syncOpen();
     const Segment* swapSegment(const Segment* newSegment);
 
     /**
@@ -383,13 +399,17 @@ class ReplicatedSegment : public Task {
                       ServerId masterId,
                       uint32_t numReplicas,
                       Tub<CycleCounter<RawMetric>>* replicationCounter = NULL,
-                      uint32_t maxBytesPerWriteRpc = 1024 * 1024);
+                      uint32_t maxBytesPerWriteRpc = 1024 * 1024,
+                      const ReedSolomon* codec = NULL,
+                      uint32_t interimReplicas = 0);
     ~ReplicatedSegment();
 
     void schedule();
     void performTask();
     void performFree(Replica& replica);
     void performWrite(Replica& replica);
+    void performFragmentWrite(Replica& replica);
+    void retireInterimReplicas();
 
     void dumpProgress();
 
@@ -400,6 +420,8 @@ class ReplicatedSegment : public Task {
     Progress getCommitted() const {
         Progress p = queued;
         foreach (auto& replica, replicas) {
+            if (!replicaIsCounted(replica))
+                continue;
             if (replica.isActive)
                 p.min(replica.committed);
             else
@@ -410,7 +432,32 @@ class ReplicatedSegment : public Task {
 
     /// Return true if this replica should be considered the primary replica.
     bool replicaIsPrimary(Replica& replica) const {
-        return &replica == &replicas[0];
+        return (!codec || interimReplicas) && &replica == &replicas[0];
+    }
+
+    /**
+     * Return true if this replica slot holds a fragment of the segment
+     * rather than a full replica; the fragment index is the slot's index
+     * less #interimReplicas.
+     */
+    bool replicaIsFragment(const Replica& replica) const {
+        return codec && !replica.fullReplica;
+    }
+
+    /// Return true if this slot is one of the #interimReplicas.
+    bool replicaIsInterim(const Replica& replica) const {
+        return uint32_t(&replica - &replicas[0]) < interimReplicas;
+    }
+
+    /**
+     * Return true if this replica counts towards the durability of the
+     * segment: the #interimReplicas until they are retired, and the other
+     * slots from then on.
+     */
+    bool replicaIsCounted(const Replica& replica) const {
+        if (replicaIsInterim(replica))
+            return !interimReplicasRetired;
+        return interimReplicas == 0 || interimReplicasRetired;
     }
 
     /// Bytes needed to hold a ReplicatedSegment instance due to VarLenArray.
@@ -498,6 +545,50 @@ class ReplicatedSegment : public Task {
      */
     const uint32_t maxBytesPerWriteRpc;
 
+    /**
+     * If non-NULL, this segment is stored on backups as
+     * codec->dataFragments + codec->parityFragments erasure-coded fragments
+     * (one per replica slot, after any #interimReplicas) rather than as full
+     * replicas. Fragments are
+     * only written once the segment has been closed, and are sent whole
+     * with a single certificate, so there are never partial fragments to
+     * recover from. Owned by the ReplicaManager.
+     */
+    const ReedSolomon* codec;
+
+    /**
+     * Only used with #codec for log heads, which must be written to
+     * incrementally while they are open: the first this many replica slots
+     * hold full replicas of the segment, and only the slots after them
+     * hold its fragments. Fragments aren't written until the full replicas
+     * are durably closed, and the full replicas are freed once every
+     * fragment is committed (see #interimReplicasRetired). Zero means
+     * every slot holds a fragment.
+     */
+    const uint32_t interimReplicas;
+
+    /**
+     * True once every fragment of a segment with #interimReplicas has been
+     * committed. From then on the fragments alone make the segment
+     * durable, and the interim replicas are freed and never recreated.
+     */
+    bool interimReplicasRetired;
+
+    /**
+     * Only used with #codec: all of the fragments of the closed segment,
+     * each #fragmentLength bytes, data fragments first. Built from the
+     * segment when the first fragment needs to be sent and released once
+     * every fragment is committed (it is rebuilt if a fragment is lost
+     * later on).
+     */
+    std::unique_ptr<char[]> fragmentData;
+
+    /// Length of each fragment in #fragmentData.
+    uint32_t fragmentLength;
+
+    /// True once swapSegment() has been called; see Replica::fullReplica.
+    bool segmentSwapped;
+
     /**
      * Tracks how much of a segment the log module has made available for
      * replication.
@@ -592,6 +683,16 @@ class ReplicatedSegment : public Task {
      */
     bool recoveringFromLostOpenReplicas;
 
+    /**
+     * True if this segment is one of several log heads that are open at the
+     * same time (see SegmentManager::allocHeadSegments()). Updating
+     * #replicationEpoch after losing an open replica would invalidate the
+     * open replicas of the other heads with lower ids, so in that case
+     * recovery from the lost replica is put off until the log has closed
+     * this segment (see isAwaitingClose()).
+     */
+    bool openWithOtherHeads;
+
     /// Intrusive list entries for #ReplicaManager::replicatedSegmentList.
     IntrusiveListHook listEntries;
 
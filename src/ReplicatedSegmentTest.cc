@@ -99,7 +99,9 @@ struct ReplicatedSegmentTest : public ::testing::Test {
         CreateSegment(ReplicatedSegmentTest* test,
                       ReplicatedSegment* precedingSegment,
                       uint64_t segmentId,
-                      uint32_t numReplicas)
+                      uint32_t numReplicas,
+                      const ReedSolomon* codec = NULL,
+                      uint32_t interimReplicas = 0)
             : logSegment(test->data, DATA_LEN)
             , segment()
         {
@@ -121,7 +123,9 @@ struct ReplicatedSegmentTest : public ::testing::Test {
                                               test->masterId,
                                               numReplicas,
                                               NULL,
-                                              MAX_BYTES_PER_WRITE));
+                                              MAX_BYTES_PER_WRITE,
+                                              codec,
+                                              interimReplicas));
             // Set up ordering constraints between this new segment and the
             // prior one in the log.
             if (precedingSegment) {
@@ -306,6 +310,7 @@ TEST_F(ReplicatedSegmentTest, handleBackupFailureWhileOpen) {
     segment->handleBackupFailure({0, 0}, false);
     foreach (auto& replica, segment->replicas)
         EXPECT_FALSE(replica.replacesLostReplica);
+    EXPECT_FALSE(segment->hasLostOpenReplica());
 
     transport.setInput("0 0"); // write
     transport.setInput("0 0"); // write
@@ -329,6 +334,7 @@ TEST_F(ReplicatedSegmentTest, handleBackupFailureWhileOpen) {
     // The other open replica is in normal (non-atomic) mode still.
     EXPECT_FALSE(segment->replicas[1].replacesLostReplica);
     EXPECT_EQ(1lu, segment->queued.epoch);
+    EXPECT_TRUE(segment->hasLostOpenReplica());
 
     // Failure of the second replica. This one has a free request
     // flight.
@@ -948,6 +954,28 @@ TEST_F(ReplicatedSegmentTest, swapSegmentThenBackupFailure) {
                 "new content!", 13));
 }
 
+TEST_F(ReplicatedSegmentTest, swapSegmentThenFragmentLost) {
+    reset();
+    ReedSolomon codec(1, 1);
+    CreateSegment coded(this, NULL, 889, 2, &codec);
+    ReplicatedSegment* codedSegment = coded.segment.get();
+    codedSegment->replicas[0].start(backupId1);
+    codedSegment->replicas[1].start(backupId2);
+
+    codedSegment->handleBackupFailure(backupId1, false);
+    EXPECT_FALSE(codedSegment->replicas[0].fullReplica);
+    EXPECT_FALSE(codedSegment->recoveringFromLostOpenReplicas);
+    EXPECT_EQ(0lu, codedSegment->queued.epoch);
+
+    codedSegment->segmentSwapped = true;
+    codedSegment->handleBackupFailure(backupId2, false);
+    EXPECT_TRUE(codedSegment->replicas[1].fullReplica);
+    EXPECT_TRUE(codedSegment->replicas[1].replacesLostReplica);
+    EXPECT_TRUE(codedSegment->replicaIsFragment(codedSegment->replicas[0]));
+    EXPECT_FALSE(codedSegment->replicaIsFragment(codedSegment->replicas[1]));
+    EXPECT_FALSE(codedSegment->replicaIsPrimary(codedSegment->replicas[0]));
+}
+
 TEST_F(ReplicatedSegmentTest, scheduleWithReplicas) {
     TestLog::Enable _;
     transport.setInput("0 0"); // write
@@ -1545,6 +1573,144 @@ TEST_F(ReplicatedSegmentTest, performWriteDataLargerThanLimit) {
     reset();
 }
 
+TEST_F(ReplicatedSegmentTest, performWriteFragments) {
+    reset();
+    ReedSolomon codec(1, 1);
+    // A non-head segment (e.g. a cleaner survivor) has no interim replicas,
+    // so its fragments go out as soon as it is closed.
+    CreateSegment coded(this, NULL, 889, 2, &codec);
+    ReplicatedSegment* codedSegment = coded.segment.get();
+    EXPECT_EQ(0u, codedSegment->interimReplicas);
+    taskQueue.performTask(); // nothing to send until closed
+    EXPECT_EQ("", transport.outputLog);
+    EXPECT_FALSE(codedSegment->isScheduled());
+    EXPECT_FALSE(codedSegment->replicas[0].isActive);
+
+    coded.logSegment.head = openLen + 5;
+    SegmentCertificate certificate;
+    coded.logSegment.getAppendedLength(&certificate);
+    codedSegment->close();
+    transport.setInput("0 0"); // fragment 0
+    transport.setInput("0 0"); // fragment 1
+    taskQueue.performTask(); // send fragments
+    EXPECT_TRUE(codedSegment->fragmentData);
+
+    // With one data fragment, the parity fragment is a copy of it.
+    WrReq request{{BACKUP_WRITE, BACKUP_SERVICE, 0},
+                  999, 889, 0, 0, 15, true, true, false, true, certificate};
+    request.dataFragments = 1;
+    request.parityFragments = 1;
+    EXPECT_TRUE(transport.outputMatches(0, MockTransport::SEND_REQUEST,
+                request, "abcdefghijklmno", 15));
+    request.common.targetId = 1;
+    request.fragmentIndex = 1;
+    EXPECT_TRUE(transport.outputMatches(1, MockTransport::SEND_REQUEST,
+                request, "abcdefghijklmno", 15));
+
+    taskQueue.performTask(); // reap fragments
+    EXPECT_EQ(codedSegment->queued, codedSegment->getCommitted());
+    EXPECT_FALSE(codedSegment->fragmentData);
+    EXPECT_FALSE(codedSegment->isScheduled());
+}
+
+TEST_F(ReplicatedSegmentTest, performWriteFragmentLargerThanLimit) {
+    reset();
+    ReedSolomon codec(1, 1);
+    CreateSegment coded(this, NULL, 889, 2, &codec);
+    ReplicatedSegment* codedSegment = coded.segment.get();
+    EXPECT_EQ(0u, codedSegment->interimReplicas);
+    coded.logSegment.head = 30;
+    SegmentCertificate certificate;
+    coded.logSegment.getAppendedLength(&certificate);
+    codedSegment->close();
+    transport.setInput("0 0");
+    transport.setInput("0 0");
+    taskQueue.performTask(); // send first parts
+
+    SegmentCertificate empty;
+    WrReq request{{BACKUP_WRITE, BACKUP_SERVICE, 0},
+                  999, 889, 0, 0, 21, true, false, false, false, empty};
+    request.dataFragments = 1;
+    request.parityFragments = 1;
+    EXPECT_TRUE(transport.outputMatches(0, MockTransport::SEND_REQUEST,
+                request, "abcdefghijklmnopqrstu", 21));
+    EXPECT_EQ(21u, codedSegment->replicas[0].sent.bytes);
+
+    taskQueue.performTask(); // reap first parts
+    EXPECT_TRUE(codedSegment->replicas[0].committed.open);
+    EXPECT_EQ(0u, codedSegment->replicas[0].committed.bytes);
+    EXPECT_FALSE(codedSegment->getCommitted().close);
+
+    transport.clearOutput();
+    transport.setInput("0 0");
+    transport.setInput("0 0");
+    taskQueue.performTask(); // send last parts
+    request = WrReq{{BACKUP_WRITE, BACKUP_SERVICE, 0},
+                    999, 889, 0, 21, 9, false, true, false, true,
+                    certificate};
+    request.dataFragments = 1;
+    request.parityFragments = 1;
+    EXPECT_TRUE(transport.outputMatches(0, MockTransport::SEND_REQUEST,
+                request, "vwxyzabcd", 9));
+
+    taskQueue.performTask(); // reap last parts
+    EXPECT_EQ(codedSegment->queued, codedSegment->getCommitted());
+    EXPECT_EQ(30u, codedSegment->getCommitted().bytes);
+}
+
+TEST_F(ReplicatedSegmentTest, performWriteFragmentsOfLogHead) {
+    reset();
+    ReedSolomon codec(1, 1);
+    CreateSegment coded(this, NULL, 889, 3, &codec, 1);
+    ReplicatedSegment* codedSegment = coded.segment.get();
+    EXPECT_TRUE(codedSegment->replicas[0].fullReplica);
+    EXPECT_TRUE(codedSegment->replicaIsPrimary(codedSegment->replicas[0]));
+    EXPECT_TRUE(codedSegment->replicaIsFragment(codedSegment->replicas[1]));
+
+    transport.setInput("0 0");
+    taskQueue.performTask(); // open the interim replica
+    EXPECT_TRUE(codedSegment->replicas[0].isActive);
+    EXPECT_FALSE(codedSegment->replicas[1].isActive);
+    taskQueue.performTask(); // reap open
+    EXPECT_TRUE(codedSegment->getCommitted().open);
+
+    coded.logSegment.head = openLen + 5;
+    codedSegment->close();
+    transport.setInput("0 0");
+    taskQueue.performTask(); // close the interim replica
+    EXPECT_FALSE(codedSegment->replicas[1].isActive);
+    EXPECT_TRUE(codedSegment->isScheduled());
+
+    TestLog::Enable _;
+    transport.setInput("0 0"); // fragment 0
+    transport.setInput("0 0"); // fragment 1
+    taskQueue.performTask(); // reap close, send fragments
+    EXPECT_TRUE(codedSegment->getCommitted().close);
+    EXPECT_TRUE(codedSegment->replicas[1].writeRpc);
+    EXPECT_TRUE(codedSegment->replicas[2].writeRpc);
+    EXPECT_TRUE(TestUtil::contains(TestLog::get(), "Sending fragment 0"));
+    EXPECT_TRUE(TestUtil::contains(TestLog::get(), "Sending fragment 1"));
+    EXPECT_FALSE(codedSegment->interimReplicasRetired);
+    EXPECT_TRUE(codedSegment->isConvertingToFragments());
+
+    taskQueue.performTask(); // reap fragments
+    EXPECT_TRUE(codedSegment->interimReplicasRetired);
+    EXPECT_FALSE(codedSegment->isConvertingToFragments());
+    EXPECT_EQ(codedSegment->queued, codedSegment->getCommitted());
+    EXPECT_TRUE(codedSegment->replicas[0].isActive);
+
+    ServerId interimBackup = codedSegment->replicas[0].backupId;
+    transport.setInput("0");
+    taskQueue.performTask(); // free the interim replica
+    EXPECT_TRUE(codedSegment->replicas[0].freeRpc);
+    taskQueue.performTask(); // reap free
+    EXPECT_FALSE(codedSegment->replicas[0].isActive);
+    ASSERT_EQ(1u, backupSelector.primaryFreed.size());
+    EXPECT_EQ(interimBackup, backupSelector.primaryFreed[0]);
+    EXPECT_EQ(codedSegment->queued, codedSegment->getCommitted());
+    EXPECT_FALSE(codedSegment->isScheduled());
+}
+
 TEST_F(ReplicatedSegmentTest, performWriteClosedButLongerThanMaxTxLimit) {
     SegmentCertificate emptyCertificate;
     transport.setInput("0 0"); // open/write
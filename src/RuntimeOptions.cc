@@ -69,6 +69,36 @@ struct Parser<std::queue<T>> : public RuntimeOptions::Parseable {
 
 };
 
+/**
+ * Specialization which parses strings of form "a b c" to std::set<T>,
+ * in the same way as for std::queue<T> above.
+ */
+template <typename T>
+struct Parser<std::set<T>> : public RuntimeOptions::Parseable {
+    explicit Parser(std::set<T> & target)
+        : target(target), optionValue("")
+    {}
+
+    void
+    parse(const char* value)
+    {
+        target.clear();
+        std::istringstream iss(value);
+        auto begin = std::istream_iterator<T>(iss);
+        auto end = std::istream_iterator<T>();
+        target.insert(begin, end);
+        optionValue = value;
+    }
+    std::string
+    getValue() {
+        return optionValue;
+    }
+    // target holds a parsed copy of value for the option.
+    std::set<T>& target;
+    // A copy of the value string is saved in optionValue.
+    std::string optionValue;
+};
+
 /**
  * Parser for coordinator crash point run time options.
  * An option is just a string in this case and currently,
@@ -129,10 +159,12 @@ RuntimeOptions::RuntimeOptions()
     : parsers()
     , mutex()
     , failRecoveryMasters()
+    , restartLocally()
     , crashCoordinator()
 {
 #define REGISTER(field) registerOption(#field, newParser(field))
     REGISTER(failRecoveryMasters);
+    REGISTER(restartLocally);
 #undef REGISTER
     registerOption("crashCoordinator",
             newcrashCoordParser(crashCoordinator));
@@ -199,6 +231,20 @@ RuntimeOptions::popFailRecoveryMasters()
     return result;
 }
 
+/**
+ * Return true, and forget about it, if \a serverId was listed in
+ * #restartLocally; otherwise return false.
+ *
+ * \param serverId
+ *      Crashed server whose recovery is about to be scheduled.
+ */
+bool
+RuntimeOptions::takeRestartLocally(ServerId serverId)
+{
+    Lock _(mutex);
+    return restartLocally.erase(serverId.toString()) > 0;
+}
+
 /**
  * Check if the argument matches the currently active crash point
  * and kills the coordinator if necessary
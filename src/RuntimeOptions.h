@@ -18,9 +18,11 @@
 
 #include <mutex>
 #include <queue>
+#include <set>
 #include <unordered_map>
 #include <string>
 #include "Common.h"
+#include "ServerId.h"
 
 namespace RAMCloud {
 
@@ -44,6 +46,7 @@ class RuntimeOptions {
         void set(const char* option, const char* value);
         std::string get(const char* option);
         uint32_t popFailRecoveryMasters();
+        bool takeRestartLocally(ServerId serverId);
         void checkAndCrashCoordinator(const char *crashPoint);
 
     PRIVATE:
@@ -88,6 +91,18 @@ class RuntimeOptions {
          */
         std::queue<uint32_t> failRecoveryMasters;
 
+        /**
+         * Servers (as printed by ServerId::toString(), e.g. "3.0") that
+         * are about to be restarted in place for maintenance. The next
+         * recovery of each of these is done by the restarted server alone,
+         * from the replicas on its own backup, rather than by the whole
+         * cluster; see Recovery::restartLocator. For example,
+         * set("restartLocally", "3.0 4.0") before restarting servers 3.0
+         * and 4.0 with the same locator and backup storage. The masters
+         * must have been run with --keepLocalReplica.
+         */
+        std::set<string> restartLocally;
+
         /**
          * Keeps track of the currently active crash point. Crashes the
          * coordinator the next time this crash point is reached.
@@ -70,5 +70,14 @@ TEST_F(RuntimeOptionsTest, popFailRecoveryMasters) {
     EXPECT_EQ(0u, options.popFailRecoveryMasters());
 }
 
+TEST_F(RuntimeOptionsTest, takeRestartLocally) {
+    EXPECT_FALSE(options.takeRestartLocally(ServerId(3, 0)));
+    options.set("restartLocally", "3.0 4.1");
+    EXPECT_FALSE(options.takeRestartLocally(ServerId(4, 0)));
+    EXPECT_TRUE(options.takeRestartLocally(ServerId(3, 0)));
+    EXPECT_FALSE(options.takeRestartLocally(ServerId(3, 0)));
+    EXPECT_TRUE(options.takeRestartLocally(ServerId(4, 1)));
+}
+
 
 }  // namespace RAMCloud
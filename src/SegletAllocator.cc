@@ -20,6 +20,7 @@
 #include "Segment.h"
 #include "ServerConfig.h"
 #include "ShortMacros.h"
+#include "ThreadId.h"
 
 namespace RAMCloud {
 
@@ -42,8 +43,13 @@ SegletAllocator::SegletAllocator(const ServerConfig* config)
       cleanerPool(),
       cleanerPoolReserve(0),
       defaultPool(),
+      magazines(),
+      magazineSize(std::max(config->segmentSize / config->segletSize, 1U)),
+      cachedSeglets(0),
+      cleanerPoolFull(true),
       segletToSegmentTable(),
-      block(config->master.logBytes)
+      block(config->master.logBytes,
+            MemoryPolicy(config->master.memoryPolicy))
 {
     assert(BitOps::isPowerOfTwo(segletSize));
     uint8_t* segletBlock = block.get();
@@ -61,6 +67,8 @@ SegletAllocator::SegletAllocator(const ServerConfig* config)
  */
 SegletAllocator::~SegletAllocator()
 {
+    reclaimMagazines();
+
     size_t totalFree = emergencyHeadPool.size() +
                        cleanerPool.size() +
                        defaultPool.size();
@@ -95,7 +103,8 @@ SegletAllocator::getMetrics(ProtoBuf::LogMetrics_SegletMetrics& m)
     m.set_emergency_head_pool_count(emergencyHeadPool.size());
     m.set_cleaner_pool_reserve(cleanerPoolReserve);
     m.set_cleaner_pool_count(cleanerPool.size());
-    m.set_default_pool_count(defaultPool.size());
+    m.set_default_pool_count(defaultPool.size() + cachedSeglets);
+    m.set_cached_count(cachedSeglets);
 }
 
 /**
@@ -116,15 +125,51 @@ SegletAllocator::alloc(AllocationType type,
                        uint32_t count,
                        vector<Seglet*>& outSeglets)
 {
+    if (type == DEFAULT) {
+        Magazine& magazine = getMagazine();
+        std::lock_guard<SpinLock> guard(magazine.lock);
+        if (magazine.seglets.size() >= count) {
+            outSeglets.insert(outSeglets.end(),
+                              magazine.seglets.end() - count,
+                              magazine.seglets.end());
+            magazine.seglets.erase(magazine.seglets.end() - count,
+                                   magazine.seglets.end());
+            cachedSeglets -= count;
+            return true;
+        }
+    }
+
     std::lock_guard<SpinLock> guard(lock);
 
     if (type == EMERGENCY_HEAD)
         return allocFromPool(emergencyHeadPool, count, outSeglets);
 
-    if (type == CLEANER)
-        return allocFromPool(cleanerPool, count, outSeglets);
+    if (type == CLEANER) {
+        if (cleanerPool.size() < count)
+            reclaimMagazines();
+        bool success = allocFromPool(cleanerPool, count, outSeglets);
+        if (cleanerPool.size() < cleanerPoolReserve)
+            cleanerPoolFull = false;
+        return success;
+    }
 
-    return allocFromPool(defaultPool, count, outSeglets);
+    if (defaultPool.size() < count)
+        reclaimMagazines();
+    if (!allocFromPool(defaultPool, count, outSeglets))
+        return false;
+
+    // Refill our magazine while we have the lock, so that the next few
+    // allocations don't need it.
+    Magazine& magazine = getMagazine();
+    std::lock_guard<SpinLock> magazineGuard(magazine.lock);
+    if (magazine.seglets.size() < magazineSize) {
+        uint32_t refill = std::min(
+            magazineSize - downCast<uint32_t>(magazine.seglets.size()),
+            downCast<uint32_t>(defaultPool.size()));
+        allocFromPool(defaultPool, refill, magazine.seglets);
+        cachedSeglets += refill;
+    }
+    return true;
 }
 
 /**
@@ -148,6 +193,9 @@ SegletAllocator::initializeEmergencyHeadReserve(uint32_t numSeglets)
     if (emergencyHeadPoolReserve != 0)
         return false;
 
+    if (defaultPool.size() < numSeglets)
+        reclaimMagazines();
+
     if (!allocFromPool(defaultPool, numSeglets, emergencyHeadPool))
         return false;
 
@@ -186,6 +234,9 @@ SegletAllocator::initializeCleanerReserve(uint32_t numSeglets)
     if (cleanerPoolReserve != 0)
         return false;
 
+    if (defaultPool.size() < numSeglets)
+        reclaimMagazines();
+
     if (!allocFromPool(defaultPool, numSeglets, cleanerPool))
         return false;
 
@@ -197,12 +248,19 @@ SegletAllocator::initializeCleanerReserve(uint32_t numSeglets)
         defaultPool.size() * segletSize / 1024 / 1024);
 
     cleanerPoolReserve = numSeglets;
+    cleanerPoolFull = true;
     return true;
 }
 
 /**
  * Return a seglet to this allocator. This is normally invoked within the
  * Seglet::free() method when a seglet returns itself.
+ *
+ * If the cleaner's reserve is full, seglets that didn't come from the
+ * emergency head pool are cached in the calling thread's magazine. Once
+ * that holds twice #magazineSize seglets, half of them go back to the pools
+ * in one batch. Everything else is returned to the pools immediately; see
+ * freeToPool().
  */
 void
 SegletAllocator::free(Seglet* seglet)
@@ -210,37 +268,29 @@ SegletAllocator::free(Seglet* seglet)
     if (DEBUG_BUILD)
         memset(seglet->get(), '!', seglet->getLength());
 
-    std::lock_guard<SpinLock> guard(lock);
-
     // This seglet no longer belongs to any segment, so update that fact first.
     setOwnerSegment(seglet, NULL);
 
-    // The emergency head pool is special. Seglets that came from it must be
-    // returned to it. Futhermore, only segments that came from it should be
-    // returned.
-    //
-    // The reason is a little subtle. The problem with always preferring to put
-    // seglets into this pool if it's non-empty is that under high memory
-    // utilization we could fail to re-fill the cleaner's pool, preventing it
-    // from having enough space to work with and deadlocking the system.
-    if (seglet->getSourcePool() == &emergencyHeadPool) {
-        emergencyHeadPool.push_back(seglet);
-        return;
+    Magazine& magazine = getMagazine();
+    if (seglet->getSourcePool() != &emergencyHeadPool && cleanerPoolFull) {
+        std::lock_guard<SpinLock> guard(magazine.lock);
+        if (magazine.seglets.size() < 2 * magazineSize) {
+            magazine.seglets.push_back(seglet);
+            cachedSeglets++;
+            return;
+        }
     }
 
-    // Any seglets not allocated to emergency heads should be used to fill empty
-    // space in the cleaner reserve. The cleaner maintains the invariant that
-    // after every pass it has consumed no more seglets than it has freed. Thus
-    // this pool should never remain non-full for long.
-    if (cleanerPool.size() < cleanerPoolReserve) {
-        cleanerPool.push_back(seglet);
-        return;
+    std::lock_guard<SpinLock> guard(lock);
+    freeToPool(seglet);
+
+    // If the magazine overflowed, drain half of it while we hold the lock.
+    std::lock_guard<SpinLock> magazineGuard(magazine.lock);
+    while (magazine.seglets.size() > magazineSize) {
+        freeToPool(magazine.seglets.back());
+        magazine.seglets.pop_back();
+        cachedSeglets--;
     }
-
-    // If we're making forward progress, any excess clean seglets accumulate in
-    // the default pool. New log heads can allocate from this to service new
-    // log appends.
-    defaultPool.push_back(seglet);
 }
 
 /**
@@ -267,7 +317,7 @@ SegletAllocator::getFreeCount(AllocationType type)
     if (type == CLEANER)
         return cleanerPool.size();
     assert(type == DEFAULT);
-    return defaultPool.size();
+    return defaultPool.size() + cachedSeglets;
 }
 
 size_t
@@ -324,7 +374,8 @@ SegletAllocator::getMemoryUtilization()
     size_t maxDefaultPoolSize = getTotalCount() -
                                 emergencyHeadPoolReserve -
                                 cleanerPoolReserve;
-    return downCast<int>(100 * (maxDefaultPoolSize - defaultPool.size()) /
+    size_t freeDefaultSeglets = defaultPool.size() + cachedSeglets;
+    return downCast<int>(100 * (maxDefaultPoolSize - freeDefaultSeglets) /
                          maxDefaultPoolSize);
 }
 
@@ -400,4 +451,72 @@ SegletAllocator::allocFromPool(vector<Seglet*>& pool,
     return true;
 }
 
+/**
+ * Return the magazine the calling thread should cache free seglets in.
+ */
+SegletAllocator::Magazine&
+SegletAllocator::getMagazine()
+{
+    return magazines[ThreadId::get() % NUM_MAGAZINES];
+}
+
+/**
+ * Return a free seglet to the appropriate pool. See free() for how seglets
+ * usually get here.
+ *
+ * This must be called with the monitor lock held.
+ */
+void
+SegletAllocator::freeToPool(Seglet* seglet)
+{
+    // The emergency head pool is special. Seglets that came from it must be
+    // returned to it. Futhermore, only segments that came from it should be
+    // returned.
+    //
+    // The reason is a little subtle. The problem with always preferring to put
+    // seglets into this pool if it's non-empty is that under high memory
+    // utilization we could fail to re-fill the cleaner's pool, preventing it
+    // from having enough space to work with and deadlocking the system.
+    if (seglet->getSourcePool() == &emergencyHeadPool) {
+        emergencyHeadPool.push_back(seglet);
+        return;
+    }
+
+    // Any seglets not allocated to emergency heads should be used to fill empty
+    // space in the cleaner reserve. The cleaner maintains the invariant that
+    // after every pass it has consumed no more seglets than it has freed. Thus
+    // this pool should never remain non-full for long.
+    if (cleanerPool.size() < cleanerPoolReserve) {
+        cleanerPool.push_back(seglet);
+        if (cleanerPool.size() == cleanerPoolReserve)
+            cleanerPoolFull = true;
+        return;
+    }
+
+    // If we're making forward progress, any excess clean seglets accumulate in
+    // the default pool. New log heads can allocate from this to service new
+    // log appends.
+    defaultPool.push_back(seglet);
+}
+
+/**
+ * Move every seglet cached in the magazines back to the pools. This is done
+ * when an allocation can't be met from the pools alone, so that seglets
+ * cached by other threads are never the reason an allocation fails, and so
+ * that the cleaner reserve is topped up before anything else.
+ *
+ * This must be called with the monitor lock held.
+ */
+void
+SegletAllocator::reclaimMagazines()
+{
+    for (int i = 0; i < NUM_MAGAZINES; i++) {
+        std::lock_guard<SpinLock> guard(magazines[i].lock);
+        foreach (Seglet* seglet, magazines[i].seglets)
+            freeToPool(seglet);
+        cachedSeglets -= magazines[i].seglets.size();
+        magazines[i].seglets.clear();
+    }
+}
+
 } // end RAMCloud
@@ -16,6 +16,8 @@
 #ifndef RAMCLOUD_SEGLETALLOCATOR_H
 #define RAMCLOUD_SEGLETALLOCATOR_H
 
+#include <atomic>
+
 #include "Common.h"
 #include "LargeBlockOfMemory.h"
 #include "Seglet.h"
@@ -52,6 +54,14 @@ class LogSegment;
  * How seglets are returned to appropriate pools is somewhat subtle (and
  * annoyingly so). See the free() method's documentation if you're interested.
  *
+ * To keep the allocator's lock off the fast path, free default seglets are
+ * also cached in a few small "magazines", each used by a subset of threads.
+ * Threads allocate from and free to their magazine, and only take the lock
+ * to refill or drain it a segment's worth of seglets at a time. Seglets
+ * cached this way are counted as free in the default pool, and are pulled
+ * back into the pools whenever an allocation (or the cleaner reserve) would
+ * otherwise come up short, so caching never causes an allocation to fail.
+ *
  * Seglets are always allocated by the SegmentManager when it creates new log
  * segments and are freed by the Segment class they're assigned to, either at
  * destruction time, or when the segment is closed and told to free unused
@@ -90,10 +100,37 @@ class SegletAllocator {
     void setOwnerSegment(Seglet* seglet, LogSegment* segment);
 
   PRIVATE:
+    /**
+     * A cache of free default-pool seglets shared by the threads whose
+     * ThreadId maps to it. See getMagazine().
+     */
+    struct Magazine {
+        Magazine()
+            : lock("SegletAllocator::Magazine::lock"),
+              seglets()
+        {
+        }
+
+        /// Protects #seglets. Since few threads share a magazine, this is
+        /// rarely contended.
+        SpinLock lock;
+
+        /// Free seglets cached for this magazine's threads.
+        vector<Seglet*> seglets;
+
+        DISALLOW_COPY_AND_ASSIGN(Magazine);
+    };
+
+    /// Number of magazines. Threads are spread over them by ThreadId.
+    enum { NUM_MAGAZINES = 16 };
+
     size_t getSegletIndex(const void* p);
     bool allocFromPool(vector<Seglet*>& pool,
                        uint32_t count,
                        vector<Seglet*>& outSeglets);
+    Magazine& getMagazine();
+    void freeToPool(Seglet* seglet);
+    void reclaimMagazines();
 
     /// Size of each seglet in bytes.
     const uint32_t segletSize;
@@ -140,6 +177,22 @@ class SegletAllocator {
     /// Pool holding all other seglets not otherwise reserved.
     vector<Seglet*> defaultPool;
 
+    /// Free default seglets cached outside of the lock; see Magazine.
+    Magazine magazines[NUM_MAGAZINES];
+
+    /// Number of seglets a magazine is refilled to when empty, and drained
+    /// back to when full (it holds at most twice this many). This is one
+    /// segment's worth, which is what the SegmentManager allocates at a time.
+    const uint32_t magazineSize;
+
+    /// Total number of seglets currently cached in #magazines.
+    std::atomic<size_t> cachedSeglets;
+
+    /// True when the cleanerPool holds its full reserve, so freed seglets
+    /// can be cached in magazines rather than going to the cleaner. Only
+    /// modified with #lock held, but read without it in free().
+    std::atomic<bool> cleanerPoolFull;
+
     /// Table mapping blocks of memory backing Seglets to their owner LogSegment
     /// objects. This allows getOwnerSegment() to look up a LogSegment object
     /// based on a pointer anywhere into ``block'' below.
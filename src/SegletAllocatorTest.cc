@@ -17,6 +17,7 @@
 
 #include "Seglet.h"
 #include "ServerConfig.h"
+#include "ThreadId.h"
 
 namespace RAMCloud {
 
@@ -116,10 +117,59 @@ TEST_F(SegletAllocatorTest, initializeCleanerReserve) {
     }
 }
 
+TEST_F(SegletAllocatorTest, alloc_fromMagazine) {
+    vector<Seglet*> seglets;
+    SegletAllocator::Magazine& magazine = allocator.getMagazine();
+    size_t defaultSeglets = allocator.defaultPool.size();
+
+    // The first allocation takes the lock and refills the magazine.
+    EXPECT_TRUE(allocator.alloc(SegletAllocator::DEFAULT, 1, seglets));
+    EXPECT_EQ(allocator.magazineSize, magazine.seglets.size());
+    EXPECT_EQ(defaultSeglets - 1 - allocator.magazineSize,
+              allocator.defaultPool.size());
+    EXPECT_EQ(defaultSeglets - 1,
+              allocator.getFreeCount(SegletAllocator::DEFAULT));
+
+    // The next ones come straight out of it.
+    EXPECT_TRUE(allocator.alloc(SegletAllocator::DEFAULT,
+                                allocator.magazineSize, seglets));
+    EXPECT_EQ(0U, magazine.seglets.size());
+    EXPECT_EQ(0U, allocator.cachedSeglets);
+    EXPECT_EQ(defaultSeglets - 1 - allocator.magazineSize,
+              allocator.defaultPool.size());
+
+    foreach (Seglet* s, seglets)
+        s->free();
+}
+
+TEST_F(SegletAllocatorTest, alloc_reclaimsMagazines) {
+    vector<Seglet*> seglets;
+    uint32_t total = downCast<uint32_t>(allocator.defaultPool.size());
+
+    // Strand a seglet in some other thread's magazine.
+    allocator.alloc(SegletAllocator::DEFAULT, 1, seglets);
+    seglets[0]->free();
+    int otherIndex = (ThreadId::get() + 1) % SegletAllocator::NUM_MAGAZINES;
+    SegletAllocator::Magazine& other = allocator.magazines[otherIndex];
+    allocator.allocFromPool(allocator.getMagazine().seglets,
+                            downCast<uint32_t>(
+                                allocator.getMagazine().seglets.size()),
+                            other.seglets);
+    seglets.clear();
+
+    EXPECT_TRUE(allocator.alloc(SegletAllocator::DEFAULT, total, seglets));
+    EXPECT_EQ(0U, other.seglets.size());
+    EXPECT_EQ(0U, allocator.cachedSeglets);
+
+    foreach (Seglet* s, seglets)
+        s->free();
+}
+
 TEST_F(SegletAllocatorTest, free) {
     vector<Seglet*> seglets;
 
     EXPECT_TRUE(allocator.alloc(SegletAllocator::DEFAULT, 2, seglets));
+    allocator.reclaimMagazines();
     seglets[0]->setSourcePool(&allocator.emergencyHeadPool);
     EXPECT_EQ(0U, allocator.emergencyHeadPool.size());
     allocator.free(seglets[0]);
@@ -128,13 +178,33 @@ TEST_F(SegletAllocatorTest, free) {
     allocator.emergencyHeadPool.clear();
     seglets[0]->setSourcePool(NULL);
     allocator.cleanerPoolReserve = 1;
+    allocator.cleanerPoolFull = false;
     EXPECT_EQ(0U, allocator.cleanerPool.size());
     allocator.free(seglets[0]);
     EXPECT_EQ(1U, allocator.cleanerPool.size());
+    EXPECT_TRUE(allocator.cleanerPoolFull);
 
+    // With the cleaner's reserve full, seglets go to the magazine.
     uint32_t defaultSeglets = downCast<uint32_t>(allocator.defaultPool.size());
     allocator.free(seglets[1]);
-    EXPECT_EQ(defaultSeglets + 1, allocator.defaultPool.size());
+    EXPECT_EQ(defaultSeglets, allocator.defaultPool.size());
+    EXPECT_EQ(1U, allocator.getMagazine().seglets.size());
+    EXPECT_EQ(defaultSeglets + 1,
+              allocator.getFreeCount(SegletAllocator::DEFAULT));
+}
+
+TEST_F(SegletAllocatorTest, free_drainsFullMagazine) {
+    vector<Seglet*> seglets;
+    uint32_t count = 2 * allocator.magazineSize + 1;
+    EXPECT_TRUE(allocator.alloc(SegletAllocator::DEFAULT, count, seglets));
+    allocator.reclaimMagazines();
+    size_t defaultSeglets = allocator.defaultPool.size();
+
+    foreach (Seglet* s, seglets)
+        s->free();
+    EXPECT_EQ(allocator.magazineSize, allocator.getMagazine().seglets.size());
+    EXPECT_EQ(defaultSeglets + count - allocator.magazineSize,
+              allocator.defaultPool.size());
 }
 
 TEST_F(SegletAllocatorTest, getFreeCount) {
@@ -799,6 +799,85 @@ Segment::checkMetadataIntegrity(const SegmentCertificate& certificate)
     return true;
 }
 
+/**
+ * Construct a checker for a segment that is yet to arrive.
+ *
+ * \param certificate
+ *      Certificate for the segment, as returned by getAppendedLength() on
+ *      the segment it was copied from.
+ */
+Segment::MetadataChecker::MetadataChecker(
+        const SegmentCertificate& certificate)
+    : certificate(certificate)
+    , checksum()
+    , offset(0)
+    , corrupt(false)
+{
+}
+
+/**
+ * Check the metadata of the entries in a segment that has partly arrived,
+ * skipping those that were checked by earlier calls.
+ *
+ * \param segment
+ *      Contiguous copy of the segment; the same start must be passed on
+ *      every call.
+ * \param length
+ *      Number of bytes of the segment that have arrived so far. Entries
+ *      whose header and length run past this are checked by a later call.
+ * \return
+ *      False if the segment is already known to be corrupt, true otherwise.
+ */
+bool
+Segment::MetadataChecker::update(const void* segment, uint32_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(segment);
+    while (!corrupt && offset < certificate.segmentLength &&
+           offset < length) {
+        const EntryHeader* header =
+                reinterpret_cast<const EntryHeader*>(bytes + offset);
+        uint32_t lengthOffset = offset + sizeof32(*header);
+        if (lengthOffset + header->getLengthBytes() > length)
+            break;
+        uint32_t entryLength = 0;
+        memcpy(&entryLength, bytes + lengthOffset, header->getLengthBytes());
+        checksum.update(header, sizeof(*header));
+        checksum.update(&entryLength, header->getLengthBytes());
+
+        offset = lengthOffset + header->getLengthBytes() + entryLength;
+        if (offset > certificate.segmentLength) {
+            LOG(WARNING, "segment corrupt: entries run off past expected "
+                "length (expected %u, next entry would have started at %u)",
+                certificate.segmentLength, offset);
+            corrupt = true;
+        }
+    }
+    return !corrupt;
+}
+
+/**
+ * Finish checking a segment once all of it has been passed to update().
+ * Must be called only once.
+ *
+ * \return
+ *      True if the segment's metadata matches its certificate, false if it
+ *      is corrupt.
+ */
+bool
+Segment::MetadataChecker::finish()
+{
+    if (corrupt)
+        return false;
+    checksum.update(&certificate, static_cast<unsigned>
+                    (sizeof(certificate)-sizeof(certificate.checksum)));
+    if (certificate.checksum != checksum.getResult()) {
+        LOG(WARNING, "segment corrupt: bad checksum (expected 0x%08x, "
+            "was 0x%08x)", certificate.checksum, checksum.getResult());
+        corrupt = true;
+    }
+    return !corrupt;
+}
+
 /**
  * Copy data out of the segment and into a contiguous output buffer.
  *
@@ -244,6 +244,18 @@ class Segment {
                               Buffer* buffer,
                               uint32_t* lengthWithMetadata = NULL);
 
+        /**
+         * Start loading the first \a numBytes of the referenced entry into
+         * the processor's caches, so that a subsequent getEntry() is less
+         * likely to stall on memory. This never faults, even if the
+         * reference has since become stale.
+         */
+        void
+        prefetchEntry(uint32_t numBytes = 128) const
+        {
+            prefetch(reinterpret_cast<const void*>(reference), numBytes);
+        }
+
         /**
          * Compare references for equality. Returns true if equal, else false.
          */
@@ -266,6 +278,35 @@ class Segment {
         uint64_t reference;
     };
 
+    /**
+     * Checks the metadata of a segment against its certificate, the same
+     * way checkMetadataIntegrity() does, while the segment is still arriving
+     * in pieces (as when a recovery master fetches a large recovery segment
+     * in chunks). Each call to update() checks the entries whose headers
+     * have arrived since the last one, so a corrupt segment is noticed as
+     * soon as its entries run off the end, and finish() needs no pass over
+     * the whole segment.
+     */
+    class MetadataChecker {
+      public:
+        explicit MetadataChecker(const SegmentCertificate& certificate);
+        bool update(const void* segment, uint32_t length);
+        bool finish();
+
+      PRIVATE:
+        /// Certificate the segment is checked against.
+        SegmentCertificate certificate;
+
+        /// Checksum of the entry headers and lengths checked so far.
+        Crc32C checksum;
+
+        /// Offset of the next entry header to check.
+        uint32_t offset;
+
+        /// Set once update() finds the segment corrupt.
+        bool corrupt;
+    };
+
     Segment();
     Segment(const vector<Seglet*>& seglets, uint32_t segletSize);
     Segment(const void* buffer, uint32_t length);
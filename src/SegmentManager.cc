@@ -266,6 +266,232 @@ SegmentManager::allocHeadSegment(uint32_t flags)
     return newHead;
 }
 
+/**
+ * Allocate segments to replace some or all of the heads of a log that
+ * appends to several heads at once (see ServerConfig::Master::numLogHeads).
+ * This only opens the new heads; the caller installs them and then calls
+ * closeHeadSegments() to finish the transition, which is when backups are
+ * waited for. That way appends to the new heads needn't wait for backups,
+ * but the rules for making the transition safe are different from
+ * allocHeadSegment()'s:
+ *
+ * - The new heads get consecutive ids and identical log digests, naming the
+ *   previous heads, the heads that stay open, and every new one. The heads
+ *   that stay open get a copy of the same digest appended, so every open
+ *   head's latest digest names all of the others. Recovery uses the latest
+ *   digest of the lowest-numbered open replica it finds, so whichever of the
+ *   heads' replicas survive, it learns about all of them. The caller must
+ *   make the appended digests durable before closing the previous heads.
+ *
+ * - The new heads are made durable before any previous head is closed, so
+ *   that backups always hold an open segment whose digest covers the log.
+ *
+ * - The previous heads are durably closed one at a time, in id order. A head
+ *   that lost an open replica updates the replication epoch once it is
+ *   closed, which invalidates all open replicas with lower ids (see
+ *   ReplicatedSegment::openWithOtherHeads), so those must be closed first.
+ *   The caller must therefore replace every head, not just some, if any of
+ *   them has lost an open replica.
+ *
+ * Until closeHeadSegments() returns, recovery may still use a digest that
+ * doesn't name the new heads; the caller must not report anything appended
+ * to them as durable before then. It must also finish one transition before
+ * starting the next, and hold the appendLock of every head throughout this
+ * call.
+ *
+ * \param numHeads
+ *      The number of heads the log has.
+ * \param[out] newHeads
+ *      The new heads are returned here, in order of increasing id. The
+ *      LogSegment::headIndex of each is the index of the head it replaces.
+ *      If out of memory and an emergency head was allocated instead (see
+ *      \a flags), this holds just that one segment, which replaces every
+ *      head.
+ * \param[out] prevHeads
+ *      The heads being replaced are returned here, in order of increasing
+ *      id, to be passed to closeHeadSegments().
+ * \param flags
+ *      If out of memory and the MUST_NOT_FAIL flag is provided, a single
+ *      emergency head segment is allocated and returned. Otherwise, false
+ *      is returned when out of memory and the flag is not provided.
+ * \param firstReplaced
+ *      Index of the first head to replace.
+ * \param numReplaced
+ *      How many heads to replace, starting with \a firstReplaced; by default,
+ *      all of them. If one of the heads that would stay open hasn't room for
+ *      a new digest, every head is replaced instead.
+ * \return
+ *      False if out of memory, in which case no transition took place and the
+ *      previous heads remain the heads of the log. True otherwise.
+ */
+bool
+SegmentManager::allocHeadSegments(uint32_t numHeads,
+                                  LogSegmentVector& newHeads,
+                                  LogSegmentVector& prevHeads,
+                                  uint32_t flags,
+                                  uint32_t firstReplaced,
+                                  uint32_t numReplaced)
+{
+    SpinLock::Guard _(lock);
+
+    uint32_t endReplaced = numHeads;
+    if (firstReplaced < numHeads && numReplaced < numHeads - firstReplaced)
+        endReplaced = firstReplaced + numReplaced;
+
+    // The HEAD list is kept in order of allocation, which is also id order.
+    LogSegmentVector openHeads;
+    LogSegmentVector keptHeads;
+    foreach (LogSegment& s, segmentsByState[HEAD]) {
+        openHeads.push_back(&s);
+        if (s.headIndex < firstReplaced || s.headIndex >= endReplaced)
+            keptHeads.push_back(&s);
+    }
+
+    // Each head that stays open needs room for a digest naming every segment
+    // in the log (a checksum and an id per segment; see LogDigest) and for
+    // the table stats.
+    if (!keptHeads.empty()) {
+        size_t segmentIds = segmentsByState[CLEANABLE_PENDING_DIGEST].size() +
+                            segmentsByState[CLEANABLE].size() +
+                            segmentsByState[NEWLY_CLEANABLE].size() +
+                            openHeads.size() + (endReplaced - firstReplaced);
+        Buffer tableStats;
+        TableStats::serialize(&tableStats, masterTableMetadata);
+        uint32_t entryLengths[] = {
+            downCast<uint32_t>(sizeof(Crc32C::ResultType) +
+                               segmentIds * sizeof(uint64_t)),
+            tableStats.size()
+        };
+        foreach (LogSegment* keptHead, keptHeads) {
+            if (keptHead->isEmergencyHead ||
+                    !keptHead->hasSpaceFor(entryLengths, 2)) {
+                firstReplaced = 0;
+                endReplaced = numHeads;
+                keptHeads.clear();
+                break;
+            }
+        }
+    }
+    foreach (LogSegment* openHead, openHeads) {
+        if (openHead->headIndex >= firstReplaced &&
+                openHead->headIndex < endReplaced)
+            prevHeads.push_back(openHead);
+    }
+
+    uint32_t now = WallTime::secondsTimestamp();
+    for (uint32_t i = firstReplaced; i < endReplaced; i++) {
+        LogSegment* newHead = alloc(ALLOC_HEAD,
+                                    nextSegmentId + (i - firstReplaced),
+                                    now);
+        if (newHead == NULL) {
+            // All of the heads or none: return what we got.
+            foreach (LogSegment* s, newHeads)
+                free(s);
+            newHeads.clear();
+            break;
+        }
+        newHead->headIndex = i;
+        newHeads.push_back(newHead);
+    }
+
+    if (newHeads.empty()) {
+        // As in allocHeadSegment(), cleaning may need an emergency head
+        // to make progress. All of the log's heads share this one.
+        if (!(flags & MUST_NOT_FAIL) &&
+            segmentsByState[FREEABLE_PENDING_DIGEST_AND_REFERENCES].empty()) {
+            prevHeads.clear();
+            return false;
+        }
+        newHeads.push_back(alloc(ALLOC_EMERGENCY_HEAD,
+                                 nextSegmentId,
+                                 now));
+        prevHeads = openHeads;
+        keptHeads.clear();
+    }
+
+    nextSegmentId += newHeads.size();
+
+    // Emergency heads are reclaimed right away, so they stay out of the
+    // digest.
+    LogSegmentVector digestHeads;
+    foreach (LogSegment* openHead, openHeads) {
+        if (!openHead->isEmergencyHead)
+            digestHeads.push_back(openHead);
+    }
+    digestHeads.insert(digestHeads.end(), newHeads.begin(), newHeads.end());
+
+    foreach (LogSegment* newHead, newHeads) {
+        writeHeader(newHead);
+        writeDigest(newHead, digestHeads);
+        writeTableStatsDigest(newHead);
+        writeSafeVersion(newHead);
+        if (newHead->isEmergencyHead)
+            newHead->close();
+
+        newHead->replicatedSegment = replicaManager.allocateHead(
+            newHead->id, newHead, NULL, true);
+        segmentsOnDiskHistogram.storeSample(++segmentsOnDisk);
+    }
+
+    foreach (LogSegment* keptHead, keptHeads) {
+        writeDigest(keptHead, digestHeads);
+        writeTableStatsDigest(keptHead);
+    }
+
+    return true;
+}
+
+/**
+ * Finish the transition started by allocHeadSegments(): wait for the new
+ * heads to be durable, then close the previous ones on backups and hand them
+ * over to the cleaner. Nothing may be appended to the previous heads any
+ * more, but the new heads may be appended to while this waits.
+ *
+ * \param newHeads
+ *      The new heads returned by allocHeadSegments().
+ * \param prevHeads
+ *      The previous heads returned by allocHeadSegments().
+ * \return
+ *      True if one of the previous heads had lost an open replica, so that
+ *      closing it invalidated the open replicas of any heads with lower ids
+ *      that stayed open (see ReplicatedSegment::openWithOtherHeads). The
+ *      caller must then replace those heads as well.
+ */
+bool
+SegmentManager::closeHeadSegments(LogSegmentVector& newHeads,
+                                  LogSegmentVector& prevHeads)
+{
+    // Only the data written by allocHeadSegments() need be durable here.
+    // If a new head loses an open replica meanwhile, this returns early;
+    // Log::sync() will then roll the heads over again.
+    foreach (LogSegment* newHead, newHeads)
+        newHead->replicatedSegment->syncOpen();
+
+    bool lostOpenReplica = false;
+    foreach (LogSegment* prevHead, prevHeads) {
+        prevHead->close();
+        prevHead->replicatedSegment->close();
+        prevHead->replicatedSegment->sync();
+        if (prevHead->replicatedSegment->hasLostOpenReplica())
+            lostOpenReplica = true;
+    }
+
+    // A head is replaced when it (or another hot head) fills up, so hot
+    // heads are often closed with room to spare. Give the unused tail back
+    // to the seglet pool so that they are as dense in memory as full
+    // segments.
+    SpinLock::Guard _(lock);
+    foreach (LogSegment* prevHead, prevHeads) {
+        if (prevHead->isEmergencyHead) {
+            free(prevHead);
+        } else {
+            prevHead->freeUnusedSeglets();
+            changeState(*prevHead, NEWLY_CLEANABLE);
+        }
+    }
+    return lostOpenReplica;
+}
+
 /**
  * Allocate a replacement segment for the cleaner to write survivor data into.
  *
@@ -360,6 +586,45 @@ SegmentManager::allocSideSegment(uint32_t flags, LogSegment* replacing)
     return s;
 }
 
+/**
+ * Allocate survivor segments for a batch of segments the cleaner is about to
+ * compact in memory, taking the SegmentManager's lock just once rather than
+ * once for each segment. Each survivor assumes the identity of the segment it
+ * replaces, as with allocSideSegment(FOR_CLEANING, replacing).
+ *
+ * Unlike allocSideSegment(), this never blocks: if the cleaner's reserve runs
+ * out part way through the batch, fewer survivors are returned than
+ * requested, and the caller may use allocSideSegment() with MUST_NOT_FAIL to
+ * wait for the rest once it has completed the compactions it could start.
+ *
+ * \param replacing
+ *      The segments that will be compacted.
+ * \param[out] outSurvivors
+ *      Survivors for the first segments in \a replacing are appended here,
+ *      in the same order.
+ */
+void
+SegmentManager::allocSurvivorSegments(LogSegmentVector& replacing,
+                                      LogSegmentVector& outSurvivors)
+{
+    SpinLock::Guard _(lock);
+
+    foreach (LogSegment* segment, replacing) {
+        assert(states[segment->slot] == CLEANABLE);
+        LogSegment* s = alloc(ALLOC_CLEANER_SIDELOG,
+                              segment->id,
+                              segment->creationTimestamp);
+        if (s == NULL)
+            break;
+
+        // Each survivor inherits the replicatedSegment of the one it replaces
+        // when compactionComplete() is invoked.
+        writeHeader(s);
+        TEST_LOG("id = %lu", s->id);
+        outSurvivors.push_back(s);
+    }
+}
+
 /**
  * This method is invoked by the log cleaner when it has finished a cleaning
  * pass. A list of cleaned segments is passed in, as well as a list of new
@@ -401,35 +666,47 @@ SegmentManager::cleaningComplete(LogSegmentVector& clean,
 
 /**
  * This method is invoked by the log cleaner when it has finished compacting
- * a single segment in memory. The old segment will be freed and the new
- * version will take its place. The on-disk contents remain unchanged until a
- * backup failure occurs that forces a copy of the new compacted segment to be
+ * a batch of segments in memory. The old segments will be freed and the new
+ * versions will take their place. The on-disk contents remain unchanged until
+ * a backup failure occurs that forces a copy of a new compacted segment to be
  * replicated.
  *
- * \param oldSegment
- *      The segment that was compacted and will be superceded by newSegment.
- * \param newSegment
- *      The compacted version of oldSegment. It contains all of the same live
- *      data, but less dead data. This must be different from oldSegment.
+ * \param oldSegments
+ *      The segments that were compacted and will be superceded by the
+ *      corresponding entries of newSegments.
+ * \param newSegments
+ *      The compacted versions of oldSegments, in the same order. Each
+ *      contains all of the same live data as its predecessor, but less dead
+ *      data, and must be a different segment.
  */
 void
-SegmentManager::compactionComplete(LogSegment* oldSegment,
-                                   LogSegment* newSegment)
+SegmentManager::compactionComplete(LogSegmentVector& oldSegments,
+                                   LogSegmentVector& newSegments)
 {
+    assert(oldSegments.size() == newSegments.size());
     SpinLock::Guard guard(lock);
 
-    // Update the previous version's ReplicatedSegment to use the new, compacted
-    // segment in the event of a backup failure.
-    assert(newSegment->replicatedSegment == NULL);
-    newSegment->replicatedSegment = oldSegment->replicatedSegment;
-    oldSegment->replicatedSegment = NULL;
-    newSegment->replicatedSegment->swapSegment(newSegment);
-
-    injectSideSegment(newSegment, NEWLY_CLEANABLE, guard);
-    freeSegment(oldSegment, false, guard);
+    uint32_t segletsUsed = 0;
+    uint32_t segletsFreed = 0;
+    for (size_t i = 0; i < oldSegments.size(); i++) {
+        LogSegment* oldSegment = oldSegments[i];
+        LogSegment* newSegment = newSegments[i];
+
+        // Update the previous version's ReplicatedSegment to use the new,
+        // compacted segment in the event of a backup failure.
+        assert(newSegment->replicatedSegment == NULL);
+        newSegment->replicatedSegment = oldSegment->replicatedSegment;
+        oldSegment->replicatedSegment = NULL;
+        newSegment->replicatedSegment->swapSegment(newSegment);
+
+        segletsUsed += newSegment->getSegletsAllocated();
+        segletsFreed += oldSegment->getSegletsAllocated();
+        injectSideSegment(newSegment, NEWLY_CLEANABLE, guard);
+        freeSegment(oldSegment, false, guard);
+    }
 
     LOG(DEBUG, "Compaction used %u seglets to free %u seglets",
-        newSegment->getSegletsAllocated(), oldSegment->getSegletsAllocated());
+        segletsUsed, segletsFreed);
 }
 
 /**
@@ -693,9 +970,12 @@ SegmentManager::allocateVersion() {
  */
 bool
 SegmentManager::raiseSafeVersion(uint64_t minimum) {
-    if (minimum > safeVersion) {
-        safeVersion = minimum;
-        return true;
+    // Several threads may replay recovery segments at once (see
+    // SegmentReplayer), so never lower a value raised concurrently.
+    uint64_t current = safeVersion;
+    while (minimum > current) {
+        if (safeVersion.compare_exchange_weak(current, minimum))
+            return true;
     }
     return false;
 }
@@ -818,6 +1098,27 @@ SegmentManager::writeHeader(LogSegment* segment)
  */
 void
 SegmentManager::writeDigest(LogSegment* newHead, LogSegment* prevHead)
+{
+    LogSegmentVector heads;
+    if (prevHead != NULL)
+        heads.push_back(prevHead);
+    heads.push_back(newHead);
+    writeDigest(newHead, heads);
+}
+
+/**
+ * Write a LogDigest naming the given head segments, in addition to all of the
+ * closed segments in the log, to a new head. Like the other writeDigest(),
+ * this should only be called when allocating heads.
+ *
+ * \param newHead
+ *      Pointer to the segment the digest should be written into.
+ * \param heads
+ *      The current and previous heads of the log to include in the digest,
+ *      including \a newHead itself.
+ */
+void
+SegmentManager::writeDigest(LogSegment* newHead, const LogSegmentVector& heads)
 {
     LogDigest digest;
 
@@ -832,10 +1133,8 @@ SegmentManager::writeDigest(LogSegment* newHead, LogSegment* prevHead)
     foreach (LogSegment& s, segmentsByState[NEWLY_CLEANABLE])
         digest.addSegmentId(s.id);
 
-    if (prevHead != NULL)
-        digest.addSegmentId(prevHead->id);
-
-    digest.addSegmentId(newHead->id);
+    foreach (LogSegment* head, heads)
+        digest.addSegmentId(head->id);
 
     SegmentList& list = segmentsByState[
         FREEABLE_PENDING_DIGEST_AND_REFERENCES];
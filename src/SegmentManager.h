@@ -119,10 +119,19 @@ class SegmentManager {
     uint32_t getSegmentsOnDisk();
     SegletAllocator& getAllocator() const;
     LogSegment* allocHeadSegment(uint32_t flags = EMPTY);
+    bool allocHeadSegments(uint32_t numHeads, LogSegmentVector& newHeads,
+                           LogSegmentVector& prevHeads, uint32_t flags = EMPTY,
+                           uint32_t firstReplaced = 0,
+                           uint32_t numReplaced = ~0u);
+    bool closeHeadSegments(LogSegmentVector& newHeads,
+                           LogSegmentVector& prevHeads);
     LogSegment* allocSideSegment(uint32_t flags = EMPTY,
                                  LogSegment* replacing = NULL);
+    void allocSurvivorSegments(LogSegmentVector& replacing,
+                               LogSegmentVector& outSurvivors);
     void cleaningComplete(LogSegmentVector& clean, LogSegmentVector& survivors);
-    void compactionComplete(LogSegment* oldSegment, LogSegment* newSegment);
+    void compactionComplete(LogSegmentVector& oldSegments,
+                            LogSegmentVector& newSegments);
     void injectSideSegments(LogSegmentVector& segments);
     void freeUnusedSideSegments(LogSegmentVector& segments);
     void cleanableSegments(LogSegmentVector& out);
@@ -263,6 +272,7 @@ class SegmentManager {
                      const SpinLock::Guard& lock);
     void writeHeader(LogSegment* segment);
     void writeDigest(LogSegment* newHead, LogSegment* prevHead);
+    void writeDigest(LogSegment* newHead, const LogSegmentVector& heads);
     void writeSafeVersion(LogSegment* head);
     void writeTableStatsDigest(LogSegment* head);
     LogSegment* getHeadSegment();
@@ -76,6 +76,25 @@ class SegmentManagerTest : public ::testing::Test {
         DISALLOW_COPY_AND_ASSIGN(DummyWorkerTimer);
     };
 
+    // Return the segment ids listed in the log digest of the given head.
+    static vector<uint64_t>
+    digestIds(LogSegment* head)
+    {
+        vector<uint64_t> ids;
+        for (SegmentIterator it(*head); !it.isDone(); it.next()) {
+            if (it.getType() != LOG_ENTRY_TYPE_LOGDIGEST)
+                continue;
+            Buffer buffer;
+            it.appendToBuffer(buffer);
+            LogDigest digest(buffer.getRange(0, buffer.size()),
+                             buffer.size());
+            ids.clear();
+            for (uint32_t i = 0; i < digest.size(); i++)
+                ids.push_back(digest[i]);
+        }
+        return ids;
+    }
+
   private:
     DISALLOW_COPY_AND_ASSIGN(SegmentManagerTest);
 };
@@ -165,6 +184,138 @@ TEST_F(SegmentManagerTest, allocHead) {
         segmentManager.segmentsByState[SegmentManager::NEWLY_CLEANABLE].size());
 }
 
+TEST_F(SegmentManagerTest, allocHeadSegments) {
+    LogSegmentVector heads;
+    LogSegmentVector prevHeads;
+    EXPECT_TRUE(segmentManager.allocHeadSegments(3, heads, prevHeads));
+    EXPECT_TRUE(prevHeads.empty());
+    ASSERT_EQ(3U, heads.size());
+    for (uint32_t i = 0; i < 3; i++) {
+        EXPECT_EQ(i + 1, heads[i]->id);
+        EXPECT_EQ(i, heads[i]->headIndex);
+        EXPECT_FALSE(heads[i]->closed);
+        EXPECT_EQ((vector<uint64_t>{1, 2, 3}), digestIds(heads[i]));
+    }
+    EXPECT_EQ(3U, segmentManager.segmentsByState[SegmentManager::HEAD].size());
+    segmentManager.closeHeadSegments(heads, prevHeads);
+
+    // The next group's digests list both groups; the old heads stay open
+    // until the transition is finished.
+    LogSegmentVector newHeads;
+    EXPECT_TRUE(segmentManager.allocHeadSegments(3, newHeads, prevHeads));
+    ASSERT_EQ(3U, newHeads.size());
+    EXPECT_EQ(4U, newHeads[0]->id);
+    EXPECT_EQ((vector<uint64_t>{1, 2, 3, 4, 5, 6}), digestIds(newHeads[2]));
+    EXPECT_TRUE(prevHeads == heads);
+    foreach (LogSegment* head, heads)
+        EXPECT_FALSE(head->closed);
+    EXPECT_EQ(6U, segmentManager.segmentsByState[SegmentManager::HEAD].size());
+}
+
+TEST_F(SegmentManagerTest, closeHeadSegments) {
+    LogSegmentVector heads;
+    LogSegmentVector prevHeads;
+    EXPECT_TRUE(segmentManager.allocHeadSegments(3, heads, prevHeads));
+    segmentManager.closeHeadSegments(heads, prevHeads);
+
+    LogSegmentVector newHeads;
+    EXPECT_TRUE(segmentManager.allocHeadSegments(3, newHeads, prevHeads));
+    segmentManager.closeHeadSegments(newHeads, prevHeads);
+    foreach (LogSegment* head, heads) {
+        EXPECT_TRUE(head->closed);
+        EXPECT_TRUE(head->replicatedSegment->getCommitted().close);
+    }
+    foreach (LogSegment* head, newHeads)
+        EXPECT_TRUE(head->replicatedSegment->getCommitted().open);
+    EXPECT_EQ(3U, segmentManager.segmentsByState[SegmentManager::HEAD].size());
+    EXPECT_EQ(3U,
+        segmentManager.segmentsByState[SegmentManager::NEWLY_CLEANABLE].size());
+}
+
+TEST_F(SegmentManagerTest, allocHeadSegments_someHeads) {
+    LogSegmentVector heads;
+    LogSegmentVector prevHeads;
+    EXPECT_TRUE(segmentManager.allocHeadSegments(3, heads, prevHeads));
+    segmentManager.closeHeadSegments(heads, prevHeads);
+
+    // Just the last head is replaced; the others get a digest naming the
+    // new one appended.
+    LogSegmentVector newHeads;
+    EXPECT_TRUE(segmentManager.allocHeadSegments(3, newHeads, prevHeads,
+                                                 SegmentManager::EMPTY, 2, 1));
+    ASSERT_EQ(1U, newHeads.size());
+    EXPECT_EQ(4U, newHeads[0]->id);
+    EXPECT_EQ(2U, newHeads[0]->headIndex);
+    ASSERT_EQ(1U, prevHeads.size());
+    EXPECT_EQ(heads[2], prevHeads[0]);
+    EXPECT_EQ((vector<uint64_t>{1, 2, 3, 4}), digestIds(newHeads[0]));
+    EXPECT_EQ((vector<uint64_t>{1, 2, 3, 4}), digestIds(heads[0]));
+    EXPECT_EQ((vector<uint64_t>{1, 2, 3, 4}), digestIds(heads[1]));
+    EXPECT_FALSE(segmentManager.closeHeadSegments(newHeads, prevHeads));
+    EXPECT_TRUE(heads[2]->closed);
+    EXPECT_FALSE(heads[0]->closed);
+    EXPECT_EQ(3U, segmentManager.segmentsByState[SegmentManager::HEAD].size());
+
+    // A head that would stay open but has no room for another digest is
+    // replaced as well, and so then is every other head.
+    char data[1000] = { 0 };
+    while (heads[1]->append(LOG_ENTRY_TYPE_OBJ, data, sizeof(data))) {
+        // fill up the second head
+    }
+    while (heads[1]->append(LOG_ENTRY_TYPE_OBJ, data, 1)) {
+        // to the brim
+    }
+    prevHeads.clear();
+    LogSegmentVector lastHeads;
+    EXPECT_TRUE(segmentManager.allocHeadSegments(3, lastHeads, prevHeads,
+                                                 SegmentManager::EMPTY, 0, 1));
+    ASSERT_EQ(3U, lastHeads.size());
+    EXPECT_EQ(3U, prevHeads.size());
+    for (uint32_t i = 0; i < 3; i++)
+        EXPECT_EQ(i, lastHeads[i]->headIndex);
+    segmentManager.closeHeadSegments(lastHeads, prevHeads);
+    EXPECT_TRUE(heads[1]->closed);
+}
+
+TEST_F(SegmentManagerTest, allocHeadSegments_outOfMemory) {
+    // Leave room for just two segments.
+    LogSegmentVector sideSegments;
+    while (LogSegment* segment = segmentManager.allocSideSegment())
+        sideSegments.push_back(segment);
+    LogSegmentVector unused(sideSegments.end() - 2, sideSegments.end());
+    foreach (LogSegment* segment, unused)
+        segment->replicatedSegment->close();
+    segmentManager.freeUnusedSideSegments(unused);
+    segmentManager.freeUnreferencedSegments();
+
+    // A partial group is never installed.
+    LogSegmentVector heads;
+    LogSegmentVector prevHeads;
+    size_t freeSlots = segmentManager.freeSlots.size();
+    EXPECT_FALSE(segmentManager.allocHeadSegments(3, heads, prevHeads));
+    EXPECT_TRUE(heads.empty());
+    EXPECT_EQ(freeSlots, segmentManager.freeSlots.size());
+    EXPECT_EQ(static_cast<LogSegment*>(NULL), segmentManager.getHeadSegment());
+
+    EXPECT_TRUE(segmentManager.allocHeadSegments(2, heads, prevHeads));
+    EXPECT_EQ(2U, heads.size());
+    segmentManager.closeHeadSegments(heads, prevHeads);
+
+    // Out of memory entirely: a single emergency head replaces the group.
+    LogSegmentVector emergencyHeads;
+    EXPECT_FALSE(segmentManager.allocHeadSegments(2, emergencyHeads,
+                                                  prevHeads));
+    EXPECT_TRUE(prevHeads.empty());
+    EXPECT_TRUE(segmentManager.allocHeadSegments(2, emergencyHeads, prevHeads,
+                                        SegmentManager::MUST_NOT_FAIL));
+    ASSERT_EQ(1U, emergencyHeads.size());
+    EXPECT_TRUE(emergencyHeads[0]->isEmergencyHead);
+    EXPECT_EQ(0U, emergencyHeads[0]->headIndex);
+    segmentManager.closeHeadSegments(emergencyHeads, prevHeads);
+    EXPECT_TRUE(heads[0]->closed);
+    EXPECT_TRUE(heads[1]->closed);
+}
+
 TEST_F(SegmentManagerTest, allocSideSegment_forRegularSideLog) {
     TestLog::Enable _(allocFilter);
 
@@ -224,6 +375,30 @@ TEST_F(SegmentManagerTest, allocSideSegment_mustNotFail) {
     thread.join();
 }
 
+TEST_F(SegmentManagerTest, allocSurvivorSegments) {
+    LogSegmentVector compacting;
+    for (int i = 0; i < 3; i++) {
+        LogSegment* segment = segmentManager.allocHeadSegment();
+        segmentManager.changeState(*segment, SegmentManager::CLEANABLE);
+        compacting.push_back(segment);
+    }
+    segmentManager.allocHeadSegment();
+
+    // Only as many survivors as there are reserved slots are handed out,
+    // and each one takes the id of the segment it will replace.
+    segmentManager.initializeSurvivorReserve(2);
+    LogSegmentVector survivors;
+    segmentManager.allocSurvivorSegments(compacting, survivors);
+    ASSERT_EQ(2U, survivors.size());
+    EXPECT_EQ(compacting[0]->id, survivors[0]->id);
+    EXPECT_EQ(compacting[1]->id, survivors[1]->id);
+    EXPECT_EQ(0U, segmentManager.freeSurvivorSlots.size());
+
+    SegmentIterator it(*survivors[1]);
+    EXPECT_FALSE(it.isDone());
+    EXPECT_EQ(LOG_ENTRY_TYPE_SEGHEADER, it.getType());
+}
+
 TEST_F(SegmentManagerTest, cleaningComplete) {
     LogSegment* cleaned = segmentManager.allocHeadSegment();
     EXPECT_NE(static_cast<LogSegment*>(NULL), cleaned);
@@ -0,0 +1,341 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "SegmentReplayer.h"
+#include "ShortMacros.h"
+
+namespace RAMCloud {
+
+/**
+ * Construct a SegmentReplayer and start its helper threads.
+ *
+ * \param objectManager
+ *      The ObjectManager to replay segments into.
+ * \param numThreads
+ *      Number of threads to replay each segment with, including the one
+ *      calling replay(). 0 is treated as 1, which replays segments just as
+ *      a single ObjectManager::replaySegment() call would.
+ * \param nextNodeIdMap
+ *      If not NULL, keeps track of the next node id of each indexlet table
+ *      replayed; see ObjectManager::replaySegment().
+ * \param queueDepth
+ *      If nonzero, start a thread to replay segments handed to enqueue(),
+ *      and let up to this many of them wait for it. enqueue() may only be
+ *      used if this is nonzero.
+ */
+SegmentReplayer::SegmentReplayer(ObjectManager* objectManager,
+                                 uint32_t numThreads,
+                                 std::unordered_map<uint64_t, uint64_t>*
+                                     nextNodeIdMap,
+                                 uint32_t queueDepth)
+    : objectManager(objectManager)
+    , numShards(std::max(numThreads, 1u))
+    , nextNodeIdMap(nextNodeIdMap)
+    , sideLogs()
+    , shardNextNodeIds(numShards)
+    , shardStats(numShards)
+    , mutex()
+    , workReady()
+    , workDone()
+    , current(NULL)
+    , round(0)
+    , shardsRemaining(0)
+    , error()
+    , exiting(false)
+    , helpers()
+    , queueDepth(queueDepth)
+    , queueMutex()
+    , queueNotEmpty()
+    , queueProgress()
+    , queue()
+    , queueBusy(false)
+    , queueError()
+    , queueExiting(false)
+    , queueThread()
+{
+    for (uint32_t shard = 0; shard < numShards; ++shard)
+        sideLogs.emplace_back(new SideLog(objectManager->getLog()));
+    for (uint32_t shard = 1; shard < numShards; ++shard)
+        helpers.emplace_back(&SegmentReplayer::helperMain, this, shard);
+    if (queueDepth != 0)
+        queueThread.construct(&SegmentReplayer::queueMain, this);
+}
+
+/**
+ * Stop the queue and helper threads. Queued segments that haven't been
+ * replayed yet are dropped, and anything replayed but not committed is
+ * discarded along with the SideLogs.
+ */
+SegmentReplayer::~SegmentReplayer()
+{
+    if (queueThread) {
+        {
+            Lock _(queueMutex);
+            queueExiting = true;
+            queueNotEmpty.notify_all();
+        }
+        queueThread->join();
+    }
+    {
+        Lock _(mutex);
+        exiting = true;
+        workReady.notify_all();
+    }
+    foreach (auto& helper, helpers)
+        helper.join();
+}
+
+/**
+ * Replay a recovery segment, returning once all of its shards have been
+ * replayed.
+ *
+ * \param it
+ *      Iterator positioned at the start of the segment.
+ * \throw
+ *      Whatever ObjectManager::replaySegment() threw for any of the shards.
+ *      The other shards are replayed nonetheless.
+ */
+void
+SegmentReplayer::replay(SegmentIterator& it)
+{
+    if (numShards == 1) {
+        replayShard(0, it);
+        return;
+    }
+
+    Lock lock(mutex);
+    current = &it;
+    if (nextNodeIdMap) {
+        for (uint32_t shard = 1; shard < numShards; ++shard)
+            shardNextNodeIds[shard] = *nextNodeIdMap;
+    }
+    for (uint32_t shard = 0; shard < numShards; ++shard)
+        shardStats[shard] = ObjectManager::ReplayStats();
+    shardsRemaining = numShards - 1;
+    error = nullptr;
+    ++round;
+    workReady.notify_all();
+
+    // Shard 0 works on a copy, so that \a it stays intact for any helpers
+    // that have yet to copy it.
+    SegmentIterator shardZero(it);
+    lock.unlock();
+    std::exception_ptr shardZeroError;
+    try {
+        replayShard(0, shardZero);
+    } catch (...) {
+        shardZeroError = std::current_exception();
+    }
+
+    lock.lock();
+    while (shardsRemaining > 0)
+        workDone.wait(lock);
+    current = NULL;
+    if (nextNodeIdMap) {
+        for (uint32_t shard = 1; shard < numShards; ++shard) {
+            foreach (auto& entry, shardNextNodeIds[shard]) {
+                uint64_t& nextNodeId = (*nextNodeIdMap)[entry.first];
+                nextNodeId = std::max(nextNodeId, entry.second);
+            }
+        }
+    }
+    for (uint32_t shard = 1; shard < numShards; ++shard)
+        shardStats[0].add(shardStats[shard]);
+    shardStats[0].addToMetrics();
+    if (shardZeroError)
+        std::rethrow_exception(shardZeroError);
+    if (error)
+        std::rethrow_exception(error);
+}
+
+/**
+ * Hand a recovery segment off to be replayed in the background, so that
+ * the caller can fetch the next one in the meantime. Blocks while
+ * queueDepth segments are already waiting.
+ *
+ * \param segmentId
+ *      Id of the segment \a segment was filtered from; only for logging.
+ * \param segment
+ *      The recovery segment. Its metadata should already have been checked
+ *      (see SegmentIterator::checkMetadataIntegrity() and
+ *      Segment::MetadataChecker).
+ * \param certificate
+ *      Certificate to iterate \a segment with.
+ *
+ * If a segment queued earlier failed to replay, \a segment is dropped
+ * instead; nothing more can be recovered, and hasFailed() and drain() tell
+ * the caller so. An earlier segment's error isn't thrown from here, since
+ * the caller would take it for an error with \a segment.
+ */
+void
+SegmentReplayer::enqueue(uint64_t segmentId, std::unique_ptr<Buffer> segment,
+                         const SegmentCertificate& certificate)
+{
+    assert(queueThread);
+    Lock lock(queueMutex);
+    while (!queueError && queue.size() >= queueDepth)
+        queueProgress.wait(lock);
+    if (queueError)
+        return;
+    queue.emplace_back(segmentId, std::move(segment), certificate);
+    queueNotEmpty.notify_one();
+}
+
+/**
+ * Wait until every segment handed to enqueue() has been replayed.
+ *
+ * \throw
+ *      Whatever ObjectManager::replaySegment() threw for the first queued
+ *      segment that failed to replay, if any; segments queued after it are
+ *      not replayed.
+ */
+void
+SegmentReplayer::drain()
+{
+    Lock lock(queueMutex);
+    while (!queue.empty() || queueBusy)
+        queueProgress.wait(lock);
+    if (queueError)
+        std::rethrow_exception(queueError);
+}
+
+/**
+ * Return true if a segment handed to enqueue() has failed to replay, in
+ * which case the caller should stop fetching segments; drain() throws the
+ * error.
+ */
+bool
+SegmentReplayer::hasFailed()
+{
+    Lock _(queueMutex);
+    return bool(queueError);
+}
+
+/**
+ * Make everything replayed so far durable and part of the master's log;
+ * see SideLog::commit().
+ */
+void
+SegmentReplayer::commit()
+{
+    foreach (auto& sideLog, sideLogs)
+        sideLog->commit();
+}
+
+// - private -
+
+/**
+ * Main loop of the helper thread for one shard: replays that shard of each
+ * segment handed out by replay(), until the destructor is called.
+ *
+ * \param shard
+ *      Which shard of each segment this thread replays; never 0.
+ */
+void
+SegmentReplayer::helperMain(uint32_t shard)
+{
+    uint64_t lastRound = 0;
+    Lock lock(mutex);
+    while (true) {
+        while (!exiting && round == lastRound)
+            workReady.wait(lock);
+        if (exiting)
+            return;
+        lastRound = round;
+        SegmentIterator it(*current);
+        lock.unlock();
+
+        std::exception_ptr shardError;
+        try {
+            replayShard(shard, it);
+        } catch (...) {
+            shardError = std::current_exception();
+        }
+
+        lock.lock();
+        if (shardError && !error)
+            error = shardError;
+        if (--shardsRemaining == 0)
+            workDone.notify_one();
+    }
+}
+
+/**
+ * Main loop of the queue thread: replays the segments handed to enqueue(),
+ * in order, until the destructor is called.
+ */
+void
+SegmentReplayer::queueMain()
+{
+    Lock lock(queueMutex);
+    while (true) {
+        while (!queueExiting && queue.empty())
+            queueNotEmpty.wait(lock);
+        if (queueExiting)
+            return;
+        QueuedSegment next(std::move(queue.front()));
+        queue.pop_front();
+        if (queueError) {
+            queueProgress.notify_all();
+            continue;
+        }
+        queueBusy = true;
+        queueProgress.notify_all();
+        lock.unlock();
+
+        std::exception_ptr replayError;
+        try {
+            uint32_t length = next.segment->size();
+            SegmentIterator it(next.segment->getRange(0, length), length,
+                               next.certificate);
+            replay(it);
+            LOG(DEBUG, "Segment %lu replay complete", next.segmentId);
+        } catch (...) {
+            replayError = std::current_exception();
+        }
+        next.segment.reset();
+
+        lock.lock();
+        if (replayError && !queueError)
+            queueError = replayError;
+        queueBusy = false;
+        queueProgress.notify_all();
+    }
+}
+
+/**
+ * Replay one shard of a segment into that shard's SideLog. When there are
+ * several shards, the shard's metrics are counted in #shardStats for
+ * replay() to add up once every shard is done.
+ *
+ * \param shard
+ *      Which shard of the segment to replay.
+ * \param it
+ *      Iterator positioned at the start of the segment.
+ */
+void
+SegmentReplayer::replayShard(uint32_t shard, SegmentIterator& it)
+{
+    std::unordered_map<uint64_t, uint64_t>* nodeIds = nextNodeIdMap;
+    if (nodeIds != NULL && shard != 0)
+        nodeIds = &shardNextNodeIds[shard];
+    ObjectManager::ReplayStats* stats = NULL;
+    if (numShards > 1)
+        stats = &shardStats[shard];
+    objectManager->replaySegment(sideLogs[shard].get(), it, nodeIds, shard,
+                                 numShards, stats);
+}
+
+} // namespace RAMCloud
@@ -0,0 +1,193 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef RAMCLOUD_SEGMENTREPLAYER_H
+#define RAMCLOUD_SEGMENTREPLAYER_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "Buffer.h"
+#include "ObjectManager.h"
+#include "SegmentIterator.h"
+#include "SideLog.h"
+#include "Tub.h"
+
+namespace RAMCloud {
+
+/**
+ * Replays recovery segments into an ObjectManager using several cores.
+ * Masters use this during recovery in place of calling
+ * ObjectManager::replaySegment() with a single SideLog.
+ *
+ * Each segment is split into numThreads shards by key hash (see the shard
+ * argument of ObjectManager::replaySegment()). The thread calling replay()
+ * replays shard 0, which also includes every entry that isn't tied to a key
+ * (prepared ops and their tombstones go with the key they refer to, since
+ * whether a prepared op is kept depends on that key's current version), and
+ * numThreads - 1 helper threads replay the others at the same
+ * time. Every shard appends to a SideLog of its own, so the threads only
+ * meet on the hash table bucket locks. Since every version of a key is
+ * replayed by the same thread, in segment order, version and tombstone
+ * conflicts are resolved exactly as they would be by a single thread.
+ *
+ * Segments can also be handed off with enqueue() instead of replay(), in
+ * which case a background thread replays them (in the same way) while the
+ * caller goes on to fetch more segments from backups; drain() waits for it
+ * to catch up. Up to queueDepth segments wait their turn before enqueue()
+ * blocks.
+ *
+ * Like a SideLog, nothing replayed becomes part of the master's log until
+ * commit() is called. The caller must hold an ObjectManager::
+ * TombstoneProtector while replaying, just as for replaySegment().
+ */
+class SegmentReplayer {
+  PUBLIC:
+    SegmentReplayer(ObjectManager* objectManager, uint32_t numThreads,
+                    std::unordered_map<uint64_t, uint64_t>* nextNodeIdMap =
+                        NULL,
+                    uint32_t queueDepth = 0);
+    ~SegmentReplayer();
+    void replay(SegmentIterator& it);
+    void enqueue(uint64_t segmentId, std::unique_ptr<Buffer> segment,
+                 const SegmentCertificate& certificate);
+    void drain();
+    bool hasFailed();
+    void commit();
+
+  PRIVATE:
+    typedef std::unique_lock<std::mutex> Lock;
+
+    /// A segment handed to enqueue() and not yet replayed.
+    struct QueuedSegment {
+        QueuedSegment(uint64_t segmentId, std::unique_ptr<Buffer> segment,
+                      const SegmentCertificate& certificate)
+            : segmentId(segmentId)
+            , segment(std::move(segment))
+            , certificate(certificate)
+        {}
+
+        /// Id of the segment the recovery segment came from (for logging).
+        uint64_t segmentId;
+
+        /// Contents of the recovery segment.
+        std::unique_ptr<Buffer> segment;
+
+        /// Certificate to iterate #segment with.
+        SegmentCertificate certificate;
+    };
+
+    void helperMain(uint32_t shard);
+    void queueMain();
+    void replayShard(uint32_t shard, SegmentIterator& it);
+
+    /// Where segments are replayed to.
+    ObjectManager* objectManager;
+
+    /// Number of shards each segment is split into (one per thread,
+    /// counting the caller of replay()).
+    const uint32_t numShards;
+
+    /// The caller's map of next B+ tree node ids, if any; see
+    /// ObjectManager::replaySegment().
+    std::unordered_map<uint64_t, uint64_t>* nextNodeIdMap;
+
+    /// Entries replayed for shard i are appended to sideLogs[i].
+    std::vector<std::unique_ptr<SideLog>> sideLogs;
+
+    /**
+     * Private copies of #nextNodeIdMap for shards other than 0, taken at
+     * the start of each replay() and merged back (keeping the highest id)
+     * once all shards are done.
+     */
+    std::vector<std::unordered_map<uint64_t, uint64_t>> shardNextNodeIds;
+
+    /**
+     * Metrics counted by each shard during the current replay() (when
+     * there is more than one shard), added to the master's metrics by the
+     * thread calling replay() once all shards are done.
+     */
+    std::vector<ObjectManager::ReplayStats> shardStats;
+
+    /// Protects all of the fields below.
+    std::mutex mutex;
+
+    /// Notified when #round advances and when #exiting is set.
+    std::condition_variable workReady;
+
+    /// Notified when #shardsRemaining drops to 0.
+    std::condition_variable workDone;
+
+    /// The segment being replayed by the current round, if any.
+    SegmentIterator* current;
+
+    /// Incremented each time replay() hands a new segment to the helpers.
+    uint64_t round;
+
+    /// Number of helper threads still replaying the current segment.
+    uint32_t shardsRemaining;
+
+    /// First exception thrown by a helper during the current round, if any;
+    /// rethrown by replay().
+    std::exception_ptr error;
+
+    /// Tells the helper threads to exit; set by the destructor.
+    bool exiting;
+
+    /// Threads running helperMain(), one for each shard but the first.
+    std::vector<std::thread> helpers;
+
+    /// Maximum number of segments in #queue; 0 if enqueue() isn't used.
+    const uint32_t queueDepth;
+
+    /// Protects the fields below (separately from #mutex, which the
+    /// queue thread takes in replay()).
+    std::mutex queueMutex;
+
+    /// Notified when a segment is added to #queue and when #queueExiting
+    /// is set.
+    std::condition_variable queueNotEmpty;
+
+    /// Notified when a segment is taken off #queue or finishes replaying.
+    std::condition_variable queueProgress;
+
+    /// Segments handed to enqueue() that the queue thread hasn't started.
+    std::deque<QueuedSegment> queue;
+
+    /// True while the queue thread is replaying a segment.
+    bool queueBusy;
+
+    /// First exception thrown while replaying a queued segment, if any;
+    /// rethrown by drain(). Once set, queued segments are discarded rather
+    /// than replayed, and enqueue() drops any more it is handed.
+    std::exception_ptr queueError;
+
+    /// Tells the queue thread to exit; set by the destructor.
+    bool queueExiting;
+
+    /// Thread running queueMain(), if #queueDepth is nonzero.
+    Tub<std::thread> queueThread;
+
+    DISALLOW_COPY_AND_ASSIGN(SegmentReplayer);
+};
+
+} // namespace RAMCloud
+
+#endif // RAMCLOUD_SEGMENTREPLAYER_H
@@ -0,0 +1,272 @@
+/* Copyright (c) 2026 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "TestUtil.h"
+#include "MasterTableMetadata.h"
+#include "ObjectManager.h"
+#include "PreparedOp.h"
+#include "SegmentReplayer.h"
+#include "ServerConfig.h"
+#include "TabletManager.h"
+#include "TransactionManager.h"
+#include "TxRecoveryManager.h"
+#include "UnackedRpcResults.h"
+
+namespace RAMCloud {
+
+class SegmentReplayerTest : public ::testing::Test,
+                            public AbstractLog::ReferenceFreer {
+  public:
+    Context context;
+    ClusterClock clusterClock;
+    ClientLeaseValidator clientLeaseValidator;
+    ServerId serverId;
+    ServerList serverList;
+    ServerConfig masterConfig;
+    MasterTableMetadata masterTableMetadata;
+    ObjectManager objectManager;
+    UnackedRpcResults unackedRpcResults;
+    TransactionManager transactionManager;
+    TxRecoveryManager txRecoveryManager;
+    TabletManager tabletManager;
+    Tub<Segment> segment;
+    Tub<SegmentIterator> it;
+
+    SegmentReplayerTest()
+        : context()
+        , clusterClock()
+        , clientLeaseValidator(&context, &clusterClock)
+        , serverId(5)
+        , serverList(&context)
+        , masterConfig(ServerConfig::forTesting())
+        , masterTableMetadata()
+        , objectManager(&context,
+                        &serverId,
+                        &masterConfig,
+                        &tabletManager,
+                        &masterTableMetadata,
+                        &unackedRpcResults,
+                        &transactionManager,
+                        &txRecoveryManager)
+        , unackedRpcResults(&context, this, &clientLeaseValidator)
+        , transactionManager(&context,
+                             objectManager.getLog(),
+                             &unackedRpcResults)
+        , txRecoveryManager(&context)
+        , tabletManager()
+        , segment()
+        , it()
+    {
+        objectManager.initOnceEnlisted();
+        tabletManager.addTablet(0, 0, ~0UL, TabletManager::NORMAL);
+        segment.construct();
+    }
+
+    /**
+     * Append an object to #segment, whose key is the 8-byte integer
+     * \a keyValue (like the keys of indexlet tables) and whose value is
+     * \a contents.
+     */
+    void
+    appendObject(uint64_t keyValue, uint64_t version, string contents)
+    {
+        Key key(0, &keyValue, sizeof(keyValue));
+        Buffer dataBuffer;
+        Object object(key, contents.c_str(),
+                      downCast<uint32_t>(contents.length()) + 1, version, 0,
+                      dataBuffer);
+        Buffer buffer;
+        object.assembleForLog(buffer);
+        EXPECT_TRUE(segment->append(LOG_ENTRY_TYPE_OBJ, buffer));
+    }
+
+    /**
+     * Point #it at the start of #segment.
+     */
+    SegmentIterator&
+    iterator()
+    {
+        it.construct(*segment);
+        return *it;
+    }
+
+    /**
+     * Return the value of the object with the 8-byte key \a keyValue, or
+     * "missing" if there is none.
+     */
+    string
+    read(uint64_t keyValue)
+    {
+        Key key(0, &keyValue, sizeof(keyValue));
+        Buffer value;
+        if (objectManager.readObject(key, &value, NULL, NULL, true) !=
+                STATUS_OK) {
+            return "missing";
+        }
+        return value.getStart<char>();
+    }
+
+    virtual void freeLogEntry(Log::Reference ref) {
+        objectManager.getLog()->free(ref);
+    }
+
+    DISALLOW_COPY_AND_ASSIGN(SegmentReplayerTest);
+};
+
+TEST_F(SegmentReplayerTest, constructor) {
+    SegmentReplayer single(&objectManager, 0);
+    EXPECT_EQ(1u, single.numShards);
+    EXPECT_EQ(1u, single.sideLogs.size());
+    EXPECT_EQ(0u, single.helpers.size());
+
+    SegmentReplayer replayer(&objectManager, 4);
+    EXPECT_EQ(4u, replayer.sideLogs.size());
+    EXPECT_EQ(3u, replayer.helpers.size());
+}
+
+TEST_F(SegmentReplayerTest, replay) {
+    ObjectManager::TombstoneProtector _(&objectManager);
+    std::unordered_map<uint64_t, uint64_t> nextNodeIdMap;
+    nextNodeIdMap[0] = 0;
+    SegmentReplayer replayer(&objectManager, 4, &nextNodeIdMap);
+    for (uint64_t i = 0; i < 40; i++)
+        appendObject(i, 2, format("new %lu", i));
+    uint64_t appendCount = metrics->master.objectAppendCount;
+    uint64_t discardCount = metrics->master.objectDiscardCount;
+    replayer.replay(iterator());
+    EXPECT_EQ(40u, nextNodeIdMap[0]);
+    EXPECT_EQ(appendCount + 40, metrics->master.objectAppendCount);
+
+    // Older versions are discarded no matter which thread replays them.
+    segment.construct();
+    for (uint64_t i = 0; i < 40; i++)
+        appendObject(i, 1, "old");
+    appendObject(99, 1, "old");
+    replayer.replay(iterator());
+    EXPECT_EQ(100u, nextNodeIdMap[0]);
+    // Every shard's counts were added once all of them were done.
+    EXPECT_EQ(appendCount + 41, metrics->master.objectAppendCount);
+    EXPECT_EQ(discardCount + 40, metrics->master.objectDiscardCount);
+
+    // Every thread got some of the objects.
+    foreach (auto& sideLog, replayer.sideLogs)
+        EXPECT_FALSE(sideLog->segments.empty());
+
+    replayer.commit();
+    for (uint64_t i = 0; i < 40; i++)
+        EXPECT_EQ(format("new %lu", i), read(i));
+    EXPECT_EQ("old", read(99));
+}
+
+TEST_F(SegmentReplayerTest, replay_singleThread) {
+    ObjectManager::TombstoneProtector _(&objectManager);
+    SegmentReplayer replayer(&objectManager, 1);
+    appendObject(7, 1, "seven");
+    replayer.replay(iterator());
+    replayer.commit();
+    EXPECT_EQ("seven", read(7));
+    EXPECT_EQ(0u, replayer.round);
+}
+
+TEST_F(SegmentReplayerTest, replay_stalePreparedOp) {
+    ObjectManager::TombstoneProtector _(&objectManager);
+    uint64_t rpcId = 1;
+    for (uint32_t threads = 1; threads <= 4; threads++) {
+        SegmentReplayer replayer(&objectManager, threads);
+
+        // Each prepared op is older than the object before it, so it must be
+        // dropped no matter which thread replays its key.
+        segment.construct();
+        for (uint64_t i = 0; i < 20; i++) {
+            uint64_t keyValue = threads * 100 + i;
+            appendObject(keyValue, 5, "value");
+
+            Key key(0, &keyValue, sizeof(keyValue));
+            Buffer buffer;
+            PreparedOp op(WireFormat::TxPrepare::WRITE, 1, 1, rpcId + i, key,
+                          "stale", 6, 1, 0, buffer);
+            Buffer opBuffer;
+            op.assembleForLog(opBuffer);
+            EXPECT_TRUE(segment->append(LOG_ENTRY_TYPE_PREP, opBuffer));
+        }
+        replayer.replay(iterator());
+        replayer.commit();
+
+        for (uint64_t i = 0; i < 20; i++) {
+            EXPECT_EQ(0UL, transactionManager.getOp(1, rpcId + i))
+                << "threads " << threads << ", key " << i;
+        }
+        rpcId += 20;
+    }
+}
+
+TEST_F(SegmentReplayerTest, enqueue) {
+    ObjectManager::TombstoneProtector _(&objectManager);
+    SegmentReplayer replayer(&objectManager, 2, NULL, 1);
+    for (uint64_t round = 0; round < 3; round++) {
+        segment.construct();
+        for (uint64_t i = 0; i < 10; i++)
+            appendObject(round * 10 + i, 1, format("value %lu", i));
+        std::unique_ptr<Buffer> buffer(new Buffer());
+        SegmentCertificate certificate;
+        segment->getAppendedLength(&certificate);
+        segment->appendToBuffer(*buffer);
+        replayer.enqueue(round, std::move(buffer), certificate);
+    }
+    replayer.drain();
+    EXPECT_TRUE(replayer.queue.empty());
+    EXPECT_FALSE(replayer.queueBusy);
+    replayer.commit();
+    for (uint64_t i = 0; i < 30; i++)
+        EXPECT_EQ(format("value %lu", i % 10), read(i));
+}
+
+TEST_F(SegmentReplayerTest, enqueue_afterFailure) {
+    ObjectManager::TombstoneProtector _(&objectManager);
+    SegmentReplayer replayer(&objectManager, 2, NULL, 1);
+    EXPECT_FALSE(replayer.hasFailed());
+    {
+        SegmentReplayer::Lock lock(replayer.queueMutex);
+        replayer.queueError = std::make_exception_ptr(
+                SegmentIteratorException(HERE, "corrupt"));
+    }
+    EXPECT_TRUE(replayer.hasFailed());
+
+    // The earlier failure isn't blamed on this segment; it is just dropped.
+    appendObject(1, 1, "value");
+    std::unique_ptr<Buffer> buffer(new Buffer());
+    SegmentCertificate certificate;
+    segment->getAppendedLength(&certificate);
+    segment->appendToBuffer(*buffer);
+    EXPECT_NO_THROW(replayer.enqueue(0, std::move(buffer), certificate));
+    EXPECT_TRUE(replayer.queue.empty());
+
+    EXPECT_THROW(replayer.drain(), SegmentIteratorException);
+    EXPECT_EQ("missing", read(1));
+}
+
+TEST_F(SegmentReplayerTest, commit) {
+    ObjectManager::TombstoneProtector _(&objectManager);
+    SegmentReplayer replayer(&objectManager, 3);
+    for (uint64_t i = 0; i < 30; i++)
+        appendObject(i, 1, "value");
+    replayer.replay(iterator());
+    replayer.commit();
+    foreach (auto& sideLog, replayer.sideLogs)
+        EXPECT_TRUE(sideLog->segments.empty());
+    EXPECT_EQ("value", read(0));
+}
+
+} // namespace RAMCloud
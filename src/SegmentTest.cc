@@ -647,6 +647,61 @@ TEST_P(SegmentTest, checkMetadataIntegrity_badLength) {
         "allocated segment size"));
 }
 
+TEST_P(SegmentTest, MetadataChecker_update) {
+    TestLog::Enable _;
+    SegmentAndAllocator segAndAlloc(GetParam());
+    Segment& s = *segAndAlloc.segment;
+    s.append(LOG_ENTRY_TYPE_OBJ, "asdfhasdf", 10);
+    s.append(LOG_ENTRY_TYPE_OBJTOMB, "qwerty", 7);
+    SegmentCertificate certificate;
+    uint32_t length = s.getAppendedLength(&certificate);
+    std::vector<char> copy(length);
+    s.copyOut(0, &copy[0], length);
+
+    // Pieces may end in the middle of an entry's header or its data.
+    Segment::MetadataChecker checker(certificate);
+    EXPECT_TRUE(checker.update(&copy[0], 1));
+    EXPECT_EQ(0u, checker.offset);
+    EXPECT_TRUE(checker.update(&copy[0], 5));
+    EXPECT_EQ(12u, checker.offset);
+    EXPECT_TRUE(checker.update(&copy[0], length));
+    EXPECT_EQ(length, checker.offset);
+    EXPECT_TRUE(checker.finish());
+
+    // An entry running off the end is noticed before the rest arrives.
+    copy[1] = 100;
+    Segment::MetadataChecker overrun(certificate);
+    EXPECT_FALSE(overrun.update(&copy[0], 5));
+    EXPECT_TRUE(StringUtil::startsWith(TestLog::get(),
+        "update: segment corrupt: entries run off past expected length"));
+    EXPECT_FALSE(overrun.update(&copy[0], length));
+    EXPECT_FALSE(overrun.finish());
+}
+
+TEST_P(SegmentTest, MetadataChecker_finish) {
+    TestLog::Enable _;
+    SegmentAndAllocator segAndAlloc(GetParam());
+    Segment& s = *segAndAlloc.segment;
+    s.append(LOG_ENTRY_TYPE_OBJ, "asdfhasdf", 10);
+    SegmentCertificate certificate;
+    uint32_t length = s.getAppendedLength(&certificate);
+    std::vector<char> copy(length);
+    s.copyOut(0, &copy[0], length);
+
+    Segment::MetadataChecker checker(certificate);
+    EXPECT_TRUE(checker.update(&copy[0], length));
+    EXPECT_TRUE(checker.finish());
+
+    // Scribbling on metadata is caught by the checksum.
+    Segment::EntryHeader newHeader(LOG_ENTRY_TYPE_OBJTOMB, 10);
+    memcpy(&copy[0], &newHeader, sizeof(newHeader));
+    Segment::MetadataChecker corrupt(certificate);
+    EXPECT_TRUE(corrupt.update(&copy[0], length));
+    EXPECT_FALSE(corrupt.finish());
+    EXPECT_TRUE(StringUtil::startsWith(TestLog::get(),
+        "finish: segment corrupt: bad checksum"));
+}
+
 TEST_P(SegmentTest, reference_constructors) {
     Log::Reference empty;
     EXPECT_EQ(0U, empty.reference);
@@ -229,6 +229,14 @@ struct ServerConfig {
         Master(Testing) // NOLINT
             : logBytes(40 * 1024 * 1024)
             , hashTableBytes(1 * 1024 * 1024)
+            , hashTableAutoResize(false)
+            , hashTableMaxBytes(0)
+            , hashTableType("chained")
+            , hashTablePerTable(false)
+            , memoryPolicy("")
+            , numLogHeads(1)
+            , mutationTraceFile("")
+            , hotObjectSeconds(0)
             , disableLogCleaner(true)
             , disableInMemoryCleaning(true)
             , diskExpansionFactor(1.0)
@@ -238,6 +246,12 @@ struct ServerConfig {
             , numReplicas(0)
             , useMinCopysets(false)
             , allowLocalBackup(false)
+            , keepLocalReplica(false)
+            , dataFragments(0)
+            , parityFragments(0)
+            , replayThreads(1)
+            , replayQueueDepth(0)
+            , recoveryChunkBytes(0)
         {}
 
         /**
@@ -248,6 +262,14 @@ struct ServerConfig {
         Master()
             : logBytes()
             , hashTableBytes()
+            , hashTableAutoResize()
+            , hashTableMaxBytes()
+            , hashTableType()
+            , hashTablePerTable()
+            , memoryPolicy()
+            , numLogHeads()
+            , mutationTraceFile()
+            , hotObjectSeconds()
             , disableLogCleaner()
             , disableInMemoryCleaning()
             , diskExpansionFactor()
@@ -257,6 +279,12 @@ struct ServerConfig {
             , numReplicas()
             , useMinCopysets()
             , allowLocalBackup()
+            , keepLocalReplica()
+            , dataFragments()
+            , parityFragments()
+            , replayThreads()
+            , replayQueueDepth()
+            , recoveryChunkBytes()
         {}
 
         /**
@@ -267,6 +295,14 @@ struct ServerConfig {
         {
             config.set_log_bytes(logBytes);
             config.set_hash_table_bytes(hashTableBytes);
+            config.set_hash_table_auto_resize(hashTableAutoResize);
+            config.set_hash_table_max_bytes(hashTableMaxBytes);
+            config.set_hash_table_type(hashTableType);
+            config.set_hash_table_per_table(hashTablePerTable);
+            config.set_memory_policy(memoryPolicy);
+            config.set_num_log_heads(numLogHeads);
+            config.set_mutation_trace_file(mutationTraceFile);
+            config.set_hot_object_seconds(hotObjectSeconds);
             config.set_disable_log_cleaner(disableLogCleaner);
             config.set_disable_in_memory_cleaning(disableInMemoryCleaning);
             config.set_backup_disk_expansion_factor(diskExpansionFactor);
@@ -276,6 +312,12 @@ struct ServerConfig {
             config.set_num_replicas(numReplicas);
             config.set_use_mincopysets(useMinCopysets);
             config.set_use_local_backup(allowLocalBackup);
+            config.set_keep_local_replica(keepLocalReplica);
+            config.set_data_fragments(dataFragments);
+            config.set_parity_fragments(parityFragments);
+            config.set_replay_threads(replayThreads);
+            config.set_replay_queue_depth(replayQueueDepth);
+            config.set_recovery_chunk_bytes(recoveryChunkBytes);
         }
 
         /**
@@ -287,6 +329,14 @@ struct ServerConfig {
         {
             logBytes = config.log_bytes();
             hashTableBytes = config.hash_table_bytes();
+            hashTableAutoResize = config.hash_table_auto_resize();
+            hashTableMaxBytes = config.hash_table_max_bytes();
+            hashTableType = config.hash_table_type();
+            hashTablePerTable = config.hash_table_per_table();
+            memoryPolicy = config.memory_policy();
+            numLogHeads = config.num_log_heads();
+            mutationTraceFile = config.mutation_trace_file();
+            hotObjectSeconds = config.hot_object_seconds();
             disableLogCleaner = config.disable_log_cleaner();
             disableInMemoryCleaning = config.disable_in_memory_cleaning();
             diskExpansionFactor = config.backup_disk_expansion_factor();
@@ -296,14 +346,60 @@ struct ServerConfig {
             numReplicas = config.num_replicas();
             useMinCopysets = config.use_mincopysets();
             allowLocalBackup = config.use_local_backup();
+            keepLocalReplica = config.keep_local_replica();
+            dataFragments = config.data_fragments();
+            parityFragments = config.parity_fragments();
+            replayThreads = config.replay_threads();
+            replayQueueDepth = config.replay_queue_depth();
+            recoveryChunkBytes = config.recovery_chunk_bytes();
         }
 
         /// Total number bytes to use for the in-memory Log.
         uint64_t logBytes;
 
-        /// Total number of bytes to use for the HashTable.
+        /// Total number of bytes to use for the HashTable initially.
         uint64_t hashTableBytes;
 
+        /// If true, the HashTable is doubled or halved online as its load
+        /// factor changes (see ObjectManager::HashTableResizer).
+        bool hashTableAutoResize;
+
+        /// If hashTableAutoResize is set, the HashTable will never be grown
+        /// beyond this many bytes. 0 means there is no limit.
+        uint64_t hashTableMaxBytes;
+
+        /// Which HashTable engine to use for the object map; see
+        /// HashTable::create().
+        string hashTableType;
+
+        /// If true, each tablet gets a HashTable of its own, which is grown
+        /// as needed and freed when the tablet is dropped (see
+        /// ObjectManager::IndexPartition). hashTableBytes then no longer
+        /// applies. Requires a resizable hashTableType.
+        bool hashTablePerTable;
+
+        /// Page size and NUMA placement for the memory backing log seglets
+        /// and the HashTable, in the form accepted by MemoryPolicy. Empty
+        /// means small pages from the local node.
+        string memoryPolicy;
+
+        /// Number of segments the Log appends to concurrently. Each worker
+        /// thread appends to one of them, so that appends from different
+        /// cores don't all serialize on a single head (see AbstractLog::Head).
+        uint32_t numLogHeads;
+
+        /// If not empty, every object write and remove is recorded in this
+        /// file (see MutationTrace), so that the workload can be replayed
+        /// later with LogCleanerBenchmark.
+        string mutationTraceFile;
+
+        /// If nonzero, the Log keeps separate heads for hot and cold objects
+        /// (numLogHeads of each), so that frequently overwritten objects
+        /// don't dilute segments full of long-lived ones. An object is hot
+        /// if it overwrites a version written less than this many seconds
+        /// earlier; all other objects go to the cold heads.
+        uint32_t hotObjectSeconds;
+
         /// If true, disable the log cleaner entirely.
         bool disableLogCleaner;
 
@@ -339,6 +435,40 @@ struct ServerConfig {
 
         /// If true, allow replication to local backup.
         bool allowLocalBackup;
+
+        /// If true, the primary replica of each segment is placed on the
+        /// backup running in this server's own process whenever it is up,
+        /// so the master can later be restarted from that backup alone
+        /// (see the coordinator's "restartLocally" runtime option).
+        bool keepLocalReplica;
+
+        /// If nonzero, closed segments are stored on backups as this many
+        /// Reed-Solomon data fragments plus parityFragments parity fragments
+        /// instead of numReplicas full replicas. Log heads are replicated in
+        /// full while they are open and converted once they are closed.
+        uint32_t dataFragments;
+
+        /// Number of parity fragments per erasure-coded segment; this many
+        /// fragments of a segment can be lost. See dataFragments.
+        uint32_t parityFragments;
+
+        /// Number of threads a recovery master replays each recovery
+        /// segment with, each taking a disjoint range of key hashes (see
+        /// SegmentReplayer).
+        uint32_t replayThreads;
+
+        /// If nonzero, a recovery master replays recovery segments in the
+        /// background while it fetches more from backups, and up to this
+        /// many fetched segments may wait to be replayed. If 0, each
+        /// segment is replayed as soon as it arrives, before the next one
+        /// is requested on the same channel.
+        uint32_t replayQueueDepth;
+
+        /// If nonzero, a recovery master fetches each recovery segment
+        /// from its backup in pieces of at most this many bytes, checking
+        /// the segment's metadata as each piece arrives. If 0, each
+        /// recovery segment is fetched with a single rpc.
+        uint32_t recoveryChunkBytes;
     } master;
 
     /**
@@ -360,6 +490,12 @@ struct ServerConfig {
             , strategy(1)
             , mockSpeed(100)
             , writeRateLimit(0)
+            , ioUring(false)
+            , groupCommit(false)
+            , mapped(false)
+            , filterThreads(0)
+            , numFragmentFrames(0)
+            , fragmentFrameSize(0)
         {}
 
         /**
@@ -377,6 +513,12 @@ struct ServerConfig {
             , strategy(1)
             , mockSpeed(0)
             , writeRateLimit(0)
+            , ioUring(false)
+            , groupCommit(false)
+            , mapped(false)
+            , filterThreads(0)
+            , numFragmentFrames(0)
+            , fragmentFrameSize(0)
         {}
 
         /**
@@ -394,6 +536,12 @@ struct ServerConfig {
             config.set_strategy(strategy);
             config.set_mock_speed(mockSpeed);
             config.set_write_rate_limit(writeRateLimit);
+            config.set_io_uring(ioUring);
+            config.set_group_commit(groupCommit);
+            config.set_mapped(mapped);
+            config.set_filter_threads(filterThreads);
+            config.set_num_fragment_frames(numFragmentFrames);
+            config.set_fragment_frame_size(fragmentFrameSize);
         }
 
         /**
@@ -412,6 +560,12 @@ struct ServerConfig {
             strategy = config.strategy();
             mockSpeed = config.mock_speed();
             writeRateLimit = config.write_rate_limit();
+            ioUring = config.io_uring();
+            groupCommit = config.group_commit();
+            mapped = config.mapped();
+            filterThreads = config.filter_threads();
+            numFragmentFrames = config.num_fragment_frames();
+            fragmentFrameSize = config.fragment_frame_size();
         }
 
         /**
@@ -470,6 +624,53 @@ struct ServerConfig {
          * If non-0, limit writes to backup to this many megabytes per second.
          */
         size_t writeRateLimit;
+
+        /**
+         * If true, disk-based storage performs replica IO through io_uring
+         * (IoUringStorage) rather than POSIX aio (MultiFileStorage), if the
+         * kernel supports it.
+         */
+        bool ioUring;
+
+        /**
+         * If true, disk-based storage coalesces concurrent synchronous
+         * replica writes (to any number of replicas) into group commits, each
+         * a single batch of IO followed by a single flush, rather than giving
+         * every write its own flush. Only matters if #sync is set.
+         */
+        bool groupCommit;
+
+        /**
+         * If true (and #inMemory is false), the backup maps #file into memory
+         * and stores replicas directly in the mapping (MappedStorage), which
+         * suits persistent memory, rather than reading and writing it.
+         */
+        bool mapped;
+
+        /**
+         * Number of threads each master recovery uses to split replicas
+         * into recovery segments in parallel, in the order recovery masters
+         * ask for them. If 0, primary replicas are split one at a time in
+         * the background and secondaries by the worker thread on demand.
+         */
+        uint32_t filterThreads;
+
+        /**
+         * Number of extra storage frames, smaller than a segment, to set
+         * aside for fragments of erasure-coded segments (see
+         * master.dataFragments) so they don't each take up a whole
+         * segment frame. Fragments that don't fit, or arrive when these
+         * are all in use, get a segment frame. Not supported by mapped
+         * storage.
+         */
+        uint32_t numFragmentFrames;
+
+        /**
+         * Bytes of replica data each fragment frame can hold. If 0, a
+         * quarter of a segment, which fits fragments of segments coded with
+         * 4 or more data fragments.
+         */
+        uint32_t fragmentFrameSize;
     } backup;
 
   public:
@@ -24,6 +24,7 @@
 #include "InfRcTransport.h"
 #endif
 #include "MemoryMonitor.h"
+#include "MemoryPolicy.h"
 #include "OptionParser.h"
 #include "PortAlarm.h"
 #include "Server.h"
@@ -100,6 +101,7 @@ main(int argc, char *argv[])
     try {
         ServerConfig config = ServerConfig::forExecution();
         string masterTotalMemory, hashTableMemory;
+        uint64_t hashTableMaxMemory;
 
         bool masterOnly;
         bool backupOnly;
@@ -112,6 +114,38 @@ main(int argc, char *argv[])
             ("backupInMemory,m",
              ProgramOptions::bool_switch(&config.backup.inMemory),
              "Backup will store segment replicas in memory")
+            ("backupFilterThreads",
+             ProgramOptions::value<uint32_t>(&config.backup.filterThreads)->
+                default_value(0),
+             "Number of threads the backup uses during each master recovery "
+             "to split replicas into recovery segments in parallel, in the "
+             "order recovery masters ask for them (0 splits one replica at "
+             "a time)")
+            ("backupFragmentFrames",
+             ProgramOptions::value<uint32_t>(
+                &config.backup.numFragmentFrames)->default_value(0),
+             "Number of extra storage frames, smaller than a segment, the "
+             "backup sets aside for fragments of erasure-coded segments "
+             "(see dataFragments); other fragments take a whole segment frame")
+            ("backupFragmentFrameSize",
+             ProgramOptions::value<uint32_t>(
+                &config.backup.fragmentFrameSize)->default_value(0),
+             "Bytes each fragment frame holds (see backupFragmentFrames); 0 "
+             "means a quarter of a segment")
+            ("backupGroupCommit",
+             ProgramOptions::bool_switch(&config.backup.groupCommit),
+             "With --sync, backup will make concurrent replica writes durable "
+             "together in group commits (one batch of IO and one flush) "
+             "rather than flushing each write separately")
+            ("backupIoUring",
+             ProgramOptions::bool_switch(&config.backup.ioUring),
+             "Backup will read and write segment replicas on disk through "
+             "io_uring rather than POSIX aio, if the kernel supports it")
+            ("backupMapped",
+             ProgramOptions::bool_switch(&config.backup.mapped),
+             "Backup will store segment replicas directly in a memory "
+             "mapping of --file (ideally on a DAX filesystem over persistent "
+             "memory) rather than reading and writing it")
             ("backupOnly,B",
              ProgramOptions::bool_switch(&backupOnly),
              "The server should run the backup service only (no master)")
@@ -133,9 +167,20 @@ main(int argc, char *argv[])
              "Which balancing algorithm to use to schedule cleaning on disk "
              "and in-memory compaction, as well as how to orchestrate multiple "
              "cleaner threads. You will almost certainly want to use the "
-             "default value. Currently the only other option is \"fixed:X\", "
-             "where 0 <= X <= 100 represents the percentage of CPU time the "
-             "disk cleaner will be limited to (the rest is for compaction).")
+             "default value. The other options are \"fixed:X\", where "
+             "0 <= X <= 100 represents the percentage of CPU time the disk "
+             "cleaner will be limited to (the rest is for compaction), and "
+             "\"adaptive\" or \"adaptive:M\", which continually retunes the "
+             "disk cleaning share and number of active cleaner threads from "
+             "measured write costs and memory pressure, optionally keeping "
+             "survivor writes to backups under M megabytes per second.")
+            ("dataFragments",
+             ProgramOptions::value<uint32_t>(
+                &config.master.dataFragments)->default_value(0),
+             "If nonzero, store closed segments on backups as this many "
+             "Reed-Solomon data fragments plus parityFragments parity "
+             "fragments, each on a different backup, instead of as full "
+             "replicas. Log heads are fully replicated until they close.")
             ("detectFailures",
              ProgramOptions::value<bool>(&config.detectFailures)->
                 default_value(true),
@@ -162,17 +207,58 @@ main(int argc, char *argv[])
              ProgramOptions::value<string>(&config.backup.file)->
                 default_value("/var/tmp/backup.log"),
              "The file path to the backup storage.")
+            ("hashTableAutoResize",
+             ProgramOptions::bool_switch(&config.master.hashTableAutoResize),
+             "Grow and shrink the hash table online (in the background) as "
+             "the number of objects stored on this master changes")
+            ("hashTableMaxMemory",
+             ProgramOptions::value<uint64_t>(&hashTableMaxMemory)->
+                default_value(0),
+             "If hashTableAutoResize is set, the maximum number of megabytes "
+             "the hash table may grow to. 0 means no limit.")
+            ("hashTableType",
+             ProgramOptions::value<string>(&config.master.hashTableType)->
+                default_value("chained"),
+             "Which hash table engine to use for the object map: \"chained\" "
+             "(the default) or \"hopscotch\" (denser, but doesn't support "
+             "hashTableAutoResize)")
+            ("hashTablePerTable",
+             ProgramOptions::bool_switch(&config.master.hashTablePerTable),
+             "Give each tablet its own hash table, sized to fit it, so that "
+             "dropping or migrating away a tablet only scans that tablet's "
+             "objects (requires a resizable hashTableType)")
             ("hashTableMemory,h",
              ProgramOptions::value<string>(&hashTableMemory)->
                 default_value("10%"),
              "Percentage or megabytes of master memory allocated to "
              "the hash table")
+            ("hotObjectSeconds",
+             ProgramOptions::value<uint32_t>(
+                &config.master.hotObjectSeconds)->default_value(0),
+             "If nonzero, append objects overwritten within this many seconds "
+             "of their previous version to separate \"hot\" log heads, and "
+             "all others to \"cold\" ones, so that cold segments stay dense "
+             "and rarely need cleaning")
+            ("keepLocalReplica",
+             ProgramOptions::bool_switch(&config.master.keepLocalReplica),
+             "Place the primary replica of each segment on this server's own "
+             "backup, so that after a planned restart (see the coordinator's "
+             "restartLocally runtime option) the master can reload its log "
+             "from local storage instead of a distributed recovery; consider "
+             "raising --replicas by one, since this replica is lost with the "
+             "machine")
             ("logCleanerThreads",
              ProgramOptions::value<uint32_t>(
                 &config.master.cleanerThreadCount)->default_value(1),
              "The number of cleaner threads controls the amount of parallelism "
              "in the cleaner. More threads will use more cores, but may be "
              "able to better keep up with high write rates.")
+            ("logHeads",
+             ProgramOptions::value<uint32_t>(
+                &config.master.numLogHeads)->default_value(1),
+             "The number of log head segments appended to concurrently. "
+             "Values larger than 1 let worker threads on different cores "
+             "append to the log in parallel.")
             ("masterOnly,M",
              ProgramOptions::bool_switch(&masterOnly),
              "The server should run the master service only (no backup)")
@@ -192,12 +278,48 @@ main(int argc, char *argv[])
              "value 0 is special: it tells the server to set the "
              "limit equal to the \"segmentFrames\" value, effectively making "
              "buffering unlimited.")
+            ("memoryPolicy",
+             ProgramOptions::value<string>(&config.master.memoryPolicy)->
+                default_value(""),
+             "Page size and NUMA placement for log and hash table memory: a "
+             "comma-separated list of \"small\" (default), \"thp\" "
+             "(transparent huge pages), \"2m\" or \"1g\" (hugetlb pages), "
+             "and \"local\" (default), \"node=N\" (also restricts the "
+             "server's threads to node N's cores), or \"interleave\"")
+            ("mutationTrace",
+             ProgramOptions::value<string>(
+                &config.master.mutationTraceFile)->default_value(""),
+             "Record the table, key hash, key and value sizes, and time of "
+             "every object write and remove to this file, for replay with "
+             "LogCleanerBenchmark's \"trace\" distribution")
+            ("parityFragments",
+             ProgramOptions::value<uint32_t>(
+                &config.master.parityFragments)->default_value(0),
+             "Number of parity fragments for erasure-coded segments (see "
+             "dataFragments); this many fragments of each segment can be lost")
             ("preferredIndex",
              ProgramOptions::value<uint32_t>(
                 &config.preferredIndex)->default_value(0),
              "Use this value as the index number for this server's server id, "
              "if that number isn't already in use. Can be used to ensure "
              "a reproducible assignment of server ids.")
+            ("recoveryChunkBytes",
+             ProgramOptions::value<uint32_t>(
+                &config.master.recoveryChunkBytes)->default_value(0),
+             "Largest piece of a recovery segment fetched from a backup with "
+             "one rpc during master recovery (0 fetches whole segments)")
+            ("replayQueueDepth",
+             ProgramOptions::value<uint32_t>(
+                &config.master.replayQueueDepth)->default_value(0),
+             "Number of recovery segments that may wait to be replayed "
+             "during master recovery while more are fetched from backups "
+             "(0 replays each segment before requesting the next one)")
+            ("replayThreads",
+             ProgramOptions::value<uint32_t>(
+                &config.master.replayThreads)->default_value(1),
+             "Number of threads used to replay each recovery segment during "
+             "master recovery; each replays the objects in a disjoint range "
+             "of key hashes")
             ("replicas,r",
              ProgramOptions::value<uint32_t>(&config.master.numReplicas),
              "Number of backup copies to make for each segment")
@@ -322,6 +444,13 @@ main(int argc, char *argv[])
         if (!backupOnly) {
             LOG(NOTICE, "Using %u backups", config.master.numReplicas);
             config.setLogAndHashTableSize(masterTotalMemory, hashTableMemory);
+            config.master.hashTableMaxBytes = hashTableMaxMemory * 1024 * 1024;
+
+            // Do this before the server starts its worker and cleaner
+            // threads, so that they inherit the restriction.
+            MemoryPolicy memoryPolicy(config.master.memoryPolicy);
+            LOG(NOTICE, "Memory policy: %s", memoryPolicy.toString().c_str());
+            memoryPolicy.bindCurrentThread();
         }
 
         // Set PortTimeout and start portTimer
@@ -91,7 +91,7 @@ void
 SideLog::commit()
 {
     Tub<SpinLock::Guard> lock;
-    lock.construct(appendLock);
+    lock.construct(heads[0].appendLock);
 
     if (segments.empty())
         return;
@@ -147,7 +147,7 @@ SideLog::commit()
 LogSegment*
 SideLog::allocNextSegment(bool mustNotFail)
 {
-    assert(!appendLock.try_lock());
+    assert(!heads[0].appendLock.try_lock());
 
     LogSegment* segment;
     if (mustNotFail)
@@ -145,6 +145,11 @@ class Syscall {
         return ::sendmsg(sockfd, msg, flags);
     }
     VIRTUAL_FOR_TESTING
+    int sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+            int flags) {
+        return ::sendmmsg(sockfd, msgvec, vlen, flags);
+    }
+    VIRTUAL_FOR_TESTING
     ssize_t sendto(int socket, const void *buffer, size_t length, int flags,
            const struct sockaddr *destAddr, socklen_t destLen)
     {
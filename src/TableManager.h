@@ -265,6 +265,7 @@ class TableManager {
     void testCreateTable(const char* name, uint64_t id);
     Tablet* testFindTablet(uint64_t tableId, uint64_t keyHash);
 
+    friend class RecoverySimulator;
     DISALLOW_COPY_AND_ASSIGN(TableManager);
 };
 
@@ -201,6 +201,34 @@ TabletManager::getTablets(vector<Tablet>* outTablets)
     }
 }
 
+/**
+ * Check whether any tablet of a given table overlapping a key hash range is
+ * being tracked by this TabletManager, regardless of its state.
+ *
+ * \param tableId
+ *      Identifier of the table to look for.
+ * \param startKeyHash
+ *      First key hash of the range to look for.
+ * \param endKeyHash
+ *      Last key hash (inclusive) of the range to look for.
+ * \return
+ *      True if at least one tablet of the table overlaps the range,
+ *      otherwise false.
+ */
+bool
+TabletManager::hasTablets(uint64_t tableId, uint64_t startKeyHash,
+                          uint64_t endKeyHash)
+{
+    SpinLock::Guard _(lock);
+    auto range = tabletMap.equal_range(tableId);
+    for (TabletMap::iterator it = range.first; it != range.second; it++) {
+        Tablet* t = &it->second;
+        if (t->startKeyHash <= endKeyHash && t->endKeyHash >= startKeyHash)
+            return true;
+    }
+    return false;
+}
+
 /**
  * Remove a tablet previously created by addTablet() or splitTablet() and delete
  * all data that tracks its existence.
@@ -131,6 +131,9 @@ class TabletManager {
                    uint64_t endKeyHash,
                    Tablet* outTablet = NULL);
     void getTablets(vector<Tablet>* outTablets);
+    bool hasTablets(uint64_t tableId,
+                    uint64_t startKeyHash = 0,
+                    uint64_t endKeyHash = ~0UL);
     bool deleteTablet(uint64_t tableId,
                       uint64_t startKeyHash,
                       uint64_t endKeyHash);
@@ -152,6 +152,23 @@ TEST_F(TabletManagerTest, getTablets) {
     EXPECT_EQ(TabletManager::NORMAL, tablets[1].state);
 }
 
+TEST_F(TabletManagerTest, hasTablets) {
+    EXPECT_FALSE(tm.hasTablets(5));
+    tm.addTablet(5, 0, 10, TabletManager::RECOVERING);
+    tm.addTablet(5, 11, 20, TabletManager::NORMAL);
+    EXPECT_TRUE(tm.hasTablets(5));
+    EXPECT_FALSE(tm.hasTablets(4));
+    EXPECT_TRUE(tm.hasTablets(5, 10, 11));
+    EXPECT_TRUE(tm.hasTablets(5, 20, 30));
+    EXPECT_FALSE(tm.hasTablets(5, 21, 30));
+
+    tm.deleteTablet(5, 0, 10);
+    EXPECT_TRUE(tm.hasTablets(5));
+    EXPECT_FALSE(tm.hasTablets(5, 0, 10));
+    tm.deleteTablet(5, 11, 20);
+    EXPECT_FALSE(tm.hasTablets(5));
+}
+
 TEST_F(TabletManagerTest, deleteTablet) {
     TestLog::Enable _("deleteTablet");
     EXPECT_FALSE(tm.deleteTablet(1, 1, 1));
@@ -16,6 +16,7 @@
 #include <errno.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
@@ -52,7 +53,9 @@ Syscall* UdpDriver::sys = &defaultSyscall;
  *      identifying the desired socket.  If NULL then a port will be
  *      chosen by system software. Typically the socket is specified
  *      explicitly for server-side drivers but not for client-side
- *      drivers.
+ *      drivers. UDP segmentation and receive offload are used only if the
+ *      "gso" and "gro" options, respectively, are set to 1 (and the kernel
+ *      supports them).
  */
 UdpDriver::UdpDriver(Context* context,
         const ServiceLocator* localServiceLocator)
@@ -68,12 +71,22 @@ UdpDriver::UdpDriver(Context* context,
     , maxTransmitQueueSize(0)
     , readerThread()
     , readerThreadExit(false)
+    , transmitBatch()
+    , gsoEnabled(false)
+    , groEnabled(false)
+    , groSlots()
+    , groBuffer()
+    , poller(context, this)
 {
+    bool useGso = false;
+    bool useGro = false;
     if (localServiceLocator != NULL) {
         locatorString = localServiceLocator->getOriginalString();
         try {
             bandwidthGbps = localServiceLocator->getOption<int>("gbs");
         } catch (ServiceLocator::NoSuchKeyException& e) {}
+        useGso = localServiceLocator->getOption<bool>("gso", false);
+        useGro = localServiceLocator->getOption<bool>("gro", false);
     }
     queueEstimator.setBandwidth(1000*bandwidthGbps);
     maxTransmitQueueSize = (uint32_t) (static_cast<double>(bandwidthGbps)
@@ -121,6 +134,29 @@ UdpDriver::UdpDriver(Context* context,
 
     socketFd = fd;
 
+    // Find out whether the kernel can segment and coalesce packets for us.
+    // A UDP_SEGMENT size of 0 means messages are sent as single datagrams
+    // unless they ask otherwise, so setting it changes nothing else.
+    int zero = 0;
+    if (useGso && sys->setsockopt(fd, SOL_UDP, UDP_SEGMENT, &zero,
+            sizeof(zero)) == 0) {
+        gsoEnabled = true;
+    }
+    int one = 1;
+    if (useGro && sys->setsockopt(fd, SOL_UDP, UDP_GRO, &one,
+            sizeof(one)) == 0) {
+        groEnabled = true;
+        groBuffer.reset(
+                new char[PacketBatch::MAX_PACKETS * MAX_SEGMENTED_SIZE]);
+        for (int i = 0; i < PacketBatch::MAX_PACKETS; i++) {
+            groSlots[i].iovec.iov_base = &groBuffer[i * MAX_SEGMENTED_SIZE];
+            groSlots[i].iovec.iov_len = MAX_SEGMENTED_SIZE;
+        }
+    }
+    LOG(NOTICE, "UdpDriver GSO %s, GRO %s",
+            gsoEnabled ? "enabled" : "disabled",
+            groEnabled ? "enabled" : "disabled");
+
     readerThread.construct(readerThreadMain, this);
 }
 
@@ -132,7 +168,7 @@ UdpDriver::~UdpDriver()
 {
     close();
     for (int batch = 0; batch < 2; batch++) {
-        for (int i = 0; i < PacketBatch::MAX_PACKETS; i++) {
+        for (int i = 0; i < PacketBatch::MAX_SPLIT_PACKETS; i++) {
             if (packetBatches[batch].buffers[i] != NULL) {
                 release(packetBatches[batch].buffers[i]->payload);
                 packetBatches[batch].buffers[i] = NULL;
@@ -147,6 +183,7 @@ UdpDriver::~UdpDriver()
 void
 UdpDriver::close()
 {
+    flushTransmitBatch();
     if (readerThread) {
         stopReaderThread();
         readerThread->join();
@@ -189,10 +226,9 @@ UdpDriver::receivePackets(int maxPackets,
     }
 
     for (int i = batch->packetsRemoved; i < limit; i++) {
-        struct mmsghdr* header = &batch->messageHeaders[i];
         PacketBuf* buffer = batch->buffers[i];
         receivedPackets->emplace_back(buffer->sender.get(), this,
-                header->msg_len, buffer->payload);
+                batch->lengths[i], buffer->payload);
         batch->buffers[i] = NULL;
     }
     if (limit < available) {
@@ -219,7 +255,8 @@ UdpDriver::release(char *payload)
         reinterpret_cast<PacketBuf*>(payload - OFFSET_OF(PacketBuf, payload)));
 }
 
-// See docs in Driver class.
+// See docs in Driver class. The packet is only added to transmitBatch
+// here; see flushTransmitBatch.
 void
 UdpDriver::sendPacket(const Address *addr,
                       const void *header,
@@ -232,37 +269,133 @@ UdpDriver::sendPacket(const Address *addr,
                            (payload ? payload->size() : 0);
     assert(totalLength <= MAX_PAYLOAD_SIZE);
 
-    // one for header, the rest for payload
-    uint32_t iovecs = 1 + (payload ? payload->getNumberChunks() : 0);
-
-    struct iovec iov[iovecs];
-    iov[0].iov_base = const_cast<void*>(header);
-    iov[0].iov_len = headerLen;
-
-    uint32_t i = 1;
+    // Neither the header nor the payload need be preserved by the caller
+    // once this returns (BasicTransport, for one, may free an RPC as soon
+    // as its last packet has been handed to us), so the whole packet is
+    // copied into the batch.
+    TransmitBatch* batch = &transmitBatch;
+    char* packet = &batch->packetSpace[batch->packetBytes];
+    memcpy(packet, header, headerLen);
+    uint32_t length = headerLen;
     while (payload && !payload->isDone()) {
-        iov[i].iov_base = const_cast<void*>(payload->getData());
-        iov[i].iov_len = payload->getLength();
-        ++i;
+        memcpy(packet + length, payload->getData(), payload->getLength());
+        length += payload->getLength();
         payload->next();
     }
+    batch->packetBytes += totalLength;
 
-    struct msghdr msg;
-    memset(&msg, 0, sizeof(msg));
-    msg.msg_iov = iov;
-    msg.msg_iovlen = iovecs;
-
+    // With GSO, the packet can be added to the previous message if it
+    // goes to the same place and isn't bigger than the packets already in
+    // the message (which must all be the same size). The message's data
+    // ends where this packet was copied, so its iovec just grows.
     const sockaddr* a = &(static_cast<const IpAddress*>(addr)->address);
-    msg.msg_name = const_cast<sockaddr *>(a);
-    msg.msg_namelen = sizeof(*a);
+    int m = batch->numMessages - 1;
+    if (gsoEnabled && m >= 0
+            && memcmp(&batch->addresses[m], a, sizeof(*a)) == 0
+            && batch->segmentSizes[m] != 0
+            && totalLength <= batch->segmentSizes[m]
+            && batch->messageBytes[m] ==
+                    batch->segments[m] * batch->segmentSizes[m]
+            && batch->segments[m] < MAX_SEGMENTS
+            && batch->messageBytes[m] + totalLength <= MAX_SEGMENTED_SIZE) {
+        batch->iovecs[m].iov_len += totalLength;
+        batch->segments[m]++;
+        batch->messageBytes[m] += totalLength;
+    } else {
+        m = batch->numMessages++;
+        batch->addresses[m] = *a;
+        batch->segmentSizes[m] = totalLength;
+        batch->segments[m] = 1;
+        batch->messageBytes[m] = totalLength;
+
+        struct msghdr* msg = &batch->messages[m].msg_hdr;
+        memset(msg, 0, sizeof(*msg));
+        msg->msg_name = &batch->addresses[m];
+        msg->msg_namelen = sizeof(batch->addresses[m]);
+        batch->iovecs[m].iov_base = packet;
+        batch->iovecs[m].iov_len = totalLength;
+        msg->msg_iov = &batch->iovecs[m];
+        msg->msg_iovlen = 1;
+    }
+    batch->numPackets++;
+    queueEstimator.packetQueued(totalLength, Cycles::rdtsc());
+
+    if (batch->numPackets == TransmitBatch::MAX_PACKETS)
+        flushTransmitBatch();
+}
 
-    ssize_t r = sys->sendmsg(socketFd, &msg, 0);
-    if (r == -1) {
-        LOG(WARNING, "UdpDriver error sending to socket: %s", strerror(errno));
+/**
+ * Hand all of the packets in transmitBatch to the kernel, with as few
+ * sendmmsg calls as possible. This is invoked by the Poller during every
+ * pass through the dispatch loop, and by sendPacket when the batch fills
+ * up.
+ */
+void
+UdpDriver::flushTransmitBatch()
+{
+    TransmitBatch* batch = &transmitBatch;
+    if (batch->numMessages == 0)
         return;
+
+    if (socketFd != -1) {
+        for (int m = 0; m < batch->numMessages; m++) {
+            if (batch->segments[m] == 1)
+                continue;
+
+            // Ask the kernel to split this message into datagrams.
+            struct msghdr* msg = &batch->messages[m].msg_hdr;
+            msg->msg_control = batch->control[m];
+            msg->msg_controllen = sizeof(batch->control[m]);
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segmentSize = downCast<uint16_t>(batch->segmentSizes[m]);
+            memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+        }
+
+        int sent = 0;
+        while (sent < batch->numMessages) {
+            int r = sys->sendmmsg(socketFd, &batch->messages[sent],
+                    batch->numMessages - sent, 0);
+            if (r == -1) {
+                // The error applies to the first message that wasn't sent;
+                // drop it (the transport will retransmit as needed) and go
+                // on with the rest.
+                int e = errno;
+                LOG(WARNING, "UdpDriver error sending to socket: %s",
+                        strerror(e));
+                if (batch->segments[sent] > 1 &&
+                        (e == EIO || e == EINVAL)) {
+                    // The device or route can't segment for us.
+                    LOG(WARNING, "UdpDriver disabling GSO");
+                    gsoEnabled = false;
+                }
+                r = 1;
+            }
+            sent += r;
+        }
     }
-    queueEstimator.packetQueued(totalLength, Cycles::rdtsc());
-    assert(static_cast<size_t>(r) == totalLength);
+
+    batch->numPackets = 0;
+    batch->numMessages = 0;
+    batch->packetBytes = 0;
+}
+
+/**
+ * This method is invoked in the inner polling loop of the dispatcher;
+ * it sends the packets queued by sendPacket since the last pass.
+ * \return
+ *      The return value is 1 if this method found something useful to do,
+ *      0 otherwise.
+ */
+int
+UdpDriver::Poller::poll()
+{
+    if (driver->transmitBatch.numMessages == 0)
+        return 0;
+    driver->flushTransmitBatch();
+    return 1;
 }
 
 /**
@@ -283,6 +416,7 @@ UdpDriver::stopReaderThread()
     }
     IpAddress address(&socketAddress);
     sendPacket(&address, "Please exit now", 15, NULL);
+    flushTransmitBatch();
 }
 
 // See docs in Driver class.
@@ -329,9 +463,22 @@ UdpDriver::readerThreadMain(UdpDriver* driver)
         Fence::enter();
 
         // Initialize the arguments that will be passed to the kernel call.
-        // Typically, some number of the initial buffers will be invalid
+        // With GRO, the kernel receives into groBuffer. Otherwise,
+        // typically, some number of the initial buffers will be invalid
         // because packets were received if
-        {
+        if (driver->groEnabled) {
+            for (int i = 0; i < PacketBatch::MAX_PACKETS; i++) {
+                struct mmsghdr* header = &batch->messageHeaders[i];
+                GroSlot* slot = &driver->groSlots[i];
+                header->msg_hdr.msg_name = &slot->address;
+                header->msg_hdr.msg_namelen = sizeof(slot->address);
+                header->msg_hdr.msg_iov = &slot->iovec;
+                header->msg_hdr.msg_iovlen = 1;
+                header->msg_hdr.msg_control = slot->control;
+                header->msg_hdr.msg_controllen = sizeof(slot->control);
+                header->msg_hdr.msg_flags = 0;
+            }
+        } else {
             SpinLock::Guard guard(driver->mutex);
             for (int i = 0; i < PacketBatch::MAX_PACKETS; i++) {
                 if (batch->buffers[i] != NULL) {
@@ -366,6 +513,14 @@ UdpDriver::readerThreadMain(UdpDriver* driver)
             }
             continue;
         }
+        if (driver->groEnabled) {
+            numPackets = driver->splitReceivedMessages(batch,
+                    downCast<int>(numPackets));
+        } else {
+            for (int i = 0; i < numPackets; i++) {
+                batch->lengths[i] = batch->messageHeaders[i].msg_len;
+            }
+        }
 
         // Hand this batch off to the dispatch thread.
         Fence::leave();
@@ -374,4 +529,79 @@ UdpDriver::readerThreadMain(UdpDriver* driver)
     }
 }
 
+/**
+ * Called by the reader thread, when GRO is enabled, to copy the packets in
+ * messages that were just received into groSlots out into PacketBufs. If
+ * the kernel coalesced several packets into one message, it says how big
+ * each one is; all but the last are the same size.
+ *
+ * \param batch
+ *      Batch whose messageHeaders describe the messages that were received;
+ *      its buffers and lengths are filled in with the individual packets.
+ * \param numMessages
+ *      Number of messages that were received.
+ * \return
+ *      The number of packets in batch.
+ */
+int
+UdpDriver::splitReceivedMessages(PacketBatch* batch, int numMessages)
+{
+    int numPackets = 0;
+    for (int i = 0; i < numMessages; i++) {
+        struct msghdr* msg = &batch->messageHeaders[i].msg_hdr;
+        uint32_t length = batch->messageHeaders[i].msg_len;
+        uint32_t segmentSize = length;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+                cmsg = CMSG_NXTHDR(msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                int size;
+                memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+                if (size > 0)
+                    segmentSize = size;
+            }
+        }
+        int segments = 1;
+        if (segmentSize != 0) {
+            segments = downCast<int>((length + segmentSize - 1) /
+                    segmentSize);
+            segments = std::max(segments, 1);
+        }
+        if (numPackets + segments > PacketBatch::MAX_SPLIT_PACKETS) {
+            // Shouldn't happen: the kernel never coalesces more than
+            // MAX_SEGMENTS packets.
+            LOG(WARNING, "UdpDriver dropping %d coalesced packets",
+                    segments);
+            continue;
+        }
+
+        {
+            SpinLock::Guard guard(mutex);
+            for (int j = 0; j < segments; j++) {
+                PacketBuf* buffer = packetBufPool.construct();
+                buffer->sender.construct(
+                        static_cast<const sockaddr*>(msg->msg_name));
+                batch->buffers[numPackets + j] = buffer;
+            }
+        }
+
+        const char* data = static_cast<const char*>(msg->msg_iov->iov_base);
+        uint32_t offset = 0;
+        for (int j = 0; j < segments; j++) {
+            uint32_t packetLength = std::min(segmentSize, length - offset);
+
+            // Packets too big for a PacketBuf are truncated, just as they
+            // are when the kernel receives into PacketBufs directly.
+            uint32_t copied = packetLength;
+            if (copied > MAX_PAYLOAD_SIZE)
+                copied = MAX_PAYLOAD_SIZE;
+            memcpy(batch->buffers[numPackets]->payload, data + offset,
+                    copied);
+            batch->lengths[numPackets] = copied;
+            numPackets++;
+            offset += packetLength;
+        }
+    }
+    return numPackets;
+}
+
 } // namespace RAMCloud
@@ -17,6 +17,7 @@
 #define RAMCLOUD_UDPDRIVER_H
 
 #include <sys/socket.h>
+#include <memory>
 #include <vector>
 
 #include "Dispatch.h"
@@ -33,6 +34,18 @@ namespace RAMCloud {
 /**
  * A Driver for kernel-provided UDP communication.  Simple packet send/receive
  * style interface. See Driver for more detail.
+ *
+ * To keep per-packet system call costs down, outgoing packets are not sent
+ * immediately: sendPacket adds them to a batch that is handed to the kernel
+ * with a single sendmmsg call at the next pass through the dispatcher's
+ * polling loop (or sooner, if the batch fills up). If the "gso=1" locator
+ * option is given and the kernel supports UDP generic segmentation offload
+ * (GSO), consecutive packets of the same size to the same destination are
+ * passed as a single message that the kernel splits into datagrams. If the
+ * "gro=1" locator option is given, the reader thread also asks for generic
+ * receive offload (GRO) and splits coalesced datagrams back into individual
+ * packets (this costs a copy of each received packet). Both are off by
+ * default.
  */
 class UdpDriver : public Driver {
   public:
@@ -59,9 +72,34 @@ class UdpDriver : public Driver {
     }
 
   PROTECTED:
+    /// Largest number of datagrams the kernel will coalesce into a single
+    /// message with GSO or GRO (UDP_MAX_SEGMENTS in the kernel).
+    static const int MAX_SEGMENTS = 64;
+
+    /// Largest message the kernel will segment with GSO or produce with
+    /// GRO (the largest UDP payload).
+    static const uint32_t MAX_SEGMENTED_SIZE = 65507;
+
+    void flushTransmitBatch();
     static void readerThreadMain(UdpDriver* driver);
     void stopReaderThread();
 
+    /**
+     * Causes the transmit batch to be flushed during each iteration through
+     * the dispatch poller loop.
+     */
+    class Poller : public Dispatch::Poller {
+      public:
+        explicit Poller(Context* context, UdpDriver* driver)
+            : Dispatch::Poller(context->dispatch, "UdpDriver::Poller")
+            , driver(driver) { }
+        virtual int poll();
+      private:
+        // Driver on whose behalf this poller operates.
+        UdpDriver* driver;
+        DISALLOW_COPY_AND_ASSIGN(Poller);
+    };
+
     struct PacketBuf : Driver::PacketBuf<IpAddress, MAX_PAYLOAD_SIZE> {
         PacketBuf()
             : Driver::PacketBuf<IpAddress, MAX_PAYLOAD_SIZE>()
@@ -78,11 +116,14 @@ class UdpDriver : public Driver {
      * packets from the background thread to UdpDriver:: receivePackets.
      */
     struct PacketBatch {
-        /// Maximum number of packets that this structure can hold at
-        /// once; this is also the maximum number of packets we can receive
-        /// from the kernel in a single kernel call.
+        /// Maximum number of messages we can receive from the kernel in a
+        /// single kernel call. Without GRO, each message is one packet.
         static const int MAX_PACKETS = 10;
 
+        /// Maximum number of packets that this structure can hold at once,
+        /// once messages coalesced by GRO have been split up.
+        static const int MAX_SPLIT_PACKETS = MAX_PACKETS * MAX_SEGMENTS;
+
         /// Number of packets that have were received from the kernel.
         /// 0 means all of the packets in the last batch have been returned by
         /// receivePackets; it's now up to the background thread to receive
@@ -100,26 +141,120 @@ class UdpDriver : public Driver {
         /// recvmmsg; see the man page for that kernel call for details.
         struct mmsghdr messageHeaders[MAX_PACKETS];
 
-        /// Entries in this array correspond to those in messageHeaders; they
-        /// hold the buffers that will be returned to transports.  NULL means
-        /// no PacketBuf has been allocated in that slot; it also means that
-        /// the corresponding slot in messageHeaders is uninitialized. If there
-        /// are NULL entries, they are always adjacent and occupy the first
-        /// slots in the array.
-        PacketBuf* buffers[MAX_PACKETS];
+        /// Hold the buffers that will be returned to transports. Without
+        /// GRO, the first MAX_PACKETS entries in this array correspond to
+        /// those in messageHeaders and the kernel receives directly into
+        /// them: NULL means no PacketBuf has been allocated in that slot; it
+        /// also means that the corresponding slot in messageHeaders is
+        /// uninitialized. If there are NULL entries, they are always adjacent
+        /// and occupy the first slots in the array. With GRO, the kernel
+        /// receives into groBuffer instead, and the reader thread fills in
+        /// buffers with the individual packets.
+        PacketBuf* buffers[MAX_SPLIT_PACKETS];
+
+        /// Length of the packet in the corresponding entry of buffers.
+        uint32_t lengths[MAX_SPLIT_PACKETS];
 
         PacketBatch()
             : packetsAvailable(0)
             , packetsRemoved(0)
             , messageHeaders()
             , buffers()
+            , lengths()
         {
-            for (int i = 0; i < MAX_PACKETS; i++) {
+            for (int i = 0; i < MAX_SPLIT_PACKETS; i++) {
                 buffers[i] = NULL;
             }
         }
     };
 
+    int splitReceivedMessages(PacketBatch* batch, int numMessages);
+
+    /**
+     * Used by the reader thread, when GRO is enabled, to receive a message
+     * that may hold several coalesced packets. Entries in groSlots
+     * correspond to those in PacketBatch::messageHeaders.
+     */
+    struct GroSlot {
+        GroSlot()
+            : address()
+            , iovec()
+            , control()
+        {}
+
+        /// Where the kernel places the sender's address.
+        sockaddr address;
+
+        /// Describes this slot's part of groBuffer.
+        struct iovec iovec;
+
+        /// Where the kernel places the size of the coalesced packets.
+        char control[CMSG_SPACE(sizeof(int))];
+    };
+
+    /**
+     * Packets passed to sendPacket that haven't yet been handed to the
+     * kernel. Each message describes either a single packet or, with GSO,
+     * several consecutive packets to the same destination that all have the
+     * same length (except that the last one may be shorter).
+     */
+    struct TransmitBatch {
+        /// Maximum number of packets in a batch; once this many have been
+        /// queued the batch is flushed.
+        static const int MAX_PACKETS = 32;
+
+        TransmitBatch()
+            : numPackets(0)
+            , numMessages(0)
+            , packetBytes(0)
+            , messages()
+            , addresses()
+            , segmentSizes()
+            , segments()
+            , messageBytes()
+            , control()
+            , iovecs()
+            , packetSpace()
+        {}
+
+        /// Number of packets in the batch.
+        int numPackets;
+
+        /// Number of entries of messages that are in use.
+        int numMessages;
+
+        /// Number of bytes of packetSpace that are in use.
+        uint32_t packetBytes;
+
+        /// Arguments for sendmmsg.
+        struct mmsghdr messages[MAX_PACKETS];
+
+        /// Destination of the corresponding entry in messages.
+        sockaddr addresses[MAX_PACKETS];
+
+        /// Length of the first packet in the corresponding message; with
+        /// GSO, the kernel splits the message into datagrams of this size.
+        uint32_t segmentSizes[MAX_PACKETS];
+
+        /// Number of packets in the corresponding message.
+        int segments[MAX_PACKETS];
+
+        /// Total number of bytes in the corresponding message.
+        uint32_t messageBytes[MAX_PACKETS];
+
+        /// Holds the UDP_SEGMENT control message for each message that
+        /// contains more than one packet.
+        char control[MAX_PACKETS][CMSG_SPACE(sizeof(uint16_t))];
+
+        /// Describes the data for the corresponding message: the packets
+        /// in a message are copied next to each other in packetSpace.
+        struct iovec iovecs[MAX_PACKETS];
+
+        /// Copies of the packets in the batch (headers and payloads), since
+        /// callers of sendPacket need not preserve either.
+        char packetSpace[MAX_PACKETS * MAX_PAYLOAD_SIZE];
+    };
+
     /// Shared RAMCloud information.
     Context* context;
 
@@ -171,6 +306,29 @@ class UdpDriver : public Driver {
     /// will exit immediately.
     bool readerThreadExit;
 
+    /// Packets waiting to be handed to the kernel; see sendPacket.
+    TransmitBatch transmitBatch;
+
+    /// True means the kernel supports UDP GSO on this socket, so consecutive
+    /// packets of the same size to the same destination are sent as a
+    /// single message. Enabled with the "gso=1" locator option.
+    bool gsoEnabled;
+
+    /// True means UDP_GRO is set on the socket, so the reader thread
+    /// receives into groBuffer. Enabled with the "gro=1" locator
+    /// option.
+    bool groEnabled;
+
+    /// Used by the reader thread to receive messages if groEnabled.
+    GroSlot groSlots[PacketBatch::MAX_PACKETS];
+
+    /// Holds MAX_SEGMENTED_SIZE bytes for each of groSlots; allocated only
+    /// if groEnabled.
+    std::unique_ptr<char[]> groBuffer;
+
+    /// Flushes transmitBatch during the dispatch polling loop.
+    Poller poller;
+
     DISALLOW_COPY_AND_ASSIGN(UdpDriver);
 };
 
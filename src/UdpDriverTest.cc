@@ -13,6 +13,8 @@
  * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <netinet/udp.h>
+
 #include "TestUtil.h"
 #include "MockSyscall.h"
 #include "Tub.h"
@@ -58,11 +60,13 @@ class UdpDriverTest : public ::testing::Test {
 
     // Used to wait for data to arrive on a driver by invoking the
     // dispatcher's receivePackets method; gives up if a long time
-    // goes by with no data. Returns the contents of all the incoming
-    // packets, separated by commas.
+    // goes by with no data. The dispatcher is polled along the way, so
+    // that packets queued by sendPacket get sent. Returns the contents
+    // of all the incoming packets, separated by commas.
     string receivePackets(UdpDriver* driver, int maxPackets = 5) {
         std::vector<Driver::Received> receivedPackets;
         for (int i = 0; i < 1000; i++) {
+            context.dispatch->poll();
             driver->receivePackets(maxPackets, &receivedPackets);
             if (receivedPackets.size() > 0) {
                 break;
@@ -129,6 +133,24 @@ TEST_F(UdpDriverTest, constructor_gbsOption) {
     EXPECT_EQ(2800u, driver2.maxTransmitQueueSize);
     Cycles::mockCyclesPerSec = 0;
 }
+TEST_F(UdpDriverTest, constructor_gsoAndGroOptions) {
+    // GSO and GRO are off unless asked for.
+    ServiceLocator locator("udp: host=localhost, port=8101");
+    UdpDriver driver(&context, &locator);
+    EXPECT_FALSE(driver.gsoEnabled);
+    EXPECT_FALSE(driver.groEnabled);
+    EXPECT_FALSE(driver.groBuffer);
+}
+TEST_F(UdpDriverTest, constructor_noKernelSupportForGsoOrGro) {
+    sys->setsockoptErrno = ENOPROTOOPT;
+    ServiceLocator locator("udp: host=localhost, port=8101, gso=1, gro=1");
+    TestLog::reset();
+    UdpDriver driver(&context, &locator);
+    EXPECT_FALSE(driver.gsoEnabled);
+    EXPECT_FALSE(driver.groEnabled);
+    EXPECT_TRUE(TestUtil::contains(TestLog::get(),
+            "UdpDriver GSO disabled, GRO disabled"));
+}
 TEST_F(UdpDriverTest, constructor_errorInSocketCall) {
     sys->socketErrno = EPERM;
     try {
@@ -232,6 +254,7 @@ TEST_F(UdpDriverTest, receivePackets_receivePartialBatches) {
     client.sendPacket(&serverAddress, "packet4", 7, NULL);
     client.sendPacket(&serverAddress, "packet5", 7, NULL);
     client.sendPacket(&serverAddress, "packet6", 7, NULL);
+    client.flushTransmitBatch();
 
     // Receive packets in 3 separate calls to receivePackets.
     server.packetBatches[1].packetsAvailable = 0;
@@ -285,14 +308,116 @@ TEST_F(UdpDriverTest, sendPacket_multipleChunks) {
     EXPECT_EQ("header:yzzy0123456789abc", receivePackets(&server));
 }
 
-TEST_F(UdpDriverTest, sendPacket_errorInSend) {
-    sys->sendmsgErrno = EPERM;
-    Buffer message;
-    message.appendExternal("xyzzy", 5);
-    Buffer::Iterator iterator(&message);
-    client.sendPacket(&serverAddress, "header:", 7, &iterator);
-    EXPECT_EQ("sendPacket: UdpDriver error sending to socket: "
+TEST_F(UdpDriverTest, sendPacket_batching) {
+    client.gsoEnabled = false;
+    sendMessage(&client, &serverAddress, "header:", "abc");
+    client.sendPacket(&serverAddress, "packet2", 7, NULL);
+    EXPECT_EQ(2, client.transmitBatch.numPackets);
+    EXPECT_EQ(2, client.transmitBatch.numMessages);
+    EXPECT_EQ(17u, client.transmitBatch.packetBytes);
+
+    client.flushTransmitBatch();
+    EXPECT_EQ(0, client.transmitBatch.numPackets);
+    EXPECT_EQ(0, client.transmitBatch.numMessages);
+    EXPECT_EQ(0u, client.transmitBatch.packetBytes);
+    EXPECT_EQ("header:abc", receivePackets(&server, 1));
+    EXPECT_EQ("packet2", receivePackets(&server, 1));
+}
+
+TEST_F(UdpDriverTest, sendPacket_flushWhenBatchFull) {
+    client.gsoEnabled = false;
+    for (int i = 1; i < UdpDriver::TransmitBatch::MAX_PACKETS; i++) {
+        client.sendPacket(&serverAddress, "packet", 6, NULL);
+    }
+    EXPECT_EQ(UdpDriver::TransmitBatch::MAX_PACKETS - 1,
+            client.transmitBatch.numPackets);
+    client.sendPacket(&serverAddress, "packet", 6, NULL);
+    EXPECT_EQ(0, client.transmitBatch.numPackets);
+}
+
+TEST_F(UdpDriverTest, sendPacket_gsoSegments) {
+    // Stall the reader thread, so that everything sent below arrives
+    // in a single batch.
+    server.packetBatches[1].packetsAvailable = 2;
+    client.sendPacket(&serverAddress, "packet0", 7, NULL);
+    EXPECT_EQ("packet0", receivePackets(&server));
+
+    // Packets to the same place can share a message as long as none is
+    // bigger than the first and only the last is smaller.
+    client.gsoEnabled = true;
+    ServiceLocator otherLocator("udp: host=localhost, port=8101");
+    IpAddress otherAddress(&otherLocator);
+    client.sendPacket(&serverAddress, "packet1", 7, NULL);
+    client.sendPacket(&serverAddress, "packet2", 7, NULL);
+    client.sendPacket(&serverAddress, "pkt3", 4, NULL);
+    client.sendPacket(&serverAddress, "packet4", 7, NULL);
+    client.sendPacket(&serverAddress, "packet5", 7, NULL);
+    client.sendPacket(&otherAddress, "packet6", 7, NULL);
+    client.sendPacket(&serverAddress, "longPacket7", 11, NULL);
+    client.sendPacket(&serverAddress, "packet8", 7, NULL);
+    UdpDriver::TransmitBatch* batch = &client.transmitBatch;
+    EXPECT_EQ(8, batch->numPackets);
+    ASSERT_EQ(4, batch->numMessages);
+    EXPECT_EQ(3, batch->segments[0]);
+    EXPECT_EQ(7u, batch->segmentSizes[0]);
+    EXPECT_EQ(18u, batch->messageBytes[0]);
+    EXPECT_EQ(2, batch->segments[1]);
+    EXPECT_EQ(1lu, batch->messages[1].msg_hdr.msg_iovlen);
+    EXPECT_EQ(14lu, batch->iovecs[1].iov_len);
+    EXPECT_EQ(1, batch->segments[2]);
+    EXPECT_EQ(2, batch->segments[3]);
+    EXPECT_EQ(11u, batch->segmentSizes[3]);
+
+    // The receiver sees the packets just as they were sent.
+    client.flushTransmitBatch();
+    server.packetBatches[1].packetsAvailable = 0;
+    EXPECT_EQ("packet1, packet2, pkt3, packet4, packet5, longPacket7, "
+            "packet8", receivePackets(&server, 10));
+}
+
+TEST_F(UdpDriverTest, flushTransmitBatch_errorInSend) {
+    sys->sendmmsgErrno = EPERM;
+    client.gsoEnabled = false;
+    client.sendPacket(&serverAddress, "packet1", 7, NULL);
+    client.sendPacket(&serverAddress, "packet2", 7, NULL);
+    client.flushTransmitBatch();
+    EXPECT_EQ("flushTransmitBatch: UdpDriver error sending to socket: "
             "Operation not permitted", TestLog::get());
+    EXPECT_EQ(0, client.transmitBatch.numMessages);
+
+    // Only the message that failed is lost.
+    EXPECT_EQ("packet2", receivePackets(&server));
+}
+
+TEST_F(UdpDriverTest, flushTransmitBatch_gsoNotSupported) {
+    sys->sendmmsgErrno = EIO;
+    client.gsoEnabled = true;
+    client.sendPacket(&serverAddress, "packet1", 7, NULL);
+    client.sendPacket(&serverAddress, "packet2", 7, NULL);
+    client.flushTransmitBatch();
+    EXPECT_EQ("flushTransmitBatch: UdpDriver error sending to socket: "
+            "Input/output error | "
+            "flushTransmitBatch: UdpDriver disabling GSO", TestLog::get());
+    EXPECT_FALSE(client.gsoEnabled);
+}
+
+TEST_F(UdpDriverTest, flushTransmitBatch_closed) {
+    client.sendPacket(&serverAddress, "packet1", 7, NULL);
+    int fd = client.socketFd;
+    client.socketFd = -1;
+    client.flushTransmitBatch();
+    client.socketFd = fd;
+    EXPECT_EQ(0, client.transmitBatch.numMessages);
+    EXPECT_EQ("", TestLog::get());
+}
+
+TEST_F(UdpDriverTest, poller) {
+    EXPECT_EQ(0, client.poller.poll());
+    client.sendPacket(&serverAddress, "packet1", 7, NULL);
+    EXPECT_EQ(1, client.poller.poll());
+    EXPECT_EQ(0, client.transmitBatch.numMessages);
+    EXPECT_EQ(0, client.poller.poll());
+    EXPECT_EQ("packet1", receivePackets(&server));
 }
 
 TEST_F(UdpDriverTest, stopReaderThread_basics) {
@@ -322,6 +447,7 @@ TEST_F(UdpDriverTest, readerThreadMain_waitForDispatchThread) {
     // The server should now be stuck waiting for batch 1 to become
     // available, so it shouldn't receive the following packet.
     client.sendPacket(&serverAddress, "packet2", 7, NULL);
+    client.flushTransmitBatch();
     usleep(1000);
     EXPECT_TRUE(TestUtil::contains(TestLog::get(), "not keeping up"));
     EXPECT_EQ(2, server.packetBatches[1].packetsAvailable);
@@ -348,12 +474,40 @@ TEST_F(UdpDriverTest, readerThreadMain_exitWhileWaitingForDispatchThread) {
     EXPECT_TRUE(TestUtil::contains(TestLog::get(), "reader thread exited"));
 }
 TEST_F(UdpDriverTest, readerThreadMain_initializeMsgHdrs) {
-    client.sendPacket(&serverAddress, "packet1", 7, NULL);
-    EXPECT_EQ("packet1", receivePackets(&server));
-    EXPECT_EQ(20lu, server.packetBufPool.outstandingObjects);
-    EXPECT_TRUE(server.packetBatches[0].buffers[0] == NULL);
-    EXPECT_FALSE(server.packetBatches[0].buffers[1] == NULL);
-    EXPECT_FALSE(server.packetBatches[1].buffers[0] == NULL);
+    // Without GRO, the kernel receives directly into PacketBufs.
+    ServiceLocator locator("udp: host=localhost, port=8101");
+    UdpDriver server2(&context, &locator);
+    IpAddress address(&locator);
+    client.sendPacket(&address, "packet1", 7, NULL);
+    EXPECT_EQ("packet1", receivePackets(&server2));
+    EXPECT_EQ(20lu, server2.packetBufPool.outstandingObjects);
+    EXPECT_TRUE(server2.packetBatches[0].buffers[0] == NULL);
+    EXPECT_FALSE(server2.packetBatches[0].buffers[1] == NULL);
+    EXPECT_FALSE(server2.packetBatches[1].buffers[0] == NULL);
+
+    // recv holds one of server2's PacketBufs; return it before server2
+    // goes away.
+    delete recv;
+    recv = NULL;
+}
+TEST_F(UdpDriverTest, readerThreadMain_gro) {
+    // With GRO, PacketBufs are allocated only for packets that arrive.
+    ServiceLocator locator("udp: host=localhost, port=8101, gro=1");
+    UdpDriver server2(&context, &locator);
+    if (!server2.groEnabled) {
+        return;
+    }
+    IpAddress address(&locator);
+    client.sendPacket(&address, "packet1", 7, NULL);
+    EXPECT_EQ("packet1", receivePackets(&server2));
+    EXPECT_EQ(1lu, server2.packetBufPool.outstandingObjects);
+    EXPECT_TRUE(server2.packetBatches[0].buffers[0] == NULL);
+    EXPECT_TRUE(server2.packetBatches[0].buffers[1] == NULL);
+
+    // recv holds one of server2's PacketBufs; return it before server2
+    // goes away.
+    delete recv;
+    recv = NULL;
 }
 TEST_F(UdpDriverTest, readerThreadMain_errorInRecvmmsg) {
     sys->recvmmsgErrno = EPERM;
@@ -369,4 +523,45 @@ TEST_F(UdpDriverTest, readerThreadMain_errorInRecvmmsg) {
     EXPECT_EQ("packet2", receivePackets(&server));
 }
 
+TEST_F(UdpDriverTest, splitReceivedMessages) {
+    UdpDriver::PacketBatch batch;
+    char data[] = "packet1packet2pkt3response";
+    struct iovec iovecs[2] = {{data, 18}, {data + 18, 8}};
+    for (int i = 0; i < 2; i++) {
+        struct msghdr* msg = &batch.messageHeaders[i].msg_hdr;
+        memset(msg, 0, sizeof(*msg));
+        msg->msg_name = &serverAddress.address;
+        msg->msg_iov = &iovecs[i];
+        msg->msg_iovlen = 1;
+        batch.messageHeaders[i].msg_len =
+                downCast<uint32_t>(iovecs[i].iov_len);
+    }
+
+    // The first message holds three packets coalesced by the kernel.
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr* msg = &batch.messageHeaders[0].msg_hdr;
+    msg->msg_control = control;
+    msg->msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_GRO;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    int segmentSize = 7;
+    memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+
+    ASSERT_EQ(4, server.splitReceivedMessages(&batch, 2));
+    string result;
+    for (int i = 0; i < 4; i++) {
+        if (i != 0) {
+            result.append(", ");
+        }
+        result.append(batch.buffers[i]->payload, batch.lengths[i]);
+        EXPECT_EQ(serverAddress.toString(),
+                batch.buffers[i]->sender->toString());
+        server.release(batch.buffers[i]->payload);
+        batch.buffers[i] = NULL;
+    }
+    EXPECT_EQ("packet1, packet2, pkt3, response", result);
+}
+
 }  // namespace RAMCloud
@@ -75,6 +75,7 @@ opcodeSymbol(uint32_t opcode)
         case MULTI_OP:                     return "MULTI_OP";
         case GET_METRICS:                  return "GET_METRICS";
         case BACKUP_FREE:                  return "BACKUP_FREE";
+        case BACKUP_GETFRAGMENT:           return "BACKUP_GETFRAGMENT";
         case BACKUP_GETRECOVERYDATA:       return "BACKUP_GETRECOVERYDATA";
         case BACKUP_STARTREADINGDATA:      return "BACKUP_STARTREADINGDATA";
         case BACKUP_WRITE:                 return "BACKUP_WRITE";
@@ -180,7 +181,8 @@ bool
 operator==(const Recover::Replica& a, const Recover::Replica& b)
 {
     return (a.backupId == b.backupId &&
-            a.segmentId == b.segmentId);
+            a.segmentId == b.segmentId &&
+            a.fragment == b.fragment);
 }
 
 /**
@@ -198,8 +200,10 @@ operator!=(const Recover::Replica& a, const Recover::Replica& b)
 std::ostream&
 operator<<(std::ostream& stream, const Recover::Replica& replica) {
     stream << "Replica(backupId=" << replica.backupId
-           << ", segmentId=" << replica.segmentId
-           << ")";
+           << ", segmentId=" << replica.segmentId;
+    if (replica.fragment)
+        stream << ", fragment";
+    stream << ")";
     return stream;
 }
 
@@ -129,7 +129,8 @@ enum Opcode {
     TX_PREPARE                  = 77,
     TX_REQUEST_ABORT            = 78,
     TX_HINT_FAILED              = 79,
-    ILLEGAL_RPC_TYPE            = 80, // 1 + the highest legitimate Opcode
+    BACKUP_GETFRAGMENT          = 80,
+    ILLEGAL_RPC_TYPE            = 81, // 1 + the highest legitimate Opcode
 };
 
 /**
@@ -151,8 +152,21 @@ enum ControlOp {
     LOG_MESSAGE                 = 1010,
     RESET_METRICS               = 1011,
     QUIESCE                     = 1012,
+    SET_TABLE_COMPRESSION       = 1013,
 };
 
+/**
+ * Input for the SET_TABLE_COMPRESSION control op, which turns value
+ * compression on or off for one table on a master (see
+ * ObjectManager::setTableCompression). Send it with serverControlAll so
+ * that every master holding part of the table gets it.
+ */
+struct SetTableCompression {
+    uint64_t tableId;           /// Table whose setting is changed.
+    uint8_t enabled;            /// Nonzero to compress values written from
+                                /// now on, zero to stop.
+} __attribute__((packed));
+
 /**
  * Used in linearizable RPCs to check whether or not the RPC can be processed.
  */
@@ -250,6 +264,40 @@ struct BackupFree {
     } __attribute__((packed));
 };
 
+struct BackupGetFragment {
+    static const Opcode opcode = BACKUP_GETFRAGMENT;
+    static const ServiceType service = BACKUP_SERVICE;
+    struct Request {
+        RequestCommonWithId common;
+        uint64_t recoveryId;    ///< Identifies the recovery for which the
+                                ///< fragment is requested.
+        uint64_t masterId;      ///< Server Id of the crashed master whose
+                                ///< segment the fragment belongs to.
+        uint64_t segmentId;     ///< Segment the fragment belongs to.
+    } __attribute__((packed));
+    struct Response {
+        Response()
+            : common()
+            , certificate()
+            , dataFragments()
+            , parityFragments()
+            , fragmentIndex()
+            , length()
+        {}
+        ResponseCommon common;
+        SegmentCertificate certificate; ///< Certificate for the whole
+                                        ///< segment, as stored with the
+                                        ///< fragment.
+        uint8_t dataFragments;  ///< Number of data fragments in the code
+                                ///< the fragment is part of.
+        uint8_t parityFragments;///< Number of parity fragments in the code
+                                ///< the fragment is part of.
+        uint8_t fragmentIndex;  ///< Which fragment of the segment this is.
+        uint32_t length;        ///< Number of bytes of fragment data
+                                ///< following this header.
+    } __attribute__((packed));
+};
+
 struct BackupGetRecoveryData {
     static const Opcode opcode = BACKUP_GETRECOVERYDATA;
     static const ServiceType service = BACKUP_SERVICE;
@@ -260,16 +308,29 @@ struct BackupGetRecoveryData {
         uint64_t masterId;      ///< Server Id from whom the request is coming.
         uint64_t segmentId;     ///< Target segment to get data from.
         uint64_t partitionId;   ///< Partition id of :ecovery segment to fetch.
+        uint32_t fragmentSourceCount; ///< If the backup only has a fragment
+                                ///< of the segment, the number of other
+                                ///< backups that hold fragments of it and
+                                ///< which it may fetch them from to rebuild
+                                ///< the segment. That many 64-bit server ids
+                                ///< follow this header.
+        uint32_t offset;        ///< Offset in the recovery segment of the
+                                ///< first byte to return.
+        uint32_t maxLength;     ///< Return at most this many bytes of the
+                                ///< recovery segment; 0 means no limit.
     } __attribute__((packed));
     struct Response {
         Response()
             : common()
             , certificate()
+            , segmentLength()
         {}
         Response(const ResponseCommon& common,
-                 const SegmentCertificate& certificate)
+                 const SegmentCertificate& certificate,
+                 uint32_t segmentLength)
             : common(common)
             , certificate(certificate)
+            , segmentLength(segmentLength)
         {}
         ResponseCommon common;
         SegmentCertificate certificate; ///< Certificate for the segment
@@ -277,6 +338,9 @@ struct BackupGetRecoveryData {
                                         ///< the response field. Used by
                                         ///< master to iterate over the
                                         ///< segment.
+        uint32_t segmentLength;         ///< Total length of the recovery
+                                        ///< segment, of which only the
+                                        ///< requested range follows.
     } __attribute__((packed));
 };
 
@@ -344,15 +408,31 @@ struct BackupStartReadingData {
                                    ///< closed on the backup. If it was it
                                    ///< is inherently consistent and can be
                                    ///< used without scrutiny during recovery.
-        Replica(uint64_t segmentId, uint64_t segmentEpoch, bool closed)
+        uint8_t dataFragments;     ///< If nonzero, the replica is only a
+                                   ///< fragment of the segment, which can be
+                                   ///< rebuilt from any dataFragments of its
+                                   ///< fragments. See ReedSolomon.
+        uint8_t parityFragments;   ///< Number of parity fragments the segment
+                                   ///< was encoded with, if a fragment.
+        uint8_t fragmentIndex;     ///< Which fragment of the segment the
+                                   ///< replica is, if a fragment.
+        Replica(uint64_t segmentId, uint64_t segmentEpoch, bool closed,
+                uint8_t dataFragments = 0, uint8_t parityFragments = 0,
+                uint8_t fragmentIndex = 0)
             : segmentId(segmentId)
             , segmentEpoch(segmentEpoch)
             , closed(closed)
+            , dataFragments(dataFragments)
+            , parityFragments(parityFragments)
+            , fragmentIndex(fragmentIndex)
         {}
         friend bool operator==(const Replica& left, const Replica& right) {
             return left.segmentId == right.segmentId &&
                    left.segmentEpoch == right.segmentEpoch &&
-                   left.closed == right.closed;
+                   left.closed == right.closed &&
+                   left.dataFragments == right.dataFragments &&
+                   left.parityFragments == right.parityFragments &&
+                   left.fragmentIndex == right.fragmentIndex;
         }
     } __attribute__((packed));
 };
@@ -393,6 +473,9 @@ struct BackupWrite {
             , primary()
             , certificateIncluded()
             , certificate()
+            , dataFragments()
+            , parityFragments()
+            , fragmentIndex()
         {}
         Request(const RequestCommonWithId& common,
                 uint64_t masterId,
@@ -416,6 +499,9 @@ struct BackupWrite {
             , primary(primary)
             , certificateIncluded(certificateIncluded)
             , certificate(certificate)
+            , dataFragments()
+            , parityFragments()
+            , fragmentIndex()
         {}
         RequestCommonWithId common;
         uint64_t masterId;        ///< Server from whom the request is coming.
@@ -439,6 +525,15 @@ struct BackupWrite {
                                         ///< written to storage
                                         ///< following the data included
                                         ///< in this rpc.
+        uint8_t dataFragments;    ///< If nonzero, the replica is fragment
+                                  ///< #fragmentIndex of the segment encoded
+                                  ///< with this many data fragments and
+                                  ///< #parityFragments parity fragments
+                                  ///< (see ReedSolomon), rather than a
+                                  ///< copy of the segment. #certificate
+                                  ///< still describes the whole segment.
+        uint8_t parityFragments;  ///< See #dataFragments.
+        uint8_t fragmentIndex;    ///< See #dataFragments.
         // Opaque byte string follows with data to write.
     } __attribute__((packed));
     struct Response {
@@ -1354,6 +1449,16 @@ struct Recover {
      * Where to find a replica for a particular segment.
      */
     struct Replica {
+        Replica()
+            : backupId()
+            , segmentId()
+            , fragment()
+        {}
+        Replica(uint64_t backupId, uint64_t segmentId, bool fragment = false)
+            : backupId(backupId)
+            , segmentId(segmentId)
+            , fragment(fragment)
+        {}
         /**
          * The backup storing the replica.
          */
@@ -1362,6 +1467,13 @@ struct Recover {
          * The ID of the segment.
          */
         uint64_t segmentId;
+        /**
+         * True if the backup only stores a fragment of the segment. It can
+         * still provide recovery segments for it, but must fetch other
+         * fragments from the rest of the backups listed for the segment
+         * to do so.
+         */
+        bool fragment;
         friend bool operator==(const Replica&, const Replica&);
         friend bool operator!=(const Replica&, const Replica&);
         friend std::ostream& operator<<(std::ostream& stream, const Replica&);
@@ -447,6 +447,7 @@ WorkerManager::workerMain(Worker* worker)
             lastIdle = current;
         }
         TEST_LOG("exiting");
+        PerfStats::unregisterStats(&PerfStats::threadStats);
     } catch (std::exception& e) {
         LOG(ERROR, "worker: %s", e.what());
         throw; // will likely call std::terminate()